@@ -4,8 +4,18 @@
 #include <unistd.h>
 #include <assert.h>
 #include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+
+#include <openssl/evp.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AESNI_INTRINSICS
+#endif
 
 #include "zeek/util.h"
+#include "zeek/digest.h"
 #include "zeek/net_util.h"
 #include "zeek/Val.h"
 #include "zeek/NetVar.h"
@@ -13,7 +23,9 @@
 #include "zeek/Scope.h"
 #include "zeek/ID.h"
 #include "zeek/IPAddr.h"
+#include "zeek/ZeekString.h"
 #include "zeek/Event.h"
+#include "zeek/3rdparty/doctest.h"
 
 namespace zeek::detail {
 
@@ -359,6 +371,251 @@ AnonymizeIPAddr_A50::Node* AnonymizeIPAddr_A50::find_node(ipaddr32_t a)
 	return nullptr;
 	}
 
+// AES-128 encryption of single blocks, on AES-NI where the CPU has it
+// and through OpenSSL otherwise.
+class AESCipher {
+public:
+	explicit AESCipher(const uint8_t* key);
+	~AESCipher();
+
+	// Encrypts n blocks of 16 bytes each.
+	void Encrypt(const uint8_t* in, uint8_t* out, int n) const;
+
+private:
+#ifdef HAVE_AESNI_INTRINSICS
+	__attribute__((target("aes,sse2"))) void ExpandKey(const uint8_t* key);
+	__attribute__((target("aes,sse2"))) void EncryptAESNI(const uint8_t* in, uint8_t* out, int n) const;
+#endif
+
+	bool use_aesni = false;
+	alignas(16) uint8_t round_keys[11][16];
+	EVP_CIPHER_CTX* ctx = nullptr;
+};
+
+AESCipher::AESCipher(const uint8_t* key)
+	{
+#ifdef HAVE_AESNI_INTRINSICS
+	if ( __builtin_cpu_supports("aes") )
+		{
+		use_aesni = true;
+		ExpandKey(key);
+		return;
+		}
+#endif
+
+	ctx = EVP_CIPHER_CTX_new();
+	EVP_EncryptInit_ex(ctx, EVP_aes_128_ecb(), nullptr, key, nullptr);
+	EVP_CIPHER_CTX_set_padding(ctx, 0);
+	}
+
+AESCipher::~AESCipher()
+	{
+	if ( ctx )
+		EVP_CIPHER_CTX_free(ctx);
+	}
+
+void AESCipher::Encrypt(const uint8_t* in, uint8_t* out, int n) const
+	{
+#ifdef HAVE_AESNI_INTRINSICS
+	if ( use_aesni )
+		{
+		EncryptAESNI(in, out, n);
+		return;
+		}
+#endif
+
+	int len;
+	EVP_EncryptUpdate(ctx, out, &len, in, n * 16);
+	}
+
+#ifdef HAVE_AESNI_INTRINSICS
+
+__attribute__((target("aes,sse2")))
+static __m128i expand_key_step(__m128i key, __m128i assist)
+	{
+	assist = _mm_shuffle_epi32(assist, 0xff);
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, assist);
+	}
+
+void AESCipher::ExpandKey(const uint8_t* key)
+	{
+	__m128i* rk = reinterpret_cast<__m128i*>(round_keys);
+
+	rk[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+
+	// The round constants need to be immediates.
+#define EXPAND(i, rcon) \
+	rk[i] = expand_key_step(rk[i - 1], _mm_aeskeygenassist_si128(rk[i - 1], rcon))
+
+	EXPAND(1, 0x01);
+	EXPAND(2, 0x02);
+	EXPAND(3, 0x04);
+	EXPAND(4, 0x08);
+	EXPAND(5, 0x10);
+	EXPAND(6, 0x20);
+	EXPAND(7, 0x40);
+	EXPAND(8, 0x80);
+	EXPAND(9, 0x1b);
+	EXPAND(10, 0x36);
+
+#undef EXPAND
+	}
+
+void AESCipher::EncryptAESNI(const uint8_t* in, uint8_t* out, int n) const
+	{
+	const __m128i* rk = reinterpret_cast<const __m128i*>(round_keys);
+	auto src = reinterpret_cast<const __m128i*>(in);
+	auto dst = reinterpret_cast<__m128i*>(out);
+	int i = 0;
+
+	// Four blocks at a time, whose rounds can overlap.
+	for ( ; i + 4 <= n; i += 4 )
+		{
+		__m128i b0 = _mm_xor_si128(_mm_loadu_si128(src + i), rk[0]);
+		__m128i b1 = _mm_xor_si128(_mm_loadu_si128(src + i + 1), rk[0]);
+		__m128i b2 = _mm_xor_si128(_mm_loadu_si128(src + i + 2), rk[0]);
+		__m128i b3 = _mm_xor_si128(_mm_loadu_si128(src + i + 3), rk[0]);
+
+		for ( int r = 1; r < 10; ++r )
+			{
+			b0 = _mm_aesenc_si128(b0, rk[r]);
+			b1 = _mm_aesenc_si128(b1, rk[r]);
+			b2 = _mm_aesenc_si128(b2, rk[r]);
+			b3 = _mm_aesenc_si128(b3, rk[r]);
+			}
+
+		_mm_storeu_si128(dst + i, _mm_aesenclast_si128(b0, rk[10]));
+		_mm_storeu_si128(dst + i + 1, _mm_aesenclast_si128(b1, rk[10]));
+		_mm_storeu_si128(dst + i + 2, _mm_aesenclast_si128(b2, rk[10]));
+		_mm_storeu_si128(dst + i + 3, _mm_aesenclast_si128(b3, rk[10]));
+		}
+
+	for ( ; i < n; ++i )
+		{
+		__m128i b = _mm_xor_si128(_mm_loadu_si128(src + i), rk[0]);
+
+		for ( int r = 1; r < 10; ++r )
+			b = _mm_aesenc_si128(b, rk[r]);
+
+		_mm_storeu_si128(dst + i, _mm_aesenclast_si128(b, rk[10]));
+		}
+	}
+
+#endif
+
+AnonymizeIPAddr_CryptoPAn::AnonymizeIPAddr_CryptoPAn(const uint8_t key[32])
+	: cipher(new AESCipher(key))
+	{
+	cipher->Encrypt(key + 16, pad, 1);
+	}
+
+AnonymizeIPAddr_CryptoPAn::~AnonymizeIPAddr_CryptoPAn() = default;
+
+void AnonymizeIPAddr_CryptoPAn::Flips(const uint8_t* addr, int from, int to,
+                                      uint8_t* flips) const
+	{
+	// Up to 128 blocks of input, encrypted in batches.
+	constexpr int BATCH = 16;
+	uint8_t in[BATCH][16];
+	uint8_t out[BATCH][16];
+
+	for ( int start = from; start < to; start += BATCH )
+		{
+		int n = std::min(BATCH, to - start);
+
+		for ( int j = 0; j < n; ++j )
+			{
+			// The first pos bits of the address, then the pad.
+			int pos = start + j;
+			int full = pos / 8;
+			uint8_t mask = 0xff << (8 - pos % 8);
+
+			memcpy(in[j], addr, full);
+			memcpy(in[j] + full, pad + full, 16 - full);
+
+			if ( pos % 8 )
+				in[j][full] = (addr[full] & mask) | (pad[full] & ~mask);
+			}
+
+		cipher->Encrypt(in[0], out[0], n);
+
+		for ( int j = 0; j < n; ++j )
+			{
+			int pos = start + j;
+			flips[pos / 8] |= (out[j][0] >> 7) << (7 - pos % 8);
+			}
+		}
+	}
+
+ipaddr32_t AnonymizeIPAddr_CryptoPAn::anonymize(ipaddr32_t input)
+	{
+	uint8_t addr[16] = { 0 };
+	uint8_t flips[16] = { 0 };
+	memcpy(addr, &input, sizeof(input));
+
+	uint32_t prefix = ntohl(input) >> 8;
+	auto it = cache24.find(prefix);
+
+	if ( it != cache24.end() )
+		memcpy(flips, &it->second, sizeof(uint32_t));
+	else
+		{
+		Flips(addr, 0, 24, flips);
+
+		if ( cache24.size() >= MAX_CACHE_SIZE )
+			cache24.clear();
+
+		uint32_t v;
+		memcpy(&v, flips, sizeof(v));
+		cache24.emplace(prefix, v);
+		}
+
+	Flips(addr, 24, 32, flips);
+
+	uint32_t f;
+	memcpy(&f, flips, sizeof(f));
+	return input ^ f;
+	}
+
+bool AnonymizeIPAddr_CryptoPAn::Anonymize6(const uint32_t* input, uint32_t* output)
+	{
+	uint8_t addr[16];
+	uint8_t flips[16] = { 0 };
+	memcpy(addr, input, sizeof(addr));
+
+	uint64_t prefix = 0;
+
+	for ( int i = 0; i < 6; ++i )
+		prefix = (prefix << 8) | addr[i];
+
+	auto it = cache48.find(prefix);
+
+	if ( it != cache48.end() )
+		memcpy(flips, &it->second, 6);
+	else
+		{
+		Flips(addr, 0, 48, flips);
+
+		if ( cache48.size() >= MAX_CACHE_SIZE )
+			cache48.clear();
+
+		uint64_t v = 0;
+		memcpy(&v, flips, 6);
+		cache48.emplace(prefix, v);
+		}
+
+	Flips(addr, 48, 128, flips);
+
+	for ( int i = 0; i < 16; ++i )
+		addr[i] ^= flips[i];
+
+	memcpy(output, addr, sizeof(addr));
+	return true;
+	}
+
 static TableValPtr anon_preserve_orig_addr;
 static TableValPtr anon_preserve_resp_addr;
 static TableValPtr anon_preserve_other_addr;
@@ -371,6 +628,22 @@ void init_ip_addr_anonymizers()
 	ip_anonymizer[PREFIX_PRESERVING_A50] = new AnonymizeIPAddr_A50();
 	ip_anonymizer[PREFIX_PRESERVING_MD5] = new AnonymizeIPAddr_PrefixMD5();
 
+	// A key of other than 32 bytes gets hashed into one, and without a
+	// key, a random one gets used.
+	uint8_t key[32];
+	auto key_id = global_scope()->Find("cryptopan_key");
+	const String* key_str = key_id && key_id->GetVal() ? key_id->GetVal()->AsString() : nullptr;
+
+	if ( key_str && key_str->Len() == sizeof(key) )
+		memcpy(key, key_str->Bytes(), sizeof(key));
+	else if ( key_str && key_str->Len() > 0 )
+		calculate_digest(Hash_SHA256, key_str->Bytes(), key_str->Len(), key);
+	else
+		for ( auto& k : key )
+			k = static_cast<uint8_t>(util::detail::random_number());
+
+	ip_anonymizer[PREFIX_PRESERVING_CRYPTOPAN] = new AnonymizeIPAddr_CryptoPAn(key);
+
 	auto id = global_scope()->Find("preserve_orig_addr");
 
 	if ( id )
@@ -437,6 +710,168 @@ ipaddr32_t anonymize_ip(ipaddr32_t ip, enum ip_addr_anonymization_class_t cl)
 	return new_ip;
 	}
 
+bool anonymize_ip6(const uint32_t* ip, uint32_t* output, enum ip_addr_anonymization_class_t cl)
+	{
+	TableVal* preserve_addr = nullptr;
+	IPAddr orig(IPv6, ip, IPAddr::Network);
+	auto addr = make_intrusive<AddrVal>(orig);
+
+	int method = -1;
+
+	switch ( cl ) {
+	case ORIG_ADDR:
+		preserve_addr = anon_preserve_orig_addr.get();
+		method = orig_addr_anonymization;
+		break;
+
+	case RESP_ADDR:
+		preserve_addr = anon_preserve_resp_addr.get();
+		method = resp_addr_anonymization;
+		break;
+
+	default:
+		preserve_addr = anon_preserve_other_addr.get();
+		method = other_addr_anonymization;
+		break;
+	}
+
+	if ( method < 0 || method >= NUM_ADDR_ANONYMIZATION_METHODS )
+		reporter->InternalError("invalid IP anonymization method");
+
+	if ( method == KEEP_ORIG_ADDR || (preserve_addr && preserve_addr->FindOrDefault(addr)) )
+		memcpy(output, ip, 16);
+
+	else if ( ! ip_anonymizer[method] )
+		reporter->InternalError("IP anonymizer not initialized");
+
+	else if ( ! ip_anonymizer[method]->Anonymize6(ip, output) )
+		return false;
+
+#ifdef LOG_ANONYMIZATION_MAPPING
+	if ( anonymization_mapping )
+		event_mgr.Enqueue(anonymization_mapping, std::move(addr),
+		                  make_intrusive<AddrVal>(IPAddr(IPv6, output, IPAddr::Network)));
+#endif
+	return true;
+	}
+
+// Adjusts a checksum for bytes of it having changed, per RFC 1624.  The
+// changed bytes are a whole number of 16-bit words.
+static void adjust_checksum(u_char* sum_field, const u_char* old_bytes,
+                            const u_char* new_bytes, int len)
+	{
+	uint32_t sum = static_cast<uint16_t>(~((sum_field[0] << 8) | sum_field[1]));
+
+	for ( int i = 0; i < len; i += 2 )
+		{
+		sum += static_cast<uint16_t>(~((old_bytes[i] << 8) | old_bytes[i + 1]));
+		sum += (new_bytes[i] << 8) | new_bytes[i + 1];
+		}
+
+	while ( sum >> 16 )
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	sum = ~sum & 0xffff;
+	sum_field[0] = sum >> 8;
+	sum_field[1] = sum & 0xff;
+	}
+
+bool anonymize_packet_addrs(u_char* data, uint32_t len)
+	{
+	auto anonymizer = static_cast<AnonymizeIPAddr_CryptoPAn*>(ip_anonymizer[PREFIX_PRESERVING_CRYPTOPAN]);
+
+	if ( ! anonymizer || len < 1 )
+		return false;
+
+	int version = data[0] >> 4;
+	u_char* addrs;
+	int addrs_len;
+	uint32_t hdr_len;
+	int proto;
+	bool first_fragment;
+	u_char old_addrs[32];
+
+	if ( version == 4 )
+		{
+		hdr_len = (data[0] & 0x0f) * 4;
+
+		if ( len < sizeof(struct ip) || hdr_len < sizeof(struct ip) || len < hdr_len )
+			return false;
+
+		addrs = data + 12;
+		addrs_len = 8;
+		proto = data[9];
+		first_fragment = (((data[6] << 8) | data[7]) & 0x1fff) == 0;
+
+		memcpy(old_addrs, addrs, addrs_len);
+
+		for ( int i = 0; i < 2; ++i )
+			{
+			ipaddr32_t a;
+			memcpy(&a, addrs + 4 * i, sizeof(a));
+			a = anonymizer->Anonymize(a);
+			memcpy(addrs + 4 * i, &a, sizeof(a));
+			}
+
+		adjust_checksum(data + 10, old_addrs, addrs, addrs_len);
+		}
+
+	else if ( version == 6 )
+		{
+		hdr_len = 40;
+
+		if ( len < hdr_len )
+			return false;
+
+		addrs = data + 8;
+		addrs_len = 32;
+		// Transport checksums only get adjusted without extension
+		// headers in between.
+		proto = data[6];
+		first_fragment = true;
+
+		memcpy(old_addrs, addrs, addrs_len);
+
+		for ( int i = 0; i < 2; ++i )
+			{
+			uint32_t a[4];
+			memcpy(a, addrs + 16 * i, sizeof(a));
+			anonymizer->Anonymize6(a, a);
+			memcpy(addrs + 16 * i, a, sizeof(a));
+			}
+		}
+
+	else
+		return false;
+
+	// The pseudo-headers of TCP, UDP and ICMPv6 cover the addresses.
+	if ( ! first_fragment )
+		return true;
+
+	u_char* l4 = data + hdr_len;
+	uint32_t l4_len = len - hdr_len;
+
+	if ( proto == IPPROTO_TCP && l4_len >= 18 )
+		adjust_checksum(l4 + 16, old_addrs, addrs, addrs_len);
+
+	else if ( proto == IPPROTO_UDP && l4_len >= 8 )
+		{
+		// A zero checksum means there's none.
+		if ( l4[6] || l4[7] )
+			{
+			adjust_checksum(l4 + 6, old_addrs, addrs, addrs_len);
+
+			if ( l4[6] == 0 && l4[7] == 0 )
+				l4[6] = l4[7] = 0xff;
+			}
+		}
+
+	else if ( proto == IPPROTO_ICMPV6 && version == 6 && l4_len >= 4 )
+		adjust_checksum(l4 + 2, old_addrs, addrs, addrs_len);
+
+	return true;
+	}
+
 #ifdef LOG_ANONYMIZATION_MAPPING
 
 void log_anonymization_mapping(ipaddr32_t input, ipaddr32_t output)
@@ -451,3 +886,44 @@ void log_anonymization_mapping(ipaddr32_t input, ipaddr32_t output)
 #endif
 
 } // namespace zeek::detail
+
+TEST_CASE("cryptopan anonymization")
+	{
+	// The key and mappings of the reference implementation's sample.
+	const uint8_t key[32] = { 21, 34, 23, 141, 51, 164, 207, 128, 19, 10, 91, 22, 73, 144, 125, 16,
+	                          216, 152, 143, 131, 121, 121, 101, 39, 98, 87, 76, 45, 42, 132, 34, 2 };
+	zeek::detail::AnonymizeIPAddr_CryptoPAn anon(key);
+
+	auto map = [&anon](const char* s)
+		{
+		in_addr a;
+		inet_pton(AF_INET, s, &a);
+		return zeek::IPAddr(in_addr{ anon.Anonymize(a.s_addr) }).AsString();
+		};
+
+	// Twice, the second time from the cache.
+	for ( int i = 0; i < 2; ++i )
+		{
+		CHECK(map("128.11.68.132") == "135.242.180.132");
+		CHECK(map("129.118.74.4") == "134.136.186.123");
+		CHECK(map("130.132.252.244") == "133.68.164.234");
+		CHECK(map("141.223.7.43") == "141.167.8.160");
+		}
+
+	// The IPv6 mapping preserves prefixes, too.
+	auto map6 = [&anon](const char* s)
+		{
+		in6_addr a;
+		uint32_t out[4];
+		inet_pton(AF_INET6, s, &a);
+		anon.Anonymize6(reinterpret_cast<const uint32_t*>(&a), out);
+		return zeek::IPAddr(IPv6, out, zeek::IPAddr::Network);
+		};
+
+	auto a = map6("2001:db8:1:2::1");
+	auto b = map6("2001:db8:1:3::1");
+	CHECK(a == map6("2001:db8:1:2::1"));
+	CHECK(a != b);
+	CHECK(zeek::IPPrefix(a, 63) == zeek::IPPrefix(b, 63));
+	CHECK(zeek::IPPrefix(a, 64) != zeek::IPPrefix(b, 64));
+	}
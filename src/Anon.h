@@ -10,8 +10,11 @@
 
 #pragma once
 
+#include <sys/types.h> // for u_char
 #include <vector>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <cstdint>
 
 namespace zeek::detail {
@@ -31,6 +34,7 @@ enum ip_addr_anonymization_method_t {
 	RANDOM_MD5,
 	PREFIX_PRESERVING_A50,
 	PREFIX_PRESERVING_MD5,
+	PREFIX_PRESERVING_CRYPTOPAN,
 	NUM_ADDR_ANONYMIZATION_METHODS,
 };
 
@@ -43,7 +47,12 @@ class AnonymizeIPAddr {
 public:
 	virtual ~AnonymizeIPAddr() = default;
 
-	ipaddr32_t Anonymize(ipaddr32_t addr);
+	virtual ipaddr32_t Anonymize(ipaddr32_t addr);
+
+	// Anonymizes an IPv6 address, returning false if the method doesn't
+	// support them.
+	virtual bool Anonymize6(const uint32_t* /* addr */, uint32_t* /* output */)
+		{ return false; }
 
 	virtual bool PreservePrefix(ipaddr32_t input, int num_bits);
 
@@ -120,12 +129,61 @@ protected:
 	Node* find_node(ipaddr32_t);
 };
 
+class AESCipher;
+
+// Crypto-PAn, per Xu et al.: bit i of the output is bit i of the input
+// flipped by the first bit of the AES encryption of the preceding bits,
+// padded with key material.  It maps IPv4 and IPv6 addresses, and the same
+// key gives the same mapping in any process, so it suits streaming and
+// sharing traces.  As operating on a prefix always yields the same flips,
+// those of each /24 and /48 get cached, leaving 8 and 80 encryptions per
+// new IPv4 and IPv6 address.
+class AnonymizeIPAddr_CryptoPAn : public AnonymizeIPAddr {
+public:
+	// The key has 32 bytes: the AES key, then the block to derive the
+	// padding from.
+	explicit AnonymizeIPAddr_CryptoPAn(const uint8_t key[32]);
+	~AnonymizeIPAddr_CryptoPAn() override;
+
+	// Skips the mapping table, which would only grow.
+	ipaddr32_t Anonymize(ipaddr32_t addr) override	{ return anonymize(addr); }
+	ipaddr32_t anonymize(ipaddr32_t addr) override;
+	bool Anonymize6(const uint32_t* addr, uint32_t* output) override;
+
+protected:
+	// Sets the bits of flips for the prefix lengths in [from, to) of the
+	// address, both given as 16 bytes in network order.
+	void Flips(const uint8_t* addr, int from, int to, uint8_t* flips) const;
+
+	// Each cache is emptied once it reaches this many entries.
+	static constexpr size_t MAX_CACHE_SIZE = 1 << 20;
+
+	std::unique_ptr<AESCipher> cipher;
+	uint8_t pad[16];
+
+	// The flips of the first 24 bits of IPv4 addresses, indexed by
+	// those, and the same for the first 48 bits of IPv6 addresses.
+	std::unordered_map<uint32_t, uint32_t> cache24;
+	std::unordered_map<uint64_t, uint64_t> cache48;
+};
+
 // The global IP anonymizers.
 extern AnonymizeIPAddr* ip_anonymizer[NUM_ADDR_ANONYMIZATION_METHODS];
 
 void init_ip_addr_anonymizers();
 ipaddr32_t anonymize_ip(ipaddr32_t ip, enum ip_addr_anonymization_class_t cl);
 
+// Anonymizes an IPv6 address, returning false if the class's method
+// doesn't support them.
+bool anonymize_ip6(const uint32_t* ip, uint32_t* output,
+                   enum ip_addr_anonymization_class_t cl);
+
+// Replaces the addresses in an IPv4 or IPv6 header with their Crypto-PAn
+// mapping, adjusting the checksums of the header and of TCP, UDP and
+// ICMPv6.  The header starts at data and len bytes of it are available.
+// Returns false if there's no complete IP header.
+bool anonymize_packet_addrs(u_char* data, uint32_t len);
+
 #define LOG_ANONYMIZATION_MAPPING
 void log_anonymization_mapping(ipaddr32_t input, ipaddr32_t output);
 
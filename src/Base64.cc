@@ -35,16 +35,32 @@ void Base64Converter::Encode(int len, const unsigned char* data, int* pblen, cha
 		*pblen = blen;
 		}
 
-	for ( int i = 0, j = 0; (i < len) && ( j < blen ); )
+	const char* a = alphabet.data();
+	int i = 0;
+	int j = 0;
+
+	// Full groups of 3 bytes, without checks for padding.
+	for ( ; i + 3 <= len && j < blen; i += 3 )
+		{
+		uint32_t bit32 = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+
+		buf[j++] = a[(bit32 >> 18) & 0x3f];
+		buf[j++] = a[(bit32 >> 12) & 0x3f];
+		buf[j++] = a[(bit32 >> 6) & 0x3f];
+		buf[j++] = a[bit32 & 0x3f];
+		}
+
+	if ( i < len && j < blen )
 		{
-			uint32_t bit32 = data[i++]  << 16;
-			bit32 += (i++ < len ? data[i-1] : 0) << 8;
-			bit32 += i++ < len ? data[i-1] : 0;
-
-			buf[j++] = alphabet[(bit32 >> 18) & 0x3f];
-			buf[j++] = alphabet[(bit32 >> 12) & 0x3f];
-			buf[j++] = (i == (len+2)) ? '=' : alphabet[(bit32 >> 6) & 0x3f];
-			buf[j++] = (i >= (len+1)) ? '=' : alphabet[bit32 & 0x3f];
+		uint32_t bit32 = data[i] << 16;
+
+		if ( i + 1 < len )
+			bit32 |= data[i + 1] << 8;
+
+		buf[j++] = a[(bit32 >> 18) & 0x3f];
+		buf[j++] = a[(bit32 >> 12) & 0x3f];
+		buf[j++] = (i + 1 < len) ? a[(bit32 >> 6) & 0x3f] : '=';
+		buf[j++] = '=';
 		}
 	}
 
@@ -185,6 +201,35 @@ int Base64Converter::Decode(int len, const char* data, int* pblen, char** pbuf)
 		if ( dlen >= len )
 			break;
 
+		// Decode complete groups directly while they're valid and
+		// aren't padded, leaving everything else to the code below.
+		if ( base64_group_next == 0 && ! base64_after_padding )
+			{
+			char* end = *pbuf + blen;
+
+			while ( len - dlen >= 4 && buf + 3 <= end )
+				{
+				auto p = reinterpret_cast<const unsigned char*>(data + dlen);
+				int k0 = base64_table[p[0]];
+				int k1 = base64_table[p[1]];
+				int k2 = base64_table[p[2]];
+				int k3 = base64_table[p[3]];
+
+				if ( (k0 | k1 | k2 | k3) < 0 ||
+				     p[0] == '=' || p[1] == '=' || p[2] == '=' || p[3] == '=' )
+					break;
+
+				uint32_t bit32 = (k0 << 18) | (k1 << 12) | (k2 << 6) | k3;
+				*buf++ = char((bit32 >> 16) & 0xff);
+				*buf++ = char((bit32 >> 8) & 0xff);
+				*buf++ = char(bit32 & 0xff);
+				dlen += 4;
+				}
+
+			if ( dlen >= len )
+				break;
+			}
+
 		if ( data[dlen] == '=' )
 			++base64_padding;
 
@@ -64,6 +64,18 @@ CompositeHash::CompositeHash(TypeListPtr composite_type)
 				(new double[size/sizeof(double) + 1]);
 		else
 			key = nullptr;
+
+		if ( size > 0 && size <= MAX_FIXED_KEY_SIZE )
+			{
+			int sz = 0;
+
+			for ( const auto& t : type->GetTypes() )
+				if ( ! (sz = BuildFixedLayout(t.get(), sz)) )
+					break;
+
+			if ( sz != size )
+				fixed_layout.clear();
+			}
 		}
 	}
 
@@ -72,6 +84,135 @@ CompositeHash::~CompositeHash()
 	delete [] key;
 	}
 
+int CompositeHash::BuildFixedLayout(Type* t, int offset)
+	{
+	if ( t->Tag() == TYPE_RECORD )
+		{
+		// Optional fields come with a marker byte, and possibly
+		// padding, so they aren't handled.
+		RecordType* rt = t->AsRecordType();
+
+		for ( int i = 0; i < rt->NumFields(); ++i )
+			{
+			Attributes* a = rt->FieldDecl(i)->attrs.get();
+
+			if ( a && a->Find(ATTR_OPTIONAL) )
+				return 0;
+
+			if ( ! (offset = BuildFixedLayout(rt->GetFieldType(i).get(), offset)) )
+				return 0;
+			}
+
+		return offset;
+		}
+
+	InternalTypeTag tag = t->InternalType();
+	unsigned int align;
+	int width;
+
+	switch ( tag ) {
+	case TYPE_INTERNAL_INT:
+	case TYPE_INTERNAL_UNSIGNED:
+		align = sizeof(bro_int_t);
+		width = sizeof(bro_int_t);
+		break;
+
+	case TYPE_INTERNAL_ADDR:
+		align = sizeof(uint32_t);
+		width = 4 * sizeof(uint32_t);
+		break;
+
+	default:
+		return 0;
+	}
+
+	// All of these widths keep the following value aligned, so a fixed
+	// key never needs padding.  Should that ever change, the key would
+	// have to be zero-filled first, so don't bother with the layout.
+	if ( SizeAlign(offset, align) - static_cast<int>(align) != offset )
+		return 0;
+
+	fixed_layout.push_back({tag, offset});
+	return offset + width;
+	}
+
+bool CompositeHash::FixedValHash(char* buf, Type* t, const Val* v, size_t* field) const
+	{
+	if ( ! v )
+		return false;
+
+	if ( t->Tag() == TYPE_RECORD )
+		{
+		if ( v->GetType()->Tag() != TYPE_RECORD )
+			return false;
+
+		RecordType* rt = t->AsRecordType();
+		auto rv = v->AsRecordVal();
+
+		if ( rv->GetType()->AsRecordType()->NumFields() != rt->NumFields() )
+			return false;
+
+		for ( int i = 0; i < rt->NumFields(); ++i )
+			if ( ! FixedValHash(buf, rt->GetFieldType(i).get(), rv->GetField(i).get(), field) )
+				return false;
+
+		return true;
+		}
+
+	const auto& f = fixed_layout[(*field)++];
+
+	if ( v->GetType()->InternalType() != f.tag )
+		return false;
+
+	char* kp = buf + f.offset;
+
+	switch ( f.tag ) {
+	case TYPE_INTERNAL_INT:
+		*reinterpret_cast<bro_int_t*>(kp) = v->ForceAsInt();
+		break;
+
+	case TYPE_INTERNAL_UNSIGNED:
+		*reinterpret_cast<bro_uint_t*>(kp) = v->ForceAsUInt();
+		break;
+
+	case TYPE_INTERNAL_ADDR:
+		v->AsAddr().CopyIPv6(reinterpret_cast<uint32_t*>(kp));
+		break;
+
+	default:
+		return false;
+	}
+
+	return true;
+	}
+
+int CompositeHash::FixedHashKey(const Val& v, char* buf) const
+	{
+	if ( fixed_layout.empty() )
+		return 0;
+
+	const auto& tl = type->GetTypes();
+	size_t field = 0;
+
+	// A record index may come without the enclosing list.
+	if ( is_complex_type && v.GetType()->Tag() != TYPE_LIST )
+		return FixedValHash(buf, tl[0].get(), &v, &field) ? size : 0;
+
+	if ( v.GetType()->Tag() != TYPE_LIST )
+		return 0;
+
+	auto lv = v.AsListVal();
+
+	if ( lv->Length() != static_cast<int>(tl.size()) )
+		return 0;
+
+	for ( auto i = 0u; i < tl.size(); ++i )
+		if ( ! FixedValHash(buf, tl[i].get(), lv->Idx(i).get(), &field) )
+			return 0;
+
+	return size;
+	}
+
 // Computes the piece of the hash for Val*, returning the new kp.
 char* CompositeHash::SingleValHash(bool type_check, char* kp0,
                                    Type* bt, Val* v, bool optional) const
@@ -345,6 +486,14 @@ std::unique_ptr<HashKey> CompositeHash::MakeHashKey(const Val& argv, bool type_c
 	if ( is_singleton )
 		return ComputeSingletonHash(v, type_check);
 
+	if ( ! fixed_layout.empty() )
+		{
+		alignas(bro_int_t) char buf[MAX_FIXED_KEY_SIZE];
+
+		if ( int sz = FixedHashKey(argv, buf) )
+			return std::make_unique<HashKey>(buf, sz, HashKey::HashBytes(buf, sz));
+		}
+
 	if ( is_complex_type && v->GetType()->Tag() != TYPE_LIST )
 		{
 		ListVal lv(TYPE_ANY);
@@ -732,6 +881,24 @@ ListValPtr CompositeHash::RecoverVals(const HashKey& k) const
 	return l;
 	}
 
+void CompositeHash::RecoverVals(const HashKey& k, std::vector<ValPtr>& vals) const
+	{
+	const auto& tl = type->GetTypes();
+	const char* kp = (const char*) k.Key();
+	const char* const k_end = kp + k.Size();
+
+	vals.resize(tl.size());
+
+	for ( size_t i = 0; i < tl.size(); ++i )
+		{
+		kp = RecoverOneVal(k, kp, k_end, tl[i].get(), &vals[i], false);
+		ASSERT(vals[i]);
+		}
+
+	if ( kp != k_end )
+		reporter->InternalError("under-ran key in CompositeHash::DescribeKey %zd", k_end - kp);
+	}
+
 const char* CompositeHash::RecoverOneVal(
 	const HashKey& k, const char* kp0,
 	const char* const k_end, Type* t,
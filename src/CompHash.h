@@ -3,6 +3,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include "zeek/Type.h"
 #include "zeek/IntrusivePtr.h"
@@ -36,8 +37,28 @@ public:
 	ListValPtr RecoverVals(const HashKey* k) const
 		{ return RecoverVals(*k); }
 
+	// Same, but stores the values in the given vector, replacing its
+	// contents, so that callers recovering many keys can reuse it.
+	void RecoverVals(const HashKey& k, std::vector<ValPtr>& vals) const;
+
 	unsigned int MemoryAllocation() const { return padded_sizeof(*this) + util::pad_size(size); }
 
+	// Largest key that FixedHashKey() builds.
+	static constexpr int MAX_FIXED_KEY_SIZE = 128;
+
+	// True if the index consists only of fixed-width types (addr, port,
+	// count, enum and the like, possibly grouped into records without
+	// optional fields), so that FixedHashKey() can key it.
+	bool HasFixedLayout() const	{ return ! fixed_layout.empty(); }
+
+	// Writes the key for the given index val into buf, which must hold
+	// MAX_FIXED_KEY_SIZE bytes aligned for a bro_int_t, and returns its
+	// size.  The key is identical to the one MakeHashKey() returns, but
+	// is built without any allocation.  Returns 0 if the index doesn't
+	// fit the fixed layout, in which case callers fall back to
+	// MakeHashKey().
+	int FixedHashKey(const Val& v, char* buf) const;
+
 protected:
 	std::unique_ptr<HashKey> ComputeSingletonHash(const Val* v, bool type_check) const;
 
@@ -95,6 +116,15 @@ protected:
 	                      bool type_check, int sz, bool optional,
 	                      bool calc_static_size) const;
 
+	// Determines the fixed key layout of the given type, appending its
+	// fields to fixed_layout.  Returns the new offset, or 0 if the type
+	// isn't of fixed width.
+	int BuildFixedLayout(Type* t, int offset);
+
+	// Writes a value of the given type according to the fixed layout,
+	// starting at the given field.  Returns false if it doesn't fit.
+	bool FixedValHash(char* buf, Type* t, const Val* v, size_t* field) const;
+
 	TypeListPtr type;
 	char* key;	// space for composite key
 	int size;
@@ -104,6 +134,15 @@ protected:
 	bool is_complex_type;
 
 	InternalTypeTag singleton_tag;
+
+	// Position of each atomic value in a fixed-width key, in the order
+	// the values appear in the index.  Empty if there's no fixed layout.
+	struct FixedField {
+		InternalTypeTag tag;
+		int offset;
+	};
+
+	std::vector<FixedField> fixed_layout;
 };
 
 } // namespace zeek::detail
@@ -0,0 +1,1174 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/CompiledBody.h"
+
+#include <algorithm>
+
+#include "zeek/Expr.h"
+#include "zeek/Stmt.h"
+#include "zeek/Frame.h"
+#include "zeek/Func.h"
+#include "zeek/ID.h"
+#include "zeek/Val.h"
+#include "zeek/Reporter.h"
+
+namespace zeek::detail {
+
+enum CompiledBody::Op : uint8_t {
+	OP_LOADK,	// a = k
+	OP_MOVE,	// a = b, marking a as set
+	OP_CHECK_DEF,	// error if a isn't set
+	OP_UNDEF,	// mark a as not set
+	OP_LOAD_GLOBAL,	// a = globals[b], unboxed as kind c
+
+	OP_ADD_I, OP_ADD_U, OP_ADD_D,	// a = b op c
+	OP_SUB_I, OP_SUB_U, OP_SUB_D,
+	OP_MUL_I, OP_MUL_U, OP_MUL_D,
+	OP_DIV_I, OP_DIV_U, OP_DIV_D,
+	OP_MOD_I, OP_MOD_U,
+	OP_AND_U, OP_OR_U, OP_XOR_U,
+
+	OP_LT_I, OP_LT_U, OP_LT_D,	// a = b op c, with a boolean result
+	OP_LE_I, OP_LE_U, OP_LE_D,
+	OP_EQ_I, OP_EQ_U, OP_EQ_D,
+	OP_NE_I, OP_NE_U, OP_NE_D,
+
+	OP_NOT, OP_NEG_I, OP_NEG_D, OP_COMPL_U,	// a = op b
+	OP_I2D, OP_U2D, OP_D2I, OP_D2U,
+
+	OP_INCR_I, OP_INCR_U, OP_DECR_I, OP_DECR_U,	// a = a op 1
+
+	OP_JMP,		// goto a
+	OP_JMP_FALSE,	// if b is zero goto a
+	OP_JMP_TRUE,	// if b isn't zero goto a
+
+	OP_CALL,	// a = calls[b], with a being -1 if unused
+	OP_RETURN,	// return b, boxed as type t
+	OP_RETURN_VOID,
+	OP_END,		// fell off the end of the body
+};
+
+namespace {
+
+// Labels for loops currently being compiled, for break and next.
+struct LoopInfo {
+	int head;
+	std::vector<int> breaks;
+};
+
+}
+
+// Lowers a body into a CompiledBody.  All of the Compile methods return
+// false when encountering something not supported, in which case the
+// compilation as a whole gets abandoned.
+class BodyCompiler {
+public:
+	BodyCompiler(CompiledBody* arg_cb, const FuncType* ft, int arg_frame_size);
+
+	bool CompileStmt(const Stmt* s);
+
+	// Finishes the compilation.
+	void Done();
+
+private:
+	using Kind = CompiledBody::Kind;
+	using Op = CompiledBody::Op;
+	using Instr = CompiledBody::Instr;
+
+	bool CompileExprStmt(const Expr* e);
+	bool CompileAssign(const Expr* lhs, const Expr* rhs);
+	bool CompileIf(const IfStmt* s);
+	bool CompileWhile(const WhileStmt* s);
+	bool CompileReturn(const ReturnStmt* s);
+	bool CompileInit(const InitStmt* s);
+
+	// Compiles an expression, returning the register that holds its
+	// value, or -1 if it's not supported.  The register is either a
+	// local variable or a temporary.
+	int CompileExpr(const Expr* e);
+
+	int CompileName(const NameExpr* e);
+	int CompileConst(const ConstExpr* e);
+	int CompileBinary(const BinaryExpr* e);
+	int CompileUnary(const UnaryExpr* e);
+	int CompileCoerce(const Expr* e, const Expr* op);
+	int CompileBool(const BinaryExpr* e);
+	int CompileCond(const CondExpr* e);
+	int CompileCall(const CallExpr* e, bool want_result);
+
+	// Returns the register of a local variable unboxed into one, or -1.
+	int LocalReg(const Expr* e) const;
+
+	int NewTemp()
+		{
+		cb->num_regs = std::max(cb->num_regs, next_temp + 1);
+		return next_temp++;
+		}
+
+	int Emit(Op op, int a = 0, int b = 0, int c = 0, const Expr* e = nullptr,
+	         const Type* t = nullptr);
+	int EmitK(int a, CompiledBody::Reg k);
+
+	// Points the jump at the given position to the next instruction.
+	void PatchToHere(int jump)	{ cb->code[jump].a = cb->code.size(); }
+
+	bool IsParam(int slot) const	{ return slot < num_params; }
+
+	CompiledBody* cb;
+	const FuncType* ft;
+	int frame_size;
+	int num_params;
+	int next_temp;
+
+	// Which frame slots are known to be set on the current path, used
+	// to skip checks for reading unset locals.
+	std::vector<bool> known_set;
+
+	std::vector<LoopInfo> loops;
+};
+
+BodyCompiler::BodyCompiler(CompiledBody* arg_cb, const FuncType* arg_ft, int arg_frame_size)
+	: cb(arg_cb), ft(arg_ft), frame_size(arg_frame_size)
+	{
+	num_params = ft->Params()->NumFields();
+	next_temp = frame_size;
+	cb->num_regs = frame_size;
+	known_set.resize(frame_size, false);
+
+	for ( int i = 0; i < num_params; ++i )
+		{
+		known_set[i] = true;
+
+		auto k = CompiledBody::KindOf(ft->Params()->GetFieldType(i).get());
+
+		if ( k != CompiledBody::KIND_NONE )
+			cb->params.push_back({i, k});
+		}
+	}
+
+void BodyCompiler::Done()
+	{
+	Emit(CompiledBody::OP_END);
+	}
+
+int BodyCompiler::Emit(Op op, int a, int b, int c, const Expr* e, const Type* t)
+	{
+	Instr i;
+	i.op = op;
+	i.a = a;
+	i.b = b;
+	i.c = c;
+	i.k.i = 0;
+	i.e = e;
+	i.t = t;
+	cb->code.push_back(i);
+
+	return cb->code.size() - 1;
+	}
+
+int BodyCompiler::EmitK(int a, CompiledBody::Reg k)
+	{
+	int pc = Emit(CompiledBody::OP_LOADK, a);
+	cb->code[pc].k = k;
+	return pc;
+	}
+
+bool BodyCompiler::CompileStmt(const Stmt* s)
+	{
+	// Temporaries don't live beyond a statement.
+	next_temp = frame_size;
+
+	switch ( s->Tag() ) {
+	case STMT_LIST:
+		for ( const auto& sub : static_cast<const StmtList*>(s)->Stmts() )
+			if ( ! CompileStmt(sub) )
+				return false;
+
+		return true;
+
+	case STMT_EXPR:
+		return CompileExprStmt(static_cast<const ExprStmt*>(s)->StmtExpr());
+
+	case STMT_IF:
+		return CompileIf(static_cast<const IfStmt*>(s));
+
+	case STMT_WHILE:
+		return CompileWhile(static_cast<const WhileStmt*>(s));
+
+	case STMT_RETURN:
+		return CompileReturn(static_cast<const ReturnStmt*>(s));
+
+	case STMT_INIT:
+		return CompileInit(static_cast<const InitStmt*>(s));
+
+	case STMT_NEXT:
+		if ( loops.empty() )
+			return false;
+
+		Emit(CompiledBody::OP_JMP, loops.back().head);
+		return true;
+
+	case STMT_BREAK:
+		if ( loops.empty() )
+			return false;
+
+		loops.back().breaks.push_back(Emit(CompiledBody::OP_JMP));
+		return true;
+
+	case STMT_NULL:
+		return true;
+
+	default:
+		return false;
+	}
+	}
+
+bool BodyCompiler::CompileExprStmt(const Expr* e)
+	{
+	switch ( e->Tag() ) {
+	case EXPR_ASSIGN:
+		{
+		auto a = static_cast<const AssignExpr*>(e);
+
+		if ( a->Op1()->Tag() != EXPR_REF )
+			return false;
+
+		return CompileAssign(static_cast<const RefExpr*>(a->Op1())->Op(), a->Op2());
+		}
+
+	case EXPR_INCR:
+	case EXPR_DECR:
+		{
+		auto op = static_cast<const UnaryExpr*>(e)->Op();
+
+		if ( op->Tag() != EXPR_REF )
+			return false;
+
+		op = static_cast<const RefExpr*>(op)->Op();
+		int r = LocalReg(op);
+
+		if ( r < 0 )
+			return false;
+
+		auto k = CompiledBody::KindOf(op->GetType().get());
+
+		if ( k == CompiledBody::KIND_DOUBLE || k != CompiledBody::KindOf(e->GetType().get()) )
+			return false;
+
+		if ( ! known_set[r] )
+			Emit(CompiledBody::OP_CHECK_DEF, r, 0, 0, op);
+
+		bool is_int = k == CompiledBody::KIND_INT;
+
+		if ( e->Tag() == EXPR_INCR )
+			Emit(is_int ? CompiledBody::OP_INCR_I : CompiledBody::OP_INCR_U, r);
+		else
+			Emit(is_int ? CompiledBody::OP_DECR_I : CompiledBody::OP_DECR_U, r, 0, 0, e);
+
+		return true;
+		}
+
+	case EXPR_ADD_TO:
+	case EXPR_REMOVE_FROM:
+		{
+		auto b = static_cast<const BinaryExpr*>(e);
+
+		if ( b->Op1()->Tag() != EXPR_REF )
+			return false;
+
+		auto lhs = static_cast<const RefExpr*>(b->Op1())->Op();
+		int r = LocalReg(lhs);
+
+		if ( r < 0 )
+			return false;
+
+		auto k = CompiledBody::KindOf(lhs->GetType().get());
+
+		if ( k != CompiledBody::KindOf(b->Op2()->GetType().get()) ||
+		     k != CompiledBody::KindOf(e->GetType().get()) )
+			return false;
+
+		if ( ! known_set[r] )
+			Emit(CompiledBody::OP_CHECK_DEF, r, 0, 0, lhs);
+
+		int r2 = CompileExpr(b->Op2());
+
+		if ( r2 < 0 )
+			return false;
+
+		Op op;
+
+		if ( e->Tag() == EXPR_ADD_TO )
+			op = k == CompiledBody::KIND_INT ? CompiledBody::OP_ADD_I :
+			     (k == CompiledBody::KIND_UINT ? CompiledBody::OP_ADD_U : CompiledBody::OP_ADD_D);
+		else
+			op = k == CompiledBody::KIND_INT ? CompiledBody::OP_SUB_I :
+			     (k == CompiledBody::KIND_UINT ? CompiledBody::OP_SUB_U : CompiledBody::OP_SUB_D);
+
+		Emit(op, r, r, r2, e);
+		return true;
+		}
+
+	case EXPR_CALL:
+		return CompileCall(static_cast<const CallExpr*>(e), false) >= 0;
+
+	default:
+		return false;
+	}
+	}
+
+bool BodyCompiler::CompileAssign(const Expr* lhs, const Expr* rhs)
+	{
+	int dst = LocalReg(lhs);
+
+	if ( dst < 0 || CompiledBody::KindOf(lhs->GetType().get()) !=
+	                CompiledBody::KindOf(rhs->GetType().get()) )
+		return false;
+
+	int r = CompileExpr(rhs);
+
+	if ( r < 0 )
+		return false;
+
+	Emit(CompiledBody::OP_MOVE, dst, r);
+	known_set[dst] = true;
+	return true;
+	}
+
+bool BodyCompiler::CompileIf(const IfStmt* s)
+	{
+	int cond = CompileExpr(s->StmtExpr());
+
+	if ( cond < 0 )
+		return false;
+
+	int to_else = Emit(CompiledBody::OP_JMP_FALSE, 0, cond);
+
+	auto before = known_set;
+
+	if ( ! CompileStmt(s->TrueBranch()) )
+		return false;
+
+	int to_end = Emit(CompiledBody::OP_JMP);
+	PatchToHere(to_else);
+
+	auto after_true = known_set;
+	known_set = before;
+
+	if ( ! CompileStmt(s->FalseBranch()) )
+		return false;
+
+	PatchToHere(to_end);
+
+	// Only what both branches set is known to be set afterwards.
+	for ( auto i = 0u; i < known_set.size(); ++i )
+		known_set[i] = known_set[i] && after_true[i];
+
+	return true;
+	}
+
+bool BodyCompiler::CompileWhile(const WhileStmt* s)
+	{
+	int head = cb->code.size();
+
+	next_temp = frame_size;
+	int cond = CompileExpr(s->Condition());
+
+	if ( cond < 0 )
+		return false;
+
+	int to_end = Emit(CompiledBody::OP_JMP_FALSE, 0, cond);
+
+	// The body may not run at all, so nothing it sets is known to be set
+	// after the loop.
+	auto before = known_set;
+
+	loops.push_back({head, {}});
+
+	if ( ! CompileStmt(s->Body()) )
+		return false;
+
+	Emit(CompiledBody::OP_JMP, head);
+	PatchToHere(to_end);
+
+	for ( auto b : loops.back().breaks )
+		PatchToHere(b);
+
+	loops.pop_back();
+	known_set = before;
+
+	return true;
+	}
+
+bool BodyCompiler::CompileReturn(const ReturnStmt* s)
+	{
+	auto e = s->StmtExpr();
+
+	if ( ! e )
+		{
+		Emit(CompiledBody::OP_RETURN_VOID);
+		return true;
+		}
+
+	int r = CompileExpr(e);
+
+	if ( r < 0 )
+		return false;
+
+	Emit(CompiledBody::OP_RETURN, 0, r, 0, e, e->GetType().get());
+	return true;
+	}
+
+bool BodyCompiler::CompileInit(const InitStmt* s)
+	{
+	for ( const auto& id : s->Inits() )
+		{
+		// Aggregates would need creating.
+		if ( CompiledBody::KindOf(id->GetType().get()) == CompiledBody::KIND_NONE )
+			return false;
+
+		Emit(CompiledBody::OP_UNDEF, id->Offset());
+		known_set[id->Offset()] = false;
+		}
+
+	return true;
+	}
+
+int BodyCompiler::LocalReg(const Expr* e) const
+	{
+	if ( e->Tag() != EXPR_NAME )
+		return -1;
+
+	auto id = static_cast<const NameExpr*>(e)->Id();
+
+	if ( id->IsGlobal() || id->IsType() ||
+	     CompiledBody::KindOf(id->GetType().get()) == CompiledBody::KIND_NONE )
+		return -1;
+
+	if ( id->Offset() >= frame_size )
+		return -1;
+
+	return id->Offset();
+	}
+
+int BodyCompiler::CompileExpr(const Expr* e)
+	{
+	// Everything evaluated here ends up in a register.
+	if ( CompiledBody::KindOf(e->GetType().get()) == CompiledBody::KIND_NONE )
+		return -1;
+
+	switch ( e->Tag() ) {
+	case EXPR_NAME:
+		return CompileName(static_cast<const NameExpr*>(e));
+
+	case EXPR_CONST:
+		return CompileConst(static_cast<const ConstExpr*>(e));
+
+	case EXPR_ADD:
+	case EXPR_SUB:
+	case EXPR_TIMES:
+	case EXPR_DIVIDE:
+	case EXPR_MOD:
+	case EXPR_AND:
+	case EXPR_OR:
+	case EXPR_XOR:
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_GE:
+	case EXPR_GT:
+		return CompileBinary(static_cast<const BinaryExpr*>(e));
+
+	case EXPR_AND_AND:
+	case EXPR_OR_OR:
+		return CompileBool(static_cast<const BinaryExpr*>(e));
+
+	case EXPR_NOT:
+	case EXPR_NEGATE:
+	case EXPR_COMPLEMENT:
+		return CompileUnary(static_cast<const UnaryExpr*>(e));
+
+	case EXPR_POSITIVE:
+	case EXPR_ARITH_COERCE:
+		return CompileCoerce(e, static_cast<const UnaryExpr*>(e)->Op());
+
+	case EXPR_COND:
+		return CompileCond(static_cast<const CondExpr*>(e));
+
+	case EXPR_CALL:
+		return CompileCall(static_cast<const CallExpr*>(e), true);
+
+	default:
+		return -1;
+	}
+	}
+
+int BodyCompiler::CompileName(const NameExpr* e)
+	{
+	auto id = e->Id();
+
+	if ( id->IsType() )
+		return -1;
+
+	if ( id->IsGlobal() )
+		{
+		int r = NewTemp();
+		cb->globals.push_back(id);
+		Emit(CompiledBody::OP_LOAD_GLOBAL, r, cb->globals.size() - 1,
+		     CompiledBody::KindOf(id->GetType().get()), e);
+		return r;
+		}
+
+	int r = LocalReg(e);
+
+	if ( r >= 0 && ! known_set[r] )
+		Emit(CompiledBody::OP_CHECK_DEF, r, 0, 0, e);
+
+	return r;
+	}
+
+int BodyCompiler::CompileConst(const ConstExpr* e)
+	{
+	int r = NewTemp();
+	auto v = e->Value();
+	EmitK(r, CompiledBody::Unbox(v, CompiledBody::KindOf(v->GetType().get())));
+	return r;
+	}
+
+int BodyCompiler::CompileBinary(const BinaryExpr* e)
+	{
+	auto k = CompiledBody::KindOf(e->Op1()->GetType().get());
+
+	// Operands are promoted to a common type by the time we get here,
+	// but don't rely on it.
+	if ( k != CompiledBody::KindOf(e->Op2()->GetType().get()) )
+		return -1;
+
+	auto tag = e->Tag();
+	bool is_cmp = tag >= EXPR_LT && tag <= EXPR_GT;
+
+	if ( ! is_cmp && k != CompiledBody::KindOf(e->GetType().get()) )
+		return -1;
+
+	// Picks the variant of an operation fitting the operands' kind.
+	auto pick = [k](Op i, Op u, Op d)
+		{
+		return k == CompiledBody::KIND_INT ? i : (k == CompiledBody::KIND_UINT ? u : d);
+		};
+
+	// Marks an operation as not existing for a kind.
+	constexpr auto none = CompiledBody::OP_END;
+
+	Op op;
+	bool swap = false;
+
+	switch ( tag ) {
+	case EXPR_ADD:
+		op = pick(CompiledBody::OP_ADD_I, CompiledBody::OP_ADD_U, CompiledBody::OP_ADD_D);
+		break;
+	case EXPR_SUB:
+		op = pick(CompiledBody::OP_SUB_I, CompiledBody::OP_SUB_U, CompiledBody::OP_SUB_D);
+		break;
+	case EXPR_TIMES:
+		op = pick(CompiledBody::OP_MUL_I, CompiledBody::OP_MUL_U, CompiledBody::OP_MUL_D);
+		break;
+	case EXPR_DIVIDE:
+		op = pick(CompiledBody::OP_DIV_I, CompiledBody::OP_DIV_U, CompiledBody::OP_DIV_D);
+		break;
+	case EXPR_MOD:
+		op = pick(CompiledBody::OP_MOD_I, CompiledBody::OP_MOD_U, none);
+		break;
+	case EXPR_AND:
+		op = pick(none, CompiledBody::OP_AND_U, none);
+		break;
+	case EXPR_OR:
+		op = pick(none, CompiledBody::OP_OR_U, none);
+		break;
+	case EXPR_XOR:
+		op = pick(none, CompiledBody::OP_XOR_U, none);
+		break;
+	case EXPR_GT:
+		swap = true;
+		// fall through
+	case EXPR_LT:
+		op = pick(CompiledBody::OP_LT_I, CompiledBody::OP_LT_U, CompiledBody::OP_LT_D);
+		break;
+	case EXPR_GE:
+		swap = true;
+		// fall through
+	case EXPR_LE:
+		op = pick(CompiledBody::OP_LE_I, CompiledBody::OP_LE_U, CompiledBody::OP_LE_D);
+		break;
+	case EXPR_EQ:
+		op = pick(CompiledBody::OP_EQ_I, CompiledBody::OP_EQ_U, CompiledBody::OP_EQ_D);
+		break;
+	case EXPR_NE:
+		op = pick(CompiledBody::OP_NE_I, CompiledBody::OP_NE_U, CompiledBody::OP_NE_D);
+		break;
+	default:
+		return -1;
+	}
+
+	if ( op == none )
+		return -1;
+
+	int r1 = CompileExpr(e->Op1());
+
+	if ( r1 < 0 )
+		return -1;
+
+	int r2 = CompileExpr(e->Op2());
+
+	if ( r2 < 0 )
+		return -1;
+
+	if ( swap )
+		std::swap(r1, r2);
+
+	int r = NewTemp();
+	Emit(op, r, r1, r2, e);
+	return r;
+	}
+
+int BodyCompiler::CompileUnary(const UnaryExpr* e)
+	{
+	auto k = CompiledBody::KindOf(e->Op()->GetType().get());
+	auto rk = CompiledBody::KindOf(e->GetType().get());
+	Op op;
+
+	switch ( e->Tag() ) {
+	case EXPR_NOT:
+		if ( k == CompiledBody::KIND_DOUBLE )
+			return -1;
+
+		op = CompiledBody::OP_NOT;
+		break;
+
+	case EXPR_NEGATE:
+		if ( k == CompiledBody::KIND_DOUBLE && rk == CompiledBody::KIND_DOUBLE )
+			op = CompiledBody::OP_NEG_D;
+		else if ( k != CompiledBody::KIND_DOUBLE && rk == CompiledBody::KIND_INT )
+			// Counts negate into ints.
+			op = CompiledBody::OP_NEG_I;
+		else
+			return -1;
+
+		break;
+
+	case EXPR_COMPLEMENT:
+		if ( k != CompiledBody::KIND_UINT || rk != CompiledBody::KIND_UINT )
+			return -1;
+
+		op = CompiledBody::OP_COMPL_U;
+		break;
+
+	default:
+		return -1;
+	}
+
+	int r1 = CompileExpr(e->Op());
+
+	if ( r1 < 0 )
+		return -1;
+
+	int r = NewTemp();
+	Emit(op, r, r1);
+	return r;
+	}
+
+int BodyCompiler::CompileCoerce(const Expr* e, const Expr* op)
+	{
+	auto from = CompiledBody::KindOf(op->GetType().get());
+	auto to = CompiledBody::KindOf(e->GetType().get());
+
+	if ( from == CompiledBody::KIND_NONE )
+		return -1;
+
+	int r1 = CompileExpr(op);
+
+	if ( r1 < 0 )
+		return -1;
+
+	int r = NewTemp();
+
+	if ( to == CompiledBody::KIND_DOUBLE && from != CompiledBody::KIND_DOUBLE )
+		Emit(from == CompiledBody::KIND_INT ? CompiledBody::OP_I2D : CompiledBody::OP_U2D, r, r1);
+	else if ( to != CompiledBody::KIND_DOUBLE && from == CompiledBody::KIND_DOUBLE )
+		Emit(to == CompiledBody::KIND_INT ? CompiledBody::OP_D2I : CompiledBody::OP_D2U, r, r1);
+	else
+		// Between ints and counts the bits stay the same.
+		Emit(CompiledBody::OP_MOVE, r, r1);
+
+	return r;
+	}
+
+int BodyCompiler::CompileBool(const BinaryExpr* e)
+	{
+	// Short-circuits, leaving the first operand's value in place when it
+	// decides the result.
+	int r = NewTemp();
+	int r1 = CompileExpr(e->Op1());
+
+	if ( r1 < 0 )
+		return -1;
+
+	Emit(CompiledBody::OP_MOVE, r, r1);
+
+	auto jop = e->Tag() == EXPR_AND_AND ? CompiledBody::OP_JMP_FALSE : CompiledBody::OP_JMP_TRUE;
+	int to_end = Emit(jop, 0, r);
+
+	int r2 = CompileExpr(e->Op2());
+
+	if ( r2 < 0 )
+		return -1;
+
+	Emit(CompiledBody::OP_MOVE, r, r2);
+	PatchToHere(to_end);
+
+	return r;
+	}
+
+int BodyCompiler::CompileCond(const CondExpr* e)
+	{
+	auto k = CompiledBody::KindOf(e->GetType().get());
+
+	if ( k != CompiledBody::KindOf(e->Op2()->GetType().get()) ||
+	     k != CompiledBody::KindOf(e->Op3()->GetType().get()) )
+		return -1;
+
+	int r = NewTemp();
+	int cond = CompileExpr(e->Op1());
+
+	if ( cond < 0 )
+		return -1;
+
+	int to_else = Emit(CompiledBody::OP_JMP_FALSE, 0, cond);
+
+	int r2 = CompileExpr(e->Op2());
+
+	if ( r2 < 0 )
+		return -1;
+
+	Emit(CompiledBody::OP_MOVE, r, r2);
+	int to_end = Emit(CompiledBody::OP_JMP);
+	PatchToHere(to_else);
+
+	int r3 = CompileExpr(e->Op3());
+
+	if ( r3 < 0 )
+		return -1;
+
+	Emit(CompiledBody::OP_MOVE, r, r3);
+	PatchToHere(to_end);
+
+	return r;
+	}
+
+int BodyCompiler::CompileCall(const CallExpr* e, bool want_result)
+	{
+	auto fe = e->Func();
+
+	if ( fe->Tag() != EXPR_NAME )
+		return -1;
+
+	auto fid = static_cast<const NameExpr*>(fe)->Id();
+
+	// Only calls of global functions, which can't go away.  Their value
+	// may still get redefined, so it's looked up for every call.
+	if ( ! fid->IsGlobal() || fid->GetType()->Tag() != TYPE_FUNC ||
+	     fid->GetType()->AsFuncType()->Flavor() != FUNC_FLAVOR_FUNCTION )
+		return -1;
+
+	CompiledBody::Call c;
+	c.call = e;
+	c.func = fid;
+	c.result = CompiledBody::KIND_NONE;
+
+	if ( want_result )
+		{
+		c.result = CompiledBody::KindOf(e->GetType().get());
+
+		if ( c.result == CompiledBody::KIND_NONE )
+			return -1;
+		}
+
+	for ( const auto& arg : e->Args()->Exprs() )
+		{
+		CompiledBody::CallArg ca;
+		ca.src = CompiledBody::CallArg::REG;
+		ca.reg = -1;
+		ca.t = arg->GetType().get();
+		ca.id = nullptr;
+		ca.e = arg;
+
+		bool is_unboxed = CompiledBody::KindOf(ca.t) != CompiledBody::KIND_NONE;
+
+		if ( arg->Tag() == EXPR_CONST )
+			{
+			ca.src = CompiledBody::CallArg::CONST;
+			ca.val = {NewRef{}, static_cast<const ConstExpr*>(arg)->Value()};
+			}
+
+		else if ( arg->Tag() == EXPR_NAME &&
+		          ! static_cast<const NameExpr*>(arg)->Id()->IsType() &&
+		          (static_cast<const NameExpr*>(arg)->Id()->IsGlobal() || ! is_unboxed) )
+			{
+			auto id = static_cast<const NameExpr*>(arg)->Id();
+
+			if ( id->IsGlobal() )
+				{
+				ca.src = CompiledBody::CallArg::GLOBAL;
+				ca.id = id;
+				}
+
+			// Other boxed values can only be arguments of the
+			// function, which we never assign to.
+			else if ( IsParam(id->Offset()) )
+				{
+				ca.src = CompiledBody::CallArg::PARAM;
+				ca.reg = id->Offset();
+				}
+
+			else
+				return -1;
+			}
+
+		else
+			{
+			ca.reg = CompileExpr(arg);
+
+			if ( ca.reg < 0 )
+				return -1;
+			}
+
+		c.args.push_back(std::move(ca));
+		}
+
+	cb->calls.push_back(std::move(c));
+
+	int r = want_result ? NewTemp() : -1;
+	Emit(CompiledBody::OP_CALL, r, cb->calls.size() - 1, 0, e);
+
+	// Without a result, anything non-negative signals success.
+	return want_result ? r : 0;
+	}
+
+std::unique_ptr<CompiledBody> CompiledBody::Compile(const Stmt* body, const FuncType* ft,
+                                                    int frame_size)
+	{
+	if ( ft->Flavor() == FUNC_FLAVOR_HOOK )
+		// Hooks need FLOW_BREAK to report their result.
+		return nullptr;
+
+	std::unique_ptr<CompiledBody> cb{new CompiledBody()};
+	BodyCompiler c(cb.get(), ft, frame_size);
+
+	if ( ! c.CompileStmt(body) )
+		return nullptr;
+
+	c.Done();
+	return cb;
+	}
+
+CompiledBody::~CompiledBody() = default;
+
+CompiledBody::Kind CompiledBody::KindOf(const Type* t)
+	{
+	switch ( t->Tag() ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+	case TYPE_ENUM:
+		return KIND_INT;
+
+	case TYPE_COUNT:
+		return KIND_UINT;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		return KIND_DOUBLE;
+
+	default:
+		return KIND_NONE;
+	}
+	}
+
+ValPtr CompiledBody::Box(Reg r, const Type* t)
+	{
+	switch ( t->Tag() ) {
+	case TYPE_BOOL:
+		return val_mgr->Bool(r.i);
+
+	case TYPE_INT:
+		return val_mgr->Int(r.i);
+
+	case TYPE_ENUM:
+		return const_cast<EnumType*>(t->AsEnumType())->GetEnumVal(r.i);
+
+	case TYPE_COUNT:
+		return val_mgr->Count(r.u);
+
+	case TYPE_DOUBLE:
+		return make_intrusive<DoubleVal>(r.d);
+
+	case TYPE_TIME:
+		return make_intrusive<TimeVal>(r.d);
+
+	case TYPE_INTERVAL:
+		return make_intrusive<IntervalVal>(r.d);
+
+	default:
+		reporter->InternalError("bad type in CompiledBody::Box");
+		return nullptr;
+	}
+	}
+
+CompiledBody::Reg CompiledBody::Unbox(const Val* v, Kind k)
+	{
+	Reg r;
+
+	switch ( k ) {
+	case KIND_INT:
+		r.i = v->InternalInt();
+		break;
+
+	case KIND_UINT:
+		r.u = v->InternalUnsigned();
+		break;
+
+	case KIND_DOUBLE:
+		r.d = v->InternalDouble();
+		break;
+
+	default:
+		reporter->InternalError("bad kind in CompiledBody::Unbox");
+	}
+
+	return r;
+	}
+
+CompiledBody::Reg CompiledBody::DoCall(Frame* f, const Call& c, const Reg* r,
+                                       const zeek::Args& args) const
+	{
+	zeek::Args call_args;
+	call_args.reserve(c.args.size());
+
+	for ( const auto& a : c.args )
+		{
+		switch ( a.src ) {
+		case CallArg::REG:
+			call_args.emplace_back(Box(r[a.reg], a.t));
+			break;
+
+		case CallArg::CONST:
+			call_args.emplace_back(a.val);
+			break;
+
+		case CallArg::PARAM:
+			call_args.emplace_back(args[a.reg]);
+			break;
+
+		case CallArg::GLOBAL:
+			{
+			const auto& v = a.id->GetVal();
+
+			if ( ! v )
+				reporter->ExprRuntimeError(a.e, "value used but not set");
+
+			call_args.emplace_back(v);
+			break;
+			}
+		}
+		}
+
+	const auto& fv = c.func->GetVal();
+
+	if ( ! fv )
+		reporter->ExprRuntimeError(c.call->Func(), "value used but not set");
+
+	const CallExpr* current_call = f->GetCall();
+	f->SetCall(c.call);
+	auto ret = fv->AsFunc()->Invoke(&call_args, f);
+	f->SetCall(current_call);
+
+	if ( c.result == KIND_NONE )
+		return {};
+
+	// The interpreter would carry on with no value here, which we
+	// can't represent.
+	if ( ! ret )
+		reporter->ExprRuntimeError(c.call, "function call returned no value");
+
+	return Unbox(ret.get(), c.result);
+	}
+
+ValPtr CompiledBody::Exec(Frame* f, const zeek::Args& args, StmtFlowType& flow) const
+	{
+	constexpr int max_stack_regs = 64;
+
+	Reg stack_regs[max_stack_regs];
+	bool stack_set[max_stack_regs];
+	std::unique_ptr<Reg[]> heap_regs;
+	std::unique_ptr<bool[]> heap_set;
+
+	Reg* r = stack_regs;
+	bool* set = stack_set;
+
+	if ( num_regs > max_stack_regs )
+		{
+		heap_regs.reset(new Reg[num_regs]);
+		heap_set.reset(new bool[num_regs]);
+		r = heap_regs.get();
+		set = heap_set.get();
+		}
+
+	std::fill(set, set + num_regs, false);
+
+	for ( const auto& p : params )
+		{
+		if ( args[p.slot] )
+			r[p.slot] = Unbox(args[p.slot].get(), p.kind);
+		else
+			r[p.slot].u = 0;
+		}
+
+	flow = FLOW_NEXT;
+
+
+#define BIN_OP(tag, field, op) \
+	case tag: r[i->a].field = r[i->b].field op r[i->c].field; break;
+#define CMP_OP(tag, field, op) \
+	case tag: r[i->a].i = r[i->b].field op r[i->c].field; break;
+#define ZERO_CHECKED_OP(tag, field, op, msg) \
+	case tag: \
+		if ( r[i->c].field == 0 ) \
+			reporter->ExprRuntimeError(i->e, msg); \
+		r[i->a].field = r[i->b].field op r[i->c].field; \
+		break;
+
+	for ( int pc = 0; ; ++pc )
+		{
+		const Instr* i = &code[pc];
+
+		switch ( i->op ) {
+		case OP_LOADK:	r[i->a] = i->k; break;
+
+		case OP_MOVE:
+			r[i->a] = r[i->b];
+			set[i->a] = true;
+			break;
+
+		case OP_CHECK_DEF:
+			if ( ! set[i->a] )
+				reporter->ExprRuntimeError(i->e, "value used but not set");
+			break;
+
+		case OP_UNDEF:	set[i->a] = false; break;
+
+		case OP_LOAD_GLOBAL:
+			{
+			const auto& v = globals[i->b]->GetVal();
+
+			if ( ! v )
+				reporter->ExprRuntimeError(i->e, "value used but not set");
+
+			r[i->a] = Unbox(v.get(), static_cast<Kind>(i->c));
+			break;
+			}
+
+		BIN_OP(OP_ADD_I, i, +)
+		BIN_OP(OP_ADD_U, u, +)
+		BIN_OP(OP_ADD_D, d, +)
+		BIN_OP(OP_SUB_I, i, -)
+		BIN_OP(OP_SUB_U, u, -)
+		BIN_OP(OP_SUB_D, d, -)
+		BIN_OP(OP_MUL_I, i, *)
+		BIN_OP(OP_MUL_U, u, *)
+		BIN_OP(OP_MUL_D, d, *)
+		ZERO_CHECKED_OP(OP_DIV_I, i, /, "division by zero")
+		ZERO_CHECKED_OP(OP_DIV_U, u, /, "division by zero")
+		ZERO_CHECKED_OP(OP_DIV_D, d, /, "division by zero")
+		ZERO_CHECKED_OP(OP_MOD_I, i, %, "modulo by zero")
+		ZERO_CHECKED_OP(OP_MOD_U, u, %, "modulo by zero")
+		BIN_OP(OP_AND_U, u, &)
+		BIN_OP(OP_OR_U, u, |)
+		BIN_OP(OP_XOR_U, u, ^)
+
+		CMP_OP(OP_LT_I, i, <)
+		CMP_OP(OP_LT_U, u, <)
+		CMP_OP(OP_LT_D, d, <)
+		CMP_OP(OP_LE_I, i, <=)
+		CMP_OP(OP_LE_U, u, <=)
+		CMP_OP(OP_LE_D, d, <=)
+		CMP_OP(OP_EQ_I, i, ==)
+		CMP_OP(OP_EQ_U, u, ==)
+		CMP_OP(OP_EQ_D, d, ==)
+		CMP_OP(OP_NE_I, i, !=)
+		CMP_OP(OP_NE_U, u, !=)
+		CMP_OP(OP_NE_D, d, !=)
+
+		case OP_NOT:	r[i->a].i = ! r[i->b].i; break;
+		case OP_NEG_I:	r[i->a].i = - r[i->b].i; break;
+		case OP_NEG_D:	r[i->a].d = - r[i->b].d; break;
+		case OP_COMPL_U:	r[i->a].u = ~ r[i->b].u; break;
+		case OP_I2D:	r[i->a].d = r[i->b].i; break;
+		case OP_U2D:	r[i->a].d = r[i->b].u; break;
+		case OP_D2I:	r[i->a].i = static_cast<bro_int_t>(r[i->b].d); break;
+		case OP_D2U:	r[i->a].u = static_cast<bro_uint_t>(r[i->b].d); break;
+
+		case OP_INCR_I:	++r[i->a].i; break;
+		case OP_INCR_U:	++r[i->a].u; break;
+		case OP_DECR_I:	--r[i->a].i; break;
+
+		case OP_DECR_U:
+			if ( r[i->a].u == 0 )
+				reporter->ExprRuntimeError(i->e, "count underflow");
+
+			--r[i->a].u;
+			break;
+
+		case OP_JMP:
+			pc = i->a - 1;
+			break;
+
+		case OP_JMP_FALSE:
+			if ( r[i->b].i == 0 )
+				pc = i->a - 1;
+			break;
+
+		case OP_JMP_TRUE:
+			if ( r[i->b].i != 0 )
+				pc = i->a - 1;
+			break;
+
+		case OP_CALL:
+			{
+			auto res = DoCall(f, calls[i->b], r, args);
+
+			if ( i->a >= 0 )
+				r[i->a] = res;
+
+			break;
+			}
+
+		case OP_RETURN:
+			flow = FLOW_RETURN;
+			return Box(r[i->b], i->t);
+
+		case OP_RETURN_VOID:
+			flow = FLOW_RETURN;
+			return nullptr;
+
+		case OP_END:
+			return nullptr;
+		}
+		}
+
+#undef BIN_OP
+#undef CMP_OP
+#undef ZERO_CHECKED_OP
+	}
+
+} // namespace zeek::detail
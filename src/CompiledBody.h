@@ -0,0 +1,140 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// An optional execution tier that runs script function bodies as compact
+// register-based instruction sequences rather than walking their syntax
+// trees.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "zeek/IntrusivePtr.h"
+#include "zeek/StmtEnums.h"
+#include "zeek/ZeekArgs.h"
+#include "zeek/util.h"
+
+ZEEK_FORWARD_DECLARE_NAMESPACED(Val, zeek);
+ZEEK_FORWARD_DECLARE_NAMESPACED(Type, zeek);
+ZEEK_FORWARD_DECLARE_NAMESPACED(FuncType, zeek);
+ZEEK_FORWARD_DECLARE_NAMESPACED(Frame, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(Stmt, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(Expr, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(CallExpr, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(ID, zeek::detail);
+
+namespace zeek {
+using ValPtr = IntrusivePtr<Val>;
+}
+
+namespace zeek::detail {
+
+class BodyCompiler;
+
+/**
+ * A script function body lowered to a sequence of instructions operating
+ * on unboxed registers.  The function's frame slots map directly onto
+ * registers, followed by temporaries, so that local variables of atomic
+ * types never get boxed into Vals.  Values get boxed only where they leave
+ * the body: as call arguments and as the return value.
+ *
+ * Only a subset of the language compiles; see Compile().
+ */
+class CompiledBody {
+public:
+	/**
+	 * Lowers a function body.
+	 *
+	 * @param body  The body to compile.
+	 *
+	 * @param ft  The type of the function the body belongs to.
+	 *
+	 * @param frame_size  The number of frame slots the body uses.
+	 *
+	 * @return  The compiled body, or nullptr if the body uses constructs
+	 * that aren't supported: anything beyond assignments to, and
+	 * arithmetic, comparisons and logic on, locals of bool, int, count,
+	 * double, time, interval and enum types, plus if, while, return and
+	 * function calls.  Other arguments of the function may be passed on
+	 * to calls.  Hooks don't compile.
+	 */
+	static std::unique_ptr<CompiledBody> Compile(const Stmt* body, const FuncType* ft,
+	                                             int frame_size);
+
+	~CompiledBody();
+
+	/**
+	 * Runs the body.  Has the same interface as Stmt::Exec(), except that
+	 * it takes the function's arguments from args rather than from the
+	 * frame.  The frame only serves as the parent of calls.
+	 */
+	ValPtr Exec(Frame* f, const zeek::Args& args, StmtFlowType& flow) const;
+
+	/**
+	 * Returns the number of instructions, for debugging output.
+	 */
+	size_t NumInstructions() const	{ return code.size(); }
+
+private:
+	friend class BodyCompiler;
+
+	union Reg {
+		bro_int_t i;
+		bro_uint_t u;
+		double d;
+	};
+
+	// The internal representation of a register's value.
+	enum Kind { KIND_INT, KIND_UINT, KIND_DOUBLE, KIND_NONE };
+
+	enum Op : uint8_t;
+
+	struct Instr {
+		Op op;
+		int a;
+		int b;
+		int c;
+		Reg k;	// Immediate operand.
+		const Expr* e;	// Origin, for run-time errors.
+		const Type* t;	// Type to box into, where needed.
+	};
+
+	// An argument of a call.
+	struct CallArg {
+		enum { REG, CONST, PARAM, GLOBAL } src;
+		int reg;	// Register or frame slot.
+		const Type* t;	// Type of a register value.
+		ValPtr val;	// Constant value.
+		const ID* id;	// Global.
+		const Expr* e;	// Origin, for run-time errors.
+	};
+
+	struct Call {
+		const CallExpr* call;
+		const ID* func;
+		Kind result;	// KIND_NONE if the result goes unused.
+		std::vector<CallArg> args;
+	};
+
+	// A function parameter that gets unboxed on entry.
+	struct Param {
+		int slot;
+		Kind kind;
+	};
+
+	CompiledBody() = default;
+
+	static Kind KindOf(const Type* t);
+	static ValPtr Box(Reg r, const Type* t);
+	static Reg Unbox(const Val* v, Kind k);
+
+	Reg DoCall(Frame* f, const Call& c, const Reg* r, const zeek::Args& args) const;
+
+	std::vector<Instr> code;
+	std::vector<Call> calls;
+	std::vector<const ID*> globals;
+	std::vector<Param> params;
+	int num_regs = 0;
+};
+
+} // namespace zeek::detail
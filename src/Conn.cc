@@ -4,6 +4,7 @@
 #include "zeek/Conn.h"
 
 #include <ctype.h>
+#include <map>
 #include <binpac.h>
 
 #include "zeek/Desc.h"
@@ -56,11 +57,214 @@ void ConnectionTimer::Dispatch(double t, bool is_expire)
 		reporter->InternalError("reference count inconsistency in ConnectionTimer::Dispatch");
 	}
 
+// The connections that share an inactivity timeout, ordered by when they
+// expire.  A single timer fires at the expiration of the head, so activity
+// only moves a connection within the list instead of rescheduling a timer
+// per connection.
+class InactivityQueue {
+public:
+	explicit InactivityQueue(double arg_timeout) : timeout(arg_timeout)	{ }
+
+	// Links a connection at its place, normally the tail.
+	void Insert(Connection* c);
+
+	void Remove(Connection* c);
+
+	// Times out the connections that expire by t.
+	void Expire(double t);
+
+	// Makes sure that a timer is pending for the head.
+	void Schedule();
+
+	double timeout;
+	Connection* head = nullptr;
+	Connection* tail = nullptr;
+	Timer* timer = nullptr;
+	bool expiring = false;
+};
+
+class InactivityQueueTimer final : public Timer {
+public:
+	InactivityQueueTimer(InactivityQueue* arg_queue, double t)
+		: Timer(t, TIMER_CONN_INACTIVITY), queue(arg_queue)	{ }
+
+	void Dispatch(double t, bool is_expire) override;
+
+private:
+	InactivityQueue* queue;
+};
+
+// The queues by their timeouts.  std::map keeps the queues at fixed
+// addresses.
+static std::map<double, InactivityQueue> inactivity_queues;
+
+// Drops a queue once its last connection has left it.
+static void release_inactivity_queue(InactivityQueue* q)
+	{
+	if ( q->head || q->expiring )
+		return;
+
+	if ( q->timer )
+		timer_mgr->Cancel(q->timer);
+
+	inactivity_queues.erase(q->timeout);
+	}
+
+void InactivityQueue::Insert(Connection* c)
+	{
+	// Activity is mostly in order, so the place is nearly always at the
+	// tail.
+	Connection* prev = tail;
+
+	while ( prev && prev->last_time > c->last_time )
+		prev = prev->inactivity_prev;
+
+	c->inactivity_queue = this;
+	c->inactivity_prev = prev;
+	c->inactivity_next = prev ? prev->inactivity_next : head;
+
+	if ( c->inactivity_next )
+		c->inactivity_next->inactivity_prev = c;
+	else
+		tail = c;
+
+	if ( prev )
+		prev->inactivity_next = c;
+	else
+		{
+		head = c;
+
+		// A pending timer for a later head would fire too late.
+		if ( timer && timer->Time() > c->last_time + timeout )
+			{
+			timer_mgr->Cancel(timer);
+			timer = nullptr;
+			}
+		}
+
+	Schedule();
+	}
+
+void InactivityQueue::Remove(Connection* c)
+	{
+	if ( c->inactivity_prev )
+		c->inactivity_prev->inactivity_next = c->inactivity_next;
+	else
+		head = c->inactivity_next;
+
+	if ( c->inactivity_next )
+		c->inactivity_next->inactivity_prev = c->inactivity_prev;
+	else
+		tail = c->inactivity_prev;
+
+	c->inactivity_queue = nullptr;
+	c->inactivity_prev = c->inactivity_next = nullptr;
+	}
+
+void InactivityQueue::Expire(double t)
+	{
+	expiring = true;
+
+	while ( head && head->last_time + timeout <= t )
+		{
+		Connection* c = head;
+		Remove(c);
+
+		Ref(c);
+		c->Event(connection_timeout, nullptr);
+		c->sessions->Remove(c);
+		++killed_by_inactivity;
+		Unref(c);
+		}
+
+	expiring = false;
+	Schedule();
+	}
+
+void InactivityQueue::Schedule()
+	{
+	if ( timer || ! head )
+		return;
+
+	timer = new InactivityQueueTimer(this, head->last_time + timeout);
+	timer_mgr->Add(timer);
+	}
+
+void InactivityQueueTimer::Dispatch(double t, bool is_expire)
+	{
+	queue->timer = nullptr;
+
+	// Like other inactivity, pending timeouts don't get flushed at
+	// termination.
+	if ( is_expire )
+		return;
+
+	// Only time out the connections that were due when this timer was,
+	// so that the later ones interleave with other timers just like
+	// timers of their own would.  Activity since scheduling the timer
+	// lets Expire() move it to the new head.
+	queue->Expire(Time());
+	release_inactivity_queue(queue);
+	}
+
 } // namespace detail
 
 uint64_t Connection::total_connections = 0;
 uint64_t Connection::current_connections = 0;
 
+// Connection slabs, see operator new/delete below.  Slots of deleted
+// connections get reused but never returned, as some long-lived
+// connection usually keeps a slab from draining anyway.
+static constexpr size_t CONNECTIONS_PER_SLAB = 256;
+
+struct FreeConnection {
+	FreeConnection* next;
+};
+
+static FreeConnection* free_connections = nullptr;
+static uint64_t num_free_connections = 0;
+static char* slab_tail = nullptr;	// The slab's never-used slots.
+static size_t slab_tail_size = 0;
+
+void* Connection::operator new(size_t size)
+	{
+	if ( size != sizeof(Connection) )
+		return ::operator new(size);
+
+	if ( free_connections )
+		{
+		void* ptr = free_connections;
+		free_connections = free_connections->next;
+		--num_free_connections;
+		return ptr;
+		}
+
+	if ( slab_tail_size == 0 )
+		{
+		slab_tail = static_cast<char*>(::operator new(CONNECTIONS_PER_SLAB * sizeof(Connection)));
+		slab_tail_size = CONNECTIONS_PER_SLAB;
+		}
+
+	void* ptr = slab_tail;
+	slab_tail += sizeof(Connection);
+	--slab_tail_size;
+	return ptr;
+	}
+
+void Connection::operator delete(void* ptr, size_t size)
+	{
+	if ( size != sizeof(Connection) )
+		{
+		::operator delete(ptr);
+		return;
+		}
+
+	auto fc = static_cast<FreeConnection*>(ptr);
+	fc->next = free_connections;
+	free_connections = fc;
+	++num_free_connections;
+	}
+
 Connection::Connection(NetSessions* s, const detail::ConnIDKey& k, double t,
                        const ConnID* id, uint32_t flow, const Packet* pkt,
                        const EncapsulationStack* arg_encap)
@@ -98,12 +302,17 @@ Connection::Connection(NetSessions* s, const detail::ConnIDKey& k, double t,
 	weird = 0;
 
 	suppress_event = 0;
+	sample_weight = 1;
+	open_transactions = 0;
+	lingering_timeout = 0.0;
 
 	record_contents = record_packets = 1;
 	record_current_packet = record_current_content = 0;
 
 	timers_canceled = 0;
 	inactivity_timeout = 0;
+	inactivity_queue = nullptr;
+	inactivity_prev = inactivity_next = nullptr;
 	installed_status_timer = 0;
 
 	finished = 0;
@@ -111,6 +320,8 @@ Connection::Connection(NetSessions* s, const detail::ConnIDKey& k, double t,
 	hist_seen = 0;
 	history = "";
 
+	conn_val_times_dirty = conn_val_history_dirty = conn_val_analyzers_dirty = 1;
+
 	root_analyzer = nullptr;
 	primary_PIA = nullptr;
 
@@ -207,12 +418,18 @@ void Connection::NextPacket(double t, bool is_orig,
 		{
 		record_current_packet = record_packet;
 		record_current_content = record_content;
+
+		// Analyzers may update the connection record both before
+		// and after any event of the packet builds it.
+		conn_val_analyzers_dirty = 1;
 		root_analyzer->NextPacket(len, data, is_orig, -1, ip, caplen);
+		conn_val_analyzers_dirty = 1;
+
 		record_packet = record_current_packet;
 		record_content = record_current_content;
 		}
 	else
-		last_time = t;
+		SetLastTime(t);
 
 	run_state::current_timestamp = 0;
 	run_state::current_pkt = nullptr;
@@ -280,18 +497,17 @@ void Connection::DeleteTimer(double /* t */)
 	sessions->Remove(this);
 	}
 
-void Connection::InactivityTimer(double t)
+void Connection::UpdateInactivity()
 	{
-	if ( last_time + inactivity_timeout <= t )
-		{
-		Event(connection_timeout, nullptr);
-		sessions->Remove(this);
-		++detail::killed_by_inactivity;
-		}
-	else
-		ADD_TIMER(&Connection::InactivityTimer,
-		          last_time + inactivity_timeout, 0,
-		          detail::TIMER_CONN_INACTIVITY);
+	// Nothing to do if the connection remains in order, as it does for
+	// nearly every packet.
+	if ( (! inactivity_next || inactivity_next->last_time >= last_time) &&
+	     (! inactivity_prev || inactivity_prev->last_time <= last_time) )
+		return;
+
+	auto q = inactivity_queue;
+	q->Remove(this);
+	q->Insert(this);
 	}
 
 void Connection::RemoveConnectionTimer(double t)
@@ -305,19 +521,50 @@ void Connection::SetInactivityTimeout(double timeout)
 	if ( timeout == inactivity_timeout )
 		return;
 
-	// First cancel and remove any existing inactivity timer.
-	for ( const auto& timer : timers )
-		if ( timer->Type() == detail::TIMER_CONN_INACTIVITY )
-			{
-			detail::timer_mgr->Cancel(timer);
-			break;
-			}
-
-	if ( timeout )
-		ADD_TIMER(&Connection::InactivityTimer,
-		          last_time + timeout, 0, detail::TIMER_CONN_INACTIVITY);
+	// First leave the queue of the old timeout.
+	if ( inactivity_queue )
+		{
+		auto q = inactivity_queue;
+		q->Remove(this);
+		detail::release_inactivity_queue(q);
+		}
 
 	inactivity_timeout = timeout;
+
+	// Like AddTimer(), don't start timing out connections that are on
+	// their way out.
+	if ( timeout && ! timers_canceled && key_valid )
+		{
+		auto it = detail::inactivity_queues.try_emplace(timeout, timeout).first;
+		it->second.Insert(this);
+		}
+	}
+
+void Connection::TransactionStarted()
+	{
+	++open_transactions;
+
+	if ( lingering_timeout > 0.0 )
+		{
+		SetInactivityTimeout(lingering_timeout);
+		lingering_timeout = 0.0;
+		}
+	}
+
+void Connection::TransactionFinished()
+	{
+	// Ignore responses to requests we didn't see.
+	if ( ! open_transactions || --open_transactions > 0 )
+		return;
+
+	double linger = BifConst::udp_transaction_linger;
+
+	if ( proto != TRANSPORT_UDP || linger <= 0.0 || lingering_timeout > 0.0 ||
+	     inactivity_timeout == 0.0 || inactivity_timeout <= linger )
+		return;
+
+	lingering_timeout = inactivity_timeout;
+	SetInactivityTimeout(linger);
 	}
 
 void Connection::EnableStatusUpdateTimer()
@@ -351,64 +598,85 @@ const RecordValPtr& Connection::ConnVal()
 	{
 	if ( ! conn_val )
 		{
+		const auto& cf = id::field::connection;
+		const auto& ef = id::field::endpoint;
+		const auto& idf = id::field::conn_id;
+
 		conn_val = make_intrusive<RecordVal>(id::connection);
 
 		TransportProto prot_type = ConnTransport();
 
 		auto id_val = make_intrusive<RecordVal>(id::conn_id);
-		id_val->Assign(0, make_intrusive<AddrVal>(orig_addr));
-		id_val->Assign(1, val_mgr->Port(ntohs(orig_port), prot_type));
-		id_val->Assign(2, make_intrusive<AddrVal>(resp_addr));
-		id_val->Assign(3, val_mgr->Port(ntohs(resp_port), prot_type));
+		id_val->AssignAddr(idf.orig_h, orig_addr);
+		id_val->Assign(idf.orig_p, val_mgr->Port(ntohs(orig_port), prot_type));
+		id_val->AssignAddr(idf.resp_h, resp_addr);
+		id_val->Assign(idf.resp_p, val_mgr->Port(ntohs(resp_port), prot_type));
 
 		auto orig_endp = make_intrusive<RecordVal>(id::endpoint);
-		orig_endp->Assign(0, val_mgr->Count(0));
-		orig_endp->Assign(1, val_mgr->Count(0));
-		orig_endp->Assign(4, val_mgr->Count(orig_flow_label));
+		orig_endp->AssignCount(ef.size, 0);
+		orig_endp->AssignCount(ef.state, 0);
+		orig_endp->AssignCount(ef.flow_label, orig_flow_label);
 
 		const int l2_len = sizeof(orig_l2_addr);
 		char null[l2_len]{};
 
 		if ( memcmp(&orig_l2_addr, &null, l2_len) != 0 )
-			orig_endp->Assign(5, make_intrusive<StringVal>(fmt_mac(orig_l2_addr, l2_len)));
+			orig_endp->Assign(ef.l2_addr, make_intrusive<StringVal>(fmt_mac(orig_l2_addr, l2_len)));
 
 		auto resp_endp = make_intrusive<RecordVal>(id::endpoint);
-		resp_endp->Assign(0, val_mgr->Count(0));
-		resp_endp->Assign(1, val_mgr->Count(0));
-		resp_endp->Assign(4, val_mgr->Count(resp_flow_label));
+		resp_endp->AssignCount(ef.size, 0);
+		resp_endp->AssignCount(ef.state, 0);
+		resp_endp->AssignCount(ef.flow_label, resp_flow_label);
 
 		if ( memcmp(&resp_l2_addr, &null, l2_len) != 0 )
-			resp_endp->Assign(5, make_intrusive<StringVal>(fmt_mac(resp_l2_addr, l2_len)));
+			resp_endp->Assign(ef.l2_addr, make_intrusive<StringVal>(fmt_mac(resp_l2_addr, l2_len)));
 
-		conn_val->Assign(0, std::move(id_val));
-		conn_val->Assign(1, std::move(orig_endp));
-		conn_val->Assign(2, std::move(resp_endp));
-		// 3 and 4 are set below.
-		conn_val->Assign(5, make_intrusive<TableVal>(id::string_set));	// service
-		conn_val->Assign(6, val_mgr->EmptyString());	// history
+		conn_val->Assign(cf.id, std::move(id_val));
+		conn_val->Assign(cf.orig, std::move(orig_endp));
+		conn_val->Assign(cf.resp, std::move(resp_endp));
+		// The start time and duration are set below.
+		conn_val->Assign(cf.service, make_intrusive<TableVal>(id::string_set));
+		conn_val->Assign(cf.history, val_mgr->EmptyString());
 
 		if ( ! uid )
 			uid.Set(zeek::detail::bits_per_uid);
 
-		conn_val->Assign(7, make_intrusive<StringVal>(uid.Base62("C").c_str()));
+		conn_val->Assign(cf.uid, make_intrusive<StringVal>(uid.Base62("C").c_str()));
 
 		if ( encapsulation && encapsulation->Depth() > 0 )
-			conn_val->Assign(8, encapsulation->ToVal());
+			conn_val->Assign(cf.tunnel, encapsulation->ToVal());
 
 		if ( vlan != 0 )
-			conn_val->Assign(9, val_mgr->Int(vlan));
+			conn_val->AssignInt(cf.vlan, vlan);
 
 		if ( inner_vlan != 0 )
-			conn_val->Assign(10, val_mgr->Int(inner_vlan));
+			conn_val->AssignInt(cf.inner_vlan, inner_vlan);
 
+		conn_val_times_dirty = conn_val_history_dirty = conn_val_analyzers_dirty = 1;
 		}
 
-	if ( root_analyzer )
-		root_analyzer->UpdateConnVal(conn_val.get());
+	// Events often come several per packet, and all but the first of
+	// them find nothing to update.
+	if ( conn_val_analyzers_dirty )
+		{
+		if ( root_analyzer )
+			root_analyzer->UpdateConnVal(conn_val.get());
 
-	conn_val->Assign(3, make_intrusive<TimeVal>(start_time));	// ###
-	conn_val->Assign(4, make_intrusive<IntervalVal>(last_time - start_time));
-	conn_val->Assign(6, make_intrusive<StringVal>(history.c_str()));
+		conn_val_analyzers_dirty = 0;
+		}
+
+	if ( conn_val_times_dirty )
+		{
+		conn_val->AssignTime(id::field::connection.start_time, start_time);
+		conn_val->AssignInterval(id::field::connection.duration, last_time - start_time);
+		conn_val_times_dirty = 0;
+		}
+
+	if ( conn_val_history_dirty )
+		{
+		conn_val->Assign(id::field::connection.history, make_intrusive<StringVal>(history));
+		conn_val_history_dirty = 0;
+		}
 
 	conn_val->SetOrigin(this);
 
@@ -434,10 +702,11 @@ void Connection::AppendAddl(const char* str)
 	{
 	const auto& cv = ConnVal();
 
-	const char* old = cv->GetField(6)->AsString()->CheckString();
+	const auto history = id::field::connection.history;
+	const char* old = cv->GetField(history)->AsString()->CheckString();
 	const char* format = *old ? "%s %s" : "%s%s";
 
-	cv->Assign(6, make_intrusive<StringVal>(util::fmt(format, old, str)));
+	cv->Assign(history, make_intrusive<StringVal>(util::fmt(format, old, str)));
 	}
 
 // Returns true if the character at s separates a version number.
@@ -533,12 +802,26 @@ void Connection::EnqueueEvent(EventHandlerPtr f, analyzer::Analyzer* a,
 	event_mgr.Enqueue(f, std::move(args), util::detail::SOURCE_LOCAL, a ? a->GetID() : 0, this);
 	}
 
+void Connection::EnqueueEventLazy(EventHandlerPtr f, analyzer::Analyzer* a,
+                                  ArgsGenerator args_gen)
+	{
+	// Being the cookie keeps us around for the generator.
+	event_mgr.EnqueueLazy(f, std::move(args_gen), util::detail::SOURCE_LOCAL,
+	                      a ? a->GetID() : 0, this);
+	}
+
 void Connection::Weird(const char* name, const char* addl, const char* source)
 	{
 	weird = 1;
 	reporter->Weird(this, name, addl ? addl : "", source ? source : "");
 	}
 
+void Connection::Weird(const detail::WeirdName& name, const char* addl, const char* source)
+	{
+	weird = 1;
+	reporter->Weird(this, name, addl ? addl : "", source ? source : "");
+	}
+
 void Connection::AddTimer(timer_func timer, double t, bool do_expire,
                           detail::TimerType type)
 	{
@@ -573,6 +856,13 @@ void Connection::CancelTimers()
 	for ( const auto& timer : tmp )
 		detail::timer_mgr->Cancel(timer);
 
+	if ( inactivity_queue )
+		{
+		auto q = inactivity_queue;
+		q->Remove(this);
+		detail::release_inactivity_queue(q);
+		}
+
 	timers_canceled = 1;
 	timers.clear();
 	}
@@ -621,6 +911,36 @@ unsigned int Connection::MemoryAllocation() const
 		;
 	}
 
+void Connection::AddMemoryUsage(analyzer::MemoryReport* report) const
+	{
+	auto& usage = (*report)["Connection"];
+	++usage.instances;
+	usage.bytes += padded_sizeof(*this)
+		+ (timers.MemoryAllocation() - padded_sizeof(timers));
+
+	if ( conn_val )
+		{
+		auto& val_usage = (*report)["conn_val"];
+		++val_usage.instances;
+		val_usage.bytes += conn_val->MemoryAllocation();
+		}
+
+	if ( root_analyzer )
+		root_analyzer->AddMemoryUsage(report);
+	}
+
+void Connection::AddFreeMemoryUsage(analyzer::MemoryReport* report)
+	{
+	auto num_slots = num_free_connections + slab_tail_size;
+
+	if ( num_slots == 0 )
+		return;
+
+	auto& usage = (*report)["free Connection slots"];
+	usage.instances += num_slots;
+	usage.bytes += num_slots * sizeof(Connection);
+	}
+
 unsigned int Connection::MemoryAllocationConnVal() const
 	{
 	return conn_val ? conn_val->MemoryAllocation() : 0;
@@ -699,8 +1019,9 @@ void Connection::CheckFlowLabel(bool is_orig, uint32_t flow_label)
 		{
 		if ( conn_val )
 			{
-			RecordVal* endp = conn_val->GetField(is_orig ? 1 : 2)->AsRecordVal();
-			endp->Assign(4, val_mgr->Count(flow_label));
+			const auto& cf = id::field::connection;
+			RecordVal* endp = conn_val->GetField(is_orig ? cf.orig : cf.resp)->AsRecordVal();
+			endp->AssignCount(id::field::endpoint.flow_label, flow_label);
 			}
 
 		if ( connection_flow_label_changed &&
@@ -723,10 +1044,16 @@ void Connection::CheckFlowLabel(bool is_orig, uint32_t flow_label)
 		saw_first_resp_packet = 1;
 	}
 
+bool Connection::PermitWeird(uint32_t id, uint64_t threshold, uint64_t rate,
+                             double duration)
+	{
+	return detail::PermitWeird(weird_state, id, threshold, rate, duration);
+	}
+
 bool Connection::PermitWeird(const char* name, uint64_t threshold, uint64_t rate,
                              double duration)
 	{
-	return detail::PermitWeird(weird_state, name, threshold, rate, duration);
+	return PermitWeird(reporter->WeirdID(name), threshold, rate, duration);
 	}
 
 } // namespace zeek
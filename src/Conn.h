@@ -23,6 +23,7 @@
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(Connection, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(ConnectionTimer, zeek::detail);
+namespace zeek::detail { class InactivityQueue; }
 ZEEK_FORWARD_DECLARE_NAMESPACED(NetSessions, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(EncapsulationStack, zeek);
 
@@ -108,9 +109,16 @@ public:
 	bool IsKeyValid() const			{ return key_valid; }
 
 	double StartTime() const		{ return start_time; }
-	void SetStartTime(double t)		{ start_time = t; }
+	void SetStartTime(double t)		{ start_time = t; conn_val_times_dirty = 1; }
 	double LastTime() const			{ return last_time; }
-	void SetLastTime(double t) 		{ last_time = t; }
+	void SetLastTime(double t)
+		{
+		last_time = t;
+		conn_val_times_dirty = 1;
+
+		if ( inactivity_queue )
+			UpdateInactivity();
+		}
 
 	const IPAddr& OrigAddr() const		{ return orig_addr; }
 	const IPAddr& RespAddr() const		{ return resp_addr; }
@@ -151,6 +159,11 @@ public:
 	void SetSkip(bool do_skip)		{ skip = do_skip ? 1 : 0; }
 	bool Skipping() const			{ return skip; }
 
+	// When flow sampling is active, the number of flows this one stands
+	// for, i.e., the sampling rate in effect when it got created.
+	uint32_t SampleWeight() const		{ return sample_weight; }
+	void SetSampleWeight(uint32_t w)	{ sample_weight = w; }
+
 	// Arrange for the connection to expire after the given amount of time.
 	void SetLifetime(double lifetime);
 
@@ -163,6 +176,13 @@ public:
 	void SetInactivityTimeout(double timeout);
 	double InactivityTimeout() const	{ return inactivity_timeout; }
 
+	// Count the connection's request/response exchanges, as analyzers
+	// recognize them.  Once a UDP connection has none open anymore, it
+	// times out after udp_transaction_linger rather than its inactivity
+	// timeout, until the next request.
+	void TransactionStarted();
+	void TransactionFinished();
+
 	// Activate connection_status_update timer.
 	void EnableStatusUpdateTimer();
 
@@ -170,10 +190,20 @@ public:
 	RecordVal* BuildConnVal();
 
 	/**
-	 * Returns the associated "connection" record.
+	 * Returns the associated "connection" record.  The record gets built
+	 * at the first call, and later calls only update the fields that
+	 * changed since the previous one.
 	 */
 	const RecordValPtr& ConnVal();
 
+	/**
+	 * Makes the next ConnVal() have the analyzers update their fields of
+	 * the record.  That happens anyway after each packet, so only
+	 * analyzers that change what goes into the record at other times,
+	 * such as in timers, need to call this.
+	 */
+	void ConnValChanged()	{ conn_val_analyzers_dirty = 1; }
+
 	void AppendAddl(const char* str);
 
 	void Match(detail::Rule::PatternType type, const u_char* data, int len,
@@ -236,9 +266,18 @@ public:
 		std::is_convertible_v<
 			std::tuple_element_t<0, std::tuple<Args...>>, ValPtr>>
 	EnqueueEvent(EventHandlerPtr h, analyzer::Analyzer* analyzer, Args&&... args)
-		{ return EnqueueEvent(h, analyzer, zeek::Args{std::forward<Args>(args)...}); }
+		{ return EnqueueEvent(h, analyzer, make_args(std::forward<Args>(args)...)); }
+
+	/**
+	 * Enqueues an event associated with this connection and given
+	 * analyzer, whose arguments get built only once it's dispatched.
+	 * The generator may use the connection, e.g. for its ConnVal().
+	 */
+	void EnqueueEventLazy(EventHandlerPtr f, analyzer::Analyzer* analyzer,
+	                      ArgsGenerator args_gen);
 
 	void Weird(const char* name, const char* addl = "", const char* source = "");
+	void Weird(const detail::WeirdName& name, const char* addl = "", const char* source = "");
 	bool DidWeird() const	{ return weird != 0; }
 
 	// Cancel all associated timers.
@@ -263,6 +302,27 @@ public:
 
 	// Just a lower bound.
 	unsigned int MemoryAllocation() const;
+
+	/**
+	 * Adds the memory of the connection, its record and its analyzers to
+	 * a report.  The connection's own share appears as "Connection", its
+	 * record's as "conn_val".
+	 *
+	 * @param report The report to add to.
+	 */
+	void AddMemoryUsage(analyzer::MemoryReport* report) const;
+
+	/**
+	 * Adds the memory of allocated but currently unused connection slots
+	 * to a report, as "free Connection slots".
+	 */
+	static void AddFreeMemoryUsage(analyzer::MemoryReport* report);
+
+	// Instances get carved from slabs and recycled through a free list,
+	// which keeps them dense and saves the allocator's per-object
+	// overhead.
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr, size_t size);
 	unsigned int MemoryAllocationConnVal() const;
 
 	static uint64_t TotalConnections()
@@ -294,7 +354,19 @@ public:
 	void HistoryThresholdEvent(EventHandlerPtr e, bool is_orig,
 	                           uint32_t threshold);
 
-	void AddHistory(char code)	{ history += code; }
+	void AddHistory(char code)	{ history += code; conn_val_history_dirty = 1; }
+
+	const std::string& History() const	{ return history; }
+	uint32_t HistorySeen() const	{ return hist_seen; }
+
+	// Restores the history of a connection that another process
+	// handed off, along with the mask of the codes it has seen.
+	void SetHistory(uint32_t seen, std::string h)
+		{
+		hist_seen = seen;
+		history = std::move(h);
+		conn_val_history_dirty = 1;
+		}
 
 	void DeleteTimer(double t);
 
@@ -318,6 +390,10 @@ public:
 	uint32_t GetOrigFlowLabel() { return orig_flow_label; }
 	uint32_t GetRespFlowLabel() { return resp_flow_label; }
 
+	bool PermitWeird(uint32_t id, uint64_t threshold, uint64_t rate,
+	                 double duration);
+
+	[[deprecated("Remove in v5.1. Use PermitWeird() with the name's Reporter::WeirdID().")]]
 	bool PermitWeird(const char* name, uint64_t threshold, uint64_t rate,
 	                 double duration);
 
@@ -333,14 +409,20 @@ protected:
 
 	// Allow other classes to access pointers to these:
 	friend class detail::ConnectionTimer;
+	friend class detail::InactivityQueue;
+
+	// Moves the connection to its place in its inactivity queue after
+	// its last activity changed.
+	void UpdateInactivity();
 
-	void InactivityTimer(double t);
 	void StatusUpdateTimer(double t);
 	void RemoveConnectionTimer(double t);
 
+	// Members are ordered to avoid padding, with the small ones
+	// filling the gaps the larger ones leave.
 	NetSessions* sessions;
 	detail::ConnIDKey key;
-	bool key_valid;
+	uint32_t hist_seen;
 
 	TimerPList timers;
 
@@ -354,10 +436,21 @@ protected:
 	u_char resp_l2_addr[Packet::L2_ADDR_LEN];	// Link-layer responder address, if available
 	double start_time, last_time;
 	double inactivity_timeout;
+
+	// The connections with the same inactivity timeout, ordered by their
+	// last activity, which share a single timer.
+	detail::InactivityQueue* inactivity_queue;
+	Connection* inactivity_prev;
+	Connection* inactivity_next;
+
 	RecordValPtr conn_val;
 	std::shared_ptr<EncapsulationStack> encapsulation; // tunnels
 	int suppress_event;	// suppress certain events to once per conn.
+	uint32_t sample_weight;	// flows this one represents when sampling
+	uint32_t open_transactions;	// see TransactionStarted()
+	double lingering_timeout;	// inactivity timeout to return to, if lingering
 
+	unsigned int key_valid:1;
 	unsigned int installed_status_timer:1;
 	unsigned int timers_canceled:1;
 	unsigned int is_active:1;
@@ -368,12 +461,15 @@ protected:
 	unsigned int record_current_packet:1, record_current_content:1;
 	unsigned int saw_first_orig_packet:1, saw_first_resp_packet:1;
 
+	// Which fields of conn_val are out of date.
+	unsigned int conn_val_times_dirty:1, conn_val_history_dirty:1;
+	unsigned int conn_val_analyzers_dirty:1;
+
 	// Count number of connections.
 	static uint64_t total_connections;
 	static uint64_t current_connections;
 
 	std::string history;
-	uint32_t hist_seen;
 
 	analyzer::TransportLayerAnalyzer* root_analyzer;
 	analyzer::pia::PIA* primary_PIA;
@@ -0,0 +1,191 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/ConnHandoff.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "zeek/Conn.h"
+#include "zeek/NetVar.h"
+#include "zeek/util.h"
+
+namespace zeek::detail {
+
+static const char magic[8] = {'Z', 'E', 'E', 'K', 'H', 'O', 'F', '1'};
+
+struct Header {
+	char magic[8];
+	uint64_t entry_size;	// Guards against a different version's layout.
+	uint64_t num_entries;
+};
+
+static double inactivity_timeout(TransportProto proto)
+	{
+	switch ( proto ) {
+	case TRANSPORT_TCP:	return tcp_inactivity_timeout;
+	case TRANSPORT_UDP:	return udp_inactivity_timeout;
+	case TRANSPORT_ICMP:	return icmp_inactivity_timeout;
+	default:		return 0.0;
+	}
+	}
+
+void ConnHandoff::Add(const Connection* c)
+	{
+	Entry e;
+	memset(&e, 0, sizeof(e));
+
+	e.key = c->Key();
+	c->OrigAddr().CopyIPv6(&e.orig_addr);
+	e.orig_port = c->OrigPort();
+	e.proto = c->ConnTransport();
+	e.start_time = c->StartTime();
+	e.last_time = c->LastTime();
+
+	if ( auto uid = c->GetUID() )
+		memcpy(e.uid, uid.Value(), sizeof(e.uid));
+	else
+		// Gets a UID when the new process first needs one.
+		memset(e.uid, 0, sizeof(e.uid));
+
+	const auto& history = c->History();
+	e.hist_seen = c->HistorySeen();
+	e.history_len = std::min(history.size(), size_t(MAX_HISTORY));
+	memcpy(e.history, history.data(), e.history_len);
+
+	added.push_back(e);
+	}
+
+bool ConnHandoff::Save(const std::string& path, std::string* error) const
+	{
+	// Writes a temporary file first so that the next process never
+	// sees a partial one.
+	std::string tmp = path + ".tmp";
+	FILE* f = fopen(tmp.c_str(), "w");
+
+	if ( ! f )
+		{
+		*error = util::fmt("cannot create %s: %s", tmp.c_str(), strerror(errno));
+		return false;
+		}
+
+	Header h;
+	memcpy(h.magic, magic, sizeof(magic));
+	h.entry_size = sizeof(Entry);
+	h.num_entries = added.size();
+
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+		(added.empty() || fwrite(added.data(), sizeof(Entry), added.size(), f) == added.size());
+
+	if ( fclose(f) != 0 )
+		ok = false;
+
+	if ( ! ok || rename(tmp.c_str(), path.c_str()) < 0 )
+		{
+		*error = util::fmt("cannot write %s: %s", path.c_str(), strerror(errno));
+		unlink(tmp.c_str());
+		return false;
+		}
+
+	return true;
+	}
+
+bool ConnHandoff::Load(const std::string& path, std::string* error)
+	{
+	FILE* f = fopen(path.c_str(), "r");
+
+	if ( ! f )
+		{
+		if ( errno != ENOENT )
+			*error = util::fmt("cannot open %s: %s", path.c_str(), strerror(errno));
+
+		return false;
+		}
+
+	unlink(path.c_str());
+
+	Header h;
+
+	if ( fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, magic, sizeof(magic)) != 0 )
+		{
+		*error = util::fmt("%s is not a connection handoff file", path.c_str());
+		fclose(f);
+		return false;
+		}
+
+	if ( h.entry_size != sizeof(Entry) )
+		{
+		*error = util::fmt("%s was written by a different version of Zeek", path.c_str());
+		fclose(f);
+		return false;
+		}
+
+	double max_timeout = std::max({tcp_inactivity_timeout, udp_inactivity_timeout,
+	                               icmp_inactivity_timeout});
+	double last_time = 0.0;
+	Entry e;
+
+	for ( uint64_t i = 0; i < h.num_entries; ++i )
+		{
+		if ( fread(&e, sizeof(e), 1, f) != 1 )
+			{
+			*error = util::fmt("%s is truncated", path.c_str());
+			entries.clear();
+			break;
+			}
+
+		e.history_len = std::min(e.history_len, uint32_t(MAX_HISTORY));
+		last_time = std::max(last_time, e.last_time);
+		entries[e.key] = e;
+		}
+
+	fclose(f);
+
+	// Without inactivity timeouts, entries could still show up any
+	// time.
+	if ( tcp_inactivity_timeout > 0.0 && udp_inactivity_timeout > 0.0 &&
+	     icmp_inactivity_timeout > 0.0 )
+		expire_all = last_time + max_timeout;
+	else
+		expire_all = 0.0;
+
+	return error->empty();
+	}
+
+bool ConnHandoff::Take(const ConnIDKey& key, TransportProto proto, double t, Entry* e)
+	{
+	if ( entries.empty() )
+		return false;
+
+	if ( expire_all > 0.0 && t > expire_all )
+		{
+		entries.clear();
+		return false;
+		}
+
+	auto it = entries.find(key);
+
+	if ( it == entries.end() || it->second.proto != static_cast<uint32_t>(proto) )
+		return false;
+
+	*e = it->second;
+	entries.erase(it);
+
+	double timeout = inactivity_timeout(proto);
+	return timeout <= 0.0 || t - e->last_time <= timeout;
+	}
+
+void ConnHandoff::Adopt(Connection* c, const Entry& e)
+	{
+	c->SetStartTime(e.start_time);
+
+	if ( e.uid[0] || e.uid[1] )
+		c->SetUID(UID(bits_per_uid, e.uid, BRO_UID_LEN));
+
+	c->SetHistory(e.hist_seen, std::string(e.history, e.history_len));
+	}
+
+} // namespace zeek::detail
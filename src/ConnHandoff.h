@@ -0,0 +1,100 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Hands the state of long-lived connections from a Zeek process that shuts
+// down to the one replacing it, so that the new process continues them
+// rather than starting over with partial connections.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "zeek/IPAddr.h"
+#include "zeek/UID.h"
+
+namespace zeek { class Connection; }
+
+namespace zeek::detail {
+
+/**
+ * The connections that a process hands off, in a file that the next
+ * process reads once at startup, and removes.  Only the state that defines
+ * a connection's identity leaves with it: its endpoints, UID, start time
+ * and history.  Analyzers start over in the new process, picking up the
+ * connection mid-stream.
+ */
+class ConnHandoff {
+public:
+	// The longest history a connection takes along.
+	static constexpr int MAX_HISTORY = 48;
+
+	struct Entry {
+		ConnIDKey key;
+		in6_addr orig_addr;
+		uint32_t orig_port;	// In network order.
+		uint32_t proto;	// A TransportProto.
+		double start_time;
+		double last_time;
+		uint64_t uid[BRO_UID_LEN];
+		uint32_t hist_seen;
+		uint32_t history_len;
+		char history[MAX_HISTORY];
+	};
+
+	/**
+	 * Adds a connection to hand off.
+	 */
+	void Add(const Connection* c);
+
+	/**
+	 * Writes the connections added so far to a file, replacing it
+	 * atomically.
+	 *
+	 * @return  True if successful, and otherwise false with an error
+	 * message in *error*.
+	 */
+	bool Save(const std::string& path, std::string* error) const;
+
+	/**
+	 * Reads the connections from a file that a previous process saved,
+	 * and removes the file so that no later process reads them again.
+	 * A truncated file, or one of a different version, yields no
+	 * connections at all.
+	 *
+	 * @return  True if successful.  Returns false with an empty error
+	 * message if there's no file, and otherwise with the error message
+	 * in *error*.
+	 */
+	bool Load(const std::string& path, std::string* error);
+
+	/**
+	 * Looks for a handed off connection and forgets about it, as
+	 * connections only get adopted once.  Connections that saw no packet
+	 * for longer than their protocol's inactivity timeout before *t*
+	 * don't count, since they would have timed out.
+	 *
+	 * @return  True if there's such a connection, which gets copied to
+	 * *e*.
+	 */
+	bool Take(const ConnIDKey& key, TransportProto proto, double t, Entry* e);
+
+	/**
+	 * Restores the state of a handed off connection in a newly created
+	 * one for the same flow.
+	 */
+	static void Adopt(Connection* c, const Entry& e);
+
+	size_t Size() const	{ return entries.size(); }
+
+private:
+	std::vector<Entry> added;
+	std::map<ConnIDKey, Entry> entries;
+
+	// Once the clock passes this, all remaining entries would have
+	// timed out.
+	double expire_all = 0.0;
+};
+
+} // namespace zeek::detail
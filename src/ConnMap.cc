@@ -0,0 +1,283 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/ConnMap.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "zeek/Conn.h"
+#include "zeek/HugePages.h"
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+template<typename T>
+BasicFlatConnMap<T>::~BasicFlatConnMap()
+	{
+	HugePages::Free(slots, capacity * sizeof(Slot));
+	}
+
+template<typename T>
+T* BasicFlatConnMap<T>::Lookup(const ConnIDKey& key, hash64_t hash) const
+	{
+	if ( ! num_entries )
+		return nullptr;
+
+	for ( size_t i = hash & mask; slots[i].conn; i = (i + 1) & mask )
+		{
+		if ( slots[i].hash == hash && slots[i].conn->Key() == key )
+			return slots[i].conn;
+		}
+
+	return nullptr;
+	}
+
+template<typename T>
+T* BasicFlatConnMap<T>::Insert(const ConnIDKey& key, T* conn)
+	{
+	if ( NeedsGrowth() )
+		Resize(capacity ? capacity * 2 : MIN_CAPACITY);
+
+	hash64_t hash = HashKey(key);
+	size_t i = hash & mask;
+
+	for ( ; slots[i].conn; i = (i + 1) & mask )
+		{
+		if ( slots[i].hash == hash && slots[i].conn->Key() == key )
+			{
+			T* old = slots[i].conn;
+			slots[i].conn = conn;
+			return old;
+			}
+		}
+
+	slots[i].hash = hash;
+	slots[i].conn = conn;
+	++num_entries;
+
+	return nullptr;
+	}
+
+template<typename T>
+bool BasicFlatConnMap<T>::Remove(const ConnIDKey& key)
+	{
+	if ( ! num_entries )
+		return false;
+
+	hash64_t hash = HashKey(key);
+	size_t i = hash & mask;
+
+	for ( ; slots[i].conn; i = (i + 1) & mask )
+		{
+		if ( slots[i].hash == hash && slots[i].conn->Key() == key )
+			break;
+		}
+
+	if ( ! slots[i].conn )
+		return false;
+
+	// Backward-shift deletion: move subsequent entries of the probe
+	// sequence into the hole as long as that doesn't place them before
+	// their home slot.
+	size_t hole = i;
+
+	for ( size_t j = (hole + 1) & mask; slots[j].conn; j = (j + 1) & mask )
+		{
+		size_t home = slots[j].hash & mask;
+
+		if ( ((j - home) & mask) >= ((j - hole) & mask) )
+			{
+			slots[hole] = slots[j];
+			hole = j;
+			}
+		}
+
+	slots[hole].conn = nullptr;
+	--num_entries;
+
+	return true;
+	}
+
+template<typename T>
+void BasicFlatConnMap<T>::Clear()
+	{
+	HugePages::Free(slots, capacity * sizeof(Slot));
+	slots = nullptr;
+	capacity = mask = num_entries = 0;
+	}
+
+template<typename T>
+void BasicFlatConnMap<T>::Resize(size_t new_capacity)
+	{
+	Slot* old_slots = slots;
+	size_t old_capacity = capacity;
+
+	// Slots are plain data, so they can live in huge pages.
+	slots = static_cast<Slot*>(HugePages::Allocate(new_capacity * sizeof(Slot)));
+	memset(slots, 0, new_capacity * sizeof(Slot));
+	capacity = new_capacity;
+	mask = new_capacity - 1;
+
+	// The stored hashes let us rehash without touching the connections.
+	for ( size_t i = 0; i < old_capacity; ++i )
+		{
+		if ( ! old_slots[i].conn )
+			continue;
+
+		size_t j = old_slots[i].hash & mask;
+
+		while ( slots[j].conn )
+			j = (j + 1) & mask;
+
+		slots[j] = old_slots[i];
+		}
+
+	HugePages::Free(old_slots, old_capacity * sizeof(Slot));
+	}
+
+template class BasicFlatConnMap<Connection>;
+
+Connection* ConnMap::Insert(const ConnIDKey& key, Connection* conn)
+	{
+	if ( use_flat )
+		return flat.Insert(key, conn);
+
+	auto [it, inserted] = tree.emplace(key, conn);
+
+	if ( inserted )
+		return nullptr;
+
+	Connection* old = it->second;
+	it->second = conn;
+	return old;
+	}
+
+std::vector<Connection*> ConnMap::SortedConnections() const
+	{
+	std::vector<Connection*> rval;
+	rval.reserve(Size());
+
+	ForEach([&rval](Connection* c) { rval.push_back(c); });
+
+	if ( use_flat )
+		std::sort(rval.begin(), rval.end(),
+		          [](const Connection* a, const Connection* b)
+		          { return a->Key() < b->Key(); });
+
+	return rval;
+	}
+
+size_t ConnMap::MemoryAllocation() const
+	{
+	if ( use_flat )
+		return flat.MemoryAllocation();
+
+	using tree_type = decltype(tree);
+	return tree.size() * (sizeof(tree_type::key_type) + sizeof(tree_type::value_type));
+	}
+
+} // namespace zeek::detail
+
+namespace {
+
+struct TestEntry {
+	zeek::detail::ConnIDKey key;
+	const zeek::detail::ConnIDKey& Key() const	{ return key; }
+};
+
+using TestMap = zeek::detail::BasicFlatConnMap<TestEntry>;
+
+// Returns entries of which groups of up to four share a home slot of a
+// table of the given capacity, in runs of adjacent home slots and with
+// some of them wrapping around the table's end.
+std::vector<TestEntry> colliding_entries(size_t capacity, size_t n)
+	{
+	std::vector<TestEntry> rval;
+	std::vector<size_t> per_home(capacity);
+
+	for ( uint32_t port = 1; rval.size() < n && port <= 65535; ++port )
+		{
+		TestEntry e;
+		e.key.port1 = port;
+		size_t home = TestMap::HashKey(e.key) & (capacity - 1);
+
+		if ( home % 8 > 1 && home != capacity - 1 )
+			continue;
+
+		if ( per_home[home] == 4 )
+			continue;
+
+		++per_home[home];
+		rval.push_back(e);
+		}
+
+	return rval;
+	}
+
+}
+
+TEST_CASE("flat conn map backward-shift deletion")
+	{
+	TestMap m;
+	auto entries = colliding_entries(64, 32);
+	REQUIRE(entries.size() == 32);
+
+	for ( auto& e : entries )
+		CHECK(m.Insert(e.key, &e) == nullptr);
+
+	// All of that fits without growing.
+	REQUIRE(m.Capacity() == 64);
+	CHECK(m.Size() == entries.size());
+	CHECK(m.Insert(entries[0].key, &entries[0]) == &entries[0]);
+	CHECK(m.Size() == entries.size());
+
+	// Removing from the middle of probe sequences must keep everything
+	// behind the holes reachable.
+	for ( size_t i = 0; i < entries.size(); i += 3 )
+		{
+		CHECK(m.Remove(entries[i].key));
+		CHECK_FALSE(m.Remove(entries[i].key));
+		}
+
+	for ( size_t i = 0; i < entries.size(); ++i )
+		CHECK(m.Lookup(entries[i].key) == (i % 3 ? &entries[i] : nullptr));
+
+	size_t seen = 0;
+	m.ForEach([&seen](TestEntry*) { ++seen; });
+	CHECK(seen == m.Size());
+	}
+
+TEST_CASE("flat conn map removal of iterated entries")
+	{
+	TestMap m;
+	auto entries = colliding_entries(64, 40);
+	REQUIRE(entries.size() == 40);
+
+	for ( auto& e : entries )
+		m.Insert(e.key, &e);
+
+	// Like NetSessions, collect the entries first and then remove them in
+	// table order, which moves entries not yet removed around.
+	std::vector<TestEntry*> collected;
+	m.ForEach([&collected](TestEntry* e) { collected.push_back(e); });
+	REQUIRE(collected.size() == entries.size());
+
+	for ( size_t i = 0; i < collected.size(); ++i )
+		{
+		REQUIRE(m.Remove(collected[i]->key));
+
+		for ( size_t j = i + 1; j < collected.size(); ++j )
+			CHECK(m.Lookup(collected[j]->key) == collected[j]);
+		}
+
+	CHECK(m.Size() == 0);
+
+	// The table keeps its storage and can be refilled.
+	for ( auto& e : entries )
+		m.Insert(e.key, &e);
+
+	CHECK(m.Size() == entries.size());
+	m.Clear();
+	CHECK(m.Capacity() == 0);
+	CHECK(m.Lookup(entries[0].key) == nullptr);
+	}
@@ -0,0 +1,195 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "zeek/IPAddr.h"
+#include "zeek/Hash.h"
+
+ZEEK_FORWARD_DECLARE_NAMESPACED(Connection, zeek);
+
+namespace zeek::detail {
+
+/**
+ * An open-addressing hash table mapping connection keys to connections.
+ *
+ * Slots only hold the precomputed hash of a key and the connection itself,
+ * so four slots fit into a single cache line. The full key is only compared
+ * (via the entry's Key()) once the hashes match. Collisions are resolved by
+ * linear probing, and removals use backward-shift deletion so that the table
+ * never accumulates tombstones.
+ *
+ * FlatConnMap is the instance for connections; the unit tests use simpler
+ * entries.
+ */
+template<typename T>
+class BasicFlatConnMap {
+public:
+	BasicFlatConnMap() = default;
+	~BasicFlatConnMap();
+
+	BasicFlatConnMap(const BasicFlatConnMap&) = delete;
+	BasicFlatConnMap& operator=(const BasicFlatConnMap&) = delete;
+
+	/**
+	 * Returns the connection stored for the given key, or nullptr.
+	 */
+	T* Lookup(const ConnIDKey& key) const
+		{ return Lookup(key, HashKey(key)); }
+
+	/**
+	 * Same as the above, but with a hash computed earlier via HashKey().
+	 */
+	T* Lookup(const ConnIDKey& key, hash64_t hash) const;
+
+	/**
+	 * Stores a connection under the given key, replacing any connection
+	 * stored for it previously. The key must match \a conn's own key.
+	 *
+	 * @return The connection that was replaced, or nullptr.
+	 */
+	T* Insert(const ConnIDKey& key, T* conn);
+
+	/**
+	 * Removes the entry for the given key.
+	 *
+	 * @return True if there was such an entry.
+	 */
+	bool Remove(const ConnIDKey& key);
+
+	/**
+	 * Removes all entries and releases the table's storage.
+	 */
+	void Clear();
+
+	size_t Size() const	{ return num_entries; }
+	size_t Capacity() const	{ return capacity; }
+
+	/**
+	 * Calls \a f for every stored connection, in table order.  The table
+	 * must not be modified while iterating.
+	 */
+	template<typename F>
+	void ForEach(F f) const
+		{
+		for ( size_t i = 0; i < capacity; ++i )
+			if ( slots[i].conn )
+				f(slots[i].conn);
+		}
+
+	/**
+	 * Returns the memory used by the slot array.
+	 */
+	size_t MemoryAllocation() const	{ return capacity * sizeof(Slot); }
+
+	static constexpr HashTier hash_tier = HASH_TIER_FAST;
+
+	/**
+	 * Computes the hash a key is stored under.
+	 */
+	static hash64_t HashKey(const ConnIDKey& key)
+		{ return KeyedHash::Hash64(&key, sizeof(key), hash_tier); }
+
+private:
+	struct Slot {
+		hash64_t hash;
+		T* conn;	// nullptr for empty slots
+	};
+
+	// Smallest non-zero table size; must be a power of two.
+	static constexpr size_t MIN_CAPACITY = 64;
+
+	bool NeedsGrowth() const
+		// Keep the load factor below 0.75.
+		{ return (num_entries + 1) * 4 > capacity * 3; }
+
+	void Resize(size_t new_capacity);
+
+	Slot* slots = nullptr;
+	size_t capacity = 0;	// always zero or a power of two
+	size_t mask = 0;
+	size_t num_entries = 0;
+};
+
+using FlatConnMap = BasicFlatConnMap<Connection>;
+extern template class BasicFlatConnMap<Connection>;
+
+/**
+ * The connection table used by NetSessions for each transport protocol.
+ * It is backed either by a std::map (the historic implementation) or by a
+ * FlatConnMap, as selected by :zeek:see:`flat_connection_tables` at
+ * construction time.  Both backends provide identical semantics; ordered
+ * traversals are available via SortedConnections() for the places where
+ * the order of script-visible side effects matters.
+ */
+class ConnMap {
+public:
+	explicit ConnMap(bool use_flat = true) : use_flat(use_flat)	{ }
+
+	Connection* Lookup(const ConnIDKey& key) const
+		{
+		if ( use_flat )
+			return flat.Lookup(key);
+
+		auto it = tree.find(key);
+		return it != tree.end() ? it->second : nullptr;
+		}
+
+	/**
+	 * Stores a connection under the given key.
+	 *
+	 * @return The connection that was replaced, or nullptr.
+	 */
+	Connection* Insert(const ConnIDKey& key, Connection* conn);
+
+	bool Remove(const ConnIDKey& key)
+		{ return use_flat ? flat.Remove(key) : tree.erase(key) > 0; }
+
+	void Clear()
+		{
+		flat.Clear();
+		tree.clear();
+		}
+
+	size_t Size() const
+		{ return use_flat ? flat.Size() : tree.size(); }
+
+	bool UsesFlatTable() const	{ return use_flat; }
+
+	/**
+	 * Calls \a f for every stored connection, in unspecified order.
+	 * The table must not be modified while iterating.
+	 */
+	template<typename F>
+	void ForEach(F f) const
+		{
+		if ( use_flat )
+			flat.ForEach(f);
+		else
+			for ( const auto& entry : tree )
+				f(entry.second);
+		}
+
+	/**
+	 * Returns all stored connections, ordered by their keys.  This is the
+	 * order in which the std::map backend traverses its entries, and
+	 * keeps termination-time event ordering independent of the backend.
+	 */
+	std::vector<Connection*> SortedConnections() const;
+
+	/**
+	 * Returns an estimate of the memory used for the table's own
+	 * bookkeeping, not counting the connections themselves.
+	 */
+	size_t MemoryAllocation() const;
+
+private:
+	bool use_flat;
+	FlatConnMap flat;
+	std::map<ConnIDKey, Connection*> tree;
+};
+
+} // namespace zeek::detail
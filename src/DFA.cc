@@ -3,9 +3,17 @@
 #include "zeek-config.h"
 
 #include "zeek/DFA.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 #include "zeek/EquivClass.h"
 #include "zeek/Desc.h"
 #include "zeek/Hash.h"
+#include "zeek/MemoryArenas.h"
 
 namespace zeek::detail {
 
@@ -20,6 +28,7 @@ DFA_State::DFA_State(int arg_state_num, const EquivClass* ec,
 	nfa_states = arg_nfa_states;
 	accept = arg_accept;
 	mark = nullptr;
+	referenced = false;
 
 	SymPartition(ec);
 
@@ -84,7 +93,10 @@ DFA_State* DFA_State::ComputeXtion(int sym, DFA_Machine* machine)
 		return xtions[sym];
 		}
 
+	MemoryTagScope mem_tag(MEMORY_DFA);
 	const EquivClass* ec = machine->EC();
+	bool limited = DFA_State_Cache::HasMemoryLimit();
+	double start = limited ? util::current_time(true) : 0.0;
 
 	DFA_State* next_d;
 
@@ -105,6 +117,14 @@ DFA_State* DFA_State::ComputeXtion(int sym, DFA_Machine* machine)
 	if ( sym != equiv_sym )
 		AddXtion(sym, next_d);
 
+	DFA_State_Cache* cache = machine->Cache();
+
+	if ( limited )
+		cache->AddBuildTime(util::current_time(true) - start);
+
+	if ( cache->OverLimit() && ! machine->precompiling )
+		cache->Evict({this, next_d, machine->StartState()});
+
 	return xtions[sym];
 	}
 
@@ -290,9 +310,14 @@ unsigned int DFA_State::Size()
 		+ (meta_ec ? meta_ec->Size() : 0);
 	}
 
+uint64_t DFA_State_Cache::memory_limit = 0;
+
 DFA_State_Cache::DFA_State_Cache()
 	{
 	hits = misses = 0;
+	evictions = 0;
+	build_time = 0;
+	mem = 0;
 	}
 
 DFA_State_Cache::~DFA_State_Cache()
@@ -354,9 +379,67 @@ DFA_State* DFA_State_Cache::Lookup(const NFA_state_list& nfas, DigestStr* digest
 DFA_State* DFA_State_Cache::Insert(DFA_State* state, DigestStr digest)
 	{
 	states.emplace(std::move(digest), state);
+	mem += StateMem(state);
 	return state;
 	}
 
+void DFA_State_Cache::Evict(std::initializer_list<const DFA_State*> keep)
+	{
+	// This approximates LRU like a clock: going round the states, one
+	// that has been used since the hand last passed it just loses its
+	// reference bit, while one that hasn't gets dropped.
+	uint64_t target = memory_limit / 10 * 9;
+	std::unordered_set<DFA_State*> victims;
+
+	auto it = states.lower_bound(clock_hand);
+	size_t visits = 2 * states.size();
+
+	for ( ; visits > 0 && mem > target; --visits )
+		{
+		if ( it == states.end() )
+			it = states.begin();
+
+		DFA_State* d = it->second;
+
+		if ( d->referenced )
+			{
+			d->referenced = false;
+			++it;
+			continue;
+			}
+
+		// Matchers hold a reference to the state they're in.
+		if ( d->RefCnt() > 1 || std::find(keep.begin(), keep.end(), d) != keep.end() )
+			{
+			++it;
+			continue;
+			}
+
+		mem -= StateMem(d);
+		victims.insert(d);
+		it = states.erase(it);
+		}
+
+	clock_hand = it == states.end() ? DigestStr() : it->first;
+
+	if ( victims.empty() )
+		return;
+
+	for ( const auto& entry : states )
+		{
+		DFA_State* d = entry.second;
+
+		for ( int sym = 0; sym < d->num_sym; ++sym )
+			if ( victims.count(d->xtions[sym]) )
+				d->xtions[sym] = DFA_UNCOMPUTED_STATE_PTR;
+		}
+
+	for ( auto d : victims )
+		Unref(d);
+
+	evictions += victims.size();
+	}
+
 void DFA_State_Cache::GetStats(Stats* s)
 	{
 	s->dfa_states = 0;
@@ -366,6 +449,8 @@ void DFA_State_Cache::GetStats(Stats* s)
 	s->mem = 0;
 	s->hits = hits;
 	s->misses = misses;
+	s->evictions = evictions;
+	s->build_time = build_time;
 
 	for ( const auto& state : states )
 		{
@@ -373,13 +458,14 @@ void DFA_State_Cache::GetStats(Stats* s)
 		++s->dfa_states;
 		s->nfa_states += e->NFAStateNum();
 		e->Stats(&s->computed, &s->uncomputed);
-		s->mem += util::pad_size(e->Size()) + padded_sizeof(*e);
+		s->mem += StateMem(e);
 		}
 	}
 
 DFA_Machine::DFA_Machine(NFA_Machine* n, EquivClass* arg_ec)
 	{
 	state_count = 0;
+	precompiling = false;
 
 	nfa = n;
 	Ref(n);
@@ -463,6 +549,239 @@ bool DFA_Machine::StateSetToDFA_State(NFA_state_list* state_set,
 	return true;
 	}
 
+bool DFA_Machine::Precompile(int max_states)
+	{
+	if ( ! start_state )
+		return true;
+
+	// Evicting would invalidate the states still to visit.  Stopping at
+	// the memory limit keeps that from being needed.
+	precompiling = true;
+
+	std::vector<DFA_State*> todo{start_state};
+	std::unordered_set<DFA_State*> seen{start_state};
+	bool complete = true;
+
+	for ( size_t i = 0; complete && i < todo.size(); ++i )
+		{
+		DFA_State* d = todo[i];
+
+		for ( int sym = 0; sym < d->num_sym; ++sym )
+			{
+			if ( d->xtions[sym] == DFA_UNCOMPUTED_STATE_PTR &&
+			     (NumStates() >= max_states || dfa_state_cache->OverLimit()) )
+				{
+				complete = false;
+				break;
+				}
+
+			DFA_State* next = d->Xtion(sym, this);
+
+			if ( next && seen.insert(next).second )
+				todo.push_back(next);
+			}
+		}
+
+	precompiling = false;
+	return complete;
+	}
+
+// Numbers the states of an NFA in an order that only depends on its
+// structure, so that equal patterns yield equal numbers across runs.
+static std::unordered_map<const NFA_State*, uint32_t> number_nfa_states(NFA_State* first,
+                                                                    std::vector<NFA_State*>* states)
+	{
+	std::unordered_map<const NFA_State*, uint32_t> nums;
+	std::vector<NFA_State*> todo{first};
+
+	while ( ! todo.empty() )
+		{
+		NFA_State* n = todo.back();
+		todo.pop_back();
+
+		if ( ! nums.emplace(n, states->size()).second )
+			continue;
+
+		states->push_back(n);
+
+		auto xtions = n->Transitions();
+
+		for ( int i = xtions->length() - 1; i >= 0; --i )
+			todo.push_back((*xtions)[i]);
+		}
+
+	return nums;
+	}
+
+static void put_word(std::string* buf, uint32_t w)
+	{
+	buf->append(reinterpret_cast<const char*>(&w), sizeof(w));
+	}
+
+// The format of a machine's saved states, in host byte order 32-bit
+// words: the number of NFA states, the number of equivalence classes and
+// the number of DFA states, followed by each DFA state, starting with
+// the start state.  A DFA state lists the number of NFA states it
+// corresponds to, their numbers as per number_nfa_states(), and then its
+// transitions for each class: the number of the next state, or
+// DFA_UNCOMPUTED_STATE, or -1 for a jam.
+void DFA_Machine::Save(std::string* buf)
+	{
+	std::vector<NFA_State*> nfa_states;
+	auto nfa_nums = number_nfa_states(nfa->FirstState(), &nfa_states);
+
+	std::vector<DFA_State*> states;
+	std::unordered_map<const DFA_State*, uint32_t> nums;
+
+	if ( start_state )
+		{
+		states.push_back(start_state);
+		nums.emplace(start_state, 0);
+		}
+
+	for ( size_t i = 0; i < states.size(); ++i )
+		for ( int sym = 0; sym < states[i]->num_sym; ++sym )
+			{
+			DFA_State* next = states[i]->xtions[sym];
+
+			if ( next && next != DFA_UNCOMPUTED_STATE_PTR &&
+			     nums.emplace(next, states.size()).second )
+				states.push_back(next);
+			}
+
+	put_word(buf, nfa_states.size());
+	put_word(buf, ec->NumClasses());
+	put_word(buf, states.size());
+
+	for ( auto d : states )
+		{
+		put_word(buf, d->nfa_states->length());
+
+		for ( auto n : *d->nfa_states )
+			put_word(buf, nfa_nums[n]);
+
+		for ( int sym = 0; sym < d->num_sym; ++sym )
+			{
+			DFA_State* next = d->xtions[sym];
+
+			if ( ! next )
+				put_word(buf, static_cast<uint32_t>(-1));
+			else if ( next == DFA_UNCOMPUTED_STATE_PTR )
+				put_word(buf, static_cast<uint32_t>(DFA_UNCOMPUTED_STATE));
+			else
+				put_word(buf, nums[next]);
+			}
+		}
+	}
+
+bool DFA_Machine::Restore(const u_char* data, size_t len)
+	{
+	const u_char* end = data + len;
+
+	auto get_word = [&](uint32_t* w)
+		{
+		if ( end - data < static_cast<ptrdiff_t>(sizeof(*w)) )
+			return false;
+
+		memcpy(w, data, sizeof(*w));
+		data += sizeof(*w);
+		return true;
+		};
+
+	std::vector<NFA_State*> nfa_states;
+	number_nfa_states(nfa->FirstState(), &nfa_states);
+
+	uint32_t num_nfa, num_sym, num_states;
+
+	if ( ! get_word(&num_nfa) || ! get_word(&num_sym) || ! get_word(&num_states) )
+		return false;
+
+	if ( num_nfa != nfa_states.size() || static_cast<int>(num_sym) != ec->NumClasses() ||
+	     ! start_state || num_states == 0 )
+		return false;
+
+	// First recreate the states, then link them up.
+	std::vector<DFA_State*> states;
+	std::vector<const u_char*> xtions;
+
+	for ( uint32_t i = 0; i < num_states; ++i )
+		{
+		uint32_t n;
+
+		if ( ! get_word(&n) || n > num_nfa )
+			return false;
+
+		auto ns = new NFA_state_list(n);
+
+		for ( uint32_t j = 0; j < n; ++j )
+			{
+			uint32_t idx;
+
+			if ( ! get_word(&idx) || idx >= num_nfa )
+				{
+				delete ns;
+				return false;
+				}
+
+			ns->push_back(nfa_states[idx]);
+			}
+
+		DFA_State* d;
+
+		if ( i == 0 )
+			{
+			// The start state exists already, check that it's the
+			// same.
+			bool same = ns->length() == start_state->nfa_states->length();
+
+			for ( int j = 0; same && j < ns->length(); ++j )
+				same = (*ns)[j] == (*start_state->nfa_states)[j];
+
+			delete ns;
+
+			if ( ! same )
+				return false;
+
+			d = start_state;
+			}
+
+		else if ( ! StateSetToDFA_State(ns, d, ec) )
+			delete ns;
+
+		if ( end - data < static_cast<ptrdiff_t>(num_sym * sizeof(uint32_t)) )
+			return false;
+
+		states.push_back(d);
+		xtions.push_back(data);
+		data += num_sym * sizeof(uint32_t);
+		}
+
+	for ( uint32_t i = 0; i < num_states; ++i )
+		{
+		data = xtions[i];
+
+		for ( uint32_t sym = 0; sym < num_sym; ++sym )
+			{
+			uint32_t next;
+			get_word(&next);
+
+			if ( next == static_cast<uint32_t>(DFA_UNCOMPUTED_STATE) )
+				continue;
+
+			if ( next == static_cast<uint32_t>(-1) )
+				states[i]->AddXtion(sym, nullptr);
+
+			else if ( next < num_states )
+				states[i]->AddXtion(sym, states[next]);
+
+			else
+				return false;
+			}
+		}
+
+	return true;
+	}
+
 int DFA_Machine::Rep(int sym)
 	{
 	for ( int i = 0; i < NUM_SYM; ++i )
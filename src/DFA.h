@@ -5,6 +5,7 @@
 
 #include <assert.h>
 #include <sys/types.h> // for u_char
+#include <initializer_list>
 #include <map>
 #include <string>
 
@@ -54,6 +55,7 @@ public:
 
 protected:
 	friend class DFA_State_Cache;
+	friend class DFA_Machine;	// for Precompile(), Save() and Restore()
 
 	DFA_State* ComputeXtion(int sym, DFA_Machine* machine);
 	void AppendIfNew(int sym, int_list* sym_list);
@@ -68,6 +70,9 @@ protected:
 	EquivClass* meta_ec;	// which ec's make same transition
 	DFA_State* mark;
 
+	// Set whenever a transition leads here; see DFA_State_Cache::Evict().
+	bool referenced;
+
 	static unsigned int transition_counter;	// see Xtion()
 };
 
@@ -86,6 +91,26 @@ public:
 
 	int NumEntries() const	{ return states.size(); }
 
+	// Returns true if the states take up more memory than the limit.
+	bool OverLimit() const	{ return memory_limit && mem > memory_limit; }
+
+	// Drops states until memory usage is back below 90% of the limit,
+	// least recently used first, except for those in keep and those
+	// a matcher is currently in.  Transitions to dropped states revert
+	// to uncomputed.
+	void Evict(std::initializer_list<const DFA_State*> keep);
+
+	// Accounts for the time spent computing a transition.
+	void AddBuildTime(double t)	{ build_time += t; }
+
+	// Sets the maximum number of bytes the states of each machine may
+	// take up.  Zero means no limit.
+	static void SetMemoryLimit(uint64_t limit)	{ memory_limit = limit; }
+
+	// True if a memory limit is set.  Without one, neither the
+	// recency of states nor the build time gets tracked.
+	static bool HasMemoryLimit()	{ return memory_limit != 0; }
+
 	struct Stats {
 		// Sum of all NFA states
 		unsigned int nfa_states;
@@ -95,16 +120,30 @@ public:
 		unsigned int mem;
 		unsigned int hits;
 		unsigned int misses;
+		unsigned int evictions;
+		double build_time;	// seconds spent computing transitions
 	};
 
 	void GetStats(Stats* s);
 
 private:
+	static unsigned int StateMem(DFA_State* d)
+		{ return util::pad_size(d->Size()) + padded_sizeof(*d); }
+
 	int hits;	// Statistics
 	int misses;
+	unsigned int evictions;
+	double build_time;
+
+	uint64_t mem;
+
+	// Where Evict() left off.
+	DigestStr clock_hand;
 
 	// Hash indexed by NFA states (MD5s of them, actually).
 	std::map<DigestStr, DFA_State*> states;
+
+	static uint64_t memory_limit;
 };
 
 class DFA_Machine : public Obj {
@@ -125,6 +164,20 @@ public:
 
 	unsigned int MemoryAllocation() const;
 
+	// Computes the states reachable from the start state ahead of time,
+	// rather than when input first leads to them.  Stops once the
+	// machine has max_states states.  Returns true if all got computed.
+	bool Precompile(int max_states);
+
+	// Appends a description of the states computed so far to buf, for
+	// a later Restore() on a machine built from the same NFA.
+	void Save(std::string* buf);
+
+	// Recreates the states described by Save().  Returns false if the
+	// description doesn't fit this machine.  States restored up to that
+	// point remain valid even then.
+	bool Restore(const u_char* data, size_t len);
+
 protected:
 	friend class DFA_State;	// for DFA_State::ComputeXtion
 	friend class DFA_State_Cache;
@@ -140,15 +193,23 @@ protected:
 	DFA_State* start_state;
 	DFA_State_Cache* dfa_state_cache;
 
+	// True while Precompile() runs, which must not lose states.
+	bool precompiling;
+
 	NFA_Machine* nfa;
 };
 
 inline DFA_State* DFA_State::Xtion(int sym, DFA_Machine* machine)
 	{
-	if ( xtions[sym] == DFA_UNCOMPUTED_STATE_PTR )
-		return ComputeXtion(sym, machine);
-	else
-		return xtions[sym];
+	DFA_State* next = xtions[sym];
+
+	if ( next == DFA_UNCOMPUTED_STATE_PTR )
+		next = ComputeXtion(sym, machine);
+
+	if ( next && DFA_State_Cache::HasMemoryLimit() )
+		next->referenced = true;
+
+	return next;
 	}
 
 } // namespace zeek::detail
@@ -0,0 +1,256 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/DFACache.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "zeek/digest.h"
+#include "zeek/Reporter.h"
+
+namespace zeek::detail {
+
+DFACacheFile* dfa_cache_file = nullptr;
+
+// The file starts with the magic, followed by the length of the Zeek
+// version that wrote it and the version itself, as the construction of
+// DFAs may change between versions.  Then comes the number of entries, and
+// the entries, each with the digest of the machine, the length of its
+// states, and the states as DFA_Machine::Save() puts them.  All numbers are
+// 32-bit in host byte order.
+static const char magic[] = "ZEEKDFA\n";
+static constexpr size_t magic_len = sizeof(magic) - 1;
+static constexpr size_t key_len = 16;
+
+DFACacheFile::DFACacheFile(std::string arg_file)
+	: file(std::move(arg_file))
+	{
+	Load();
+	}
+
+DFACacheFile::~DFACacheFile()
+	{
+	for ( auto& m : machines )
+		Unref(m.dfa);
+
+	Unmap();
+	}
+
+void DFACacheFile::Load()
+	{
+	int fd = open(file.c_str(), O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		if ( errno != ENOENT )
+			reporter->Warning("cannot open DFA cache file %s: %s", file.c_str(),
+			                  strerror(errno));
+		return;
+		}
+
+	struct stat st;
+
+	if ( fstat(fd, &st) < 0 || st.st_size == 0 )
+		{
+		close(fd);
+		return;
+		}
+
+	void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if ( p == MAP_FAILED )
+		{
+		reporter->Warning("cannot map DFA cache file %s: %s", file.c_str(), strerror(errno));
+		return;
+		}
+
+	map = static_cast<const u_char*>(p);
+	map_len = st.st_size;
+
+	const u_char* data = map;
+	const u_char* end = map + map_len;
+
+	auto get_word = [&](uint32_t* w)
+		{
+		if ( end - data < static_cast<ptrdiff_t>(sizeof(*w)) )
+			return false;
+
+		memcpy(w, data, sizeof(*w));
+		data += sizeof(*w);
+		return true;
+		};
+
+	if ( map_len < magic_len || memcmp(data, magic, magic_len) != 0 )
+		{
+		reporter->Warning("%s is not a DFA cache file", file.c_str());
+		Unmap();
+		return;
+		}
+
+	data += magic_len;
+
+	uint32_t version_len;
+
+	if ( ! get_word(&version_len) || static_cast<size_t>(end - data) < version_len )
+		{
+		reporter->Warning("DFA cache file %s is corrupt", file.c_str());
+		Unmap();
+		return;
+		}
+
+	if ( std::string(reinterpret_cast<const char*>(data), version_len) != VERSION )
+		{
+		// Written by another version, so it gets rebuilt.
+		Unmap();
+		return;
+		}
+
+	data += version_len;
+
+	uint32_t num_entries;
+
+	if ( ! get_word(&num_entries) )
+		{
+		reporter->Warning("DFA cache file %s is corrupt", file.c_str());
+		Unmap();
+		return;
+		}
+
+	for ( uint32_t i = 0; i < num_entries; ++i )
+		{
+		uint32_t len;
+
+		if ( end - data < static_cast<ptrdiff_t>(key_len) )
+			break;
+
+		DigestStr key(data, key_len);
+		data += key_len;
+
+		if ( ! get_word(&len) || static_cast<size_t>(end - data) < len )
+			break;
+
+		entries[key] = {data, len};
+		data += len;
+		}
+
+	if ( entries.size() != num_entries )
+		{
+		reporter->Warning("DFA cache file %s is corrupt", file.c_str());
+		entries.clear();
+		Unmap();
+		}
+	}
+
+void DFACacheFile::Unmap()
+	{
+	if ( map )
+		munmap(const_cast<u_char*>(map), map_len);
+
+	map = nullptr;
+	map_len = 0;
+	}
+
+void DFACacheFile::Attach(DFA_Machine* dfa, const std::string& source)
+	{
+	u_char digest[key_len];
+	internal_md5(reinterpret_cast<const u_char*>(source.data()), source.size(), digest);
+
+	DigestStr key(digest, key_len);
+	bool restored = false;
+
+	auto it = entries.find(key);
+
+	if ( it != entries.end() )
+		restored = dfa->Restore(it->second.first, it->second.second);
+
+	Ref(dfa);
+	machines.push_back({dfa, std::move(key), restored});
+	}
+
+void DFACacheFile::Finish(int max_states)
+	{
+	std::map<DigestStr, std::string> out;
+	bool changed = false;
+
+	for ( auto& m : machines )
+		{
+		int num_states = m.dfa->NumStates();
+		m.dfa->Precompile(max_states);
+
+		if ( ! m.restored || m.dfa->NumStates() != num_states )
+			changed = true;
+
+		auto& buf = out[m.key];
+
+		if ( buf.empty() )
+			m.dfa->Save(&buf);
+		}
+
+	if ( changed )
+		{
+		// Keep what other configurations sharing the file put there.
+		for ( const auto& [key, e] : entries )
+			if ( out.find(key) == out.end() )
+				out[key] = std::string(reinterpret_cast<const char*>(e.first), e.second);
+
+		Write(out);
+		}
+
+	for ( auto& m : machines )
+		Unref(m.dfa);
+
+	machines.clear();
+	entries.clear();
+	Unmap();
+	}
+
+bool DFACacheFile::Write(const std::map<DigestStr, std::string>& out)
+	{
+	// Write to a temporary file first, so that processes starting up
+	// concurrently never see a partial one.
+	std::string tmp = file + ".tmp." + std::to_string(getpid());
+	FILE* f = fopen(tmp.c_str(), "w");
+
+	if ( ! f )
+		{
+		reporter->Error("cannot write DFA cache file %s: %s", tmp.c_str(), strerror(errno));
+		return false;
+		}
+
+	auto put_word = [f](uint32_t w) { fwrite(&w, sizeof(w), 1, f); };
+
+	fwrite(magic, magic_len, 1, f);
+	put_word(strlen(VERSION));
+	fwrite(VERSION, strlen(VERSION), 1, f);
+	put_word(out.size());
+
+	for ( const auto& [key, states] : out )
+		{
+		fwrite(key.data(), key_len, 1, f);
+		put_word(states.size());
+		fwrite(states.data(), states.size(), 1, f);
+		}
+
+	bool ok = ! ferror(f);
+
+	if ( fclose(f) != 0 )
+		ok = false;
+
+	if ( ! ok || rename(tmp.c_str(), file.c_str()) < 0 )
+		{
+		reporter->Error("cannot write DFA cache file %s: %s", file.c_str(), strerror(errno));
+		unlink(tmp.c_str());
+		return false;
+		}
+
+	return true;
+	}
+
+} // namespace zeek::detail
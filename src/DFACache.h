@@ -0,0 +1,85 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Keeps the DFAs of the regular expressions compiled at startup in a file
+// across runs, so that matchers have their states ready rather than
+// computing them on live traffic.
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "zeek/DFA.h"
+
+namespace zeek::detail {
+
+/**
+ * A file of precomputed DFA states.  Machines built while the instance
+ * exists get their recorded states restored from the file.  Finish()
+ * then computes the states of all these machines ahead of time and, if
+ * that found new ones, writes them out for the next run.
+ *
+ * Machines are identified by a digest of the patterns they've been
+ * compiled from, so a changed signature set only invalidates its own
+ * entries.  The file is memory-mapped, letting processes that start up
+ * together share its pages.
+ */
+class DFACacheFile {
+public:
+	/**
+	 * Constructor.  Reads the file, if it exists.
+	 *
+	 * @param file  The name of the file.
+	 */
+	explicit DFACacheFile(std::string file);
+	~DFACacheFile();
+
+	/**
+	 * Restores the states recorded for a machine, and registers it for
+	 * Finish().
+	 *
+	 * @param dfa  The machine, freshly built.
+	 *
+	 * @param source  Whatever determines the machine's structure, i.e.
+	 * the patterns and the options compiling them.
+	 */
+	void Attach(DFA_Machine* dfa, const std::string& source);
+
+	/**
+	 * Computes the states of all registered machines, and updates the
+	 * file if that found any it didn't have.  Releases the machines and
+	 * the file.
+	 *
+	 * @param max_states  The maximum number of states to compute per
+	 * machine.  Further states still get computed once input leads to
+	 * them.
+	 */
+	void Finish(int max_states);
+
+private:
+	void Load();
+	void Unmap();
+	bool Write(const std::map<DigestStr, std::string>& entries);
+
+	struct Machine {
+		DFA_Machine* dfa;
+		DigestStr key;
+		bool restored;
+	};
+
+	std::string file;
+
+	const u_char* map = nullptr;
+	size_t map_len = 0;
+
+	// Where in the mapped file the states of each machine are.
+	std::map<DigestStr, std::pair<const u_char*, size_t>> entries;
+
+	std::vector<Machine> machines;
+};
+
+// Null unless a DFA cache file is in use.
+extern DFACacheFile* dfa_cache_file;
+
+} // namespace zeek::detail
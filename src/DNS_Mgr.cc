@@ -29,7 +29,10 @@
 #include <stdlib.h>
 
 #include <algorithm>
+#include <functional>
+#include <string_view>
 
+#include "zeek/DNS_SharedCache.h"
 #include "zeek/ZeekString.h"
 #include "zeek/Expr.h"
 #include "zeek/Event.h"
@@ -70,6 +73,7 @@ public:
 	const char* ReqHost() const	{ return host; }
 	const IPAddr& ReqAddr() const		{ return addr; }
 	bool ReqIsTxt() const	{ return qtype == 16; }
+	int ReqFamily() const	{ return fam; }
 
 	int MakeRequest(nb_dns_info* nb_dns);
 	int RequestPending() const	{ return request_pending; }
@@ -109,6 +113,10 @@ public:
 	DNS_Mapping(const IPAddr& addr, struct hostent* h, uint32_t ttl);
 	DNS_Mapping(FILE* f);
 
+	// Builds a mapping from an entry of the shared cache, for a name if
+	// host is given and otherwise for the address.
+	DNS_Mapping(const DNS_SharedCache::Entry& e, const char* host, const IPAddr& addr);
+
 	bool NoMapping() const		{ return no_mapping; }
 	bool InitFailed() const		{ return init_failed; }
 
@@ -135,6 +143,10 @@ public:
 
 	bool Expired() const
 		{
+		if ( failed )
+			// Failed lookups expire with their negative TTL.
+			return util::current_time() > (creation_time + req_ttl);
+
 		if ( req_host && num_addrs == 0)
 			return false; // nothing to expire
 
@@ -262,6 +274,40 @@ DNS_Mapping::DNS_Mapping(FILE* f)
 	init_failed = false;
 	}
 
+DNS_Mapping::DNS_Mapping(const DNS_SharedCache::Entry& e, const char* host,
+                         const IPAddr& addr)
+	{
+	Clear();
+	init_failed = false;
+
+	req_host = host ? util::copy_string(host) : nullptr;
+	req_addr = addr;
+	req_ttl = e.ttl;
+	creation_time = e.creation_time;
+	map_type = e.addr_type;
+	failed = e.failed;
+
+	if ( failed )
+		return;
+
+	num_names = 1;
+	names = new char*[num_names];
+
+	if ( ! e.name.empty() )
+		names[0] = util::copy_string(e.name.c_str());
+	else
+		// Like for results of name lookups, which carry no name.
+		names[0] = host ? util::copy_string(host) : nullptr;
+
+	num_addrs = e.addrs.size();
+
+	if ( num_addrs > 0 )
+		{
+		addrs = new IPAddr[num_addrs];
+		std::copy(e.addrs.begin(), e.addrs.end(), addrs);
+		}
+	}
+
 DNS_Mapping::~DNS_Mapping()
 	{
 	delete [] req_host;
@@ -387,23 +433,31 @@ DNS_Mgr::DNS_Mgr(DNS_MgrMode arg_mode)
 	num_requests = 0;
 	successful = 0;
 	failed = 0;
-	nb_dns = nullptr;
+	negative_hits = 0;
+	shared_hits = 0;
+	next_resolver = 0;
+	negative_ttl = 0;
 	}
 
 DNS_Mgr::~DNS_Mgr()
 	{
-	if ( nb_dns )
-		nb_dns_finish(nb_dns);
+	for ( auto r : resolvers )
+		nb_dns_finish(r);
 
 	delete [] cache_name;
 	delete [] dir;
 	}
 
-void DNS_Mgr::InitSource()
+size_t DNS_Mgr::AddrHash::operator()(const IPAddr& addr) const
 	{
-	if ( did_init )
-		return;
+	const uint32_t* bytes;
+	int len = addr.GetBytes(&bytes);
+	std::string_view v(reinterpret_cast<const char*>(bytes), len * sizeof(uint32_t));
+	return std::hash<std::string_view>{}(v);
+	}
 
+bool DNS_Mgr::AddResolver(char* err)
+	{
 	// Note that Init() may be called by way of LookupHost() during the act of
 	// parsing a hostname literal (e.g. google.com), so we can't use a
 	// script-layer option to configure the DNS resolver as it may not be
@@ -411,7 +465,7 @@ void DNS_Mgr::InitSource()
 	// the lookup.
 	auto dns_resolver = util::zeekenv("ZEEK_DNS_RESOLVER");
 	auto dns_resolver_addr = dns_resolver ? IPAddr(dns_resolver) : IPAddr();
-	char err[NB_DNS_ERRSIZE];
+	nb_dns_info* nb_dns;
 
 	if ( dns_resolver_addr == IPAddr() )
 		nb_dns = nb_dns_init(err);
@@ -435,15 +489,33 @@ void DNS_Mgr::InitSource()
 		nb_dns = nb_dns_init2(err, (struct sockaddr*)&ss);
 		}
 
-	if ( nb_dns )
-		{
-		if ( ! iosource_mgr->RegisterFd(nb_dns_fd(nb_dns), this) )
-			reporter->FatalError("Failed to register nb_dns file descriptor with iosource_mgr");
-		}
-	else
-		{
+	if ( ! nb_dns )
+		return false;
+
+	if ( ! iosource_mgr->RegisterFd(nb_dns_fd(nb_dns), this) )
+		reporter->FatalError("Failed to register nb_dns file descriptor with iosource_mgr");
+
+	resolvers.push_back(nb_dns);
+	return true;
+	}
+
+nb_dns_info* DNS_Mgr::NextResolver()
+	{
+	if ( resolvers.empty() )
+		return nullptr;
+
+	return resolvers[next_resolver++ % resolvers.size()];
+	}
+
+void DNS_Mgr::InitSource()
+	{
+	if ( did_init )
+		return;
+
+	char err[NB_DNS_ERRSIZE];
+
+	if ( ! AddResolver(err) )
 		reporter->Warning("problem initializing NB-DNS: %s", err);
-		}
 
 	did_init = true;
 	}
@@ -451,10 +523,39 @@ void DNS_Mgr::InitSource()
 void DNS_Mgr::InitPostScript()
 	{
 	dm_rec = id::find_type<RecordType>("dns_mapping");
+	negative_ttl = static_cast<uint32_t>(id::find_val("dns_negative_ttl")->AsInterval());
 
 	// Registering will call Init()
 	iosource_mgr->Register(this, true);
 
+	// Spread requests over more sockets now that the scripts could say
+	// how many, unless the first one already failed.
+	auto num_resolvers = id::find_val("dns_resolver_sockets")->AsCount();
+
+	while ( ! resolvers.empty() && resolvers.size() < num_resolvers )
+		{
+		char err[NB_DNS_ERRSIZE];
+
+		if ( ! AddResolver(err) )
+			{
+			reporter->Warning("problem initializing NB-DNS: %s", err);
+			break;
+			}
+		}
+
+	auto shared_file = id::find_val("dns_shared_cache_file")->AsStringVal();
+
+	if ( mode != DNS_FAKE && shared_file->Len() > 0 )
+		{
+		std::string error;
+		shared_cache = DNS_SharedCache::Open(shared_file->ToStdString(),
+		                                     id::find_val("dns_shared_cache_size")->AsCount(),
+		                                     &error);
+
+		if ( ! shared_cache )
+			reporter->Warning("cannot use shared DNS cache: %s", error.c_str());
+		}
+
 	const char* cache_dir = dir ? dir : ".";
 	cache_name = new char[strlen(cache_dir) + 64];
 	sprintf(cache_name, "%s/%s", cache_dir, ".zeek-dns-cache");
@@ -492,7 +593,7 @@ TableValPtr DNS_Mgr::LookupHost(const char* name)
 
 	InitSource();
 
-	if ( ! nb_dns )
+	if ( resolvers.empty() )
 		return empty_addr_set();
 
 	if ( mode != DNS_PRIME )
@@ -594,9 +695,13 @@ void DNS_Mgr::Verify()
 
 void DNS_Mgr::Resolve()
 	{
-	if ( ! nb_dns )
+	if ( resolvers.empty() )
 		return;
 
+	// Resolving synchronously is for priming the cache and for names in
+	// scripts, so it keeps to a single socket.
+	nb_dns_info* nb_dns = resolvers[0];
+
 	int i;
 
 	int first_req = 0;
@@ -611,7 +716,7 @@ void DNS_Mgr::Resolve()
 	// new request, if we have more.
 	while ( num_pending > 0 )
 		{
-		int status = AnswerAvailable(DNS_TIMEOUT);
+		int status = AnswerAvailable(nb_dns, DNS_TIMEOUT);
 
 		if ( status <= 0 )
 			{
@@ -735,6 +840,11 @@ void DNS_Mgr::AddResult(DNS_Mgr_Request* dr, struct nb_dns_result* r)
 	struct hostent* h = (r && r->host_errno == 0) ? r->hostent : nullptr;
 	u_int32_t ttl = (r && r->host_errno == 0) ? r->ttl : 0;
 
+	// Remember names and addresses that don't exist for a while, but
+	// not lookups that got no answer or failed for other reasons.
+	if ( r && r->host_errno == HOST_NOT_FOUND )
+		ttl = negative_ttl;
+
 	DNS_Mapping* new_dm;
 	DNS_Mapping* prev_dm;
 	int keep_prev = 0;
@@ -744,6 +854,10 @@ void DNS_Mgr::AddResult(DNS_Mgr_Request* dr, struct nb_dns_result* r)
 		new_dm = new DNS_Mapping(dr->ReqHost(), h, ttl);
 		prev_dm = nullptr;
 
+		if ( new_dm->Failed() )
+			// Keeps failed A and AAAA lookups apart.
+			new_dm->map_type = dr->ReqFamily();
+
 		if ( dr->ReqIsTxt() )
 			{
 			TextMap::iterator it = text_mappings.find(dr->ReqHost());
@@ -820,7 +934,41 @@ void DNS_Mgr::AddResult(DNS_Mgr_Request* dr, struct nb_dns_result* r)
 	if ( keep_prev )
 		delete new_dm;
 	else
+		{
+		ShareMapping(new_dm, dr->ReqIsTxt());
 		delete prev_dm;
+		}
+	}
+
+void DNS_Mgr::ShareMapping(DNS_Mapping* dm, bool is_txt)
+	{
+	// Results that expire right away aren't worth sharing.
+	if ( ! shared_cache || dm->req_ttl == 0 )
+		return;
+
+	DNS_SharedCache::Entry e;
+	e.creation_time = dm->CreationTime();
+	e.ttl = dm->req_ttl;
+	e.failed = dm->Failed();
+	e.addr_type = dm->Type();
+
+	if ( ! dm->ReqHost() || is_txt )
+		{
+		if ( dm->names && dm->names[0] )
+			e.name = dm->names[0];
+
+		if ( is_txt )
+			shared_cache->Insert(DNS_SharedCache::TEXT, dm->ReqHost(), e);
+		else
+			shared_cache->Insert(DNS_SharedCache::ADDR, dm->ReqAddr().AsString(), e);
+		}
+	else
+		{
+		e.addrs.assign(dm->addrs, dm->addrs + dm->num_addrs);
+		shared_cache->Insert(dm->Type() == AF_INET ? DNS_SharedCache::HOST4 :
+		                                             DNS_SharedCache::HOST6,
+		                     dm->ReqHost(), e);
+		}
 	}
 
 void DNS_Mgr::CompareMappings(DNS_Mapping* prev_dm, DNS_Mapping* new_dm)
@@ -959,12 +1107,37 @@ void DNS_Mgr::Save(FILE* f, const HostMap& m)
 		}
 	}
 
-const char* DNS_Mgr::LookupAddrInCache(const IPAddr& addr)
+// Returns a mapping for the shared cache's result of a request, or null if
+// there's none.
+static DNS_Mapping* shared_mapping(const DNS_SharedCache* cache, DNS_SharedCache::Kind kind,
+                                   const string& req, const char* host, const IPAddr& addr)
 	{
+	DNS_SharedCache::Entry e;
+
+	if ( ! cache || ! cache->Lookup(kind, req, util::current_time(), &e) )
+		return nullptr;
+
+	return new DNS_Mapping(e, host, addr);
+	}
+
+const char* DNS_Mgr::LookupAddrInCache(const IPAddr& addr, bool* negative)
+	{
+	if ( negative )
+		*negative = false;
+
 	AddrMap::iterator it = addr_mappings.find(addr);
 
 	if ( it == addr_mappings.end() )
-		return nullptr;
+		{
+		auto d = shared_mapping(shared_cache.get(), DNS_SharedCache::ADDR,
+		                        addr.AsString(), nullptr, addr);
+
+		if ( ! d )
+			return nullptr;
+
+		++shared_hits;
+		it = addr_mappings.emplace(addr, d).first;
+		}
 
 	DNS_Mapping* d = it->second;
 
@@ -975,23 +1148,63 @@ const char* DNS_Mgr::LookupAddrInCache(const IPAddr& addr)
 		return nullptr;
 		}
 
+	if ( d->Failed() )
+		{
+		if ( negative )
+			*negative = true;
+
+		return nullptr;
+		}
+
 	// The escapes in the following strings are to avoid having it
 	// interpreted as a trigraph sequence.
 	return d->names ? d->names[0] : "<\?\?\?>";
 	}
 
-TableValPtr DNS_Mgr::LookupNameInCache(const string& name)
+TableValPtr DNS_Mgr::LookupNameInCache(const string& name, bool* negative)
 	{
+	if ( negative )
+		*negative = false;
+
 	HostMap::iterator it = host_mappings.find(name);
 	if ( it == host_mappings.end() )
 		{
-		it = host_mappings.begin();
-		return nullptr;
+		// Take the shared results only if both of the pair are there,
+		// as otherwise the answer to a new request for the other one
+		// would look like the first of a pair.
+		auto d4 = shared_mapping(shared_cache.get(), DNS_SharedCache::HOST4,
+		                         name, name.c_str(), IPAddr());
+		auto d6 = d4 ? shared_mapping(shared_cache.get(), DNS_SharedCache::HOST6,
+		                              name, name.c_str(), IPAddr()) : nullptr;
+
+		if ( ! d6 )
+			{
+			delete d4;
+			return nullptr;
+			}
+
+		++shared_hits;
+		it = host_mappings.emplace(name, std::make_pair(d4, d6)).first;
 		}
 
 	DNS_Mapping* d4 = it->second.first;
 	DNS_Mapping* d6 = it->second.second;
 
+	if ( d4 && d6 && d4->Failed() && d6->Failed() )
+		{
+		if ( d4->Expired() || d6->Expired() )
+			{
+			host_mappings.erase(it);
+			delete d4;
+			delete d6;
+			}
+
+		else if ( negative )
+			*negative = true;
+
+		return nullptr;
+		}
+
 	if ( ! d4 || ! d4->names || ! d6 || ! d6->names )
 		return nullptr;
 
@@ -1009,11 +1222,23 @@ TableValPtr DNS_Mgr::LookupNameInCache(const string& name)
 	return tv6;
 	}
 
-const char* DNS_Mgr::LookupTextInCache(const string& name)
+const char* DNS_Mgr::LookupTextInCache(const string& name, bool* negative)
 	{
+	if ( negative )
+		*negative = false;
+
 	TextMap::iterator it = text_mappings.find(name);
 	if ( it == text_mappings.end() )
-		return nullptr;
+		{
+		auto d = shared_mapping(shared_cache.get(), DNS_SharedCache::TEXT,
+		                        name, name.c_str(), IPAddr());
+
+		if ( ! d )
+			return nullptr;
+
+		++shared_hits;
+		it = text_mappings.emplace(name, d).first;
+		}
 
 	DNS_Mapping* d = it->second;
 
@@ -1024,6 +1249,14 @@ const char* DNS_Mgr::LookupTextInCache(const string& name)
 		return nullptr;
 		}
 
+	if ( d->Failed() )
+		{
+		if ( negative )
+			*negative = true;
+
+		return nullptr;
+		}
+
 	// The escapes in the following strings are to avoid having it
 	// interpreted as a trigraph sequence.
 	return d->names ? d->names[0] : "<\?\?\?>";
@@ -1043,6 +1276,12 @@ static void resolve_lookup_cb(DNS_Mgr::LookupCallback* callback,
 	delete callback;
 	}
 
+static void timeout_lookup_cb(DNS_Mgr::LookupCallback* callback)
+	{
+	callback->Timeout();
+	delete callback;
+	}
+
 void DNS_Mgr::AsyncLookupAddr(const IPAddr& host, LookupCallback* callback)
 	{
 	InitSource();
@@ -1054,13 +1293,21 @@ void DNS_Mgr::AsyncLookupAddr(const IPAddr& host, LookupCallback* callback)
 		}
 
 	// Do we already know the answer?
-	const char* name = LookupAddrInCache(host);
+	bool negative;
+	const char* name = LookupAddrInCache(host, &negative);
 	if ( name )
 		{
 		resolve_lookup_cb(callback, name);
 		return;
 		}
 
+	if ( negative )
+		{
+		++negative_hits;
+		timeout_lookup_cb(callback);
+		return;
+		}
+
 	AsyncRequest* req = nullptr;
 
 	// Have we already a request waiting for this host?
@@ -1092,13 +1339,21 @@ void DNS_Mgr::AsyncLookupName(const string& name, LookupCallback* callback)
 		}
 
 	// Do we already know the answer?
-	auto addrs = LookupNameInCache(name);
+	bool negative;
+	auto addrs = LookupNameInCache(name, &negative);
 	if ( addrs )
 		{
 		resolve_lookup_cb(callback, std::move(addrs));
 		return;
 		}
 
+	if ( negative )
+		{
+		++negative_hits;
+		timeout_lookup_cb(callback);
+		return;
+		}
+
 	AsyncRequest* req = nullptr;
 
 	// Have we already a request waiting for this host?
@@ -1130,7 +1385,8 @@ void DNS_Mgr::AsyncLookupNameText(const string& name, LookupCallback* callback)
 		}
 
 	// Do we already know the answer?
-	const char* txt = LookupTextInCache(name);
+	bool negative;
+	const char* txt = LookupTextInCache(name, &negative);
 
 	if ( txt )
 		{
@@ -1138,6 +1394,13 @@ void DNS_Mgr::AsyncLookupNameText(const string& name, LookupCallback* callback)
 		return;
 		}
 
+	if ( negative )
+		{
+		++negative_hits;
+		timeout_lookup_cb(callback);
+		return;
+		}
+
 	AsyncRequest* req = nullptr;
 
 	// Have we already a request waiting for this host?
@@ -1172,13 +1435,18 @@ static bool DoRequest(nb_dns_info* nb_dns, DNS_Mgr_Request* dr)
 
 void DNS_Mgr::IssueAsyncRequests()
 	{
-	while ( asyncs_queued.size() && asyncs_pending < MAX_PENDING_REQUESTS )
+	// Each resolver socket takes that many requests at a time.
+	int max_pending = MAX_PENDING_REQUESTS * std::max(int(resolvers.size()), 1);
+
+	while ( asyncs_queued.size() && asyncs_pending < max_pending )
 		{
 		AsyncRequest* req = asyncs_queued.front();
 		asyncs_queued.pop_front();
 
 		++num_requests;
 
+		nb_dns_info* nb_dns = NextResolver();
+
 		bool success;
 
 		if ( req->IsAddrReq() )
@@ -1341,7 +1609,7 @@ double DNS_Mgr::GetNextTimeout()
 
 void DNS_Mgr::Process()
 	{
-	if ( ! nb_dns )
+	if ( resolvers.empty() )
 		return;
 
 	while ( asyncs_timeouts.size() > 0 )
@@ -1365,13 +1633,20 @@ void DNS_Mgr::Process()
 		delete req;
 		}
 
-	if ( AnswerAvailable(0) <= 0 )
-		return;
+	// Read the answers that arrived at each socket, but at most as many
+	// as it takes requests at a time, so that a burst of them doesn't
+	// hold up everything else.
+	for ( auto r : resolvers )
+		for ( int i = 0; i < MAX_PENDING_REQUESTS && AnswerAvailable(r, 0) > 0; ++i )
+			ProcessAnswer(r);
+	}
 
+void DNS_Mgr::ProcessAnswer(nb_dns_info* resolver)
+	{
 	char err[NB_DNS_ERRSIZE];
 	struct nb_dns_result r;
 
-	int status = nb_dns_activity(nb_dns, &r, err);
+	int status = nb_dns_activity(resolver, &r, err);
 
 	if ( status < 0 )
 		reporter->Warning("NB-DNS error in DNS_Mgr::Process (%s)", err);
@@ -1406,12 +1681,12 @@ void DNS_Mgr::Process()
 		}
 	}
 
-int DNS_Mgr::AnswerAvailable(int timeout)
+int DNS_Mgr::AnswerAvailable(nb_dns_info* resolver, int timeout)
 	{
-	if ( ! nb_dns )
+	if ( ! resolver )
 		return -1;
 
-	int fd = nb_dns_fd(nb_dns);
+	int fd = nb_dns_fd(resolver);
 	if ( fd < 0 )
 		{
 		reporter->Warning("nb_dns_fd() failed in DNS_Mgr::WaitForReplies");
@@ -1455,12 +1730,14 @@ void DNS_Mgr::GetStats(Stats* stats)
 	stats->cached_hosts = host_mappings.size();
 	stats->cached_addresses = addr_mappings.size();
 	stats->cached_texts = text_mappings.size();
+	stats->negative_hits = negative_hits;
+	stats->shared_hits = shared_hits;
 	}
 
 void DNS_Mgr::Terminate()
 	{
-	if ( nb_dns )
-		iosource_mgr->UnregisterFd(nb_dns_fd(nb_dns), this);
+	for ( auto r : resolvers )
+		iosource_mgr->UnregisterFd(nb_dns_fd(r), this);
 	}
 
 } // namespace zeek::detail
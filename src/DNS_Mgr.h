@@ -4,8 +4,11 @@
 
 #include <list>
 #include <map>
+#include <memory>
 #include <queue>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "zeek/List.h"
 #include "zeek/EventHandler.h"
@@ -36,6 +39,7 @@ namespace zeek::detail {
 using DNS_mgr_request_list = PList<DNS_Mgr_Request>;
 
 class DNS_Mapping;
+class DNS_SharedCache;
 
 enum DNS_MgrMode {
 	DNS_PRIME,	// used to prime the cache
@@ -68,9 +72,12 @@ public:
 	void Resolve();
 	bool Save();
 
-	const char* LookupAddrInCache(const IPAddr& addr);
-	TableValPtr LookupNameInCache(const std::string& name);
-	const char* LookupTextInCache(const std::string& name);
+	// The following return null if there's no cached result.  If
+	// *negative* is given, they set it to whether that's because the
+	// cache remembers that the lookup failed.
+	const char* LookupAddrInCache(const IPAddr& addr, bool* negative = nullptr);
+	TableValPtr LookupNameInCache(const std::string& name, bool* negative = nullptr);
+	const char* LookupTextInCache(const std::string& name, bool* negative = nullptr);
 
 	// Support for async lookups.
 	class LookupCallback {
@@ -95,6 +102,8 @@ public:
 		unsigned long cached_hosts;
 		unsigned long cached_addresses;
 		unsigned long cached_texts;
+		unsigned long negative_hits;	// Lookups answered by cached failures.
+		unsigned long shared_hits;	// Results found in the shared cache.
 	};
 
 	void GetStats(Stats* stats);
@@ -117,17 +126,35 @@ protected:
 	ListValPtr AddrListDelta(ListVal* al1, ListVal* al2);
 	void DumpAddrList(FILE* f, ListVal* al);
 
-	typedef std::map<std::string, std::pair<DNS_Mapping*, DNS_Mapping*> > HostMap;
-	typedef std::map<IPAddr, DNS_Mapping*> AddrMap;
-	typedef std::map<std::string, DNS_Mapping*> TextMap;
+	struct AddrHash {
+		size_t operator()(const IPAddr& addr) const;
+	};
+
+	typedef std::unordered_map<std::string, std::pair<DNS_Mapping*, DNS_Mapping*> > HostMap;
+	typedef std::unordered_map<IPAddr, DNS_Mapping*, AddrHash> AddrMap;
+	typedef std::unordered_map<std::string, DNS_Mapping*> TextMap;
 	void LoadCache(FILE* f);
 	void Save(FILE* f, const AddrMap& m);
 	void Save(FILE* f, const HostMap& m);
 
-	// Selects on the fd to see if there is an answer available (timeout
-	// is secs). Returns 0 on timeout, -1 on EINTR or other error, and 1
-	// if answer is ready.
-	int AnswerAvailable(int timeout);
+	// Stores a new result in the shared cache, if there's one.
+	void ShareMapping(DNS_Mapping* dm, bool is_txt);
+
+	// Opens another resolver socket.  Returns false with an error message
+	// in *err* if that fails.
+	bool AddResolver(char* err);
+
+	// Returns the resolver socket for the next request, rotating through
+	// all of them.
+	nb_dns_info* NextResolver();
+
+	// Selects on the resolver's fd to see if there is an answer available
+	// (timeout is secs). Returns 0 on timeout, -1 on EINTR or other error,
+	// and 1 if answer is ready.
+	int AnswerAvailable(nb_dns_info* resolver, int timeout);
+
+	// Reads an answer from the resolver and finishes its request.
+	void ProcessAnswer(nb_dns_info* resolver);
 
 	// Issue as many queued async requests as slots are available.
 	void IssueAsyncRequests();
@@ -152,7 +179,12 @@ protected:
 
 	DNS_mgr_request_list requests;
 
-	nb_dns_info* nb_dns;
+	std::vector<nb_dns_info*> resolvers;
+	size_t next_resolver;
+
+	std::unique_ptr<DNS_SharedCache> shared_cache;
+	uint32_t negative_ttl;	// How long to remember failed lookups.
+
 	char* cache_name;
 	char* dir;	// directory in which cache_name resides
 
@@ -212,13 +244,13 @@ protected:
 
 	};
 
-	typedef std::map<IPAddr, AsyncRequest*> AsyncRequestAddrMap;
+	typedef std::unordered_map<IPAddr, AsyncRequest*, AddrHash> AsyncRequestAddrMap;
 	AsyncRequestAddrMap asyncs_addrs;
 
-	typedef std::map<std::string, AsyncRequest*> AsyncRequestNameMap;
+	typedef std::unordered_map<std::string, AsyncRequest*> AsyncRequestNameMap;
 	AsyncRequestNameMap asyncs_names;
 
-	typedef std::map<std::string, AsyncRequest*> AsyncRequestTextMap;
+	typedef std::unordered_map<std::string, AsyncRequest*> AsyncRequestTextMap;
 	AsyncRequestTextMap asyncs_texts;
 
 	typedef std::list<AsyncRequest*> QueuedList;
@@ -239,6 +271,8 @@ protected:
 	unsigned long num_requests;
 	unsigned long successful;
 	unsigned long failed;
+	unsigned long negative_hits;
+	unsigned long shared_hits;
 };
 
 extern DNS_Mgr* dns_mgr;
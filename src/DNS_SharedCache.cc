@@ -0,0 +1,365 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/DNS_SharedCache.h"
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include "zeek/Hash.h"
+#include "zeek/util.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+static const char magic[8] = {'Z', 'E', 'E', 'K', 'D', 'N', 'S', '1'};
+
+// The number of slots an entry may occupy, starting at the one its hash
+// selects.
+static constexpr uint64_t PROBES = 4;
+
+struct DNS_SharedCache::Header {
+	char magic[8];
+	uint64_t salt_check;	// StaticHash64() of the magic.
+	uint64_t num_slots;
+	uint64_t slot_size;
+};
+
+struct DNS_SharedCache::Slot {
+	// Odd while a writer updates the slot, zero if it was never used.
+	std::atomic<uint32_t> seq;
+	uint8_t kind;
+	uint8_t failed;
+	uint8_t addr_type;
+	uint8_t num_addrs;
+	uint64_t key[2];	// StaticHash128() of the kind and request.
+	double creation_time;
+	uint32_t ttl;
+	uint32_t name_len;
+
+	union {
+		char name[MAX_NAME + 1];
+		uint32_t addrs[MAX_ADDRS][4];
+	};
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "shared DNS cache needs lock-free atomics");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "shared DNS cache needs plain atomics");
+
+static void make_key(DNS_SharedCache::Kind kind, const std::string& req, uint64_t* key)
+	{
+	std::string k;
+	k.reserve(1 + req.size());
+	k.push_back(static_cast<char>(kind));
+	k.append(req);
+
+	hash128_t h;
+	KeyedHash::StaticHash128(k.data(), k.size(), &h);
+	key[0] = h[0];
+	key[1] = h[1];
+	}
+
+std::unique_ptr<DNS_SharedCache> DNS_SharedCache::Open(const std::string& path,
+                                                       uint64_t num_slots,
+                                                       std::string* error)
+	{
+	int fd = open(path.c_str(), O_RDWR | O_CREAT, 0600);
+
+	if ( fd < 0 )
+		{
+		*error = util::fmt("cannot open %s: %s", path.c_str(), strerror(errno));
+		return nullptr;
+		}
+
+	// Keeps processes that start at the same time from all initializing
+	// the file.
+	flock(fd, LOCK_EX);
+
+	struct stat st;
+
+	if ( fstat(fd, &st) < 0 )
+		{
+		*error = util::fmt("cannot stat %s: %s", path.c_str(), strerror(errno));
+		close(fd);
+		return nullptr;
+		}
+
+	if ( st.st_size == 0 )
+		{
+		Header h;
+		memcpy(h.magic, magic, sizeof(magic));
+		h.salt_check = KeyedHash::StaticHash64(magic, sizeof(magic));
+		h.num_slots = std::max(num_slots, PROBES);
+		h.slot_size = sizeof(Slot);
+
+		// The slots that ftruncate() adds read as zeros, i.e., unused.
+		st.st_size = sizeof(Header) + h.num_slots * sizeof(Slot);
+
+		if ( ftruncate(fd, st.st_size) < 0 ||
+		     pwrite(fd, &h, sizeof(h), 0) != static_cast<ssize_t>(sizeof(h)) )
+			{
+			*error = util::fmt("cannot initialize %s: %s", path.c_str(), strerror(errno));
+			close(fd);
+			return nullptr;
+			}
+		}
+
+	size_t size = st.st_size;
+
+	if ( size < sizeof(Header) )
+		{
+		*error = util::fmt("%s is not a DNS cache", path.c_str());
+		close(fd);
+		return nullptr;
+		}
+
+	void* m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	// The mapping keeps the file open, and with it the lock.
+	flock(fd, LOCK_UN);
+	close(fd);
+
+	if ( m == MAP_FAILED )
+		{
+		*error = util::fmt("cannot map %s: %s", path.c_str(), strerror(errno));
+		return nullptr;
+		}
+
+	std::unique_ptr<DNS_SharedCache> cache{
+		new DNS_SharedCache(path, static_cast<char*>(m), size)};
+
+	auto h = reinterpret_cast<const Header*>(m);
+
+	if ( memcmp(h->magic, magic, sizeof(magic)) != 0 )
+		*error = util::fmt("%s is not a DNS cache", path.c_str());
+
+	else if ( h->salt_check != KeyedHash::StaticHash64(magic, sizeof(magic)) )
+		*error = util::fmt("%s was written with a different digest_salt", path.c_str());
+
+	else if ( h->slot_size != sizeof(Slot) || h->num_slots < PROBES ||
+	          (size - sizeof(Header)) / sizeof(Slot) != h->num_slots )
+		*error = util::fmt("%s was written by a different version of Zeek", path.c_str());
+
+	else
+		{
+		cache->num_slots = h->num_slots;
+		return cache;
+		}
+
+	return nullptr;
+	}
+
+DNS_SharedCache::DNS_SharedCache(std::string arg_path, char* arg_base, size_t arg_size)
+	: path(std::move(arg_path)), base(arg_base), size(arg_size), num_slots(0)
+	{
+	}
+
+DNS_SharedCache::~DNS_SharedCache()
+	{
+	munmap(base, size);
+	}
+
+DNS_SharedCache::Slot* DNS_SharedCache::GetSlot(uint64_t i) const
+	{
+	return reinterpret_cast<Slot*>(base + sizeof(Header)) + i % num_slots;
+	}
+
+bool DNS_SharedCache::Lookup(Kind kind, const std::string& req, double now, Entry* e) const
+	{
+	uint64_t key[2];
+	make_key(kind, req, key);
+
+	for ( uint64_t i = 0; i < PROBES; ++i )
+		{
+		const Slot* s = GetSlot(key[0] + i);
+		uint32_t seq = s->seq.load(std::memory_order_acquire);
+
+		if ( seq == 0 || (seq & 1) )
+			continue;
+
+		if ( s->kind != kind || s->key[0] != key[0] || s->key[1] != key[1] )
+			continue;
+
+		// Copy the slot before checking that no writer changed it in
+		// the meantime.
+		Slot copy;
+		memcpy(reinterpret_cast<char*>(&copy) + sizeof(copy.seq),
+		       reinterpret_cast<const char*>(s) + sizeof(s->seq),
+		       sizeof(Slot) - sizeof(s->seq));
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if ( s->seq.load(std::memory_order_relaxed) != seq ||
+		     copy.kind != kind || copy.key[0] != key[0] || copy.key[1] != key[1] )
+			return false;
+
+		if ( now > copy.creation_time + copy.ttl )
+			return false;
+
+		e->creation_time = copy.creation_time;
+		e->ttl = copy.ttl;
+		e->failed = copy.failed;
+		e->addr_type = copy.addr_type;
+		e->name.clear();
+		e->addrs.clear();
+
+		if ( kind == ADDR || kind == TEXT )
+			e->name.assign(copy.name, std::min(copy.name_len, uint32_t(MAX_NAME)));
+		else
+			{
+			int n = std::min(int(copy.num_addrs), MAX_ADDRS);
+
+			for ( int j = 0; j < n; ++j )
+				{
+				in6_addr a;
+				memcpy(&a, copy.addrs[j], sizeof(a));
+				e->addrs.emplace_back(a);
+				}
+			}
+
+		return true;
+		}
+
+	return false;
+	}
+
+void DNS_SharedCache::Insert(Kind kind, const std::string& req, const Entry& e)
+	{
+	if ( e.name.size() > MAX_NAME )
+		return;
+
+	uint64_t key[2];
+	make_key(kind, req, key);
+
+	// Use the request's slot if it has one, and otherwise the one that
+	// expires first, counting unused slots as long expired.
+	Slot* target = nullptr;
+	double target_expiry = 0.0;
+
+	for ( uint64_t i = 0; i < PROBES; ++i )
+		{
+		Slot* s = GetSlot(key[0] + i);
+		uint32_t seq = s->seq.load(std::memory_order_relaxed);
+
+		if ( seq & 1 )
+			continue;
+
+		if ( seq != 0 && s->kind == kind && s->key[0] == key[0] && s->key[1] == key[1] )
+			{
+			target = s;
+			break;
+			}
+
+		double expiry = seq == 0 ? 0.0 : s->creation_time + s->ttl;
+
+		if ( ! target || expiry < target_expiry )
+			{
+			target = s;
+			target_expiry = expiry;
+			}
+		}
+
+	if ( ! target )
+		return;
+
+	uint32_t seq = target->seq.load(std::memory_order_relaxed);
+
+	// Skip the update if another process is writing the slot.
+	if ( (seq & 1) ||
+	     ! target->seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire) )
+		return;
+
+	target->kind = kind;
+	target->failed = e.failed;
+	target->addr_type = e.addr_type;
+	target->key[0] = key[0];
+	target->key[1] = key[1];
+	target->creation_time = e.creation_time;
+	target->ttl = e.ttl;
+	target->num_addrs = 0;
+	target->name_len = 0;
+
+	if ( kind == ADDR || kind == TEXT )
+		{
+		memcpy(target->name, e.name.data(), e.name.size());
+		target->name[e.name.size()] = '\0';
+		target->name_len = e.name.size();
+		}
+	else
+		{
+		int n = std::min(int(e.addrs.size()), MAX_ADDRS);
+
+		for ( int j = 0; j < n; ++j )
+			e.addrs[j].CopyIPv6(target->addrs[j], IPAddr::Network);
+
+		target->num_addrs = n;
+		}
+
+	// Skip 0 when wrapping around, which marks unused slots.
+	uint32_t next = seq + 2;
+	target->seq.store(next ? next : 2, std::memory_order_release);
+	}
+
+} // namespace zeek::detail
+
+TEST_SUITE_BEGIN("DNS_SharedCache");
+
+TEST_CASE("shared DNS cache")
+	{
+	char tmpl[] = "/tmp/zeek-dns-cache-XXXXXX";
+	int fd = mkstemp(tmpl);
+	REQUIRE(fd >= 0);
+	close(fd);
+	unlink(tmpl);
+
+	std::string error;
+	auto cache = zeek::detail::DNS_SharedCache::Open(tmpl, 64, &error);
+	REQUIRE(cache);
+	CHECK(cache->NumSlots() == 64);
+
+	zeek::detail::DNS_SharedCache::Entry e;
+	e.creation_time = 100.0;
+	e.ttl = 60;
+	e.name = "www.example.com";
+	cache->Insert(zeek::detail::DNS_SharedCache::ADDR, "192.0.2.1", e);
+
+	e.name.clear();
+	e.addrs.emplace_back("192.0.2.1");
+	e.addrs.emplace_back("192.0.2.2");
+	cache->Insert(zeek::detail::DNS_SharedCache::HOST4, "www.example.com", e);
+
+	zeek::detail::DNS_SharedCache::Entry f;
+	CHECK(cache->Lookup(zeek::detail::DNS_SharedCache::ADDR, "192.0.2.1", 120.0, &f));
+	CHECK(f.name == "www.example.com");
+	CHECK(! cache->Lookup(zeek::detail::DNS_SharedCache::ADDR, "192.0.2.1", 200.0, &f));
+	CHECK(! cache->Lookup(zeek::detail::DNS_SharedCache::TEXT, "192.0.2.1", 120.0, &f));
+
+	// A second mapping of the file sees the entries of the first.
+	auto other = zeek::detail::DNS_SharedCache::Open(tmpl, 1024, &error);
+	REQUIRE(other);
+	CHECK(other->NumSlots() == 64);
+	CHECK(other->Lookup(zeek::detail::DNS_SharedCache::HOST4, "www.example.com", 120.0, &f));
+	REQUIRE(f.addrs.size() == 2);
+	CHECK(f.addrs[1] == zeek::IPAddr("192.0.2.2"));
+
+	e.failed = true;
+	e.addrs.clear();
+	other->Insert(zeek::detail::DNS_SharedCache::HOST4, "www.example.com", e);
+	CHECK(cache->Lookup(zeek::detail::DNS_SharedCache::HOST4, "www.example.com", 120.0, &f));
+	CHECK(f.failed);
+	CHECK(f.addrs.empty());
+
+	unlink(tmpl);
+	}
+
+TEST_SUITE_END();
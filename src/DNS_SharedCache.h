@@ -0,0 +1,113 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A cache of DNS lookup results in a memory-mapped file, which the Zeek
+// processes on a host share so that a name one of them resolved doesn't get
+// queried again by the others.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zeek/IPAddr.h"
+
+namespace zeek::detail {
+
+/**
+ * DNS lookup results in a file that all processes map read-write.  The file
+ * holds a fixed number of fixed-size slots, addressed by a hash of the
+ * request, so it never grows; entries get replaced when their slots are
+ * needed, preferring those that expired.  Each slot carries a sequence
+ * number that writers make odd while they update it, which lets readers
+ * detect and skip entries that change under them without any locking.
+ *
+ * The layout depends on digest_salt, so only processes of the same
+ * installation can share a file.
+ */
+class DNS_SharedCache {
+public:
+	enum Kind : uint8_t {
+		ADDR = 1,	// Reverse lookup of an address.
+		HOST4,	// A records of a name.
+		HOST6,	// AAAA records of a name.
+		TEXT,	// TXT record of a name.
+	};
+
+	// The most addresses an entry holds for a name.
+	static constexpr int MAX_ADDRS = 16;
+
+	// The longest name or text an entry holds.
+	static constexpr int MAX_NAME = 255;
+
+	struct Entry {
+		double creation_time = 0.0;
+		uint32_t ttl = 0;
+		bool failed = false;
+		int addr_type = 0;	// AF_INET or AF_INET6, for names.
+		std::string name;	// The resolved name or text.
+		std::vector<IPAddr> addrs;	// The resolved addresses.
+	};
+
+	/**
+	 * Maps a cache file, creating it if it doesn't exist yet.
+	 *
+	 * @param path  The file.
+	 *
+	 * @param num_slots  The number of entries the file holds, if it gets
+	 * created.  An existing file keeps its own size.
+	 *
+	 * @return  The mapped file, or null with an error message in
+	 * *error*.
+	 */
+	static std::unique_ptr<DNS_SharedCache> Open(const std::string& path,
+	                                             uint64_t num_slots,
+	                                             std::string* error);
+
+	~DNS_SharedCache();
+
+	/**
+	 * Looks up the result of a request.
+	 *
+	 * @param kind  The type of the request.
+	 *
+	 * @param req  The requested name, or the address as a string.
+	 *
+	 * @param now  The current time, to skip expired entries.
+	 *
+	 * @param e  Set to the entry, if found.
+	 *
+	 * @return  True if there's an unexpired entry for the request.
+	 */
+	bool Lookup(Kind kind, const std::string& req, double now, Entry* e) const;
+
+	/**
+	 * Stores the result of a request, replacing any earlier one.  Results
+	 * with names longer than MAX_NAME don't get stored, and those with
+	 * more than MAX_ADDRS addresses keep only the first ones.
+	 */
+	void Insert(Kind kind, const std::string& req, const Entry& e);
+
+	/**
+	 * Returns the number of entries the file holds.
+	 */
+	uint64_t NumSlots() const	{ return num_slots; }
+
+	const std::string& Path() const	{ return path; }
+
+private:
+	struct Header;
+	struct Slot;
+
+	DNS_SharedCache(std::string path, char* base, size_t size);
+
+	Slot* GetSlot(uint64_t i) const;
+
+	std::string path;
+	char* base;
+	size_t size;
+	uint64_t num_slots;
+};
+
+} // namespace zeek::detail
@@ -182,7 +182,19 @@ void ODesc::Add(double d, bool no_exp)
 
 void ODesc::Add(const IPAddr& addr)
 	{
-	Add(addr.AsString());
+	if ( addr.GetFamily() != IPv4 )
+		{
+		Add(addr.AsString());
+		return;
+		}
+
+	// Skip the temporary string for IPv4, the common case.
+	in4_addr in4;
+	addr.CopyIPv4(&in4);
+
+	char tmp[INET_ADDRSTRLEN];
+	int n = IPAddr::FormatIPv4(in4, tmp);
+	AddBytes(tmp, n);
 	}
 
 void ODesc::Add(const IPPrefix& prefix)
@@ -385,6 +397,9 @@ void ODesc::AddBytesRaw(const void* bytes, unsigned int n)
 
 void ODesc::Grow(unsigned int n)
 	{
+	if ( offset + n + SLOP < size )
+		return;
+
 	while ( offset + n + SLOP >= size )
 		size *= 2;
 
@@ -11,8 +11,15 @@
 #include <climits>
 #include <fstream>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include "zeek/3rdparty/doctest.h"
 
+#include "zeek/HugePages.h"
 #include "zeek/Reporter.h"
 #include "zeek/util.h"
 
@@ -42,6 +49,10 @@ public:
 	// point due to an insertion. Only used for robust cookies.
 	std::vector<detail::DictEntry>* visited = nullptr;
 
+	// The last entry returned from the inserted ones, whose key callers
+	// may still refer to.
+	detail::DictEntry current{nullptr};
+
 	void MakeRobust()
 		{
 		// IterCookies can't be made robust after iteration has started.
@@ -217,6 +228,53 @@ TEST_CASE("dict iteration")
 	delete key2;
 	}
 
+TEST_CASE("dict iteration with keys in place")
+	{
+	PDict<uint32_t> dict;
+
+	uint32_t val = 15;
+	uint32_t key_val = 5;
+	auto key = new detail::HashKey(key_val);
+
+	uint32_t val2 = 10;
+	uint32_t key_val2 = 25;
+	auto key2 = new detail::HashKey(key_val2);
+
+	dict.Insert(key, &val);
+	dict.Insert(key2, &val2);
+
+	const void* it_key;
+	int it_key_size;
+	detail::hash_t it_hash;
+	IterCookie* it = dict.InitForIteration();
+	int count = 0;
+
+	while ( uint32_t* entry = dict.NextEntry(it_key, it_key_size, it_hash, it) )
+		{
+		uint32_t k;
+		CHECK(it_key_size == sizeof(k));
+		memcpy(&k, it_key, sizeof(k));
+
+		if ( k == key_val )
+			{
+			CHECK(it_hash == (uint32_t)key->Hash());
+			CHECK(*entry == 15);
+			}
+		else
+			{
+			CHECK(k == key_val2);
+			CHECK(*entry == 10);
+			}
+
+		count++;
+		}
+
+	CHECK(count == 2);
+
+	delete key;
+	delete key2;
+	}
+
 TEST_CASE("dict iterator invalidation")
 	{
 	PDict<uint32_t> dict;
@@ -288,6 +346,44 @@ TEST_CASE("dict iterator invalidation")
 	delete key3;
 	}
 
+TEST_CASE("dict probing")
+	{
+	// Enough entries for several resizes and long clusters.
+	PDict<uint32_t> dict;
+	std::vector<uint32_t> vals(5000);
+
+	for ( uint32_t i = 0; i < vals.size(); i++ )
+		{
+		vals[i] = i;
+		detail::HashKey key(i);
+		dict.Insert(&key, &vals[i]);
+		}
+
+	CHECK(dict.Length() == 5000);
+
+	for ( uint32_t i = 0; i < vals.size(); i += 2 )
+		{
+		detail::HashKey key(i);
+		CHECK(dict.RemoveEntry(key) == &vals[i]);
+		}
+
+	CHECK(dict.Length() == 2500);
+
+	for ( uint32_t i = 0; i < vals.size(); i++ )
+		{
+		detail::HashKey key(i);
+		uint32_t* v = dict.Lookup(&key);
+
+		if ( i % 2 )
+			CHECK(v == &vals[i]);
+		else
+			CHECK(v == nullptr);
+		}
+
+	detail::HashKey missing(uint32_t(10000));
+	CHECK(dict.Lookup(&missing) == nullptr);
+	}
+
 TEST_SUITE_END();
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
@@ -448,6 +544,14 @@ void Dictionary::AssertValid() const
 	ASSERT(valid);
 	DUMPIF(! valid);
 
+	if ( table )
+		for ( int i = 0; i < Capacity(); i++ )
+			{
+			valid = (ctrl[i] == (table[i].Empty() ? detail::DICT_CTRL_EMPTY : table[i].Tag()));
+			ASSERT(valid);
+			DUMPIF(! valid);
+			}
+
 	//entries must clustered together
 	for ( int i = 1; i < Capacity(); i++ )
 		{
@@ -489,6 +593,7 @@ size_t Dictionary::MemoryAllocation() const
 	if ( table )
 		{
 		size += zeek::util::pad_size(Capacity() * sizeof(detail::DictEntry));
+		size += zeek::util::pad_size(Capacity() + detail::DICT_PROBE_GROUP);
 		for ( int i = Capacity()-1; i>=0; i-- )
 			if ( ! table[i].Empty() && table[i].key_size > 8 )
 				size += zeek::util::pad_size(table[i].key_size);
@@ -647,8 +752,10 @@ void Dictionary::Clear()
 				delete_func(table[i].value);
 			table[i].Clear();
 			}
-		free(table);
+		detail::HugePages::Free(table, Capacity() * sizeof(detail::DictEntry));
+		detail::HugePages::Free(ctrl, Capacity() + detail::DICT_PROBE_GROUP);
 		table = nullptr;
+		ctrl = nullptr;
 		}
 
 	if ( order )
@@ -672,9 +779,11 @@ void Dictionary::Clear()
 void Dictionary::Init()
 	{
 	ASSERT(! table);
-	table = (detail::DictEntry*)malloc(sizeof(detail::DictEntry) * Capacity(true));
+	table = (detail::DictEntry*)detail::HugePages::Allocate(sizeof(detail::DictEntry) * Capacity(true));
+	ctrl = (uint8_t*)detail::HugePages::Allocate(Capacity(true) + detail::DICT_PROBE_GROUP);
 	for ( int i = Capacity() - 1; i >= 0; i-- )
 		table[i].SetEmpty();
+	memset(ctrl, detail::DICT_CTRL_EMPTY, Capacity() + detail::DICT_PROBE_GROUP);
 	}
 
 // private
@@ -770,6 +879,10 @@ int Dictionary::LookupIndex(const void* key, int key_size, detail::hash_t hash,
                             int* insert_position/*output*/, int* insert_distance/*output*/)
 	{
 	ASSERT(bucket>=0 && bucket < Buckets());
+
+	if ( ! insert_position && ! insert_distance )
+		return ProbeIndex(key, key_size, hash, bucket, end);
+
 	int i = bucket;
 	for ( ; i < end && ! table[i].Empty() && BucketByPosition(i) <= bucket; i++ )
 		if ( BucketByPosition(i) == bucket && table[i].Equal((char*)key, key_size, hash) )
@@ -785,6 +898,70 @@ int Dictionary::LookupIndex(const void* key, int key_size, detail::hash_t hash,
 	return -1;
 	}
 
+// Returns a bit mask of the control bytes in the group starting at ctrl that equal c.
+static inline uint32_t match_ctrl(const uint8_t* ctrl, uint8_t c)
+	{
+#if defined(__SSE2__)
+	__m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+	__m128i eq = _mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(c)));
+	return static_cast<uint32_t>(_mm_movemask_epi8(eq));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	static const uint8_t bits[16] = { 1, 2, 4, 8, 16, 32, 64, 128,
+	                                  1, 2, 4, 8, 16, 32, 64, 128 };
+	uint8x16_t eq = vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(c));
+	uint8x16_t masked = vandq_u8(eq, vld1q_u8(bits));
+	return vaddv_u8(vget_low_u8(masked)) | (vaddv_u8(vget_high_u8(masked)) << 8);
+#else
+	uint32_t mask = 0;
+	for ( int i = 0; i < detail::DICT_PROBE_GROUP; i++ )
+		if ( ctrl[i] == c )
+			mask |= 1u << i;
+	return mask;
+#endif
+	}
+
+// Same as the scalar loop in LookupIndex(), but only looks at entries whose
+// control byte matches. Within the run of occupied positions starting at the
+// bucket, entries are ordered by bucket, so we can stop at the first matching
+// entry of a later bucket, or at the first empty position.
+int Dictionary::ProbeIndex(const void* key, int key_size, detail::hash_t hash, int bucket, int end) const
+	{
+	uint8_t tag = detail::DictEntry::Tag(hash);
+
+	for ( int group = bucket; group < end; group += detail::DICT_PROBE_GROUP )
+		{
+		uint32_t match = match_ctrl(ctrl + group, tag);
+		uint32_t empty = match_ctrl(ctrl + group, detail::DICT_CTRL_EMPTY);
+
+		// Only consider what comes before the first empty position, and
+		// before the end.
+		if ( empty )
+			match &= (empty & -empty) - 1;
+
+		if ( end - group < detail::DICT_PROBE_GROUP )
+			match &= (1u << (end - group)) - 1;
+
+		while ( match )
+			{
+			int i = group + __builtin_ctz(match);
+			int b = BucketByPosition(i);
+
+			if ( b > bucket )
+				return -1;
+
+			if ( b == bucket && table[i].Equal((const char*)key, key_size, hash) )
+				return i;
+
+			match &= match - 1;
+			}
+
+		if ( empty )
+			return -1;
+		}
+
+	return -1;
+	}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Insert
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -891,14 +1068,14 @@ void Dictionary::InsertAndRelocate(detail::DictEntry& entry, int insert_position
 			{
 			ASSERT(insert_position == Capacity());
 			SizeUp(); //copied all the items to new table. as it's just copying without remapping, insert_position is now empty.
-			table[insert_position] = entry;
+			SetEntry(insert_position, entry);
 			if ( last_affected_position )
 				*last_affected_position = insert_position;
 			return;
 			}
 		if ( table[insert_position].Empty() )
 			{   //the condition to end the loop.
-			table[insert_position] = entry;
+			SetEntry(insert_position, entry);
 			if ( last_affected_position )
 				*last_affected_position = insert_position;
 			return;
@@ -910,7 +1087,7 @@ void Dictionary::InsertAndRelocate(detail::DictEntry& entry, int insert_position
 		t.distance += next - insert_position;
 
 		//swap
-		table[insert_position] = entry;
+		SetEntry(insert_position, entry);
 		entry = t;
 		insert_position = next; //append to the end of the current cluster.
 		}
@@ -936,9 +1113,14 @@ void Dictionary::SizeUp()
 	int prev_capacity = Capacity();
 	log2_buckets++;
 	int capacity = Capacity();
-	table = (detail::DictEntry*)realloc(table, capacity * sizeof(detail::DictEntry));
+	table = (detail::DictEntry*)detail::HugePages::Reallocate(table, prev_capacity * sizeof(detail::DictEntry),
+	                                                          capacity * sizeof(detail::DictEntry));
+	ctrl = (uint8_t*)detail::HugePages::Reallocate(ctrl, prev_capacity + detail::DICT_PROBE_GROUP,
+	                                               capacity + detail::DICT_PROBE_GROUP);
 	for ( int i = prev_capacity; i < capacity; i++ )
 		table[i].SetEmpty();
+	memset(ctrl + prev_capacity, detail::DICT_CTRL_EMPTY,
+	       capacity - prev_capacity + detail::DICT_PROBE_GROUP);
 
 	// REmap from last to first in reverse order. SizeUp can be triggered by 2 conditions, one of
 	// which is that the last space in the table is occupied and there's nowhere to put new items.
@@ -1015,13 +1197,13 @@ detail::DictEntry Dictionary::RemoveAndRelocate(int position, int* last_affected
 		if ( position == Capacity() - 1 || table[position+1].Empty() || table[position+1].distance == 0 )
 			{
 			//no next cluster to fill, or next position is empty or next position is already in perfect bucket.
-			table[position].SetEmpty();
+			SetEmpty(position);
 			if ( last_affected_position )
 				*last_affected_position = position;
 			return entry;
 			}
 		int next = TailOfClusterByPosition(position+1);
-		table[position] = table[next];
+		SetEntry(position, table[next]);
 		table[position].distance -= next - position; //distance improved for the item.
 		position = next;
 		}
@@ -1134,6 +1316,19 @@ void Dictionary::StopIterationNonConst(IterCookie* cookie) //const
 	}
 
 void* Dictionary::NextEntryNonConst(detail::HashKey*& h, IterCookie*& c, bool return_hash) //const
+	{
+	const detail::DictEntry* e = NextDictEntry(c);
+
+	if ( ! e )
+		return nullptr;
+
+	if ( return_hash )
+		h = new detail::HashKey(e->GetKey(), e->key_size, e->hash);
+
+	return e->value;
+	}
+
+const detail::DictEntry* Dictionary::NextDictEntry(IterCookie*& c)
 	{
 	// If there are any inserted entries, return them first.
 	// That keeps the list small and helps avoiding searching
@@ -1153,12 +1348,9 @@ void* Dictionary::NextEntryNonConst(detail::HashKey*& h, IterCookie*& c, bool re
 		{
 		// Return the last one. Order doesn't matter,
 		// and removing from the tail is cheaper.
-		detail::DictEntry e = c->inserted->back();
-		if ( return_hash )
-			h = new detail::HashKey(e.GetKey(), e.key_size, e.hash);
-		void* v = e.value;
+		c->current = c->inserted->back();
 		c->inserted->pop_back();
-		return v;
+		return &c->current;
 		}
 
 	if ( c->next < 0 )
@@ -1201,14 +1393,12 @@ void* Dictionary::NextEntryNonConst(detail::HashKey*& h, IterCookie*& c, bool re
 		}
 
 	ASSERT(! table[c->next].Empty());
-	void* v = table[c->next].value;
-	if ( return_hash )
-		h = new detail::HashKey(table[c->next].GetKey(), table[c->next].key_size, table[c->next].hash);
+	const detail::DictEntry* e = &table[c->next];
 
 	//prepare for next time.
 	c->next = Next(c->next);
 	ASSERT_VALID(c);
-	return v;
+	return e;
 	}
 
 IterCookie* Dictionary::InitForIteration() const
@@ -1223,6 +1413,21 @@ void* Dictionary::NextEntry(detail::HashKey*& h, IterCookie*& cookie, bool retur
 	return dp->NextEntryNonConst(h, cookie, return_hash);
 	}
 
+void* Dictionary::NextEntry(const void*& key, int& key_size, detail::hash_t& hash,
+                            IterCookie*& cookie) const
+	{
+	Dictionary* dp = const_cast<Dictionary*>(this);
+	const detail::DictEntry* e = dp->NextDictEntry(cookie);
+
+	if ( ! e )
+		return nullptr;
+
+	key = e->GetKey();
+	key_size = e->key_size;
+	hash = e->hash;
+	return e->value;
+	}
+
 void Dictionary::StopIteration(IterCookie* cookie) const
 	{
 	Dictionary* dp = const_cast<Dictionary*>(this);
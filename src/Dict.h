@@ -48,6 +48,13 @@ constexpr uint8_t DICT_THRESHOLD_BITS = 3;
 // bucket at which to start looking for the next value to return.
 constexpr uint16_t TOO_FAR_TO_REACH = 0xFFFF;
 
+// Lookups compare this many control bytes at a time.
+constexpr int DICT_PROBE_GROUP = 16;
+
+// Control byte marking an empty position. Control bytes of occupied positions
+// hold the top 7 bits of the entry's hash instead, see DictEntry::Tag().
+constexpr uint8_t DICT_CTRL_EMPTY = 0x80;
+
 /**
  * An entry stored in the dictionary.
  */
@@ -121,6 +128,10 @@ public:
 
 	const char* GetKey() const { return key_size <= 8 ? key_here : key; }
 
+	// The entry's control byte.
+	uint8_t Tag() const	{ return Tag(hash); }
+	static uint8_t Tag(hash_t h)	{ return (h & HASH_MASK) >> 25; }
+
 	bool Equal(const char* arg_key, int arg_key_size, hash_t arg_hash) const
 		{//only 40-bit hash comparison.
 		return ( 0 == ((hash ^ arg_hash) & HASH_MASK) )
@@ -231,6 +242,12 @@ public:
 	void* NextEntry(detail::HashKey*& h, IterCookie*& cookie, bool return_hash) const;
 	void StopIteration(IterCookie* cookie) const;
 
+	// Like NextEntry(), but points key at the entry's key instead of
+	// returning a copy in a new HashKey.  The key remains valid until the
+	// next call or until the dictionary changes.
+	void* NextEntry(const void*& key, int& key_size, detail::hash_t& hash,
+	                IterCookie*& cookie) const;
+
 	void SetDeleteFunc(dict_delete_func f)		{ delete_func = f; }
 
 	// With a robust cookie, it is safe to change the dictionary while
@@ -306,6 +323,21 @@ private:
 	void* NextEntryNonConst(detail::HashKey*& h, IterCookie*& cookie, bool return_hash);
 	void StopIterationNonConst(IterCookie* cookie);
 
+	// Advances the iteration, returning the entry or null at its end.
+	const detail::DictEntry* NextDictEntry(IterCookie*& cookie);
+
+	// Updates a table position together with its control byte.
+	void SetEntry(int position, const detail::DictEntry& entry)
+		{
+		table[position] = entry;
+		ctrl[position] = entry.Tag();
+		}
+	void SetEmpty(int position)
+		{
+		table[position].SetEmpty();
+		ctrl[position] = detail::DICT_CTRL_EMPTY;
+		}
+
 	//Lookup
 	int LinearLookupIndex(const void* key, int key_size, detail::hash_t hash) const;
 	int LookupIndex(const void* key, int key_size, detail::hash_t hash, int* insert_position = nullptr,
@@ -313,6 +345,9 @@ private:
 	int LookupIndex(const void* key, int key_size, detail::hash_t hash, int begin, int end,
 		int* insert_position = nullptr, int* insert_distance  = nullptr);
 
+	// Lookup through the control bytes, comparing a group of them at a time.
+	int ProbeIndex(const void* key, int key_size, detail::hash_t hash, int bucket, int end) const;
+
 	/// Insert entry, Adjust cookies when necessary.
 	void InsertRelocateAndAdjust(detail::DictEntry& entry, int insert_position);
 
@@ -368,6 +403,11 @@ private:
 	uint64_t cum_entries = 0;
 	dict_delete_func delete_func = nullptr;
 	detail::DictEntry* table = nullptr;
+
+	// One control byte per table position, plus one group's worth of padding
+	// so that probing never reads past the end.
+	uint8_t* ctrl = nullptr;
+
 	std::vector<IterCookie*>* cookies = nullptr;
 
 	// Order means the order of insertion. means no deletion until exit. will be inefficient.
@@ -389,6 +429,8 @@ public:
 		}
 	T* Lookup(const detail::HashKey* key) const
 		{ return (T*) Dictionary::Lookup(key); }
+	T* Lookup(const void* key, int key_size, detail::hash_t h) const
+		{ return (T*) Dictionary::Lookup(key, key_size, h); }
 	T* Insert(const char* key, T* val, bool* iterators_invalidated = nullptr)
 		{
 		detail::HashKey h(key);
@@ -410,6 +452,9 @@ public:
 		}
 	T* NextEntry(detail::HashKey*& h, IterCookie*& cookie) const
 		{ return (T*) Dictionary::NextEntry(h, cookie, true); }
+	T* NextEntry(const void*& key, int& key_size, detail::hash_t& hash,
+	             IterCookie*& cookie) const
+		{ return (T*) Dictionary::NextEntry(key, key_size, hash, cookie); }
 	T* RemoveEntry(const detail::HashKey* key, bool* iterators_invalidated = nullptr)
 		{ return (T*) Remove(key->Key(), key->Size(), key->Hash(), false, iterators_invalidated); }
 	T* RemoveEntry(const detail::HashKey& key, bool* iterators_invalidated = nullptr)
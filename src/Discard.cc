@@ -5,6 +5,7 @@
 #include "zeek/Discard.h"
 
 #include <algorithm>
+#include <cstring>
 
 #include "zeek/ZeekString.h"
 #include "zeek/RunState.h"
@@ -13,6 +14,7 @@
 #include "zeek/Val.h"
 #include "zeek/IP.h"
 #include "zeek/Reporter.h" // for InterpreterException
+#include "zeek/net_util.h"
 
 namespace zeek::detail {
 
@@ -24,6 +26,8 @@ Discarder::Discarder()
 	check_icmp = id::find_func("discarder_check_icmp");
 
 	discarder_maxlen = static_cast<int>(id::find_val("discarder_maxlen")->AsCount());
+
+	CompileRules();
 	}
 
 Discarder::~Discarder()
@@ -32,13 +36,168 @@ Discarder::~Discarder()
 
 bool Discarder::IsActive()
 	{
-	return check_ip || check_tcp || check_udp || check_icmp;
+	return ! rules.empty() || check_ip || check_tcp || check_udp || check_icmp;
+	}
+
+void Discarder::CompileRules()
+	{
+	const auto& rv = id::find_val("discard_rules");
+
+	if ( ! rv )
+		return;
+
+	auto vv = rv->AsVectorVal();
+
+	for ( unsigned int i = 0; i < vv->Size(); ++i )
+		{
+		const auto& v = vv->At(i);
+
+		if ( ! v )
+			continue;
+
+		auto r = v->AsRecordVal();
+
+		Rule rule;
+
+		if ( const auto& proto = r->GetField("proto") )
+			rule.proto = proto->AsEnum();
+
+		auto add_nets = [](const ValPtr& v) -> std::unique_ptr<PrefixTable>
+			{
+			if ( ! v )
+				return nullptr;
+
+			auto t = std::make_unique<PrefixTable>();
+			auto nets = v->AsTableVal()->ToPureListVal();
+
+			for ( int j = 0; j < nets->Length(); ++j )
+				t->Insert(nets->Idx(j).get());
+
+			return t;
+			};
+
+		rule.src_nets = add_nets(r->GetField("src_nets"));
+		rule.dst_nets = add_nets(r->GetField("dst_nets"));
+
+		auto port = [r](const char* field)
+			{
+			return static_cast<uint16_t>(std::min(r->GetFieldOrDefault(field)->AsCount(),
+			                                      bro_uint_t(65535)));
+			};
+
+		rule.src_port_min = port("src_port_min");
+		rule.src_port_max = port("src_port_max");
+		rule.dst_port_min = port("dst_port_min");
+		rule.dst_port_max = port("dst_port_max");
+		rule.tcp_flags_mask = r->GetFieldOrDefault("tcp_flags_mask")->AsCount();
+		rule.tcp_flags = r->GetFieldOrDefault("tcp_flags")->AsCount() & rule.tcp_flags_mask;
+
+		if ( const auto& prefix = r->GetField("payload_prefix") )
+			{
+			auto s = prefix->AsString();
+			rule.payload_prefix.assign(reinterpret_cast<const char*>(s->Bytes()), s->Len());
+			}
+
+		rule.needs_transport = rule.src_port_min > 0 || rule.src_port_max < 65535 ||
+		                       rule.dst_port_min > 0 || rule.dst_port_max < 65535 ||
+		                       rule.tcp_flags_mask || ! rule.payload_prefix.empty();
+
+		rules.emplace_back(std::move(rule));
+		}
+	}
+
+bool Discarder::MatchRules(const std::unique_ptr<IP_Hdr>& ip, int len, int caplen) const
+	{
+	int proto;
+
+	switch ( ip->NextProto() ) {
+	case IPPROTO_TCP: proto = TRANSPORT_TCP; break;
+	case IPPROTO_UDP: proto = TRANSPORT_UDP; break;
+	case IPPROTO_ICMP:
+	case IPPROTO_ICMPV6: proto = TRANSPORT_ICMP; break;
+	default: proto = TRANSPORT_UNKNOWN; break;
+	}
+
+	// The transport header, if it's there in full.
+	const u_char* data = ip->Payload();
+	int hdr_len = ip->HdrLen();
+	len -= hdr_len;
+	caplen -= hdr_len;
+
+	int th_len = 0;
+
+	if ( ! ip->IsFragment() )
+		{
+		if ( proto == TRANSPORT_TCP && caplen >= static_cast<int>(sizeof(struct tcphdr)) )
+			th_len = reinterpret_cast<const struct tcphdr*>(data)->th_off * 4;
+		else if ( proto == TRANSPORT_UDP )
+			th_len = sizeof(struct udphdr);
+
+		if ( th_len > caplen )
+			th_len = 0;
+		}
+
+	uint16_t src_port = 0;
+	uint16_t dst_port = 0;
+	uint8_t flags = 0;
+
+	if ( th_len )
+		{
+		// Source and destination port start both headers.
+		auto ports = reinterpret_cast<const uint16_t*>(data);
+		src_port = ntohs(ports[0]);
+		dst_port = ntohs(ports[1]);
+
+		if ( proto == TRANSPORT_TCP )
+			flags = reinterpret_cast<const struct tcphdr*>(data)->th_flags;
+		}
+
+	auto payload = reinterpret_cast<const char*>(data) + th_len;
+	int payload_len = std::max(std::min(len, caplen) - th_len, 0);
+
+	for ( const auto& r : rules )
+		{
+		if ( r.proto >= 0 && r.proto != proto )
+			continue;
+
+		if ( r.needs_transport )
+			{
+			if ( ! th_len )
+				continue;
+
+			if ( src_port < r.src_port_min || src_port > r.src_port_max ||
+			     dst_port < r.dst_port_min || dst_port > r.dst_port_max )
+				continue;
+
+			if ( (flags & r.tcp_flags_mask) != r.tcp_flags ||
+			     (r.tcp_flags_mask && proto != TRANSPORT_TCP) )
+				continue;
+
+			if ( r.payload_prefix.size() > static_cast<size_t>(payload_len) ||
+			     memcmp(payload, r.payload_prefix.data(), r.payload_prefix.size()) != 0 )
+				continue;
+			}
+
+		if ( r.src_nets && ! r.src_nets->Lookup(ip->SrcAddr(), 128) )
+			continue;
+
+		if ( r.dst_nets && ! r.dst_nets->Lookup(ip->DstAddr(), 128) )
+			continue;
+
+		return true;
+		}
+
+	return false;
 	}
 
 bool Discarder::NextPacket(const std::unique_ptr<IP_Hdr>& ip, int len, int caplen)
 	{
 	bool discard_packet = false;
 
+	// The rules come first, as they don't need any script values.
+	if ( ! rules.empty() && MatchRules(ip, len, caplen) )
+		return true;
+
 	if ( check_ip )
 		{
 		zeek::Args args{ip->ToPktHdrVal()};
@@ -4,8 +4,11 @@
 
 #include <sys/types.h> // for u_char
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "zeek/IntrusivePtr.h"
+#include "zeek/PrefixTable.h"
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(IP_Hdr, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Func, zeek);
@@ -26,8 +29,32 @@ public:
 	bool NextPacket(const std::unique_ptr<IP_Hdr>& ip, int len, int caplen);
 
 protected:
+	// A compiled entry of discard_rules.
+	struct Rule {
+		int proto = -1;	// a TransportProto, or -1 for any
+		std::unique_ptr<PrefixTable> src_nets;
+		std::unique_ptr<PrefixTable> dst_nets;
+		uint16_t src_port_min = 0;
+		uint16_t src_port_max = 65535;
+		uint16_t dst_port_min = 0;
+		uint16_t dst_port_max = 65535;
+		uint8_t tcp_flags = 0;
+		uint8_t tcp_flags_mask = 0;
+		std::string payload_prefix;
+
+		// Whether the rule looks at the transport header or payload.
+		bool needs_transport = false;
+	};
+
+	void CompileRules();
+
+	// Returns true if any of the rules matches the packet.
+	bool MatchRules(const std::unique_ptr<IP_Hdr>& ip, int len, int caplen) const;
+
 	Val* BuildData(const u_char* data, int hdrlen, int len, int caplen);
 
+	std::vector<Rule> rules;
+
 	FuncPtr check_ip;
 	FuncPtr check_tcp;
 	FuncPtr check_udp;
@@ -6,18 +6,30 @@
 #include "zeek/Desc.h"
 #include "zeek/Func.h"
 #include "zeek/NetVar.h"
+#include "zeek/PipelineStats.h"
 #include "zeek/Trigger.h"
 #include "zeek/Val.h"
 #include "zeek/plugin/Manager.h"
 #include "zeek/iosource/Manager.h"
 #include "zeek/iosource/PktSrc.h"
 #include "zeek/RunState.h"
+#include "zeek/3rdparty/doctest.h"
 
 zeek::EventMgr zeek::event_mgr;
 zeek::EventMgr& mgr = zeek::event_mgr;
 
 namespace zeek {
 
+// Recycled Event instances, see operator new/delete below.  Never freed,
+// as events may get deleted during static destruction.
+static std::vector<void*>& free_events()
+	{
+	static auto* events = new std::vector<void*>();
+	return *events;
+	}
+
+constexpr size_t MAX_FREE_EVENTS = 4096;
+
 	Event::Event(EventHandlerPtr arg_handler, zeek::Args arg_args,
              util::detail::SourceID arg_src, analyzer::ID arg_aid,
              Obj* arg_obj)
@@ -25,13 +37,78 @@ namespace zeek {
 	  args(std::move(arg_args)),
 	  src(arg_src),
 	  aid(arg_aid),
-	  obj(arg_obj),
-	  next_event(nullptr)
+	  obj(arg_obj)
 	{
 	if ( obj )
 		Ref(obj);
 	}
 
+Event::Event(EventHandlerPtr arg_handler, ArgsGenerator arg_args_gen,
+             util::detail::SourceID arg_src, analyzer::ID arg_aid,
+             Obj* arg_obj)
+	: handler(arg_handler),
+	  args_gen(std::move(arg_args_gen)),
+	  src(arg_src),
+	  aid(arg_aid),
+	  obj(arg_obj)
+	{
+	if ( obj )
+		Ref(obj);
+	}
+
+Event::~Event()
+	{
+	detail::release_args(std::move(args));
+	}
+
+void* Event::operator new(size_t size)
+	{
+	auto& events = free_events();
+
+	if ( size == sizeof(Event) && ! events.empty() )
+		{
+		void* ptr = events.back();
+		events.pop_back();
+		return ptr;
+		}
+
+	return ::operator new(size);
+	}
+
+void Event::operator delete(void* ptr, size_t size)
+	{
+	auto& events = free_events();
+
+	if ( size == sizeof(Event) && events.size() < MAX_FREE_EVENTS )
+		{
+		events.push_back(ptr);
+		return;
+		}
+
+	::operator delete(ptr);
+	}
+
+TEST_CASE("event free list")
+	{
+	auto args = make_args(ValPtr{}, ValPtr{});
+	auto args_data = args.data();
+
+	auto e = new Event(EventHandlerPtr(), std::move(args));
+	void* ptr = e;
+	Unref(e);
+
+	// The next event reuses the instance, and the next argument list
+	// the storage of the deleted event's.
+	e = new Event(EventHandlerPtr(), Args{});
+	CHECK(static_cast<void*>(e) == ptr);
+	Unref(e);
+
+	auto reused = detail::acquire_args(2);
+	CHECK(reused.empty());
+	CHECK(reused.data() == args_data);
+	detail::release_args(std::move(reused));
+	}
+
 void Event::Describe(ODesc* d) const
 	{
 	if ( d->IsReadable() )
@@ -42,7 +119,7 @@ void Event::Describe(ODesc* d) const
 
 	if ( ! d->IsBinary() )
 		d->Add("(");
-	describe_vals(args, d);
+	describe_vals(Args(), d);
 	if ( ! d->IsBinary() )
 		d->Add("(");
 	}
@@ -57,6 +134,9 @@ void Event::Dispatch(bool no_remote)
 
 	try
 		{
+		if ( args_gen )
+			BuildArgs();
+
 		handler->Call(&args, no_remote);
 		}
 
@@ -73,9 +153,20 @@ void Event::Dispatch(bool no_remote)
 		reporter->EndErrorHandler();
 	}
 
+void Event::BuildArgs() const
+	{
+	// Reset first, in case the generator asks for the arguments itself.
+	auto gen = std::move(args_gen);
+	args_gen = nullptr;
+
+	if ( args.empty() )
+		args = detail::acquire_args(0);
+
+	gen(args);
+	}
+
 EventMgr::EventMgr()
 	{
-	head = tail = nullptr;
 	current_src = util::detail::SOURCE_LOCAL;
 	current_aid = 0;
 	src_val = nullptr;
@@ -84,12 +175,8 @@ EventMgr::EventMgr()
 
 EventMgr::~EventMgr()
 	{
-	while ( head )
-		{
-		Event* n = head->NextEvent();
-		Unref(head);
-		head = n;
-		}
+	for ( auto e : queue )
+		Unref(e);
 
 	Unref(src_val);
 	}
@@ -126,26 +213,46 @@ void EventMgr::Enqueue(const EventHandlerPtr& h, Args vl,
                        util::detail::SourceID src,
                        analyzer::ID aid, Obj* obj)
 	{
+	if ( ! WantsEvent(h) )
+		{
+		detail::release_args(std::move(vl));
+		CountUnwanted();
+		return;
+		}
+
 	QueueEvent(new Event(h, std::move(vl), src, aid, obj));
 	}
 
+void EventMgr::EnqueueLazy(const EventHandlerPtr& h, ArgsGenerator args_gen,
+                           util::detail::SourceID src,
+                           analyzer::ID aid, Obj* obj)
+	{
+	if ( WantsEvent(h) )
+		QueueEvent(new Event(h, std::move(args_gen), src, aid, obj));
+	else
+		CountUnwanted();
+	}
+
+bool EventMgr::WantsEvent(const EventHandlerPtr& h) const
+	{
+	return h || new_event ||
+		plugin_mgr->HavePluginForHook(plugin::HOOK_QUEUE_EVENT);
+	}
+
 void EventMgr::QueueEvent(Event* event)
 	{
-	bool done = PLUGIN_HOOK_WITH_RESULT(HOOK_QUEUE_EVENT, HookQueueEvent(event), false);
+	auto h = event->Handler();
+	bool done = (plugin_mgr->HavePluginForHook(plugin::HOOK_QUEUE_EVENT) ||
+	             (h.Ptr() && h->HasPluginHooks())) ?
+		plugin_mgr->HookQueueEvent(event) : false;
 
 	if ( done )
 		return;
 
-	if ( ! head )
-		{
-		head = tail = event;
+	if ( queue.empty() )
 		queue_flare.Fire();
-		}
-	else
-		{
-		tail->SetNext(event);
-		tail = event;
-		}
+
+	queue.push_back(event);
 
 	++event_mgr.num_events_queued;
 	}
@@ -163,6 +270,7 @@ void EventMgr::Drain()
 		Enqueue(event_queue_flush_point, Args{});
 
 	detail::SegmentProfiler prof(detail::segment_logger, "draining-events");
+	detail::StageTimer timer(detail::PipelineStats::EVENT_DRAIN);
 
 	PLUGIN_HOOK_VOID(HOOK_DRAIN_EVENTS, HookDrainEvents());
 
@@ -175,26 +283,33 @@ void EventMgr::Drain()
 	// just one round to make it less likley to break existing scripts
 	// that expect the old behavior to trigger something quickly.
 
-	for ( int round = 0; head && round < 2; round++ )
+	// A handler may drain events itself, leaving spare_queue to
+	// that nested Drain().
+	std::vector<Event*> current;
+	current.swap(spare_queue);
+
+	for ( int round = 0; ! queue.empty() && round < 2; round++ )
 		{
-		Event* current = head;
-		head = nullptr;
-		tail = nullptr;
+		current.swap(queue);
 
-		while ( current )
-			{
-			Event* next = current->NextEvent();
+		if ( EventHandler::TelemetryEnabled() )
+			max_queue_depth = std::max(max_queue_depth, static_cast<uint64_t>(current.size()));
 
-			current_src = current->Source();
-			current_aid = current->Analyzer();
-			current->Dispatch();
-			Unref(current);
+		for ( auto event : current )
+			{
+			current_src = event->Source();
+			current_aid = event->Analyzer();
+			event->Dispatch();
+			Unref(event);
 
 			++event_mgr.num_events_dispatched;
-			current = next;
 			}
+
+		current.clear();
 		}
 
+	spare_queue.swap(current);
+
 	// Note: we might eventually need a general way to specify things to
 	// do after draining events.
 	draining = false;
@@ -206,14 +321,9 @@ void EventMgr::Drain()
 
 void EventMgr::Describe(ODesc* d) const
 	{
-	int n = 0;
-	Event* e;
-	for ( e = head; e; e = e->NextEvent() )
-		++n;
-
-	d->AddCount(n);
+	d->AddCount(queue.size());
 
-	for ( e = head; e; e = e->NextEvent() )
+	for ( auto e : queue )
 		{
 		e->Describe(d);
 		d->NL();
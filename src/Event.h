@@ -4,6 +4,7 @@
 
 #include <tuple>
 #include <type_traits>
+#include <vector>
 
 #include "zeek/ZeekList.h"
 #include "zeek/analyzer/Analyzer.h"
@@ -22,13 +23,29 @@ public:
 	      util::detail::SourceID src = util::detail::SOURCE_LOCAL, analyzer::ID aid = 0,
 	      Obj* obj = nullptr);
 
-	void SetNext(Event* n)		{ next_event = n; }
-	Event* NextEvent() const	{ return next_event; }
+	/**
+	 * Constructor for an event whose arguments get built on demand.
+	 */
+	Event(EventHandlerPtr handler, ArgsGenerator args_gen,
+	      util::detail::SourceID src = util::detail::SOURCE_LOCAL, analyzer::ID aid = 0,
+	      Obj* obj = nullptr);
+	~Event() override;
+
+	// Instances get recycled through a free list, as there's a steady
+	// stream of short-lived ones.
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr, size_t size);
 
 	util::detail::SourceID Source() const		{ return src; }
 	analyzer::ID Analyzer() const	{ return aid; }
 	EventHandlerPtr Handler() const	{ return handler; }
-	const zeek::Args& Args() const	{ return args; }
+	const zeek::Args& Args() const
+		{
+		if ( args_gen )
+			BuildArgs();
+
+		return args;
+		}
 
 	void Describe(ODesc* d) const override;
 
@@ -39,12 +56,14 @@ protected:
 	// EventMgr::Dispatch().
 	void Dispatch(bool no_remote = false);
 
+	void BuildArgs() const;
+
 	EventHandlerPtr handler;
-	zeek::Args args;
+	mutable zeek::Args args;
+	mutable ArgsGenerator args_gen;
 	util::detail::SourceID src;
 	analyzer::ID aid;
 	Obj* obj;
-	Event* next_event;
 };
 
 class EventMgr final : public Obj, public iosource::IOSource {
@@ -86,10 +105,10 @@ public:
 	                detail::TimerMgr* mgr = nullptr, Obj* obj = nullptr);
 
 	/**
-	 * Adds an event to the queue.  If no handler is found for the event
-	 * when later going to call it, nothing happens except for having
-	 * wasted a bit of time/resources, so callers may want to first check
-	 * if any handler/consumer exists before enqueuing an event.
+	 * Adds an event to the queue.  Events that nothing wants, as per
+	 * WantsEvent(), get dropped right away.  As that happens only after
+	 * building the arguments, callers may want to first check if any
+	 * handler/consumer exists before enqueuing an event.
 	 * @param h  reference to the event handler to later call.
 	 * @param vl  the argument list to the event handler call.
 	 * @param src  indicates the origin of the event (local versus remote).
@@ -101,6 +120,22 @@ public:
 	             util::detail::SourceID src = util::detail::SOURCE_LOCAL, analyzer::ID aid = 0,
 	             Obj* obj = nullptr);
 
+	/**
+	 * Adds an event to the queue whose arguments get built only once
+	 * it's dispatched.  Other than Enqueue(), this avoids building them
+	 * in the first place if nothing wants the event, so callers need
+	 * not check for that.
+	 * @param h  reference to the event handler to later call.
+	 * @param args_gen  builds the argument list to the event handler call.
+	 * @param src  indicates the origin of the event (local versus remote).
+	 * @param aid  identifies the protocol analyzer generating the event.
+	 * @param obj  an arbitrary object to use as a "cookie" or just hold a
+	 * reference to until dispatching the event.
+	 */
+	void EnqueueLazy(const EventHandlerPtr& h, ArgsGenerator args_gen,
+	                 util::detail::SourceID src = util::detail::SOURCE_LOCAL,
+	                 analyzer::ID aid = 0, Obj* obj = nullptr);
+
 	/**
 	 * A version of Enqueue() taking a variable number of arguments.
 	 */
@@ -109,14 +144,28 @@ public:
 		std::is_convertible_v<
 			std::tuple_element_t<0, std::tuple<Args...>>, ValPtr>>
 	Enqueue(const EventHandlerPtr& h, Args&&... args)
-		{ return Enqueue(h, zeek::Args{std::forward<Args>(args)...}); }
+		{
+		if ( WantsEvent(h) )
+			Enqueue(h, make_args(std::forward<Args>(args)...));
+		else
+			CountUnwanted();
+		}
+
+	/**
+	 * Returns whether an event for a handler would do anything once
+	 * dispatched, or whether something else wants to see it: handling
+	 * of new_event, or a plugin hooking into event queueing.  Enqueue()
+	 * drops events for which this is false, but still counts them as
+	 * queued and dispatched.
+	 */
+	bool WantsEvent(const EventHandlerPtr& h) const;
 
 	void Dispatch(Event* event, bool no_remote = false);
 
 	void Drain();
 	bool IsDraining() const	{ return draining; }
 
-	bool HasEvents() const	{ return head != nullptr; }
+	bool HasEvents() const	{ return ! queue.empty(); }
 
 	// Returns the source ID of last raised event.
 	util::detail::SourceID CurrentSource() const	{ return current_src; }
@@ -138,11 +187,27 @@ public:
 	uint64_t num_events_queued = 0;
 	uint64_t num_events_dispatched = 0;
 
+	// The largest number of events a round of draining found queued,
+	// while event handler telemetry is on.
+	uint64_t max_queue_depth = 0;
+
 protected:
 	void QueueEvent(Event* event);
 
-	Event* head;
-	Event* tail;
+	// Accounts for an event dropped as nothing wants it, just as if it
+	// had been dispatched without effect.
+	void CountUnwanted()
+		{
+		++num_events_queued;
+		++num_events_dispatched;
+		}
+
+	// Events in the order they got queued.  Draining swaps this with
+	// spare_queue, so that events queued meanwhile wait for the next
+	// round, and both vectors keep their storage for reuse.
+	std::vector<Event*> queue;
+	std::vector<Event*> spare_queue;
+
 	util::detail::SourceID current_src;
 	analyzer::ID current_aid;
 	RecordVal* src_val;
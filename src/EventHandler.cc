@@ -1,5 +1,8 @@
 #include "zeek/EventHandler.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "zeek/Event.h"
 #include "zeek/Desc.h"
 #include "zeek/Func.h"
@@ -13,6 +16,8 @@
 
 namespace zeek {
 
+bool EventHandler::telemetry_enabled = false;
+
 EventHandler::EventHandler(std::string arg_name)
 	{
 	name = std::move(arg_name);
@@ -25,7 +30,7 @@ EventHandler::EventHandler(std::string arg_name)
 EventHandler::operator bool() const
 	{
 	return enabled && ((local && local->HasBodies())
-			   || generate_always
+			   || generate_always || plugin_hooks
 			   || ! auto_publish.empty());
 	}
 
@@ -106,8 +111,48 @@ void EventHandler::Call(Args* vl, bool no_remote)
 		}
 
 	if ( local )
+		{
 		// No try/catch here; we pass exceptions upstream.
+		if ( ! telemetry_enabled )
+			{
+			local->Invoke(vl);
+			return;
+			}
+
+		double start = util::current_time(true);
 		local->Invoke(vl);
+
+		if ( ! telemetry )
+			telemetry = std::make_unique<Telemetry>();
+
+		telemetry->Add(util::current_time(true) - start);
+		}
+	}
+
+void EventHandler::Telemetry::Add(double t)
+	{
+	++calls;
+	time += t;
+
+	double us = t * 1e6;
+	int b = us > 1 ? static_cast<int>(4 * std::log2(us)) : 0;
+	++hist[std::min(b, BUCKETS - 1)];
+	}
+
+double EventHandler::Telemetry::Quantile(double q) const
+	{
+	uint64_t want = static_cast<uint64_t>(std::ceil(q * calls));
+	uint64_t seen = 0;
+
+	for ( int b = 0; b < BUCKETS; ++b )
+		{
+		seen += hist[b];
+
+		if ( seen >= want && seen > 0 )
+			return std::exp2((b + 1) / 4.0) / 1e6;
+		}
+
+	return 0;
 	}
 
 void EventHandler::NewEvent(Args* vl)
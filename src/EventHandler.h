@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <memory>
 #include <unordered_set>
 #include <string>
 
@@ -67,6 +70,36 @@ public:
 	void SetGenerateAlways()	{ generate_always = true; }
 	bool GenerateAlways()	{ return generate_always; }
 
+	// Whether a plugin hooks the queueing of this event in particular,
+	// see Plugin::EnableEventHook().  That makes the event get raised
+	// just as SetGenerateAlways() does.
+	void SetPluginHooks(bool arg_plugin_hooks)	{ plugin_hooks = arg_plugin_hooks; }
+	bool HasPluginHooks() const	{ return plugin_hooks; }
+
+	// Statistics of the handler's invocations while telemetry is on.
+	struct Telemetry {
+		// Invocation times go into buckets growing by a factor of
+		// 2^(1/4), starting at one microsecond.
+		static constexpr int BUCKETS = 100;
+
+		uint64_t calls = 0;
+		double time = 0;	// seconds, in total
+		std::array<uint32_t, BUCKETS> hist{};
+
+		void Add(double t);
+
+		// Returns an upper bound of the given quantile of the
+		// invocation times, in seconds.
+		double Quantile(double q) const;
+	};
+
+	// Returns nullptr if the handler hasn't run since the last reset.
+	const Telemetry* GetTelemetry() const	{ return telemetry.get(); }
+	void ResetTelemetry()	{ telemetry.reset(); }
+
+	static void SetTelemetryEnabled(bool enabled)	{ telemetry_enabled = enabled; }
+	static bool TelemetryEnabled()	{ return telemetry_enabled; }
+
 private:
 	void NewEvent(zeek::Args* vl);	// Raise new_event() meta event.
 
@@ -77,8 +110,12 @@ private:
 	bool enabled;
 	bool error_handler;	// this handler reports error messages.
 	bool generate_always;
+	bool plugin_hooks = false;
 
 	std::unordered_set<std::string> auto_publish;
+
+	std::unique_ptr<Telemetry> telemetry;
+	static bool telemetry_enabled;
 };
 
 // Encapsulates a ptr to an event handler to overload the boolean operator.
@@ -758,6 +758,14 @@ ValPtr BinaryExpr::StringFold(Val* v1, Val* v2) const
 	case EXPR_ADD:
 	case EXPR_ADD_TO:
 		{
+		// Strings don't change once created, so appending to or
+		// prepending an empty one can return the other as is.
+		if ( s2->Len() == 0 )
+			return {NewRef{}, v1};
+
+		if ( s1->Len() == 0 )
+			return {NewRef{}, v2};
+
 		std::vector<const String*> strings;
 		strings.push_back(s1);
 		strings.push_back(s2);
@@ -4198,6 +4206,33 @@ CallExpr::CallExpr(ExprPtr arg_func, ListExprPtr arg_args, bool in_hook)
 		else
 			SetType(yield);
 
+		// Calls of built-ins with a direct entry point can take it if
+		// the arguments need no coercion.
+		if ( func->Tag() == EXPR_NAME )
+			{
+			const auto& id = static_cast<NameExpr*>(func.get())->Id();
+			const auto& v = id->IsGlobal() ? id->GetVal() : nullptr;
+
+			if ( v && v->GetType()->Tag() == TYPE_FUNC &&
+			     v->AsFunc()->GetKind() == Func::BUILTIN_FUNC )
+				{
+				auto bif = static_cast<const BuiltinFunc*>(v->AsFunc());
+				const auto& params = func_type->AsFuncType()->Params();
+				const ExprPList& e = args->Exprs();
+				bool match = bif->Direct() && e.length() == params->NumFields() &&
+				             e.length() <= BuiltinFunc::MAX_DIRECT_ARGS;
+
+				for ( int i = 0; match && i < e.length(); ++i )
+					{
+					const auto& pt = params->GetFieldType(i);
+					match = pt->Tag() != TYPE_ANY && same_type(e[i]->GetType(), pt);
+					}
+
+				if ( match )
+					direct = bif;
+				}
+			}
+
 		// Check for call to built-ins that can be statically analyzed.
 		ValPtr func_val;
 
@@ -4272,6 +4307,10 @@ ValPtr CallExpr::Eval(Frame* f) const
 
 	ValPtr ret;
 	auto func_val = func->Eval(f);
+
+	if ( direct && func_val && func_val->AsFunc() == direct && direct->CanCallDirect() )
+		return EvalDirect(f);
+
 	auto v = eval_list(f, args.get());
 
 	if ( func_val && v )
@@ -4292,6 +4331,25 @@ ValPtr CallExpr::Eval(Frame* f) const
 	return ret;
 	}
 
+ValPtr CallExpr::EvalDirect(Frame* f) const
+	{
+	const ExprPList& e = args->Exprs();
+	ValPtr vals[BuiltinFunc::MAX_DIRECT_ARGS];
+	Val* borrowed[BuiltinFunc::MAX_DIRECT_ARGS];
+
+	for ( int i = 0; i < e.length(); ++i )
+		{
+		vals[i] = e[i]->Eval(f);
+
+		if ( ! vals[i] )
+			return nullptr;
+
+		borrowed[i] = vals[i].get();
+		}
+
+	return direct->Direct()(borrowed);
+	}
+
 TraversalCode CallExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
@@ -76,6 +76,7 @@ class NameExpr;
 class IndexExpr;
 class AssignExpr;
 class CallExpr;
+class BuiltinFunc;
 class EventExpr;
 class Stmt;
 
@@ -262,6 +263,8 @@ public:
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 protected:
+	friend class ScriptOptimizer;
+
 	UnaryExpr(BroExprTag arg_tag, ExprPtr arg_op);
 
 	void ExprDescribe(ODesc* d) const override;
@@ -287,6 +290,8 @@ public:
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 protected:
+	friend class ScriptOptimizer;
+
 	BinaryExpr(BroExprTag arg_tag,
 	           ExprPtr arg_op1, ExprPtr arg_op2)
 		: Expr(arg_tag), op1(std::move(arg_op1)), op2(std::move(arg_op2))
@@ -474,6 +479,8 @@ public:
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 protected:
+	friend class ScriptOptimizer;
+
 	void ExprDescribe(ODesc* d) const override;
 
 	ExprPtr op1;
@@ -823,8 +830,15 @@ public:
 protected:
 	void ExprDescribe(ODesc* d) const override;
 
+	// Calls the direct entry point of the built-in.
+	ValPtr EvalDirect(Frame* f) const;
+
 	ExprPtr func;
 	ListExprPtr args;
+
+	// The callee, if it's a built-in with a direct entry point that the
+	// arguments' types suit.
+	const BuiltinFunc* direct = nullptr;
 };
 
 
@@ -0,0 +1,161 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/FileMagicIndex.h"
+
+#include <ctype.h>
+#include <algorithm>
+#include <cstring>
+
+#include "zeek/LiteralPrefilter.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+bool FileMagicIndex::Add(const char* pattern, int id)
+	{
+	int offset;
+	std::string lit;
+	bool nocase, whole;
+
+	if ( ! LiteralPrefilter::AnchoredLiteral(pattern, &offset, &lit, &nocase, &whole) )
+		return false;
+
+	Entry e{std::move(lit), nocase, id, nullptr};
+
+	if ( nocase )
+		for ( auto& c : e.lit )
+			c = tolower(static_cast<u_char>(c));
+
+	if ( ! whole )
+		{
+		// Like the signature matcher's file magic groups.
+		e.re = std::make_unique<Specific_RE_Matcher>(MATCH_EXACTLY, 1);
+
+		string_list exprs;
+		int_list ids;
+		exprs.push_back(const_cast<char*>(pattern));
+		ids.push_back(id);
+
+		if ( ! e.re->CompileSet(exprs, ids) )
+			return false;
+		}
+
+	auto t = std::lower_bound(tables.begin(), tables.end(), offset,
+	                          [](const Table& t, int offset) { return t.offset < offset; });
+
+	if ( t == tables.end() || t->offset != offset )
+		{
+		t = tables.emplace(t);
+		t->offset = offset;
+		}
+
+	uint32_t n = entries.size();
+	u_char first = e.lit[0];
+	t->buckets[first].push_back(n);
+
+	if ( nocase && toupper(first) != first )
+		t->buckets[toupper(first)].push_back(n);
+
+	entries.push_back(std::move(e));
+	return true;
+	}
+
+bool FileMagicIndex::Matches(const Entry& e, const u_char* data, int len) const
+	{
+	int n = e.lit.size();
+
+	if ( n > len )
+		return false;
+
+	if ( ! e.nocase )
+		return memcmp(e.lit.data(), data, n) == 0;
+
+	for ( int i = 0; i < n; ++i )
+		if ( tolower(data[i]) != static_cast<u_char>(e.lit[i]) )
+			return false;
+
+	return true;
+	}
+
+bool FileMagicIndex::Match(const u_char* data, int len, AcceptingMatchSet* matches) const
+	{
+	bool matched = false;
+
+	for ( const auto& t : tables )
+		{
+		if ( t.offset >= len )
+			break;
+
+		for ( auto n : t.buckets[data[t.offset]] )
+			{
+			const Entry& e = entries[n];
+
+			if ( ! Matches(e, data + t.offset, len - t.offset) )
+				continue;
+
+			if ( ! e.re )
+				{
+				// Positions count the beginning of the data as
+				// the first symbol, as RE_Match_State does.
+				matches->insert({e.id, t.offset + e.lit.size()});
+				matched = true;
+				continue;
+				}
+
+			RE_Match_State s(e.re.get());
+
+			if ( s.Match(data, len, true, false, true) )
+				{
+				const auto& am = s.AcceptedMatches();
+				matches->insert(am.begin(), am.end());
+				matched = true;
+				}
+			}
+		}
+
+	return matched;
+	}
+
+} // namespace zeek::detail
+
+TEST_CASE("file magic index")
+	{
+	using zeek::detail::FileMagicIndex;
+	FileMagicIndex idx;
+
+	CHECK(idx.Add("^\\x89PNG", 1));
+	CHECK(idx.Add("^.{4}ftyp", 2));
+	CHECK(idx.Add("(?i:^<html)", 3));
+	CHECK_FALSE(idx.Add("^(GIF87a|GIF89a)", 4));
+	CHECK_FALSE(idx.Add("^[a-z]+", 5));
+	CHECK(idx.Add("^\\x7fELF[\\x01\\x02]", 6));
+	CHECK(idx.Size() == 4);
+
+	zeek::detail::AcceptingMatchSet m;
+	auto match = [&](const std::string& s)
+		{
+		m.clear();
+		return idx.Match(reinterpret_cast<const u_char*>(s.data()), s.size(), &m);
+		};
+
+	CHECK(match("\x89PNG\r\n"));
+	CHECK(m.size() == 1);
+	CHECK(m.count(1) == 1);
+	CHECK(m[1] == 4);
+
+	CHECK(match(std::string("\0\0\0\x18" "ftypmp42", 12)));
+	CHECK(m.count(2) == 1);
+
+	CHECK(match("<HTML><body>"));
+	CHECK(m.count(3) == 1);
+
+	// Patterns with more than their literal run their expressions.
+	CHECK(match("\x7f" "ELF\x02"));
+	CHECK(m.count(6) == 1);
+	CHECK_FALSE(match("\x7f" "ELF\x03"));
+
+	CHECK_FALSE(match("xPNG"));
+	CHECK_FALSE(match("\x89P"));
+	}
@@ -0,0 +1,80 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A table of file magic patterns by the bytes they start with, which
+// replaces running their regular expressions on every file.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zeek/RE.h"
+
+namespace zeek::detail {
+
+/**
+ * Matches the file magic patterns of the form "^.{<offset>}<literal>...",
+ * which are most of them.  Patterns get looked up through the data's byte
+ * at each of their offsets, and only those whose literals are there go on
+ * to match.  Patterns that consist of just their literals match right
+ * then, while the others run their own regular expressions.  All other
+ * patterns remain with the signature matcher's pattern groups.
+ */
+class FileMagicIndex {
+public:
+	/**
+	 * Adds a pattern, if it has the right form.
+	 *
+	 * @param pattern  The pattern's text, as given in a signature.
+	 *
+	 * @param id  The pattern's accept index.
+	 *
+	 * @return  False if the pattern needs to go into a pattern group.
+	 */
+	bool Add(const char* pattern, int id);
+
+	/**
+	 * Matches the patterns against the start of a file.
+	 *
+	 * @param data  The file's first bytes.
+	 *
+	 * @param len  The length of data.
+	 *
+	 * @param matches  Receives the accept indices of the patterns that
+	 * match, with the positions of their matches.
+	 *
+	 * @return  True if any pattern matched.
+	 */
+	bool Match(const u_char* data, int len, AcceptingMatchSet* matches) const;
+
+	/**
+	 * Returns the number of patterns in the index.
+	 */
+	size_t Size() const	{ return entries.size(); }
+
+private:
+	struct Entry {
+		std::string lit;	// Lower-cased if nocase.
+		bool nocase;
+		int id;
+		// Null if the literal is the whole pattern.
+		std::unique_ptr<Specific_RE_Matcher> re;
+	};
+
+	// The patterns whose literals start at the same offset, by the
+	// literals' first bytes.
+	struct Table {
+		int offset;
+		std::vector<uint32_t> buckets[256];
+	};
+
+	bool Matches(const Entry& e, const u_char* data, int len) const;
+
+	std::vector<Entry> entries;
+	std::vector<Table> tables;	// Ordered by offset.
+};
+
+} // namespace zeek::detail
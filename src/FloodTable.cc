@@ -0,0 +1,110 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/FloodTable.h"
+
+#include "zeek/Event.h"
+#include "zeek/Hash.h"
+#include "zeek/ID.h"
+#include "zeek/NetVar.h"
+#include "zeek/Val.h"
+
+namespace zeek::detail {
+
+bool FloodTable::Summarize(double t, const IPAddr& src, TransportProto proto, uint32_t len)
+	{
+	if ( t >= interval_end )
+		{
+		if ( interval_end > 0.0 )
+			EndInterval();
+
+		interval_end = t + BifConst::flood_summary_interval;
+		}
+
+	Source& s = sources[src];
+	++s.new_flows;
+
+	if ( ! s.summarizing )
+		{
+		if ( s.new_flows <= BifConst::flood_flow_threshold )
+			return false;
+
+		s.summarizing = true;
+		}
+
+	Summary& sum = proto == TRANSPORT_UDP ? s.udp : s.icmp;
+
+	if ( ! sum.pkts )
+		sum.first = t;
+
+	sum.last = t;
+	++sum.pkts;
+	sum.bytes += len;
+	return true;
+	}
+
+void FloodTable::EndInterval()
+	{
+	for ( auto it = sources.begin(); it != sources.end(); )
+		{
+		Source& s = it->second;
+
+		if ( s.udp.pkts )
+			Report(it->first, TRANSPORT_UDP, s.udp);
+
+		if ( s.icmp.pkts )
+			Report(it->first, TRANSPORT_ICMP, s.icmp);
+
+		if ( s.new_flows > BifConst::flood_flow_threshold )
+			{
+			s.new_flows = 0;
+			s.summarizing = true;
+			s.udp = s.icmp = Summary();
+			++it;
+			}
+		else
+			it = sources.erase(it);
+		}
+	}
+
+void FloodTable::Flush()
+	{
+	for ( const auto& [src, s] : sources )
+		{
+		if ( s.udp.pkts )
+			Report(src, TRANSPORT_UDP, s.udp);
+
+		if ( s.icmp.pkts )
+			Report(src, TRANSPORT_ICMP, s.icmp);
+		}
+
+	sources.clear();
+	interval_end = 0.0;
+	}
+
+void FloodTable::Report(const IPAddr& src, TransportProto proto, const Summary& s)
+	{
+	if ( ! flood_summary )
+		return;
+
+	static auto flood_summary_type = id::find_type<RecordType>("FloodSummary");
+
+	auto r = make_intrusive<RecordVal>(flood_summary_type);
+	r->AssignAddr(0, src);
+	r->Assign(1, id::transport_proto->GetEnumVal(proto));
+	r->AssignTime(2, s.first);
+	r->AssignInterval(3, s.last - s.first);
+	r->AssignCount(4, s.pkts);
+	r->AssignCount(5, s.bytes);
+
+	event_mgr.Enqueue(flood_summary, std::move(r));
+	}
+
+size_t FloodTable::AddrHash::operator()(const IPAddr& a) const
+	{
+	uint32_t words[4];
+	a.CopyIPv6(words);
+	return HashKey::HashBytes(words, sizeof(words));
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,86 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Per-source counters of UDP and ICMP packets, kept instead of connections
+// for sources that start flows faster than a threshold.
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+
+#include "zeek/IPAddr.h"
+#include "zeek/net_util.h"
+
+namespace zeek::detail {
+
+/**
+ * Counts the UDP and ICMP packets that don't belong to a connection by
+ * their source, when :zeek:see:`flood_flow_threshold` is set.  Once a
+ * source sends more such packets within :zeek:see:`flood_summary_interval`
+ * than the threshold, its further ones become part of a summary instead of
+ * connections.  The summaries get reported through :zeek:see:`flood_summary`
+ * at the end of each interval, and a source keeps getting summarized for
+ * as long as it stays above the threshold.
+ */
+class FloodTable {
+public:
+	/**
+	 * Counts a packet that doesn't belong to a connection.
+	 *
+	 * @param t  The packet's time.
+	 *
+	 * @param src  The packet's source address.
+	 *
+	 * @param proto  Either TRANSPORT_UDP or TRANSPORT_ICMP.
+	 *
+	 * @param len  The packet's length, including its IP header.
+	 *
+	 * @return  True if the packet went into the source's summary, false
+	 * if it should start a connection.
+	 */
+	bool Summarize(double t, const IPAddr& src, TransportProto proto, uint32_t len);
+
+	/**
+	 * Reports all summaries.
+	 */
+	void Flush();
+
+	/**
+	 * Returns the number of sources counted in the current interval.
+	 */
+	size_t Size() const	{ return sources.size(); }
+
+private:
+	struct Summary {
+		double first = 0.0;
+		double last = 0.0;
+		uint64_t pkts = 0;
+		uint64_t bytes = 0;
+	};
+
+	struct Source {
+		// The packets counted in the current interval, whether
+		// summarized or not.
+		uint64_t new_flows = 0;
+		// Set once the source exceeded the threshold, and kept for
+		// the next interval then.
+		bool summarizing = false;
+		Summary udp;
+		Summary icmp;
+	};
+
+	// Reports the summaries of the interval that ended, and forgets the
+	// sources that stayed below the threshold.
+	void EndInterval();
+
+	static void Report(const IPAddr& src, TransportProto proto, const Summary& s);
+
+	struct AddrHash {
+		size_t operator()(const IPAddr& a) const;
+	};
+
+	std::unordered_map<IPAddr, Source, AddrHash> sources;
+	double interval_end = 0.0;
+};
+
+} // namespace zeek::detail
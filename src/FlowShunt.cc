@@ -0,0 +1,185 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/FlowShunt.h"
+
+#include <netinet/in.h>
+#include <algorithm>
+#include <utility>
+
+#include "zeek/RunState.h"
+
+namespace zeek::detail {
+
+FlowShunt::Key::Key(const u_char* a1, uint16_t p1, const u_char* a2, uint16_t p2, uint8_t arg_proto)
+	{
+	memset(this, 0, sizeof(*this));
+
+	int c = memcmp(a1, a2, 16);
+
+	if ( c > 0 || (c == 0 && p1 > p2) )
+		{
+		std::swap(a1, a2);
+		std::swap(p1, p2);
+		}
+
+	memcpy(addr1, a1, 16);
+	memcpy(addr2, a2, 16);
+	port1 = p1;
+	port2 = p2;
+	proto = arg_proto;
+	}
+
+size_t FlowShunt::KeyHash::operator()(const Key& k) const
+	{
+	static_assert(sizeof(Key) % 4 == 0, "FlowShunt::Key must consist of whole words");
+
+	// FNV-1a, over 32-bit words.
+	uint32_t words[sizeof(Key) / 4];
+	memcpy(words, &k, sizeof(words));
+
+	uint64_t h = 14695981039346656037ULL;
+
+	for ( auto w : words )
+		{
+		h ^= w;
+		h *= 1099511628211ULL;
+		}
+
+	return h;
+	}
+
+FlowShunt::Key FlowShunt::MakeKey(const IPAddr& orig_h, uint32_t orig_p, const IPAddr& resp_h,
+                                  uint32_t resp_p, uint8_t proto)
+	{
+	in6_addr a1, a2;
+	orig_h.CopyIPv6(&a1);
+	resp_h.CopyIPv6(&a2);
+
+	// Ports are kept in network order, as they appear in packets.
+	return Key(reinterpret_cast<const u_char*>(&a1), htons(orig_p),
+	           reinterpret_cast<const u_char*>(&a2), htons(resp_p), proto);
+	}
+
+static int to_ip_proto(TransportProto proto)
+	{
+	switch ( proto ) {
+	case TRANSPORT_TCP:
+		return IPPROTO_TCP;
+	case TRANSPORT_UDP:
+		return IPPROTO_UDP;
+	default:
+		return -1;
+	}
+	}
+
+bool FlowShunt::Add(const IPAddr& orig_h, uint32_t orig_p, const IPAddr& resp_h, uint32_t resp_p,
+                    TransportProto proto, double expire)
+	{
+	int ip_proto = to_ip_proto(proto);
+
+	if ( ip_proto < 0 )
+		return false;
+
+	if ( flows.size() >= expire_at_size )
+		Expire();
+
+	flows[MakeKey(orig_h, orig_p, resp_h, resp_p, ip_proto)] = expire;
+	return true;
+	}
+
+bool FlowShunt::Remove(const IPAddr& orig_h, uint32_t orig_p, const IPAddr& resp_h, uint32_t resp_p,
+                       TransportProto proto)
+	{
+	int ip_proto = to_ip_proto(proto);
+
+	if ( ip_proto < 0 )
+		return false;
+
+	return flows.erase(MakeKey(orig_h, orig_p, resp_h, resp_p, ip_proto)) > 0;
+	}
+
+void FlowShunt::Expire()
+	{
+	for ( auto it = flows.begin(); it != flows.end(); )
+		{
+		if ( it->second && it->second <= run_state::network_time )
+			it = flows.erase(it);
+		else
+			++it;
+		}
+
+	// Don't scan again before the table has doubled in size.
+	expire_at_size = std::max(flows.size() * 2, size_t(1024));
+	}
+
+bool FlowShunt::Match(const u_char* data, size_t len)
+	{
+	if ( flows.empty() || len < 1 )
+		return false;
+
+	const u_char* src;
+	const u_char* dst;
+	const u_char* ports;
+	uint8_t proto;
+	u_char mapped_src[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+	u_char mapped_dst[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+	switch ( data[0] >> 4 ) {
+	case 4:
+		{
+		size_t hdr_len = (data[0] & 0x0f) * 4;
+
+		if ( hdr_len < 20 || len < hdr_len + 4 )
+			return false;
+
+		// Only the first fragment would have the ports.
+		if ( ((data[6] << 8) | data[7]) & 0x3fff )
+			return false;
+
+		proto = data[9];
+		memcpy(mapped_src + 12, data + 12, 4);
+		memcpy(mapped_dst + 12, data + 16, 4);
+		src = mapped_src;
+		dst = mapped_dst;
+		ports = data + hdr_len;
+		break;
+		}
+
+	case 6:
+		if ( len < 40 + 4 )
+			return false;
+
+		proto = data[6];
+		src = data + 8;
+		dst = data + 24;
+		ports = data + 40;
+		break;
+
+	default:
+		return false;
+	}
+
+	if ( proto != IPPROTO_TCP && proto != IPPROTO_UDP )
+		return false;
+
+	uint16_t sport, dport;
+	memcpy(&sport, ports, 2);
+	memcpy(&dport, ports + 2, 2);
+
+	auto it = flows.find(Key(src, sport, dst, dport, proto));
+
+	if ( it == flows.end() )
+		return false;
+
+	if ( it->second && it->second <= run_state::network_time )
+		{
+		flows.erase(it);
+		return false;
+		}
+
+	++packets_shunted;
+	return true;
+	}
+
+} // namespace zeek::detail
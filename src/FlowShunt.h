@@ -0,0 +1,96 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Drops the packets of flows that scripts don't want to see anymore,
+// before any per-packet state gets built for them.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+#include "zeek/IPAddr.h"
+#include "zeek/net_util.h"
+
+namespace zeek::detail {
+
+/**
+ * A table of shunted TCP and UDP flows, matched against the raw IP headers
+ * of incoming packets.  Flows match in both directions.
+ */
+class FlowShunt {
+public:
+	/**
+	 * Shunts a flow.
+	 *
+	 * @param expire  The network time at which the shunt ends, or 0 to
+	 * keep it until it's removed.
+	 *
+	 * @return  False if the protocol isn't TCP or UDP.
+	 */
+	bool Add(const IPAddr& orig_h, uint32_t orig_p, const IPAddr& resp_h, uint32_t resp_p,
+	         TransportProto proto, double expire);
+
+	/**
+	 * Removes a flow's shunt.
+	 *
+	 * @return  False if the flow wasn't shunted.
+	 */
+	bool Remove(const IPAddr& orig_h, uint32_t orig_p, const IPAddr& resp_h, uint32_t resp_p,
+	            TransportProto proto);
+
+	/**
+	 * Returns whether a packet belongs to a shunted flow.  Fragments,
+	 * and IPv6 packets with extension headers, never match.
+	 *
+	 * @param data  The packet's IP header.
+	 *
+	 * @param len  The number of bytes available at data.
+	 */
+	bool Match(const u_char* data, size_t len);
+
+	/**
+	 * Returns the number of shunted flows.
+	 */
+	size_t Size() const	{ return flows.size(); }
+
+	/**
+	 * Returns the number of packets dropped so far.
+	 */
+	uint64_t PacketsShunted() const	{ return packets_shunted; }
+
+private:
+	// The 5-tuple, with the lower of both endpoints first so that either
+	// direction maps to the same key.  Addresses are in IPv6 form, with
+	// IPv4 ones mapped.
+	struct Key {
+		u_char addr1[16];
+		u_char addr2[16];
+		uint16_t port1;
+		uint16_t port2;
+		uint8_t proto;
+		uint8_t pad[3];
+
+		Key(const u_char* a1, uint16_t p1, const u_char* a2, uint16_t p2, uint8_t proto);
+
+		bool operator==(const Key& other) const
+			{ return memcmp(this, &other, sizeof(Key)) == 0; }
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key& k) const;
+	};
+
+	static Key MakeKey(const IPAddr& orig_h, uint32_t orig_p, const IPAddr& resp_h,
+	                   uint32_t resp_p, uint8_t proto);
+
+	void Expire();
+
+	// Maps to the network time the shunt ends, or 0.
+	std::unordered_map<Key, double, KeyHash> flows;
+	size_t expire_at_size = 1024;
+	uint64_t packets_shunted = 0;
+};
+
+} // namespace zeek::detail
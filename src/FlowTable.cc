@@ -0,0 +1,113 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/FlowTable.h"
+
+#include <netinet/in.h>
+#include <limits>
+
+#include "zeek/Conn.h"
+#include "zeek/Event.h"
+#include "zeek/NetVar.h"
+#include "zeek/Val.h"
+
+namespace zeek::detail {
+
+void FlowTable::Update(double t, const ConnID& id, const ConnIDKey& key, TransportProto proto,
+                       uint32_t len, uint8_t tcp_flags)
+	{
+	FlowMap& flows = proto == TRANSPORT_TCP ? tcp_flows :
+		(proto == TRANSPORT_UDP ? udp_flows : icmp_flows);
+
+	auto [it, inserted] = flows.try_emplace(key);
+	Flow& f = it->second;
+
+	if ( inserted )
+		{
+		// The first packet's sender counts as the originator.
+		f.orig_h = id.src_addr;
+		f.orig_p = id.src_port;
+		f.resp_h = id.dst_addr;
+		f.resp_p = id.dst_port;
+		f.first = t;
+		f.pkts[0] = f.pkts[1] = 0;
+		f.bytes[0] = f.bytes[1] = 0;
+		f.flags[0] = f.flags[1] = 0;
+		}
+
+	int dir = (id.src_addr == f.orig_h && id.src_port == f.orig_p) ? 0 : 1;
+	f.last = t;
+	++f.pkts[dir];
+	f.bytes[dir] += len;
+	f.flags[dir] |= tcp_flags;
+
+	if ( t >= next_expire )
+		{
+		// Sweeping in steps of a tenth of the timeout reports flows at
+		// most that much later than they expire.
+		double timeout = BifConst::flow_accounting_timeout;
+
+		if ( next_expire > 0.0 )
+			Expire(t - timeout);
+
+		next_expire = t + timeout / 10;
+		}
+	}
+
+void FlowTable::Expire(double idle_before)
+	{
+	for ( auto [flows, proto] : { std::make_pair(&tcp_flows, TRANSPORT_TCP),
+	                              std::make_pair(&udp_flows, TRANSPORT_UDP),
+	                              std::make_pair(&icmp_flows, TRANSPORT_ICMP) } )
+		{
+		for ( auto it = flows->begin(); it != flows->end(); )
+			{
+			if ( it->second.last < idle_before )
+				{
+				Report(it->second, proto);
+				it = flows->erase(it);
+				}
+			else
+				++it;
+			}
+		}
+	}
+
+void FlowTable::Flush()
+	{
+	Expire(std::numeric_limits<double>::infinity());
+	}
+
+size_t FlowTable::Size() const
+	{
+	return tcp_flows.size() + udp_flows.size() + icmp_flows.size();
+	}
+
+void FlowTable::Report(const Flow& f, TransportProto proto)
+	{
+	if ( ! flow_record )
+		return;
+
+	static auto flow_record_type = id::find_type<RecordType>("FlowRecord");
+
+	auto id_val = make_intrusive<RecordVal>(id::conn_id);
+	id_val->AssignAddr(0, f.orig_h);
+	id_val->Assign(1, val_mgr->Port(ntohs(f.orig_p), proto));
+	id_val->AssignAddr(2, f.resp_h);
+	id_val->Assign(3, val_mgr->Port(ntohs(f.resp_p), proto));
+
+	auto r = make_intrusive<RecordVal>(flow_record_type);
+	r->Assign(0, std::move(id_val));
+	r->AssignTime(1, f.first);
+	r->AssignInterval(2, f.last - f.first);
+	r->AssignCount(3, f.pkts[0]);
+	r->AssignCount(4, f.bytes[0]);
+	r->AssignCount(5, f.pkts[1]);
+	r->AssignCount(6, f.bytes[1]);
+	r->AssignCount(7, f.flags[0]);
+	r->AssignCount(8, f.flags[1]);
+
+	event_mgr.Enqueue(flow_record, std::move(r));
+	}
+
+} // namespace zeek::detail
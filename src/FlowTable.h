@@ -0,0 +1,88 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Per-flow packet and byte counters, kept instead of connections when only
+// flow summaries are wanted.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+#include <unordered_map>
+
+#include "zeek/IPAddr.h"
+#include "zeek/net_util.h"
+#include "zeek/ConnMap.h"
+
+namespace zeek::detail {
+
+/**
+ * A table of TCP, UDP and ICMP flows with their counters, which replaces
+ * connections and their analyzers when :zeek:see:`flow_accounting_only` is
+ * set.  Flows that stay idle for :zeek:see:`flow_accounting_timeout` get
+ * reported through :zeek:see:`flow_record` and removed.
+ */
+class FlowTable {
+public:
+	/**
+	 * Counts a packet.
+	 *
+	 * @param t  The packet's time.
+	 *
+	 * @param id  The packet's 5-tuple, as NetSessions builds it.
+	 *
+	 * @param key  The key of *id*.
+	 *
+	 * @param proto  The flow's transport protocol.
+	 *
+	 * @param len  The packet's length, including its IP header.
+	 *
+	 * @param tcp_flags  The TCP flags of the packet, if TCP.
+	 */
+	void Update(double t, const ConnID& id, const ConnIDKey& key, TransportProto proto,
+	            uint32_t len, uint8_t tcp_flags);
+
+	/**
+	 * Reports and removes the flows that have been idle since before the
+	 * given time.
+	 */
+	void Expire(double idle_before);
+
+	/**
+	 * Reports and removes all flows.
+	 */
+	void Flush();
+
+	/**
+	 * Returns the number of active flows.
+	 */
+	size_t Size() const;
+
+private:
+	struct Flow {
+		IPAddr orig_h;
+		IPAddr resp_h;
+		uint32_t orig_p;	// In network order.
+		uint32_t resp_p;	// In network order.
+		double first;
+		double last;
+		uint64_t pkts[2];	// Originator's, then responder's.
+		uint64_t bytes[2];
+		uint8_t flags[2];	// TCP flags seen, ORed.
+	};
+
+	struct KeyHash {
+		size_t operator()(const ConnIDKey& k) const
+			{ return FlatConnMap::HashKey(k); }
+	};
+
+	using FlowMap = std::unordered_map<ConnIDKey, Flow, KeyHash>;
+
+	static void Report(const Flow& f, TransportProto proto);
+
+	FlowMap tcp_flows;
+	FlowMap udp_flows;
+	FlowMap icmp_flows;
+	double next_expire = 0.0;
+};
+
+} // namespace zeek::detail
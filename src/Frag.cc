@@ -3,6 +3,9 @@
 #include "zeek-config.h"
 
 #include "zeek/Frag.h"
+
+#include <vector>
+
 #include "zeek/Hash.h"
 #include "zeek/IP.h"
 #include "zeek/NetVar.h"
@@ -15,18 +18,34 @@ constexpr uint32_t MAX_ACCEPTABLE_FRAG_SIZE = 64000;
 
 namespace zeek::detail {
 
+// Recycled FragReassembler instances, see operator new/delete below.
+static std::vector<void*> free_reassemblers;
+constexpr size_t MAX_FREE_REASSEMBLERS = 1024;
+
 FragTimer::~FragTimer()
 	{
-	if ( f )
-		f->ClearTimer();
+	if ( mgr )
+		mgr->ClearTimer();
 	}
 
-void FragTimer::Dispatch(double t, bool /* is_expire */)
+void FragTimer::Dispatch(double t, bool is_expire)
 	{
-	if ( f )
-		f->Expire(t);
+	if ( mgr )
+		{
+		// The timer manager deletes us once this returns, and the
+		// manager may schedule a new timer meanwhile.
+		FragmentManager* m = mgr;
+		mgr = nullptr;
+		m->ClearTimer();
+
+		if ( is_expire )
+			// We're terminating.
+			m->Clear();
+		else
+			m->Expire(t);
+		}
 	else
-		reporter->InternalWarning("fragment timer dispatched w/o reassembler");
+		reporter->InternalWarning("fragment timer dispatched w/o manager");
 	}
 
 FragReassembler::FragReassembler(NetSessions* arg_s,
@@ -36,19 +55,25 @@ FragReassembler::FragReassembler(NetSessions* arg_s,
 	{
 	s = arg_s;
 	key = k;
+	start_time = t;
 
 	const struct ip* ip4 = ip->IP4_Hdr();
 	if ( ip4 )
 		{
 		proto_hdr_len = ip->HdrLen();
-		proto_hdr = new u_char[64];	// max IP header + slop
+		proto_hdr = proto_hdr_buf;	// max IP header + slop
 		// Don't do a structure copy - need to pick up options, too.
 		memcpy((void*) proto_hdr, (const void*) ip4, proto_hdr_len);
 		}
 	else
 		{
 		proto_hdr_len = ip->HdrLen() - 8; // minus length of fragment header
-		proto_hdr = new u_char[proto_hdr_len];
+
+		if ( proto_hdr_len <= sizeof(proto_hdr_buf) )
+			proto_hdr = proto_hdr_buf;
+		else
+			proto_hdr = new u_char[proto_hdr_len];
+
 		memcpy(proto_hdr, ip->IP6_Hdr(), proto_hdr_len);
 		}
 
@@ -56,21 +81,37 @@ FragReassembler::FragReassembler(NetSessions* arg_s,
 	frag_size = 0;	// flag meaning "not known"
 	next_proto = ip->NextProto();
 
-	if ( frag_timeout != 0.0 )
+	AddFragment(t, ip, pkt);
+	}
+
+FragReassembler::~FragReassembler()
+	{
+	if ( proto_hdr != proto_hdr_buf )
+		delete [] proto_hdr;
+	}
+
+void* FragReassembler::operator new(size_t size)
+	{
+	if ( size == sizeof(FragReassembler) && ! free_reassemblers.empty() )
 		{
-		expire_timer = new FragTimer(this, t + frag_timeout);
-		timer_mgr->Add(expire_timer);
+		void* ptr = free_reassemblers.back();
+		free_reassemblers.pop_back();
+		return ptr;
 		}
-	else
-		expire_timer = nullptr;
 
-	AddFragment(t, ip, pkt);
+	return ::operator new(size);
 	}
 
-FragReassembler::~FragReassembler()
+void FragReassembler::operator delete(void* ptr, size_t size)
 	{
-	DeleteTimer();
-	delete [] proto_hdr;
+	if ( size == sizeof(FragReassembler) &&
+	     free_reassemblers.size() < MAX_FREE_REASSEMBLERS )
+		{
+		free_reassemblers.push_back(ptr);
+		return;
+		}
+
+	::operator delete(ptr);
 	}
 
 void FragReassembler::AddFragment(double t, const std::unique_ptr<IP_Hdr>& ip,
@@ -278,7 +319,6 @@ void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */)
 		if ( b.upper > n )
 			{
 			reporter->InternalWarning("bad fragment reassembly");
-			DeleteTimer();
 			Expire(run_state::network_time);
 			delete [] pkt_start;
 			return;
@@ -297,7 +337,6 @@ void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */)
 		reassem4->ip_len = htons(frag_size + proto_hdr_len);
 		reassembled_pkt = std::make_unique<IP_Hdr>(reassem4, true);
 		reassembled_pkt->reassembled = true;
-		DeleteTimer();
 		}
 
 	else if ( version == 6 )
@@ -307,7 +346,6 @@ void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */)
 		const IPv6_Hdr_Chain* chain = new IPv6_Hdr_Chain(reassem6, next_proto, n);
 		reassembled_pkt = std::make_unique<IP_Hdr>(reassem6, true, n, chain);
 		reassembled_pkt->reassembled = true;
-		DeleteTimer();
 		}
 
 	else
@@ -321,20 +359,24 @@ void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */)
 void FragReassembler::Expire(double t)
 	{
 	block_list.Clear();
-	expire_timer->ClearReassembler();
-	expire_timer = nullptr;	// timer manager will delete it
-
 	fragment_mgr->Remove(this);
 	}
 
-void FragReassembler::DeleteTimer()
+size_t FragmentManager::KeyHash::operator()(const FragReassemblerKey& k) const
 	{
-	if ( expire_timer )
-		{
-		expire_timer->ClearReassembler();
-		timer_mgr->Cancel(expire_timer);
-		expire_timer = nullptr;	// timer manager will delete it
-		}
+	// Keyed, so that one can't aim for collisions.
+	uint32_t words[9];
+	std::get<0>(k).CopyIPv6(&words[0]);
+	std::get<1>(k).CopyIPv6(&words[4]);
+	words[8] = std::get<2>(k);
+	return HashKey::HashBytes(words, sizeof(words));
+	}
+
+size_t FragmentManager::AddrHash::operator()(const IPAddr& a) const
+	{
+	uint32_t words[4];
+	a.CopyIPv6(words);
+	return HashKey::HashBytes(words, sizeof(words));
 	}
 
 FragmentManager::~FragmentManager()
@@ -348,30 +390,88 @@ FragReassembler* FragmentManager::NextFragment(double t, const std::unique_ptr<I
 	uint32_t frag_id = ip->ID();
 	FragReassemblerKey key = std::make_tuple(ip->SrcAddr(), ip->DstAddr(), frag_id);
 
-	FragReassembler* f = nullptr;
 	auto it = fragments.find(key);
-	if ( it != fragments.end() )
-		f = it->second;
 
-	if ( ! f )
+	if ( it != fragments.end() )
 		{
-		f = new FragReassembler(sessions, ip, pkt, key, t);
-		fragments[key] = f;
-		if ( fragments.size() > max_fragments )
-			max_fragments = fragments.size();
+		FragReassembler* f = it->second;
+		f->AddFragment(t, ip, pkt);
 		return f;
 		}
 
-	f->AddFragment(t, ip, pkt);
+	if ( BifConst::frag_max_reassemblers_per_source )
+		{
+		auto src = sources.find(ip->SrcAddr());
+
+		if ( src != sources.end() &&
+		     src->second >= BifConst::frag_max_reassemblers_per_source )
+			{
+			sessions->Weird("excessive_fragmented_datagrams_from_source", ip.get());
+			return nullptr;
+			}
+		}
+
+	if ( BifConst::frag_max_reassemblers &&
+	     fragments.size() >= BifConst::frag_max_reassemblers )
+		{
+		// Make room by giving up on the oldest datagram.
+		sessions->Weird("fragment_reassembly_table_full", ip.get());
+		Remove(oldest);
+		}
+
+	++sources[ip->SrcAddr()];
+
+	auto f = new FragReassembler(sessions, ip, pkt, key, t);
+	fragments[key] = f;
+
+	if ( fragments.size() > max_fragments )
+		max_fragments = fragments.size();
+
+	f->prev = newest;
+
+	if ( newest )
+		newest->next = f;
+	else
+		oldest = f;
+
+	newest = f;
+
+	ScheduleExpiration();
 	return f;
 	}
 
+void FragmentManager::ScheduleExpiration()
+	{
+	if ( frag_timeout == 0.0 || expire_timer || ! oldest )
+		return;
+
+	expire_timer = new FragTimer(this, oldest->start_time + frag_timeout);
+	timer_mgr->Add(expire_timer);
+	}
+
+void FragmentManager::Expire(double t)
+	{
+	while ( oldest && oldest->start_time + frag_timeout <= t )
+		oldest->Expire(t);
+
+	ScheduleExpiration();
+	}
+
 void FragmentManager::Clear()
 	{
+	if ( expire_timer )
+		{
+		expire_timer->ClearManager();
+		timer_mgr->Cancel(expire_timer);
+		expire_timer = nullptr;	// timer manager deleted it
+		}
+
 	for ( const auto& entry : fragments )
 		Unref(entry.second);
 
 	fragments.clear();
+	sources.clear();
+	oldest = newest = nullptr;
 	}
 
 void FragmentManager::Remove(detail::FragReassembler* f)
@@ -380,14 +480,34 @@ void FragmentManager::Remove(detail::FragReassembler* f)
 		return;
 
 	if ( fragments.erase(f->Key()) == 0 )
+		{
 		reporter->InternalWarning("fragment reassembler not in dict");
+		Unref(f);
+		return;
+		}
+
+	if ( f->prev )
+		f->prev->next = f->next;
+	else
+		oldest = f->next;
+
+	if ( f->next )
+		f->next->prev = f->prev;
+	else
+		newest = f->prev;
+
+	auto src = sources.find(std::get<0>(f->Key()));
+
+	if ( src != sources.end() && --src->second == 0 )
+		sources.erase(src);
 
 	Unref(f);
 	}
 
 uint32_t FragmentManager::MemoryAllocation() const
 	{
-	return fragments.size() * (sizeof(FragmentMap::key_type) + sizeof(FragmentMap::value_type));
+	return fragments.size() * (sizeof(FragmentMap::key_type) + sizeof(FragmentMap::value_type)) +
+	       sources.size() * sizeof(decltype(sources)::value_type);
 	}
 
 } // namespace zeek::detail
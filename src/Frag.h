@@ -4,6 +4,7 @@
 
 #include <sys/types.h> // for u_char
 #include <tuple>
+#include <unordered_map>
 
 #include "zeek/util.h" // for bro_uint_t
 #include "zeek/IPAddr.h"
@@ -14,6 +15,7 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(NetSessions, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(IP_Hdr, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(FragReassembler, zeek::detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(FragTimer, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(FragmentManager, zeek::detail);
 
 namespace zeek::detail {
 
@@ -25,21 +27,27 @@ public:
 	                const FragReassemblerKey& k, double t);
 	~FragReassembler() override;
 
+	// Instances get recycled through a free list, so that a flood of
+	// fragmented datagrams doesn't keep the allocator busy.
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr, size_t size);
+
 	void AddFragment(double t, const std::unique_ptr<IP_Hdr>& ip, const u_char* pkt);
 
 	void Expire(double t);
-	void DeleteTimer();
-	void ClearTimer()	{ expire_timer = nullptr; }
 
 	std::unique_ptr<IP_Hdr> ReassembledPkt()	{ return std::move(reassembled_pkt); }
 	const FragReassemblerKey& Key() const	{ return key; }
 
 protected:
+	friend class FragmentManager;
+
 	void BlockInserted(DataBlockMap::const_iterator it) override;
 	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override;
 	void Weird(const char* name) const;
 
 	u_char* proto_hdr;
+	u_char proto_hdr_buf[64];	// holds proto_hdr unless it's larger
 	std::unique_ptr<IP_Hdr> reassembled_pkt;
 	NetSessions* s;
 	uint64_t frag_size;	// size of fully reassembled fragment
@@ -47,45 +55,94 @@ protected:
 	uint16_t next_proto; // first IPv6 fragment header's next proto field
 	uint16_t proto_hdr_len;
 
-	FragTimer* expire_timer;
+	double start_time;
+
+	// The FragmentManager's list of reassemblers, oldest first.
+	FragReassembler* prev = nullptr;
+	FragReassembler* next = nullptr;
 };
 
 class FragTimer final : public Timer {
 public:
-	FragTimer(FragReassembler* arg_f, double arg_t)
+	FragTimer(FragmentManager* arg_mgr, double arg_t)
 		: Timer(arg_t, TIMER_FRAG)
-			{ f = arg_f; }
+			{ mgr = arg_mgr; }
 	~FragTimer() override;
 
 	void Dispatch(double t, bool is_expire) override;
 
 	// Break the association between this timer and its creator.
-	void ClearReassembler()	{ f = nullptr; }
+	void ClearManager()	{ mgr = nullptr; }
 
 protected:
-	FragReassembler* f;
+	FragmentManager* mgr;
 };
 
+/**
+ * Tracks the fragmented datagrams under reassembly.
+ *
+ * The number of datagrams in reassembly is bounded by the script-level
+ * frag_max_reassemblers; once full, the oldest one gets dropped to make
+ * room. frag_max_reassemblers_per_source additionally caps the datagrams
+ * any single source may have in reassembly, so that one host can't crowd
+ * out everybody else. Expiration after frag_timeout is driven by a single
+ * timer for the oldest datagram, since with a fixed timeout datagrams
+ * expire in the order they arrived.
+ */
 class FragmentManager {
 public:
 
 	FragmentManager() = default;
 	~FragmentManager();
 
+	/**
+	 * Adds a fragment to the reassembly of its datagram.
+	 *
+	 * @return The datagram's reassembler, or null if the fragment got
+	 * dropped because its source has reached its limit.
+	 */
 	FragReassembler* NextFragment(double t, const std::unique_ptr<IP_Hdr>& ip,
 	                              const u_char* pkt);
 	void Clear();
 	void Remove(detail::FragReassembler* f);
 
+	/**
+	 * Expires all datagrams that have been in reassembly for longer
+	 * than frag_timeout.
+	 */
+	void Expire(double t);
+
 	size_t Size() const	{ return fragments.size(); }
 	size_t MaxFragments() const 	{ return max_fragments; }
 	uint32_t MemoryAllocation() const;
 
 private:
+	friend class FragTimer;
+
+	struct KeyHash {
+		size_t operator()(const FragReassemblerKey& k) const;
+	};
 
-	using FragmentMap = std::map<detail::FragReassemblerKey, detail::FragReassembler*>;
+	struct AddrHash {
+		size_t operator()(const IPAddr& a) const;
+	};
+
+	void ScheduleExpiration();
+	void ClearTimer()	{ expire_timer = nullptr; }
+
+	using FragmentMap = std::unordered_map<detail::FragReassemblerKey,
+	                                       detail::FragReassembler*, KeyHash>;
 	FragmentMap fragments;
 	size_t max_fragments = 0;
+
+	// Number of datagrams in reassembly per source address.
+	std::unordered_map<IPAddr, uint32_t, AddrHash> sources;
+
+	// All reassemblers in order of creation, and hence expiration.
+	FragReassembler* oldest = nullptr;
+	FragReassembler* newest = nullptr;
+
+	FragTimer* expire_timer = nullptr;
 };
 
 extern FragmentManager* fragment_mgr;
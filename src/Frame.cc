@@ -15,10 +15,66 @@ std::vector<zeek::detail::Frame*> g_frame_stack;
 
 namespace zeek::detail {
 
+// Frames larger than this get their elements from the heap directly.
+static constexpr int MAX_POOLED_FRAME_SIZE = 64;
+
+// Number of unused element arrays kept per frame size.  Recursion deeper
+// than this allocates again.
+static constexpr size_t MAX_POOLED_PER_SIZE = 32;
+
+// Unused element arrays, indexed by their size.  All their values are null.
+using ElementPool = std::vector<std::vector<void*>>;
+
+static ElementPool& element_pool()
+	{
+	// Never destroyed, frames may still go away during shutdown.
+	static thread_local ElementPool* p = new ElementPool(MAX_POOLED_FRAME_SIZE + 1);
+	return *p;
+	}
+
+Frame::Element* Frame::AllocElements(int size)
+	{
+	if ( size == 0 )
+		return nullptr;
+
+	if ( size <= MAX_POOLED_FRAME_SIZE )
+		{
+		auto& free_list = element_pool()[size];
+
+		if ( ! free_list.empty() )
+			{
+			auto e = static_cast<Element*>(free_list.back());
+			free_list.pop_back();
+			return e;
+			}
+		}
+
+	return new Element[size]();
+	}
+
+void Frame::FreeElements(Element* elements, int size)
+	{
+	if ( ! elements )
+		return;
+
+	if ( size <= MAX_POOLED_FRAME_SIZE )
+		{
+		auto& free_list = element_pool()[size];
+
+		if ( free_list.size() < MAX_POOLED_PER_SIZE )
+			{
+			free_list.push_back(elements);
+			return;
+			}
+		}
+
+	delete [] elements;
+	}
+
 Frame::Frame(int arg_size, const ScriptFunc* func, const zeek::Args* fn_args)
 	{
 	size = arg_size;
-	frame = std::make_unique<Element[]>(size);
+	frame = AllocElements(size);
 	function = func;
 	func_args = fn_args;
 
@@ -51,6 +107,8 @@ Frame::~Frame()
 
 	for ( int i = 0; i < size; ++i )
 		ClearElement(i);
+
+	FreeElements(frame, size);
 	}
 
 void Frame::AddFunctionWithClosureRef(ScriptFunc* func)
@@ -188,6 +246,32 @@ Frame* Frame::Clone() const
 	return other;
 	}
 
+Frame* Frame::ShareClone() const
+	{
+	Frame* other = new Frame(size, function, func_args);
+
+	if ( offset_map )
+		other->offset_map = std::make_unique<OffsetMap>(*offset_map);
+
+	other->CaptureClosure(closure, outer_ids);
+
+	other->call = call;
+	other->trigger = trigger;
+
+	for ( int i = 0; i < size; i++ )
+		{
+		if ( ! frame[i].val )
+			continue;
+
+		if ( frame[i].weak_ref )
+			other->SetElementWeak(i, frame[i].val.get());
+		else
+			other->SetElement(i, frame[i].val);
+		}
+
+	return other;
+	}
+
 static bool val_is_func(const ValPtr& v, ScriptFunc* func)
 	{
 	if ( v->GetType()->Tag() != TYPE_FUNC )
@@ -533,7 +617,10 @@ void Frame::ClearTrigger()
 void Frame::ClearElement(int n)
 	{
 	if ( frame[n].weak_ref )
+		{
 		frame[n].val.release();
+		frame[n].weak_ref = false;
+		}
 	else
 		frame[n] = {nullptr, false};
 	}
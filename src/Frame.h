@@ -161,6 +161,16 @@ public:
 	 */
 	Frame* Clone() const;
 
+	/**
+	 * Copies the frame like Clone(), except that the copy refers to the
+	 * same values rather than to copies of them.  Assigning to an element
+	 * of one frame doesn't affect the other, but modifying an aggregate in
+	 * place does, so this is for when neither side does that.
+	 *
+	 * @return a copy of this frame sharing its values.
+	 */
+	Frame* ShareClone() const;
+
 	/**
 	 * Clones a Frame, only making copies of the values associated with
 	 * the IDs in selection. Cloning a frame does not deep-copy its
@@ -313,8 +323,13 @@ private:
 	bool break_on_return;
 	bool delayed;
 
+	// Element arrays are recycled through a per-thread pool, see
+	// AllocElements().
+	static Element* AllocElements(int size);
+	static void FreeElements(Element* elements, int size);
+
 	/** Associates ID's offsets with values. */
-	std::unique_ptr<Element[]> frame;
+	Element* frame;
 
 	/** The enclosing frame of this frame. */
 	Frame* closure;
@@ -30,6 +30,7 @@
 #include <signal.h>
 
 #include <algorithm>
+#include <optional>
 
 #include <broker/error.hh>
 
@@ -51,6 +52,8 @@
 #include "zeek/Traverse.h"
 #include "zeek/Reporter.h"
 #include "zeek/plugin/Manager.h"
+#include "zeek/ScriptProfile.h"
+#include "zeek/CompiledBody.h"
 #include "zeek/module_util.h"
 #include "zeek/iosource/PktSrc.h"
 #include "zeek/iosource/PktDumper.h"
@@ -60,6 +63,7 @@
 #include "reporter.bif.func_h"
 #include "strings.bif.func_h"
 #include "option.bif.func_h"
+#include "sumstats.bif.func_h"
 #include "supervisor.bif.func_h"
 #include "packet_analysis.bif.func_h"
 
@@ -68,6 +72,7 @@
 #include "reporter.bif.func_def"
 #include "strings.bif.func_def"
 #include "option.bif.func_def"
+#include "sumstats.bif.func_def"
 #include "supervisor.bif.func_def"
 #include "packet_analysis.bif.func_def"
 
@@ -297,6 +302,42 @@ Val* Func::Call(ValPList* args, detail::Frame* parent) const
 
 namespace detail {
 
+namespace {
+
+// Looks for constructs that may keep a reference to the frame of the
+// function they occur in.
+class FrameRetentionFinder : public TraversalCallback {
+public:
+	TraversalCode PreStmt(const Stmt* s) override
+		{
+		// Triggers get set up from the frame.
+		if ( s->Tag() == STMT_WHEN )
+			found = true;
+
+		return found ? TC_ABORTALL : TC_CONTINUE;
+		}
+
+	TraversalCode PreExpr(const Expr* e) override
+		{
+		// Lambdas capture the frame as their closure.
+		if ( e->Tag() == EXPR_LAMBDA )
+			found = true;
+
+		return found ? TC_ABORTALL : TC_CONTINUE;
+		}
+
+	bool found = false;
+};
+
+}
+
+static bool may_retain_frame(const Stmt* body)
+	{
+	FrameRetentionFinder finder;
+	body->Traverse(&finder);
+	return finder.found;
+	}
+
 ScriptFunc::ScriptFunc(const IDPtr& arg_id, StmtPtr arg_body,
                        const std::vector<IDPtr>& aggr_inits,
                        size_t arg_frame_size, int priority)
@@ -311,6 +352,7 @@ ScriptFunc::ScriptFunc(const IDPtr& arg_id, StmtPtr arg_body,
 		Body b;
 		b.stmts = AddInits(std::move(arg_body), aggr_inits);
 		b.priority = priority;
+		heap_frames = may_retain_frame(b.stmts.get());
 		bodies.push_back(b);
 		}
 	}
@@ -337,9 +379,9 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 	if ( sample_logger )
 		sample_logger->FunctionSeen(this);
 
-	auto [handled, hook_result] = PLUGIN_HOOK_WITH_RESULT(HOOK_CALL_FUNCTION,
-	                                                      HookCallFunction(this, parent, args),
-	                                                      empty_hook_result);
+	auto [handled, hook_result] =
+		(plugin_hooks || plugin_mgr->HavePluginForHook(plugin::HOOK_CALL_FUNCTION)) ?
+		plugin_mgr->HookCallFunction(this, parent, args) : empty_hook_result;
 
 	CheckPluginResult(handled, hook_result, Flavor());
 
@@ -353,7 +395,19 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 		return Flavor() == FUNC_FLAVOR_HOOK ? val_mgr->True() : nullptr;
 		}
 
-	auto f = make_intrusive<Frame>(frame_size, this, args);
+	// Unless the function can hand out references to its frame, the frame
+	// doesn't outlive the call and can live on the stack.
+	std::optional<Frame> stack_frame;
+	FramePtr heap_frame;
+	Frame* f;
+
+	if ( heap_frames || closure )
+		{
+		heap_frame = make_intrusive<Frame>(frame_size, this, args);
+		f = heap_frame.get();
+		}
+	else
+		f = &stack_frame.emplace(frame_size, this, args);
 
 	if ( closure )
 		f->CaptureClosure(closure, outer_ids);
@@ -365,7 +419,7 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 		f->SetCall(parent->GetCall());
 		}
 
-	g_frame_stack.push_back(f.get());	// used for backtracing
+	g_frame_stack.push_back(f);	// used for backtracing
 	const CallExpr* call_expr = parent ? parent->GetCall() : nullptr;
 	call_stack.emplace_back(CallInfo{call_expr, this, *args});
 
@@ -387,6 +441,8 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 			sample_logger->LocationSeen(
 				body.stmts->GetLocationInfo());
 
+		ScriptProfileScope profile_scope(this, body.stmts.get());
+
 		// Fill in the rest of the frame with the function's arguments.
 		for ( auto j = 0u; j < args->size(); ++j )
 			{
@@ -401,7 +457,10 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 
 		try
 			{
-			result = body.stmts->Exec(f.get(), flow);
+			if ( auto cb = GetCompiledBody(body, f) )
+				result = cb->Exec(f, *args, flow);
+			else
+				result = body.stmts->Exec(f, flow);
 			}
 
 		catch ( InterpreterException& e )
@@ -472,6 +531,45 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 	return result;
 	}
 
+const CompiledBody* ScriptFunc::GetCompiledBody(const Body& body, const Frame* f) const
+	{
+	if ( body.compiled )
+		{
+		// Statement-level tooling and trigger conditions need the
+		// interpreter.
+		if ( g_policy_debug || g_trace_state.DoTrace() || script_profile_mgr ||
+		     f->GetTrigger() )
+			return nullptr;
+
+		return body.compiled.get();
+		}
+
+	if ( body.compile_failed || BifConst::script_compile_threshold == 0 ||
+	     ++body.num_calls < BifConst::script_compile_threshold )
+		return nullptr;
+
+	// Closures live in the frame, which compiled bodies don't keep up
+	// to date.  Coverage tracking happens per statement.
+	if ( closure || ! outer_ids.empty() || util::zeekenv("ZEEK_PROFILER_FILE") )
+		{
+		body.compile_failed = true;
+		return nullptr;
+		}
+
+	body.compiled = CompiledBody::Compile(body.stmts.get(), GetType().get(), frame_size);
+
+	if ( ! body.compiled )
+		{
+		body.compile_failed = true;
+		return nullptr;
+		}
+
+	DBG_LOG(DBG_SCRIPTS, "compiled body of %s into %zu instructions", Name(),
+	        body.compiled->NumInstructions());
+
+	return GetCompiledBody(body, f);
+	}
+
 void ScriptFunc::AddBody(StmtPtr new_body,
                          const std::vector<IDPtr>& new_inits,
                          size_t new_frame_size, int priority)
@@ -497,6 +595,9 @@ void ScriptFunc::AddBody(StmtPtr new_body,
 	b.stmts = new_body;
 	b.priority = priority;
 
+	if ( may_retain_frame(b.stmts.get()) )
+		heap_frames = true;
+
 	bodies.push_back(b);
 	sort(bodies.begin(), bodies.end());
 	}
@@ -572,6 +673,7 @@ FuncPtr ScriptFunc::DoClone()
 	CopyStateInto(other.get());
 
 	other->frame_size = frame_size;
+	other->heap_frames = heap_frames;
 	other->closure = closure ? closure->SelectiveClone(outer_ids, this) : nullptr;
 	other->weak_closure_ref = false;
 	other->outer_ids = outer_ids;
@@ -648,9 +750,9 @@ ValPtr BuiltinFunc::Invoke(Args* args, Frame* parent) const
 	if ( sample_logger )
 		sample_logger->FunctionSeen(this);
 
-	auto [handled, hook_result] = PLUGIN_HOOK_WITH_RESULT(HOOK_CALL_FUNCTION,
-	                                                      HookCallFunction(this, parent, args),
-	                                                      empty_hook_result);
+	auto [handled, hook_result] =
+		(plugin_hooks || plugin_mgr->HavePluginForHook(plugin::HOOK_CALL_FUNCTION)) ?
+		plugin_mgr->HookCallFunction(this, parent, args) : empty_hook_result;
 
 	CheckPluginResult(handled, hook_result, FUNC_FLAVOR_FUNCTION);
 
@@ -667,6 +769,7 @@ ValPtr BuiltinFunc::Invoke(Args* args, Frame* parent) const
 
 	const CallExpr* call_expr = parent ? parent->GetCall() : nullptr;
 	call_stack.emplace_back(CallInfo{call_expr, this, *args});
+	ScriptProfileScope profile_scope(this, nullptr);
 	auto result = std::move(func(parent, args).rval);
 	call_stack.pop_back();
 
@@ -681,6 +784,14 @@ ValPtr BuiltinFunc::Invoke(Args* args, Frame* parent) const
 	return result;
 	}
 
+bool BuiltinFunc::CanCallDirect() const
+	{
+	return direct && ! plugin_hooks &&
+	       ! plugin_mgr->HavePluginForHook(plugin::HOOK_CALL_FUNCTION) &&
+	       ! g_policy_debug && ! g_trace_state.DoTrace() && ! script_profile_mgr &&
+	       ! sample_logger && ! segment_logger;
+	}
+
 void BuiltinFunc::Describe(ODesc* d) const
 	{
 	d->Add(Name());
@@ -913,6 +1024,7 @@ void init_primary_bifs()
 	NetStats = id::find_type<RecordType>("NetStats");
 	MatcherStats = id::find_type<RecordType>("MatcherStats");
 	ConnStats = id::find_type<RecordType>("ConnStats");
+	ConnMemoryUsage = id::find_type<RecordType>("ConnMemoryUsage");
 	ReassemblerStats = id::find_type<RecordType>("ReassemblerStats");
 	DNSStats = id::find_type<RecordType>("DNSStats");
 	GapStats = id::find_type<RecordType>("GapStats");
@@ -920,8 +1032,13 @@ void init_primary_bifs()
 	TimerStats = id::find_type<RecordType>("TimerStats");
 	FileAnalysisStats = id::find_type<RecordType>("FileAnalysisStats");
 	ThreadStats = id::find_type<RecordType>("ThreadStats");
+	IOSourceStats = id::find_type<RecordType>("IOSourceStats");
+	IOSourceServiceStats = id::find_type<RecordType>("IOSourceServiceStats");
 	BrokerStats = id::find_type<RecordType>("BrokerStats");
 	ReporterStats = id::find_type<RecordType>("ReporterStats");
+	EventHandlerStats = id::find_type<RecordType>("EventHandlerStats");
+	EventTelemetry = id::find_type<RecordType>("EventTelemetry");
+	PipelineStageStats = id::find_type<RecordType>("PipelineStageStats");
 
 	var_sizes = id::find_type("var_sizes")->AsTableType();
 
@@ -930,9 +1047,23 @@ void init_primary_bifs()
 #include "reporter.bif.func_init"
 #include "strings.bif.func_init"
 #include "option.bif.func_init"
+#include "sumstats.bif.func_init"
 #include "supervisor.bif.func_init"
 #include "packet_analysis.bif.func_init"
 
+	// Direct entry points of frequently called BIFs.
+	auto set_direct = [](const char* name, BuiltinFunc::direct_func f)
+		{
+		const auto& bif = id::find_func(name);
+		assert(bif && bif->GetKind() == Func::BUILTIN_FUNC);
+		static_cast<BuiltinFunc*>(bif.get())->SetDirect(f);
+		};
+
+	set_direct("network_time", direct_bif<::network_time_direct>);
+	set_direct("to_lower", direct_bif<::to_lower_direct>);
+	set_direct("to_upper", direct_bif<::to_upper_direct>);
+	set_direct("split_string", direct_bif<::split_string_direct>);
+
 	init_builtin_types();
 	did_builtin_init = true;
 	}
@@ -24,6 +24,8 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(CallExpr, zeek::detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(ID, zeek::detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(FuncType, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Frame, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(CompiledBody, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(ScriptOptimizer, zeek::detail);
 
 namespace caf {
 template <class> class expected;
@@ -66,6 +68,13 @@ public:
 	struct Body {
 		detail::StmtPtr stmts;
 		int priority;
+
+		// Set once the body has been compiled, see
+		// script_compile_threshold.
+		mutable std::shared_ptr<detail::CompiledBody> compiled;
+		mutable uint64_t num_calls = 0;
+		mutable bool compile_failed = false;
+
 		bool operator<(const Body& other) const
 			{ return priority > other.priority; } // reverse sort
 	};
@@ -124,11 +133,18 @@ public:
 
 	virtual detail::TraversalCode Traverse(detail::TraversalCallback* cb) const;
 
+	// Whether a plugin hooks the calls of this function in particular,
+	// see Plugin::EnableFunctionHook().
+	void SetPluginHooks(bool arg_plugin_hooks)	{ plugin_hooks = arg_plugin_hooks; }
+	bool HasPluginHooks() const	{ return plugin_hooks; }
+
 	uint32_t GetUniqueFuncID() const { return unique_id; }
 	static const FuncPtr& GetFuncPtrByID(uint32_t id)
 		{ return id >= unique_ids.size() ? Func::nil : unique_ids[id]; }
 
 protected:
+	friend class detail::ScriptOptimizer;
+
 	Func();
 
 	// Copies this function's state into other.
@@ -144,6 +160,7 @@ protected:
 	uint32_t unique_id;
 	FuncTypePtr type;
 	std::string name;
+	bool plugin_hooks = false;
 	static inline std::vector<FuncPtr> unique_ids;
 };
 
@@ -219,8 +236,16 @@ protected:
 	void SetClosureFrame(Frame* f);
 
 private:
+	// Returns the compiled version of the given body if it's to be used
+	// for running it in the given frame, compiling it when it's due.
+	const CompiledBody* GetCompiledBody(const Body& body, const Frame* f) const;
+
 	size_t frame_size;
 
+	// True if a body may keep references to the frame of a call, which
+	// then can't live on the stack.
+	bool heap_frames = false;
+
 	// List of the outer IDs used in the function.
 	IDPList outer_ids;
 	// The frame the ScriptFunc was initialized in.
@@ -239,15 +264,61 @@ public:
 	ValPtr Invoke(zeek::Args* args, Frame* parent) const override;
 	built_in_func TheFunc() const	{ return func; }
 
+	/**
+	 * A typed entry point of a BIF, which calls can use instead of
+	 * Invoke() when their arguments have exactly the types the BIF
+	 * declares.  The arguments are borrowed.  Such an entry point must
+	 * not report errors, as its calls don't show up on the call stack.
+	 * See direct_bif() for wrapping a function with typed parameters.
+	 */
+	using direct_func = ValPtr (*)(Val* const* args);
+
+	// The most arguments a direct entry point can take.
+	static constexpr int MAX_DIRECT_ARGS = 4;
+
+	void SetDirect(direct_func f)	{ direct = f; }
+	direct_func Direct() const	{ return direct; }
+
+	/**
+	 * Returns true if a call may go to the direct entry point, i.e.,
+	 * there is one and nothing observes the calls: no plugin hooks,
+	 * tracing, debugging or profiling.
+	 */
+	bool CanCallDirect() const;
+
 	void Describe(ODesc* d) const override;
 
 protected:
 	BuiltinFunc()	{ func = nullptr; is_pure = 0; }
 
 	built_in_func func;
+	direct_func direct = nullptr;
 	bool is_pure;
 };
 
+template <typename F> struct direct_bif_traits;
+
+template <typename R, typename... A>
+struct direct_bif_traits<R (*)(A*...)> {
+	static constexpr size_t arity = sizeof...(A);
+
+	template <auto F, size_t... I>
+	static ValPtr Call(Val* const* args, std::index_sequence<I...>)
+		{ return F(static_cast<A*>(args[I])...); }
+};
+
+/**
+ * Turns a function like ``StringValPtr f(StringVal* s, PatternVal* p)``,
+ * whose parameters match a BIF's, into the BIF's direct entry point.
+ */
+template <auto F>
+ValPtr direct_bif(Val* const* args)
+	{
+	using traits = direct_bif_traits<decltype(F)>;
+	static_assert(traits::arity <= BuiltinFunc::MAX_DIRECT_ARGS);
+	return traits::template Call<F>(args, std::make_index_sequence<traits::arity>{});
+	}
+
 extern bool check_built_in_call(BuiltinFunc* f, CallExpr* call);
 
 struct CallInfo {
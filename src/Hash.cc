@@ -11,6 +11,7 @@
 #include "zeek/Reporter.h"
 #include "zeek/ZeekString.h"
 #include "zeek/Val.h" // needed for const.bif
+#include "zeek/3rdparty/doctest.h"
 
 #include "const.bif.netvar_h"
 
@@ -42,6 +43,11 @@ void KeyedHash::InitializeSeeds(const std::array<uint32_t, SEED_INIT_SIZE>& seed
 	calculate_digest(Hash_SHA256, (const u_char*) seed_data.data(), sizeof(seed_data) - 16, reinterpret_cast<unsigned char*>(shared_highwayhash_key));
 	memcpy(shared_siphash_key, reinterpret_cast<const char*>(seed_data.data()) + 64, 16);
 
+	// Derived from the SipHash key, so that they can't reveal it.  Odd
+	// keys keep the multiplications from losing bits.
+	for ( uint64_t i = 0; i < 3; ++i )
+		shared_fast_key[i] = (shared_fast_key[i] ^ Hash64(&i, sizeof(i))) | 1;
+
 	seeds_initialized = true;
 	}
 
@@ -219,3 +225,27 @@ hash_t HashKey::HashBytes(const void* bytes, int size)
 	}
 
 } // namespace zeek::detail
+
+TEST_CASE("fast keyed hash")
+	{
+	using zeek::detail::KeyedHash;
+	uint8_t buf[64];
+
+	for ( size_t i = 0; i < sizeof(buf); ++i )
+		buf[i] = static_cast<uint8_t>(i * 7);
+
+	for ( size_t n = 1; n <= sizeof(buf); ++n )
+		{
+		auto h = KeyedHash::FastHash64(buf, n);
+		CHECK(h == KeyedHash::FastHash64(buf, n));
+		CHECK(h != KeyedHash::FastHash64(buf, n - 1));
+
+		// Each byte matters.
+		for ( size_t i = 0; i < n; ++i )
+			{
+			buf[i] ^= 0x01;
+			CHECK(h != KeyedHash::FastHash64(buf, n));
+			buf[i] ^= 0x01;
+			}
+		}
+	}
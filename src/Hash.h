@@ -20,6 +20,7 @@
 #pragma once
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "zeek/util.h" // for bro_int_t
 
@@ -43,6 +44,20 @@ typedef uint64_t hash64_t;
 typedef uint64_t hash128_t[2];
 typedef uint64_t hash256_t[4];
 
+/**
+ * How strong a hash the keys of a table need.  Each table type declares the
+ * tier it uses, and all its keys must get hashed with that tier.
+ */
+typedef enum {
+	// SipHash, for tables whose keys attackers can make up at will, such
+	// as strings.
+	HASH_TIER_STRONG,
+	// A keyed multiply-mix hash in the style of wyhash, for short
+	// fixed-size keys such as addresses and ports.  Its per-process keys
+	// keep collisions from being precomputed, at a fraction of the cost.
+	HASH_TIER_FAST,
+} HashTier;
+
 class KeyedHash {
 public:
 	/**
@@ -63,6 +78,77 @@ public:
 	 */
 	static hash64_t Hash64(const void* bytes, uint64_t size);
 
+	/**
+	 * Generate a 64 bit digest hash of the given tier, seeded like
+	 * Hash64().
+	 *
+	 * @param bytes Bytes to hash
+	 *
+	 * @param size Size of bytes
+	 *
+	 * @param tier The tier of the hash
+	 *
+	 * @returns 64 bit digest hash
+	 */
+	static hash64_t Hash64(const void* bytes, uint64_t size, HashTier tier)
+		{ return tier == HASH_TIER_FAST ? FastHash64(bytes, size) : Hash64(bytes, size); }
+
+	/**
+	 * Generate the 64 bit digest hash of HASH_TIER_FAST, seeded like
+	 * Hash64().  It's inline so that the branches on the size fold away
+	 * for keys of fixed size.
+	 *
+	 * @param bytes Bytes to hash
+	 *
+	 * @param size Size of bytes
+	 *
+	 * @returns 64 bit digest hash
+	 */
+	static hash64_t FastHash64(const void* bytes, uint64_t size)
+		{
+		auto p = static_cast<const uint8_t*>(bytes);
+		const uint64_t* k = shared_fast_key;
+		uint64_t seed = Mix(k[0] ^ k[1], k[2]);
+		uint64_t a, b;
+
+		if ( size <= 16 )
+			{
+			if ( size >= 4 )
+				{
+				uint64_t off = (size >> 3) << 2;
+				a = (Read32(p) << 32) | Read32(p + off);
+				b = (Read32(p + size - 4) << 32) | Read32(p + size - 4 - off);
+				}
+			else if ( size > 0 )
+				{
+				a = (uint64_t(p[0]) << 16) | (uint64_t(p[size >> 1]) << 8) | p[size - 1];
+				b = 0;
+				}
+			else
+				a = b = 0;
+			}
+		else
+			{
+			uint64_t i = size;
+
+			while ( i > 16 )
+				{
+				seed = Mix(Read64(p) ^ k[1], Read64(p + 8) ^ seed);
+				p += 16;
+				i -= 16;
+				}
+
+			// The last 16 bytes, overlapping with the previous
+			// ones if needed.
+			a = Read64(p + i - 16);
+			b = Read64(p + i - 8);
+			}
+
+		__uint128_t r = static_cast<__uint128_t>(a ^ k[1]) * (b ^ seed);
+		return Mix(static_cast<uint64_t>(r) ^ k[0] ^ size,
+		           static_cast<uint64_t>(r >> 64) ^ k[1]);
+		}
+
 	/**
 	 * Generate a 128 bit digest hash.
 	 *
@@ -197,8 +283,34 @@ private:
 	alignas(16) static unsigned long long shared_siphash_key[2];
 	// This key changes each start (unless a seed is specified)
 	inline static uint8_t shared_hmac_md5_key[16];
+	// The keys of FastHash64(), which start out as wyhash's constants. They
+	// change each start (unless a seed is specified)
+	inline static uint64_t shared_fast_key[3] = {
+		0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL
+	};
 	inline static bool seeds_initialized = false;
 
+	// Helpers of FastHash64().
+	static uint64_t Mix(uint64_t a, uint64_t b)
+		{
+		__uint128_t r = static_cast<__uint128_t>(a) * b;
+		return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+		}
+
+	static uint64_t Read64(const uint8_t* p)
+		{
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+		}
+
+	static uint64_t Read32(const uint8_t* p)
+		{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+		}
+
 	friend void util::detail::hmac_md5(size_t size, const unsigned char* bytes, unsigned char digest[16]);
 	friend BifReturnVal BifFunc::md5_hmac_bif(zeek::detail::Frame* frame, const Args*);
 };
@@ -0,0 +1,201 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/HugePages.h"
+
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include "zeek/NetVar.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+HugePages::Stats HugePages::stats;
+
+namespace {
+
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+struct Region {
+	size_t len;
+	bool hugetlb;
+};
+
+std::unordered_map<void*, Region>& regions()
+	{
+	static std::unordered_map<void*, Region> r;
+	return r;
+	}
+
+// Set once MAP_HUGETLB failed, which it keeps doing when no huge pages
+// are reserved.
+bool hugetlb_unavailable = false;
+
+void* map_hugetlb(size_t len)
+	{
+#ifdef MAP_HUGETLB
+	if ( hugetlb_unavailable )
+		return nullptr;
+
+	void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+	               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+	if ( p != MAP_FAILED )
+		return p;
+
+	hugetlb_unavailable = true;
+#endif
+	return nullptr;
+	}
+
+// Maps a region aligned to a huge page, so that the kernel can back all
+// of it with transparent huge pages.
+void* map_thp(size_t len)
+	{
+	size_t map_len = len + HUGE_PAGE_SIZE;
+	void* m = mmap(nullptr, map_len, PROT_READ | PROT_WRITE,
+	               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if ( m == MAP_FAILED )
+		return nullptr;
+
+	auto start = reinterpret_cast<uintptr_t>(m);
+	auto aligned = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+	if ( aligned > start )
+		munmap(m, aligned - start);
+
+	if ( size_t tail = start + map_len - (aligned + len) )
+		munmap(reinterpret_cast<void*>(aligned + len), tail);
+
+	void* p = reinterpret_cast<void*>(aligned);
+
+#ifdef MADV_HUGEPAGE
+	madvise(p, len, MADV_HUGEPAGE);
+#endif
+
+	return p;
+	}
+
+} // namespace
+
+void* HugePages::Allocate(size_t bytes)
+	{
+	if ( ! BifConst::huge_page_threshold || bytes < BifConst::huge_page_threshold )
+		return malloc(bytes);
+
+	size_t len = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+	bool hugetlb = true;
+	void* p = map_hugetlb(len);
+
+	if ( ! p )
+		{
+		hugetlb = false;
+		p = map_thp(len);
+		}
+
+	if ( ! p )
+		return malloc(bytes);
+
+	regions()[p] = {len, hugetlb};
+	++stats.regions;
+
+	if ( hugetlb )
+		stats.hugetlb_bytes += len;
+	else
+		stats.thp_bytes += len;
+
+	return p;
+	}
+
+void* HugePages::Reallocate(void* p, size_t old_bytes, size_t new_bytes)
+	{
+	if ( ! p )
+		return Allocate(new_bytes);
+
+	auto& r = regions();
+	auto it = r.find(p);
+
+	if ( it == r.end() )
+		{
+		if ( ! BifConst::huge_page_threshold || new_bytes < BifConst::huge_page_threshold )
+			return realloc(p, new_bytes);
+		}
+
+	else if ( new_bytes <= it->second.len )
+		return p;
+
+	void* q = Allocate(new_bytes);
+
+	if ( ! q )
+		return nullptr;
+
+	memcpy(q, p, std::min(old_bytes, new_bytes));
+	Free(p, old_bytes);
+	return q;
+	}
+
+void HugePages::Free(void* p, size_t bytes)
+	{
+	if ( ! p )
+		return;
+
+	auto& r = regions();
+	auto it = r.empty() ? r.end() : r.find(p);
+
+	if ( it == r.end() )
+		{
+		free(p);
+		return;
+		}
+
+	munmap(p, it->second.len);
+	--stats.regions;
+
+	if ( it->second.hugetlb )
+		stats.hugetlb_bytes -= it->second.len;
+	else
+		stats.thp_bytes -= it->second.len;
+
+	r.erase(it);
+	}
+
+} // namespace zeek::detail
+
+TEST_CASE("huge pages")
+	{
+	using zeek::detail::HugePages;
+	auto saved = zeek::BifConst::huge_page_threshold;
+	zeek::BifConst::huge_page_threshold = 1024 * 1024;
+
+	void* small = HugePages::Allocate(1000);
+	REQUIRE(small);
+	CHECK(HugePages::GetStats().regions == 0);
+
+	auto* big = static_cast<char*>(HugePages::Allocate(1024 * 1024));
+	REQUIRE(big);
+	CHECK(HugePages::GetStats().regions == 1);
+	big[0] = 1;
+	big[1024 * 1024 - 1] = 2;
+
+	// Growing to the threshold moves the data into a region.
+	small = HugePages::Reallocate(small, 1000, 2 * 1024 * 1024);
+	REQUIRE(small);
+	CHECK(HugePages::GetStats().regions == 2);
+
+	// Growing within the region's pages keeps it in place.
+	CHECK(HugePages::Reallocate(big, 1024 * 1024, 2 * 1024 * 1024) == big);
+	CHECK(big[0] == 1);
+
+	HugePages::Free(big, 2 * 1024 * 1024);
+	HugePages::Free(small, 2 * 1024 * 1024);
+	CHECK(HugePages::GetStats().regions == 0);
+	CHECK(HugePages::GetStats().hugetlb_bytes + HugePages::GetStats().thp_bytes == 0);
+
+	zeek::BifConst::huge_page_threshold = saved;
+	}
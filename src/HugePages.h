@@ -0,0 +1,62 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Allocation of large, long-lived arrays from 2MB pages, which keeps the
+// TLB misses of random accesses to them down.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zeek::detail {
+
+/**
+ * Allocates arrays of at least :zeek:see:`huge_page_threshold` bytes
+ * from their own mappings, backed by huge pages.  A mapping first tries
+ * MAP_HUGETLB, which needs pages reserved by the administrator, and
+ * otherwise asks for transparent huge pages through madvise().  Smaller
+ * arrays, and all of them while the threshold is zero, come from malloc().
+ *
+ * Memory from Allocate() or Reallocate() must go back through Free(),
+ * even if it came from malloc().
+ */
+class HugePages {
+public:
+	/**
+	 * Returns uninitialized memory, or nullptr if none is left.
+	 */
+	static void* Allocate(size_t bytes);
+
+	/**
+	 * Grows or shrinks an allocation, like realloc().
+	 *
+	 * @param p  The allocation, or nullptr.
+	 *
+	 * @param old_bytes  The size it was allocated with.
+	 *
+	 * @param new_bytes  The size it is to have.
+	 */
+	static void* Reallocate(void* p, size_t old_bytes, size_t new_bytes);
+
+	/**
+	 * Releases an allocation.
+	 *
+	 * @param p  The allocation, or nullptr.
+	 *
+	 * @param bytes  The size it was allocated with.
+	 */
+	static void Free(void* p, size_t bytes);
+
+	struct Stats {
+		uint64_t regions = 0;	// Allocations in their own mappings.
+		uint64_t hugetlb_bytes = 0;	// Mapped with MAP_HUGETLB.
+		uint64_t thp_bytes = 0;	// Mapped with madvise(MADV_HUGEPAGE).
+	};
+
+	static const Stats& GetStats()	{ return stats; }
+
+private:
+	static Stats stats;
+};
+
+} // namespace zeek::detail
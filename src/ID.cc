@@ -34,6 +34,10 @@ TableTypePtr id::count_set;
 VectorTypePtr id::string_vec;
 VectorTypePtr id::index_vec;
 
+id::field::ConnID id::field::conn_id;
+id::field::Endpoint id::field::endpoint;
+id::field::Connection id::field::connection;
+
 const detail::IDPtr& id::find(std::string_view name)
 	{
 	return zeek::detail::global_scope()->Find(name);
@@ -90,6 +94,17 @@ FuncPtr id::find_func(std::string_view name)
 	return v->AsFuncPtr();
 	}
 
+static int find_field(const RecordTypePtr& rt, const char* field)
+	{
+	int offset = rt->FieldOffset(field);
+
+	if ( offset < 0 )
+		reporter->InternalError("Failed to find field %s of %s", field,
+		                        rt->GetName().c_str());
+
+	return offset;
+	}
+
 void id::detail::init_types()
 	{
 	conn_id = id::find_type<RecordType>("conn_id");
@@ -103,6 +118,33 @@ void id::detail::init_types()
 	count_set = id::find_type<TableType>("count_set");
 	string_vec = id::find_type<VectorType>("string_vec");
 	index_vec = id::find_type<VectorType>("index_vec");
+
+	auto& ci = field::conn_id;
+	ci.orig_h = find_field(conn_id, "orig_h");
+	ci.orig_p = find_field(conn_id, "orig_p");
+	ci.resp_h = find_field(conn_id, "resp_h");
+	ci.resp_p = find_field(conn_id, "resp_p");
+
+	auto& ep = field::endpoint;
+	ep.size = find_field(endpoint, "size");
+	ep.state = find_field(endpoint, "state");
+	ep.num_pkts = find_field(endpoint, "num_pkts");
+	ep.num_bytes_ip = find_field(endpoint, "num_bytes_ip");
+	ep.flow_label = find_field(endpoint, "flow_label");
+	ep.l2_addr = find_field(endpoint, "l2_addr");
+
+	auto& c = field::connection;
+	c.id = find_field(connection, "id");
+	c.orig = find_field(connection, "orig");
+	c.resp = find_field(connection, "resp");
+	c.start_time = find_field(connection, "start_time");
+	c.duration = find_field(connection, "duration");
+	c.service = find_field(connection, "service");
+	c.history = find_field(connection, "history");
+	c.uid = find_field(connection, "uid");
+	c.tunnel = find_field(connection, "tunnel");
+	c.vlan = find_field(connection, "vlan");
+	c.inner_vlan = find_field(connection, "inner_vlan");
 	}
 
 namespace detail {
@@ -270,6 +270,32 @@ extern TableTypePtr count_set;
 extern VectorTypePtr string_vec;
 extern VectorTypePtr index_vec;
 
+/**
+ * The offsets of the fields of the well-known record types above that the
+ * core accesses.  They get resolved once along with the types, so that
+ * per-connection code doesn't look fields up by name.
+ */
+namespace field {
+
+struct ConnID {
+	int orig_h, orig_p, resp_h, resp_p;
+};
+
+struct Endpoint {
+	int size, state, num_pkts, num_bytes_ip, flow_label, l2_addr;
+};
+
+struct Connection {
+	int id, orig, resp, start_time, duration, service, history, uid,
+	    tunnel, vlan, inner_vlan;
+};
+
+extern ConnID conn_id;
+extern Endpoint endpoint;
+extern Connection connection;
+
+} // namespace field
+
 namespace detail {
 
 void init_types();
@@ -475,15 +475,75 @@ static inline bool isIPv6ExtHeader(uint8_t type)
 	}
 	}
 
+// Recycled IP_Hdr instances and header chains, one pool per thread.  Never
+// freed, as headers may get deleted during static destruction.
+static std::vector<void*>& free_ip_hdrs()
+	{
+	static thread_local auto* hdrs = new std::vector<void*>();
+	return *hdrs;
+	}
+
+static std::vector<IPv6_Hdr_Chain*>& free_hdr_chains()
+	{
+	static thread_local auto* chains = new std::vector<IPv6_Hdr_Chain*>();
+	return *chains;
+	}
+
+constexpr size_t MAX_FREE_IP_HDRS = 256;
+
 IPv6_Hdr_Chain::~IPv6_Hdr_Chain()
 	{
-	for ( size_t i = 0; i < chain.size(); ++i ) delete chain[i];
 #ifdef ENABLE_MOBILE_IPV6
 	delete homeAddr;
 #endif
 	delete finalDst;
 	}
 
+IPv6_Hdr_Chain* IPv6_Hdr_Chain::Acquire(const struct ip6_hdr* ip6, int len)
+	{
+	auto& chains = free_hdr_chains();
+
+	if ( chains.empty() )
+		return new IPv6_Hdr_Chain(ip6, len);
+
+	IPv6_Hdr_Chain* c = chains.back();
+	chains.pop_back();
+	c->Init(ip6, len, false);
+	return c;
+	}
+
+void IPv6_Hdr_Chain::Release(const IPv6_Hdr_Chain* c)
+	{
+	if ( ! c )
+		return;
+
+	auto& chains = free_hdr_chains();
+
+	if ( chains.size() >= MAX_FREE_IP_HDRS )
+		{
+		delete c;
+		return;
+		}
+
+	auto nc = const_cast<IPv6_Hdr_Chain*>(c);
+	nc->Reset();
+	chains.push_back(nc);
+	}
+
+void IPv6_Hdr_Chain::Reset()
+	{
+	chain.clear();
+	length = 0;
+
+#ifdef ENABLE_MOBILE_IPV6
+	delete homeAddr;
+	homeAddr = nullptr;
+#endif
+
+	delete finalDst;
+	finalDst = nullptr;
+	}
+
 void IPv6_Hdr_Chain::Init(const struct ip6_hdr* ip6, int total_len,
                           bool set_next, uint16_t next)
 	{
@@ -506,21 +566,18 @@ void IPv6_Hdr_Chain::Init(const struct ip6_hdr* ip6, int total_len,
 			return;
 
 		current_type = next_type;
-		IPv6_Hdr* p = new IPv6_Hdr(current_type, hdrs);
+		IPv6_Hdr p(current_type, hdrs);
 
-		next_type = p->NextHdr();
-		uint16_t cur_len = p->Length();
+		next_type = p.NextHdr();
+		uint16_t cur_len = p.Length();
 
 		// If this header is truncated, don't add it to chain, don't go further.
 		if ( cur_len > total_len )
-			{
-			delete p;
 			return;
-			}
 
 		if ( set_next && next_type == IPPROTO_FRAGMENT )
 			{
-			p->ChangeNext(next);
+			p.ChangeNext(next);
 			next_type = next;
 			}
 
@@ -556,7 +613,7 @@ bool IPv6_Hdr_Chain::IsFragment() const
 		return false;
 		}
 
-	return chain[chain.size()-1]->Type() == IPPROTO_FRAGMENT;
+	return chain[chain.size()-1].Type() == IPPROTO_FRAGMENT;
 	}
 
 IPAddr IPv6_Hdr_Chain::SrcAddr() const
@@ -571,7 +628,7 @@ IPAddr IPv6_Hdr_Chain::SrcAddr() const
 		return IPAddr();
 		}
 
-	return IPAddr(((const struct ip6_hdr*)(chain[0]->Data()))->ip6_src);
+	return IPAddr(((const struct ip6_hdr*)(chain[0].Data()))->ip6_src);
 	}
 
 IPAddr IPv6_Hdr_Chain::DstAddr() const
@@ -585,7 +642,7 @@ IPAddr IPv6_Hdr_Chain::DstAddr() const
 		return IPAddr();
 		}
 
-	return IPAddr(((const struct ip6_hdr*)(chain[0]->Data()))->ip6_dst);
+	return IPAddr(((const struct ip6_hdr*)(chain[0].Data()))->ip6_dst);
 	}
 
 void IPv6_Hdr_Chain::ProcessRoutingHeader(const struct ip6_rthdr* r, uint16_t len)
@@ -692,9 +749,9 @@ VectorValPtr IPv6_Hdr_Chain::ToVal() const
 
 	for ( size_t i = 1; i < chain.size(); ++i )
 		{
-		auto v = chain[i]->ToVal();
+		auto v = chain[i].ToVal();
 		auto ext_hdr = make_intrusive<RecordVal>(ip6_ext_hdr_type);
-		uint8_t type = chain[i]->Type();
+		uint8_t type = chain[i].Type();
 		ext_hdr->Assign(0, val_mgr->Count(type));
 
 		switch (type) {
@@ -753,6 +810,33 @@ IP_Hdr* IP_Hdr::Copy() const
 	return new IP_Hdr(new_ip6, true, 0, new_ip6_hdrs);
 	}
 
+void* IP_Hdr::operator new(size_t size)
+	{
+	auto& hdrs = free_ip_hdrs();
+
+	if ( size == sizeof(IP_Hdr) && ! hdrs.empty() )
+		{
+		void* ptr = hdrs.back();
+		hdrs.pop_back();
+		return ptr;
+		}
+
+	return ::operator new(size);
+	}
+
+void IP_Hdr::operator delete(void* ptr, size_t size)
+	{
+	auto& hdrs = free_ip_hdrs();
+
+	if ( size == sizeof(IP_Hdr) && hdrs.size() < MAX_FREE_IP_HDRS )
+		{
+		hdrs.push_back(ptr);
+		return;
+		}
+
+	::operator delete(ptr);
+	}
+
 IPv6_Hdr_Chain* IPv6_Hdr_Chain::Copy(const ip6_hdr* new_hdr) const
 	{
 	IPv6_Hdr_Chain* rval = new IPv6_Hdr_Chain;
@@ -774,12 +858,12 @@ IPv6_Hdr_Chain* IPv6_Hdr_Chain::Copy(const ip6_hdr* new_hdr) const
 		}
 
 	const u_char* new_data = (const u_char*)new_hdr;
-	const u_char* old_data = chain[0]->Data();
+	const u_char* old_data = chain[0].Data();
 
 	for ( size_t i = 0; i < chain.size(); ++i )
 		{
-		int off = chain[i]->Data() - old_data;
-		rval->chain.push_back(new IPv6_Hdr(chain[i]->Type(), new_data + off));
+		int off = chain[i].Data() - old_data;
+		rval->chain.emplace_back(chain[i].Type(), new_data + off);
 		}
 
 	return rval;
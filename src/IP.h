@@ -162,6 +162,18 @@ public:
 
 	~IPv6_Hdr_Chain();
 
+	/**
+	 * Returns a header chain initialized from an IPv6 header structure,
+	 * recycling a released one if available.  This avoids allocating
+	 * anything in the common case of packets without extension headers.
+	 */
+	static IPv6_Hdr_Chain* Acquire(const struct ip6_hdr* ip6, int len);
+
+	/**
+	 * Releases a header chain for reuse by Acquire(), or deletes it.
+	 */
+	static void Release(const IPv6_Hdr_Chain* c);
+
 	/**
 	 * @return a copy of the header chain, but with pointers to individual
 	 * IPv6 headers now pointing within \a new_hdr.
@@ -181,7 +193,7 @@ public:
 	/**
 	 * Accesses the header at the given location in the chain.
 	 */
-	const IPv6_Hdr* operator[](const size_t i) const { return chain[i]; }
+	const IPv6_Hdr* operator[](const size_t i) const { return &chain[i]; }
 
 	/**
 	 * Returns whether the header chain indicates a fragmented packet.
@@ -193,7 +205,7 @@ public:
 	 */
 	const struct ip6_frag* GetFragHdr() const
 		{ return IsFragment() ?
-				(const struct ip6_frag*)chain[chain.size()-1]->Data(): nullptr; }
+				(const struct ip6_frag*)chain[chain.size()-1].Data(): nullptr; }
 
 	/**
 	 * If the header chain is a fragment, returns the offset in number of bytes
@@ -261,6 +273,11 @@ protected:
 	void Init(const struct ip6_hdr* ip6, int total_len, bool set_next,
 	          uint16_t next = 0);
 
+	/**
+	 * Empties the chain, keeping the storage of its headers.
+	 */
+	void Reset();
+
 	/**
 	 * Process a routing header and allocate/remember the final destination
 	 * address if it has segments left and is a valid routing header.
@@ -275,7 +292,7 @@ protected:
 	void ProcessDstOpts(const struct ip6_dest* d, uint16_t len);
 #endif
 
-	std::vector<IPv6_Hdr*> chain;
+	std::vector<IPv6_Hdr> chain;
 
 	/**
 	 * The summation of all header lengths in the chain in bytes.
@@ -326,7 +343,7 @@ public:
 	 */
 	IP_Hdr(const struct ip6_hdr* arg_ip6, bool arg_del, int len,
 	       const IPv6_Hdr_Chain* c = nullptr)
-		: ip6(arg_ip6), ip6_hdrs(c ? c : new IPv6_Hdr_Chain(ip6, len)),
+		: ip6(arg_ip6), ip6_hdrs(c ? c : IPv6_Hdr_Chain::Acquire(ip6, len)),
 		  del(arg_del)
 		{
 		}
@@ -338,12 +355,17 @@ public:
 	 */
 	IP_Hdr* Copy() const;
 
+	// Instances get recycled through a free list, as every IP packet
+	// comes with one, and tunneled ones with one per layer.
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr, size_t size);
+
 	/**
 	 * Destructor.
 	 */
 	~IP_Hdr()
 		{
-		delete ip6_hdrs;
+		IPv6_Hdr_Chain::Release(ip6_hdrs);
 
 		if ( del )
 			{
@@ -125,6 +125,40 @@ bool IPAddr::ConvertString(const char* s, in6_addr* result)
 	// some platforms have more sensitive implementations than others
 	// that can't e.g. handle leading zeroes.
 	int a[4];
+
+	// Addresses usually consist of nothing but digits and dots, which
+	// the loop here handles.  Anything else goes through sscanf() to
+	// keep what it accepts.
+	const char* p = s;
+	int i = 0;
+
+	for ( ; i < 4; ++i )
+		{
+		if ( i > 0 && *p++ != '.' )
+			break;
+
+		if ( *p < '0' || *p > '9' )
+			break;
+
+		int v = 0;
+
+		while ( *p >= '0' && *p <= '9' && v <= 255 )
+			v = v * 10 + (*p++ - '0');
+
+		if ( v > 255 )
+			break;
+
+		a[i] = v;
+		}
+
+	if ( i == 4 && *p == '\0' )
+		{
+		uint32_t addr = htonl((a[0] << 24) | (a[1] << 16) | (a[2] << 8) | a[3]);
+		memcpy(result->s6_addr, v4_mapped_prefix, sizeof(v4_mapped_prefix));
+		memcpy(&result->s6_addr[12], &addr, sizeof(uint32_t));
+		return true;
+		}
+
 	int n = 0;
 	int match_count = sscanf(s, "%d.%d.%d.%d%n", a+0, a+1, a+2, a+3, &n);
 
@@ -145,6 +179,45 @@ bool IPAddr::ConvertString(const char* s, in6_addr* result)
 	return true;
 	}
 
+// Writes the decimal digits of an address byte, returning the position
+// after them.
+static char* format_octet(char* p, unsigned int v)
+	{
+	if ( v >= 100 )
+		{
+		*p++ = '0' + v / 100;
+		v %= 100;
+		*p++ = '0' + v / 10;
+		v %= 10;
+		}
+
+	else if ( v >= 10 )
+		{
+		*p++ = '0' + v / 10;
+		v %= 10;
+		}
+
+	*p++ = '0' + v;
+	return p;
+	}
+
+int IPAddr::FormatIPv4(const in4_addr& in4, char* buf)
+	{
+	auto b = reinterpret_cast<const unsigned char*>(&in4.s_addr);
+	char* p = buf;
+
+	for ( int i = 0; i < 4; ++i )
+		{
+		if ( i > 0 )
+			*p++ = '.';
+
+		p = format_octet(p, b[i]);
+		}
+
+	*p = '\0';
+	return p - buf;
+	}
+
 void IPAddr::Init(const char* s)
 	{
 	if ( ! ConvertString(s, &in6) )
@@ -159,11 +232,10 @@ std::string IPAddr::AsString() const
 	if ( GetFamily() == IPv4 )
 		{
 		char s[INET_ADDRSTRLEN];
-
-		if ( ! bro_inet_ntop(AF_INET, &in6.s6_addr[12], s, INET_ADDRSTRLEN) )
-			return "<bad IPv4 address conversion";
-		else
-			return s;
+		in4_addr in4;
+		CopyIPv4(&in4);
+		int n = FormatIPv4(in4, s);
+		return {s, static_cast<size_t>(n)};
 		}
 	else
 		{
@@ -425,6 +425,19 @@ public:
 	 */
 	static bool ConvertString(const char* s, in6_addr* result);
 
+	/**
+	 * Writes the dotted representation of an IPv4 address, without
+	 * going through inet_ntop().
+	 *
+	 * @param in4 the address, in network byte order.
+	 *
+	 * @param buf receives the NUL-terminated text, and needs room for
+	 * INET_ADDRSTRLEN characters.
+	 *
+	 * @return the length of the text.
+	 */
+	static int FormatIPv4(const in4_addr& in4, char* buf);
+
 	/**
 	 * @param s the IPv4 or IPv6 string to convert (ASCII, NUL-terminated).
 	 *
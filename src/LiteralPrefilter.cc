@@ -0,0 +1,359 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/LiteralPrefilter.h"
+
+#include <ctype.h>
+#include <cstdlib>
+#include <cstring>
+
+#include "zeek/util.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+LiteralPrefilter::LiteralPrefilter()
+	: bigrams(65536 / 64)
+	{
+	}
+
+void LiteralPrefilter::Add(const std::string& lit, bool nocase)
+	{
+	Literal l{lit, nocase};
+
+	if ( nocase )
+		{
+		for ( auto& c : l.text )
+			c = tolower(static_cast<u_char>(c));
+
+		u_char a = l.text[0];
+		u_char b = l.text[1];
+
+		for ( u_char x : {a, static_cast<u_char>(toupper(a))} )
+			for ( u_char y : {b, static_cast<u_char>(toupper(b))} )
+				SetBigram(Bigram(x, y));
+		}
+	else
+		SetBigram(Bigram(l.text[0], l.text[1]));
+
+	max_len = std::max(max_len, static_cast<int>(l.text.size()));
+	literals.push_back(std::move(l));
+	}
+
+bool LiteralPrefilter::Matches(const Literal& l, const u_char* data, int len) const
+	{
+	int n = l.text.size();
+
+	if ( n > len )
+		return false;
+
+	if ( ! l.nocase )
+		return memcmp(l.text.data(), data, n) == 0;
+
+	for ( int i = 0; i < n; ++i )
+		if ( tolower(data[i]) != static_cast<u_char>(l.text[i]) )
+			return false;
+
+	return true;
+	}
+
+int LiteralPrefilter::Find(const u_char* data, int len, int max_start) const
+	{
+	int end = std::min(max_start, len - 1);
+
+	for ( int i = 0; i < end; ++i )
+		{
+		if ( ! HasBigram(Bigram(data[i], data[i + 1])) )
+			continue;
+
+		for ( const auto& l : literals )
+			if ( Matches(l, data + i, len - i) )
+				return i;
+		}
+
+	return -1;
+	}
+
+// Returns whether the pattern has an alternative at its top level, as in
+// ".*a|b", or is malformed.
+static bool has_top_level_alternative(const char* s)
+	{
+	int depth = 0;
+
+	for ( ; *s; ++s )
+		{
+		switch ( *s ) {
+		case '\\':
+			if ( s[1] )
+				++s;
+			break;
+
+		case '"':
+			for ( ++s; *s && *s != '"'; ++s )
+				if ( *s == '\\' && s[1] )
+					++s;
+
+			if ( ! *s )
+				return true;
+			break;
+
+		case '[':
+			++s;
+
+			if ( *s == '^' )
+				++s;
+
+			if ( *s == ']' )
+				++s;
+
+			for ( ; *s && *s != ']'; ++s )
+				{
+				if ( *s == '\\' && s[1] )
+					++s;
+
+				else if ( s[0] == '[' && s[1] == ':' )
+					{
+					const char* e = strstr(s, ":]");
+
+					if ( ! e )
+						return true;
+
+					s = e + 1;
+					}
+				}
+
+			if ( ! *s )
+				return true;
+			break;
+
+		case '(':
+			++depth;
+			break;
+
+		case ')':
+			if ( --depth < 0 )
+				return true;
+			break;
+
+		case '|':
+			if ( depth == 0 )
+				return true;
+			break;
+		}
+		}
+
+	return depth != 0;
+	}
+
+// Signatures mark case-insensitive patterns by wrapping them into
+// "(?i:...)".  Returns the pattern without that, setting nocase if it was
+// there.
+static std::string strip_nocase(const char* pattern, bool* nocase)
+	{
+	std::string p = pattern;
+	*nocase = false;
+
+	const char ci[] = "(?i:";
+	const size_t ci_len = sizeof(ci) - 1;
+
+	if ( p.compare(0, ci_len, ci) == 0 && p.size() > ci_len && p.back() == ')' &&
+	     ! has_top_level_alternative(p.substr(ci_len, p.size() - ci_len - 1).c_str()) )
+		{
+		p = p.substr(ci_len, p.size() - ci_len - 1);
+		*nocase = true;
+		}
+
+	return p;
+	}
+
+// Collects the literal atoms at the start of s into lit.  Returns where
+// they end.
+static const char* scan_literal(const char* s, std::string* lit)
+	{
+	lit->clear();
+
+	while ( *s )
+		{
+		std::string atom;
+		const char* next;
+
+		if ( *s == '\\' )
+			{
+			next = s + 1;
+
+			if ( ! *next )
+				break;
+
+			atom = static_cast<char>(util::detail::expand_escape(next));
+			}
+
+		else if ( *s == '"' )
+			{
+			for ( next = s + 1; *next && *next != '"'; )
+				{
+				if ( *next == '\\' && next[1] )
+					atom += static_cast<char>(util::detail::expand_escape(++next));
+				else
+					atom += *next++;
+				}
+
+			if ( ! *next )
+				break;
+
+			++next;
+			}
+
+		else if ( strchr("|*+?.(){}[]^$", *s) )
+			break;
+
+		else
+			{
+			atom = *s;
+			next = s + 1;
+			}
+
+		// A repeated atom may not be there.
+		if ( *next == '*' || *next == '?' || *next == '{' )
+			break;
+
+		*lit += atom;
+
+		if ( *next == '+' )
+			break;
+
+		s = next;
+		}
+
+	return s;
+	}
+
+bool LiteralPrefilter::LeadingLiteral(const char* pattern, std::string* lit, bool* nocase)
+	{
+	std::string p = strip_nocase(pattern, nocase);
+
+	if ( p.compare(0, 2, ".*") != 0 || has_top_level_alternative(p.c_str()) )
+		return false;
+
+	scan_literal(p.c_str() + 2, lit);
+	return lit->size() >= 2;
+	}
+
+bool LiteralPrefilter::AnchoredLiteral(const char* pattern, int* offset, std::string* lit,
+                                       bool* nocase, bool* whole)
+	{
+	std::string p = strip_nocase(pattern, nocase);
+
+	if ( has_top_level_alternative(p.c_str()) )
+		return false;
+
+	const char* s = p.c_str();
+
+	if ( *s == '^' )
+		++s;
+
+	// Skip single arbitrary bytes, as in "...." or ".{4}".  (In the
+	// multi-line mode of signature matching, "." matches newlines, too.)
+	*offset = 0;
+
+	while ( *s == '.' )
+		{
+		if ( s[1] == '{' )
+			{
+			char* end;
+			long n = strtol(s + 2, &end, 10);
+
+			if ( end == s + 2 || *end != '}' || n < 0 || n > 65535 )
+				return false;
+
+			*offset += n;
+			s = end + 1;
+			}
+
+		else if ( s[1] == '*' || s[1] == '+' || s[1] == '?' )
+			return false;
+
+		else
+			{
+			++*offset;
+			++s;
+			}
+		}
+
+	const char* end = scan_literal(s, lit);
+
+	// Anything left, such as a repetition of the literal's last atom,
+	// needs the full pattern.
+	*whole = ! *end;
+	return ! lit->empty();
+	}
+
+TEST_CASE("literal prefilter find")
+	{
+	LiteralPrefilter pf;
+	pf.Add("HELLO", false);
+	pf.Add("GoodBye", true);
+
+	auto find = [&pf](const char* s, int max_start = -1)
+		{
+		int len = strlen(s);
+		return pf.Find(reinterpret_cast<const u_char*>(s), len,
+		               max_start < 0 ? len : max_start);
+		};
+
+	CHECK(pf.MaxLen() == 7);
+	CHECK(find("HELLO") == 0);
+	CHECK(find("xxHELLO world") == 2);
+	CHECK(find("hello") == -1);
+	CHECK(find("xGOODBYE") == 1);
+	CHECK(find("xgoodbye") == 1);
+	CHECK(find("HELL") == -1);
+	CHECK(find("") == -1);
+	CHECK(find("H") == -1);
+
+	// The earliest occurrence wins, whichever string it is.
+	CHECK(find("goodbye HELLO") == 0);
+	CHECK(find("HEL goodbye HELLO") == 4);
+
+	// A string straddling a chunk boundary shows up once the saved tail
+	// is joined with the start of the next chunk, and must start within
+	// the tail.
+	CHECK(find("aaHELLO th", 4) == 2);
+	CHECK(find("aaHELLO th", 2) == -1);
+	CHECK(find("aaaHELLO", 4) == 3);
+	CHECK(find("aaaHELLO", 3) == -1);
+	}
+
+TEST_CASE("literal prefilter leading literal")
+	{
+	std::string lit;
+	bool nocase;
+
+	CHECK(LiteralPrefilter::LeadingLiteral(".*HELLO", &lit, &nocase));
+	CHECK(lit == "HELLO");
+	CHECK_FALSE(nocase);
+
+	CHECK(LiteralPrefilter::LeadingLiteral(".*ABCDEF[0-9]+XYZ", &lit, &nocase));
+	CHECK(lit == "ABCDEF");
+
+	CHECK(LiteralPrefilter::LeadingLiteral("(?i:.*goodbye)", &lit, &nocase));
+	CHECK(lit == "goodbye");
+	CHECK(nocase);
+
+	// The last atom may be repeated, so it's not part of the literal.
+	CHECK(LiteralPrefilter::LeadingLiteral(".*abcd*", &lit, &nocase));
+	CHECK(lit == "abc");
+	CHECK(LiteralPrefilter::LeadingLiteral(".*abc+", &lit, &nocase));
+	CHECK(lit == "abc");
+
+	CHECK(LiteralPrefilter::LeadingLiteral(".*\\x00\\x01AB", &lit, &nocase));
+	CHECK(lit == std::string("\0\1AB", 4));
+
+	CHECK_FALSE(LiteralPrefilter::LeadingLiteral("HELLO", &lit, &nocase));
+	CHECK_FALSE(LiteralPrefilter::LeadingLiteral("^.*HELLO", &lit, &nocase));
+	CHECK_FALSE(LiteralPrefilter::LeadingLiteral(".*HELLO|WORLD", &lit, &nocase));
+	CHECK_FALSE(LiteralPrefilter::LeadingLiteral(".*a", &lit, &nocase));
+	CHECK_FALSE(LiteralPrefilter::LeadingLiteral(".*[ab]cd", &lit, &nocase));
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,109 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A quick test for whether data contains any of a set of literal strings,
+// used to avoid running signature pattern groups that can't match yet.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace zeek::detail {
+
+/**
+ * Finds the first occurrence of any of a set of strings, each of at least
+ * two bytes.  Scanning checks each pair of adjacent bytes of the data
+ * against a bitmap of the strings' first two bytes, and only compares
+ * further where that hits.
+ */
+class LiteralPrefilter {
+public:
+	LiteralPrefilter();
+
+	/**
+	 * Adds a string to look for.
+	 *
+	 * @param lit  The string, of at least two bytes.
+	 *
+	 * @param nocase  True if the string matches regardless of case.
+	 */
+	void Add(const std::string& lit, bool nocase);
+
+	/**
+	 * Returns the offset of the first occurrence of any of the strings
+	 * in data, or -1 if there's none.
+	 *
+	 * @param data  The data to search.
+	 *
+	 * @param len  The length of data.
+	 *
+	 * @param max_start  Only occurrences starting before this offset
+	 * count.
+	 */
+	int Find(const u_char* data, int len, int max_start) const;
+	int Find(const u_char* data, int len) const	{ return Find(data, len, len); }
+
+	/**
+	 * Returns the length of the longest string.
+	 */
+	int MaxLen() const	{ return max_len; }
+
+	/**
+	 * Returns the string a pattern's matches always start with, if the
+	 * pattern has the form ".*<literal>...", i.e., if it can only match
+	 * where that string occurs.
+	 *
+	 * @param pattern  The pattern's text, as given in a signature.
+	 *
+	 * @param lit  Set to the string.
+	 *
+	 * @param nocase  Set to true if the pattern is case-insensitive.
+	 *
+	 * @return  False if the pattern doesn't have this form, or its
+	 * leading literal is shorter than two bytes.
+	 */
+	static bool LeadingLiteral(const char* pattern, std::string* lit, bool* nocase);
+
+	/**
+	 * Returns the string that a pattern matched from the start of the
+	 * data has at a fixed offset, if the pattern has the form
+	 * "^.{<offset>}<literal>...", as file magic signatures often do.
+	 * This assumes multi-line matching, where "." matches any byte.
+	 *
+	 * @param pattern  The pattern's text, as given in a signature.
+	 *
+	 * @param offset  Set to the number of bytes preceding the string.
+	 *
+	 * @param lit  Set to the string.
+	 *
+	 * @param nocase  Set to true if the pattern is case-insensitive.
+	 *
+	 * @param whole  Set to true if the string is all the pattern
+	 * matches, so that it matches wherever the string occurs.
+	 *
+	 * @return  False if the pattern doesn't have this form.
+	 */
+	static bool AnchoredLiteral(const char* pattern, int* offset, std::string* lit,
+	                            bool* nocase, bool* whole);
+
+private:
+	struct Literal {
+		std::string text;	// Lower-cased if nocase.
+		bool nocase;
+	};
+
+	static int Bigram(u_char a, u_char b)	{ return (a << 8) | b; }
+
+	void SetBigram(int b)	{ bigrams[b >> 6] |= uint64_t(1) << (b & 63); }
+	bool HasBigram(int b) const	{ return bigrams[b >> 6] & (uint64_t(1) << (b & 63)); }
+
+	bool Matches(const Literal& l, const u_char* data, int len) const;
+
+	std::vector<uint64_t> bigrams;	// 65536 bits
+	std::vector<Literal> literals;
+	int max_len = 0;
+};
+
+} // namespace zeek::detail
@@ -0,0 +1,130 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/MemoryArenas.h"
+
+#ifdef USE_JEMALLOC
+#include <jemalloc/jemalloc.h>
+#endif
+
+#include "zeek/NetVar.h"
+#include "zeek/Reporter.h"
+#include "zeek/util.h"
+
+namespace zeek::detail {
+
+bool MemoryArenas::enabled = false;
+unsigned MemoryArenas::arenas[NUM_MEMORY_TAGS];
+
+#ifdef USE_JEMALLOC
+// The MIB of "thread.arena", which the tag scopes set all the time.
+static size_t thread_arena_mib[2];
+static size_t thread_arena_miblen = 2;
+#endif
+
+const char* MemoryArenas::TagName(MemoryTag tag)
+	{
+	static const char* names[NUM_MEMORY_TAGS] = {
+		"sessions", "reassembly", "scripts", "dfa", "logging", "broker", "files",
+	};
+
+	return names[tag];
+	}
+
+void MemoryArenas::Init()
+	{
+#ifdef USE_JEMALLOC
+	if ( ! BifConst::memory_arenas )
+		return;
+
+	for ( int i = 0; i < NUM_MEMORY_TAGS; ++i )
+		{
+		size_t len = sizeof(arenas[i]);
+
+		if ( mallctl("arenas.create", &arenas[i], &len, nullptr, 0) != 0 )
+			{
+			reporter->Warning("failed to create the memory arena for %s",
+			                  TagName(MemoryTag(i)));
+			return;
+			}
+		}
+
+	if ( mallctlnametomib("thread.arena", thread_arena_mib, &thread_arena_miblen) != 0 )
+		{
+		reporter->Warning("failed to look up jemalloc's thread.arena");
+		return;
+		}
+
+	enabled = true;
+
+	bool tcache = false;
+	mallctl("thread.tcache.enabled", nullptr, nullptr, &tcache, sizeof(tcache));
+	Switch(MEMORY_SCRIPTS);
+#endif
+	}
+
+void MemoryArenas::BindThread(MemoryTag tag)
+	{
+	if ( ! enabled )
+		return;
+
+	Switch(tag);
+
+#ifdef USE_JEMALLOC
+	bool tcache = true;
+	mallctl("thread.tcache.enabled", nullptr, nullptr, &tcache, sizeof(tcache));
+#endif
+	}
+
+unsigned MemoryArenas::Switch(MemoryTag tag)
+	{
+	unsigned prev = 0;
+
+#ifdef USE_JEMALLOC
+	size_t len = sizeof(prev);
+	mallctlbymib(thread_arena_mib, thread_arena_miblen, &prev, &len,
+	             &arenas[tag], sizeof(arenas[tag]));
+#endif
+
+	return prev;
+	}
+
+void MemoryArenas::Restore(unsigned arena)
+	{
+#ifdef USE_JEMALLOC
+	mallctlbymib(thread_arena_mib, thread_arena_miblen, nullptr, nullptr,
+	             &arena, sizeof(arena));
+#endif
+	}
+
+MemoryArenas::Stats MemoryArenas::GetStats()
+	{
+	Stats stats{};
+
+#ifdef USE_JEMALLOC
+	if ( ! enabled )
+		return stats;
+
+	// The statistics only get updated with a new epoch.
+	uint64_t epoch = 1;
+	size_t len = sizeof(epoch);
+	mallctl("epoch", &epoch, &len, &epoch, len);
+
+	for ( int i = 0; i < NUM_MEMORY_TAGS; ++i )
+		{
+		for ( const char* kind : {"small", "large"} )
+			{
+			size_t allocated = 0;
+			len = sizeof(allocated);
+			auto name = util::fmt("stats.arenas.%u.%s.allocated", arenas[i], kind);
+
+			if ( mallctl(name, &allocated, &len, nullptr, 0) == 0 )
+				stats[i] += allocated;
+			}
+		}
+#endif
+
+	return stats;
+	}
+
+} // namespace zeek::detail
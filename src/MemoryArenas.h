@@ -0,0 +1,105 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Separate jemalloc arenas for Zeek's main subsystems, so that the memory
+// each of them holds can be told apart.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace zeek::detail {
+
+enum MemoryTag {
+	MEMORY_SESSIONS,
+	MEMORY_REASSEMBLY,
+	MEMORY_SCRIPTS,	// Everything on the main thread that isn't tagged otherwise.
+	MEMORY_DFA,
+	MEMORY_LOGGING,
+	MEMORY_BROKER,
+	MEMORY_FILES,
+	NUM_MEMORY_TAGS,
+};
+
+/**
+ * The arenas of the subsystems, when Zeek uses jemalloc and
+ * :zeek:see:`memory_arenas` is set.  A thread allocates from the arena of
+ * the tag it's bound to, which on the main thread changes through
+ * MemoryTagScope while a subsystem does its work.  The main thread runs
+ * without a thread cache then, which would otherwise hand out memory of
+ * whichever arena filled it; other threads stay bound to one arena and
+ * keep their caches.
+ */
+class MemoryArenas {
+public:
+	/**
+	 * Creates the arenas and binds the main thread to MEMORY_SCRIPTS.
+	 * Does nothing when jemalloc isn't available or the arenas aren't
+	 * enabled.
+	 */
+	static void Init();
+
+	static bool Enabled()	{ return enabled; }
+
+	/**
+	 * Returns the name of a tag, as used in statistics.
+	 */
+	static const char* TagName(MemoryTag tag);
+
+	/**
+	 * Binds the calling thread to a tag's arena for good, with a thread
+	 * cache.
+	 */
+	static void BindThread(MemoryTag tag);
+
+	/**
+	 * Switches the calling thread to a tag's arena.
+	 *
+	 * @return  The arena to go back to through Restore().
+	 */
+	static unsigned Switch(MemoryTag tag);
+
+	static void Restore(unsigned arena);
+
+	using Stats = std::array<uint64_t, NUM_MEMORY_TAGS>;
+
+	/**
+	 * Returns the bytes currently allocated from each tag's arena, all
+	 * zero if the arenas aren't enabled.
+	 */
+	static Stats GetStats();
+
+private:
+	static bool enabled;
+	static unsigned arenas[NUM_MEMORY_TAGS];
+};
+
+/**
+ * Tags the allocations of the main thread for as long as it exists.
+ */
+class MemoryTagScope {
+public:
+	explicit MemoryTagScope(MemoryTag tag)
+		{
+		if ( MemoryArenas::Enabled() )
+			{
+			prev = MemoryArenas::Switch(tag);
+			switched = true;
+			}
+		}
+
+	~MemoryTagScope()
+		{
+		if ( switched )
+			MemoryArenas::Restore(prev);
+		}
+
+	MemoryTagScope(const MemoryTagScope&) = delete;
+	MemoryTagScope& operator=(const MemoryTagScope&) = delete;
+
+private:
+	unsigned prev = 0;
+	bool switched = false;
+};
+
+} // namespace zeek::detail
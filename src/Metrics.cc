@@ -0,0 +1,674 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/Metrics.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+
+#include "zeek/Event.h"
+#include "zeek/HugePages.h"
+#include "zeek/IP.h"
+#include "zeek/MemoryArenas.h"
+#include "zeek/Reassem.h"
+#include "zeek/Reporter.h"
+#include "zeek/Sessions.h"
+#include "zeek/Timer.h"
+#include "zeek/util.h"
+#include "zeek/broker/Manager.h"
+#include "zeek/iosource/Manager.h"
+#include "zeek/threading/Manager.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+MetricsRegistry metrics_registry;
+
+// How long a client may take to send its request and read the response.
+static constexpr double CLIENT_TIMEOUT = 10.0;
+
+// The longest request that gets accepted.
+static constexpr size_t MAX_REQUEST = 8192;
+
+void Metric::Render(std::string* out) const
+	{
+	static const char* type_names[] = { "counter", "gauge", "histogram" };
+
+	out->append("# HELP ").append(name).append(" ");
+
+	for ( auto c : help )
+		{
+		if ( c == '\\' )
+			out->append("\\\\");
+		else if ( c == '\n' )
+			out->append("\\n");
+		else
+			out->push_back(c);
+		}
+
+	out->append("\n# TYPE ").append(name).append(" ").append(type_names[type]).append("\n");
+	RenderSamples(out);
+	}
+
+std::string Metric::Label(const std::string& name, const std::string& value)
+	{
+	std::string rval = name + "=\"";
+
+	for ( auto c : value )
+		{
+		if ( c == '\\' || c == '"' )
+			{
+			rval.push_back('\\');
+			rval.push_back(c);
+			}
+		else if ( c == '\n' )
+			rval.append("\\n");
+		else
+			rval.push_back(c);
+		}
+
+	rval.push_back('"');
+	return rval;
+	}
+
+std::string Metric::FormatValue(double v)
+	{
+	if ( std::isnan(v) )
+		return "NaN";
+
+	if ( std::isinf(v) )
+		return v > 0 ? "+Inf" : "-Inf";
+
+	// Integral values, which most are, render without exponent.
+	if ( v == std::floor(v) && std::fabs(v) < 1e15 )
+		return util::fmt("%" PRId64, static_cast<int64_t>(v));
+
+	return util::fmt("%.15g", v);
+	}
+
+void Counter::RenderSamples(std::string* out) const
+	{
+	out->append(name).append(" ").append(util::fmt("%" PRIu64, Value())).append("\n");
+	}
+
+void Gauge::RenderSamples(std::string* out) const
+	{
+	out->append(name).append(" ").append(FormatValue(Value())).append("\n");
+	}
+
+Histogram::Histogram(std::string name, std::string help, std::vector<double> arg_bounds)
+	: Metric(std::move(name), std::move(help), HISTOGRAM), bounds(std::move(arg_bounds)),
+	  buckets(new std::atomic<uint64_t>[bounds.size() + 1])
+	{
+	std::sort(bounds.begin(), bounds.end());
+
+	for ( size_t i = 0; i <= bounds.size(); ++i )
+		buckets[i].store(0, std::memory_order_relaxed);
+	}
+
+void Histogram::Observe(double v)
+	{
+	// The first bucket whose bound isn't below the value, as "le" says.
+	auto i = std::lower_bound(bounds.begin(), bounds.end(), v) - bounds.begin();
+	buckets[i].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+
+	double cur = sum.load(std::memory_order_relaxed);
+
+	while ( ! sum.compare_exchange_weak(cur, cur + v, std::memory_order_relaxed) )
+		;
+	}
+
+void Histogram::RenderSamples(std::string* out) const
+	{
+	// The text format wants cumulative counts.
+	uint64_t n = 0;
+
+	for ( size_t i = 0; i <= bounds.size(); ++i )
+		{
+		n += buckets[i].load(std::memory_order_relaxed);
+		auto le = i < bounds.size() ? FormatValue(bounds[i]) : "+Inf";
+		out->append(name).append("_bucket{le=\"").append(le).append("\"} ");
+		out->append(util::fmt("%" PRIu64, n)).append("\n");
+		}
+
+	out->append(name).append("_sum ");
+	out->append(FormatValue(sum.load(std::memory_order_relaxed))).append("\n");
+	out->append(name).append("_count ");
+	out->append(util::fmt("%" PRIu64, count.load(std::memory_order_relaxed))).append("\n");
+	}
+
+void CallbackMetric::RenderSamples(std::string* out) const
+	{
+	Samples samples;
+	collect(&samples);
+
+	for ( const auto& s : samples )
+		{
+		out->append(name);
+
+		if ( ! s.labels.empty() )
+			out->append("{").append(s.labels).append("}");
+
+		out->append(" ").append(FormatValue(s.value)).append("\n");
+		}
+	}
+
+Metric* MetricsRegistry::Find(const std::string& name, Metric::Type type) const
+	{
+	auto i = by_name.find(name);
+
+	if ( i == by_name.end() )
+		return nullptr;
+
+	if ( i->second->GetType() != type )
+		reporter->InternalError("metric %s registered with different types", name.c_str());
+
+	return i->second;
+	}
+
+Metric* MetricsRegistry::Add(std::unique_ptr<Metric> m)
+	{
+	auto rval = m.get();
+	by_name[m->Name()] = rval;
+	metrics.push_back(std::move(m));
+	return rval;
+	}
+
+Counter* MetricsRegistry::GetCounter(const std::string& name, const std::string& help)
+	{
+	std::lock_guard<std::mutex> guard(lock);
+
+	if ( auto m = Find(name, Metric::COUNTER) )
+		return static_cast<Counter*>(m);
+
+	return static_cast<Counter*>(Add(std::make_unique<Counter>(name, help)));
+	}
+
+Gauge* MetricsRegistry::GetGauge(const std::string& name, const std::string& help)
+	{
+	std::lock_guard<std::mutex> guard(lock);
+
+	if ( auto m = Find(name, Metric::GAUGE) )
+		return static_cast<Gauge*>(m);
+
+	return static_cast<Gauge*>(Add(std::make_unique<Gauge>(name, help)));
+	}
+
+Histogram* MetricsRegistry::GetHistogram(const std::string& name, const std::string& help,
+                                         std::vector<double> bounds)
+	{
+	std::lock_guard<std::mutex> guard(lock);
+
+	if ( auto m = Find(name, Metric::HISTOGRAM) )
+		return static_cast<Histogram*>(m);
+
+	return static_cast<Histogram*>(Add(std::make_unique<Histogram>(name, help,
+	                                                               std::move(bounds))));
+	}
+
+void MetricsRegistry::AddCallback(const std::string& name, const std::string& help,
+                                  Metric::Type type, CallbackMetric::Collector collect)
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	auto m = std::make_unique<CallbackMetric>(name, help, type, std::move(collect));
+	auto i = by_name.find(name);
+
+	if ( i == by_name.end() )
+		{
+		Add(std::move(m));
+		return;
+		}
+
+	for ( auto& old : metrics )
+		if ( old.get() == i->second )
+			{
+			i->second = m.get();
+			old = std::move(m);
+			break;
+			}
+	}
+
+std::string MetricsRegistry::Render() const
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	std::string rval;
+
+	for ( const auto& m : metrics )
+		m->Render(&rval);
+
+	return rval;
+	}
+
+void MetricsRegistry::AddCoreMetrics()
+	{
+	using Samples = CallbackMetric::Samples;
+
+	auto session_stats = [](auto get)
+		{
+		return [get](Samples* s)
+			{
+			if ( ! sessions )
+				return;
+
+			SessionStats stats;
+			sessions->GetStats(stats);
+			get(stats, s);
+			};
+		};
+
+	AddCallback("zeek_packets_processed_total", "Packets that reached session processing.",
+	            Metric::COUNTER, session_stats([](const SessionStats& st, Samples* s)
+		{
+		s->push_back({"", double(st.num_packets)});
+		}));
+
+	AddCallback("zeek_connections_active", "Connections currently in memory.",
+	            Metric::GAUGE, session_stats([](const SessionStats& st, Samples* s)
+		{
+		s->push_back({Metric::Label("protocol", "tcp"), double(st.num_TCP_conns)});
+		s->push_back({Metric::Label("protocol", "udp"), double(st.num_UDP_conns)});
+		s->push_back({Metric::Label("protocol", "icmp"), double(st.num_ICMP_conns)});
+		}));
+
+	AddCallback("zeek_connections_total", "Connections seen since startup.",
+	            Metric::COUNTER, session_stats([](const SessionStats& st, Samples* s)
+		{
+		s->push_back({Metric::Label("protocol", "tcp"), double(st.cumulative_TCP_conns)});
+		s->push_back({Metric::Label("protocol", "udp"), double(st.cumulative_UDP_conns)});
+		s->push_back({Metric::Label("protocol", "icmp"), double(st.cumulative_ICMP_conns)});
+		}));
+
+	AddCallback("zeek_fragments_active", "IP fragments currently held for reassembly.",
+	            Metric::GAUGE, session_stats([](const SessionStats& st, Samples* s)
+		{
+		s->push_back({"", double(st.num_fragments)});
+		}));
+
+	AddCallback("zeek_timers_active", "Timers currently pending.", Metric::GAUGE,
+	            [](Samples* s)
+		{
+		if ( timer_mgr )
+			s->push_back({"", double(timer_mgr->Size())});
+		});
+
+	AddCallback("zeek_timers_total", "Timers created since startup.", Metric::COUNTER,
+	            [](Samples* s)
+		{
+		if ( timer_mgr )
+			s->push_back({"", double(timer_mgr->CumulativeNum())});
+		});
+
+	AddCallback("zeek_reassembly_memory_bytes", "Memory held by reassemblers.",
+	            Metric::GAUGE, [](Samples* s)
+		{
+		static const std::pair<ReassemblerType, const char*> kinds[] = {
+			{REASSEM_TCP, "tcp"}, {REASSEM_FRAG, "frag"},
+			{REASSEM_FILE, "file"}, {REASSEM_UNKNOWN, "unknown"},
+		};
+
+		for ( const auto& [kind, name] : kinds )
+			s->push_back({Metric::Label("kind", name),
+			              double(Reassembler::MemoryAllocation(kind))});
+		});
+
+	AddCallback("zeek_huge_page_bytes", "Memory of tables mapped from huge pages.",
+	            Metric::GAUGE, [](Samples* s)
+		{
+		const auto& st = HugePages::GetStats();
+		s->push_back({Metric::Label("kind", "hugetlb"), double(st.hugetlb_bytes)});
+		s->push_back({Metric::Label("kind", "thp"), double(st.thp_bytes)});
+		});
+
+	AddCallback("zeek_memory_arena_bytes", "Memory allocated from each subsystem's arena.",
+	            Metric::GAUGE, [](Samples* s)
+		{
+		if ( ! MemoryArenas::Enabled() )
+			return;
+
+		auto stats = MemoryArenas::GetStats();
+
+		for ( int i = 0; i < NUM_MEMORY_TAGS; ++i )
+			s->push_back({Metric::Label("subsystem", MemoryArenas::TagName(MemoryTag(i))),
+			              double(stats[i])});
+		});
+
+	AddCallback("zeek_event_queue_depth", "Events queued but not yet dispatched.",
+	            Metric::GAUGE, [](Samples* s)
+		{
+		s->push_back({"", double(event_mgr.Size())});
+		});
+
+	AddCallback("zeek_events_dispatched_total", "Events dispatched since startup.",
+	            Metric::COUNTER, [](Samples* s)
+		{
+		s->push_back({"", double(event_mgr.num_events_dispatched)});
+		});
+
+	// A log writer's backlog is the "in" direction of its thread, which
+	// is named after the log's path and the writer.
+	AddCallback("zeek_thread_messages_pending", "Messages queued between the main thread and a child thread.",
+	            Metric::GAUGE, [](Samples* s)
+		{
+		if ( ! thread_mgr )
+			return;
+
+		for ( const auto& [name, st] : thread_mgr->GetMsgThreadStats() )
+			{
+			auto thread = Metric::Label("thread", name);
+			s->push_back({thread + "," + Metric::Label("direction", "in"),
+			              double(st.pending_in)});
+			s->push_back({thread + "," + Metric::Label("direction", "out"),
+			              double(st.pending_out)});
+			}
+		});
+
+	AddCallback("zeek_thread_messages_total", "Messages sent between the main thread and a child thread.",
+	            Metric::COUNTER, [](Samples* s)
+		{
+		if ( ! thread_mgr )
+			return;
+
+		for ( const auto& [name, st] : thread_mgr->GetMsgThreadStats() )
+			{
+			auto thread = Metric::Label("thread", name);
+			s->push_back({thread + "," + Metric::Label("direction", "in"),
+			              double(st.sent_in)});
+			s->push_back({thread + "," + Metric::Label("direction", "out"),
+			              double(st.sent_out)});
+			}
+		});
+
+	AddCallback("zeek_thread_queue_overflows_total", "Messages that didn't fit into a thread queue's ring.",
+	            Metric::COUNTER, [](Samples* s)
+		{
+		if ( ! thread_mgr )
+			return;
+
+		for ( const auto& [name, st] : thread_mgr->GetMsgThreadStats() )
+			{
+			auto thread = Metric::Label("thread", name);
+			s->push_back({thread + "," + Metric::Label("direction", "in"),
+			              double(st.queue_in_stats.num_overflows)});
+			s->push_back({thread + "," + Metric::Label("direction", "out"),
+			              double(st.queue_out_stats.num_overflows)});
+			}
+		});
+
+	AddCallback("zeek_broker_peers", "Connected Broker peers.", Metric::GAUGE,
+	            [](Samples* s)
+		{
+		if ( broker_mgr )
+			s->push_back({"", double(broker_mgr->GetStatistics().num_peers)});
+		});
+
+	AddCallback("zeek_broker_buffered", "Messages buffered for sending to Broker peers.",
+	            Metric::GAUGE, [](Samples* s)
+		{
+		if ( ! broker_mgr )
+			return;
+
+		const auto& st = broker_mgr->GetStatistics();
+		s->push_back({Metric::Label("kind", "event"), double(st.num_events_buffered)});
+		s->push_back({Metric::Label("kind", "log"), double(st.num_logs_buffered)});
+		});
+
+	AddCallback("zeek_broker_messages_total", "Messages exchanged with Broker peers.",
+	            Metric::COUNTER, [](Samples* s)
+		{
+		if ( ! broker_mgr )
+			return;
+
+		const auto& st = broker_mgr->GetStatistics();
+		auto in = Metric::Label("direction", "in");
+		auto out = Metric::Label("direction", "out");
+		auto event = Metric::Label("kind", "event");
+		auto log = Metric::Label("kind", "log");
+		s->push_back({event + "," + in, double(st.num_events_incoming)});
+		s->push_back({event + "," + out, double(st.num_events_outgoing)});
+		s->push_back({log + "," + in, double(st.num_logs_incoming)});
+		s->push_back({log + "," + out, double(st.num_logs_outgoing)});
+		});
+	}
+
+MetricsServer::~MetricsServer()
+	{
+	for ( const auto& c : clients )
+		close(c.first);
+
+	if ( listen_fd >= 0 )
+		close(listen_fd);
+	}
+
+bool MetricsServer::Listen(const std::string& addr, uint16_t port)
+	{
+	sockaddr_storage ss;
+	memset(&ss, 0, sizeof(ss));
+	socklen_t len;
+
+	auto sin = reinterpret_cast<sockaddr_in*>(&ss);
+	auto sin6 = reinterpret_cast<sockaddr_in6*>(&ss);
+
+	if ( inet_pton(AF_INET, addr.c_str(), &sin->sin_addr) == 1 )
+		{
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons(port);
+		len = sizeof(*sin);
+		}
+
+	else if ( inet_pton(AF_INET6, addr.c_str(), &sin6->sin6_addr) == 1 )
+		{
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = htons(port);
+		len = sizeof(*sin6);
+		}
+
+	else
+		{
+		reporter->Error("invalid metrics address %s", addr.c_str());
+		return false;
+		}
+
+	listen_fd = socket(ss.ss_family, SOCK_STREAM, 0);
+
+	if ( listen_fd < 0 )
+		{
+		reporter->Error("cannot create metrics socket: %s", strerror(errno));
+		return false;
+		}
+
+	int on = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	if ( bind(listen_fd, reinterpret_cast<sockaddr*>(&ss), len) < 0 ||
+	     listen(listen_fd, 16) < 0 )
+		{
+		reporter->Error("cannot listen for metrics on %s:%u: %s", addr.c_str(), port,
+		                strerror(errno));
+		close(listen_fd);
+		listen_fd = -1;
+		return false;
+		}
+
+	fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+	fcntl(listen_fd, F_SETFD, FD_CLOEXEC);
+
+	if ( ! iosource_mgr->RegisterFd(listen_fd, this) )
+		{
+		reporter->Error("cannot register metrics socket");
+		close(listen_fd);
+		listen_fd = -1;
+		return false;
+		}
+
+	iosource_mgr->Register(this, true);
+	return true;
+	}
+
+double MetricsServer::GetNextTimeout()
+	{
+	if ( clients.empty() )
+		return -1;
+
+	// Come back soon for responses that didn't fit into the socket's
+	// buffer, and otherwise when the first client times out.
+	double now = util::current_time();
+	double next = -1;
+
+	for ( const auto& [fd, c] : clients )
+		{
+		if ( ! c.response.empty() )
+			return 0;
+
+		double left = std::max(c.deadline - now, 0.0);
+
+		if ( next < 0 || left < next )
+			next = left;
+		}
+
+	return next;
+	}
+
+void MetricsServer::Process()
+	{
+	Accept();
+
+	std::vector<int> done;
+	double now = util::current_time();
+
+	for ( auto& [fd, c] : clients )
+		if ( now > c.deadline || ! Serve(fd, &c) )
+			done.push_back(fd);
+
+	for ( auto fd : done )
+		Drop(fd);
+	}
+
+void MetricsServer::Accept()
+	{
+	while ( true )
+		{
+		int fd = accept(listen_fd, nullptr, nullptr);
+
+		if ( fd < 0 )
+			{
+			if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+				reporter->Warning("cannot accept metrics connection: %s", strerror(errno));
+
+			return;
+			}
+
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+		if ( ! iosource_mgr->RegisterFd(fd, this) )
+			{
+			close(fd);
+			continue;
+			}
+
+		clients[fd].deadline = util::current_time() + CLIENT_TIMEOUT;
+		}
+	}
+
+bool MetricsServer::Serve(int fd, Client* c)
+	{
+	if ( c->response.empty() )
+		{
+		char buf[2048];
+		ssize_t n;
+
+		while ( (n = read(fd, buf, sizeof(buf))) > 0 )
+			c->request.append(buf, n);
+
+		if ( n == 0 )
+			return false;
+
+		if ( n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+			return false;
+
+		if ( c->request.size() > MAX_REQUEST )
+			return false;
+
+		if ( c->request.find("\r\n\r\n") == std::string::npos &&
+		     c->request.find("\n\n") == std::string::npos )
+			return true;
+
+		std::string body;
+		const char* status = "200 OK";
+
+		if ( c->request.compare(0, 4, "GET ") == 0 )
+			body = metrics_registry.Render();
+		else
+			status = "405 Method Not Allowed";
+
+		c->response = util::fmt("HTTP/1.0 %s\r\n"
+		                        "Content-Type: text/plain; version=0.0.4\r\n"
+		                        "Content-Length: %zu\r\n"
+		                        "Connection: close\r\n\r\n", status, body.size());
+		c->response.append(body);
+		}
+
+	while ( c->sent < c->response.size() )
+		{
+		ssize_t n = write(fd, c->response.data() + c->sent, c->response.size() - c->sent);
+
+		if ( n < 0 )
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+		c->sent += n;
+		}
+
+	return false;
+	}
+
+void MetricsServer::Drop(int fd)
+	{
+	iosource_mgr->UnregisterFd(fd, this);
+	close(fd);
+	clients.erase(fd);
+	}
+
+} // namespace zeek::detail
+
+TEST_SUITE_BEGIN("Metrics");
+
+TEST_CASE("metrics rendering")
+	{
+	zeek::detail::MetricsRegistry r;
+
+	auto c = r.GetCounter("test_requests_total", "Requests.");
+	c->Inc();
+	c->Inc(2);
+	CHECK(r.GetCounter("test_requests_total", "Requests.") == c);
+
+	auto h = r.GetHistogram("test_latency_seconds", "Latency.", {0.1, 1.0});
+	h->Observe(0.05);
+	h->Observe(0.1);
+	h->Observe(5);
+
+	r.AddCallback("test_queue", "Queue \"depth\".", zeek::detail::Metric::GAUGE,
+	              [](zeek::detail::CallbackMetric::Samples* s)
+		{
+		s->push_back({zeek::detail::Metric::Label("name", "a\"b"), 1.5});
+		});
+
+	auto text = r.Render();
+	CHECK(text.find("# TYPE test_requests_total counter\ntest_requests_total 3\n") != std::string::npos);
+	CHECK(text.find("test_latency_seconds_bucket{le=\"0.1\"} 2\n") != std::string::npos);
+	CHECK(text.find("test_latency_seconds_bucket{le=\"+Inf\"} 3\n") != std::string::npos);
+	CHECK(text.find("test_latency_seconds_count 3\n") != std::string::npos);
+	CHECK(text.find("test_queue{name=\"a\\\"b\"} 1.5\n") != std::string::npos);
+	CHECK(text.find("# HELP test_queue Queue \"depth\".\n") != std::string::npos);
+	}
+
+TEST_SUITE_END();
@@ -0,0 +1,255 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A registry of counters, gauges and histograms, and an HTTP endpoint that
+// exposes them in the Prometheus text format.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "zeek/iosource/IOSource.h"
+
+namespace zeek::detail {
+
+/**
+ * Base class of all metrics.  Updating a metric is a relaxed atomic
+ * operation, so any thread may update the metrics it holds without
+ * locking.  Metrics live as long as the registry that created them.
+ */
+class Metric {
+public:
+	enum Type { COUNTER, GAUGE, HISTOGRAM };
+
+	Metric(std::string arg_name, std::string arg_help, Type arg_type)
+		: name(std::move(arg_name)), help(std::move(arg_help)), type(arg_type)
+		{ }
+
+	virtual ~Metric() = default;
+
+	const std::string& Name() const	{ return name; }
+	Type GetType() const	{ return type; }
+
+	/**
+	 * Appends the metric in the text format, including its HELP and
+	 * TYPE lines.
+	 */
+	void Render(std::string* out) const;
+
+	/**
+	 * Returns a label pair for use in a sample's labels, with the value
+	 * escaped as the text format requires.
+	 */
+	static std::string Label(const std::string& name, const std::string& value);
+
+	/**
+	 * Returns a number formatted as the text format requires.
+	 */
+	static std::string FormatValue(double v);
+
+protected:
+	// Appends the samples of the metric.
+	virtual void RenderSamples(std::string* out) const = 0;
+
+	std::string name;
+	std::string help;
+	Type type;
+};
+
+/**
+ * A count that only goes up.
+ */
+class Counter final : public Metric {
+public:
+	Counter(std::string name, std::string help)
+		: Metric(std::move(name), std::move(help), COUNTER)
+		{ }
+
+	void Inc(uint64_t n = 1)
+		{ value.fetch_add(n, std::memory_order_relaxed); }
+
+	uint64_t Value() const	{ return value.load(std::memory_order_relaxed); }
+
+protected:
+	void RenderSamples(std::string* out) const override;
+
+private:
+	std::atomic<uint64_t> value{0};
+};
+
+/**
+ * A value that may go up and down.
+ */
+class Gauge final : public Metric {
+public:
+	Gauge(std::string name, std::string help)
+		: Metric(std::move(name), std::move(help), GAUGE)
+		{ }
+
+	void Set(double v)	{ value.store(v, std::memory_order_relaxed); }
+
+	void Add(double v)
+		{
+		double cur = value.load(std::memory_order_relaxed);
+
+		while ( ! value.compare_exchange_weak(cur, cur + v, std::memory_order_relaxed) )
+			;
+		}
+
+	double Value() const	{ return value.load(std::memory_order_relaxed); }
+
+protected:
+	void RenderSamples(std::string* out) const override;
+
+private:
+	std::atomic<double> value{0.0};
+};
+
+/**
+ * Counts observations into buckets of fixed upper bounds.
+ */
+class Histogram final : public Metric {
+public:
+	/**
+	 * @param bounds  The upper bounds of the buckets, in ascending order.
+	 * A last bucket without bound gets added.
+	 */
+	Histogram(std::string name, std::string help, std::vector<double> bounds);
+
+	void Observe(double v);
+
+protected:
+	void RenderSamples(std::string* out) const override;
+
+private:
+	std::vector<double> bounds;
+	std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+	std::atomic<uint64_t> count{0};
+	std::atomic<double> sum{0.0};
+};
+
+/**
+ * A metric whose samples a function computes when the metric gets
+ * rendered.  This suits values that components already track, such as
+ * table sizes.  The function runs on the main thread.
+ */
+class CallbackMetric final : public Metric {
+public:
+	struct Sample {
+		// Label pairs as returned by Label(), separated by commas.
+		std::string labels;
+		double value;
+	};
+
+	using Samples = std::vector<Sample>;
+	using Collector = std::function<void(Samples* samples)>;
+
+	CallbackMetric(std::string name, std::string help, Type type, Collector arg_collect)
+		: Metric(std::move(name), std::move(help), type), collect(std::move(arg_collect))
+		{ }
+
+protected:
+	void RenderSamples(std::string* out) const override;
+
+private:
+	Collector collect;
+};
+
+/**
+ * Holds all metrics of a process.  Registering a metric takes a lock,
+ * updating one doesn't.
+ */
+class MetricsRegistry {
+public:
+	/**
+	 * Returns the counter of the given name, creating it the first time.
+	 * The same goes for the other metric types below.
+	 */
+	Counter* GetCounter(const std::string& name, const std::string& help);
+
+	Gauge* GetGauge(const std::string& name, const std::string& help);
+
+	Histogram* GetHistogram(const std::string& name, const std::string& help,
+	                        std::vector<double> bounds);
+
+	/**
+	 * Adds a metric whose samples get computed when rendered, replacing
+	 * any earlier metric of the same name.
+	 */
+	void AddCallback(const std::string& name, const std::string& help, Metric::Type type,
+	                 CallbackMetric::Collector collect);
+
+	/**
+	 * Returns all metrics in the text format, in the order of their
+	 * registration.
+	 */
+	std::string Render() const;
+
+	/**
+	 * Registers the metrics of the core engine: connections, timers,
+	 * reassembly memory, the event queue, thread queues, and Broker.
+	 */
+	void AddCoreMetrics();
+
+private:
+	Metric* Find(const std::string& name, Metric::Type type) const;
+	Metric* Add(std::unique_ptr<Metric> m);
+
+	mutable std::mutex lock;
+	std::vector<std::unique_ptr<Metric>> metrics;
+	std::unordered_map<std::string, Metric*> by_name;
+};
+
+extern MetricsRegistry metrics_registry;
+
+/**
+ * Answers HTTP requests with the metrics of the registry, whatever their
+ * path.  It runs as part of the main loop, so that the callbacks of metrics
+ * can access the state of the core.
+ */
+class MetricsServer final : public iosource::IOSource {
+public:
+	~MetricsServer() override;
+
+	/**
+	 * Starts listening and registers the server with the I/O source
+	 * manager.
+	 *
+	 * @param addr  The address to listen on.
+	 *
+	 * @param port  The TCP port to listen on.
+	 *
+	 * @return True if successful, and otherwise false, after reporting
+	 * the error.
+	 */
+	bool Listen(const std::string& addr, uint16_t port);
+
+	// IOSource interface.
+	void Process() override;
+	const char* Tag() override	{ return "MetricsServer"; }
+	double GetNextTimeout() override;
+
+private:
+	struct Client {
+		std::string request;
+		std::string response;
+		size_t sent = 0;
+		double deadline;
+	};
+
+	void Accept();
+	// Returns false once the client is done with.
+	bool Serve(int fd, Client* c);
+	void Drop(int fd);
+
+	int listen_fd = -1;
+	std::unordered_map<int, Client> clients;
+};
+
+} // namespace zeek::detail
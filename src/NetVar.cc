@@ -183,6 +183,7 @@ int sig_max_group_size;
 
 int dpd_reassemble_first_packets;
 int dpd_buffer_size;
+uint64_t dpd_buffer_total_size;
 int dpd_match_only_beginning;
 int dpd_late_match_stop;
 int dpd_ignore_ports;
@@ -192,8 +193,10 @@ int check_for_unused_event_handlers;
 double timer_mgr_inactivity_timeout;
 
 int record_all_packets;
+int anonymize_dumped_packets;
 
 bro_uint_t bits_per_uid;
+int counter_based_uids;
 
 } // namespace zeek::detail. The namespace has be closed here before we include the netvar_def files.
 
@@ -242,7 +245,9 @@ void init_general_global_var()
 	sig_max_group_size = id::find_val("sig_max_group_size")->AsCount();
 	check_for_unused_event_handlers = id::find_val("check_for_unused_event_handlers")->AsBool();
 	record_all_packets = id::find_val("record_all_packets")->AsBool();
+	anonymize_dumped_packets = id::find_val("anonymize_dumped_packets")->AsBool();
 	bits_per_uid = id::find_val("bits_per_uid")->AsCount();
+	counter_based_uids = id::find_val("counter_based_uids")->AsBool();
 	}
 
 extern void zeek_legacy_netvar_init();
@@ -319,7 +324,7 @@ void init_net_var()
 	stp_delta = 0.0;
 	if ( const auto& v = id::find_val("stp_delta") ) stp_delta = v->AsInterval();
 	stp_idle_min = 0.0;
-	if ( const auto& v = id::find_val("stp_idle_min") ) stp_delta = v->AsInterval();
+	if ( const auto& v = id::find_val("stp_idle_min") ) stp_idle_min = v->AsInterval();
 
 	orig_addr_anonymization = 0;
 	if ( const auto& id = id::find("orig_addr_anonymization") )
@@ -350,6 +355,7 @@ void init_net_var()
 
 	dpd_reassemble_first_packets = id::find_val("dpd_reassemble_first_packets")->AsBool();
 	dpd_buffer_size = id::find_val("dpd_buffer_size")->AsCount();
+	dpd_buffer_total_size = id::find_val("dpd_buffer_total_size")->AsCount();
 	dpd_match_only_beginning = id::find_val("dpd_match_only_beginning")->AsBool();
 	dpd_late_match_stop = id::find_val("dpd_late_match_stop")->AsBool();
 	dpd_ignore_ports = id::find_val("dpd_ignore_ports")->AsBool();
@@ -84,6 +84,7 @@ extern int sig_max_group_size;
 
 extern int dpd_reassemble_first_packets;
 extern int dpd_buffer_size;
+extern uint64_t dpd_buffer_total_size;
 extern int dpd_match_only_beginning;
 extern int dpd_late_match_stop;
 extern int dpd_ignore_ports;
@@ -93,8 +94,10 @@ extern int check_for_unused_event_handlers;
 extern double timer_mgr_inactivity_timeout;
 
 extern int record_all_packets;
+extern int anonymize_dumped_packets;
 
 extern bro_uint_t bits_per_uid;
+extern int counter_based_uids;
 
 // Initializes globals that don't pertain to network/event analysis.
 extern void init_general_global_var();
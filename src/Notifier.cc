@@ -1,6 +1,7 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
 #include <set>
+#include <cinttypes>
 
 #include "zeek/Notifier.h"
 #include "zeek/DebugLogger.h"
@@ -24,6 +25,9 @@ Registry::~Registry()
 	{
 	while ( registrations.begin() != registrations.end() )
 		Unregister(registrations.begin()->first);
+
+	while ( keyed_registrations.begin() != keyed_registrations.end() )
+		Unregister(keyed_registrations.begin()->first);
 	}
 
 void Registry::Register(Modifiable* m, Receiver* r)
@@ -34,6 +38,15 @@ void Registry::Register(Modifiable* m, Receiver* r)
 	++m->num_receivers;
 	}
 
+void Registry::Register(Modifiable* m, uint64_t key, Receiver* r)
+	{
+	DBG_LOG(DBG_NOTIFIERS, "registering object %p key %" PRIu64 " for receiver %p",
+	        m, key, r);
+
+	keyed_registrations[m].insert({key, r});
+	++m->num_receivers;
+	}
+
 void Registry::Unregister(Modifiable* m, Receiver* r)
 	{
 	DBG_LOG(DBG_NOTIFIERS, "unregistering object %p from receiver %p", m, r);
@@ -50,6 +63,30 @@ void Registry::Unregister(Modifiable* m, Receiver* r)
 		}
 	}
 
+void Registry::Unregister(Modifiable* m, uint64_t key, Receiver* r)
+	{
+	DBG_LOG(DBG_NOTIFIERS, "unregistering object %p key %" PRIu64 " from receiver %p",
+	        m, key, r);
+
+	auto k = keyed_registrations.find(m);
+	if ( k == keyed_registrations.end() )
+		return;
+
+	auto x = k->second.equal_range(key);
+	for ( auto i = x.first; i != x.second; i++ )
+		{
+		if ( i->second == r )
+			{
+			--m->num_receivers;
+			k->second.erase(i);
+			break;
+			}
+		}
+
+	if ( k->second.empty() )
+		keyed_registrations.erase(k);
+	}
+
 void Registry::Unregister(Modifiable* m)
 	{
 	DBG_LOG(DBG_NOTIFIERS, "unregistering object %p from all notifiers", m);
@@ -59,6 +96,13 @@ void Registry::Unregister(Modifiable* m)
 		--i->first->num_receivers;
 
 	registrations.erase(x.first, x.second);
+
+	auto k = keyed_registrations.find(m);
+	if ( k != keyed_registrations.end() )
+		{
+		m->num_receivers -= k->second.size();
+		keyed_registrations.erase(k);
+		}
 	}
 
 void Registry::Modified(Modifiable* m)
@@ -68,6 +112,30 @@ void Registry::Modified(Modifiable* m)
 	auto x = registrations.equal_range(m);
 	for ( auto i = x.first; i != x.second; i++ )
 		i->second->Modified(m);
+
+	// Without an element to go by, everybody interested in one of them
+	// needs to take a look.
+	auto k = keyed_registrations.find(m);
+	if ( k != keyed_registrations.end() )
+		for ( auto& i : k->second )
+			i.second->Modified(m);
+	}
+
+void Registry::Modified(Modifiable* m, uint64_t key)
+	{
+	DBG_LOG(DBG_NOTIFIERS, "object %p key %" PRIu64 " has been modified", m, key);
+
+	auto x = registrations.equal_range(m);
+	for ( auto i = x.first; i != x.second; i++ )
+		i->second->Modified(m);
+
+	auto k = keyed_registrations.find(m);
+	if ( k == keyed_registrations.end() )
+		return;
+
+	auto y = k->second.equal_range(key);
+	for ( auto i = y.first; i != y.second; i++ )
+		i->second->Modified(m);
 	}
 
 void Registry::Terminate()
@@ -77,6 +145,10 @@ void Registry::Terminate()
 	for ( auto& r : registrations )
 		receivers.emplace(r.second);
 
+	for ( auto& k : keyed_registrations )
+		for ( auto& r : k.second )
+			receivers.emplace(r.second);
+
 	for ( auto& r : receivers )
 		r->Terminate();
 	}
@@ -52,6 +52,21 @@ public:
 	 */
 	void Register(Modifiable* m, Receiver* r);
 
+	/**
+	 * Registers a receiver to be informed when a particular element of
+	 * a modifiable object has changed, such as a table's entry for an
+	 * index.  The receiver gets notified also for modifications that
+	 * the object doesn't attribute to any element.
+	 *
+	 * @param m object to track.
+	 *
+	 * @param key hash of the element to track.  Elements with colliding
+	 * hashes lead to spurious, but harmless, notifications.
+	 *
+	 * @param r receiver to notify on changes.
+	 */
+	void Register(Modifiable* m, uint64_t key, Receiver* r);
+
 	/**
 	 * Cancels a receiver's request to be informed about an object's
 	 * modification. The arguments to the method must match what was
@@ -63,6 +78,13 @@ public:
 	 */
 	void Unregister(Modifiable* m, Receiver* Receiver);
 
+	/**
+	 * Cancels a receiver's request to be informed about modifications
+	 * of an object's element. The arguments to the method must match
+	 * what was originally registered.
+	 */
+	void Unregister(Modifiable* m, uint64_t key, Receiver* r);
+
 	/**
 	 * Cancels any active receiver requests to be informed about a
 	 * partilar object's modifications.
@@ -84,8 +106,16 @@ private:
 	// Will be called from the object itself.
 	void Modified(Modifiable* m);
 
+	// Inform the receivers of a modification to one of the object's
+	// elements, i.e., those registered for the object as a whole and
+	// those registered for the element.
+	void Modified(Modifiable* m, uint64_t key);
+
 	typedef std::unordered_multimap<Modifiable*, Receiver*> ModifiableMap;
 	ModifiableMap registrations;
+
+	typedef std::unordered_multimap<uint64_t, Receiver*> KeyMap;
+	std::unordered_map<Modifiable*, KeyMap> keyed_registrations;
 };
 
 /**
@@ -109,6 +139,17 @@ public:
 			registry.Modified(this);
 		}
 
+	/**
+	 * Signals a modification of the object's element with the given
+	 * hash, which only the receivers interested in the object as a whole
+	 * or in that element get to see.
+	 */
+	void Modified(uint64_t key)
+		{
+		if ( num_receivers )
+			registry.Modified(this, key);
+		}
+
 protected:
 	friend class Registry;
 
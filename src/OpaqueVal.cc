@@ -8,6 +8,7 @@
 #include <broker/error.hh>
 
 #include "zeek/CompHash.h"
+#include "zeek/IPAddr.h"
 #include "zeek/NetVar.h"
 #include "zeek/Reporter.h"
 #include "zeek/Scope.h"
@@ -15,6 +16,7 @@
 #include "zeek/Var.h"
 #include "zeek/probabilistic/BloomFilter.h"
 #include "zeek/probabilistic/CardinalityCounter.h"
+#include "zeek/probabilistic/CountMinSketch.h"
 
 namespace zeek {
 
@@ -224,7 +226,7 @@ MD5Val::MD5Val() : HashVal(md5_type)
 MD5Val::~MD5Val()
 	{
 	if ( IsValid() )
-		EVP_MD_CTX_free(ctx);
+		detail::hash_free(ctx);
 	}
 
 void HashVal::digest_one(EVP_MD_CTX* h, const Val* v)
@@ -364,7 +366,7 @@ SHA1Val::SHA1Val() : HashVal(sha1_type)
 SHA1Val::~SHA1Val()
 	{
 	if ( IsValid() )
-		EVP_MD_CTX_free(ctx);
+		detail::hash_free(ctx);
 	}
 
 ValPtr SHA1Val::DoClone(CloneState* state)
@@ -487,7 +489,7 @@ SHA256Val::SHA256Val() : HashVal(sha256_type)
 SHA256Val::~SHA256Val()
 	{
 	if ( IsValid() )
-		EVP_MD_CTX_free(ctx);
+		detail::hash_free(ctx);
 	}
 
 ValPtr SHA256Val::DoClone(CloneState* state)
@@ -740,14 +742,73 @@ bool BloomFilterVal::Typify(TypePtr arg_type)
 	return true;
 	}
 
+// Puts the bytes of the key that the CompositeHash would build for a value
+// of the given type into *key*, without allocating a HashKey, and returns
+// their number.  The value's type must match.  Non-singleton keys get
+// written into buf, which needs to hold CompositeHash::MAX_FIXED_KEY_SIZE
+// bytes.  Returns 0 for types that need the full CompositeHash, or if the
+// value doesn't fit the fixed layout.
+static int direct_hash_key(const detail::CompositeHash* hash, const Type* t,
+                           const Val& v, char* buf, const void** key)
+	{
+	if ( t->Tag() == TYPE_RECORD )
+		{
+		*key = buf;
+		return hash->HasFixedLayout() ? hash->FixedHashKey(v, buf) : 0;
+		}
+
+	switch ( t->InternalType() ) {
+	case TYPE_INTERNAL_INT:
+	case TYPE_INTERNAL_UNSIGNED:
+		*reinterpret_cast<bro_int_t*>(buf) = v.ForceAsInt();
+		*key = buf;
+		return sizeof(bro_int_t);
+
+	case TYPE_INTERNAL_DOUBLE:
+		*reinterpret_cast<double*>(buf) = v.InternalDouble();
+		*key = buf;
+		return sizeof(double);
+
+	case TYPE_INTERNAL_ADDR:
+		v.AsAddr().CopyIPv6(reinterpret_cast<uint32_t*>(buf));
+		*key = buf;
+		return 4 * sizeof(uint32_t);
+
+	case TYPE_INTERNAL_STRING:
+		// MakeHashKey() keys strings by their bytes, so there's no
+		// copy to make.  Empty strings take the regular path, since a
+		// zero size means no direct key.
+		*key = v.AsString()->Bytes();
+		return v.AsString()->Len();
+
+	default:
+		return 0;
+	}
+	}
+
 void BloomFilterVal::Add(const Val* val)
 	{
+	alignas(bro_int_t) char buf[detail::CompositeHash::MAX_FIXED_KEY_SIZE];
+	const void* k;
+
+	if ( int n = direct_hash_key(hash, type.get(), *val, buf, &k) )
+		{
+		bloom_filter->Add(k, n);
+		return;
+		}
+
 	auto key = hash->MakeHashKey(*val, true);
 	bloom_filter->Add(key.get());
 	}
 
 size_t BloomFilterVal::Count(const Val* val) const
 	{
+	alignas(bro_int_t) char buf[detail::CompositeHash::MAX_FIXED_KEY_SIZE];
+	const void* k;
+
+	if ( int n = direct_hash_key(hash, type.get(), *val, buf, &k) )
+		return bloom_filter->Count(k, n);
+
 	auto key = hash->MakeHashKey(*val, true);
 	size_t cnt = bloom_filter->Count(key.get());
 	return cnt;
@@ -954,20 +1015,219 @@ bool CardinalityVal::DoUnserialize(const broker::data& data)
 	return true;
 	}
 
+CountMinSketchVal::CountMinSketchVal() : OpaqueVal(countminsketch_type)
+	{
+	cms = nullptr;
+	hash = nullptr;
+	}
+
+CountMinSketchVal::CountMinSketchVal(probabilistic::detail::CountMinSketch* arg_cms)
+	: OpaqueVal(countminsketch_type)
+	{
+	cms = arg_cms;
+	hash = nullptr;
+	}
+
+CountMinSketchVal::~CountMinSketchVal()
+	{
+	delete cms;
+	delete hash;
+	}
+
+ValPtr CountMinSketchVal::DoClone(CloneState* state)
+	{
+	auto v = make_intrusive<CountMinSketchVal>(new probabilistic::detail::CountMinSketch(*cms));
+
+	if ( type )
+		v->Typify(type);
+
+	return state->NewClone(this, std::move(v));
+	}
+
+bool CountMinSketchVal::Typify(TypePtr arg_type)
+	{
+	if ( type )
+		return false;
+
+	type = std::move(arg_type);
+
+	auto tl = make_intrusive<TypeList>(type);
+	tl->Append(type);
+	hash = new detail::CompositeHash(std::move(tl));
+
+	return true;
+	}
+
+void CountMinSketchVal::Add(const Val* val, uint64_t n)
+	{
+	alignas(bro_int_t) char buf[detail::CompositeHash::MAX_FIXED_KEY_SIZE];
+	const void* k;
+
+	if ( int len = direct_hash_key(hash, type.get(), *val, buf, &k) )
+		{
+		cms->Add(k, len, n);
+		return;
+		}
+
+	auto key = hash->MakeHashKey(*val, true);
+	cms->Add(key->Key(), key->Size(), n);
+	}
+
+uint64_t CountMinSketchVal::Estimate(const Val* val) const
+	{
+	alignas(bro_int_t) char buf[detail::CompositeHash::MAX_FIXED_KEY_SIZE];
+	const void* k;
+
+	if ( int len = direct_hash_key(hash, type.get(), *val, buf, &k) )
+		return cms->Estimate(k, len);
+
+	auto key = hash->MakeHashKey(*val, true);
+	return cms->Estimate(key->Key(), key->Size());
+	}
+
+CountMinSketchValPtr CountMinSketchVal::Merge(const CountMinSketchVal* x,
+                                              const CountMinSketchVal* y)
+	{
+	if ( x->Type() && // any one 0 is ok here
+	     y->Type() &&
+	     ! same_type(x->Type(), y->Type()) )
+		{
+		reporter->Error("cannot merge count-min sketches with different types");
+		return nullptr;
+		}
+
+	auto copy = new probabilistic::detail::CountMinSketch(*x->cms);
+
+	if ( ! copy->Merge(y->cms) )
+		{
+		delete copy;
+		return nullptr;
+		}
+
+	auto merged = make_intrusive<CountMinSketchVal>(copy);
+	const auto& t = x->Type() ? x->Type() : y->Type();
+
+	if ( t && ! merged->Typify(t) )
+		{
+		reporter->Error("failed to set type on merged count-min sketch");
+		return nullptr;
+		}
+
+	return merged;
+	}
+
+IMPLEMENT_OPAQUE_VALUE(CountMinSketchVal)
+
+broker::expected<broker::data> CountMinSketchVal::DoSerialize() const
+	{
+	broker::vector d;
+
+	if ( type )
+		{
+		auto t = SerializeType(type);
+		if ( ! t )
+			return broker::ec::invalid_data;
+
+		d.emplace_back(std::move(*t));
+		}
+	else
+		d.emplace_back(broker::none());
+
+	auto cs = cms->Serialize();
+	if ( ! cs )
+		return broker::ec::invalid_data;
+
+	d.emplace_back(*cs);
+	return {std::move(d)};
+	}
+
+bool CountMinSketchVal::DoUnserialize(const broker::data& data)
+	{
+	auto v = caf::get_if<broker::vector>(&data);
+
+	if ( ! (v && v->size() == 2) )
+		return false;
+
+	auto no_type = caf::get_if<broker::none>(&(*v)[0]);
+	if ( ! no_type )
+		{
+		auto t = UnserializeType((*v)[0]);
+
+		if ( ! (t && Typify(std::move(t))) )
+			return false;
+		}
+
+	auto cu = probabilistic::detail::CountMinSketch::Unserialize((*v)[1]);
+	if ( ! cu )
+		return false;
+
+	cms = cu.release();
+	return true;
+	}
+
 ParaglobVal::ParaglobVal(std::unique_ptr<paraglob::Paraglob> p)
 : OpaqueVal(paraglob_type)
 	{
 	this->internal_paraglob = std::move(p);
 	}
 
-VectorValPtr ParaglobVal::Get(StringVal* &pattern)
+size_t ParaglobVal::cache_size = 0;
+
+const std::vector<std::string>& ParaglobVal::Match(const std::string& input)
+	{
+	if ( ! cache_size )
+		{
+		uncached = internal_paraglob->get(input);
+		return uncached;
+		}
+
+	auto it = cache.find(input);
+
+	if ( it != cache.end() )
+		return it->second;
+
+	if ( cache.size() >= cache_size )
+		cache.clear();
+
+	return cache.emplace(input, internal_paraglob->get(input)).first->second;
+	}
+
+VectorValPtr ParaglobVal::MakeResult(const std::vector<std::string>& matches) const
 	{
 	auto rval = make_intrusive<VectorVal>(id::string_vec);
-	std::string string_pattern (reinterpret_cast<const char*>(pattern->Bytes()), pattern->Len());
 
-	std::vector<std::string> matches = this->internal_paraglob->get(string_pattern);
 	for ( size_t i = 0; i < matches.size(); i++ )
-		rval->Assign(i, make_intrusive<StringVal>(matches.at(i)));
+		rval->Assign(i, make_intrusive<StringVal>(matches[i]));
+
+	return rval;
+	}
+
+VectorValPtr ParaglobVal::Get(StringVal* &pattern)
+	{
+	std::string string_pattern (reinterpret_cast<const char*>(pattern->Bytes()), pattern->Len());
+	return MakeResult(Match(string_pattern));
+	}
+
+VectorValPtr ParaglobVal::GetBatch(const VectorVal* inputs)
+	{
+	static auto string_vec_vec = id::find_type<VectorType>("string_vec_vec");
+	auto rval = make_intrusive<VectorVal>(string_vec_vec);
+	auto n = inputs->Size();
+
+	for ( unsigned int i = 0; i < n; ++i )
+		{
+		const auto& v = inputs->At(i);
+
+		if ( ! v )
+			{
+			rval->Assign(i, make_intrusive<VectorVal>(id::string_vec));
+			continue;
+			}
+
+		auto s = v->AsString();
+		std::string input(reinterpret_cast<const char*>(s->Bytes()), s->Len());
+		rval->Assign(i, MakeResult(Match(input)));
+		}
 
 	return rval;
 	}
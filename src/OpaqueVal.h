@@ -3,6 +3,7 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
+#include <unordered_map>
 #include <broker/expected.hh>
 #include <paraglob/paraglob.h>
 
@@ -15,6 +16,7 @@ namespace broker { class data; }
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(BloomFilter, zeek, probabilistic);
 ZEEK_FORWARD_DECLARE_NAMESPACED(CardinalityCounter, zeek, probabilistic, detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(CountMinSketch, zeek, probabilistic, detail);
 
 namespace zeek {
 
@@ -24,6 +26,9 @@ using OpaqueValPtr = IntrusivePtr<OpaqueVal>;
 class BloomFilterVal;
 using BloomFilterValPtr = IntrusivePtr<BloomFilterVal>;
 
+class CountMinSketchVal;
+using CountMinSketchValPtr = IntrusivePtr<CountMinSketchVal>;
+
 /**
   * Singleton that registers all available all available types of opaque
   * values. This faciliates their serialization into Broker values.
@@ -364,20 +369,82 @@ private:
 	probabilistic::detail::CardinalityCounter* c;
 };
 
+class CountMinSketchVal : public OpaqueVal {
+public:
+	explicit CountMinSketchVal(probabilistic::detail::CountMinSketch* cms);
+	~CountMinSketchVal() override;
+
+	ValPtr DoClone(CloneState* state) override;
+
+	const TypePtr& Type() const
+		{ return type; }
+
+	bool Typify(TypePtr type);
+
+	void Add(const Val* val, uint64_t n);
+	uint64_t Estimate(const Val* val) const;
+
+	probabilistic::detail::CountMinSketch* Get()	{ return cms; };
+
+	static CountMinSketchValPtr Merge(const CountMinSketchVal* x,
+	                                  const CountMinSketchVal* y);
+
+protected:
+	CountMinSketchVal();
+
+	DECLARE_OPAQUE_VALUE(CountMinSketchVal)
+private:
+	// Disable.
+	CountMinSketchVal(const CountMinSketchVal&);
+	CountMinSketchVal& operator=(const CountMinSketchVal&);
+
+	TypePtr type;
+	detail::CompositeHash* hash;
+	probabilistic::detail::CountMinSketch* cms;
+};
+
 class ParaglobVal : public OpaqueVal {
 public:
 	explicit ParaglobVal(std::unique_ptr<paraglob::Paraglob> p);
 	VectorValPtr Get(StringVal* &pattern);
+
+	/**
+	 * Matches several strings at once.
+	 *
+	 * @param inputs  A vector of strings.
+	 *
+	 * @return  A vector holding the patterns that match each input.
+	 */
+	VectorValPtr GetBatch(const VectorVal* inputs);
+
 	ValPtr DoClone(CloneState* state) override;
 	bool operator==(const ParaglobVal& other) const;
 
+	/**
+	 * Sets how many match results every paraglob keeps for inputs it
+	 * has seen before.  Zero disables the caching.
+	 */
+	static void SetCacheSize(size_t n)	{ cache_size = n; }
+
 protected:
 	ParaglobVal() : OpaqueVal(paraglob_type) {}
 
 	DECLARE_OPAQUE_VALUE(ParaglobVal)
 
 private:
+	// Returns the patterns matching an input, from the cache if possible.
+	const std::vector<std::string>& Match(const std::string& input);
+
+	VectorValPtr MakeResult(const std::vector<std::string>& matches) const;
+
 	std::unique_ptr<paraglob::Paraglob> internal_paraglob;
+
+	// Once full, the cache starts over, which is cheaper than keeping
+	// track of what's been used recently and still works for the
+	// few inputs that dominate typical traffic.
+	std::unordered_map<std::string, std::vector<std::string>> cache;
+	std::vector<std::string> uncached;
+	static size_t cache_size;
 };
 
 } // namespace zeek
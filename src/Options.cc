@@ -11,6 +11,7 @@
 #endif
 
 #include <algorithm>
+#include <cstdlib>
 #include <sstream>
 
 #include "zeek/bsd-getopt-long.h"
@@ -39,6 +40,7 @@ void Options::filter_supervised_node_options()
 	ignore_checksums = og.ignore_checksums;
 	use_watchdog = og.use_watchdog;
 	pseudo_realtime = og.pseudo_realtime;
+	reassembly_memory_limit = og.reassembly_memory_limit;
 	dns_mode = og.dns_mode;
 
 	bare_mode = og.bare_mode;
@@ -87,7 +89,7 @@ void usage(const char* prog, int code)
 	fprintf(stderr, "    -e|--exec <zeek code>          | augment loaded scripts by given code\n");
 	fprintf(stderr, "    -f|--filter <filter>           | tcpdump filter\n");
 	fprintf(stderr, "    -h|--help                      | command line help\n");
-	fprintf(stderr, "    -i|--iface <interface>         | read from given interface (only one allowed)\n");
+	fprintf(stderr, "    -i|--iface <interface>         | read from given interface (repeatable)\n");
 	fprintf(stderr, "    -p|--prefix <prefix>           | add given prefix to Zeek script file resolution\n");
 	fprintf(stderr, "    -r|--readfile <readfile>       | read from given tcpdump file (only one allowed, pass '-' as the filename to read from stdin)\n");
 	fprintf(stderr, "    -s|--rulefile <rulefile>       | read rules from given file\n");
@@ -117,6 +119,10 @@ void usage(const char* prog, int code)
 	fprintf(stderr, "    -M|--mem-profile               | record heap [perftools]\n");
 #endif
 	fprintf(stderr, "    --pseudo-realtime[=<speedup>]  | enable pseudo-realtime for performance evaluation (default 1)\n");
+	fprintf(stderr, "    --reassembly-memory-limit <bytes> | limit the data buffered by all reassemblers together\n");
+	fprintf(stderr, "    --profile-scripts[=<file>]     | profile script execution to given file (default script-profile.log)\n");
+	fprintf(stderr, "    --dfa-cache <file>             | precompile pattern DFAs at startup, caching them in given file\n");
+	fprintf(stderr, "    --parallel <num>               | split the trace file's flows across given number of processes\n");
 	fprintf(stderr, "    -j|--jobs                      | enable supervisor mode\n");
 
 #ifdef USE_IDMEF
@@ -134,6 +140,7 @@ void usage(const char* prog, int code)
 	fprintf(stderr, "    $ZEEK_PROFILER_FILE            | Output file for script execution statistics (not set)\n");
 	fprintf(stderr, "    $ZEEK_DISABLE_ZEEKYGEN         | Disable Zeekygen documentation support (%s)\n", util::zeekenv("ZEEK_DISABLE_ZEEKYGEN") ? "set" : "not set");
 	fprintf(stderr, "    $ZEEK_DNS_RESOLVER             | IPv4/IPv6 address of DNS resolver to use (%s)\n", util::zeekenv("ZEEK_DNS_RESOLVER") ? util::zeekenv("ZEEK_DNS_RESOLVER") : "not set, will use first IPv4 address from /etc/resolv.conf");
+	fprintf(stderr, "    $ZEEK_TIMER_MGR                | Timer manager implementation, 'pq' or 'wheel' (%s)\n", util::zeekenv("ZEEK_TIMER_MGR") ? util::zeekenv("ZEEK_TIMER_MGR") : "pq");
 	fprintf(stderr, "    $ZEEK_DEBUG_LOG_STDERR         | Use stderr for debug logs generated via the -B flag");
 
 	fprintf(stderr, "\n");
@@ -272,6 +279,10 @@ Options parse_cmdline(int argc, char** argv)
 #endif
 
 		{"pseudo-realtime",	optional_argument, nullptr,	'E'},
+		{"reassembly-memory-limit",	required_argument, nullptr,	'R'},
+		{"profile-scripts",	optional_argument, nullptr,	'y'},
+		{"dfa-cache",	required_argument, nullptr,	'k'},
+		{"parallel",	required_argument, nullptr,	'L'},
 		{"jobs",	optional_argument, nullptr,	'j'},
 		{"test",		no_argument,		nullptr,	'#'},
 
@@ -317,19 +328,16 @@ Options parse_cmdline(int argc, char** argv)
 			rval.print_usage = true;
 			break;
 		case 'i':
-			if ( rval.interface )
-				{
-				fprintf(stderr, "ERROR: Only a single interface option (-i) is allowed.\n");
-				exit(1);
-				}
-
 			if ( rval.pcap_file )
 				{
 				fprintf(stderr, "ERROR: Using -i is not allow when reading a pcap file.\n");
 				exit(1);
 				}
 
-			rval.interface = optarg;
+			if ( rval.interface )
+				*rval.interface += std::string(" ") + optarg;
+			else
+				rval.interface = optarg;
 			break;
 		case 'j':
 			rval.supervisor_mode = true;
@@ -384,6 +392,38 @@ Options parse_cmdline(int argc, char** argv)
 			if ( optarg )
 				rval.pseudo_realtime = atof(optarg);
 			break;
+		case 'R':
+			{
+			char* end;
+			rval.reassembly_memory_limit = strtoull(optarg, &end, 10);
+
+			if ( end == optarg || *end )
+				{
+				fprintf(stderr, "invalid reassembly memory limit: %s\n", optarg);
+				usage(zargs[0], 1);
+				}
+			}
+			break;
+		case 'y':
+			rval.script_profile_file = optarg ? optarg : "script-profile.log";
+			break;
+		case 'k':
+			rval.dfa_cache_file = optarg;
+			break;
+		case 'L':
+			{
+			char* end;
+			long n = strtol(optarg, &end, 10);
+
+			if ( end == optarg || *end || n < 1 )
+				{
+				fprintf(stderr, "invalid number of processes: %s\n", optarg);
+				usage(zargs[0], 1);
+				}
+
+			rval.parallel = n;
+			}
+			break;
 		case 'F':
 			if ( rval.dns_mode != detail::DNS_DEFAULT )
 				usage(zargs[0], 1);
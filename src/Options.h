@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <vector>
@@ -45,6 +46,10 @@ struct Options {
 	bool ignore_checksums = false;
 	bool use_watchdog = false;
 	double pseudo_realtime = 0;
+	std::optional<uint64_t> reassembly_memory_limit;
+	std::optional<std::string> script_profile_file;
+	std::optional<std::string> dfa_cache_file;
+	std::optional<int> parallel;
 	detail::DNS_MgrMode dns_mode = detail::DNS_DEFAULT;
 
 	bool supervisor_mode = false;
@@ -0,0 +1,174 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/PacketHeader.h"
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <algorithm>
+
+#include <broker/error.hh>
+
+#include "zeek/IP.h"
+#include "zeek/Var.h"
+
+namespace zeek {
+
+// The fixed part of a transport-layer header, which is all that a pkt_hdr
+// record covers.
+static size_t transport_hdr_len(int proto)
+	{
+	switch ( proto ) {
+	case IPPROTO_TCP:
+		return sizeof(struct tcphdr);
+	case IPPROTO_UDP:
+		return sizeof(struct udphdr);
+	case IPPROTO_ICMP:
+	case IPPROTO_ICMPV6:
+		return 8;
+	default:
+		return 0;
+	}
+	}
+
+PacketHeaderVal::PacketHeaderVal() : OpaqueVal(packet_header_type)
+	{
+	}
+
+PacketHeaderVal::PacketHeaderVal(const IP_Hdr& arg_ip) : OpaqueVal(packet_header_type)
+	{
+	size_t hdr_len = arg_ip.HdrLen();
+	size_t l4_len = std::min(transport_hdr_len(arg_ip.NextProto()),
+	                         static_cast<size_t>(arg_ip.PayloadLen()));
+
+	// What the packet lacks of the transport-layer header reads as
+	// zeros, as the resize leaves it.
+	auto start = arg_ip.IP4_Hdr() ? reinterpret_cast<const u_char*>(arg_ip.IP4_Hdr()) :
+		reinterpret_cast<const u_char*>(arg_ip.IP6_Hdr());
+	data.assign(start, start + hdr_len + l4_len);
+	data.resize(hdr_len + transport_hdr_len(arg_ip.NextProto()));
+
+	Parse();
+	}
+
+PacketHeaderVal::~PacketHeaderVal()
+	{
+	}
+
+bool PacketHeaderVal::Parse()
+	{
+	ip.reset();
+
+	if ( data.size() < sizeof(struct ip) )
+		return false;
+
+	auto ip4 = reinterpret_cast<const struct ip*>(data.data());
+
+	if ( ip4->ip_v == 4 )
+		{
+		if ( static_cast<size_t>(ip4->ip_hl) * 4 > data.size() )
+			return false;
+
+		ip = std::make_unique<IP_Hdr>(ip4, false);
+		}
+
+	else if ( ip4->ip_v == 6 && data.size() >= sizeof(struct ip6_hdr) )
+		{
+		auto ip6 = reinterpret_cast<const struct ip6_hdr*>(data.data());
+		ip = std::make_unique<IP_Hdr>(ip6, false, static_cast<int>(data.size()));
+
+		if ( ip->HdrLen() > data.size() )
+			{
+			ip.reset();
+			return false;
+			}
+		}
+
+	else
+		return false;
+
+	// Unserialized data may lack the transport-layer header.
+	data.resize(std::max(data.size(), ip->HdrLen() + transport_hdr_len(ip->NextProto())));
+	return true;
+	}
+
+const RecordValPtr& PacketHeaderVal::ToPktHdrVal()
+	{
+	if ( ! pkt_hdr )
+		{
+		static auto pkt_hdr_type = id::find_type<RecordType>("pkt_hdr");
+		pkt_hdr = ip ? ip->ToPktHdrVal() : make_intrusive<RecordVal>(pkt_hdr_type);
+		}
+
+	return pkt_hdr;
+	}
+
+bool PacketHeaderVal::Ports(uint32_t* src, uint32_t* dst, TransportProto* proto) const
+	{
+	if ( ! ip )
+		return false;
+
+	switch ( ip->NextProto() ) {
+	case IPPROTO_TCP:
+		{
+		auto tp = reinterpret_cast<const struct tcphdr*>(ip->Payload());
+		*src = ntohs(tp->th_sport);
+		*dst = ntohs(tp->th_dport);
+		*proto = TRANSPORT_TCP;
+		return true;
+		}
+
+	case IPPROTO_UDP:
+		{
+		auto up = reinterpret_cast<const struct udphdr*>(ip->Payload());
+		*src = ntohs(up->uh_sport);
+		*dst = ntohs(up->uh_dport);
+		*proto = TRANSPORT_UDP;
+		return true;
+		}
+
+	default:
+		return false;
+	}
+	}
+
+uint32_t PacketHeaderVal::TCPFlags() const
+	{
+	if ( ! ip || ip->NextProto() != IPPROTO_TCP )
+		return 0;
+
+	return reinterpret_cast<const struct tcphdr*>(ip->Payload())->th_flags;
+	}
+
+ValPtr PacketHeaderVal::DoClone(CloneState* state)
+	{
+	// The headers are immutable, so clones can share them.
+	return {NewRef{}, this};
+	}
+
+IMPLEMENT_OPAQUE_VALUE(PacketHeaderVal)
+
+broker::expected<broker::data> PacketHeaderVal::DoSerialize() const
+	{
+	return {broker::vector{std::string(data.begin(), data.end())}};
+	}
+
+bool PacketHeaderVal::DoUnserialize(const broker::data& data)
+	{
+	auto v = caf::get_if<broker::vector>(&data);
+
+	if ( ! (v && v->size() == 1) )
+		return false;
+
+	auto bytes = caf::get_if<std::string>(&(*v)[0]);
+
+	if ( ! bytes )
+		return false;
+
+	this->data.assign(bytes->begin(), bytes->end());
+	return Parse();
+	}
+
+} // namespace zeek
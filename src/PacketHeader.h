@@ -0,0 +1,74 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A view on a packet's IP and transport-layer headers that per-packet
+// event handlers can query field by field, instead of getting all of the
+// headers converted into a pkt_hdr record upfront.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <memory>
+#include <vector>
+
+#include "zeek/OpaqueVal.h"
+
+ZEEK_FORWARD_DECLARE_NAMESPACED(IP_Hdr, zeek);
+
+namespace zeek {
+
+/**
+ * A copy of a packet's IP header, including any IPv6 extension headers,
+ * and of the fixed part of its transport-layer header.  A \c pkt_hdr
+ * record gets built only when asked for, and just once.
+ */
+class PacketHeaderVal : public OpaqueVal {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param ip  The packet's IP header, which must be followed by the
+	 * packet's payload.
+	 */
+	explicit PacketHeaderVal(const IP_Hdr& ip);
+	~PacketHeaderVal() override;
+
+	/**
+	 * Returns the headers, or null for an instance that failed to
+	 * unserialize.
+	 */
+	const IP_Hdr* IP() const	{ return ip.get(); }
+
+	/**
+	 * Returns the headers as a \c pkt_hdr record, building it on first
+	 * use.
+	 */
+	const RecordValPtr& ToPktHdrVal();
+
+	/**
+	 * Returns the TCP or UDP source and destination ports through the
+	 * arguments, or false if the packet has neither.
+	 */
+	bool Ports(uint32_t* src, uint32_t* dst, TransportProto* proto) const;
+
+	/**
+	 * Returns the TCP header's flags, or zero if the packet isn't TCP.
+	 */
+	uint32_t TCPFlags() const;
+
+	ValPtr DoClone(CloneState* state) override;
+
+protected:
+	PacketHeaderVal();
+
+	DECLARE_OPAQUE_VALUE(PacketHeaderVal)
+
+private:
+	// Sets up ip over the copied headers.
+	bool Parse();
+
+	std::vector<u_char> data;
+	std::unique_ptr<IP_Hdr> ip;
+	RecordValPtr pkt_hdr;	// Built by ToPktHdrVal().
+};
+
+} // namespace zeek
@@ -0,0 +1,264 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/ParallelReplay.h"
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "zeek/IP.h"
+#include "zeek/IPAddr.h"
+#include "zeek/util.h"
+
+namespace zeek::detail {
+
+int num_shards = 1;
+int shard_index = 0;
+
+static const char* shard_tag = ".shard";
+
+// Returns the timestamp that an ASCII log line starts with, in either the
+// TSV or the JSON format.  Lines without one sort first.
+static double line_ts(const std::string& line)
+	{
+	const char* s = line.c_str();
+
+	if ( strncmp(s, "{\"ts\":", 6) == 0 )
+		s += 6;
+
+	return strtod(s, nullptr);
+	}
+
+// If the file name is that of a shard's log, returns its base name.
+static bool shard_log_base(const std::string& name, const std::string& ext,
+                           std::string* base)
+	{
+	auto pos = name.rfind(shard_tag);
+
+	if ( pos == std::string::npos || pos == 0 )
+		return false;
+
+	auto i = pos + strlen(shard_tag);
+	auto digits = i;
+
+	while ( i < name.size() && isdigit(name[i]) )
+		++i;
+
+	if ( i == digits || name.compare(i, std::string::npos, "." + ext) != 0 )
+		return false;
+
+	*base = name.substr(0, pos);
+	return true;
+	}
+
+// Merges the shards' versions of a log into one.  The header comes from
+// the first shard that has the log, and so does the trailing "#close".
+static void merge_log(const std::string& base, const std::string& ext, int n)
+	{
+	std::vector<std::ifstream> ins(n);
+	std::vector<std::string> lines(n);
+	std::vector<std::string> footer;
+	std::string target = base + "." + ext;
+	std::ofstream out(target);
+
+	if ( ! out )
+		{
+		fprintf(stderr, "cannot write %s: %s\n", target.c_str(), strerror(errno));
+		return;
+		}
+
+	using item = std::pair<double, int>;
+	std::priority_queue<item, std::vector<item>, std::greater<item>> next;
+	int first = -1;
+
+	// Reads the next data line of a shard, collecting the first shard's
+	// comments after its header on the way.
+	auto advance = [&](int i)
+		{
+		while ( std::getline(ins[i], lines[i]) )
+			{
+			if ( lines[i].empty() || lines[i][0] != '#' )
+				{
+				next.emplace(line_ts(lines[i]), i);
+				return;
+				}
+
+			if ( i == first )
+				footer.push_back(lines[i]);
+			}
+		};
+
+	for ( int i = 0; i < n; ++i )
+		{
+		std::string path = base + shard_tag + std::to_string(i) + "." + ext;
+		ins[i].open(path);
+
+		if ( ! ins[i] )
+			continue;
+
+		if ( first < 0 )
+			first = i;
+
+		// Keep the header lines of the first shard together, ahead of
+		// any data.
+		if ( i == first )
+			{
+			std::string line;
+
+			while ( ins[i].peek() == '#' && std::getline(ins[i], line) )
+				out << line << '\n';
+			}
+
+		advance(i);
+		unlink(path.c_str());
+		}
+
+	while ( ! next.empty() )
+		{
+		int i = next.top().second;
+		next.pop();
+		out << lines[i] << '\n';
+		advance(i);
+		}
+
+	for ( const auto& line : footer )
+		out << line << '\n';
+	}
+
+static void merge_logs(const std::string& ext, int n)
+	{
+	DIR* dir = opendir(".");
+
+	if ( ! dir )
+		{
+		fprintf(stderr, "cannot read log directory: %s\n", strerror(errno));
+		return;
+		}
+
+	std::set<std::string> bases;
+	std::string base;
+
+	while ( auto* e = readdir(dir) )
+		if ( shard_log_base(e->d_name, ext, &base) )
+			bases.insert(base);
+
+	closedir(dir);
+
+	for ( const auto& b : bases )
+		merge_log(b, ext, n);
+	}
+
+void run_parallel(int n)
+	{
+	const char* env = util::zeekenv("ZEEK_LOG_SUFFIX");
+	std::string ext = env ? env : "log";
+	std::vector<pid_t> children;
+
+	for ( int i = 0; i < n; ++i )
+		{
+		pid_t pid = fork();
+
+		if ( pid < 0 )
+			{
+			fprintf(stderr, "cannot fork shard: %s\n", strerror(errno));
+			exit(1);
+			}
+
+		if ( pid == 0 )
+			{
+			num_shards = n;
+			shard_index = i;
+
+			auto suffix = util::fmt("%s%d.%s", shard_tag + 1, i, ext.c_str());
+			setenv("ZEEK_LOG_SUFFIX", suffix, 1);
+			return;
+			}
+
+		children.push_back(pid);
+		}
+
+	int rval = 0;
+
+	for ( auto pid : children )
+		{
+		int status;
+
+		while ( waitpid(pid, &status, 0) < 0 )
+			{
+			if ( errno != EINTR )
+				{
+				status = 1;
+				break;
+				}
+			}
+
+		if ( ! WIFEXITED(status) || WEXITSTATUS(status) != 0 )
+			rval = 1;
+		}
+
+	merge_logs(ext, n);
+	exit(rval);
+	}
+
+int flow_shard(const IP_Hdr* ip, const uint8_t* payload, int len)
+	{
+	uint32_t a[4], b[4];
+	ip->SrcAddr().CopyIPv6(a);
+	ip->DstAddr().CopyIPv6(b);
+
+	uint8_t proto = ip->NextProto();
+	uint16_t pa = 0, pb = 0;
+
+	if ( (proto == IPPROTO_TCP || proto == IPPROTO_UDP || proto == IPPROTO_SCTP) &&
+	     len >= 4 )
+		{
+		memcpy(&pa, payload, sizeof(pa));
+		memcpy(&pb, payload + 2, sizeof(pb));
+		}
+
+	// Order the endpoints so that both directions hash alike.
+	int c = memcmp(a, b, sizeof(a));
+
+	if ( c > 0 || (c == 0 && pa > pb) )
+		{
+		std::swap(a, b);
+		std::swap(pa, pb);
+		}
+
+	uint8_t key[sizeof(a) + sizeof(b) + sizeof(pa) + sizeof(pb) + 1];
+	uint8_t* k = key;
+	memcpy(k, a, sizeof(a));
+	k += sizeof(a);
+	memcpy(k, b, sizeof(b));
+	k += sizeof(b);
+	memcpy(k, &pa, sizeof(pa));
+	k += sizeof(pa);
+	memcpy(k, &pb, sizeof(pb));
+	k += sizeof(pb);
+	*k = proto;
+
+	// FNV-1a, which is the same for all processes, unlike the keyed
+	// hashes.
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for ( auto byte : key )
+		h = (h ^ byte) * 0x100000001b3ULL;
+
+	return h % num_shards;
+	}
+
+} // namespace zeek::detail
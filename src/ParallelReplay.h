@@ -0,0 +1,44 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Processing of a trace file by several processes at once, each analyzing
+// the flows that a symmetric hash of their 5-tuples assigns to it.
+
+#pragma once
+
+#include <cstdint>
+
+namespace zeek {
+
+class IP_Hdr;
+
+namespace detail {
+
+// The number of processes analyzing the trace, and the one of this
+// process.  A single process analyzes all packets.
+extern int num_shards;
+extern int shard_index;
+
+/**
+ * Forks one process per shard.  Each child returns, with its shard set and
+ * its ASCII logs written with a ".shard<index>" suffix.  The parent waits
+ * for all children, merges their logs in timestamp order, and exits.
+ *
+ * @param n  The number of shards, at least 2.
+ */
+extern void run_parallel(int n);
+
+/**
+ * Returns the shard that a packet's flow belongs to.  Both directions of a
+ * flow map to the same shard, as do all fragments of a datagram once
+ * reassembled.
+ *
+ * @param ip  The packet's IP header.
+ *
+ * @param payload  The data following the IP header(s).
+ *
+ * @param len  The length of *payload*.
+ */
+extern int flow_shard(const IP_Hdr* ip, const uint8_t* payload, int len);
+
+} // namespace detail
+} // namespace zeek
@@ -0,0 +1,78 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/PipelineStats.h"
+
+#include <cmath>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+bool PipelineStats::enabled = false;
+std::array<PipelineStats::Histogram, PipelineStats::NUM_STAGES> PipelineStats::stages;
+
+double PipelineStats::Histogram::Quantile(double q) const
+	{
+	uint64_t want = static_cast<uint64_t>(std::ceil(q * count));
+	uint64_t seen = 0;
+
+	for ( int b = 0; b < BUCKETS; ++b )
+		{
+		seen += hist[b];
+
+		if ( seen < want || seen == 0 )
+			continue;
+
+		if ( b < 4 )
+			return (b + 1) / 1e9;
+
+		// The bucket's values are below its quarter's upper end.
+		int msb = b / 4;
+		return std::ldexp(4 + b % 4 + 1, msb - 2) / 1e9;
+		}
+
+	return 0;
+	}
+
+const char* PipelineStats::StageName(Stage s)
+	{
+	switch ( s ) {
+	case PKTSRC_EXTRACT:	return "pktsrc_extract";
+	case PACKET_ANALYSIS:	return "packet_analysis";
+	case SESSION_LOOKUP:	return "session_lookup";
+	case CONNECTION:	return "connection";
+	case TCP_REASSEMBLY:	return "tcp_reassembly";
+	case EVENT_DRAIN:	return "event_drain";
+	case TIMER_EXPIRY:	return "timer_expiry";
+	default:	return "<unknown>";
+	}
+	}
+
+void PipelineStats::Reset()
+	{
+	stages = {};
+	}
+
+} // namespace zeek::detail
+
+TEST_CASE("pipeline stats histogram")
+	{
+	using zeek::detail::PipelineStats;
+	PipelineStats::Histogram h;
+
+	CHECK(PipelineStats::Histogram::Bucket(3) == 3);
+	CHECK(PipelineStats::Histogram::Bucket(4) == 8);
+	CHECK(PipelineStats::Histogram::Bucket(7) == 11);
+	CHECK(PipelineStats::Histogram::Bucket(8) == 12);
+
+	for ( int i = 0; i < 99; ++i )
+		h.Add(1000);
+
+	h.Add(1000000);
+
+	CHECK(h.count == 100);
+	CHECK(h.Quantile(0.5) >= 1000 / 1e9);
+	CHECK(h.Quantile(0.5) < 1200 / 1e9);
+	CHECK(h.Quantile(0.999) >= 1000000 / 1e9);
+	}
@@ -0,0 +1,110 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Timing of the stages that packets pass through, for finding out where
+// processing time goes.
+
+#pragma once
+
+#include <time.h>
+#include <array>
+#include <cstdint>
+
+namespace zeek::detail {
+
+/**
+ * Latency histograms of the processing stages, collected while
+ * :zeek:see:`pipeline_stage_telemetry` is set.  Stages nest: the time of
+ * one includes that of the stages it calls into, e.g. packet analysis
+ * includes the connection lookup.  All stages run on the main thread, so
+ * recording is a plain increment.
+ */
+class PipelineStats {
+public:
+	enum Stage {
+		PKTSRC_EXTRACT,	// Getting the next packet from the source.
+		PACKET_ANALYSIS,	// All analysis of a packet.
+		SESSION_LOOKUP,	// Finding or creating its connection.
+		CONNECTION,	// The connection's analyzers processing it.
+		TCP_REASSEMBLY,	// Reassembling and delivering TCP payload.
+		EVENT_DRAIN,	// Dispatching queued events.
+		TIMER_EXPIRY,	// Expiring timers.
+		NUM_STAGES
+	};
+
+	// Durations go into buckets that split each power of two into four,
+	// in nanoseconds.
+	struct Histogram {
+		static constexpr int BUCKETS = 256;
+
+		uint64_t count = 0;
+		uint64_t total = 0;	// nanoseconds
+		std::array<uint64_t, BUCKETS> hist{};
+
+		void Add(uint64_t ns)
+			{
+			++count;
+			total += ns;
+			++hist[Bucket(ns)];
+			}
+
+		// Returns an upper bound of the given quantile, in seconds.
+		double Quantile(double q) const;
+
+		static int Bucket(uint64_t ns)
+			{
+			if ( ns < 4 )
+				return ns;
+
+			int msb = 63 - __builtin_clzll(ns);
+			return msb * 4 + ((ns >> (msb - 2)) & 3);
+			}
+	};
+
+	static bool Enabled()	{ return enabled; }
+	static void SetEnabled(bool arg_enabled)	{ enabled = arg_enabled; }
+
+	static const char* StageName(Stage s);
+	static const Histogram& Get(Stage s)	{ return stages[s]; }
+	static void Add(Stage s, uint64_t ns)	{ stages[s].Add(ns); }
+	static void Reset();
+
+	// A monotonic clock in nanoseconds.
+	static uint64_t Now()
+		{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+		}
+
+private:
+	static bool enabled;
+	static std::array<Histogram, NUM_STAGES> stages;
+};
+
+/**
+ * Times a stage for as long as it's in scope.
+ */
+class StageTimer {
+public:
+	explicit StageTimer(PipelineStats::Stage arg_stage)
+		: stage(arg_stage), start(PipelineStats::Enabled() ? PipelineStats::Now() : 0)
+		{
+		}
+
+	~StageTimer()	{ Stop(); }
+
+	// Ends the timing early.
+	void Stop()
+		{
+		if ( start )
+			PipelineStats::Add(stage, PipelineStats::Now() - start);
+
+		start = 0;
+		}
+
+private:
+	PipelineStats::Stage stage;
+	uint64_t start;
+};
+
+} // namespace zeek::detail
@@ -1,9 +1,62 @@
 #include "zeek/PrefixTable.h"
+
+#include <algorithm>
+#include <cstring>
+
 #include "zeek/Reporter.h"
 #include "zeek/Val.h"
 
 namespace zeek::detail {
 
+uint64_t PrefixTable::stride_threshold = 0;
+
+uint32_t IPv4StrideTrie::Child(std::vector<uint32_t>& v, size_t i)
+	{
+	uint32_t e = v[i];
+
+	if ( e & child_bit )
+		return e & ~child_bit;
+
+	// The new node inherits the entry's match for all of its entries.
+	uint32_t n = nodes.size() / 256;
+	nodes.resize(nodes.size() + 256, e);
+	v[i] = n | child_bit;	// v may be nodes, so index it only now.
+	return n;
+	}
+
+void IPv4StrideTrie::Add(uint32_t addr, int width, void* data)
+	{
+	uint32_t v = values.size();
+	values.push_back(data);
+
+	if ( width < 32 )
+		addr &= width ? ~0u << (32 - width) : 0;
+
+	std::vector<uint32_t>* entries = &root;
+	size_t start;
+	size_t count;
+
+	if ( width <= 16 )
+		{
+		start = addr >> 16;
+		count = 1 << (16 - width);
+		}
+
+	else
+		{
+		uint32_t n = Child(root, addr >> 16);
+
+		if ( width > 24 )
+			n = Child(nodes, n * 256 + ((addr >> 8) & 0xff));
+
+		entries = &nodes;
+		start = n * 256 + (width > 24 ? addr & 0xff : (addr >> 8) & 0xff);
+		count = 1 << ((width > 24 ? 32 : 24) - width);
+		}
+
+	std::fill_n(entries->begin() + start, count, v);
+	}
+
 prefix_t* PrefixTable::MakePrefix(const IPAddr& addr, int width)
 	{
 	prefix_t* prefix = (prefix_t*) util::safe_malloc(sizeof(prefix_t));
@@ -39,6 +92,7 @@ void* PrefixTable::Insert(const IPAddr& addr, int width, void* data)
 	// If there is no data to be associated with addr, we take the
 	// node itself.
 	node->data = data ? data : node;
+	Changed();
 
 	return old;
 	}
@@ -91,6 +145,16 @@ std::list<std::tuple<IPPrefix,void*>> PrefixTable::FindAll(const SubNetVal* valu
 
 void* PrefixTable::Lookup(const IPAddr& addr, int width, bool exact) const
 	{
+	if ( ! exact && width == 128 && addr.GetFamily() == IPv4 )
+		{
+		if ( auto trie = StrideTrie() )
+			{
+			const uint32_t* bytes;
+			addr.GetBytes(&bytes);
+			return trie->Lookup(ntohl(*bytes));
+			}
+		}
+
 	prefix_t* prefix = MakePrefix(addr, width);
 	patricia_node_t* node =
 		exact ? patricia_search_exact(tree, prefix) :
@@ -138,6 +202,7 @@ void* PrefixTable::Remove(const IPAddr& addr, int width)
 
 	void* old = node->data;
 	patricia_remove(tree, node);
+	Changed();
 
 	return old;
 	}
@@ -165,6 +230,94 @@ void* PrefixTable::Remove(const Val* value)
 	}
 	}
 
+const IPv4StrideTrie* PrefixTable::StrideTrie() const
+	{
+	if ( stride_trie )
+		return stride_trie.get();
+
+	uint64_t size = tree->num_active_node;
+
+	// Building the trie takes time linear in the table's size, so
+	// it has to wait for as many lookups to pay off.
+	if ( ! stride_threshold || size < stride_threshold ||
+	     ++lookups_since_change < size )
+		return nullptr;
+
+	BuildStrideTrie();
+	return stride_trie.get();
+	}
+
+// Returns true if the first n bits of a prefix, for n up to 96, equal
+// those of IPv4-mapped addresses.
+static bool matches_ipv4_mapped(const prefix_t* p, int n)
+	{
+	static const u_char v4_mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+	auto bytes = reinterpret_cast<const u_char*>(&p->add.sin6);
+
+	if ( memcmp(bytes, v4_mapped, n / 8) != 0 )
+		return false;
+
+	if ( n % 8 == 0 )
+		return true;
+
+	return ((bytes[n / 8] ^ v4_mapped[n / 8]) & (0xff << (8 - n % 8)) & 0xff) == 0;
+	}
+
+void PrefixTable::BuildStrideTrie() const
+	{
+	struct Entry {
+		int width;
+		uint32_t addr;
+		void* data;
+	};
+
+	std::vector<Entry> entries;
+	std::vector<patricia_node_t*> stack;
+
+	if ( tree->head )
+		stack.push_back(tree->head);
+
+	while ( ! stack.empty() )
+		{
+		auto n = stack.back();
+		stack.pop_back();
+
+		if ( n->l )
+			stack.push_back(n->l);
+
+		if ( n->r )
+			stack.push_back(n->r);
+
+		if ( ! n->prefix )
+			continue;
+
+		int width = n->prefix->bitlen;
+
+		if ( ! matches_ipv4_mapped(n->prefix, std::min(width, 96)) )
+			continue;
+
+		// Prefixes of IPv6 space that contain all the IPv4-mapped
+		// addresses match any IPv4 address, like a /0.
+		if ( width <= 96 )
+			{
+			entries.push_back({width - 96, 0, n->data});
+			continue;
+			}
+
+		uint32_t addr;
+		memcpy(&addr, reinterpret_cast<const u_char*>(&n->prefix->add.sin6) + 12, 4);
+		entries.push_back({width - 96, ntohl(addr), n->data});
+		}
+
+	std::stable_sort(entries.begin(), entries.end(),
+	                 [](const Entry& a, const Entry& b) { return a.width < b.width; });
+
+	stride_trie = std::make_unique<IPv4StrideTrie>();
+
+	for ( const auto& e : entries )
+		stride_trie->Add(e.addr, std::max(e.width, 0), e.data);
+	}
+
 PrefixTable::iterator PrefixTable::InitIterator()
 	{
 	iterator i;
@@ -5,6 +5,8 @@ extern "C" {
 }
 
 #include <list>
+#include <memory>
+#include <vector>
 
 #include "zeek/IPAddr.h"
 
@@ -13,6 +15,57 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(SubNetVal, zeek);
 
 namespace zeek::detail {
 
+// A multibit trie with strides of 16, 8 and 8 bits for longest-prefix
+// matches of IPv4 addresses, which takes at most three memory accesses per
+// lookup where the patricia trie chases a pointer per bit.  Prefixes get
+// pushed down to the leaves, so it can't be updated in place; PrefixTable
+// builds one from scratch once it's large and lookups dominate.
+class IPv4StrideTrie {
+public:
+	IPv4StrideTrie() : root(1 << 16)	{ }
+
+	// Adds a prefix, given in host order.  Prefixes must get added in
+	// order of increasing width, so that longer ones override the
+	// shorter ones they fall under.
+	void Add(uint32_t addr, int width, void* data);
+
+	// Returns the data of the longest prefix that addr, in host order,
+	// falls under, or nil if there's none.
+	void* Lookup(uint32_t addr) const
+		{
+		uint32_t e = root[addr >> 16];
+
+		if ( e & child_bit )
+			{
+			e = nodes[(e & ~child_bit) * 256 + ((addr >> 8) & 0xff)];
+
+			if ( e & child_bit )
+				e = nodes[(e & ~child_bit) * 256 + (addr & 0xff)];
+			}
+
+		return values[e];
+		}
+
+	size_t MemoryAllocation() const
+		{
+		return (root.capacity() + nodes.capacity()) * sizeof(uint32_t) +
+			values.capacity() * sizeof(void*);
+		}
+
+private:
+	static constexpr uint32_t child_bit = 0x80000000;
+
+	// Returns the index of the node that entry i of v points to,
+	// creating it if there's none yet.
+	uint32_t Child(std::vector<uint32_t>& v, size_t i);
+
+	// Entries either have child_bit set and index a node of 256
+	// entries, or index values, where 0 means no match.
+	std::vector<uint32_t> root;
+	std::vector<uint32_t> nodes;
+	std::vector<void*> values{nullptr};
+};
+
 class PrefixTable {
 private:
 	struct iterator {
@@ -48,7 +101,7 @@ public:
 	void* Remove(const IPAddr& addr, int width);
 	void* Remove(const Val* value);
 
-	void Clear()	{ Clear_Patricia(tree, delete_function); }
+	void Clear()	{ Clear_Patricia(tree, delete_function); Changed(); }
 
 	// Sets a function to call for each node when table is cleared/destroyed.
 	void SetDeleteFunction(data_fn_t del_fn)	{ delete_function = del_fn; }
@@ -56,10 +109,33 @@ public:
 	iterator InitIterator();
 	void* GetNext(iterator* i);
 
+	/**
+	 * Sets the number of trie nodes from which on longest-prefix
+	 * lookups of IPv4 addresses go through an IPv4StrideTrie.  Zero
+	 * disables them.
+	 */
+	static void SetStrideThreshold(uint64_t n)	{ stride_threshold = n; }
+
 private:
 	static prefix_t* MakePrefix(const IPAddr& addr, int width);
 	static IPPrefix PrefixToIPPrefix(prefix_t* p);
 
+	void Changed()
+		{
+		stride_trie.reset();
+		lookups_since_change = 0;
+		}
+
+	// Returns the stride trie, building it if the table is large and
+	// enough lookups have happened since the last change to make up
+	// for the cost, or nil.
+	const IPv4StrideTrie* StrideTrie() const;
+	void BuildStrideTrie() const;
+
+	mutable std::unique_ptr<IPv4StrideTrie> stride_trie;
+	mutable uint64_t lookups_since_change = 0;
+	static uint64_t stride_threshold;
+
 	patricia_tree_t* tree;
 	data_fn_t delete_function;
 };
@@ -4,9 +4,11 @@
 #include "zeek/RE.h"
 
 #include <stdlib.h>
+#include <unordered_map>
 #include <utility>
 
 #include "zeek/DFA.h"
+#include "zeek/DFACache.h"
 #include "zeek/CCL.h"
 #include "zeek/EquivClass.h"
 #include "zeek/Reporter.h"
@@ -146,6 +148,9 @@ bool Specific_RE_Matcher::Compile(bool lazy)
 
 	dfa = new DFA_Machine(nfa, EC());
 
+	if ( dfa_cache_file )
+		dfa_cache_file->Attach(dfa, util::fmt("%d %d %s", mt, multiline, pattern_text));
+
 	Unref(nfa);
 	nfa = nullptr;
 
@@ -198,6 +203,19 @@ bool Specific_RE_Matcher::CompileSet(const string_list& set, const int_list& idx
 	dfa = new DFA_Machine(nfa, EC());
 	ecs = EC()->EquivClasses();
 
+	if ( dfa_cache_file )
+		{
+		std::string source = util::fmt("set %d %d", mt, multiline);
+
+		loop_over_list(set, i)
+			{
+			source += '\0';
+			source += std::to_string(idx[i]) + ":" + set[i];
+			}
+
+		dfa_cache_file->Attach(dfa, source);
+		}
+
 	return true;
 	}
 
@@ -305,6 +323,19 @@ void Specific_RE_Matcher::Dump(FILE* f)
 	dfa->Dump(f);
 	}
 
+RE_Match_State::~RE_Match_State()
+	{
+	Unref(current_state);
+	}
+
+void RE_Match_State::Clear()
+	{
+	current_pos = -1;
+	Unref(current_state);
+	current_state = nullptr;
+	accepted_matches.clear();
+	}
+
 inline void RE_Match_State::AddMatches(const AcceptingSet& as,
                                        MatchPos position)
 	{
@@ -315,8 +346,10 @@ inline void RE_Match_State::AddMatches(const AcceptingSet& as,
 	}
 
 bool RE_Match_State::Match(const u_char* bv, int n,
-				bool bol, bool eol, bool clear)
+				bool bol, bool eol, bool clear, int start_pos)
 	{
+	DFA_State* prev_state = current_state;
+
 	if ( current_pos == -1 )
 		{
 		// First call to Match().
@@ -336,12 +369,25 @@ bool RE_Match_State::Match(const u_char* bv, int n,
 	else if ( clear )
 		current_state = dfa->StartState();
 
-	if ( ! current_state )
-		return false;
+	size_t old_matches = accepted_matches.size();
 
-	current_pos = 0;
+	if ( current_state )
+		Feed(bv, n, bol, eol, start_pos);
 
-	size_t old_matches = accepted_matches.size();
+	if ( current_state != prev_state )
+		{
+		if ( current_state )
+			Ref(current_state);
+
+		Unref(prev_state);
+		}
+
+	return accepted_matches.size() != old_matches;
+	}
+
+void RE_Match_State::Feed(const u_char* bv, int n, bool bol, bool eol, int start_pos)
+	{
+	current_pos = start_pos;
 
 	int ec;
 	int m = bol ? n + 1 : n;
@@ -373,8 +419,6 @@ bool RE_Match_State::Match(const u_char* bv, int n,
 
 		current_state = next_state;
 		}
-
-	return accepted_matches.size() != old_matches;
 	}
 
 int Specific_RE_Matcher::LongestMatch(const u_char* bv, int n)
@@ -475,51 +519,108 @@ RE_Matcher* RE_Matcher_disjunction(const RE_Matcher* re1, const RE_Matcher* re2)
 	return matcher_merge(re1, re2, "|");
 	}
 
+// Compiled matchers by their full pattern text, which already tells the
+// match types apart, for sharing them between patterns that scripts
+// build at runtime, e.g. with string_to_pattern() or the & and | operators.
+// It's never freed, as its DFAs mustn't outlive the rest at exit.
+using MatcherCache = std::unordered_map<std::string, std::shared_ptr<Specific_RE_Matcher>>;
+static MatcherCache& matcher_cache = *new MatcherCache();
+
+// Entries beyond this get shed, if no pattern uses them anymore.
+static constexpr size_t MAX_CACHED_MATCHERS = 1000;
+
+static bool compile_cached(std::shared_ptr<Specific_RE_Matcher>& m, bool lazy)
+	{
+	if ( ! m->PatternText() )
+		return m->Compile(lazy);
+
+	std::string key = m->PatternText();
+	auto it = matcher_cache.find(key);
+
+	if ( it != matcher_cache.end() )
+		{
+		m = it->second;
+		return true;
+		}
+
+	// Failures aren't cached so that they get reported each time.
+	if ( ! m->Compile(lazy) )
+		return false;
+
+	if ( matcher_cache.size() >= MAX_CACHED_MATCHERS )
+		{
+		for ( auto i = matcher_cache.begin(); i != matcher_cache.end(); )
+			{
+			if ( i->second.use_count() == 1 )
+				i = matcher_cache.erase(i);
+			else
+				++i;
+			}
+		}
+
+	if ( matcher_cache.size() < MAX_CACHED_MATCHERS )
+		matcher_cache.emplace(std::move(key), m);
+
+	return true;
+	}
+
 } // namespace detail
 
 RE_Matcher::RE_Matcher()
 	{
-	re_anywhere = new detail::Specific_RE_Matcher(detail::MATCH_ANYWHERE);
-	re_exact = new detail::Specific_RE_Matcher(detail::MATCH_EXACTLY);
+	re_anywhere = std::make_shared<detail::Specific_RE_Matcher>(detail::MATCH_ANYWHERE);
+	re_exact = std::make_shared<detail::Specific_RE_Matcher>(detail::MATCH_EXACTLY);
 	}
 
 RE_Matcher::RE_Matcher(const char* pat)
 	{
-	re_anywhere = new detail::Specific_RE_Matcher(detail::MATCH_ANYWHERE);
-	re_exact = new detail::Specific_RE_Matcher(detail::MATCH_EXACTLY);
+	re_anywhere = std::make_shared<detail::Specific_RE_Matcher>(detail::MATCH_ANYWHERE);
+	re_exact = std::make_shared<detail::Specific_RE_Matcher>(detail::MATCH_EXACTLY);
 
 	AddPat(pat);
 	}
 
 RE_Matcher::RE_Matcher(const char* exact_pat, const char* anywhere_pat)
 	{
-	re_anywhere = new detail::Specific_RE_Matcher(detail::MATCH_ANYWHERE);
+	re_anywhere = std::make_shared<detail::Specific_RE_Matcher>(detail::MATCH_ANYWHERE);
 	re_anywhere->SetPat(anywhere_pat);
-	re_exact = new detail::Specific_RE_Matcher(detail::MATCH_EXACTLY);
+	re_exact = std::make_shared<detail::Specific_RE_Matcher>(detail::MATCH_EXACTLY);
 	re_exact->SetPat(exact_pat);
 	}
 
-RE_Matcher::~RE_Matcher()
+RE_Matcher::~RE_Matcher() = default;
+
+void RE_Matcher::Unshare(std::shared_ptr<detail::Specific_RE_Matcher>& m,
+                         detail::match_type mt)
 	{
-	delete re_anywhere;
-	delete re_exact;
+	if ( ! m->DFA() )
+		return;
+
+	auto copy = std::make_shared<detail::Specific_RE_Matcher>(mt);
+	copy->SetPat(m->PatternText());
+	m = std::move(copy);
 	}
 
 void RE_Matcher::AddPat(const char* new_pat)
 	{
+	Unshare(re_anywhere, detail::MATCH_ANYWHERE);
+	Unshare(re_exact, detail::MATCH_EXACTLY);
 	re_anywhere->AddPat(new_pat);
 	re_exact->AddPat(new_pat);
 	}
 
 void RE_Matcher::MakeCaseInsensitive()
 	{
+	Unshare(re_anywhere, detail::MATCH_ANYWHERE);
+	Unshare(re_exact, detail::MATCH_EXACTLY);
 	re_anywhere->MakeCaseInsensitive();
 	re_exact->MakeCaseInsensitive();
 	}
 
 bool RE_Matcher::Compile(bool lazy)
 	{
-	return re_anywhere->Compile(lazy) && re_exact->Compile(lazy);
+	return detail::compile_cached(re_anywhere, lazy) &&
+		detail::compile_cached(re_exact, lazy);
 	}
 
 } // namespace zeek
@@ -6,6 +6,7 @@
 #include <ctype.h>
 #include <set>
 #include <map>
+#include <memory>
 #include <string>
 
 #include "zeek/List.h"
@@ -153,6 +154,8 @@ public:
 		current_state = nullptr;
 		}
 
+	~RE_Match_State();
+
 	const AcceptingMatchSet& AcceptedMatches() const
 		{ return accepted_matches; }
 
@@ -160,23 +163,26 @@ public:
 	int Length()	{ return current_pos; }
 
 	// Returns true if this inputs leads to at least one new match.
-	// If clear is true, starts matching over.
-	bool Match(const u_char* bv, int n, bool bol, bool eol, bool clear);
+	// If clear is true, starts matching over.  start_pos is the
+	// position to report matches relative to for the first symbol fed.
+	bool Match(const u_char* bv, int n, bool bol, bool eol, bool clear,
+	           int start_pos = 0);
 
-	void Clear()
-		{
-		current_pos = -1;
-		current_state = nullptr;
-		accepted_matches.clear();
-		}
+	void Clear();
 
 	void AddMatches(const AcceptingSet& as, MatchPos position);
 
 protected:
+	// Runs the input through the DFA, from current_state onwards.
+	void Feed(const u_char* bv, int n, bool bol, bool eol, int start_pos);
+
 	DFA_Machine* dfa;
 	int* ecs;
 
 	AcceptingMatchSet accepted_matches;
+
+	// We hold a reference to this, so that the DFA's state cache
+	// doesn't evict it.
 	DFA_State* current_state;
 	int current_pos;
 };
@@ -198,6 +204,9 @@ public:
 	// Makes the matcher as specified to date case-insensitive.
 	void MakeCaseInsensitive();
 
+	// Compiles the matcher, or shares the compiled matchers of another
+	// one with the same pattern, including the states its DFAs built
+	// so far.
 	bool Compile(bool lazy = false);
 
 	// Returns true if s exactly matches the pattern, false otherwise.
@@ -235,8 +244,12 @@ public:
 		}
 
 protected:
-	detail::Specific_RE_Matcher* re_anywhere;
-	detail::Specific_RE_Matcher* re_exact;
+	// Compiled matchers are shared, so changing one detaches it first.
+	static void Unshare(std::shared_ptr<detail::Specific_RE_Matcher>& m,
+	                    detail::match_type mt);
+
+	std::shared_ptr<detail::Specific_RE_Matcher> re_anywhere;
+	std::shared_ptr<detail::Specific_RE_Matcher> re_exact;
 };
 
 } // namespace zeek
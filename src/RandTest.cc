@@ -13,8 +13,10 @@
 */
 
 #include "zeek/RandTest.h"
+#include "zeek/3rdparty/doctest.h"
 
 #include <math.h>
+#include <algorithm>
 
 constexpr double log2of10 = 3.32192809488736234787;
 
@@ -27,6 +29,14 @@ static double rt_log2(double x)
 // RT_INCIRC = pow(pow(256.0, (double) (RT_MONTEN / 2)) - 1, 2.0);
 constexpr double RT_INCIRC = 281474943156225.0;
 
+// Buffers of at least RT_LANE_MIN bytes get counted into RT_LANES sets of
+// bins.
+constexpr int RT_LANES = 4;
+constexpr int RT_LANE_MIN = 1024;
+
+// The number of bytes whose serial correlation sums fit into 32 bits.
+constexpr int RT_SUM_BLOCK = 65536;
+
 namespace zeek::detail {
 
 RandTest::RandTest()
@@ -43,54 +53,134 @@ RandTest::RandTest()
 		}
 	}
 
+void RandTest::add_monte(int oc)
+	{
+	monte[mp++] = oc;  /* Save character for Monte Carlo */
+	if (mp >= RT_MONTEN)  /* Calculate every RT_MONTEN character */
+		{
+		mp = 0;
+		mcount++;
+		montex = 0;
+		montey = 0;
+		for (int mj=0; mj < RT_MONTEN/2; mj++)
+			{
+			montex = (montex * 256.0) + monte[mj];
+			montey = (montey * 256.0) + monte[(RT_MONTEN / 2) + mj];
+			}
+		if (montex*montex + montey*montey <= RT_INCIRC)
+			{
+			inmont++;
+			}
+		}
+	}
+
 void RandTest::add(const void *buf, int bufl)
 	{
 	const unsigned char *bp = static_cast<const unsigned char*>(buf);
-	int oc;
 
-	while (bufl-- > 0)
+	if (bufl <= 0)
+		return;
+
+	totalc += bufl;
+
+	/* Count occurrences.  Successive bytes of the same value would
+	   stall on incrementing the same counter, so large buffers get
+	   counted into separate sets of bins that get summed up after. */
+	if (bufl >= RT_LANE_MIN)
 		{
-		oc = *bp++;
-		ccount[oc]++;   /* Update counter for this bin */
-		totalc++;
-
-		/* Update inside / outside circle counts for Monte Carlo
- 		   computation of PI */
-		monte[mp++] = oc;  /* Save character for Monte Carlo */
-		if (mp >= RT_MONTEN)  /* Calculate every RT_MONTEN character */
-			{
-			mp = 0;
-			mcount++;
-			montex = 0;
-			montey = 0;
-			for (int mj=0; mj < RT_MONTEN/2; mj++)
-				{
-				montex = (montex * 256.0) + monte[mj];
-				montey = (montey * 256.0) + monte[(RT_MONTEN / 2) + mj];
-				}
-			if (montex*montex + montey*montey <= RT_INCIRC)
-				{
-				inmont++;
-				}
-			}
+		uint32_t lanes[RT_LANES][256] = { { 0 } };
+		int i = 0;
+
+		for (; i + RT_LANES <= bufl; i += RT_LANES)
+			for (int l = 0; l < RT_LANES; l++)
+				lanes[l][bp[i + l]]++;
 
-		/* Update calculation of serial correlation coefficient */
-		if (sccfirst)
+		for (; i < bufl; i++)
+			lanes[0][bp[i]]++;
+
+		for (int c = 0; c < 256; c++)
 			{
-			sccfirst = 0;
-			scclast = 0;
-			sccu0 = oc;
+			uint64_t sum = 0;
+
+			for (int l = 0; l < RT_LANES; l++)
+				sum += lanes[l][c];
+
+			ccount[c] += sum;
 			}
-		else
+		}
+	else
+		{
+		for (int i = 0; i < bufl; i++)
+			ccount[bp[i]]++;
+		}
+
+	/* Update inside / outside circle counts for Monte Carlo
+	   computation of PI, every RT_MONTEN characters.  Characters
+	   complete a pending set of coordinates first, then whole sets
+	   get taken straight from the buffer. */
+	int i = 0;
+
+	while (mp != 0 && i < bufl)
+		add_monte(bp[i++]);
+
+	uint64_t hits = 0;
+	int64_t sets = (bufl - i) / RT_MONTEN;
+
+	for (int64_t k = 0; k < sets; k++, i += RT_MONTEN)
+		{
+		/* The coordinates are integers that doubles represent
+		   exactly, so integer math yields the same hits. */
+		const unsigned char *m = bp + i;
+		uint64_t x = (uint64_t(m[0]) << 16) | (m[1] << 8) | m[2];
+		uint64_t y = (uint64_t(m[3]) << 16) | (m[4] << 8) | m[5];
+		hits += (x * x + y * y <= uint64_t(RT_INCIRC));
+		}
+
+	if (sets > 0)
+		{
+		const unsigned char *m = bp + i - RT_MONTEN;
+		montex = (m[0] << 16) | (m[1] << 8) | m[2];
+		montey = (m[3] << 16) | (m[4] << 8) | m[5];
+		mcount += sets;
+		inmont += hits;
+		}
+
+	while (i < bufl)
+		add_monte(bp[i++]);
+
+	/* Update calculation of serial correlation coefficient */
+	if (sccfirst)
+		{
+		sccfirst = 0;
+		scclast = 0;
+		sccu0 = bp[0];
+		}
+
+	scct1 = scct1 + scclast * bp[0];
+
+	/* The sums of a block fit into 32 bits.  The loops over them
+	   vectorize, and being sums of integers, adding them up in blocks
+	   yields the same result as adding them up one by one. */
+	for (int start = 0; start < bufl; start += RT_SUM_BLOCK)
+		{
+		int end = std::min(bufl, start + RT_SUM_BLOCK);
+		uint32_t t1 = 0, t2 = 0, t3 = 0;
+
+		for (int j = std::max(start, 1); j < end; j++)
+			t1 += uint32_t(bp[j - 1]) * bp[j];
+
+		for (int j = start; j < end; j++)
 			{
-			scct1 = scct1 + scclast * oc;
+			t2 += bp[j];
+			t3 += uint32_t(bp[j]) * bp[j];
 			}
 
-		scct2 = scct2 + oc;
-		scct3 = scct3 + (oc * oc);
-		scclast = oc;
-		oc <<= 1;
+		scct1 += t1;
+		scct2 += t2;
+		scct3 += t3;
 		}
+
+	scclast = bp[bufl - 1];
 	}
 
 void RandTest::end(double* r_ent, double* r_chisq,
@@ -147,3 +237,37 @@ void RandTest::end(double* r_ent, double* r_chisq,
 	}
 
 } // namespace zeek::detail
+
+TEST_CASE("randtest blocks")
+	{
+	unsigned char buf[4096 + 7];
+
+	for ( size_t i = 0; i < sizeof(buf); i++ )
+		buf[i] = (i * 7 + (i >> 3)) & 0xff;
+
+	// Whole buffers take the block path, single bytes the other one.
+	zeek::detail::RandTest whole, bytes;
+	whole.add(buf, sizeof(buf));
+
+	for ( size_t i = 0; i < sizeof(buf); i++ )
+		bytes.add(buf + i, 1);
+
+	double r1[5], r2[5];
+	whole.end(&r1[0], &r1[1], &r1[2], &r1[3], &r1[4]);
+	bytes.end(&r2[0], &r2[1], &r2[2], &r2[3], &r2[4]);
+
+	for ( int i = 0; i < 5; i++ )
+		CHECK(r1[i] == r2[i]);
+
+	// Every value equally often.
+	zeek::detail::RandTest uniform;
+
+	for ( size_t i = 0; i < 4096; i++ )
+		buf[i] = i & 0xff;
+
+	uniform.add(buf, 4096);
+	uniform.end(&r1[0], &r1[1], &r1[2], &r1[3], &r1[4]);
+	CHECK(r1[0] == doctest::Approx(8.0));
+	CHECK(r1[1] == 0.0);
+	CHECK(r1[2] == 127.5);
+	}
@@ -22,6 +22,8 @@ public:
 private:
 	friend class zeek::EntropyVal;
 
+	void add_monte(int oc);
+
 	int64_t ccount[256];  /* Bins to count occurrences of values */
 	int64_t totalc;       /* Total bytes counted */
 	int mp;
@@ -3,16 +3,232 @@
 #include "zeek-config.h"
 #include "zeek/Reassem.h"
 
+#include <stdlib.h>
 #include <algorithm>
+#include <new>
+#include <string>
 
 #include "zeek/Desc.h"
+#include "zeek/MemoryArenas.h"
+#include "zeek/NetVar.h"
+#include "zeek/3rdparty/doctest.h"
 
 using std::min;
 
 namespace zeek {
 
+namespace detail {
+
+// Slabs are aligned to their size, so that a chunk's slab can be found by
+// masking its address.
+static constexpr uintptr_t SLAB_SIZE = 256 * 1024;
+static constexpr int MIN_CHUNK_SHIFT = 6;	// 64 bytes
+static constexpr int MAX_CHUNK_SHIFT = 14;	// 16 KB, DataBlockPool::MAX_CHUNK_SIZE
+static constexpr int NUM_SIZE_CLASSES = MAX_CHUNK_SHIFT - MIN_CHUNK_SHIFT + 1;
+
+static_assert((uint64_t(1) << MAX_CHUNK_SHIFT) == DataBlockPool::MAX_CHUNK_SIZE);
+
+namespace {
+
+struct FreeChunk {
+	FreeChunk* next;
+};
+
+// The header at the start of each slab. Its first chunk is sacrificed for
+// it, the remaining ones are handed out.
+struct Slab {
+	Slab* prev = nullptr;	// Neighbors in the size class's list of slabs
+	Slab* next = nullptr;	// that have chunks available.
+	bool listed = false;
+
+	FreeChunk* free_chunks = nullptr;
+	uint32_t chunk_size;
+	uint32_t num_chunks;
+	uint32_t carved = 0;	// Chunks taken from the never-used tail so far.
+	uint32_t used = 0;
+
+	explicit Slab(uint32_t arg_chunk_size)
+		: chunk_size(arg_chunk_size), num_chunks(SLAB_SIZE / arg_chunk_size - 1)
+		{ }
+
+	bool Full() const	{ return ! free_chunks && carved == num_chunks; }
+	};
+
+struct SizeClass {
+	Slab* available = nullptr;
+	Slab* spare = nullptr;	// One entirely unused slab kept around.
+	};
+
+struct Pool {
+	SizeClass classes[NUM_SIZE_CLASSES];
+	};
+
+static_assert(sizeof(Slab) <= (1 << MIN_CHUNK_SHIFT));
+
+} // namespace
+
+static Pool& pool()
+	{
+	// Never destroyed, blocks may still live on during shutdown.
+	static thread_local Pool* p = new Pool;
+	return *p;
+	}
+
+static int chunk_shift(uint64_t size)
+	{
+	int shift = MIN_CHUNK_SHIFT;
+
+	while ( (uint64_t(1) << shift) < size )
+		++shift;
+
+	return shift;
+	}
+
+static void link_slab(SizeClass* c, Slab* slab)
+	{
+	slab->prev = nullptr;
+	slab->next = c->available;
+
+	if ( c->available )
+		c->available->prev = slab;
+
+	c->available = slab;
+	slab->listed = true;
+	}
+
+static void unlink_slab(SizeClass* c, Slab* slab)
+	{
+	if ( slab->prev )
+		slab->prev->next = slab->next;
+	else
+		c->available = slab->next;
+
+	if ( slab->next )
+		slab->next->prev = slab->prev;
+
+	slab->prev = slab->next = nullptr;
+	slab->listed = false;
+	}
+
+u_char* DataBlockPool::Allocate(uint64_t size, uint64_t* capacity)
+	{
+	int shift = chunk_shift(size);
+	*capacity = uint64_t(1) << shift;
+
+	if ( shift > MAX_CHUNK_SHIFT )
+		return new u_char[*capacity];
+
+	SizeClass* c = &pool().classes[shift - MIN_CHUNK_SHIFT];
+	Slab* slab = c->available;
+
+	if ( ! slab )
+		{
+		if ( c->spare )
+			{
+			slab = c->spare;
+			c->spare = nullptr;
+			}
+		else
+			{
+			void* mem = aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+
+			if ( ! mem )
+				throw std::bad_alloc();
+
+			slab = new (mem) Slab(*capacity);
+			}
+
+		link_slab(c, slab);
+		}
+
+	u_char* chunk;
+
+	if ( slab->free_chunks )
+		{
+		chunk = reinterpret_cast<u_char*>(slab->free_chunks);
+		slab->free_chunks = slab->free_chunks->next;
+		}
+	else
+		chunk = reinterpret_cast<u_char*>(slab) + (++slab->carved) * slab->chunk_size;
+
+	++slab->used;
+
+	if ( slab->Full() )
+		unlink_slab(c, slab);
+
+	return chunk;
+	}
+
+void DataBlockPool::Free(u_char* chunk, uint64_t capacity)
+	{
+	if ( capacity > MAX_CHUNK_SIZE )
+		{
+		delete [] chunk;
+		return;
+		}
+
+	SizeClass* c = &pool().classes[chunk_shift(capacity) - MIN_CHUNK_SHIFT];
+	auto slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(chunk) & ~(SLAB_SIZE - 1));
+
+	auto fc = reinterpret_cast<FreeChunk*>(chunk);
+	fc->next = slab->free_chunks;
+	slab->free_chunks = fc;
+	--slab->used;
+
+	if ( ! slab->listed )
+		link_slab(c, slab);
+
+	if ( slab->used > 0 )
+		return;
+
+	unlink_slab(c, slab);
+
+	if ( c->spare )
+		{
+		slab->~Slab();
+		free(slab);
+		return;
+		}
+
+	slab->free_chunks = nullptr;
+	slab->carved = 0;
+	c->spare = slab;
+	}
+
+TEST_CASE("data block pool")
+	{
+	uint64_t cap1, cap2, cap3;
+	u_char* a = DataBlockPool::Allocate(10, &cap1);
+	u_char* b = DataBlockPool::Allocate(100, &cap2);
+	u_char* c = DataBlockPool::Allocate(100000, &cap3);
+
+	CHECK(cap1 == 64);
+	CHECK(cap2 == 128);
+	CHECK(cap3 == 131072);
+
+	memset(a, 1, cap1);
+	memset(b, 2, cap2);
+	memset(c, 3, cap3);
+
+	DataBlockPool::Free(a, cap1);
+	u_char* d = DataBlockPool::Allocate(64, &cap1);
+	CHECK(d == a);
+
+	DataBlockPool::Free(b, cap2);
+	DataBlockPool::Free(c, cap3);
+	DataBlockPool::Free(d, cap1);
+	}
+
+} // namespace detail
+
 uint64_t Reassembler::total_size = 0;
 uint64_t Reassembler::sizes[REASSEM_NUM];
+uint64_t Reassembler::memory_limit = 0;
+uint64_t Reassembler::num_evictions = 0;
+uint64_t Reassembler::evicted_bytes = 0;
+Reassembler* Reassembler::first_reassembler = nullptr;
+Reassembler* Reassembler::last_reassembler = nullptr;
+std::vector<Reassembler*>* Reassembler::eviction_candidates = nullptr;
 
 DataBlock::DataBlock(const u_char* data, uint64_t size, uint64_t arg_seq)
 	{
@@ -22,6 +238,90 @@ DataBlock::DataBlock(const u_char* data, uint64_t size, uint64_t arg_seq)
 	memcpy(block, data, size);
 	}
 
+DataBlock::DataBlock(const u_char* data, uint64_t size, uint64_t arg_seq, bool pooled)
+	{
+	seq = arg_seq;
+	upper = seq + size;
+
+	if ( pooled )
+		block = detail::DataBlockPool::Allocate(size, &capacity);
+	else
+		block = new u_char[size];
+
+	memcpy(block, data, size);
+	}
+
+DataBlock::DataBlock(const u_char* data, uint64_t size, uint64_t arg_seq,
+                     iosource::PacketLease* arg_lease)
+	{
+	seq = arg_seq;
+	upper = seq + size;
+	block = const_cast<u_char*>(data);
+	lease = arg_lease;
+	}
+
+void DataBlock::Unlease(bool pooled)
+	{
+	auto size = Size();
+	u_char* data = pooled ? detail::DataBlockPool::Allocate(size, &capacity) : new u_char[size];
+	memcpy(data, block, size);
+	block = data;
+	lease = nullptr;
+	}
+
+void DataBlock::Extend(const u_char* data, uint64_t size)
+	{
+	uint64_t old_size = Size();
+	uint64_t new_size = old_size + size;
+
+	if ( new_size > capacity )
+		{
+		uint64_t new_capacity;
+		u_char* new_block = detail::DataBlockPool::Allocate(new_size, &new_capacity);
+		memcpy(new_block, block, old_size);
+		FreeData();
+		block = new_block;
+		capacity = new_capacity;
+		}
+
+	memcpy(block + old_size, data, size);
+	upper += size;
+	}
+
+TEST_CASE("data block extend")
+	{
+	DataBlock b(reinterpret_cast<const u_char*>("abc"), 3, 10);
+	b.Extend(reinterpret_cast<const u_char*>("defg"), 4);
+	CHECK(b.seq == 10);
+	CHECK(b.upper == 17);
+	CHECK(memcmp(b.block, "abcdefg", 7) == 0);
+
+	DataBlock moved(std::move(b));
+	std::string big(20000, 'x');
+	moved.Extend(reinterpret_cast<const u_char*>(big.data()), big.size());
+	CHECK(moved.Size() == 20007);
+	CHECK(memcmp(moved.block, "abcdefgxxx", 10) == 0);
+	}
+
+TEST_CASE("data block unlease")
+	{
+	iosource::PacketLease lease(nullptr, 0);
+	u_char packet[] = "abcdef";
+
+	DataBlock b(packet + 1, 4, 10, &lease);
+	CHECK(b.Lease() == &lease);
+	CHECK(b.block == packet + 1);
+
+	DataBlock moved(std::move(b));
+	CHECK(moved.Lease() == &lease);
+	CHECK(b.Lease() == nullptr);
+
+	DataBlock copy(moved);
+	CHECK(copy.Lease() == nullptr);
+	CHECK(copy.block != packet + 1);
+	CHECK(memcmp(copy.block, "bcde", 4) == 0);
+	}
+
 void DataBlockList::DataSize(uint64_t seq_cutoff, uint64_t* below, uint64_t* above) const
 	{
 	for ( const auto& e : block_map )
@@ -48,6 +348,9 @@ void DataBlockList::Delete(DataBlockMap::const_iterator it)
 	const auto& b = it->second;
 	auto size = b.Size();
 
+	if ( b.lease )
+		b.lease->Release(reassembler);
+
 	block_map.erase(it);
 	total_data_size -= size;
 
@@ -73,9 +376,30 @@ void DataBlockList::Clear()
 	Reassembler::total_size -= total;
 	Reassembler::sizes[reassembler->rtype] -= total;
 	total_data_size = 0;
+
+	for ( const auto& e : block_map )
+		if ( e.second.lease )
+			e.second.lease->Release(reassembler);
+
 	block_map.clear();
 	}
 
+void DataBlockList::Unlease(const iosource::PacketLease* lease)
+	{
+	for ( auto& e : block_map )
+		if ( e.second.lease == lease )
+			e.second.Unlease(compact);
+	}
+
+DataBlock DataBlockList::NewDataBlock(const u_char* data, uint64_t size, uint64_t seq)
+	{
+	if ( reassembler )
+		if ( auto lease = iosource::PacketLease::Acquire(reassembler, data, size) )
+			return DataBlock(data, size, seq, lease);
+
+	return DataBlock(data, size, seq, compact);
+	}
+
 void DataBlockList::Append(DataBlock block, uint64_t limit)
 	{
 	total_data_size += block.Size();
@@ -105,7 +429,11 @@ DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
                       DataBlockMap::const_iterator hint)
 	{
 	auto size = upper - seq;
-	auto rval = block_map.emplace_hint(hint, seq, DataBlock(data, size, seq));
+
+	if ( compact && hint != block_map.begin() && Coalesce(std::prev(hint), seq, upper, data) )
+		return std::prev(hint);
+
+	auto rval = block_map.emplace_hint(hint, seq, NewDataBlock(data, size, seq));
 
 	total_data_size += size;
 	Reassembler::sizes[reassembler->rtype] += size + sizeof(DataBlock);
@@ -114,6 +442,35 @@ DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
 	return rval;
 	}
 
+bool DataBlockList::Coalesce(DataBlockMap::const_iterator it, uint64_t seq, uint64_t upper,
+                             const u_char* data)
+	{
+	const auto& b = it->second;
+	auto size = upper - seq;
+
+	// Reassemblers deliver a block only if it starts right at the
+	// current delivery point, so a block must not have been delivered in
+	// part. Limiting the size keeps blocks in pooled chunks and lets
+	// trimming free memory in reasonable steps.
+	if ( b.upper != seq || b.seq < reassembler->LastReassemSeq() ||
+	     b.Size() + size > detail::DataBlockPool::MAX_CHUNK_SIZE )
+		return false;
+
+	// Leased blocks don't get copied just to extend them.
+	if ( b.lease )
+		return false;
+
+	// Turns the const_iterator into a mutable one.
+	auto mit = block_map.erase(it, it);
+	mit->second.Extend(data, size);
+
+	total_data_size += size;
+	Reassembler::sizes[reassembler->rtype] += size;
+	Reassembler::total_size += size;
+
+	return true;
+	}
+
 DataBlockMap::const_iterator
 DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
                       DataBlockMap::const_iterator* hint)
@@ -271,6 +628,38 @@ Reassembler::Reassembler(uint64_t init_seq, ReassemblerType reassem_type)
 	  last_reassem_seq(init_seq), trim_seq(init_seq),
 	  max_old_blocks(0), rtype(reassem_type)
 	{
+	// Fragments always use pooled storage, as floods of them would
+	// otherwise mean a heap allocation per fragment.
+	if ( rtype == REASSEM_FRAG ||
+	     (BifConst::compact_reassembly_buffers &&
+	      (rtype == REASSEM_TCP || rtype == REASSEM_FILE)) )
+		block_list.SetCompact(true);
+
+	prev_reassembler = last_reassembler;
+
+	if ( last_reassembler )
+		last_reassembler->next_reassembler = this;
+	else
+		first_reassembler = this;
+
+	last_reassembler = this;
+	}
+
+Reassembler::~Reassembler()
+	{
+	if ( prev_reassembler )
+		prev_reassembler->next_reassembler = next_reassembler;
+	else
+		first_reassembler = next_reassembler;
+
+	if ( next_reassembler )
+		next_reassembler->prev_reassembler = prev_reassembler;
+	else
+		last_reassembler = prev_reassembler;
+
+	if ( eviction_candidates )
+		std::replace(eviction_candidates->begin(), eviction_candidates->end(),
+		             this, static_cast<Reassembler*>(nullptr));
 	}
 
 void Reassembler::CheckOverlap(const DataBlockList& list,
@@ -328,6 +717,7 @@ void Reassembler::NewBlock(double t, uint64_t seq, uint64_t len, const u_char* d
 	if ( len == 0 )
 		return;
 
+	detail::MemoryTagScope mem_tag(detail::MEMORY_REASSEMBLY);
 	uint64_t upper_seq = seq + len;
 
 	CheckOverlap(old_block_list, seq, len, data);
@@ -347,6 +737,9 @@ void Reassembler::NewBlock(double t, uint64_t seq, uint64_t len, const u_char* d
 		len -= amount_old;
 		}
 
+	if ( block_list.Empty() )
+		buffered_since = t;
+
 	auto it = block_list.Insert(seq, upper_seq, data);;
 	BlockInserted(it);
 	}
@@ -376,6 +769,66 @@ void Reassembler::Describe(ODesc* d) const
 	d->Add("reassembler");
 	}
 
+void Reassembler::LeaseRevoked(const iosource::PacketLease* lease)
+	{
+	block_list.Unlease(lease);
+	old_block_list.Unlease(lease);
+	}
+
+void Reassembler::Evict()
+	{
+	ClearOldBlocks();
+
+	if ( ! block_list.Empty() )
+		TrimToSeq(block_list.LastBlock().upper);
+	}
+
+void Reassembler::EnforceMemoryLimit()
+	{
+	if ( eviction_candidates )
+		// Delivering evicted data led back here.
+		return;
+
+	std::vector<Reassembler*> candidates;
+
+	for ( auto r = first_reassembler; r; r = r->next_reassembler )
+		if ( r->TotalSize() > 0 )
+			candidates.push_back(r);
+
+	// Oldest first, and the largest first among those equally old.
+	std::sort(candidates.begin(), candidates.end(),
+	          [](const Reassembler* a, const Reassembler* b)
+		{
+		if ( a->buffered_since != b->buffered_since )
+			return a->buffered_since < b->buffered_since;
+
+		return a->TotalSize() > b->TotalSize();
+		});
+
+	// Leave some room, so that we don't evict again right away.
+	uint64_t target = memory_limit - memory_limit / 10;
+
+	eviction_candidates = &candidates;
+
+	for ( auto r : candidates )
+		{
+		if ( total_size <= target )
+			break;
+
+		if ( ! r )
+			// Went away while we were evicting others.
+			continue;
+
+		uint64_t size = r->TotalSize();
+		r->Evict();
+
+		++num_evictions;
+		evicted_bytes += size;
+		}
+
+	eviction_candidates = nullptr;
+	}
+
 void Reassembler::Undelivered(uint64_t up_to_seq)
 	{
 	// TrimToSeq() expects this.
@@ -7,8 +7,10 @@
 #include <sys/types.h> // for u_char
 #include <cstdint>
 #include <map>
+#include <vector>
 
 #include "zeek/Obj.h"
+#include "zeek/iosource/PacketLease.h"
 
 namespace zeek {
 
@@ -26,6 +28,43 @@ enum ReassemblerType {
 
 class Reassembler;
 
+namespace detail {
+
+/**
+ * A per-thread pool of fixed-size chunks for buffering reassembly data.
+ *
+ * Chunk sizes are powers of two. Small chunks are carved out of larger
+ * slabs, so that many small out-of-order segments don't scatter across
+ * the heap; freed chunks are reused for the same size class, and slabs
+ * that become entirely unused are returned. Requests beyond the largest
+ * slab chunk size go to the heap directly, still rounded up to a power of
+ * two so that growing blocks get reallocated only rarely.
+ */
+class DataBlockPool {
+public:
+	/**
+	 * The largest amount of data that a chunk carved out of a slab holds.
+	 */
+	static constexpr uint64_t MAX_CHUNK_SIZE = 16 * 1024;
+
+	/**
+	 * Allocates a chunk of at least the given size.
+	 *
+	 * @param size The number of bytes needed.
+	 *
+	 * @param capacity Returns the chunk's actual size, which needs to be
+	 * passed back to Free().
+	 */
+	static u_char* Allocate(uint64_t size, uint64_t* capacity);
+
+	/**
+	 * Returns a chunk obtained from Allocate() to the pool.
+	 */
+	static void Free(u_char* chunk, uint64_t capacity);
+};
+
+} // namespace detail
+
 /**
  * A block/segment of data for use in the reassembly process.
  */
@@ -37,6 +76,21 @@ public:
 	 */
 	DataBlock(const u_char* data, uint64_t size, uint64_t seq);
 
+	/**
+	 * Create a data block/segment whose data is stored in a chunk from
+	 * the DataBlockPool, which allows extending it later.
+	 */
+	DataBlock(const u_char* data, uint64_t size, uint64_t seq,
+	          bool pooled);
+
+	/**
+	 * Create a data block/segment that refers to packet data under a
+	 * lease instead of copying it. The block doesn't release the lease
+	 * itself, its list does.
+	 */
+	DataBlock(const u_char* data, uint64_t size, uint64_t seq,
+	          iosource::PacketLease* lease);
+
 	DataBlock(const DataBlock& other)
 		{
 		seq = other.seq;
@@ -51,7 +105,11 @@ public:
 		seq = other.seq;
 		upper = other.upper;
 		block = other.block;
+		capacity = other.capacity;
+		lease = other.lease;
 		other.block = nullptr;
+		other.capacity = 0;
+		other.lease = nullptr;
 		}
 
 	DataBlock& operator=(const DataBlock& other)
@@ -62,7 +120,7 @@ public:
 		seq = other.seq;
 		upper = other.upper;
 		auto size = other.Size();
-		delete [] block;
+		FreeData();
 		block = new u_char[size];
 		memcpy(block, other.block, size);
 		return *this;
@@ -75,14 +133,18 @@ public:
 
 		seq = other.seq;
 		upper = other.upper;
-		delete [] block;
+		FreeData();
 		block = other.block;
+		capacity = other.capacity;
+		lease = other.lease;
 		other.block = nullptr;
+		other.capacity = 0;
+		other.lease = nullptr;
 		return *this;
 		}
 
 	~DataBlock()
-		{ delete [] block; }
+		{ FreeData(); }
 
 	/**
 	 * @return length of the data block
@@ -90,9 +152,45 @@ public:
 	uint64_t Size() const
 		{ return upper - seq; }
 
+	/**
+	 * Appends data directly following the block's current end. Moves the
+	 * data into a larger pooled chunk if necessary. Must not be used on
+	 * leased blocks.
+	 */
+	void Extend(const u_char* data, uint64_t size);
+
+	/**
+	 * @return the lease on the packet data that the block refers to, or
+	 * null if the block holds its own copy.
+	 */
+	const iosource::PacketLease* Lease() const
+		{ return lease; }
+
 	uint64_t seq;
 	uint64_t upper;
 	u_char* block;
+
+private:
+	friend class DataBlockList;
+
+	// Replaces leased data with a copy.
+	void Unlease(bool pooled);
+
+	void FreeData()
+		{
+		if ( lease )
+			// The data belongs to the packet source.
+			lease = nullptr;
+		else if ( capacity )
+			detail::DataBlockPool::Free(block, capacity);
+		else
+			delete [] block;
+
+		capacity = 0;
+		}
+
+	uint64_t capacity = 0;	// Size of the pooled chunk, or 0 if not pooled.
+	iosource::PacketLease* lease = nullptr;
 };
 
 using DataBlockMap = std::map<uint64_t, DataBlock>;
@@ -111,6 +209,15 @@ public:
 	DataBlockList(Reassembler* r) : reassembler(r)
 		{ }
 
+	/**
+	 * Switches the list to compact storage for blocks inserted from now
+	 * on: their data comes from the DataBlockPool, and data directly
+	 * following a block that's still entirely undelivered gets appended
+	 * to that block instead of creating a new one.
+	 */
+	void SetCompact(bool arg_compact)
+		{ compact = arg_compact; }
+
 	~DataBlockList()
 		{ Clear(); }
 
@@ -174,6 +281,12 @@ public:
 	 */
 	void Clear();
 
+	/**
+	 * Copies the data of the blocks referring to packet data under the
+	 * given lease.
+	 */
+	void Unlease(const iosource::PacketLease* lease);
+
 	/**
 	 * Insert a new data block into the list.
 	 * @param seq  lower sequence number of the data block
@@ -246,15 +359,34 @@ private:
 	 */
 	DataBlock Remove(DataBlockMap::const_iterator it);
 
+	/**
+	 * Creates a block for new data, referring to the packet data under a
+	 * lease if possible.
+	 */
+	DataBlock NewDataBlock(const u_char* data, uint64_t size, uint64_t seq);
+
+	/**
+	 * Appends data to an existing block when storing compactly, if
+	 * that's possible without affecting delivery.
+	 * @param it  the block preceding the new data
+	 * @param seq  lower sequence number of the new data
+	 * @param upper  highest sequence number of the new data
+	 * @param data  points to the new data
+	 * @return true if the data was appended
+	 */
+	bool Coalesce(DataBlockMap::const_iterator it, uint64_t seq, uint64_t upper,
+	              const u_char* data);
+
 	Reassembler* reassembler = nullptr;
 	size_t total_data_size = 0;
+	bool compact = false;
 	DataBlockMap block_map;
 };
 
-class Reassembler : public Obj {
+class Reassembler : public Obj, public iosource::PacketLeaseHolder {
 public:
 	Reassembler(uint64_t init_seq, ReassemblerType reassem_type = REASSEM_UNKNOWN);
-	~Reassembler() override	{}
+	~Reassembler() override;
 
 	void NewBlock(double t, uint64_t seq, uint64_t len, const u_char* data);
 
@@ -281,6 +413,9 @@ public:
 
 	void Describe(ODesc* d) const override;
 
+	// PacketLeaseHolder interface.
+	void LeaseRevoked(const iosource::PacketLease* lease) override;
+
 	// Sum over all data buffered in some reassembler.
 	static uint64_t TotalMemoryAllocation()	{ return total_size; }
 
@@ -289,10 +424,47 @@ public:
 
 	void SetMaxOldBlocks(uint32_t count)	{ max_old_blocks = count; }
 
+	/**
+	 * Sets a budget for the data that all reassemblers together may
+	 * buffer. Once it's exceeded, CheckMemoryLimit() evicts the data
+	 * of the reassemblers that have been buffering the longest.
+	 *
+	 * @param limit The budget in bytes, or zero for no limit.
+	 */
+	static void SetMemoryLimit(uint64_t limit)	{ memory_limit = limit; }
+
+	/**
+	 * Returns the current budget for buffered data, zero if unlimited.
+	 */
+	static uint64_t MemoryLimit()	{ return memory_limit; }
+
+	/**
+	 * Evicts buffered data if the memory limit is exceeded, until usage
+	 * is back below 90% of the limit. The affected reassemblers report
+	 * the evicted data as gaps. Must not be called from within any
+	 * reassembler's processing, as eviction may deliver data.
+	 */
+	static void CheckMemoryLimit()
+		{
+		if ( memory_limit && total_size > memory_limit )
+			EnforceMemoryLimit();
+		}
+
+	// Number of times a reassembler had its data evicted.
+	static uint64_t NumEvictions()	{ return num_evictions; }
+
+	// Total amount of buffered data evicted.
+	static uint64_t EvictedBytes()	{ return evicted_bytes; }
+
 protected:
 
 	friend class DataBlockList;
 
+	// Gives up on everything currently buffered, skipping over any
+	// holes.  The default flushes the block list up to its end, which
+	// reports the holes via Undelivered().
+	virtual void Evict();
+
 	virtual void Undelivered(uint64_t up_to_seq);
 
 	virtual void BlockInserted(DataBlockMap::const_iterator it) = 0;
@@ -312,6 +484,25 @@ protected:
 
 	static uint64_t total_size;
 	static uint64_t sizes[REASSEM_NUM];
+
+private:
+	static void EnforceMemoryLimit();
+
+	// When the block list last went from empty to holding data.
+	double buffered_since = 0.0;
+
+	// All existing reassemblers, in creation order.
+	Reassembler* prev_reassembler = nullptr;
+	Reassembler* next_reassembler = nullptr;
+	static Reassembler* first_reassembler;
+	static Reassembler* last_reassembler;
+
+	// While evicting: the reassemblers still to consider.
+	static std::vector<Reassembler*>* eviction_candidates;
+
+	static uint64_t memory_limit;
+	static uint64_t num_evictions;
+	static uint64_t evicted_bytes;
 };
 
 } // namespace zeek
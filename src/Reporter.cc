@@ -21,6 +21,9 @@
 #include "zeek/plugin/Manager.h"
 #include "zeek/input.h"
 #include "zeek/file_analysis/File.h"
+#include "zeek/Hash.h"
+
+#include <cinttypes>
 
 #ifdef SYSLOG_INT
 extern "C" {
@@ -60,6 +63,7 @@ Reporter::Reporter(bool arg_abort_on_scripting_errors)
 
 Reporter::~Reporter()
 	{
+	StopStderrWriter();
 	closelog();
 	}
 
@@ -71,6 +75,12 @@ void Reporter::InitOptions()
 	weird_sampling_rate = id::find_val("Weird::sampling_rate")->AsCount();
 	weird_sampling_threshold = id::find_val("Weird::sampling_threshold")->AsCount();
 	weird_sampling_duration = id::find_val("Weird::sampling_duration")->AsInterval();
+	rate_limit = id::find_val("Reporter::rate_limit")->AsCount();
+	rate_limit_interval = id::find_val("Reporter::rate_limit_interval")->AsInterval();
+	stderr_queue_size = id::find_val("Reporter::stderr_queue_size")->AsCount();
+
+	if ( stderr_queue_size && ! stderr_writer.joinable() )
+		stderr_writer = std::thread(&Reporter::WriteStderrLines, this);
 
 	auto init_weird_set = [](WeirdSet* set, const char* name)
 		{
@@ -92,6 +102,7 @@ void Reporter::InitOptions()
 
 	init_weird_set(&weird_sampling_whitelist, "Weird::sampling_whitelist");
 	init_weird_set(&weird_sampling_global_list, "Weird::sampling_global_list");
+	UpdateWeirdLists();
 	}
 
 void Reporter::Info(const char* fmt, ...)
@@ -127,7 +138,8 @@ void Reporter::FatalError(const char* fmt, ...)
 	va_list ap;
 	va_start(ap, fmt);
 
-	// Always log to stderr.
+	// Always log to stderr, and after what's queued for it.
+	StopStderrWriter();
 	DoLog("fatal error", nullptr, stderr, nullptr, nullptr, true, false, nullptr, fmt, ap);
 
 	va_end(ap);
@@ -143,7 +155,8 @@ void Reporter::FatalErrorWithCore(const char* fmt, ...)
 	va_list ap;
 	va_start(ap, fmt);
 
-	// Always log to stderr.
+	// Always log to stderr, and after what's queued for it.
+	StopStderrWriter();
 	DoLog("fatal error", nullptr, stderr, nullptr, nullptr, true, false, nullptr, fmt, ap);
 
 	va_end(ap);
@@ -196,7 +209,8 @@ void Reporter::InternalError(const char* fmt, ...)
 	va_list ap;
 	va_start(ap, fmt);
 
-	// Always log to stderr.
+	// Always log to stderr, and after what's queued for it.
+	StopStderrWriter();
 	DoLog("internal error", nullptr, stderr, nullptr, nullptr, true, false, nullptr, fmt, ap);
 
 	va_end(ap);
@@ -241,99 +255,132 @@ void Reporter::Syslog(const char* fmt, ...)
 	va_end(ap);
 	}
 
-void Reporter::WeirdHelper(EventHandlerPtr event, ValPList vl, const char* fmt_name, ...)
+void Reporter::WeirdHelper(EventHandlerPtr event, ValPList vl, WeirdInfo& w)
 	{
-	va_list ap;
-	va_start(ap, fmt_name);
-	DoLog("weird", event, nullptr, nullptr, &vl, false, false, nullptr, fmt_name, ap);
-	va_end(ap);
+	// This is DoLog() for weirds, which have no location, time or
+	// formatting, so that their names can go straight to the hooks and
+	// reuse the names' values.
+	bool raise_event = true;
+
+	if ( via_events && ! in_error_handler )
+		{
+		const detail::Location* loc1 = nullptr;
+		const detail::Location* loc2 = nullptr;
+
+		if ( locations.size() )
+			{
+			loc1 = locations.back().first;
+			loc2 = locations.back().second;
+			}
+
+		raise_event = PLUGIN_HOOK_WITH_RESULT(HOOK_REPORTER,
+		                                      HookReporter("weird", event, nullptr, &vl, false,
+		                                                   loc1, loc2, false, w.name.c_str()), true);
+		}
+
+	if ( raise_event && event && via_events && ! in_error_handler )
+		{
+		if ( ! w.val )
+			w.val = make_intrusive<StringVal>(w.name);
+
+		Args args;
+		args.reserve(1 + vl.length());
+		args.emplace_back(w.val);
+
+		for ( auto v : vl )
+			args.emplace_back(AdoptRef{}, v);
+
+		event_mgr.Enqueue(event, std::move(args));
+		}
+	else
+		{
+		for ( const auto& av : vl )
+			Unref(av);
+		}
 	}
 
-void Reporter::UpdateWeirdStats(const char* name)
+uint32_t Reporter::WeirdID(const char* name)
 	{
-	++weird_count;
-	++weird_count_by_type[name];
-	}
+	// Looking up the name as a string_view saves building a string for
+	// the weirds whose names we've seen before, which is nearly all.
+	auto it = weird_ids.find(name);
 
-class NetWeirdTimer final : public detail::Timer {
-public:
-	NetWeirdTimer(double t, const char* name, double timeout)
-		: detail::Timer(t + timeout, detail::TIMER_NET_WEIRD_EXPIRE),
-		  weird_name(name)
-		{}
+	if ( it != weird_ids.end() )
+		return it->second;
 
-	void Dispatch(double t, bool is_expire) override
-		{ reporter->ResetNetWeird(weird_name); }
+	auto& w = weird_names.emplace_back();
+	w.name = name;
+	w.id = weird_names.size() - 1;
+	w.on_whitelist = weird_sampling_whitelist.count(w.name) > 0;
+	w.on_global_list = weird_sampling_global_list.count(w.name) > 0;
+	weird_ids.emplace(w.name, w.id);
 
-	std::string weird_name;
-};
+	return w.id;
+	}
 
-class FlowWeirdTimer final : public detail::Timer {
-public:
-	using IPPair = std::pair<IPAddr, IPAddr>;
+Reporter::WeirdInfo& Reporter::UpdateWeirdStats(uint32_t id)
+	{
+	++weird_count;
 
-	FlowWeirdTimer(double t, IPPair p, double timeout)
-		: detail::Timer(t + timeout, detail::TIMER_FLOW_WEIRD_EXPIRE),
-		  endpoints(std::move(p))
-		{}
+	auto& w = weird_names[id];
+	++w.count;
+	return w;
+	}
 
-	void Dispatch(double t, bool is_expire) override
-		{ reporter->ResetFlowWeird(endpoints.first, endpoints.second); }
+void Reporter::UpdateWeirdLists()
+	{
+	for ( auto& w : weird_names )
+		{
+		w.on_whitelist = weird_sampling_whitelist.count(w.name) > 0;
+		w.on_global_list = weird_sampling_global_list.count(w.name) > 0;
+		}
+	}
 
-	IPPair endpoints;
-};
+Reporter::WeirdCountMap Reporter::GetWeirdsByType() const
+	{
+	WeirdCountMap rval;
 
-class ConnTupleWeirdTimer final : public detail::Timer {
-public:
-	using ConnTuple = Reporter::ConnTuple;
+	for ( const auto& w : weird_names )
+		rval.emplace(w.name, w.count);
 
-	ConnTupleWeirdTimer(double t, ConnTuple id, double timeout)
-		: detail::Timer(t + timeout, detail::TIMER_CONN_TUPLE_WEIRD_EXPIRE),
-		  conn_id(std::move(id))
+	return rval;
+	}
+
+class NetWeirdTimer final : public detail::Timer {
+public:
+	NetWeirdTimer(double t, const std::string& name, double timeout)
+		: detail::Timer(t + timeout, detail::TIMER_NET_WEIRD_EXPIRE),
+		  weird_name(name)
 		{}
 
 	void Dispatch(double t, bool is_expire) override
-		{ reporter->ResetExpiredConnWeird(conn_id); }
+		{ reporter->ResetNetWeird(weird_name); }
 
-	ConnTuple conn_id;
+	std::string weird_name;
 };
 
 void Reporter::ResetNetWeird(const std::string& name)
 	{
-	net_weird_state.erase(name);
-	}
+	auto it = weird_ids.find(name);
 
-void Reporter::ResetFlowWeird(const IPAddr& orig, const IPAddr& resp)
-	{
-	flow_weird_state.erase(std::make_pair(orig, resp));
+	if ( it != weird_ids.end() )
+		weird_names[it->second].net_count = 0;
 	}
 
-void Reporter::ResetExpiredConnWeird(const ConnTuple& id)
+Reporter::PermitWeird Reporter::CheckGlobalWeirdLists(WeirdInfo& w)
 	{
-	expired_conn_weird_state.erase(id);
-	}
-
-Reporter::PermitWeird Reporter::CheckGlobalWeirdLists(const char* name)
-	{
-	if ( WeirdOnSamplingWhiteList(name) )
+	if ( w.on_whitelist )
 		return PermitWeird::Allow;
 
-	if ( WeirdOnGlobalList(name) )
+	if ( w.on_global_list )
 		// We track weirds on the global list through the "net_weird" table.
-		return PermitNetWeird(name) ? PermitWeird::Allow : PermitWeird::Deny;
+		return PermitNetWeird(w) ? PermitWeird::Allow : PermitWeird::Deny;
 
 	return PermitWeird::Unknown;
 	}
 
-bool Reporter::PermitNetWeird(const char* name)
+bool Reporter::PermitWeirdCount(uint64_t count) const
 	{
-	auto& count = net_weird_state[name];
-	++count;
-
-	if ( count == 1 )
-		detail::timer_mgr->Add(new NetWeirdTimer(run_state::network_time, name,
-		                                         weird_sampling_duration));
-
 	if ( count <= weird_sampling_threshold )
 		return true;
 
@@ -344,152 +391,201 @@ bool Reporter::PermitNetWeird(const char* name)
 		return false;
 	}
 
-bool Reporter::PermitFlowWeird(const char* name,
-                               const IPAddr& orig, const IPAddr& resp)
+bool Reporter::PermitNetWeird(WeirdInfo& w)
 	{
-	auto endpoints = std::make_pair(orig, resp);
-	auto& map = flow_weird_state[endpoints];
-
-	if ( map.empty() )
-		detail::timer_mgr->Add(new FlowWeirdTimer(run_state::network_time, endpoints,
-		                                          weird_sampling_duration));
-
-	auto& count = map[name];
-	++count;
-
-	if ( count <= weird_sampling_threshold )
-		return true;
+	if ( ++w.net_count == 1 )
+		detail::timer_mgr->Add(new NetWeirdTimer(run_state::network_time, w.name,
+		                                         weird_sampling_duration));
 
-	auto num_above_threshold = count - weird_sampling_threshold;
-	if ( weird_sampling_rate )
-		return num_above_threshold % weird_sampling_rate == 0;
-	else
-		return false;
+	return PermitWeirdCount(w.net_count);
 	}
 
-bool Reporter::PermitExpiredConnWeird(const char* name, const RecordVal& conn_id)
+bool Reporter::PermitFlowWeird(const WeirdInfo& w, const IPAddr& orig, const IPAddr& resp)
 	{
-	auto conn_tuple = std::make_tuple(conn_id.GetField("orig_h")->AsAddr(),
-	                                  conn_id.GetField("resp_h")->AsAddr(),
-	                                  conn_id.GetField("orig_p")->AsPortVal()->Port(),
-	                                  conn_id.GetField("resp_p")->AsPortVal()->Port(),
-	                                  conn_id.GetField("resp_p")->AsPortVal()->PortType());
+	struct {
+		uint32_t orig[4];
+		uint32_t resp[4];
+		uint32_t id;
+	} key;
 
-	auto& map = expired_conn_weird_state[conn_tuple];
+	orig.CopyIPv6(key.orig);
+	resp.CopyIPv6(key.resp);
+	key.id = w.id;
 
-	if ( map.empty() )
-		detail::timer_mgr->Add(new ConnTupleWeirdTimer(run_state::network_time,
-		                                               std::move(conn_tuple),
-		                                               weird_sampling_duration));
+	// Rather than a timer per flow, all counts expire together once per
+	// sampling duration.
+	flow_weird_counts.Expire(run_state::network_time, weird_sampling_duration);
+	auto count = flow_weird_counts.Increment(detail::HashKey::HashBytes(&key, sizeof(key)));
 
-	auto& count = map[name];
-	++count;
+	return PermitWeirdCount(count);
+	}
 
-	if ( count <= weird_sampling_threshold )
-		return true;
+bool Reporter::PermitExpiredConnWeird(const WeirdInfo& w, const RecordVal& conn_id)
+	{
+	struct {
+		uint32_t orig[4];
+		uint32_t resp[4];
+		uint32_t orig_p;
+		uint32_t resp_p;
+		uint32_t proto;
+		uint32_t id;
+	} key;
 
-	auto num_above_threshold = count - weird_sampling_threshold;
+	const auto& f = id::field::conn_id;
+	conn_id.GetField(f.orig_h)->AsAddr().CopyIPv6(key.orig);
+	conn_id.GetField(f.resp_h)->AsAddr().CopyIPv6(key.resp);
+	key.orig_p = conn_id.GetField(f.orig_p)->AsPortVal()->Port();
+	key.resp_p = conn_id.GetField(f.resp_p)->AsPortVal()->Port();
+	key.proto = conn_id.GetField(f.resp_p)->AsPortVal()->PortType();
+	key.id = w.id;
 
-	if ( weird_sampling_rate )
-		return num_above_threshold % weird_sampling_rate == 0;
-	else
-		return false;
+	expired_conn_weird_counts.Expire(run_state::network_time, weird_sampling_duration);
+	auto count = expired_conn_weird_counts.Increment(detail::HashKey::HashBytes(&key, sizeof(key)));
+
+	return PermitWeirdCount(count);
 	}
 
 void Reporter::Weird(const char* name, const char* addl, const char* source)
 	{
-	UpdateWeirdStats(name);
+	NetWeird(UpdateWeirdStats(name), addl, source);
+	}
+
+void Reporter::Weird(const detail::WeirdName& name, const char* addl, const char* source)
+	{
+	NetWeird(UpdateWeirdStats(name.ID()), addl, source);
+	}
 
-	if ( ! WeirdOnSamplingWhiteList(name) )
+void Reporter::NetWeird(WeirdInfo& w, const char* addl, const char* source)
+	{
+	if ( ! w.on_whitelist )
 		{
-		if ( ! PermitNetWeird(name) )
+		if ( ! PermitNetWeird(w) )
 			return;
 		}
 
-	WeirdHelper(net_weird, {new StringVal(addl), new StringVal(source)}, "%s", name);
+	WeirdHelper(net_weird, {new StringVal(addl), new StringVal(source)}, w);
 	}
 
 void Reporter::Weird(file_analysis::File* f, const char* name, const char* addl, const char* source)
 	{
-	UpdateWeirdStats(name);
+	FileWeird(f, UpdateWeirdStats(name), addl, source);
+	}
+
+void Reporter::Weird(file_analysis::File* f, const detail::WeirdName& name, const char* addl, const char* source)
+	{
+	FileWeird(f, UpdateWeirdStats(name.ID()), addl, source);
+	}
 
-	switch ( CheckGlobalWeirdLists(name) ) {
+void Reporter::FileWeird(file_analysis::File* f, WeirdInfo& w, const char* addl, const char* source)
+	{
+	switch ( CheckGlobalWeirdLists(w) ) {
 	case PermitWeird::Allow:
 		break;
 	case PermitWeird::Deny:
 		return;
 	case PermitWeird::Unknown:
-		if ( ! f->PermitWeird(name, weird_sampling_threshold,
+		if ( ! f->PermitWeird(w.id, weird_sampling_threshold,
 		                      weird_sampling_rate, weird_sampling_duration) )
 			return;
 	}
 
-	WeirdHelper(file_weird, {f->ToVal()->Ref(), new StringVal(addl), new StringVal(source)},
-	            "%s", name);
+	WeirdHelper(file_weird, {f->ToVal()->Ref(), new StringVal(addl), new StringVal(source)}, w);
 	}
 
 void Reporter::Weird(Connection* conn, const char* name, const char* addl, const char* source)
 	{
-	UpdateWeirdStats(name);
+	ConnWeird(conn, UpdateWeirdStats(name), addl, source);
+	}
+
+void Reporter::Weird(Connection* conn, const detail::WeirdName& name, const char* addl, const char* source)
+	{
+	ConnWeird(conn, UpdateWeirdStats(name.ID()), addl, source);
+	}
 
-	switch ( CheckGlobalWeirdLists(name) ) {
+void Reporter::ConnWeird(Connection* conn, WeirdInfo& w, const char* addl, const char* source)
+	{
+	switch ( CheckGlobalWeirdLists(w) ) {
 	case PermitWeird::Allow:
 		break;
 	case PermitWeird::Deny:
 		return;
 	case PermitWeird::Unknown:
-		if ( ! conn->PermitWeird(name, weird_sampling_threshold,
+		if ( ! conn->PermitWeird(w.id, weird_sampling_threshold,
 		                         weird_sampling_rate, weird_sampling_duration) )
 			return;
 	}
 
-	WeirdHelper(conn_weird, {conn->ConnVal()->Ref(), new StringVal(addl), new StringVal(source)},
-	            "%s", name);
+	WeirdHelper(conn_weird, {conn->ConnVal()->Ref(), new StringVal(addl), new StringVal(source)}, w);
 	}
 
 void Reporter::Weird(RecordValPtr conn_id, StringValPtr uid, const char* name,
                      const char* addl, const char* source)
 	{
-	UpdateWeirdStats(name);
+	auto& w = UpdateWeirdStats(name);
 
-	switch ( CheckGlobalWeirdLists(name) ) {
+	switch ( CheckGlobalWeirdLists(w) ) {
 	case PermitWeird::Allow:
 		break;
 	case PermitWeird::Deny:
 		return;
 	case PermitWeird::Unknown:
-		if ( ! PermitExpiredConnWeird(name, *conn_id) )
+		if ( ! PermitExpiredConnWeird(w, *conn_id) )
 			return;
 	}
 
 	WeirdHelper(expired_conn_weird,
 	            {conn_id.release(), uid.release(), new StringVal(addl), new StringVal(source)},
-	            "%s", name);
+	            w);
 	}
 
 void Reporter::Weird(const IPAddr& orig, const IPAddr& resp, const char* name, const char* addl, const char* source)
 	{
-	UpdateWeirdStats(name);
+	FlowWeird(orig, resp, UpdateWeirdStats(name), addl, source);
+	}
+
+void Reporter::Weird(const IPAddr& orig, const IPAddr& resp, const detail::WeirdName& name,
+                     const char* addl, const char* source)
+	{
+	FlowWeird(orig, resp, UpdateWeirdStats(name.ID()), addl, source);
+	}
 
-	switch ( CheckGlobalWeirdLists(name) ) {
+void Reporter::FlowWeird(const IPAddr& orig, const IPAddr& resp, WeirdInfo& w,
+                         const char* addl, const char* source)
+	{
+	switch ( CheckGlobalWeirdLists(w) ) {
 	case PermitWeird::Allow:
 		break;
 	case PermitWeird::Deny:
 		return;
 	case PermitWeird::Unknown:
-		if ( ! PermitFlowWeird(name, orig, resp) )
+		if ( ! PermitFlowWeird(w, orig, resp) )
 			 return;
 	}
 
 	WeirdHelper(flow_weird,
 	            {new AddrVal(orig), new AddrVal(resp), new StringVal(addl), new StringVal(source)},
-	            "%s", name);
+	            w);
 	}
 
 void Reporter::DoLog(const char* prefix, EventHandlerPtr event, FILE* out,
                      Connection* conn, ValPList* addl, bool location, bool time,
                      const char* postfix, const char* fmt, va_list ap)
 	{
+	uint64_t suppressed = 0;
+
+	// Fatal and internal errors, which come without an event, always go
+	// out.  The others can be suppressed before any formatting.
+	if ( event.Ptr() && ! PermitMessage(prefix, fmt, &suppressed) )
+		{
+		if ( addl )
+			{
+			for ( const auto& av : *addl )
+				Unref(av);
+			}
+
+		return;
+		}
+
 	static char tmp[512];
 
 	int size = sizeof(tmp);
@@ -553,6 +649,9 @@ void Reporter::DoLog(const char* prefix, EventHandlerPtr event, FILE* out,
 		if ( postfix )
 			n += strlen(postfix) + 10; // Add a bit of slack.
 
+		if ( suppressed )
+			n += 64;
+
 		if ( n > -1 && n < size )
 			// We had enough space;
 			break;
@@ -570,6 +669,12 @@ void Reporter::DoLog(const char* prefix, EventHandlerPtr event, FILE* out,
 		// buffer size above.
 		snprintf(buffer + strlen(buffer), size - strlen(buffer), " (%s)", postfix);
 
+	if ( suppressed )
+		// Again, adjust the additional buffer size above when changing
+		// this.
+		snprintf(buffer + strlen(buffer), size - strlen(buffer),
+		         " [%" PRIu64 " similar messages suppressed]", suppressed);
+
 	bool raise_event = true;
 
 	if ( via_events && ! in_error_handler )
@@ -653,8 +758,7 @@ void Reporter::DoLog(const char* prefix, EventHandlerPtr event, FILE* out,
 		s += buffer;
 		s += "\n";
 
-		if ( out )
-			fprintf(out, "%s", s.c_str());
+		EmitLine(out, std::move(s));
 		}
 
 	if ( alloced )
@@ -666,5 +770,124 @@ bool Reporter::EmitToStderr(bool flag)
 	return flag || ! run_state::detail::zeek_init_done;
 	}
 
+bool Reporter::PermitMessage(const char* prefix, const char* fmt, uint64_t* suppressed)
+	{
+	// Nothing gets suppressed during startup, for not hiding why it
+	// may fail.
+	if ( ! rate_limit || ! run_state::detail::zeek_init_done )
+		return true;
+
+	MessageSite site{fmt, prefix, nullptr, nullptr};
+
+	if ( locations.size() )
+		{
+		site.loc1 = locations.back().first;
+		site.loc2 = locations.back().second;
+		}
+
+	double now = run_state::network_time ? run_state::network_time : util::current_time();
+	auto& s = message_sites[site];
+
+	if ( s.count && now - s.start < rate_limit_interval )
+		{
+		if ( s.count < rate_limit )
+			{
+			++s.count;
+			return true;
+			}
+
+		++s.suppressed;
+		++suppressed_count;
+		return false;
+		}
+
+	*suppressed = s.suppressed;
+	s.start = now;
+	s.count = 1;
+	s.suppressed = 0;
+
+	// Locations created at runtime could grow the table without bounds,
+	// so it sheds the places that have gone quiet once it gets large.
+	if ( message_sites.size() > 10000 )
+		{
+		for ( auto it = message_sites.begin(); it != message_sites.end(); )
+			{
+			if ( now - it->second.start >= rate_limit_interval )
+				it = message_sites.erase(it);
+			else
+				++it;
+			}
+		}
+
+	return true;
+	}
+
+void Reporter::EmitLine(FILE* out, std::string line)
+	{
+	if ( ! out )
+		return;
+
+	if ( out != stderr || ! stderr_writer.joinable() )
+		{
+		fprintf(out, "%s", line.c_str());
+		return;
+		}
+
+	std::lock_guard<std::mutex> lock(stderr_mutex);
+
+	if ( stderr_lines.size() >= stderr_queue_size )
+		{
+		++stderr_dropped;
+		++stderr_dropped_count;
+		return;
+		}
+
+	if ( stderr_dropped )
+		{
+		stderr_lines.emplace_back(util::fmt("%" PRIu64 " messages not written to stderr due to a full queue\n",
+		                                    stderr_dropped));
+		stderr_dropped = 0;
+		}
+
+	stderr_lines.emplace_back(std::move(line));
+	stderr_have_lines.notify_one();
+	}
+
+void Reporter::WriteStderrLines()
+	{
+	std::unique_lock<std::mutex> lock(stderr_mutex);
+
+	while ( true )
+		{
+		stderr_have_lines.wait(lock, [this] { return stderr_done || ! stderr_lines.empty(); });
+
+		if ( stderr_lines.empty() )
+			return;
+
+		auto lines = std::move(stderr_lines);
+		stderr_lines.clear();
+		lock.unlock();
+
+		for ( const auto& l : lines )
+			fputs(l.c_str(), stderr);
+
+		lock.lock();
+		}
+	}
+
+void Reporter::StopStderrWriter()
+	{
+	if ( ! stderr_writer.joinable() )
+		return;
+
+		{
+		std::lock_guard<std::mutex> lock(stderr_mutex);
+		stderr_done = true;
+		}
+
+	stderr_have_lines.notify_one();
+	stderr_writer.join();
+	}
+
 
 } // namespace zeek
@@ -4,16 +4,23 @@
 
 #include <stdarg.h>
 
+#include <condition_variable>
+#include <deque>
 #include <list>
+#include <mutex>
+#include <thread>
 #include <utility>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <map>
 #include <unordered_set>
 #include <unordered_map>
 
+#include "zeek/IntrusivePtr.h"
 #include "zeek/ZeekList.h"
 #include "zeek/net_util.h"
+#include "zeek/WeirdState.h"
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(Analyzer, zeek, analyzer);
 ZEEK_FORWARD_DECLARE_NAMESPACED(File, zeek, file_analysis);
@@ -27,7 +34,6 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(Expr, zeek::detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Reporter, zeek);
 
 namespace zeek {
-template <class T> class IntrusivePtr;
 using RecordValPtr = IntrusivePtr<RecordVal>;
 using StringValPtr = IntrusivePtr<StringVal>;
 
@@ -105,6 +111,24 @@ public:
 	void Weird(const IPAddr& orig, const IPAddr& resp, const char* name,
 	           const char* addl = "", const char* source = "");	// Raises flow_weird().
 
+	// The same for names known at compile time, which skip looking up
+	// the name.
+	void Weird(const detail::WeirdName& name, const char* addl = "",
+	           const char* source = "");
+	void Weird(file_analysis::File* f, const detail::WeirdName& name,
+	           const char* addl = "", const char* source = "");
+	void Weird(Connection* conn, const detail::WeirdName& name,
+	           const char* addl = "", const char* source = "");
+	void Weird(const IPAddr& orig, const IPAddr& resp, const detail::WeirdName& name,
+	           const char* addl = "", const char* source = "");
+
+	/**
+	 * Returns the ID of a weird name, which identifies it in the weird
+	 * sampling state.  IDs get assigned at a name's first use, and stay
+	 * the same for the remainder of the process.
+	 */
+	uint32_t WeirdID(const char* name);
+
 	// Syslog a message. This methods does nothing if we're running
 	// offline from a trace.
 	void Syslog(const char* fmt, ...) FMT_ATTR;
@@ -154,12 +178,14 @@ public:
 	/**
 	 * Reset/cleanup state tracking for a "flow" weird.
 	 */
-	void ResetFlowWeird(const IPAddr& orig, const IPAddr& resp);
+	[[deprecated("Remove in v5.1. Flow weird state now expires in batches.")]]
+	void ResetFlowWeird(const IPAddr& orig, const IPAddr& resp)	{ }
 
 	/**
 	 * Reset/cleanup state tracking for a "expired conn" weird.
 	 */
-	void ResetExpiredConnWeird(const ConnTuple& id);
+	[[deprecated("Remove in v5.1. Expired conn weird state now expires in batches.")]]
+	void ResetExpiredConnWeird(const ConnTuple& id)	{ }
 
 	/**
 	 * Return the total number of weirds generated (counts weirds before
@@ -172,8 +198,21 @@ public:
 	 * Return number of weirds generated per weird type/name (counts weirds
 	 * before any rate-limiting occurs).
 	 */
-	const WeirdCountMap& GetWeirdsByType() const
-		{ return weird_count_by_type; }
+	WeirdCountMap GetWeirdsByType() const;
+
+	/**
+	 * Return the total number of messages that Reporter::rate_limit
+	 * suppressed.
+	 */
+	uint64_t GetSuppressedCount() const
+		{ return suppressed_count; }
+
+	/**
+	 * Return the total number of messages that didn't make it to stderr
+	 * because the queue sized by Reporter::stderr_queue_size was full.
+	 */
+	uint64_t GetStderrDroppedCount() const
+		{ return stderr_dropped_count; }
 
 	/**
 	 * Gets the weird sampling whitelist.
@@ -191,6 +230,7 @@ public:
 	void SetWeirdSamplingWhitelist(WeirdSet weird_sampling_whitelist)
 		{
 		this->weird_sampling_whitelist = std::move(weird_sampling_whitelist);
+		UpdateWeirdLists();
 		}
 
 	/**
@@ -209,6 +249,7 @@ public:
 	void SetWeirdSamplingGlobalList(WeirdSet weird_sampling_global_list)
 		{
 		this->weird_sampling_global_list = std::move(weird_sampling_global_list);
+		UpdateWeirdLists();
 		}
 
 	/**
@@ -277,20 +318,87 @@ private:
 		   Connection* conn, ValPList* addl, bool location, bool time,
 		   const char* postfix, const char* fmt, va_list ap) __attribute__((format(printf, 10, 0)));
 
-	// WeirdHelper doesn't really have to be variadic, but it calls DoLog
-	// and that takes va_list anyway.
-	void WeirdHelper(EventHandlerPtr event, ValPList vl, const char* fmt_name, ...) __attribute__((format(printf, 4, 5)));;
-	void UpdateWeirdStats(const char* name);
-	inline bool WeirdOnSamplingWhiteList(const char* name)
-		{ return weird_sampling_whitelist.find(name) != weird_sampling_whitelist.end(); }
-	inline bool WeirdOnGlobalList(const char* name)
-		{ return weird_sampling_global_list.find(name) != weird_sampling_global_list.end(); }
-	bool PermitNetWeird(const char* name);
-	bool PermitFlowWeird(const char* name, const IPAddr& o, const IPAddr& r);
-	bool PermitExpiredConnWeird(const char* name, const RecordVal& conn_id);
+	// Whether a message may go out under Reporter::rate_limit, going by
+	// its format string and the current script location.  Sets
+	// suppressed to the number of messages suppressed since the last
+	// one from the same place that got through.
+	bool PermitMessage(const char* prefix, const char* fmt, uint64_t* suppressed);
+
+	// Writes a line to the given stream, by way of the stderr writer
+	// thread if there is one.
+	void EmitLine(FILE* out, std::string line);
+
+	// The body of the stderr writer thread.
+	void WriteStderrLines();
+
+	// Writes out what's still queued for stderr and stops the thread.
+	void StopStderrWriter();
+
+	// A place that messages come from, for rate-limiting.
+	struct MessageSite {
+		const char* fmt;
+		const char* prefix;
+		const detail::Location* loc1;
+		const detail::Location* loc2;
+
+		bool operator==(const MessageSite& o) const
+			{
+			return fmt == o.fmt && prefix == o.prefix &&
+			       loc1 == o.loc1 && loc2 == o.loc2;
+			}
+	};
+
+	struct MessageSiteHash {
+		size_t operator()(const MessageSite& s) const
+			{
+			auto h = std::hash<const void*>{};
+			return h(s.fmt) ^ (h(s.loc1) << 1) ^ (h(s.loc2) << 2) ^ (h(s.prefix) << 3);
+			}
+	};
+
+	struct MessageSiteState {
+		double start = 0;	// Start of the current interval.
+		uint64_t count = 0;	// Messages let through in the interval.
+		uint64_t suppressed = 0;	// Messages suppressed in the interval.
+	};
+
+	// What's known about the weirds of a name.  Its ID is the index of
+	// the entry in weird_names.
+	struct WeirdInfo {
+		std::string name;
+		uint32_t id = 0;
+		uint64_t count = 0;	// Before any rate-limiting.
+		uint64_t net_count = 0;	// Since the last reset.
+		bool on_whitelist = false;
+		bool on_global_list = false;
+		StringValPtr val;	// The name, once an event needed it.
+	};
+
+	// Raises a weird event with the name and the additional arguments,
+	// or leaves it to a plugin's reporter hook.
+	void WeirdHelper(EventHandlerPtr event, ValPList vl, WeirdInfo& w);
+
+	// Count the weird and return the entry for its name.
+	WeirdInfo& UpdateWeirdStats(const char* name)
+		{ return UpdateWeirdStats(WeirdID(name)); }
+	WeirdInfo& UpdateWeirdStats(uint32_t id);
+
+	void NetWeird(WeirdInfo& w, const char* addl, const char* source);
+	void FileWeird(file_analysis::File* f, WeirdInfo& w,
+	               const char* addl, const char* source);
+	void ConnWeird(Connection* conn, WeirdInfo& w,
+	               const char* addl, const char* source);
+	void FlowWeird(const IPAddr& orig, const IPAddr& resp, WeirdInfo& w,
+	               const char* addl, const char* source);
+
+	void UpdateWeirdLists();
+	bool PermitWeirdCount(uint64_t count) const;
+	bool PermitNetWeird(WeirdInfo& w);
+	bool PermitFlowWeird(const WeirdInfo& w, const IPAddr& o, const IPAddr& r);
+	bool PermitExpiredConnWeird(const WeirdInfo& w, const RecordVal& conn_id);
 
 	enum class PermitWeird { Allow, Deny, Unknown };
-	PermitWeird CheckGlobalWeirdLists(const char* name);
+	PermitWeird CheckGlobalWeirdLists(WeirdInfo& w);
 
 	bool EmitToStderr(bool flag);
 
@@ -305,10 +413,11 @@ private:
 	std::list<std::pair<const detail::Location*, const detail::Location*> > locations;
 
 	uint64_t weird_count;
-	WeirdCountMap weird_count_by_type;
-	WeirdCountMap net_weird_state;
-	WeirdFlowMap flow_weird_state;
-	WeirdConnTupleMap expired_conn_weird_state;
+	// A deque, since weird_ids refers to the names' strings.
+	std::deque<WeirdInfo> weird_names;
+	std::unordered_map<std::string_view, uint32_t> weird_ids;
+	detail::WeirdCounts flow_weird_counts;
+	detail::WeirdCounts expired_conn_weird_counts;
 
 	WeirdSet weird_sampling_whitelist;
 	WeirdSet weird_sampling_global_list;
@@ -316,6 +425,23 @@ private:
 	uint64_t weird_sampling_rate;
 	double weird_sampling_duration;
 
+	uint64_t rate_limit = 0;
+	double rate_limit_interval = 0;
+	uint64_t suppressed_count = 0;
+	std::unordered_map<MessageSite, MessageSiteState, MessageSiteHash> message_sites;
+
+	// With Reporter::stderr_queue_size set, a thread writes the messages
+	// to stderr, so that a slow terminal or pipe doesn't stall the
+	// analysis.  Fatal errors still go out right away.
+	size_t stderr_queue_size = 0;
+	std::deque<std::string> stderr_lines;
+	uint64_t stderr_dropped = 0;	// Since the last line that got queued.
+	uint64_t stderr_dropped_count = 0;
+	bool stderr_done = false;
+	std::mutex stderr_mutex;
+	std::condition_variable stderr_have_lines;
+	std::thread stderr_writer;
+
 };
 
 extern Reporter* reporter;
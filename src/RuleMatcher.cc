@@ -3,6 +3,7 @@
 #include "zeek/RuleMatcher.h"
 
 #include <algorithm>
+#include <climits>
 #include <functional>
 
 #include "zeek/RuleAction.h"
@@ -23,6 +24,8 @@
 #include "zeek/Var.h"
 #include "zeek/IPAddr.h"
 #include "zeek/RunState.h"
+#include "zeek/LiteralPrefilter.h"
+#include "zeek/FileMagicIndex.h"
 
 using namespace std;
 
@@ -141,6 +144,7 @@ RuleHdrTest::~RuleHdrTest()
 		for ( auto pset : psets[i] )
 			{
 			delete pset->re;
+			delete pset->prefilter;
 			delete pset;
 			}
 		}
@@ -227,6 +231,7 @@ RuleMatcher::RuleMatcher(int arg_RE_level)
 	RE_level = arg_RE_level;
 	parse_error = false;
 	has_non_file_magic_rule = false;
+	file_magic_index = nullptr;
 	}
 
 RuleMatcher::~RuleMatcher()
@@ -235,6 +240,7 @@ RuleMatcher::~RuleMatcher()
 	DumpStats(stderr);
 #endif
 	Delete(root);
+	delete file_magic_index;
 
 	for ( auto rule : rules )
 		delete rule;
@@ -401,7 +407,7 @@ void RuleMatcher::BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs,
 		{
 		for ( int i = 0; i < Rule::TYPES; ++i )
 			if ( exprs[i].length() )
-				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i]);
+				BuildPatternSets(hdr_test, i, exprs[i], ids[i]);
 		}
 
 	// Get the patterns on all of our children.
@@ -428,17 +434,90 @@ void RuleMatcher::BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs,
 		{
 		for ( int i = 0; i < Rule::TYPES; ++i )
 			if ( exprs[i].length() )
-				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i]);
+				BuildPatternSets(hdr_test, i, exprs[i], ids[i]);
 		}
 
 	// If we're below the RE_level, the regexprs remains empty.
 	}
 
-void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
+void RuleMatcher::BuildPatternSets(RuleHdrTest* hdr_test, int type,
                                    const string_list& exprs, const int_list& ids)
 	{
 	assert(static_cast<size_t>(exprs.length()) == ids.size());
 
+	RuleHdrTest::pattern_set_list* dst = &hdr_test->psets[type];
+
+	if ( type == Rule::FILE_MAGIC )
+		{
+		// Only the root's file magic patterns get matched, see
+		// InitFileMagic().
+		if ( hdr_test != root || ! BifConst::sig_file_magic_index )
+			{
+			BuildPatternGroups(dst, exprs, ids, false);
+			return;
+			}
+
+		if ( ! file_magic_index )
+			file_magic_index = new FileMagicIndex();
+
+		string_list group_exprs;
+		int_list group_ids;
+
+		loop_over_list(exprs, i)
+			{
+			if ( ! file_magic_index->Add(exprs[i], ids[i]) )
+				{
+				group_exprs.push_back(exprs[i]);
+				group_ids.push_back(ids[i]);
+				}
+			}
+
+		if ( group_exprs.length() )
+			BuildPatternGroups(dst, group_exprs, group_ids, false);
+
+		return;
+		}
+
+	if ( ! BifConst::sig_literal_prefilter )
+		{
+		BuildPatternGroups(dst, exprs, ids, false);
+		return;
+		}
+
+	// Patterns starting with ".*<literal>" need not run before the
+	// literal shows up.  That only helps if all of a group's patterns
+	// are like that, so they get grouped separately.
+	string_list plain_exprs, literal_exprs;
+	int_list plain_ids, literal_ids;
+
+	loop_over_list(exprs, i)
+		{
+		std::string lit;
+		bool nocase;
+
+		if ( LiteralPrefilter::LeadingLiteral(exprs[i], &lit, &nocase) )
+			{
+			literal_exprs.push_back(exprs[i]);
+			literal_ids.push_back(ids[i]);
+			}
+		else
+			{
+			plain_exprs.push_back(exprs[i]);
+			plain_ids.push_back(ids[i]);
+			}
+		}
+
+	if ( plain_exprs.length() )
+		BuildPatternGroups(dst, plain_exprs, plain_ids, false);
+
+	if ( literal_exprs.length() )
+		BuildPatternGroups(dst, literal_exprs, literal_ids, true);
+	}
+
+void RuleMatcher::BuildPatternGroups(RuleHdrTest::pattern_set_list* dst,
+                                     const string_list& exprs, const int_list& ids,
+                                     bool prefilter)
+	{
 	// We build groups of at most sig_max_group_size regexps.
 
 	string_list group_exprs;
@@ -459,6 +538,20 @@ void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
 				new RuleHdrTest::PatternSet;
 			set->re = new Specific_RE_Matcher(MATCH_EXACTLY, 1);
 			set->re->CompileSet(group_exprs, group_ids);
+
+			if ( prefilter && group_exprs.length() )
+				{
+				set->prefilter = new LiteralPrefilter();
+
+				for ( const auto& e : group_exprs )
+					{
+					std::string lit;
+					bool nocase;
+					LiteralPrefilter::LeadingLiteral(e, &lit, &nocase);
+					set->prefilter->Add(lit, nocase);
+					}
+				}
+
 			set->patterns = group_exprs;
 			set->ids = group_ids;
 			dst->push_back(set);
@@ -690,13 +783,18 @@ RuleMatcher::MIME_Matches* RuleMatcher::Match(RuleFileMagicState* state,
 			newmatch = true;
 		}
 
+	AcceptingMatchSet accepted_matches;
+
+	if ( file_magic_index &&
+	     file_magic_index->Match(data, std::min(len, static_cast<uint64_t>(INT_MAX)),
+	                             &accepted_matches) )
+		newmatch = true;
+
 	if ( ! newmatch )
 		return rval;
 
 	DBG_LOG(DBG_RULES, "New pattern match found");
 
-	AcceptingMatchSet accepted_matches;
-
 	for ( const auto& m : state->matchers )
 		{
 		const AcceptingMatchSet& ams = m->state->AcceptedMatches();
@@ -782,6 +880,8 @@ RuleEndpointState* RuleMatcher::InitEndpoint(analyzer::Analyzer* analyzer,
 					auto* m = new RuleEndpointState::Matcher;
 					m->state = new RE_Match_State(set->re);
 					m->type = (Rule::PatternType) i;
+					m->prefilter = set->prefilter;
+					m->active = ! set->prefilter;
 					state->matchers.push_back(m);
 					}
 				}
@@ -894,9 +994,17 @@ void RuleMatcher::Match(RuleEndpointState* state, Rule::PatternType type,
 	// Feed data into all relevant matchers.
 	for ( const auto& m : state->matchers )
 		{
-		if ( m->type == type &&
-		     m->state->Match((const u_char*) data, data_len,
-					bol, eol, clear) )
+		if ( m->type != type )
+			continue;
+
+		if ( m->prefilter )
+			{
+			if ( MatchPrefiltered(m, data, data_len, bol, eol, clear) )
+				newmatch = true;
+			}
+
+		else if ( m->state->Match((const u_char*) data, data_len,
+		                          bol, eol, clear) )
 			newmatch = true;
 		}
 
@@ -975,6 +1083,77 @@ void RuleMatcher::Match(RuleEndpointState* state, Rule::PatternType type,
 		}
 	}
 
+bool RuleMatcher::MatchPrefiltered(RuleEndpointState::Matcher* m, const u_char* data,
+                                   int data_len, bool bol, bool eol, bool clear)
+	{
+	if ( clear )
+		{
+		m->active = false;
+		m->tail.clear();
+		}
+
+	if ( m->active )
+		return m->state->Match(data, data_len, bol, eol, false);
+
+	const LiteralPrefilter* pf = m->prefilter;
+	size_t keep = pf->MaxLen() - 1;
+	bool newmatch = false;
+
+	// Matching restarts from the DFA's start state once a literal shows
+	// up; the patterns' leading ".*" would have consumed everything up
+	// to there.
+	if ( ! m->tail.empty() )
+		{
+		// The literal may start in what we saw before.
+		std::string junction = m->tail;
+		junction.append(reinterpret_cast<const char*>(data),
+		                std::min(static_cast<size_t>(data_len), keep));
+
+		int i = pf->Find(reinterpret_cast<const u_char*>(junction.data()),
+		                 junction.size(), m->tail.size());
+
+		if ( i >= 0 )
+			{
+			m->active = true;
+			newmatch = m->state->Match(reinterpret_cast<const u_char*>(m->tail.data()) + i,
+			                           m->tail.size() - i, false, false, true);
+			m->tail.clear();
+
+			if ( m->state->Match(data, data_len, false, eol, false) )
+				newmatch = true;
+
+			return newmatch;
+			}
+		}
+
+	int i = pf->Find(data, data_len);
+
+	if ( i >= 0 )
+		{
+		m->active = true;
+		m->tail.clear();
+
+		// Report positions as if matching had started at the
+		// beginning of the data, including its BOL.
+		if ( i == 0 )
+			return m->state->Match(data, data_len, bol, eol, true);
+
+		return m->state->Match(data + i, data_len - i, false, eol, true, i + (bol ? 1 : 0));
+		}
+
+	if ( static_cast<size_t>(data_len) >= keep )
+		m->tail.assign(reinterpret_cast<const char*>(data) + data_len - keep, keep);
+	else
+		{
+		m->tail.append(reinterpret_cast<const char*>(data), data_len);
+
+		if ( m->tail.size() > keep )
+			m->tail.erase(0, m->tail.size() - keep);
+		}
+
+	return false;
+	}
+
 void RuleMatcher::FinishEndpoint(RuleEndpointState* state)
 	{
 	// Send EOL to payload matchers.
@@ -1127,7 +1306,11 @@ void RuleMatcher::ClearEndpointState(RuleEndpointState* state)
 	state->payload_size = -1;
 
 	for ( const auto& matcher : state->matchers )
+		{
 		matcher->state->Clear();
+		matcher->active = ! matcher->prefilter;
+		matcher->tail.clear();
+		}
 	}
 
 void RuleMatcher::ClearFileMagicState(RuleFileMagicState* state) const
@@ -1202,6 +1385,8 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 		stats->hits = 0;
 		stats->misses = 0;
 		stats->nfa_states = 0;
+		stats->evictions = 0;
+		stats->build_time = 0;
 		hdr_test = root;
 		}
 
@@ -1222,6 +1407,8 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 			stats->hits += cstats.hits;
 			stats->misses += cstats.misses;
 			stats->nfa_states += cstats.nfa_states;
+			stats->evictions += cstats.evictions;
+			stats->build_time += cstats.build_time;
 			}
 		}
 
@@ -1238,8 +1425,9 @@ void RuleMatcher::DumpStats(File* f)
 	                         "computed trans. = %d; matchers = %d; mem = %d\n",
 	                         run_state::network_time, stats.dfa_states, stats.computed,
 	                         stats.matchers, stats.mem));
-	f->Write(util::fmt("%.6f DFA cache hits = %d; misses = %d\n", run_state::network_time,
-	                         stats.hits, stats.misses));
+	f->Write(util::fmt("%.6f DFA cache hits = %d; misses = %d; evictions = %d; build time = %.6fs\n",
+	                         run_state::network_time, stats.hits, stats.misses,
+	                         stats.evictions, stats.build_time));
 
 	DumpStateStats(f, root);
 	}
@@ -1256,9 +1444,15 @@ void RuleMatcher::DumpStateStats(File* f, RuleHdrTest* hdr_test)
 			RuleHdrTest::PatternSet* set = hdr_test->psets[i][j];
 			assert(set->re);
 
-			f->Write(util::fmt("%.6f %d DFA states in %s group %d from sigs ",
+			DFA_State_Cache::Stats cstats;
+			set->re->DFA()->Cache()->GetStats(&cstats);
+
+			f->Write(util::fmt("%.6f %d DFA states (%dK, hits = %d, misses = %d, "
+			                   "evictions = %d, build time = %.6fs) in %s group %d from sigs ",
 			                   run_state::network_time,
-			                   set->re->DFA()->NumStates(),
+			                   set->re->DFA()->NumStates(), cstats.mem / 1024,
+			                   cstats.hits, cstats.misses, cstats.evictions,
+			                   cstats.build_time,
 			                   Rule::TypeToString((Rule::PatternType)i), j));
 
 			for ( const auto& id : set->ids )
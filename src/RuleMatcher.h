@@ -38,6 +38,8 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(Val, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Analyzer, zeek, analyzer);
 ZEEK_FORWARD_DECLARE_NAMESPACED(IntSet, zeek::detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(PIA, zeek, analyzer::pia);
+ZEEK_FORWARD_DECLARE_NAMESPACED(LiteralPrefilter, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(FileMagicIndex, zeek::detail);
 
 namespace zeek::detail {
 
@@ -104,7 +106,7 @@ private:
 	friend class RuleMatcher;
 
 	struct PatternSet {
-		PatternSet() : re() {}
+		PatternSet() : re(), prefilter() {}
 
 		// If we're above the 'RE_level' (see RuleMatcher), this
 		// expr contains all patterns on this node. If we're on
@@ -112,6 +114,11 @@ private:
 		// of any of its children.
 		Specific_RE_Matcher* re;
 
+		// If set, all patterns have the form ".*<literal>...", and
+		// this finds where the first of the literals occurs.
+		// Matching then starts there, rather than right away.
+		LiteralPrefilter* prefilter;
+
 		// All the patterns and their rule indices.
 		string_list patterns;
 		int_list ids;	// (only needed for debugging)
@@ -164,6 +171,13 @@ private:
 	struct Matcher {
 		RE_Match_State* state;
 		Rule::PatternType type;
+
+		// See RuleHdrTest::PatternSet.  Until the prefilter finds a
+		// literal, data doesn't go into the state, and the matcher
+		// keeps the last bytes seen in case a literal starts there.
+		const LiteralPrefilter* prefilter;
+		bool active;
+		std::string tail;
 	};
 
 	using matcher_list = PList<Matcher>;
@@ -302,6 +316,10 @@ public:
 		// # cache hits (sampled, multiply by MOVE_TO_FRONT_SAMPLE_SIZE)
 		unsigned int hits;
 		unsigned int misses;	// # cache misses
+
+		// # DFA states dropped due to the memory limit
+		unsigned int evictions;
+		double build_time;	// seconds spent computing DFA states
 	};
 
 	Val* BuildRuleStateValue(const Rule* rule,
@@ -324,10 +342,22 @@ private:
 	// Traverse tree building the combined regular expressions.
 	void BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs, int_list* ids);
 
-	// Build groups of regular epxressions.
-	void BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
+	// Build groups of regular epxressions for the patterns of the given
+	// type.  Patterns suitable for a prefilter get their own groups,
+	// and file magic patterns suitable for the file magic index go
+	// there instead.
+	void BuildPatternSets(RuleHdrTest* hdr_test, int type,
 				const string_list& exprs, const int_list& ids);
 
+	void BuildPatternGroups(RuleHdrTest::pattern_set_list* dst,
+				const string_list& exprs, const int_list& ids,
+				bool prefilter);
+
+	// Feeds data into a matcher with a prefilter.  Returns true if
+	// there's a new match.
+	bool MatchPrefiltered(RuleEndpointState::Matcher* m, const u_char* data,
+				int data_len, bool bol, bool eol, bool clear);
+
 	// Check an arbitrary rule if it's satisfied right now.
 	// eos signals end of stream
 	void ExecRule(Rule* rule, RuleEndpointState* state, bool eos);
@@ -360,6 +390,7 @@ private:
 	bool has_non_file_magic_rule;
 	bool parse_error;
 	RuleHdrTest* root;
+	FileMagicIndex* file_magic_index;	// Set with sig_file_magic_index.
 	rule_list rules;
 	rule_dict rules_by_id;
 };
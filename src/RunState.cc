@@ -31,6 +31,9 @@ extern "C" {
 #include "zeek/Reporter.h"
 #include "zeek/Scope.h"
 #include "zeek/Anon.h"
+#include "zeek/Reassem.h"
+#include "zeek/ScriptProfile.h"
+#include "zeek/PipelineStats.h"
 #include "zeek/iosource/Manager.h"
 #include "zeek/iosource/PktSrc.h"
 #include "zeek/iosource/PktDumper.h"
@@ -159,12 +162,21 @@ void init_run(const std::optional<std::string>& interface,
 		reading_live = true;
 		reading_traces = false;
 
-		iosource::PktSrc* ps = iosource_mgr->OpenPktSrc(*interface, true);
-		assert(ps);
+		// Repeated -i options and the interfaces variable separate
+		// several interfaces with spaces.
+		for ( auto name : util::tokenize_string(*interface, ' ') )
+			{
+			if ( name.empty() )
+				continue;
 
-		if ( ! ps->IsOpen() )
-			reporter->FatalError("problem with interface %s (%s)",
-			                           interface->c_str(), ps->ErrorMsg());
+			std::string iface(name);
+			iosource::PktSrc* ps = iosource_mgr->OpenPktSrc(iface, true);
+			assert(ps);
+
+			if ( ! ps->IsOpen() )
+				reporter->FatalError("problem with interface %s (%s)",
+				                     iface.c_str(), ps->ErrorMsg());
+			}
 		}
 
 	else
@@ -205,6 +217,7 @@ void init_run(const std::optional<std::string>& interface,
 void expire_timers()
 	{
 	zeek::detail::SegmentProfiler prof(zeek::detail::segment_logger, "expiring-timers");
+	zeek::detail::StageTimer timer(zeek::detail::PipelineStats::TIMER_EXPIRY);
 
 	current_dispatched +=
 		zeek::detail::timer_mgr->Advance(network_time,
@@ -255,6 +268,7 @@ void dispatch_packet(Packet* pkt, iosource::PktSrc* pkt_src)
 		}
 
 	packet_mgr->ProcessPacket(pkt);
+	Reassembler::CheckMemoryLimit();
 	event_mgr.Drain();
 
 	if ( sp )
@@ -312,7 +326,7 @@ void run_loop()
 				{
 				DBG_LOG(DBG_MAINLOOP, "processing source %s", src->Tag());
 				current_iosrc = src;
-				src->Process();
+				iosource_mgr->ProcessSource(src);
 				}
 			}
 		else if ( (have_pending_timers || communication_enabled ||
@@ -329,6 +343,9 @@ void run_loop()
 
 		event_mgr.Drain();
 
+		if ( zeek::detail::script_profile_mgr )
+			zeek::detail::script_profile_mgr->CheckReportRequest();
+
 		processing_start_time = 0.0;	// = "we're not processing now"
 		current_dispatched = 0;
 		current_iosrc = nullptr;
@@ -367,11 +384,13 @@ void run_loop()
 
 void get_final_stats()
 	{
-	iosource::PktSrc* ps = iosource_mgr->GetPktSrc();
-	if ( ps && ps->IsLive() )
+	for ( auto ps : iosource_mgr->GetPktSrcs() )
 		{
+		if ( ! ps->IsLive() )
+			continue;
+
 		iosource::PktSrc::Stats s;
-		ps->Statistics(&s);
+		ps->GetStatistics(&s);
 		double dropped_pct = s.dropped > 0.0 ? ((double)s.dropped / ((double)s.received + (double)s.dropped)) * 100.0 : 0.0;
 		reporter->Info("%" PRIu64 " packets received on interface %s, %" PRIu64 " (%.2f%%) dropped",
 		                     s.received, ps->Path().c_str(), s.dropped, dropped_pct);
@@ -385,7 +404,10 @@ void finish_run(int drain_events)
 	if ( drain_events )
 		{
 		if ( sessions )
+			{
+			sessions->SaveHandoff();
 			sessions->Drain();
+			}
 
 		event_mgr.Drain();
 
@@ -0,0 +1,192 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/SYNTable.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+SYNTable::SYNTable(size_t max_attempts)
+	{
+	pool.resize(max_attempts);
+	free_entries.reserve(max_attempts);
+
+	for ( size_t i = max_attempts; i > 0; --i )
+		free_entries.push_back(i - 1);
+
+	// At most half of the slots get used, which keeps probe sequences
+	// short.
+	size_t capacity = 64;
+
+	while ( capacity < 2 * max_attempts )
+		capacity *= 2;
+
+	slots.resize(capacity);
+	mask = capacity - 1;
+	}
+
+size_t SYNTable::Find(const ConnIDKey& key, hash64_t hash) const
+	{
+	size_t i = hash & mask;
+
+	for ( ; slots[i].entry; i = (i + 1) & mask )
+		{
+		if ( slots[i].hash == hash && pool[slots[i].entry - 1].attempt.key == key )
+			break;
+		}
+
+	return i;
+	}
+
+SYNTable::Attempt* SYNTable::Lookup(const ConnIDKey& key)
+	{
+	if ( ! num_attempts )
+		return nullptr;
+
+	const Slot& s = slots[Find(key, HashKey(key))];
+	return s.entry ? &pool[s.entry - 1].attempt : nullptr;
+	}
+
+SYNTable::Attempt* SYNTable::Insert(const ConnIDKey& key, double expire)
+	{
+	if ( free_entries.empty() )
+		return nullptr;
+
+	hash64_t hash = HashKey(key);
+	size_t i = Find(key, hash);
+
+	if ( slots[i].entry )
+		return nullptr;
+
+	uint32_t n = free_entries.back();
+	free_entries.pop_back();
+
+	Entry& e = pool[n];
+	e.attempt.key = key;
+	e.expire = expire;
+	e.used = true;
+
+	slots[i].hash = hash;
+	slots[i].entry = n + 1;
+	++num_attempts;
+
+	expirations.push_back({n, e.generation});
+	return &e.attempt;
+	}
+
+void SYNTable::RemoveSlot(size_t i)
+	{
+	Entry& e = pool[slots[i].entry - 1];
+	e.used = false;
+	++e.generation;
+	free_entries.push_back(slots[i].entry - 1);
+	--num_attempts;
+
+	// Backward-shift deletion, as in FlatConnMap.
+	size_t hole = i;
+
+	for ( size_t j = (hole + 1) & mask; slots[j].entry; j = (j + 1) & mask )
+		{
+		size_t home = slots[j].hash & mask;
+
+		if ( ((j - home) & mask) >= ((j - hole) & mask) )
+			{
+			slots[hole] = slots[j];
+			hole = j;
+			}
+		}
+
+	slots[hole].entry = 0;
+	}
+
+bool SYNTable::Remove(const ConnIDKey& key, Attempt* a)
+	{
+	if ( ! num_attempts )
+		return false;
+
+	size_t i = Find(key, HashKey(key));
+
+	if ( ! slots[i].entry )
+		return false;
+
+	*a = pool[slots[i].entry - 1].attempt;
+	RemoveSlot(i);
+	return true;
+	}
+
+double SYNTable::NextExpiration()
+	{
+	// Attempts that got removed leave their expirations behind.
+	while ( ! expirations.empty() )
+		{
+		const Expiration& x = expirations.front();
+		const Entry& e = pool[x.entry];
+
+		if ( e.used && e.generation == x.generation )
+			return e.expire;
+
+		expirations.pop_front();
+		}
+
+	return 0.0;
+	}
+
+bool SYNTable::TakeExpired(double t, Attempt* a)
+	{
+	double expire = NextExpiration();
+
+	if ( expire == 0.0 || expire > t )
+		return false;
+
+	ConnIDKey key = pool[expirations.front().entry].attempt.key;
+	expirations.pop_front();
+	return Remove(key, a);
+	}
+
+uint32_t SYNTable::HeaderHash(const u_char* tcp_hdr, int len)
+	{
+	// The ports are part of the key already.
+	hash64_t h = KeyedHash::FastHash64(tcp_hdr + 4, len > 4 ? len - 4 : 0);
+	return static_cast<uint32_t>(h ^ (h >> 32));
+	}
+
+} // namespace zeek::detail
+
+TEST_CASE("syn table")
+	{
+	using zeek::detail::SYNTable;
+	zeek::detail::ConnIDKey k1, k2, k3;
+	k1.port1 = 1;
+	k2.port1 = 2;
+	k3.port1 = 3;
+
+	SYNTable t(2);
+	CHECK(t.Lookup(k1) == nullptr);
+	CHECK(t.NextExpiration() == 0.0);
+
+	REQUIRE(t.Insert(k1, 10.0));
+	REQUIRE(t.Insert(k2, 20.0));
+	CHECK(t.Insert(k1, 30.0) == nullptr);
+	CHECK(t.Size() == 2);
+
+	// The table is full.
+	CHECK(t.Insert(k3, 30.0) == nullptr);
+
+	SYNTable::Attempt a;
+	CHECK_FALSE(t.TakeExpired(5.0, &a));
+	REQUIRE(t.TakeExpired(10.0, &a));
+	CHECK(a.key == k1);
+	CHECK(t.Lookup(k1) == nullptr);
+	CHECK(t.Lookup(k2) != nullptr);
+
+	// Removed attempts don't expire anymore.
+	REQUIRE(t.Insert(k3, 30.0));
+	CHECK(t.Remove(k2, &a));
+	CHECK(a.key == k2);
+	CHECK_FALSE(t.Remove(k2, &a));
+	CHECK(t.NextExpiration() == 30.0);
+	REQUIRE(t.TakeExpired(40.0, &a));
+	CHECK(a.key == k3);
+	CHECK(t.Size() == 0);
+	}
@@ -0,0 +1,136 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// TCP connection attempts that haven't been answered yet, kept in place of
+// connections until they get a reply.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "zeek/IPAddr.h"
+#include "zeek/Hash.h"
+
+namespace zeek::detail {
+
+/**
+ * A fixed-size table of SYNs that NetSessions hasn't created connections
+ * for, when :zeek:see:`tcp_syn_table_size` is set.  Each attempt keeps the
+ * headers of its SYN, so that the connection can get created from them
+ * once there's a reply, or once the attempt times out.
+ */
+class SYNTable {
+public:
+	// Room for the longest IPv4 and TCP headers.
+	static constexpr int MAX_HDR_LEN = 120;
+
+	struct Attempt {
+		ConnIDKey key;
+		IPAddr orig_addr;
+		uint32_t orig_port;	// In network order.
+		double first;	// Time of the first SYN.
+		double last;	// Time of the last SYN.
+		uint32_t num_syns;
+		// Hash of the TCP header, telling whether later SYNs repeat
+		// the first.
+		uint32_t hdr_hash;
+		uint32_t vlan;
+		uint32_t inner_vlan;
+		u_char l2_src[6];
+		u_char l2_dst[6];
+		bool has_l2;
+		uint8_t hdr_len;
+		u_char hdr[MAX_HDR_LEN];	// The IP and TCP headers.
+	};
+
+	/**
+	 * @param max_attempts  The number of attempts the table holds.
+	 */
+	explicit SYNTable(size_t max_attempts);
+
+	/**
+	 * Returns the attempt with the given key, or null.
+	 */
+	Attempt* Lookup(const ConnIDKey& key);
+
+	/**
+	 * Adds an attempt for the key, which mustn't have one yet.  The
+	 * caller fills in everything but the key.
+	 *
+	 * @param expire  When the attempt times out.
+	 *
+	 * @return  The new attempt, or null if the table is full.
+	 */
+	Attempt* Insert(const ConnIDKey& key, double expire);
+
+	/**
+	 * Removes an attempt, copying it to *a*.
+	 *
+	 * @return  False if there's no attempt with the key.
+	 */
+	bool Remove(const ConnIDKey& key, Attempt* a);
+
+	/**
+	 * Removes the oldest attempt if it has timed out by the given time,
+	 * copying it to *a*.
+	 *
+	 * @return  False if no attempt has timed out.
+	 */
+	bool TakeExpired(double t, Attempt* a);
+
+	/**
+	 * Returns when the oldest attempt times out, or zero if there's none.
+	 */
+	double NextExpiration();
+
+	size_t Size() const	{ return num_attempts; }
+
+	size_t MemoryAllocation() const
+		{ return pool.capacity() * sizeof(Entry) + slots.capacity() * sizeof(Slot); }
+
+	/**
+	 * Returns the hash that Attempt::hdr_hash holds for a TCP header.
+	 */
+	static uint32_t HeaderHash(const u_char* tcp_hdr, int len);
+
+private:
+	struct Entry {
+		Attempt attempt;
+		double expire;
+		uint32_t generation = 0;	// Tells whether an expiration is stale.
+		bool used = false;
+	};
+
+	struct Slot {
+		hash64_t hash;
+		uint32_t entry;	// Index into the pool plus one, zero if empty.
+	};
+
+	struct Expiration {
+		uint32_t entry;
+		uint32_t generation;
+	};
+
+	static hash64_t HashKey(const ConnIDKey& key)
+		{ return KeyedHash::Hash64(&key, sizeof(key), HASH_TIER_FAST); }
+
+	// Returns the slot holding the key, or the empty slot ending its
+	// probe sequence.
+	size_t Find(const ConnIDKey& key, hash64_t hash) const;
+
+	void RemoveSlot(size_t i);
+
+	std::vector<Entry> pool;
+	std::vector<uint32_t> free_entries;
+	std::vector<Slot> slots;
+	size_t mask;
+	size_t num_attempts = 0;
+
+	// In the order the attempts got added, which is the order of their
+	// timeouts.
+	std::deque<Expiration> expirations;
+};
+
+} // namespace zeek::detail
@@ -2,6 +2,7 @@
 
 #include <sys/errno.h>
 #include <limits.h> // for PATH_MAX
+#include <unordered_set>
 
 #include "zeek/DebugLogger.h"
 #include "zeek/Reporter.h"
@@ -11,6 +12,11 @@ namespace zeek::detail {
 std::list<ScannedFile> files_scanned;
 std::vector<std::string> sig_files;
 
+// The canonical paths of the first num_scanned_paths entries of
+// files_scanned, which only ever gets appended to.
+static std::unordered_set<std::string> scanned_paths;
+static size_t num_scanned_paths = 0;
+
 ScannedFile::ScannedFile(int arg_include_level,
                          std::string arg_name,
                          bool arg_skipped,
@@ -37,14 +43,19 @@ ScannedFile::ScannedFile(int arg_include_level,
 
 bool ScannedFile::AlreadyScanned() const
 	{
-	auto rval = false;
-
-	for ( const auto& it : files_scanned )
-		if ( it.canonical_path == canonical_path )
-			{
-			rval = true;
-			break;
-			}
+	if ( num_scanned_paths > files_scanned.size() )
+		{
+		scanned_paths.clear();
+		num_scanned_paths = 0;
+		}
+
+	// Pick up the files added since the last call, which are at the end.
+	auto it = files_scanned.rbegin();
+
+	for ( auto n = files_scanned.size(); num_scanned_paths < n; ++num_scanned_paths, ++it )
+		scanned_paths.insert(it->canonical_path);
+
+	auto rval = scanned_paths.count(canonical_path) > 0;
 
 	DBG_LOG(zeek::DBG_SCRIPTS, "AlreadyScanned result (%d) %s", rval, canonical_path.data());
 	return rval;
@@ -19,7 +19,7 @@ public:
 	            bool arg_prefixes_checked = false);
 
 	/**
-	 * Compares the canonical path of this file against every canonical path
+	 * Compares the canonical path of this file against the canonical paths
 	 * in files_scanned and returns whether there's any match.
 	 */
 	bool AlreadyScanned() const;
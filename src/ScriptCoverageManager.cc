@@ -11,12 +11,36 @@
 #include "zeek/Stmt.h"
 #include "zeek/Desc.h"
 #include "zeek/Reporter.h"
+#include "zeek/RunState.h"
+#include "zeek/Timer.h"
 #include "zeek/util.h"
 
 using namespace std;
 
 namespace zeek::detail {
 
+class ScriptCoverageTimer final : public Timer {
+public:
+	ScriptCoverageTimer(double t, double arg_interval)
+		: Timer(t, TIMER_SCRIPT_COVERAGE), interval(arg_interval)
+		{
+		}
+
+	void Dispatch(double t, bool is_expire) override
+		{
+		// The final write happens at termination anyway.
+		if ( is_expire || run_state::terminating )
+			return;
+
+		script_coverage_mgr.WriteStats();
+		timer_mgr->Add(new ScriptCoverageTimer(run_state::network_time + interval,
+		                                       interval));
+		}
+
+private:
+	double interval;
+};
+
 ScriptCoverageManager::ScriptCoverageManager()
 	: ignoring(0), delim('\t')
 	{
@@ -129,32 +153,41 @@ bool ScriptCoverageManager::WriteStats()
 		return false;
 		}
 
-	for ( list<Stmt*>::const_iterator it = stmts.begin();
-	      it != stmts.end(); ++it )
+	descs.reserve(stmts.size());
+
+	for ( size_t i = descs.size(); i < stmts.size(); ++i )
 		{
 		ODesc location_info;
-		(*it)->GetLocationInfo()->Describe(&location_info);
+		stmts[i]->GetLocationInfo()->Describe(&location_info);
 		ODesc desc_info;
-		(*it)->Describe(&desc_info);
+		stmts[i]->Describe(&desc_info);
 		string desc(desc_info.Description());
 		canonicalize_desc cd{delim};
 		for_each(desc.begin(), desc.end(), cd);
-		pair<string, string> location_desc(location_info.Description(), desc);
-		if ( usage_map.find(location_desc) != usage_map.end() )
-			usage_map[location_desc] += (*it)->GetAccessCount();
-		else
-			usage_map[location_desc] = (*it)->GetAccessCount();
+		descs.emplace_back(location_info.Description(), std::move(desc));
 		}
 
-	map<pair<string, string>, uint64_t >::const_iterator it;
-	for ( it = usage_map.begin(); it != usage_map.end(); ++it )
-		{
-		fprintf(f, "%" PRIu64"%c%s%c%s\n", it->second, delim,
-				it->first.first.c_str(), delim, it->first.second.c_str());
-		}
+	// Start over from the earlier runs' counts, so that repeated writes
+	// don't add up the current run's more than once.
+	auto totals = usage_map;
+
+	for ( size_t i = 0; i < stmts.size(); ++i )
+		totals[descs[i]] += stmts[i]->GetAccessCount();
+
+	for ( const auto& [location_desc, count] : totals )
+		fprintf(f, "%" PRIu64"%c%s%c%s\n", count, delim,
+		        location_desc.first.c_str(), delim, location_desc.second.c_str());
 
 	fclose(f);
 	return true;
 	}
 
+void ScriptCoverageManager::StartPeriodicWrites(double interval)
+	{
+	if ( interval <= 0 || ! util::zeekenv("ZEEK_PROFILER_FILE") )
+		return;
+
+	timer_mgr->Add(new ScriptCoverageTimer(run_state::network_time + interval, interval));
+	}
+
 } // namespace zeek::detail
@@ -2,7 +2,7 @@
 
 #include <map>
 #include <utility>
-#include <list>
+#include <vector>
 #include <string>
 
 #include "zeek/util.h"
@@ -33,10 +33,18 @@ public:
 	 * ".XXXXXX" (exactly 6 X's), then it is first passed through mkstemp
 	 * to get a unique file.
 	 *
+	 * This can be called repeatedly, each time writing the counts so far.
+	 *
 	 * @return: true when usage info is written, otherwise false.
 	 */
 	bool WriteStats();
 
+	/**
+	 * Starts writing the stats every given number of seconds while
+	 * running, if ZEEK_PROFILER_FILE is set.
+	 */
+	void StartPeriodicWrites(double interval);
+
 	void SetDelim(char d) { delim = d; }
 
 	void IncIgnoreDepth() { ignoring++; }
@@ -47,8 +55,16 @@ public:
 private:
 	/**
 	 * The current, global ScriptCoverageManager instance creates this list at parse-time.
+	 * A statement's index is its ID.
+	 */
+	std::vector<Stmt*> stmts;
+
+	/**
+	 * The location-desc pairs of the statements, by ID, as far as they've
+	 * been needed.  Describing statements is expensive, and their
+	 * descriptions don't change, so periodic writes only do it once.
 	 */
-	std::list<Stmt*> stmts;
+	std::vector<std::pair<std::string, std::string>> descs;
 
 	/**
 	 * Indicates whether new statments will not be considered as part of
@@ -63,9 +79,8 @@ private:
 
 	/**
 	 * This maps Stmt location-desc pairs to the total number of times that
-	 * Stmt has been executed.  The map can be initialized from a file at
-	 * startup time and modified at shutdown time before writing back
-	 * to a file.
+	 * Stmt has been executed in earlier runs, as initialized from a file
+	 * at startup time.  Writes add the current run's counts to it.
 	 */
 	std::map<std::pair<std::string, std::string>, uint64_t> usage_map;
 
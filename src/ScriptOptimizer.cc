@@ -0,0 +1,711 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/ScriptOptimizer.h"
+
+#include <algorithm>
+
+#include "zeek/Debug.h"
+#include "zeek/DebugLogger.h"
+#include "zeek/Expr.h"
+#include "zeek/Func.h"
+#include "zeek/ID.h"
+#include "zeek/Reporter.h"
+#include "zeek/Scope.h"
+#include "zeek/Stmt.h"
+#include "zeek/Traverse.h"
+#include "zeek/Val.h"
+
+#include "const.bif.h"
+
+namespace zeek::detail {
+
+// How deeply inlined bodies may themselves get calls inlined.
+static constexpr size_t MAX_INLINE_DEPTH = 3;
+
+// Whether constants of the type can stand in for their identifiers.
+static bool is_atomic(const Type* t)
+	{
+	switch ( t->Tag() ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+	case TYPE_COUNT:
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+	case TYPE_STRING:
+	case TYPE_ADDR:
+	case TYPE_SUBNET:
+	case TYPE_PORT:
+	case TYPE_ENUM:
+		return true;
+
+	default:
+		return false;
+	}
+	}
+
+// Returns the value of a boolean constant expression, or -1.
+static int const_bool(const Expr* e)
+	{
+	if ( ! e->IsConst() || e->GetType()->Tag() != TYPE_BOOL )
+		return -1;
+
+	return static_cast<const ConstExpr*>(e)->Value()->IsZero() ? 0 : 1;
+	}
+
+// Whether the statement does nothing at all.
+static bool is_empty(const Stmt* s)
+	{
+	if ( ! s || s->Tag() == STMT_NULL )
+		return true;
+
+	if ( s->Tag() != STMT_LIST && s->Tag() != STMT_EVENT_BODY_LIST )
+		return false;
+
+	const auto& stmts = static_cast<const StmtList*>(s)->Stmts();
+	return std::all_of(stmts.begin(), stmts.end(), is_empty);
+	}
+
+static ExprPtr make_const(ValPtr v, const Expr* orig)
+	{
+	auto c = make_intrusive<ConstExpr>(std::move(v));
+	c->SetLocationInfo(orig->GetLocationInfo());
+	return c;
+	}
+
+void ScriptOptimizer::Run()
+	{
+	std::vector<ScriptFunc*> funcs;
+
+	for ( const auto& [name, id] : global_scope()->Vars() )
+		{
+		const auto& v = id->GetVal();
+
+		if ( ! v || v->GetType()->Tag() != TYPE_FUNC )
+			continue;
+
+		Func* f = v->AsFunc();
+
+		if ( f->GetKind() == Func::SCRIPT_FUNC &&
+		     std::find(funcs.begin(), funcs.end(), f) == funcs.end() )
+			funcs.push_back(static_cast<ScriptFunc*>(f));
+		}
+
+	for ( auto* f : funcs )
+		for ( auto& b : f->bodies )
+			OptimizeStmt(b.stmts);
+
+	for ( auto* f : funcs )
+		{
+		if ( f->Flavor() != FUNC_FLAVOR_EVENT )
+			continue;
+
+		auto& bodies = f->bodies;
+		auto n = bodies.size();
+
+		bodies.erase(std::remove_if(bodies.begin(), bodies.end(),
+		                            [](const Func::Body& b) { return is_empty(b.stmts.get()); }),
+		             bodies.end());
+
+		num_handlers += n - bodies.size();
+		}
+	}
+
+void ScriptOptimizer::OptimizeExpr(ExprPtr& e)
+	{
+	switch ( e->Tag() ) {
+	case EXPR_NAME:
+		{
+		auto id = static_cast<NameExpr*>(e.get())->Id();
+
+		if ( id->IsGlobal() && id->IsConst() && ! id->IsType() && id->GetVal() &&
+		     is_atomic(id->GetType().get()) )
+			{
+			e = make_const(id->GetVal(), e.get());
+			++num_folded;
+			}
+
+		return;
+		}
+
+	case EXPR_NOT:
+	case EXPR_COMPLEMENT:
+	case EXPR_POSITIVE:
+	case EXPR_NEGATE:
+	case EXPR_SIZE:
+	case EXPR_FIELD:
+	case EXPR_HAS_FIELD:
+	case EXPR_ARITH_COERCE:
+	case EXPR_RECORD_COERCE:
+	case EXPR_CAST:
+	case EXPR_IS:
+	case EXPR_CLONE:
+		OptimizeExpr(static_cast<UnaryExpr*>(e.get())->op);
+		break;
+
+	case EXPR_ASSIGN:
+	case EXPR_ADD_TO:
+	case EXPR_REMOVE_FROM:
+		// Only the right-hand side; the left one is a target.
+		OptimizeExpr(static_cast<BinaryExpr*>(e.get())->op2);
+		return;
+
+	case EXPR_ADD:
+	case EXPR_SUB:
+	case EXPR_TIMES:
+	case EXPR_DIVIDE:
+	case EXPR_MOD:
+	case EXPR_AND:
+	case EXPR_OR:
+	case EXPR_XOR:
+	case EXPR_AND_AND:
+	case EXPR_OR_OR:
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_GE:
+	case EXPR_GT:
+	case EXPR_IN:
+		{
+		auto b = static_cast<BinaryExpr*>(e.get());
+		OptimizeExpr(b->op1);
+		OptimizeExpr(b->op2);
+		break;
+		}
+
+	case EXPR_INDEX:
+		{
+		auto b = static_cast<BinaryExpr*>(e.get());
+		OptimizeExpr(b->op1);
+		OptimizeList(static_cast<ListExpr*>(b->op2.get()));
+		return;
+		}
+
+	case EXPR_COND:
+		{
+		auto c = static_cast<CondExpr*>(e.get());
+		OptimizeExpr(c->op1);
+		OptimizeExpr(c->op2);
+		OptimizeExpr(c->op3);
+
+		if ( int cond = const_bool(c->op1.get()); cond >= 0 )
+			{
+			auto branch = cond ? c->op2 : c->op3;
+
+			if ( same_type(branch->GetType(), e->GetType()) )
+				{
+				e = std::move(branch);
+				++num_branches;
+				}
+			}
+
+		return;
+		}
+
+	case EXPR_LIST:
+		OptimizeList(static_cast<ListExpr*>(e.get()));
+		return;
+
+	case EXPR_CALL:
+		{
+		auto c = static_cast<CallExpr*>(e.get());
+		OptimizeList(c->Args());
+
+		if ( auto inlined = Inline(c) )
+			{
+			e = std::move(inlined);
+			++num_inlined;
+			}
+
+		return;
+		}
+
+	default:
+		return;
+	}
+
+	if ( auto folded = Fold(e.get()) )
+		{
+		e = std::move(folded);
+		++num_folded;
+		}
+	}
+
+void ScriptOptimizer::OptimizeList(ListExpr* l)
+	{
+	auto& exprs = l->Exprs();
+
+	for ( int i = 0; i < exprs.length(); ++i )
+		{
+		ExprPtr e{NewRef{}, exprs[i]};
+		auto orig = e.get();
+
+		OptimizeExpr(e);
+
+		if ( e.get() != orig )
+			Unref(exprs.replace(i, e.release()));
+		}
+	}
+
+ExprPtr ScriptOptimizer::Fold(Expr* e)
+	{
+	if ( e->IsError() )
+		return nullptr;
+
+	// Short-circuiting operators with a constant first operand.
+	if ( e->Tag() == EXPR_AND_AND || e->Tag() == EXPR_OR_OR )
+		{
+		auto b = static_cast<BinaryExpr*>(e);
+		int v1 = const_bool(b->op1.get());
+
+		if ( v1 < 0 || b->op2->GetType()->Tag() != TYPE_BOOL )
+			return nullptr;
+
+		if ( (e->Tag() == EXPR_AND_AND) == (v1 == 1) )
+			return b->op2;
+
+		return b->op1;
+		}
+
+	switch ( e->Tag() ) {
+	case EXPR_NOT:
+	case EXPR_POSITIVE:
+	case EXPR_NEGATE:
+	case EXPR_SIZE:
+		if ( ! static_cast<UnaryExpr*>(e)->op->IsConst() )
+			return nullptr;
+		break;
+
+	case EXPR_ADD:
+	case EXPR_TIMES:
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_GE:
+	case EXPR_GT:
+		{
+		// Division and subtraction stay as they are, as they may
+		// raise errors.
+		auto b = static_cast<BinaryExpr*>(e);
+
+		if ( ! b->BothConst() )
+			return nullptr;
+		break;
+		}
+
+	default:
+		return nullptr;
+	}
+
+	try
+		{
+		auto v = e->Eval(nullptr);
+
+		if ( v && same_type(v->GetType(), e->GetType()) )
+			return make_const(std::move(v), e);
+		}
+	catch ( InterpreterException& )
+		{
+		}
+
+	return nullptr;
+	}
+
+ExprPtr ScriptOptimizer::Inline(CallExpr* c)
+	{
+	if ( c->IsError() || c->Func()->Tag() != EXPR_NAME || inlining.size() >= MAX_INLINE_DEPTH )
+		return nullptr;
+
+	auto id = static_cast<NameExpr*>(c->Func())->Id();
+	const auto& v = id->GetVal();
+
+	if ( ! id->IsGlobal() || ! id->IsConst() || ! v || v->GetType()->Tag() != TYPE_FUNC )
+		return nullptr;
+
+	auto f = v->AsFunc();
+
+	if ( f->GetKind() != Func::SCRIPT_FUNC || f->Flavor() != FUNC_FLAVOR_FUNCTION ||
+	     f->GetBodies().size() != 1 || ! f->GetScope() )
+		return nullptr;
+
+	auto sf = static_cast<const ScriptFunc*>(f);
+
+	if ( std::find(inlining.begin(), inlining.end(), sf) != inlining.end() )
+		return nullptr;
+
+	// The body must be a single return statement.
+	const Stmt* body = f->GetBodies()[0].stmts.get();
+
+	if ( body->Tag() == STMT_LIST )
+		{
+		const auto& stmts = static_cast<const StmtList*>(body)->Stmts();
+
+		if ( stmts.length() != 1 )
+			return nullptr;
+
+		body = stmts[0];
+		}
+
+	if ( body->Tag() != STMT_RETURN )
+		return nullptr;
+
+	auto ret = const_cast<Expr*>(static_cast<const ReturnStmt*>(body)->StmtExpr());
+
+	if ( ! ret || ! same_type(ret->GetType(), c->GetType()) )
+		return nullptr;
+
+	const auto& params = f->GetType()->Params();
+	const auto& args = c->Args()->Exprs();
+
+	if ( params->NumFields() != args.length() )
+		return nullptr;
+
+	std::unordered_map<const ID*, Expr*> arg_map;
+
+	for ( int i = 0; i < args.length(); ++i )
+		{
+		const auto& p = f->GetScope()->Find(params->FieldName(i));
+
+		if ( ! p || params->GetFieldType(i)->Tag() == TYPE_ANY ||
+		     ! same_type(args[i]->GetType(), p->GetType()) )
+			return nullptr;
+
+		arg_map[p.get()] = args[i];
+		}
+
+	// Arguments other than names and constants must not get evaluated
+	// more than once or be dropped, and their order must not matter.
+	struct UseCounter : public TraversalCallback {
+		std::unordered_map<const ID*, int> uses;
+
+		TraversalCode PreExpr(const Expr* e) override
+			{
+			if ( e->Tag() == EXPR_NAME )
+				++uses[static_cast<const NameExpr*>(e)->Id()];
+
+			return TC_CONTINUE;
+			}
+	};
+
+	UseCounter counter;
+	ret->Traverse(&counter);
+
+	int num_complex = 0;
+
+	for ( const auto& [p, a] : arg_map )
+		{
+		if ( a->Tag() == EXPR_NAME || a->Tag() == EXPR_CONST )
+			continue;
+
+		if ( ! a->IsPure() || counter.uses[p] != 1 )
+			return nullptr;
+
+		++num_complex;
+		}
+
+	if ( num_complex > 1 )
+		return nullptr;
+
+	auto inlined = Substitute(ret, arg_map);
+
+	if ( ! inlined || inlined->IsError() )
+		return nullptr;
+
+	// The inlined body may simplify further with the arguments in
+	// place.
+	inlining.push_back(sf);
+	OptimizeExpr(inlined);
+	inlining.pop_back();
+
+	DBG_LOG(DBG_SCRIPTS, "inlined call of %s at %s:%d", f->Name(),
+	        c->GetLocationInfo()->filename, c->GetLocationInfo()->first_line);
+
+	return inlined;
+	}
+
+ExprPtr ScriptOptimizer::Substitute(Expr* e, const std::unordered_map<const ID*, Expr*>& args)
+	{
+	auto sub = [this, &args](Expr* op) { return Substitute(op, args); };
+	ExprPtr r;
+
+	switch ( e->Tag() ) {
+	case EXPR_CONST:
+		return {NewRef{}, e};
+
+	case EXPR_NAME:
+		{
+		auto id = static_cast<NameExpr*>(e)->Id();
+
+		if ( auto a = args.find(id); a != args.end() )
+			return {NewRef{}, a->second};
+
+		// Locals other than the parameters would need a frame.
+		if ( ! id->IsGlobal() )
+			return nullptr;
+
+		r = make_intrusive<NameExpr>(IDPtr{NewRef{}, id});
+		break;
+		}
+
+	case EXPR_NOT:
+	case EXPR_POSITIVE:
+	case EXPR_NEGATE:
+	case EXPR_SIZE:
+	case EXPR_FIELD:
+	case EXPR_HAS_FIELD:
+	case EXPR_ARITH_COERCE:
+		{
+		auto u = static_cast<UnaryExpr*>(e);
+		auto op = sub(u->op.get());
+
+		if ( ! op )
+			return nullptr;
+
+		switch ( e->Tag() ) {
+		case EXPR_NOT:
+			r = make_intrusive<NotExpr>(std::move(op));
+			break;
+		case EXPR_POSITIVE:
+			r = make_intrusive<PosExpr>(std::move(op));
+			break;
+		case EXPR_NEGATE:
+			r = make_intrusive<NegExpr>(std::move(op));
+			break;
+		case EXPR_SIZE:
+			r = make_intrusive<SizeExpr>(std::move(op));
+			break;
+		case EXPR_FIELD:
+			r = make_intrusive<FieldExpr>(std::move(op),
+			                              static_cast<FieldExpr*>(e)->FieldName());
+			break;
+		case EXPR_HAS_FIELD:
+			r = make_intrusive<HasFieldExpr>(std::move(op),
+			                                 static_cast<HasFieldExpr*>(e)->FieldName());
+			break;
+		default:
+			r = make_intrusive<ArithCoerceExpr>(std::move(op), e->GetType()->Tag());
+			break;
+		}
+
+		break;
+		}
+
+	case EXPR_ADD:
+	case EXPR_SUB:
+	case EXPR_TIMES:
+	case EXPR_AND_AND:
+	case EXPR_OR_OR:
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_GE:
+	case EXPR_GT:
+	case EXPR_IN:
+		{
+		auto b = static_cast<BinaryExpr*>(e);
+		auto op1 = sub(b->op1.get());
+		auto op2 = sub(b->op2.get());
+
+		if ( ! op1 || ! op2 )
+			return nullptr;
+
+		switch ( e->Tag() ) {
+		case EXPR_ADD:
+			r = make_intrusive<AddExpr>(std::move(op1), std::move(op2));
+			break;
+		case EXPR_SUB:
+			r = make_intrusive<SubExpr>(std::move(op1), std::move(op2));
+			break;
+		case EXPR_TIMES:
+			r = make_intrusive<TimesExpr>(std::move(op1), std::move(op2));
+			break;
+		case EXPR_AND_AND:
+		case EXPR_OR_OR:
+			r = make_intrusive<BoolExpr>(e->Tag(), std::move(op1), std::move(op2));
+			break;
+		case EXPR_EQ:
+		case EXPR_NE:
+			r = make_intrusive<EqExpr>(e->Tag(), std::move(op1), std::move(op2));
+			break;
+		case EXPR_IN:
+			r = make_intrusive<InExpr>(std::move(op1), std::move(op2));
+			break;
+		default:
+			r = make_intrusive<RelExpr>(e->Tag(), std::move(op1), std::move(op2));
+			break;
+		}
+
+		break;
+		}
+
+	case EXPR_INDEX:
+		{
+		auto ie = static_cast<IndexExpr*>(e);
+
+		if ( dynamic_cast<IndexExprWhen*>(ie) || ie->IsSlice() )
+			return nullptr;
+
+		auto op1 = sub(ie->op1.get());
+		auto op2 = sub(ie->op2.get());
+
+		if ( ! op1 || ! op2 )
+			return nullptr;
+
+		r = make_intrusive<IndexExpr>(std::move(op1), cast_intrusive<ListExpr>(std::move(op2)));
+		break;
+		}
+
+	case EXPR_COND:
+		{
+		auto c = static_cast<CondExpr*>(e);
+		auto op1 = sub(c->op1.get());
+		auto op2 = sub(c->op2.get());
+		auto op3 = sub(c->op3.get());
+
+		if ( ! op1 || ! op2 || ! op3 )
+			return nullptr;
+
+		r = make_intrusive<CondExpr>(std::move(op1), std::move(op2), std::move(op3));
+		break;
+		}
+
+	case EXPR_LIST:
+		{
+		auto l = make_intrusive<ListExpr>();
+
+		for ( auto* le : static_cast<ListExpr*>(e)->Exprs() )
+			{
+			auto op = sub(le);
+
+			if ( ! op )
+				return nullptr;
+
+			l->Append(std::move(op));
+			}
+
+		r = std::move(l);
+		break;
+		}
+
+	case EXPR_CALL:
+		{
+		auto c = static_cast<CallExpr*>(e);
+		auto func = sub(c->Func());
+		auto call_args = sub(c->Args());
+
+		if ( ! func || ! call_args )
+			return nullptr;
+
+		r = make_intrusive<CallExpr>(std::move(func), cast_intrusive<ListExpr>(std::move(call_args)));
+		break;
+		}
+
+	default:
+		return nullptr;
+	}
+
+	// The copy must behave just like the original.
+	if ( r->IsError() || ! same_type(r->GetType(), e->GetType()) )
+		return nullptr;
+
+	r->SetLocationInfo(e->GetLocationInfo());
+	return r;
+	}
+
+void ScriptOptimizer::OptimizeStmt(StmtPtr& s)
+	{
+	if ( ! s )
+		return;
+
+	switch ( s->Tag() ) {
+	case STMT_LIST:
+	case STMT_EVENT_BODY_LIST:
+		{
+		auto& stmts = static_cast<StmtList*>(s.get())->Stmts();
+
+		for ( int i = 0; i < stmts.length(); ++i )
+			{
+			StmtPtr child{NewRef{}, stmts[i]};
+			auto orig = child.get();
+
+			OptimizeStmt(child);
+
+			if ( child.get() != orig )
+				Unref(stmts.replace(i, child.release()));
+			}
+
+		break;
+		}
+
+	case STMT_EXPR:
+	case STMT_RETURN:
+		if ( auto es = static_cast<ExprStmt*>(s.get()); es->e )
+			OptimizeExpr(es->e);
+		break;
+
+	case STMT_PRINT:
+		OptimizeList(static_cast<ExprListStmt*>(s.get())->l.get());
+		break;
+
+	case STMT_IF:
+		{
+		auto is = static_cast<IfStmt*>(s.get());
+		OptimizeExpr(is->e);
+		OptimizeStmt(is->s1);
+		OptimizeStmt(is->s2);
+
+		if ( int cond = const_bool(is->e.get()); cond >= 0 )
+			{
+			s = cond ? is->s1 : is->s2;
+			++num_branches;
+			}
+
+		break;
+		}
+
+	case STMT_WHILE:
+		{
+		auto ws = static_cast<WhileStmt*>(s.get());
+		OptimizeExpr(ws->loop_condition);
+		OptimizeStmt(ws->body);
+
+		if ( const_bool(ws->loop_condition.get()) == 0 )
+			{
+			s = make_intrusive<NullStmt>();
+			++num_branches;
+			}
+
+		break;
+		}
+
+	case STMT_FOR:
+		{
+		auto fs = static_cast<ForStmt*>(s.get());
+		OptimizeExpr(fs->e);
+		OptimizeStmt(fs->body);
+		break;
+		}
+
+	default:
+		break;
+	}
+	}
+
+void optimize_scripts()
+	{
+	if ( ! BifConst::script_optimize || g_policy_debug )
+		return;
+
+	ScriptOptimizer opt;
+	opt.Run();
+
+	DBG_LOG(DBG_SCRIPTS, "script optimizer: %d constants folded, %d calls inlined, "
+	        "%d branches removed, %d event handler bodies removed",
+	        opt.NumFolded(), opt.NumInlined(), opt.NumBranchesRemoved(),
+	        opt.NumHandlersRemoved());
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,86 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// An optional pass over the script functions and event handlers, run once
+// all scripts have been parsed, that simplifies their syntax trees.
+
+#pragma once
+
+#include "zeek-config.h"
+
+#include <unordered_map>
+#include <vector>
+
+#include "zeek/IntrusivePtr.h"
+
+ZEEK_FORWARD_DECLARE_NAMESPACED(Func, zeek);
+ZEEK_FORWARD_DECLARE_NAMESPACED(Expr, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(Stmt, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(ID, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(ListExpr, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(CallExpr, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(ScriptFunc, zeek::detail);
+
+namespace zeek::detail {
+
+using ExprPtr = IntrusivePtr<Expr>;
+using StmtPtr = IntrusivePtr<Stmt>;
+
+/**
+ * Rewrites the bodies of all global script functions and event handlers:
+ *
+ * - Global constants of atomic types, including redef'd ones, get
+ *   replaced by their values, and operators on constants get folded.
+ *
+ * - Branches that constants rule out get removed.
+ *
+ * - Calls of functions whose body is a single return statement get
+ *   replaced by the returned expression, with the arguments substituted
+ *   for the parameters.
+ *
+ * - Event handler bodies left without statements get removed, so that
+ *   events without any remaining handler don't get raised.
+ *
+ * The pass runs when :zeek:see:`script_optimize` is set.
+ */
+class ScriptOptimizer {
+public:
+	void Run();
+
+	int NumFolded() const	{ return num_folded; }
+	int NumInlined() const	{ return num_inlined; }
+	int NumBranchesRemoved() const	{ return num_branches; }
+	int NumHandlersRemoved() const	{ return num_handlers; }
+
+private:
+	// Each of these simplifies the expression or statement in the given
+	// slot, replacing it if needed.
+	void OptimizeExpr(ExprPtr& e);
+	void OptimizeList(ListExpr* l);
+	void OptimizeStmt(StmtPtr& s);
+
+	// Returns a constant for the expression if it can be folded, or
+	// null.
+	ExprPtr Fold(Expr* e);
+
+	// Returns the body of the called function with the arguments in
+	// place of the parameters, or null if the call can't be inlined.
+	ExprPtr Inline(CallExpr* c);
+
+	// Copies the expression, replacing the parameters of the inlined
+	// function by the given arguments.  Returns null if the expression
+	// contains anything the copying doesn't support.
+	ExprPtr Substitute(Expr* e, const std::unordered_map<const ID*, Expr*>& args);
+
+	// The functions getting inlined at the moment, to avoid recursion.
+	std::vector<const ScriptFunc*> inlining;
+
+	int num_folded = 0;
+	int num_inlined = 0;
+	int num_branches = 0;
+	int num_handlers = 0;
+};
+
+// Runs the optimizer over all scripts, if enabled.
+extern void optimize_scripts();
+
+} // namespace zeek::detail
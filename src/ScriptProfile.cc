@@ -0,0 +1,263 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/ScriptProfile.h"
+
+#include <cstdio>
+#include <algorithm>
+
+#ifdef HAVE_MALLINFO
+#include <malloc.h>
+#endif
+
+#include "zeek/Func.h"
+#include "zeek/Stmt.h"
+#include "zeek/Desc.h"
+#include "zeek/Reporter.h"
+
+namespace zeek::detail {
+
+ScriptProfileMgr* script_profile_mgr = nullptr;
+
+// Returns the number of bytes currently allocated from the heap, or 0 if
+// that's not known.
+static uint64_t heap_in_use()
+	{
+#ifdef HAVE_MALLINFO
+	// The counter is an int and may wrap; callers only use differences
+	// of it, computed modulo 2^32.
+	return static_cast<unsigned int>(mallinfo().uordblks);
+#else
+	return 0;
+#endif
+	}
+
+static int64_t heap_growth(uint64_t start, uint64_t end)
+	{
+	return static_cast<int32_t>(static_cast<uint32_t>(end - start));
+	}
+
+// Turns a description into something fitting into a single tab-separated
+// column.  Compound statements describe their whole body, so this only
+// keeps the beginning.
+static std::string canonicalize(std::string s)
+	{
+	constexpr size_t max_len = 80;
+
+	if ( s.size() > max_len )
+		s = s.substr(0, max_len) + "...";
+
+	std::replace(s.begin(), s.end(), '\n', ' ');
+	std::replace(s.begin(), s.end(), '\t', ' ');
+	return s;
+	}
+
+static std::string location_of(const Obj* o)
+	{
+	const Location* loc = o ? o->GetLocationInfo() : nullptr;
+
+	if ( ! loc || ! loc->filename )
+		return "<builtin>";
+
+	return util::fmt("%s:%d", loc->filename, loc->first_line);
+	}
+
+ScriptProfileMgr::ScriptProfileMgr(std::string arg_file)
+	: file(std::move(arg_file))
+	{
+	}
+
+ScriptProfileMgr::~ScriptProfileMgr()
+	{
+	for ( auto& [key, p] : funcs )
+		{
+		Unref(const_cast<Func*>(p->func));
+		Unref(const_cast<Stmt*>(p->body));
+		}
+
+	for ( auto& [s, p] : stmts )
+		Unref(const_cast<Stmt*>(s));
+	}
+
+ScriptProfileMgr::FuncProfile* ScriptProfileMgr::GetProfile(const Func* f, const Stmt* body)
+	{
+	// Bodies of event handlers and hooks are profiled separately.
+	const void* key = body ? static_cast<const void*>(body) : static_cast<const void*>(f);
+	auto& p = funcs[key];
+
+	if ( ! p )
+		{
+		// Keep both alive, their descriptions are only needed when
+		// reporting.
+		Ref(const_cast<Func*>(f));
+
+		if ( body )
+			Ref(const_cast<Stmt*>(body));
+
+		p = std::make_unique<FuncProfile>(FuncProfile{f, body, f->Name(), {}});
+		}
+
+	return p.get();
+	}
+
+void ScriptProfileMgr::StartInvocation(const Func* f, const Stmt* body)
+	{
+	FuncProfile* prof = GetProfile(f, body);
+	CallNode* parent = activations.empty() ? &root : activations.back().node;
+	auto& node = parent->children[prof];
+
+	if ( ! node )
+		{
+		node = std::make_unique<CallNode>();
+		node->prof = prof;
+		}
+
+	// Take the memory reading first, so that the time spent on it
+	// doesn't count.
+	uint64_t mem = heap_in_use();
+	activations.push_back({prof, node.get(), util::current_time(true), mem, 0.0, 0});
+	}
+
+void ScriptProfileMgr::EndInvocation()
+	{
+	if ( activations.empty() )
+		{
+		reporter->InternalWarning("unbalanced script profiling");
+		return;
+		}
+
+	auto& a = activations.back();
+	double dtime = util::current_time(true) - a.start;
+	int64_t dmem = heap_growth(a.mem_start, heap_in_use());
+
+	auto& s = a.prof->stats;
+	++s.ncalls;
+	s.time += dtime;
+	s.child_time += a.child_time;
+	s.mem += dmem;
+	s.child_mem += a.child_mem;
+
+	a.node->time += dtime - a.child_time;
+
+	activations.pop_back();
+
+	if ( ! activations.empty() )
+		{
+		auto& parent = activations.back();
+		parent.child_time += dtime;
+		parent.child_mem += dmem;
+		}
+	}
+
+void ScriptProfileMgr::StmtFinished(const Stmt* s, double start)
+	{
+	double dtime = util::current_time(true) - start;
+	auto [it, inserted] = stmts.try_emplace(s);
+
+	if ( inserted )
+		Ref(const_cast<Stmt*>(s));
+
+	++it->second.ncalls;
+	it->second.time += dtime;
+	}
+
+void ScriptProfileMgr::Report()
+	{
+	FILE* f = fopen(file.c_str(), "w");
+
+	if ( ! f )
+		{
+		reporter->Error("cannot open script profile file %s", file.c_str());
+		return;
+		}
+
+	std::vector<const FuncProfile*> sorted_funcs;
+	sorted_funcs.reserve(funcs.size());
+
+	for ( const auto& [key, p] : funcs )
+		sorted_funcs.push_back(p.get());
+
+	// Functions spending most time on their own first.
+	std::sort(sorted_funcs.begin(), sorted_funcs.end(),
+	          [](const FuncProfile* a, const FuncProfile* b)
+		{
+		return a->stats.time - a->stats.child_time > b->stats.time - b->stats.child_time;
+		});
+
+	fprintf(f, "#fields\tkind\tname\tlocation\tcalls\ttime\texcl_time\tmem\texcl_mem\n");
+
+	for ( const auto* p : sorted_funcs )
+		{
+		const auto& s = p->stats;
+		std::string kind = p->body ? p->func->GetType()->FlavorString() : "bif";
+
+		fprintf(f, "%s\t%s\t%s\t%" PRIu64 "\t%.6f\t%.6f\t%" PRId64 "\t%" PRId64 "\n",
+		        kind.c_str(), p->name.c_str(), location_of(p->body).c_str(), s.ncalls, s.time,
+		        s.time - s.child_time, s.mem, s.mem - s.child_mem);
+		}
+
+	std::vector<std::pair<const Stmt*, const StmtProfile*>> sorted_stmts;
+	sorted_stmts.reserve(stmts.size());
+
+	for ( const auto& [s, p] : stmts )
+		sorted_stmts.emplace_back(s, &p);
+
+	std::sort(sorted_stmts.begin(), sorted_stmts.end(),
+	          [](const auto& a, const auto& b) { return a.second->time > b.second->time; });
+
+	for ( const auto& [s, p] : sorted_stmts )
+		{
+		ODesc d;
+		d.SetShort();
+		s->Describe(&d);
+
+		// Statements only have inclusive measurements.
+		fprintf(f, "stmt\t%s\t%s\t%" PRIu64 "\t%.6f\t-\t-\t-\n",
+		        canonicalize(d.Description()).c_str(), location_of(s).c_str(),
+		        p->ncalls, p->time);
+		}
+
+	fclose(f);
+
+	std::string folded_file = file + ".folded";
+	f = fopen(folded_file.c_str(), "w");
+
+	if ( ! f )
+		{
+		reporter->Error("cannot open script profile file %s", folded_file.c_str());
+		return;
+		}
+
+	std::string stack;
+	ReportFolded(f, &root, &stack);
+	fclose(f);
+	}
+
+void ScriptProfileMgr::ReportFolded(FILE* f, const CallNode* node, std::string* stack) const
+	{
+	auto len = stack->size();
+
+	if ( node->prof )
+		{
+		if ( ! stack->empty() )
+			stack->push_back(';');
+
+		stack->append(node->prof->name);
+
+		if ( node->prof->body )
+			stack->append("@" + location_of(node->prof->body));
+
+		// In microseconds, as flamegraph.pl wants integral counts.
+		auto usecs = static_cast<uint64_t>(node->time * 1e6 + 0.5);
+
+		if ( usecs > 0 )
+			fprintf(f, "%s %" PRIu64 "\n", stack->c_str(), usecs);
+		}
+
+	for ( const auto& [prof, child] : node->children )
+		ReportFolded(f, child.get(), stack);
+
+	stack->resize(len);
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,181 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Profiling of script execution: per function body and per statement call
+// counts, wall-clock time and heap growth.
+
+#pragma once
+
+#include <csignal>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "zeek/util.h"
+
+ZEEK_FORWARD_DECLARE_NAMESPACED(Func, zeek);
+ZEEK_FORWARD_DECLARE_NAMESPACED(Stmt, zeek::detail);
+
+namespace zeek::detail {
+
+/**
+ * Collects execution statistics of script functions, event handlers and
+ * hooks (separately for each of their bodies), built-in functions, and
+ * the statements of script bodies.
+ *
+ * Function statistics are kept both inclusive and exclusive of the time
+ * and memory spent in profiled callees.  Memory figures are the growth of
+ * the allocated heap while running, so they may be negative for code that
+ * releases more than it allocates.
+ *
+ * Report() writes a tab-separated summary to the output file, plus the
+ * exclusive time of each distinct call stack in the "folded" format read
+ * by flamegraph.pl to the same file name with ".folded" appended.
+ */
+class ScriptProfileMgr {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param file  The name of the file to write reports to.
+	 */
+	explicit ScriptProfileMgr(std::string file);
+	~ScriptProfileMgr();
+
+	/**
+	 * Marks the start of running a function.  Calls nest, and need to
+	 * be matched by EndInvocation().
+	 *
+	 * @param f  The function.
+	 *
+	 * @param body  The body of the function being run, or nullptr for
+	 * built-in functions.
+	 */
+	void StartInvocation(const Func* f, const Stmt* body);
+
+	/**
+	 * Marks the end of running the most recently started function.
+	 */
+	void EndInvocation();
+
+	/**
+	 * Returns the time to pass to StmtFinished() once the statement
+	 * about to be executed has finished.
+	 */
+	double StmtStart() const	{ return util::current_time(true); }
+
+	/**
+	 * Accounts for one execution of a statement.
+	 *
+	 * @param s  The statement.
+	 *
+	 * @param start  The value StmtStart() returned before executing it.
+	 */
+	void StmtFinished(const Stmt* s, double start);
+
+	/**
+	 * Writes out the statistics collected so far, replacing the content
+	 * of the output files.
+	 */
+	void Report();
+
+	/**
+	 * Asks for a report at the next opportunity.  Safe to call from a
+	 * signal handler.
+	 */
+	static void RequestReport()	{ report_requested = 1; }
+
+	/**
+	 * Writes a report if one has been requested via RequestReport().
+	 */
+	void CheckReportRequest()
+		{
+		if ( report_requested )
+			{
+			report_requested = 0;
+			Report();
+			}
+		}
+
+private:
+	struct Stats {
+		uint64_t ncalls = 0;
+		double time = 0.0;
+		double child_time = 0.0;
+		int64_t mem = 0;
+		int64_t child_mem = 0;
+	};
+
+	struct FuncProfile {
+		const Func* func;
+		const Stmt* body;
+		std::string name;
+		Stats stats;
+	};
+
+	struct StmtProfile {
+		uint64_t ncalls = 0;
+		double time = 0.0;
+	};
+
+	// A node in the tree of call stacks seen so far.
+	struct CallNode {
+		FuncProfile* prof = nullptr;
+		double time = 0.0;	// Exclusive time.
+		std::unordered_map<FuncProfile*, std::unique_ptr<CallNode>> children;
+	};
+
+	// A function currently running.
+	struct Activation {
+		FuncProfile* prof;
+		CallNode* node;
+		double start;
+		uint64_t mem_start;
+		double child_time;
+		int64_t child_mem;
+	};
+
+	FuncProfile* GetProfile(const Func* f, const Stmt* body);
+
+	void ReportFolded(FILE* f, const CallNode* node, std::string* stack) const;
+
+	std::string file;
+	std::unordered_map<const void*, std::unique_ptr<FuncProfile>> funcs;
+	std::unordered_map<const Stmt*, StmtProfile> stmts;
+	std::vector<Activation> activations;
+	CallNode root;
+
+	inline static volatile std::sig_atomic_t report_requested = 0;
+};
+
+/**
+ * Profiles a function for the lifetime of the instance, if profiling is
+ * enabled.
+ */
+class ScriptProfileScope {
+public:
+	ScriptProfileScope(const Func* f, const Stmt* body);
+	~ScriptProfileScope();
+
+private:
+	ScriptProfileMgr* mgr;
+};
+
+// Null unless script profiling is enabled.
+extern ScriptProfileMgr* script_profile_mgr;
+
+inline ScriptProfileScope::ScriptProfileScope(const Func* f, const Stmt* body)
+	: mgr(script_profile_mgr)
+	{
+	if ( mgr )
+		mgr->StartInvocation(f, body);
+	}
+
+inline ScriptProfileScope::~ScriptProfileScope()
+	{
+	if ( mgr )
+		mgr->EndInvocation();
+	}
+
+} // namespace zeek::detail
@@ -8,10 +8,15 @@
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <limits>
 
 #include <pcap.h>
 
 #include "zeek/Desc.h"
+#include "zeek/Hash.h"
+#include "zeek/MemoryArenas.h"
+#include "zeek/PacketHeader.h"
+#include "zeek/PipelineStats.h"
 #include "zeek/RunState.h"
 #include "zeek/Event.h"
 #include "zeek/Timer.h"
@@ -26,9 +31,12 @@
 #include "zeek/analyzer/Manager.h"
 
 #include "zeek/iosource/IOSource.h"
+#include "zeek/iosource/Manager.h"
+#include "zeek/iosource/PktSrc.h"
 #include "zeek/packet_analysis/Manager.h"
 
 #include "analyzer/protocol/stepping-stone/events.bif.h"
+#include "analyzer/protocol/tcp/events.bif.h"
 
 // These represent NetBIOS services on ephemeral ports.  They're numbered
 // so that we can use a single int to hold either an actual TCP/UDP server
@@ -44,6 +52,9 @@ zeek::NetSessions*& sessions = zeek::sessions;
 namespace zeek {
 
 NetSessions::NetSessions()
+	: tcp_conns(BifConst::flat_connection_tables),
+	  udp_conns(BifConst::flat_connection_tables),
+	  icmp_conns(BifConst::flat_connection_tables)
 	{
 	if ( stp_correlate_pair )
 		stp_manager = new analyzer::stepping_stone::SteppingStoneManager();
@@ -51,21 +62,48 @@ NetSessions::NetSessions()
 		stp_manager = nullptr;
 
 	packet_filter = nullptr;
+	flow_shunt = nullptr;
+
+	if ( BifConst::flow_accounting_only )
+		flow_table = std::make_unique<detail::FlowTable>();
+
+	if ( BifConst::Tunnel::udp_tunnel_fast_path )
+		udp_tunnels = std::make_unique<detail::UDPTunnelCache>();
+
+	if ( BifConst::flood_flow_threshold > 0 )
+		flood_table = std::make_unique<detail::FloodTable>();
+
+	if ( BifConst::tcp_syn_table_size > 0 )
+		syn_table = std::make_unique<detail::SYNTable>(BifConst::tcp_syn_table_size);
+
+	flow_sampling_rate = BifConst::flow_sampling_rate > 1 ? BifConst::flow_sampling_rate : 1;
+	next_flow_sampling_check = 0.0;
+	sampling_pkts_received = sampling_pkts_dropped = 0;
+
+	if ( BifConst::flow_partition_count > 1 &&
+	     BifConst::flow_partition_index >= BifConst::flow_partition_count )
+		reporter->FatalError("flow_partition_index must be less than flow_partition_count");
 
 	memset(&stats, 0, sizeof(SessionStats));
+
+	if ( BifConst::conn_handoff_file->Len() > 0 )
+		{
+		std::string error;
+		auto file = BifConst::conn_handoff_file->ToStdString();
+
+		if ( ! handoff.Load(file, &error) && ! error.empty() )
+			reporter->Warning("%s", error.c_str());
+		}
 	}
 
 NetSessions::~NetSessions()
 	{
 	delete packet_filter;
+	delete flow_shunt;
 	delete stp_manager;
 
-	for ( const auto& entry : tcp_conns )
-		Unref(entry.second);
-	for ( const auto& entry : udp_conns )
-		Unref(entry.second);
-	for ( const auto& entry : icmp_conns )
-		Unref(entry.second);
+	for ( auto* m : { &tcp_conns, &udp_conns, &icmp_conns } )
+		m->ForEach([](Connection* c) { Unref(c); });
 
 	detail::fragment_mgr->Clear();
 	}
@@ -76,6 +114,8 @@ void NetSessions::Done()
 
 void NetSessions::NextPacket(double t, Packet* pkt)
 	{
+	detail::StageTimer timer(detail::PipelineStats::PACKET_ANALYSIS);
+	detail::MemoryTagScope mem_tag(detail::MEMORY_SESSIONS);
 	packet_mgr->ProcessPacket(pkt);
 	}
 
@@ -166,19 +206,63 @@ void NetSessions::ProcessTransportLayer(double t, const Packet* pkt, size_t rema
 	}
 
 	detail::ConnIDKey key = detail::BuildConnIDKey(id);
+
+	if ( flow_table )
+		{
+		TransportProto tproto = proto == IPPROTO_TCP ? TRANSPORT_TCP :
+			(proto == IPPROTO_UDP ? TRANSPORT_UDP : TRANSPORT_ICMP);
+		uint8_t tcp_flags = proto == IPPROTO_TCP ?
+			reinterpret_cast<const struct tcphdr*>(data)->th_flags : 0;
+
+		flow_table->Update(t, id, key, tproto, ip_hdr->TotalLen(), tcp_flags);
+		return;
+		}
+
+	if ( proto == IPPROTO_UDP && udp_tunnels && udp_tunnels->Size() > 0 &&
+	     udp_tunnels->Process(t, pkt, key, id, data, len, remaining) )
+		return;
+
+	if ( syn_table && ! promoting_syn )
+		{
+		detail::SYNTable::Attempt a;
+
+		while ( syn_table->TakeExpired(t, &a) )
+			PromoteSYNAttempt(a);
+
+		if ( proto == IPPROTO_TCP &&
+		     ProcessSYNAttempt(t, pkt, key, id, data, len, remaining) )
+			return;
+		}
+
 	Connection* conn = nullptr;
+	detail::StageTimer lookup_timer(detail::PipelineStats::SESSION_LOOKUP);
 
 	// FIXME: The following is getting pretty complex. Need to split up
 	// into separate functions.
-	auto it = d->find(key);
-	if ( it != d->end() )
-		conn = it->second;
+	conn = d->Lookup(key);
 
 	if ( ! conn )
 		{
+		if ( BifConst::flow_sampling_max_rate > BifConst::flow_sampling_rate &&
+		     t >= next_flow_sampling_check )
+			AdjustFlowSampling(t);
+
+		if ( (flow_sampling_rate > 1 || BifConst::flow_partition_count > 1) &&
+		     ! WantFlow(key, proto) )
+			return;
+
+		if ( flood_table && proto != IPPROTO_TCP &&
+		     flood_table->Summarize(t, id.src_addr,
+		                            proto == IPPROTO_UDP ? TRANSPORT_UDP : TRANSPORT_ICMP,
+		                            ip_hdr->TotalLen()) )
+			return;
+
 		conn = NewConn(key, t, &id, data, proto, ip_hdr->FlowLabel(), pkt);
 		if ( conn )
+			{
+			conn->SetSampleWeight(flow_sampling_rate);
 			InsertConnection(d, key, conn);
+			}
 		}
 	else
 		{
@@ -198,6 +282,8 @@ void NetSessions::ProcessTransportLayer(double t, const Packet* pkt, size_t rema
 			}
 		}
 
+	lookup_timer.Stop();
+
 	if ( ! conn )
 		return;
 
@@ -222,8 +308,15 @@ void NetSessions::ProcessTransportLayer(double t, const Packet* pkt, size_t rema
 		conn->EnqueueEvent(new_packet, nullptr, conn->ConnVal(), pkt_hdr_val ?
 		                   std::move(pkt_hdr_val) : ip_hdr->ToPktHdrVal());
 
-	conn->NextPacket(t, is_orig, ip_hdr.get(), len, remaining, data,
-	                 record_packet, record_content, pkt);
+	if ( new_packet_header )
+		conn->EnqueueEvent(new_packet_header, nullptr, conn->ConnVal(),
+		                   make_intrusive<PacketHeaderVal>(*ip_hdr));
+
+		{
+		detail::StageTimer timer(detail::PipelineStats::CONNECTION);
+		conn->NextPacket(t, is_orig, ip_hdr.get(), len, remaining, data,
+		                 record_packet, record_content, pkt);
+		}
 
 	// We skip this block for reassembled packets because the pointer
 	// math wouldn't work.
@@ -318,17 +411,17 @@ Connection* NetSessions::FindConnection(Val* v)
 		return nullptr;
 
 	RecordType* vr = vt->AsRecordType();
-	auto vl = v->AsRecord();
+	auto rv = v->AsRecordVal();
 
 	int orig_h, orig_p;	// indices into record's value list
 	int resp_h, resp_p;
 
 	if ( vr == id::conn_id )
 		{
-		orig_h = 0;
-		orig_p = 1;
-		resp_h = 2;
-		resp_p = 3;
+		orig_h = id::field::conn_id.orig_h;
+		orig_p = id::field::conn_id.orig_p;
+		resp_h = id::field::conn_id.resp_h;
+		resp_p = id::field::conn_id.resp_p;
 		}
 
 	else
@@ -346,11 +439,11 @@ Connection* NetSessions::FindConnection(Val* v)
 		// types, too.
 		}
 
-	const IPAddr& orig_addr = (*vl)[orig_h]->AsAddr();
-	const IPAddr& resp_addr = (*vl)[resp_h]->AsAddr();
+	IPAddr orig_addr = rv->GetAddrField(orig_h);
+	IPAddr resp_addr = rv->GetAddrField(resp_h);
 
-	PortVal* orig_portv = (*vl)[orig_p]->AsPortVal();
-	PortVal* resp_portv = (*vl)[resp_p]->AsPortVal();
+	PortVal* orig_portv = rv->GetField(orig_p)->AsPortVal();
+	PortVal* resp_portv = rv->GetField(resp_p)->AsPortVal();
 
 	ConnID id;
 
@@ -379,12 +472,7 @@ Connection* NetSessions::FindConnection(Val* v)
 		return nullptr;
 		}
 
-	Connection* conn = nullptr;
-	auto it = d->find(key);
-	if ( it != d->end() )
-		conn = it->second;
-
-	return conn;
+	return d->Lookup(key);
 	}
 
 void NetSessions::Remove(Connection* c)
@@ -407,6 +495,9 @@ void NetSessions::Remove(Connection* c)
 		c->Done();
 		c->RemovalEvent();
 
+		if ( udp_tunnels && c->ConnTransport() == TRANSPORT_UDP )
+			udp_tunnels->Remove(key);
+
 		// Zero out c's copy of the key, so that if c has been Ref()'d
 		// up, we know on a future call to Remove() that it's no
 		// longer in the dictionary.
@@ -414,17 +505,17 @@ void NetSessions::Remove(Connection* c)
 
 		switch ( c->ConnTransport() ) {
 		case TRANSPORT_TCP:
-			if ( tcp_conns.erase(key) == 0 )
+			if ( ! tcp_conns.Remove(key) )
 				reporter->InternalWarning("connection missing");
 			break;
 
 		case TRANSPORT_UDP:
-			if ( udp_conns.erase(key) == 0 )
+			if ( ! udp_conns.Remove(key) )
 				reporter->InternalWarning("connection missing");
 			break;
 
 		case TRANSPORT_ICMP:
-			if ( icmp_conns.erase(key) == 0 )
+			if ( ! icmp_conns.Remove(key) )
 				reporter->InternalWarning("connection missing");
 			break;
 
@@ -444,25 +535,16 @@ void NetSessions::Insert(Connection* c)
 	Connection* old = nullptr;
 
 	switch ( c->ConnTransport() ) {
-	// Remove first. Otherwise the map would still reference the old key for
-	// already existing connections.
-
 	case TRANSPORT_TCP:
-		old = LookupConn(tcp_conns, c->Key());
-		tcp_conns.erase(c->Key());
-		InsertConnection(&tcp_conns, c->Key(), c);
+		old = InsertConnection(&tcp_conns, c->Key(), c);
 		break;
 
 	case TRANSPORT_UDP:
-		old = LookupConn(udp_conns, c->Key());
-		udp_conns.erase(c->Key());
-		InsertConnection(&udp_conns, c->Key(), c);
+		old = InsertConnection(&udp_conns, c->Key(), c);
 		break;
 
 	case TRANSPORT_ICMP:
-		old = LookupConn(icmp_conns, c->Key());
-		icmp_conns.erase(c->Key());
-		InsertConnection(&icmp_conns, c->Key(), c);
+		old = InsertConnection(&icmp_conns, c->Key(), c);
 		break;
 
 	default:
@@ -475,6 +557,9 @@ void NetSessions::Insert(Connection* c)
 		{
 		// Some clean-ups similar to those in Remove() (but invisible
 		// to the script layer).
+		if ( udp_tunnels && old->ConnTransport() == TRANSPORT_UDP )
+			udp_tunnels->Remove(old->Key());
+
 		old->CancelTimers();
 		old->ClearKey();
 		Unref(old);
@@ -483,51 +568,74 @@ void NetSessions::Insert(Connection* c)
 
 void NetSessions::Drain()
 	{
-	for ( const auto& entry : tcp_conns )
-		{
-		Connection* tc = entry.second;
-		tc->Done();
-		tc->RemovalEvent();
-		}
+	if ( flow_table )
+		flow_table->Flush();
 
-	for ( const auto& entry : udp_conns )
-		{
-		Connection* uc = entry.second;
-		uc->Done();
-		uc->RemovalEvent();
-		}
+	if ( flood_table )
+		flood_table->Flush();
 
-	for ( const auto& entry : icmp_conns )
+	if ( syn_table )
 		{
-		Connection* ic = entry.second;
-		ic->Done();
-		ic->RemovalEvent();
+		detail::SYNTable::Attempt a;
+
+		while ( syn_table->TakeExpired(std::numeric_limits<double>::max(), &a) )
+			PromoteSYNAttempt(a);
 		}
+
+	// Walk the connections in key order so that the resulting events
+	// don't depend on the table implementation.
+	for ( auto* m : { &tcp_conns, &udp_conns, &icmp_conns } )
+		for ( Connection* c : m->SortedConnections() )
+			{
+			c->Done();
+			c->RemovalEvent();
+			}
+	}
+
+void NetSessions::SaveHandoff()
+	{
+	if ( BifConst::conn_handoff_file->Len() == 0 )
+		return;
+
+	detail::ConnHandoff out;
+
+	for ( auto* m : { &tcp_conns, &udp_conns, &icmp_conns } )
+		m->ForEach([&out](Connection* c)
+			{
+			if ( c->LastTime() - c->StartTime() >= BifConst::conn_handoff_min_duration )
+				out.Add(c);
+			});
+
+	std::string error;
+
+	if ( ! out.Save(BifConst::conn_handoff_file->ToStdString(), &error) )
+		reporter->Error("%s", error.c_str());
 	}
 
 void NetSessions::Clear()
 	{
-	for ( const auto& entry : tcp_conns )
-		Unref(entry.second);
-	for ( const auto& entry : udp_conns )
-		Unref(entry.second);
-	for ( const auto& entry : icmp_conns )
-		Unref(entry.second);
+	if ( udp_tunnels )
+		udp_tunnels->Clear();
+
+	if ( syn_table )
+		syn_table = std::make_unique<detail::SYNTable>(BifConst::tcp_syn_table_size);
 
-	tcp_conns.clear();
-	udp_conns.clear();
-	icmp_conns.clear();
+	for ( auto* m : { &tcp_conns, &udp_conns, &icmp_conns } )
+		{
+		m->ForEach([](Connection* c) { Unref(c); });
+		m->Clear();
+		}
 
 	detail::fragment_mgr->Clear();
 	}
 
 void NetSessions::GetStats(SessionStats& s) const
 	{
-	s.num_TCP_conns = tcp_conns.size();
+	s.num_TCP_conns = tcp_conns.Size();
 	s.cumulative_TCP_conns = stats.cumulative_TCP_conns;
-	s.num_UDP_conns = udp_conns.size();
+	s.num_UDP_conns = udp_conns.Size();
 	s.cumulative_UDP_conns = stats.cumulative_UDP_conns;
-	s.num_ICMP_conns = icmp_conns.size();
+	s.num_ICMP_conns = icmp_conns.Size();
 	s.cumulative_ICMP_conns = stats.cumulative_ICMP_conns;
 	s.num_fragments = detail::fragment_mgr->Size();
 	s.num_packets = packet_mgr->PacketsProcessed();
@@ -538,6 +646,221 @@ void NetSessions::GetStats(SessionStats& s) const
 	s.max_fragments = detail::fragment_mgr->MaxFragments();
 	}
 
+bool NetSessions::WantFlow(const detail::ConnIDKey& key, int proto) const
+	{
+	// The key is the same for both directions of the flow.
+	struct {
+		detail::ConnIDKey key;
+		uint32_t proto;
+	} flow;
+
+	memset(&flow, 0, sizeof(flow));
+	flow.key = key;
+	flow.proto = proto;
+
+	hash64_t h = KeyedHash::StaticHash64(&flow, sizeof(flow));
+
+	// Partitioning takes the hash's remainder, and sampling decides on
+	// what's left, so that each partition gets sampled evenly.
+	if ( BifConst::flow_partition_count > 1 )
+		{
+		if ( h % BifConst::flow_partition_count != BifConst::flow_partition_index )
+			return false;
+
+		h /= BifConst::flow_partition_count;
+		}
+
+	return h % flow_sampling_rate == 0;
+	}
+
+void NetSessions::AdjustFlowSampling(double t)
+	{
+	next_flow_sampling_check = t + BifConst::flow_sampling_interval;
+
+	// Drops on any of the interfaces count.
+	iosource::PktSrc::Stats s;
+	bool live = false;
+
+	for ( auto ps : iosource_mgr->GetPktSrcs() )
+		{
+		if ( ! ps->IsLive() )
+			continue;
+
+		iosource::PktSrc::Stats ps_stats;
+		ps->GetStatistics(&ps_stats);
+		s.received += ps_stats.received;
+		s.dropped += ps_stats.dropped;
+		live = true;
+		}
+
+	if ( ! live )
+		return;
+
+	uint32_t base_rate = BifConst::flow_sampling_rate > 1 ? BifConst::flow_sampling_rate : 1;
+	uint64_t received = s.received - sampling_pkts_received;
+	uint64_t dropped = s.dropped - sampling_pkts_dropped;
+	sampling_pkts_received = s.received;
+	sampling_pkts_dropped = s.dropped;
+
+	if ( received + dropped == 0 )
+		return;
+
+	// Rates stay powers of two apart from the configured one, so that a
+	// flow sampled at a higher rate is also in the sample at any lower one.
+	if ( static_cast<double>(dropped) / (received + dropped) > BifConst::flow_sampling_drop_ratio )
+		{
+		if ( flow_sampling_rate * 2 <= BifConst::flow_sampling_max_rate )
+			flow_sampling_rate *= 2;
+		}
+
+	else if ( dropped == 0 && flow_sampling_rate / 2 >= base_rate )
+		flow_sampling_rate /= 2;
+	}
+
+bool NetSessions::ProcessSYNAttempt(double t, const Packet* pkt, const detail::ConnIDKey& key,
+                                    const ConnID& id, const u_char* data, uint32_t len,
+                                    size_t remaining)
+	{
+	const struct tcphdr* tp = reinterpret_cast<const struct tcphdr*>(data);
+
+	if ( auto a = syn_table->Lookup(key) )
+		{
+		// Retransmissions of the SYN just get counted.
+		if ( id.src_addr == a->orig_addr && id.src_port == a->orig_port &&
+		     CanDeferSYN(pkt, tp, len, remaining) &&
+		     detail::SYNTable::HeaderHash(data, len) == a->hdr_hash )
+			{
+			a->last = t;
+			++a->num_syns;
+			pkt->dump_packet = true;
+			return true;
+			}
+
+		detail::SYNTable::Attempt attempt;
+		syn_table->Remove(key, &attempt);
+		PromoteSYNAttempt(attempt);
+		return false;
+		}
+
+	if ( ! CanDeferSYN(pkt, tp, len, remaining) || tcp_conns.Lookup(key) )
+		return false;
+
+	// Flows outside of the sample get dropped on the regular path.
+	if ( (flow_sampling_rate > 1 || BifConst::flow_partition_count > 1) &&
+	     ! WantFlow(key, IPPROTO_TCP) )
+		return false;
+
+	const IP_Hdr* ip = pkt->ip_hdr.get();
+	const u_char* hdr = ip->IP4_Hdr() ?
+		reinterpret_cast<const u_char*>(ip->IP4_Hdr()) :
+		reinterpret_cast<const u_char*>(ip->IP6_Hdr());
+	int hdr_len = (data - hdr) + len;
+
+	if ( hdr_len > detail::SYNTable::MAX_HDR_LEN )
+		return false;
+
+	auto a = syn_table->Insert(key, t + detail::tcp_attempt_delay);
+
+	if ( ! a )
+		return false;
+
+	a->orig_addr = id.src_addr;
+	a->orig_port = id.src_port;
+	a->first = a->last = t;
+	a->num_syns = 1;
+	a->hdr_hash = detail::SYNTable::HeaderHash(data, len);
+	a->vlan = pkt->vlan;
+	a->inner_vlan = pkt->inner_vlan;
+	a->has_l2 = pkt->l2_src && pkt->l2_dst;
+
+	if ( a->has_l2 )
+		{
+		memcpy(a->l2_src, pkt->l2_src, sizeof(a->l2_src));
+		memcpy(a->l2_dst, pkt->l2_dst, sizeof(a->l2_dst));
+		}
+
+	a->hdr_len = hdr_len;
+	memcpy(a->hdr, hdr, hdr_len);
+
+	pkt->dump_packet = true;
+	return true;
+	}
+
+bool NetSessions::CanDeferSYN(const Packet* pkt, const struct tcphdr* tp, uint32_t len,
+                              size_t remaining) const
+	{
+	const IP_Hdr* ip = pkt->ip_hdr.get();
+
+	if ( (tp->th_flags & (TH_SYN | TH_ACK | TH_FIN | TH_RST)) != TH_SYN )
+		return false;
+
+	// Only SYNs without payload or anything else that the headers alone
+	// wouldn't reproduce.
+	if ( static_cast<uint32_t>(tp->th_off * 4) != len || remaining < len ||
+	     pkt->cap_len < pkt->len || pkt->encap || ip->reassembled ||
+	     ip->NumHeaders() > 1 || handoff.Size() > 0 )
+		return false;
+
+	// Nor for anything that gets to see the single packets.
+	if ( new_packet || new_packet_header || tcp_packet || connection_SYN_packet ||
+	     packet_contents || tcp_option || tcp_options )
+		return false;
+
+	// A bad checksum gets reported with the connection.
+	auto sum = detail::ip_in_cksum(ip->IP4_Hdr(), ip->SrcAddr(), ip->DstAddr(),
+	                               IPPROTO_TCP, reinterpret_cast<const uint8_t*>(tp), len);
+	return sum == 0xffff;
+	}
+
+void NetSessions::PromoteSYNAttempt(const detail::SYNTable::Attempt& a)
+	{
+	const struct ip* ip4 = reinterpret_cast<const struct ip*>(a.hdr);
+	bool is_ipv4 = ip4->ip_v == 4;
+	const Packet* saved_pkt = run_state::current_pkt;
+	promoting_syn = true;
+
+	// The first SYN at its own time, any retransmissions at the last
+	// one's.
+	for ( uint32_t i = 0; i < a.num_syns; ++i )
+		{
+		double t = i == 0 ? a.first : a.last;
+		pkt_timeval ts;
+		ts.tv_sec = static_cast<time_t>(t);
+		ts.tv_usec = static_cast<suseconds_t>((t - ts.tv_sec) * 1e6);
+
+		Packet p(DLT_RAW, &ts, a.hdr_len, a.hdr_len, a.hdr);
+
+		if ( is_ipv4 )
+			{
+			p.l3_proto = L3_IPV4;
+			p.ip_hdr = std::make_unique<IP_Hdr>(ip4, false);
+			}
+		else
+			{
+			p.l3_proto = L3_IPV6;
+			p.ip_hdr = std::make_unique<IP_Hdr>(
+				reinterpret_cast<const struct ip6_hdr*>(a.hdr), false, a.hdr_len);
+			}
+
+		// The SYN got dumped when it went into the table already.
+		p.ip_hdr->reassembled = true;
+		p.vlan = a.vlan;
+		p.inner_vlan = a.inner_vlan;
+
+		if ( a.has_l2 )
+			{
+			p.l2_src = a.l2_src;
+			p.l2_dst = a.l2_dst;
+			}
+
+		run_state::current_pkt = &p;
+		ProcessTransportLayer(t, &p, a.hdr_len - p.ip_hdr->HdrLen());
+		}
+
+	run_state::current_pkt = saved_pkt;
+	promoting_syn = false;
+	}
+
 Connection* NetSessions::NewConn(const detail::ConnIDKey& k, double t, const ConnID* id,
                                  const u_char* data, int proto, uint32_t flow_label,
                                  const Packet* pkt)
@@ -575,8 +898,16 @@ Connection* NetSessions::NewConn(const detail::ConnIDKey& k, double t, const Con
 		}
 
 	bool flip = false;
+	detail::ConnHandoff::Entry handed_off;
+	bool adopt = handoff.Take(k, tproto, t, &handed_off);
 
-	if ( ! WantConnection(src_h, dst_h, tproto, flags, flip) )
+	// A connection that the previous process handed off keeps its
+	// originator, whatever the packet at hand looks like.
+	if ( adopt )
+		flip = id->src_port != handed_off.orig_port ||
+			id->src_addr != IPAddr(handed_off.orig_addr);
+
+	else if ( ! WantConnection(src_h, dst_h, tproto, flags, flip) )
 		return nullptr;
 
 	Connection* conn = new Connection(this, k, t, id, flow_label, pkt);
@@ -585,6 +916,9 @@ Connection* NetSessions::NewConn(const detail::ConnIDKey& k, double t, const Con
 	if ( flip )
 		conn->FlipRoles();
 
+	if ( adopt )
+		detail::ConnHandoff::Adopt(conn, handed_off);
+
 	if ( ! analyzer_mgr->BuildInitialAnalyzerTree(conn) )
 		{
 		conn->Done();
@@ -600,11 +934,7 @@ Connection* NetSessions::NewConn(const detail::ConnIDKey& k, double t, const Con
 
 Connection* NetSessions::LookupConn(const ConnectionMap& conns, const detail::ConnIDKey& key)
 	{
-	auto it = conns.find(key);
-	if ( it != conns.end() )
-		return it->second;
-
-	return nullptr;
+	return conns.Lookup(key);
 	}
 
 bool NetSessions::IsLikelyServerPort(uint32_t port, TransportProto proto) const
@@ -702,6 +1032,31 @@ void NetSessions::Weird(const char* name, const Packet* pkt, const char* addl, c
 	reporter->Weird(weird_name, addl, source);
 	}
 
+void NetSessions::Weird(const detail::WeirdName& name, const Packet* pkt,
+                        const char* addl, const char* source)
+	{
+	if ( pkt )
+		{
+		// Weirds in tunnels get their own names, which the plain
+		// version builds.
+		if ( pkt->encap && pkt->encap->LastType() != BifEnum::Tunnel::NONE )
+			{
+			Weird(name.Name(), pkt, addl, source);
+			return;
+			}
+
+		pkt->dump_packet = true;
+
+		if ( pkt->ip_hdr )
+			{
+			reporter->Weird(pkt->ip_hdr->SrcAddr(), pkt->ip_hdr->DstAddr(), name, addl, source);
+			return;
+			}
+		}
+
+	reporter->Weird(name, addl, source);
+	}
+
 void NetSessions::Weird(const char* name, const IP_Hdr* ip, const char* addl)
 	{
 	reporter->Weird(ip->SrcAddr(), ip->DstAddr(), name, addl);
@@ -715,14 +1070,8 @@ unsigned int NetSessions::ConnectionMemoryUsage()
 		// Connections have been flushed already.
 		return 0;
 
-	for ( const auto& entry : tcp_conns )
-		mem += entry.second->MemoryAllocation();
-
-	for ( const auto& entry : udp_conns )
-		mem += entry.second->MemoryAllocation();
-
-	for ( const auto& entry : icmp_conns )
-		mem += entry.second->MemoryAllocation();
+	for ( const auto* m : { &tcp_conns, &udp_conns, &icmp_conns } )
+		m->ForEach([&mem](Connection* c) { mem += c->MemoryAllocation(); });
 
 	return mem;
 	}
@@ -735,16 +1084,22 @@ unsigned int NetSessions::ConnectionMemoryUsageConnVals()
 		// Connections have been flushed already.
 		return 0;
 
-	for ( const auto& entry : tcp_conns )
-		mem += entry.second->MemoryAllocationConnVal();
+	for ( const auto* m : { &tcp_conns, &udp_conns, &icmp_conns } )
+		m->ForEach([&mem](Connection* c) { mem += c->MemoryAllocationConnVal(); });
 
-	for ( const auto& entry : udp_conns )
-		mem += entry.second->MemoryAllocationConnVal();
+	return mem;
+	}
+
+void NetSessions::ConnectionMemoryReport(analyzer::MemoryReport* report)
+	{
+	if ( run_state::terminating )
+		// Connections have been flushed already.
+		return;
 
-	for ( const auto& entry : icmp_conns )
-		mem += entry.second->MemoryAllocationConnVal();
+	for ( const auto* m : { &tcp_conns, &udp_conns, &icmp_conns } )
+		m->ForEach([report](Connection* c) { c->AddMemoryUsage(report); });
 
-	return mem;
+	Connection::AddFreeMemoryUsage(report);
 	}
 
 unsigned int NetSessions::MemoryAllocation()
@@ -755,37 +1110,40 @@ unsigned int NetSessions::MemoryAllocation()
 
 	return ConnectionMemoryUsage()
 		+ padded_sizeof(*this)
-		+ (tcp_conns.size() * (sizeof(ConnectionMap::key_type) + sizeof(ConnectionMap::value_type)))
-		+ (udp_conns.size() * (sizeof(ConnectionMap::key_type) + sizeof(ConnectionMap::value_type)))
-		+ (icmp_conns.size() * (sizeof(ConnectionMap::key_type) + sizeof(ConnectionMap::value_type)))
+		+ tcp_conns.MemoryAllocation()
+		+ udp_conns.MemoryAllocation()
+		+ icmp_conns.MemoryAllocation()
+		+ (syn_table ? syn_table->MemoryAllocation() : 0)
 		+ detail::fragment_mgr->MemoryAllocation();
 		// FIXME: MemoryAllocation() not implemented for rest.
 		;
 	}
 
-void NetSessions::InsertConnection(ConnectionMap* m, const detail::ConnIDKey& key, Connection* conn)
+Connection* NetSessions::InsertConnection(ConnectionMap* m, const detail::ConnIDKey& key, Connection* conn)
 	{
-	(*m)[key] = conn;
+	Connection* old = m->Insert(key, conn);
 
 	switch ( conn->ConnTransport() )
 		{
 		case TRANSPORT_TCP:
 			stats.cumulative_TCP_conns++;
-			if ( m->size() > stats.max_TCP_conns )
-				stats.max_TCP_conns = m->size();
+			if ( m->Size() > stats.max_TCP_conns )
+				stats.max_TCP_conns = m->Size();
 			break;
 		case TRANSPORT_UDP:
 			stats.cumulative_UDP_conns++;
-			if ( m->size() > stats.max_UDP_conns )
-				stats.max_UDP_conns = m->size();
+			if ( m->Size() > stats.max_UDP_conns )
+				stats.max_UDP_conns = m->Size();
 			break;
 		case TRANSPORT_ICMP:
 			stats.cumulative_ICMP_conns++;
-			if ( m->size() > stats.max_ICMP_conns )
-				stats.max_ICMP_conns = m->size();
+			if ( m->Size() > stats.max_ICMP_conns )
+				stats.max_ICMP_conns = m->Size();
 			break;
 		default: break;
 		}
+
+	return old;
 	}
 
 } // namespace zeek
@@ -3,12 +3,20 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
-#include <map>
+#include <memory>
 #include <utility>
 
+#include "zeek/ConnMap.h"
+#include "zeek/ConnHandoff.h"
 #include "zeek/Frag.h"
 #include "zeek/PacketFilter.h"
+#include "zeek/FlowShunt.h"
+#include "zeek/FloodTable.h"
+#include "zeek/FlowTable.h"
+#include "zeek/SYNTable.h"
+#include "zeek/UDPTunnelCache.h"
 #include "zeek/NetVar.h"
+#include "zeek/analyzer/Analyzer.h"
 #include "zeek/analyzer/protocol/tcp/Stats.h"
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(EncapsulationStack, zeek);
@@ -17,6 +25,7 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(Connection, zeek);
 class ConnCompressor;
 
 namespace zeek { struct ConnID; }
+namespace zeek::detail { class WeirdName; }
 using ConnID [[deprecated("Remove in v4.1. Use zeek::ConnID.")]] = zeek::ConnID;
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(SteppingStoneManager, zeek, analyzer::stepping_stone);
@@ -64,6 +73,10 @@ public:
 	// that are still active.
 	void Drain();
 
+	// Writes the long-lived connections to conn_handoff_file, if set,
+	// for the process that replaces this one to continue them.
+	void SaveHandoff();
+
 	// Clears the session maps.
 	void Clear();
 
@@ -71,6 +84,8 @@ public:
 
 	void Weird(const char* name, const Packet* pkt,
 	           const char* addl = "", const char* source = "");
+	void Weird(const detail::WeirdName& name, const Packet* pkt,
+	           const char* addl = "", const char* source = "");
 	void Weird(const char* name, const IP_Hdr* ip,
 	           const char* addl = "");
 
@@ -81,11 +96,27 @@ public:
 		return packet_filter;
 		}
 
+	detail::FlowShunt* GetFlowShunt(bool init=true)
+		{
+		if ( ! flow_shunt && init )
+			flow_shunt = new detail::FlowShunt();
+		return flow_shunt;
+		}
+
+	// The established UDP tunnels, or null without
+	// Tunnel::udp_tunnel_fast_path.
+	detail::UDPTunnelCache* GetUDPTunnelCache()	{ return udp_tunnels.get(); }
+
+	// The flow sampling rate currently in effect: one in this many new
+	// flows gets analyzed.
+	uint32_t FlowSamplingRate() const	{ return flow_sampling_rate; }
+	void SetFlowSamplingRate(uint32_t rate)	{ flow_sampling_rate = rate > 1 ? rate : 1; }
+
 	analyzer::stepping_stone::SteppingStoneManager* GetSTPManager()	{ return stp_manager; }
 
 	unsigned int CurrentConnections()
 		{
-		return tcp_conns.size() + udp_conns.size() + icmp_conns.size();
+		return tcp_conns.Size() + udp_conns.Size() + icmp_conns.Size();
 		}
 
 	/**
@@ -127,13 +158,17 @@ public:
 
 	unsigned int ConnectionMemoryUsage();
 	unsigned int ConnectionMemoryUsageConnVals();
+
+	// Breaks the memory of all connections down by analyzer, see
+	// Connection::AddMemoryUsage().
+	void ConnectionMemoryReport(analyzer::MemoryReport* report);
 	unsigned int MemoryAllocation();
 	analyzer::tcp::TCPStateStats tcp_stats;	// keeps statistics on TCP states
 
 protected:
 	friend class ConnCompressor;
 
-	using ConnectionMap = std::map<detail::ConnIDKey, Connection*>;
+	using ConnectionMap = detail::ConnMap;
 
 	Connection* NewConn(const detail::ConnIDKey& k, double t, const ConnID* id,
 	                    const u_char* data, int proto, uint32_t flow_label,
@@ -165,19 +200,68 @@ protected:
 
 	// Inserts a new connection into the sessions map. If a connection with
 	// the same key already exists in the map, it will be overwritten by
-	// the new one.  Connection count stats get updated either way (so most
-	// cases should likely check that the key is not already in the map to
-	// avoid unnecessary incrementing of connecting counts).
-	void InsertConnection(ConnectionMap* m, const detail::ConnIDKey& key, Connection* conn);
+	// the new one and returned.  Connection count stats get updated either
+	// way (so most cases should likely check that the key is not already in
+	// the map to avoid unnecessary incrementing of connecting counts).
+	Connection* InsertConnection(ConnectionMap* m, const detail::ConnIDKey& key, Connection* conn);
+
+	// Returns whether a flow with the given key falls into this process's
+	// partition and into the sample at the current flow sampling rate.
+	bool WantFlow(const detail::ConnIDKey& key, int proto) const;
+
+	// Adapts the flow sampling rate to the drops the packet source
+	// reported since the last call.
+	void AdjustFlowSampling(double t);
+
+	// Keeps the packet in the SYN table instead of passing it on, if
+	// it's a SYN that the table can stand in for or repeats one there.
+	// Any other packet of an attempt in the table turns it into a
+	// connection first.  Returns true if the packet is done with.
+	bool ProcessSYNAttempt(double t, const Packet* pkt, const detail::ConnIDKey& key,
+	                       const ConnID& id, const u_char* data, uint32_t len,
+	                       size_t remaining);
+
+	// Returns whether a SYN can go into the SYN table, or needs a
+	// connection right away.
+	bool CanDeferSYN(const Packet* pkt, const struct tcphdr* tp, uint32_t len,
+	                 size_t remaining) const;
+
+	// Creates the connection of an attempt from the SYN table by
+	// processing its SYNs again.
+	void PromoteSYNAttempt(const detail::SYNTable::Attempt& a);
 
 	ConnectionMap tcp_conns;
 	ConnectionMap udp_conns;
 	ConnectionMap icmp_conns;
 
+	// The connections that the previous process handed off, waiting
+	// for their next packet.
+	detail::ConnHandoff handoff;
+
 	SessionStats stats;
 
 	analyzer::stepping_stone::SteppingStoneManager* stp_manager;
 	detail::PacketFilter* packet_filter;
+	detail::FlowShunt* flow_shunt;
+
+	// Replaces the connection tables with flow_accounting_only.
+	std::unique_ptr<detail::FlowTable> flow_table;
+
+	// The established UDP tunnels, with Tunnel::udp_tunnel_fast_path.
+	std::unique_ptr<detail::UDPTunnelCache> udp_tunnels;
+
+	// The UDP and ICMP packets of flooding sources, with
+	// flood_flow_threshold.
+	std::unique_ptr<detail::FloodTable> flood_table;
+
+	// The unanswered SYNs, with tcp_syn_table_size.
+	std::unique_ptr<detail::SYNTable> syn_table;
+	bool promoting_syn = false;
+
+	uint32_t flow_sampling_rate;
+	double next_flow_sampling_check;
+	uint64_t sampling_pkts_received;
+	uint64_t sampling_pkts_dropped;
 };
 
 // Manager for the currently active sessions.
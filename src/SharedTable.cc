@@ -0,0 +1,463 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/SharedTable.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <broker/error.hh>
+
+#include "zeek/CompHash.h"
+#include "zeek/Desc.h"
+#include "zeek/Dict.h"
+#include "zeek/Hash.h"
+#include "zeek/Reporter.h"
+#include "zeek/broker/Data.h"
+
+namespace zeek {
+namespace detail {
+
+static const char magic[8] = {'Z', 'E', 'E', 'K', 'S', 'T', 'B', '1'};
+
+// All offsets are from the start of the file, and all sections are aligned
+// to 8 bytes, like the keys CompositeHash builds.
+struct SharedTableFile::Header {
+	char magic[8];
+	uint64_t salt_check;	// StaticHash64() of the magic.
+	uint64_t checksum;	// StaticHash64() of what follows the header.
+	uint64_t type_len;	// Length of the table type's description.
+	uint64_t num_entries;
+	uint64_t num_slots;	// A power of two.
+	uint64_t slots;	// Offset of the slots, which hold entry offsets, 0 if empty.
+};
+
+// Followed by the key and then the yield, each padded to 8 bytes.
+struct SharedTableFile::Entry {
+	uint64_t hash;	// StaticHash64() of the key.
+	uint32_t key_len;
+	uint32_t yield_len;
+};
+
+static uint64_t pad(uint64_t n)
+	{
+	return (n + 7) & ~uint64_t(7);
+	}
+
+static std::string describe_type(const Type* t)
+	{
+	ODesc d;
+	t->Describe(&d);
+	return d.Description();
+	}
+
+// Returns true if a type's hash keys don't depend on the process, unlike
+// function IDs and whatever holds opaque values.
+static bool shareable(const Type* t)
+	{
+	switch ( t->Tag() ) {
+	case TYPE_FUNC:
+	case TYPE_OPAQUE:
+	case TYPE_ANY:
+	case TYPE_FILE:
+		return false;
+
+	case TYPE_RECORD:
+		{
+		auto rt = t->AsRecordType();
+
+		for ( int i = 0; i < rt->NumFields(); ++i )
+			if ( ! shareable(rt->GetFieldType(i).get()) )
+				return false;
+
+		return true;
+		}
+
+	case TYPE_TABLE:
+		{
+		auto tt = t->AsTableType();
+
+		if ( ! shareable(tt->GetIndices().get()) )
+			return false;
+
+		return tt->IsSet() || shareable(tt->Yield().get());
+		}
+
+	case TYPE_VECTOR:
+		return shareable(t->Yield().get());
+
+	case TYPE_LIST:
+		for ( const auto& lt : t->AsTypeList()->GetTypes() )
+			if ( ! shareable(lt.get()) )
+				return false;
+
+		return true;
+
+	default:
+		return true;
+	}
+	}
+
+static std::unique_ptr<CompositeHash> make_yield_hash(const TableType* t)
+	{
+	if ( t->IsSet() )
+		return nullptr;
+
+	auto tl = make_intrusive<TypeList>(t->Yield());
+	tl->Append(t->Yield());
+	return std::make_unique<CompositeHash>(std::move(tl));
+	}
+
+std::string SharedTableFile::Write(TableVal* t, const std::string& path)
+	{
+	auto tt = t->GetType()->AsTableType();
+
+	if ( ! shareable(tt) )
+		return "tables with functions, opaques or values of type any can't be shared";
+
+	struct Pending {
+		uint64_t hash;
+		uint64_t offset;
+	};
+
+	auto type_desc = describe_type(tt);
+	auto yield_hash = make_yield_hash(tt);
+	auto tbl = t->AsTable();
+
+	uint64_t num_slots = 16;
+
+	// Keep the load factor at or below 1/2, so that probes stay short.
+	while ( num_slots < 2 * static_cast<uint64_t>(tbl->Length()) )
+		num_slots *= 2;
+
+	uint64_t slots = pad(sizeof(Header) + type_desc.size());
+	uint64_t offset = slots + num_slots * sizeof(uint64_t);
+	std::vector<Pending> pending;
+	std::vector<uint64_t> slot_offsets(num_slots);
+
+	auto tmp = path + ".tmp";
+	FILE* f = fopen(tmp.c_str(), "w+");
+
+	if ( ! f )
+		return util::fmt("cannot open %s: %s", tmp.c_str(), strerror(errno));
+
+	// The entries go out in iteration order right after the slots,
+	// so we can write them as we go and fill in the slots at the end.
+	bool ok = fseek(f, offset, SEEK_SET) == 0;
+
+	HashKey* k;
+	IterCookie* c = tbl->InitForIteration();
+
+	while ( TableEntryVal* v = tbl->NextEntry(k, c) )
+		{
+		std::unique_ptr<HashKey> key{k};
+		std::unique_ptr<HashKey> yield;
+
+		if ( yield_hash && ! (yield = yield_hash->MakeHashKey(*v->GetVal(), false)) )
+			{
+			tbl->StopIteration(c);
+			fclose(f);
+			unlink(tmp.c_str());
+			return "cannot encode a yield of the table";
+			}
+
+		Entry e;
+		e.hash = KeyedHash::StaticHash64(key->Key(), key->Size());
+		e.key_len = key->Size();
+		e.yield_len = yield ? yield->Size() : 0;
+
+		static const char zeros[8] = {};
+		ok = ok && fwrite(&e, sizeof(e), 1, f) == 1 &&
+			fwrite(key->Key(), 1, e.key_len, f) == e.key_len &&
+			fwrite(zeros, 1, pad(e.key_len) - e.key_len, f) == pad(e.key_len) - e.key_len;
+
+		if ( yield )
+			ok = ok && fwrite(yield->Key(), 1, e.yield_len, f) == e.yield_len &&
+				fwrite(zeros, 1, pad(e.yield_len) - e.yield_len, f) == pad(e.yield_len) - e.yield_len;
+
+		pending.push_back({e.hash, offset});
+		offset += sizeof(e) + pad(e.key_len) + pad(e.yield_len);
+		}
+
+	for ( const auto& p : pending )
+		{
+		uint64_t i = p.hash & (num_slots - 1);
+
+		while ( slot_offsets[i] )
+			i = (i + 1) & (num_slots - 1);
+
+		slot_offsets[i] = p.offset;
+		}
+
+	Header h;
+	memcpy(h.magic, magic, sizeof(magic));
+	h.salt_check = KeyedHash::StaticHash64(magic, sizeof(magic));
+	h.checksum = 0;
+	h.type_len = type_desc.size();
+	h.num_entries = pending.size();
+	h.num_slots = num_slots;
+	h.slots = slots;
+
+	std::string front(slots, '\0');
+	memcpy(&front[0], &h, sizeof(h));
+	memcpy(&front[sizeof(h)], type_desc.data(), type_desc.size());
+
+	ok = ok && fseek(f, 0, SEEK_SET) == 0 &&
+		fwrite(front.data(), 1, front.size(), f) == front.size() &&
+		fwrite(slot_offsets.data(), sizeof(uint64_t), num_slots, f) == num_slots &&
+		fflush(f) == 0;
+
+	// Checksum the complete file through a mapping of it, so that
+	// attaching can verify it the same way.
+	if ( ok )
+		{
+		void* m = mmap(nullptr, offset, PROT_READ, MAP_SHARED, fileno(f), 0);
+
+		if ( m == MAP_FAILED )
+			ok = false;
+		else
+			{
+			h.checksum = KeyedHash::StaticHash64(static_cast<const char*>(m) + sizeof(h),
+			                                      offset - sizeof(h));
+			munmap(m, offset);
+
+			ok = fseek(f, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, f) == 1;
+			}
+		}
+
+	if ( fclose(f) != 0 )
+		ok = false;
+
+	if ( ! ok || rename(tmp.c_str(), path.c_str()) != 0 )
+		{
+		auto err = util::fmt("cannot write %s: %s", path.c_str(), strerror(errno));
+		unlink(tmp.c_str());
+		return err;
+		}
+
+	return "";
+	}
+
+std::unique_ptr<SharedTableFile> SharedTableFile::Map(const std::string& path,
+                                                      const TableType* t,
+                                                      std::string* error)
+	{
+	int fd = open(path.c_str(), O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		*error = util::fmt("cannot open %s: %s", path.c_str(), strerror(errno));
+		return nullptr;
+		}
+
+	struct stat st;
+
+	if ( fstat(fd, &st) < 0 )
+		{
+		*error = util::fmt("cannot stat %s: %s", path.c_str(), strerror(errno));
+		close(fd);
+		return nullptr;
+		}
+
+	size_t size = st.st_size;
+
+	if ( size < sizeof(Header) )
+		{
+		*error = util::fmt("%s is not a shared table", path.c_str());
+		close(fd);
+		return nullptr;
+		}
+
+	void* m = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if ( m == MAP_FAILED )
+		{
+		*error = util::fmt("cannot map %s: %s", path.c_str(), strerror(errno));
+		return nullptr;
+		}
+
+	std::unique_ptr<SharedTableFile> file{
+		new SharedTableFile(path, static_cast<const char*>(m), size, st.st_dev, st.st_ino)};
+
+	auto h = file->GetHeader();
+	auto type_desc = describe_type(t);
+
+	if ( memcmp(h->magic, magic, sizeof(magic)) != 0 )
+		*error = util::fmt("%s is not a shared table", path.c_str());
+
+	else if ( h->salt_check != KeyedHash::StaticHash64(magic, sizeof(magic)) )
+		*error = util::fmt("%s was written with a different digest_salt", path.c_str());
+
+	else if ( h->type_len != type_desc.size() || sizeof(Header) + h->type_len > size ||
+	          memcmp(file->base + sizeof(Header), type_desc.data(), h->type_len) != 0 )
+		*error = util::fmt("%s holds a table of a different type than %s",
+		                   path.c_str(), type_desc.c_str());
+
+	else if ( h->checksum != KeyedHash::StaticHash64(file->base + sizeof(Header),
+	                                                  size - sizeof(Header)) )
+		*error = util::fmt("%s is corrupt", path.c_str());
+
+	else
+		return file;
+
+	return nullptr;
+	}
+
+SharedTableFile::SharedTableFile(std::string arg_path, const char* arg_base, size_t arg_size,
+                                 dev_t arg_dev, ino_t arg_ino)
+	: path(std::move(arg_path)), base(arg_base), size(arg_size), dev(arg_dev), ino(arg_ino)
+	{
+	}
+
+SharedTableFile::~SharedTableFile()
+	{
+	munmap(const_cast<char*>(base), size);
+	}
+
+bool SharedTableFile::Find(const HashKey& key, const char** yield, int* yield_len) const
+	{
+	auto h = GetHeader();
+	auto slots = reinterpret_cast<const uint64_t*>(base + h->slots);
+	uint64_t hash = KeyedHash::StaticHash64(key.Key(), key.Size());
+	uint64_t mask = h->num_slots - 1;
+
+	for ( uint64_t i = hash & mask; slots[i]; i = (i + 1) & mask )
+		{
+		auto e = reinterpret_cast<const Entry*>(base + slots[i]);
+		auto k = reinterpret_cast<const char*>(e + 1);
+
+		if ( e->hash != hash || e->key_len != static_cast<uint32_t>(key.Size()) ||
+		     memcmp(k, key.Key(), e->key_len) != 0 )
+			continue;
+
+		*yield = k + pad(e->key_len);
+		*yield_len = e->yield_len;
+		return true;
+		}
+
+	return false;
+	}
+
+uint64_t SharedTableFile::Size() const
+	{
+	return GetHeader()->num_entries;
+	}
+
+bool SharedTableFile::Changed() const
+	{
+	struct stat st;
+
+	if ( stat(path.c_str(), &st) < 0 )
+		return true;
+
+	return st.st_dev != dev || st.st_ino != ino;
+	}
+
+} // namespace detail
+
+SharedTableVal::SharedTableVal() : OpaqueVal(shared_table_type)
+	{
+	}
+
+SharedTableVal::SharedTableVal(std::shared_ptr<detail::SharedTableFile> arg_file, TableTypePtr t)
+	: OpaqueVal(shared_table_type), file(std::move(arg_file))
+	{
+	Typify(std::move(t));
+	}
+
+SharedTableVal::~SharedTableVal()
+	{
+	}
+
+void SharedTableVal::Typify(TableTypePtr t)
+	{
+	type = std::move(t);
+	index_hash = std::make_unique<detail::CompositeHash>(type->GetIndices());
+	yield_hash = detail::make_yield_hash(type.get());
+	}
+
+std::unique_ptr<detail::HashKey> SharedTableVal::MakeKey(const ListVal& index) const
+	{
+	return index_hash->MakeHashKey(index, true);
+	}
+
+bool SharedTableVal::Contains(const ListVal& index) const
+	{
+	auto key = MakeKey(index);
+	const char* yield;
+	int yield_len;
+
+	return key && file->Find(*key, &yield, &yield_len);
+	}
+
+ValPtr SharedTableVal::Lookup(const ListVal& index) const
+	{
+	auto key = MakeKey(index);
+	const char* yield;
+	int yield_len;
+
+	if ( ! (key && file->Find(*key, &yield, &yield_len)) )
+		return nullptr;
+
+	if ( ! yield_hash )
+		return val_mgr->True();
+
+	detail::HashKey k(yield, yield_len, 0, true);
+	return yield_hash->RecoverVals(k)->Idx(0);
+	}
+
+ValPtr SharedTableVal::DoClone(CloneState* state)
+	{
+	// The contents are immutable, so clones can share them.
+	return state->NewClone(this, make_intrusive<SharedTableVal>(file, type));
+	}
+
+IMPLEMENT_OPAQUE_VALUE(SharedTableVal)
+
+broker::expected<broker::data> SharedTableVal::DoSerialize() const
+	{
+	// Receivers map the same file, which works for processes on the
+	// same host.
+	auto t = SerializeType(type);
+
+	if ( ! t )
+		return broker::ec::invalid_data;
+
+	return {broker::vector{file->Path(), std::move(*t)}};
+	}
+
+bool SharedTableVal::DoUnserialize(const broker::data& data)
+	{
+	auto v = caf::get_if<broker::vector>(&data);
+
+	if ( ! (v && v->size() == 2) )
+		return false;
+
+	auto path = caf::get_if<std::string>(&(*v)[0]);
+	auto t = UnserializeType((*v)[1]);
+
+	if ( ! (path && t && t->Tag() == TYPE_TABLE) )
+		return false;
+
+	std::string error;
+	auto f = detail::SharedTableFile::Map(*path, t->AsTableType(), &error);
+
+	if ( ! f )
+		{
+		reporter->Error("%s", error.c_str());
+		return false;
+		}
+
+	file = std::move(f);
+	Typify(cast_intrusive<TableType>(std::move(t)));
+	return true;
+	}
+
+} // namespace zeek
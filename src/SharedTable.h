@@ -0,0 +1,144 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Read-only tables that live in memory-mapped files, so that Zeek processes
+// on the same host share a single copy of their contents.
+
+#pragma once
+
+#include <sys/types.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "zeek/OpaqueVal.h"
+
+ZEEK_FORWARD_DECLARE_NAMESPACED(CompositeHash, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(HashKey, zeek::detail);
+
+namespace zeek {
+namespace detail {
+
+/**
+ * A table's contents in a file, as an open-addressing hash table over the
+ * keys that its CompositeHash produces, followed by the encoded index and
+ * yield of every entry.  Files get mapped read-only, so the kernel keeps a
+ * single copy of them in the page cache no matter how many processes map
+ * them.  The layout depends on the Zeek build and on digest_salt, so only
+ * processes of the same installation can share files.
+ */
+class SharedTableFile {
+public:
+	/**
+	 * Writes a table's contents to a file.  The file gets written under
+	 * a temporary name and then renamed, so that processes that have
+	 * the old one mapped keep seeing its contents until they map the
+	 * new one.
+	 *
+	 * @return  An error message, or an empty string on success.
+	 */
+	static std::string Write(TableVal* t, const std::string& path);
+
+	/**
+	 * Maps a file that Write() created for a table of the given type.
+	 *
+	 * @return  The mapped file, or null with an error message in
+	 * *error*.
+	 */
+	static std::unique_ptr<SharedTableFile> Map(const std::string& path,
+	                                            const TableType* t,
+	                                            std::string* error);
+
+	~SharedTableFile();
+
+	/**
+	 * Looks up the entry for a key.
+	 *
+	 * @param yield  Set to the encoded yield of the entry, if found.
+	 *
+	 * @param yield_len  Set to the size of the encoded yield.
+	 *
+	 * @return  True if there's an entry for the key.
+	 */
+	bool Find(const HashKey& key, const char** yield, int* yield_len) const;
+
+	/**
+	 * Returns the number of entries.
+	 */
+	uint64_t Size() const;
+
+	/**
+	 * Returns the path the file was mapped from.
+	 */
+	const std::string& Path() const	{ return path; }
+
+	/**
+	 * Returns true if the path now refers to a different file than the
+	 * one mapped, such as after a Write() to it.
+	 */
+	bool Changed() const;
+
+private:
+	struct Header;
+	struct Entry;
+
+	SharedTableFile(std::string path, const char* base, size_t size,
+	                dev_t dev, ino_t ino);
+
+	const Header* GetHeader() const
+		{ return reinterpret_cast<const Header*>(base); }
+
+	std::string path;
+	const char* base;
+	size_t size;
+	dev_t dev;
+	ino_t ino;
+};
+
+} // namespace detail
+
+/**
+ * A handle on a mapped SharedTableFile, as returned by shared_table_attach.
+ */
+class SharedTableVal : public OpaqueVal {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param file  The mapped file.
+	 *
+	 * @param t  The type of the table that the file holds.
+	 */
+	SharedTableVal(std::shared_ptr<detail::SharedTableFile> file, TableTypePtr t);
+	~SharedTableVal() override;
+
+	/**
+	 * Returns true if the table has an entry for the index.
+	 */
+	bool Contains(const ListVal& index) const;
+
+	/**
+	 * Returns the yield of the table's entry for the index, or null if
+	 * there's none.  For sets, that's the bool true.
+	 */
+	ValPtr Lookup(const ListVal& index) const;
+
+	const detail::SharedTableFile* File() const	{ return file.get(); }
+
+	ValPtr DoClone(CloneState* state) override;
+
+protected:
+	SharedTableVal();
+
+	DECLARE_OPAQUE_VALUE(SharedTableVal)
+
+private:
+	void Typify(TableTypePtr t);
+	std::unique_ptr<detail::HashKey> MakeKey(const ListVal& index) const;
+
+	std::shared_ptr<detail::SharedTableFile> file;
+	TableTypePtr type;
+	std::unique_ptr<detail::CompositeHash> index_hash;
+	std::unique_ptr<detail::CompositeHash> yield_hash;	// Null for sets.
+};
+
+} // namespace zeek
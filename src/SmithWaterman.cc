@@ -3,13 +3,19 @@
 #include "zeek-config.h"
 
 #include <ctype.h>
+#include <string.h>
 #include <algorithm>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "zeek/SmithWaterman.h"
 #include "zeek/Var.h"
 #include "zeek/util.h"
 #include "zeek/Reporter.h"
 #include "zeek/Val.h"
+#include "zeek/3rdparty/doctest.h"
 
 namespace zeek::detail {
 
@@ -175,58 +181,67 @@ bool SubstringCmp::operator()(const Substring* bst1,
 		return false;
 		}
 
-	if ( bst1->GetAlignments()[_index].index <=
+	// A strict ordering, as std::sort() requires.
+	if ( bst1->GetAlignments()[_index].index <
 	     bst2->GetAlignments()[_index].index )
 		return true;
 
 	return false;
 	}
 
-// A node in Smith-Waterman's dynamic programming matrix.  Each node
-// contains the byte it represents in the case of a match, the score
-// at this point, and a pointer to the previous cell. Previous means
-// one up and left in case of a match, or a jump somewhere above and
-// left in case of a gap.
+// The traceback of Smith-Waterman's dynamic programming matrix, which keeps
+// a byte of flags per cell.  The scores themselves are only needed for the
+// current and the previous row.  A cell's predecessor is one up and left in
+// case of a match, and otherwise the cell above or the one to the left.  The
+// cells of row and column 0 have no predecessor, and neither do the cells
+// outside of the band, if any.
+//
+// The cells of a row are either in plain order or in the striped order of
+// the SIMD computation, in which column j sits in lane (j - 1) / seg_len of
+// vector (j - 1) % seg_len.
 //
-struct SWNode {
-	// ID field for the cell, for debugging purposes.
-	int id;
+class SWMatrix {
+public:
+	enum {
+		SWC_MATCH = 1,	// the bytes match, predecessor up/left
+		SWC_UP = 2,	// no match, predecessor above
+		SWC_VISITED = 4,	// walked through by a traceback
+	};
 
-	u_char swn_byte;
-	bool swn_byte_assigned;
-	bool swn_visited;
+	static constexpr int LANES = 4;
 
-	// The score in this cell. The cell with the globally best score
-	// marks the end of the alignment.
-	int swn_score;
+	SWMatrix(const String* s1, const String* s2, int arg_band, bool striped)
+	: _s1(s1), _s2(s2), _rows(s1->Len() + 1), _cols(s2->Len() + 1), _band(arg_band)
+		{
+		int n = _cols - 1;
 
-	// Pointer to previous match, walking back yields subsequence.
-	SWNode* swn_prev;
-};
+		if ( striped )
+			{
+			_seg_len = (n + LANES - 1) / LANES;
+			_stride = _seg_len * LANES;
+			}
+		else
+			{
+			_seg_len = 0;
+			_stride = _band > 0 ? std::min(n, 2 * _band + 1) : n;
+			}
 
-// A matrix of Smith-Waterman nodes.
-//
-class SWNodeMatrix {
-public:
-	SWNodeMatrix(const String* s1, const String* s2)
-	: _s1(s1), _s2(s2), _rows(s1->Len() + 1), _cols(s2->Len() + 1)
-		{
-		_nodes = new SWNode[_cols * _rows];
-		memset(_nodes, 0, sizeof(SWNode) * _cols * _rows);
+		_cells.assign(size_t(_rows) * _stride, 0);
 		}
 
-	~SWNodeMatrix()	{ delete [] _nodes; }
+	// Returns the flags of a cell, which must not be a boundary one.
+	uint8_t& operator()(int row, int col)	{ return _cells[Index(row, col)]; }
 
-	SWNode* operator()(int row, int col)
-		{
-		// Make sure access is in allowed range.
-		if ( row < 0 || row >= _rows )
-			return nullptr;
-		if ( col < 0 || col >= _cols )
-			return nullptr;
+	bool IsBoundary(int row, int col) const
+		{ return row == 0 || col == 0 || col < FirstCol(row) || col > LastCol(row); }
 
-		return &(_nodes[row * _cols + col]);
-		}
+	// The range of columns of a row that aren't boundary cells.
+	int FirstCol(int row) const	{ return _band > 0 ? std::max(1, row - _band) : 1; }
+	int LastCol(int row) const
+		{ return _band > 0 ? std::min(_cols - 1, row + _band) : _cols - 1; }
+
+	uint8_t* GetRow(int row)	{ return &_cells[size_t(row) * _stride]; }
+	int GetSegLen() const	{ return _seg_len; }
 
 	const String* GetRowsString() const	{ return _s1; }
 	const String* GetColsString() const	{ return _s2; }
@@ -234,55 +249,297 @@ public:
 	int GetHeight() const	{ return _rows; }
 	int GetWidth() const	{ return _cols; }
 
-	// Quick helper function that calculates the coordinates of a
-	// node in the matrix via pointer arithmetic.
-	//
-	void GetNodeIndices(SWNode* node, int& row, int& col)
+private:
+	size_t Index(int row, int col) const
 		{
-		SWNode* base = &_nodes[0];
-		int offset = (node - base);
-		col = (offset % _cols);
-		row = (offset / _cols);
+		size_t base = size_t(row) * _stride;
+
+		if ( _seg_len )
+			return base + ((col - 1) % _seg_len) * LANES + (col - 1) / _seg_len;
+
+		return base + col - FirstCol(row);
 		}
 
-private:
 	const String* _s1;
 	const String* _s2;
 
 	int _rows, _cols;
-	SWNode* _nodes;
+	int _band;
+	int _seg_len;
+	int _stride;
+	std::vector<uint8_t> _cells;
 };
 
-// Returns the common subsequence starting from a given node.
+// Scoring is as follows.  A match adds 1 to the score up and left, plus 99
+// if that cell was a match, too, which favours longer consecutive
+// substrings.  Without a match, a cell takes the highest score among its
+// neighbours above, to the left, and up and left.
+//
+static constexpr int SW_MATCH_SCORE = 1;
+static constexpr int SW_CHAIN_BONUS = 99;
+
+// Fills the matrix one row at a time, restricted to the band if there is
+// one.  Returns the cell with the best score in row and col, or row 0 if
+// no score beats 1.
+//
+static void sw_fill(SWMatrix& matrix, int& max_row, int& max_col)
+	{
+	byte_vec string1 = matrix.GetRowsString()->Bytes();
+	byte_vec string2 = matrix.GetColsString()->Bytes();
+	int rows = matrix.GetHeight();
+	int cols = matrix.GetWidth();
+
+	// Scores and matches of the previous and the current row.  Cells
+	// outside of the band keep a score of 0.
+	std::vector<int> scores(2 * cols, 0);
+	std::vector<uint8_t> matches(2 * cols, 0);
+	int* prev = &scores[0];
+	int* cur = &scores[cols];
+	uint8_t* prev_match = &matches[0];
+	uint8_t* cur_match = &matches[cols];
+
+	// Only real scores count, see below.
+	int matrix_max = 1;
+	max_row = max_col = 0;
+
+	for ( int i = 1; i < rows; ++i )
+		{
+		int first = matrix.FirstCol(i);
+		int last = matrix.LastCol(i);
+
+		// The band may end before the last row.
+		if ( first > last )
+			break;
+
+		cur[first - 1] = 0;
+		cur_match[first - 1] = 0;
+
+		for ( int j = first; j <= last; ++j )
+			{
+			int score_t = prev[j];
+			int score_l = cur[j - 1];
+			int score_tl = prev[j - 1];
+			uint8_t& flags = matrix(i, j);
+
+			if ( string1[i - 1] == string2[j - 1] )
+				{
+				cur[j] = score_tl + SW_MATCH_SCORE + (prev_match[j - 1] ? SW_CHAIN_BONUS : 0);
+				cur_match[j] = 1;
+				flags = SWMatrix::SWC_MATCH;
+				}
+			else
+				{
+				cur[j] = std::max(std::max(score_t, score_l), score_tl);
+				cur_match[j] = 0;
+				flags = (cur[j] == score_t) ? SWMatrix::SWC_UP : 0;
+				}
+
+			if ( cur[j] > matrix_max )
+				{
+				matrix_max = cur[j];
+				max_row = i;
+				max_col = j;
+				}
+			}
+
+		std::swap(prev, cur);
+		std::swap(prev_match, cur_match);
+		}
+	}
+
+#ifdef __SSE2__
+
+static inline __m128i sw_max(__m128i a, __m128i b)
+	{
+	__m128i gt = _mm_cmpgt_epi32(a, b);
+	return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+	}
+
+// Returns a where mask is set, and b elsewhere.
+static inline __m128i sw_select(__m128i mask, __m128i a, __m128i b)
+	{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+	}
+
+// Fills the matrix as sw_fill() does, but on vectors of 4 cells, in the
+// striped layout of Farrar (2007).  A row's scores get computed in a
+// first pass that assumes no contribution from the left across vector
+// lanes, with a second pass that fixes up the cells to which the score of
+// the cell to their left carries over, stopping as soon as no score
+// changes.
+//
+static void sw_fill_striped(SWMatrix& matrix, int& max_row, int& max_col)
+	{
+	byte_vec string1 = matrix.GetRowsString()->Bytes();
+	byte_vec string2 = matrix.GetColsString()->Bytes();
+	int rows = matrix.GetHeight();
+	int n = matrix.GetWidth() - 1;
+	int seg_len = matrix.GetSegLen();
+
+	// One allocation for the striped second string, the mask of its
+	// real columns, and the scores and matches of two rows.
+	struct Vec { __m128i v; };
+	std::vector<Vec> vecs(6 * seg_len, Vec{_mm_setzero_si128()});
+	__m128i* str2 = &vecs[0].v;
+	__m128i* valid = str2 + seg_len;
+	__m128i* prev = str2 + 2 * seg_len;
+	__m128i* cur = str2 + 3 * seg_len;
+	__m128i* prev_match = str2 + 4 * seg_len;
+	__m128i* cur_match = str2 + 5 * seg_len;
+
+	for ( int s = 0; s < seg_len; ++s )
+		{
+		alignas(16) int32_t bytes[SWMatrix::LANES];
+		alignas(16) int32_t real[SWMatrix::LANES];
+
+		for ( int l = 0; l < SWMatrix::LANES; ++l )
+			{
+			int k = l * seg_len + s;
+			// Padding matches no byte.
+			bytes[l] = k < n ? string2[k] : -1;
+			real[l] = k < n ? -1 : 0;
+			}
+
+		str2[s] = _mm_load_si128(reinterpret_cast<const __m128i*>(bytes));
+		valid[s] = _mm_load_si128(reinterpret_cast<const __m128i*>(real));
+		}
+
+	const __m128i match_score = _mm_set1_epi32(SW_MATCH_SCORE);
+	const __m128i chain_bonus = _mm_set1_epi32(SW_CHAIN_BONUS);
+	const __m128i match_flag = _mm_set1_epi32(SWMatrix::SWC_MATCH);
+	const __m128i up_flag = _mm_set1_epi32(SWMatrix::SWC_UP);
+
+	int matrix_max = 1;
+	max_row = max_col = 0;
+
+	for ( int i = 1; i < rows; ++i )
+		{
+		__m128i c = _mm_set1_epi32(string1[i - 1]);
+
+		// The cells up and left of the first vector's come from the
+		// last vector, one lane over.
+		__m128i tl = _mm_slli_si128(prev[seg_len - 1], 4);
+		__m128i tl_match = _mm_slli_si128(prev_match[seg_len - 1], 4);
+		__m128i left = _mm_setzero_si128();
+
+		for ( int s = 0; s < seg_len; ++s )
+			{
+			__m128i match = _mm_cmpeq_epi32(str2[s], c);
+			__m128i diag = _mm_add_epi32(_mm_add_epi32(tl, match_score),
+			                             _mm_and_si128(tl_match, chain_bonus));
+			__m128i h = sw_select(match, diag, sw_max(sw_max(prev[s], tl), left));
+
+			cur[s] = h;
+			cur_match[s] = match;
+			left = h;
+
+			tl = prev[s];
+			tl_match = prev_match[s];
+			}
+
+		for ( ;; )
+			{
+			left = _mm_slli_si128(left, 4);
+			int s = 0;
+
+			for ( ; s < seg_len; ++s )
+				{
+				__m128i h = sw_select(cur_match[s], cur[s], sw_max(cur[s], left));
+
+				if ( _mm_movemask_epi8(_mm_cmpeq_epi32(h, cur[s])) == 0xffff )
+					break;
+
+				cur[s] = h;
+				left = h;
+				}
+
+			if ( s < seg_len )
+				break;
+			}
+
+		uint8_t* flags = matrix.GetRow(i);
+		__m128i row_max = _mm_setzero_si128();
+
+		for ( int s = 0; s < seg_len; ++s )
+			{
+			__m128i up = _mm_andnot_si128(cur_match[s], _mm_cmpeq_epi32(cur[s], prev[s]));
+			__m128i f = _mm_or_si128(_mm_and_si128(cur_match[s], match_flag),
+			                         _mm_and_si128(up, up_flag));
+
+			f = _mm_packs_epi32(f, f);
+			f = _mm_packus_epi16(f, f);
+			int32_t packed = _mm_cvtsi128_si32(f);
+			memcpy(flags + s * SWMatrix::LANES, &packed, sizeof(packed));
+
+			row_max = sw_max(row_max, _mm_and_si128(cur[s], valid[s]));
+			}
+
+		alignas(16) int32_t lanes[SWMatrix::LANES];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), row_max);
+		int best = *std::max_element(lanes, lanes + SWMatrix::LANES);
+
+		// The best cell is the row's first one with the row's best
+		// score, if that beats the ones so far.
+		if ( best > matrix_max )
+			{
+			for ( int j = 1; j <= n; ++j )
+				{
+				_mm_store_si128(reinterpret_cast<__m128i*>(lanes), cur[(j - 1) % seg_len]);
+
+				if ( lanes[(j - 1) / seg_len] == best )
+					{
+					matrix_max = best;
+					max_row = i;
+					max_col = j;
+					break;
+					}
+				}
+			}
+
+		std::swap(prev, cur);
+		std::swap(prev_match, cur_match);
+		}
+	}
+
+#endif
+
+// Returns the common subsequence starting from a given cell.
 // @result: vector holding results on return.
 // @matrix: SW matrix.
-// @node: starting node.
+// @i, @j: starting cell.
 // @params: SW parameters.
 //
-static void sw_collect_single(Substring::Vec* result, SWNodeMatrix& matrix,
-			      SWNode* node, SWParams& params)
+static void sw_collect_single(Substring::Vec* result, SWMatrix& matrix,
+                              int i, int j, SWParams& params)
 	{
 	std::string substring("");
 	int row = 0, col = 0;
+	byte_vec string1 = matrix.GetRowsString()->Bytes();
 
-	while ( node )
+	for ( ;; )
 		{
-//		printf("NODE: %i\n", node->id);
-		node->swn_visited = true;
+		// Boundary cells end the walk, as a gap.
+		bool boundary = matrix.IsBoundary(i, j);
+		uint8_t flags = 0;
+
+		if ( ! boundary )
+			{
+			matrix(i, j) |= SWMatrix::SWC_VISITED;
+			flags = matrix(i, j);
+			}
 
 		// Once we hit a gap, terminate the string and prepend
 		// it to our result vector, IF it has at least the length
 		// requested through the params._min_toklen parameter.
 		//
-		if ( node->swn_byte_assigned )
+		if ( flags & SWMatrix::SWC_MATCH )
 			{
-			matrix.GetNodeIndices(node, row, col);
-			substring += node->swn_byte;
-//			printf("SUBSTRING: %s\n", substring.c_str());
+			row = i;
+			col = j;
+			substring += string1[i - 1];
 			}
 		else
 			{
-//			printf("GAP\n");
 			if ( substring.size() >= params._min_toklen )
 				{
 				reverse(substring.begin(), substring.end());
@@ -295,7 +552,18 @@ static void sw_collect_single(Substring::Vec* result, SWNodeMatrix& matrix,
 			substring = "";
 			}
 
-		node = node->swn_prev;
+		if ( boundary )
+			break;
+
+		if ( flags & SWMatrix::SWC_MATCH )
+			{
+			--i;
+			--j;
+			}
+		else if ( flags & SWMatrix::SWC_UP )
+			--i;
+		else
+			--j;
 		}
 
 	// Anything left over now is the first string of an alignment and is
@@ -320,25 +588,25 @@ static void sw_collect_single(Substring::Vec* result, SWNodeMatrix& matrix,
 // @params: SW parameters.
 //
 // The approach taken is to essentially follow back from all starting points of
-// common subsequences while tracking which nodes were visited earlier and which
+// common subsequences while tracking which cells were visited earlier and which
 // substrings are redundant (i.e., fully covered by a larger common substring).
 //
 static void sw_collect_multiple(Substring::Vec* result,
-                                SWNodeMatrix& matrix, SWParams& params)
+                                SWMatrix& matrix, SWParams& params)
 	{
 	std::vector<Substring::Vec*> als;
 
 	for ( int i = matrix.GetHeight() - 1; i > 0; --i )
 		{
-		for ( int j = matrix.GetWidth() - 1; j > 0; --j )
+		for ( int j = matrix.LastCol(i); j >= matrix.FirstCol(i); --j )
 			{
-			SWNode* node = matrix(i, j);
+			uint8_t flags = matrix(i, j);
 
-			if ( ! (node->swn_byte_assigned && ! node->swn_visited) )
+			if ( ! ((flags & SWMatrix::SWC_MATCH) && ! (flags & SWMatrix::SWC_VISITED)) )
 				continue;
 
 			auto* new_al = new Substring::Vec();
-			sw_collect_single(new_al, matrix, node, params);
+			sw_collect_single(new_al, matrix, i, j, params);
 
 			for ( auto& old_al : als )
 				{
@@ -397,157 +665,44 @@ Substring::Vec* smith_waterman(const String* s1, const String* s2,
 	     ! s2 || s2->Len() < int(params._min_toklen) )
 		return result;
 
-	// Length of both strings, plus one because SW needs
-	// an extra row and column.
-	//
-	int i, len1 = s1->Len() + 1;
-	int j, len2 = s2->Len() + 1;
-
-	int row = 0, col = 0;
-
-	byte_vec string1 = s1->Bytes();
-	byte_vec string2 = s2->Bytes();
+	// A band at least as wide as the strings doesn't restrict anything.
+	int band = params._band;
 
-	SWNodeMatrix matrix(s1, s2);	// dynamic programming matrix.
-	SWNode* node_max = nullptr;	// pointer to the best score's node
-	SWNode* node_br_max = nullptr;	// pointer to lowest-right matching node
+	if ( band >= std::max(s1->Len(), s2->Len()) )
+		band = 0;
 
-	// The highest score in the matrix, globally.  We initialize to 1
-	// because we are only interested in real scores (initializing to
-	// -infty would mean 0 is larger, and would complicate the link
-	// structure in the matrix).
-	//
-	int matrix_max = 1;
-	int br_max_r = 0;
-	int br_max_b = 0;
-
-
-	// Matrix initialization ----------------------------------------------
-
-	// Assign IDs to each cell -- this is only for debugging purposes
-	// and can go later.
-
-	int counter = 1;
-
-	for ( i = 1; i < len1; ++i )
-		for ( j = 1; j < len2; ++j )
-			matrix(i, j)->id = counter++;
-
-	// Subsequence calculation --------------------------------------------
-
-	for ( i = 1; i < len1; ++i )
-		{
-		for ( j = 1; j < len2; ++j )
-			{
-			// Current node, top/left neighbours.
-			//
-			SWNode* current = matrix(i, j);
-			SWNode* node_tl = matrix(i-1, j-1);
-			SWNode* node_l  = matrix(i, j-1);
-			SWNode* node_t  = matrix(i-1, j);
-
-			// Scores of neighbouring nodes.
-			//
-			int score_t = node_t->swn_score;
-			int score_l = node_l->swn_score;
-			int score_tl = node_tl->swn_score;
-
-			// If strings at current indices match, assign new
-			// score to current node.  Minus-one adjustments
-			// are necessary since matrix has one extra
-			// row + column.
-			//
-			if ( string1[i-1] == string2[j-1] )
-				{
-				// We have a match: improve previous score.
-				//
-				score_tl += 1;
-
-				// If we're continuing a chain of matches, rate
-				// higher.  This favours longer consecutive
-				// substrings.
-				//
-				if ( node_tl->swn_byte_assigned )
-					score_tl += 99;
-
-				// Store the byte we've matched in the node for
-				// easier access.
-				//
-				current->swn_byte = string1[i-1];
-				current->swn_byte_assigned = true;
-				}
-
-			// Pick the score among the neighbours that is now highest.
-			// This is the core of Smith-Waterman.
-			//
-			if ( current->swn_byte_assigned )
-				current->swn_score = score_tl;
-			else
-				current->swn_score = std::max(std::max(score_t, score_l), score_tl);
-
-			// Establish predecessor chain according to neighbor
-			// with best score.
-			//
-			if ( current->swn_score == score_tl &&
-			     current->swn_byte_assigned )
-				{
-				// If we had matched bytes (*and* it's the
-				// best neighbor), marke the node accordingly
-				//
-				if ( i >= br_max_b && j >= br_max_r )
-					{
-					node_br_max = current;
-					br_max_b = i;
-					br_max_r = j;
-					}
+#ifdef __SSE2__
+	bool striped = (band == 0);
+#else
+	bool striped = false;
+#endif
 
-				current->swn_prev = node_tl;
-				}
-			else if ( current->swn_score == score_t )
-				current->swn_prev = node_t;
-			else
-				current->swn_prev = node_l;
-
-			// Check if we have a new global maximum -- we
-			// specifically track the node that is the global
-			// maximum so we now from where to backtrack at
-			// the end of the matrix iteration.
-			//
-			if ( current->swn_score > matrix_max )
-				{
-				node_max = current;
-				matrix_max = current->swn_score;
-				}
+	// The dynamic programming matrix, with an extra row and column.
+	SWMatrix matrix(s1, s2, band, striped);
 
-#if 0
-			printf("%4i/%.5i%c/%.5i[%c%c] ",
-				current->swn_score,
-		 		current->id,
-				current->swn_byte_assigned ? '*' : ' ',
-		 		current->swn_prev ? current->swn_prev->id : 0,
-			       string1[i-1], string2[j-1]);
-#endif
-			//printf("%.5i ", current->swn_score);
-			}
+	// The cell with the globally best score, where the alignment ends.
+	int max_row, max_col;
 
-#if 0
-		printf("\n");
+#ifdef __SSE2__
+	if ( striped )
+		sw_fill_striped(matrix, max_row, max_col);
+	else
 #endif
-		}
+		sw_fill(matrix, max_row, max_col);
 
 	// Result generation.
 
 	// How we do this depends on the mode we operate in.  In SW_SINGLE, we
-	// follow the path from the best node until there is no predecessor
-	// (that is, when we hit a node in row 0), and stop.  In SW_MULTIPLE,
+	// follow the path from the best cell until there is no predecessor
+	// (that is, when we hit a cell in row 0), and stop.  In SW_MULTIPLE,
 	// we collect all non-redundant common subsequences.
 
 	if ( params._sw_variant == SW_MULTIPLE )
 		sw_collect_multiple(result, matrix, params);
-	else
-		sw_collect_single(result, matrix, node_max, params);
+	else if ( max_row > 0 )
+		sw_collect_single(result, matrix, max_row, max_col, params);
 
-	if ( len1 > len2 )
+	if ( s1->Len() > s2->Len() )
 		sort(result->begin(), result->end(), SubstringCmp(0));
 	else
 		sort(result->begin(), result->end(), SubstringCmp(1));
@@ -556,3 +711,33 @@ Substring::Vec* smith_waterman(const String* s1, const String* s2,
 	}
 
 } // namespace zeek::detail
+
+TEST_CASE("smith-waterman banding")
+	{
+	zeek::String s1(std::string("abcdefXYZWgh"));
+	zeek::String s2(std::string("XYZWqqqqqqgh"));
+
+	auto align = [&](unsigned int band)
+		{
+		zeek::detail::SWParams params(2, zeek::detail::SW_SINGLE, band);
+		auto* subseq = zeek::detail::smith_waterman(&s1, &s2, params);
+		std::string result;
+
+		for ( const auto* bst : *subseq )
+			result += zeek::util::fmt("%s/%d/%d;", bst->CheckString(),
+			                          bst->GetAlignments()[0].index,
+			                          bst->GetAlignments()[1].index);
+
+		zeek::util::delete_each(subseq);
+		delete subseq;
+		return result;
+		};
+
+	// A band as wide as the strings changes nothing, a narrower one
+	// loses the alignment that's off the diagonal by 6.
+	auto full = align(0);
+	CHECK(full == "XYZW/6/0;gh/10/10;");
+	CHECK(align(12) == full);
+	CHECK(align(6) == full);
+	CHECK(align(2) == "gh/10/10;");
+	}
@@ -115,10 +115,12 @@ enum SWVariant {
 // Parameters for Smith-Waterman are stored in this simple record.
 //
 struct SWParams {
-	explicit SWParams(unsigned int min_toklen = 3, SWVariant sw_variant = SW_SINGLE)
+	explicit SWParams(unsigned int min_toklen = 3, SWVariant sw_variant = SW_SINGLE,
+	                  unsigned int band = 0)
 		{
 		_min_toklen = min_toklen;
 		_sw_variant = sw_variant;
+		_band = band;
 		}
 
 	// The minimum string size to report.  For example, min_toklen = 2
@@ -126,6 +128,11 @@ struct SWParams {
 	unsigned int _min_toklen;
 
 	SWVariant _sw_variant;
+
+	// If non-zero, only cells whose row and column differ by at most
+	// this much get computed, which limits the work to O(n * band) at
+	// the price of missing alignments that stray further.
+	unsigned int _band;
 };
 
 
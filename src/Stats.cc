@@ -185,8 +185,9 @@ void ProfileLogger::Log()
 		rule_matcher->GetStats(&stats);
 
 		file->Write(util::fmt("%06f RuleMatcher: matchers=%d nfa_states=%d dfa_states=%d "
-		                      "ncomputed=%d mem=%dK\n", run_state::network_time, stats.matchers,
-		                      stats.nfa_states, stats.dfa_states, stats.computed, stats.mem / 1024));
+		                      "ncomputed=%d mem=%dK evictions=%d\n", run_state::network_time,
+		                      stats.matchers, stats.nfa_states, stats.dfa_states, stats.computed,
+		                      stats.mem / 1024, stats.evictions));
 		}
 
 	file->Write(util::fmt("%.06f Timers: current=%d max=%d lag=%.2fs\n",
@@ -17,6 +17,7 @@
 #include "zeek/Debug.h"
 #include "zeek/Traverse.h"
 #include "zeek/Trigger.h"
+#include "zeek/ScriptProfile.h"
 #include "zeek/IntrusivePtr.h"
 #include "zeek/logging/Manager.h"
 
@@ -1237,19 +1238,25 @@ ValPtr ForStmt::DoExec(Frame* f, Val* v, StmtFlowType& flow) const
 		if ( ! loop_vals->Length() )
 			return nullptr;
 
-		HashKey* k;
+		// The keys get used in place and the index values recovered
+		// into the same vector, so iterations don't allocate beyond
+		// what the values themselves need.
+		const void* key;
+		int key_size;
+		hash_t hash;
+		std::vector<ValPtr> ind_vals;
+
 		TableEntryVal* current_tev;
 		IterCookie* c = loop_vals->InitForIteration();
-		while ( (current_tev = loop_vals->NextEntry(k, c)) )
+		while ( (current_tev = loop_vals->NextEntry(key, key_size, hash, c)) )
 			{
-			auto ind_lv = tv->RecreateIndex(*k);
-			delete k;
+			tv->RecreateIndex(HashKey(key, key_size, hash, true), ind_vals);
 
 			if ( value_var )
 				f->SetElement(value_var, current_tev->GetVal());
 
-			for ( int i = 0; i < ind_lv->Length(); i++ )
-				f->SetElement((*loop_vars)[i], ind_lv->Idx(i));
+			for ( size_t i = 0; i < ind_vals.size(); i++ )
+				f->SetElement((*loop_vars)[i], std::move(ind_vals[i]));
 
 			flow = FLOW_NEXT;
 
@@ -1560,7 +1567,16 @@ ValPtr StmtList::Exec(Frame* f, StmtFlowType& flow) const
 			{ // ### Abort or something
 			}
 
-		auto result = stmt->Exec(f, flow);
+		ValPtr result;
+
+		if ( script_profile_mgr )
+			{
+			double start = script_profile_mgr->StmtStart();
+			result = stmt->Exec(f, flow);
+			script_profile_mgr->StmtFinished(stmt, start);
+			}
+		else
+			result = stmt->Exec(f, flow);
 
 		if ( ! post_execute_stmt(stmt, f, result.get(), &flow) )
 			{ // ### Abort or something
@@ -51,7 +51,7 @@ public:
 
 	void RegisterAccess() const	{ last_access = run_state::network_time; access_count++; }
 	void AccessStats(ODesc* d) const;
-	uint32_t GetAccessCount() const { return access_count; }
+	uint64_t GetAccessCount() const { return access_count; }
 
 	void Describe(ODesc* d) const override;
 
@@ -73,7 +73,7 @@ protected:
 
 	// FIXME: Learn the exact semantics of mutable.
 	mutable double last_access;	// time of last execution
-	mutable uint32_t access_count;	// number of executions
+	mutable uint64_t access_count;	// number of executions
 };
 
 class ExprListStmt : public Stmt {
@@ -83,6 +83,8 @@ public:
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 protected:
+	friend class ScriptOptimizer;
+
 	ExprListStmt(StmtTag t, ListExprPtr arg_l);
 
 	~ExprListStmt() override;
@@ -120,6 +122,8 @@ public:
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 protected:
+	friend class ScriptOptimizer;
+
 	ExprStmt(StmtTag t, ExprPtr e);
 
 	virtual ValPtr DoExec(Frame* f, Val* v, StmtFlowType& flow) const;
@@ -142,6 +146,8 @@ public:
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 protected:
+	friend class ScriptOptimizer;
+
 	ValPtr DoExec(Frame* f, Val* v, StmtFlowType& flow) const override;
 	bool IsPure() const override;
 
@@ -254,6 +260,9 @@ public:
 	WhileStmt(ExprPtr loop_condition, StmtPtr body);
 	~WhileStmt() override;
 
+	const Expr* Condition() const	{ return loop_condition.get(); }
+	const Stmt* Body() const	{ return body.get(); }
+
 	bool IsPure() const override;
 
 	void Describe(ODesc* d) const override;
@@ -261,6 +270,8 @@ public:
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 protected:
+	friend class ScriptOptimizer;
+
 	ValPtr Exec(Frame* f, StmtFlowType& flow) const override;
 
 	ExprPtr loop_condition;
@@ -287,6 +298,8 @@ public:
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 protected:
+	friend class ScriptOptimizer;
+
 	ValPtr DoExec(Frame* f, Val* v, StmtFlowType& flow) const override;
 
 	IDPList* loop_vars;
@@ -3,6 +3,8 @@
 #include "zeek-config.h"
 #include "zeek/Timer.h"
 
+#include <algorithm>
+
 #include "zeek/util.h"
 #include "zeek/Desc.h"
 #include "zeek/RunState.h"
@@ -48,6 +50,7 @@ const char* TimerNames[] = {
 	"TimerMgrExpireTimer",
 	"ThreadHeartbeat",
 	"UnknownProtocolExpire",
+	"ScriptCoverageTimer",
 };
 
 const char* timer_type_to_string(TimerType type)
@@ -192,4 +195,293 @@ double PQ_TimerMgr::GetNextTimeout()
 	return -1;
 	}
 
+TimerWheelMgr::TimerWheelMgr(double arg_resolution)
+	: TimerMgr(), resolution(arg_resolution)
+	{
+	}
+
+TimerWheelMgr::~TimerWheelMgr()
+	{
+	// The priority queues delete their remaining timers themselves.
+	for ( auto& wheel : wheels )
+		for ( auto& slot : wheel )
+			for ( auto timer : slot )
+				delete timer;
+	}
+
+uint64_t TimerWheelMgr::Tick(double time) const
+	{
+	if ( time <= 0 )
+		return 0;
+
+	return static_cast<uint64_t>(time / resolution);
+	}
+
+void TimerWheelMgr::Add(Timer* timer)
+	{
+	DBG_LOG(DBG_TM, "Adding timer %s (%p) at %.6f",
+	        timer_type_to_string(timer->Type()), timer, timer->Time());
+
+	// As with PQ_TimerMgr, already expired timers get added as well and
+	// go straight to the ready queue, which dispatches them in order.
+	Place(timer);
+
+	++current_timers[timer->Type()];
+	++cumulative_num;
+
+	if ( ++num_timers > peak_num_timers )
+		peak_num_timers = num_timers;
+	}
+
+void TimerWheelMgr::Place(Timer* timer)
+	{
+	uint64_t tick = Tick(timer->Time());
+
+	if ( expiring || tick <= current_tick )
+		{
+		timer->wheel_level = LEVEL_READY;
+
+		if ( ! ready.Add(timer) )
+			reporter->InternalError("out of memory");
+
+		return;
+		}
+
+	// The timer goes into the wheel for the most significant group of
+	// tick bits in which it differs from the current tick.
+	uint64_t diff = tick ^ current_tick;
+	int level = 0;
+
+	while ( level < LEVELS && (diff >> (BITS * (level + 1))) )
+		++level;
+
+	if ( level == LEVELS )
+		{
+		timer->wheel_level = LEVEL_OVERFLOW;
+
+		if ( ! overflow.Add(timer) )
+			reporter->InternalError("out of memory");
+
+		return;
+		}
+
+	Slot& slot = wheels[level][(tick >> (BITS * level)) & SLOT_MASK];
+	timer->wheel_level = level;
+	timer->SetOffset(slot.size());
+	slot.push_back(timer);
+	++level_size[level];
+	}
+
+void TimerWheelMgr::Unlink(Timer* timer)
+	{
+	int level = timer->wheel_level;
+
+	if ( level == LEVEL_READY || level == LEVEL_OVERFLOW )
+		{
+		auto& q = ( level == LEVEL_READY ) ? ready : overflow;
+
+		if ( ! q.Remove(timer) )
+			reporter->InternalError("asked to remove a missing timer");
+
+		return;
+		}
+
+	Slot& slot = wheels[level][(Tick(timer->Time()) >> (BITS * level)) & SLOT_MASK];
+	int offset = timer->Offset();
+
+	if ( offset < 0 || offset >= static_cast<int>(slot.size()) || slot[offset] != timer )
+		reporter->InternalError("asked to remove a missing timer");
+
+	// Constant-time removal: fill the hole with the slot's last timer.
+	slot[offset] = slot.back();
+	slot[offset]->SetOffset(offset);
+	slot.pop_back();
+	timer->SetOffset(-1);
+	--level_size[level];
+	}
+
+void TimerWheelMgr::Cascade(int level)
+	{
+	Slot timers;
+	timers.swap(wheels[level][(current_tick >> (BITS * level)) & SLOT_MASK]);
+	level_size[level] -= timers.size();
+
+	for ( auto timer : timers )
+		Place(timer);
+	}
+
+void TimerWheelMgr::PromoteOverflow()
+	{
+	while ( Timer* top = static_cast<Timer*>(overflow.Top()) )
+		{
+		uint64_t tick = Tick(top->Time());
+
+		if ( tick > current_tick && ((tick ^ current_tick) >> (BITS * LEVELS)) )
+			break;
+
+		overflow.Remove();
+		Place(top);
+		}
+	}
+
+void TimerWheelMgr::AdvanceTo(uint64_t target)
+	{
+	while ( true )
+		{
+		PromoteOverflow();
+
+		// Everything in the innermost slot of the current tick is due.
+		Slot& due = wheels[0][current_tick & SLOT_MASK];
+
+		for ( auto timer : due )
+			{
+			timer->wheel_level = LEVEL_READY;
+
+			if ( ! ready.Add(timer) )
+				reporter->InternalError("out of memory");
+			}
+
+		level_size[0] -= due.size();
+		due.clear();
+
+		if ( current_tick >= target )
+			break;
+
+		// Skip ahead over stretches in which nothing can become due:
+		// with the innermost N wheels empty, nothing happens before
+		// the next slot boundary of wheel N.
+		int empty = 0;
+		while ( empty < LEVELS && level_size[empty] == 0 )
+			++empty;
+
+		uint64_t next;
+
+		if ( empty == LEVELS )
+			{
+			next = target;
+
+			if ( Timer* top = static_cast<Timer*>(overflow.Top()) )
+				next = std::max(current_tick + 1, Tick(top->Time()));
+			}
+		else if ( empty > 0 )
+			next = ((current_tick >> (BITS * empty)) + 1) << (BITS * empty);
+		else
+			next = current_tick + 1;
+
+		current_tick = std::min(next, target);
+
+		for ( int level = LEVELS - 1; level > 0; --level )
+			{
+			uint64_t level_mask = (uint64_t(1) << (BITS * level)) - 1;
+
+			if ( (current_tick & level_mask) == 0 )
+				Cascade(level);
+			}
+		}
+	}
+
+int TimerWheelMgr::DoAdvance(double new_t, int max_expire)
+	{
+	AdvanceTo(Tick(new_t));
+
+	Timer* timer = static_cast<Timer*>(ready.Top());
+	for ( num_expired = 0; (num_expired < max_expire || max_expire == 0) &&
+		     timer && timer->Time() <= new_t; ++num_expired )
+		{
+		last_timestamp = timer->Time();
+		--current_timers[timer->Type()];
+		--num_timers;
+
+		// Remove it before dispatching, since the dispatch
+		// can otherwise delete it, and then we won't know
+		// whether we should delete it too.
+		(void) ready.Remove();
+
+		DBG_LOG(DBG_TM, "Dispatching timer %s (%p)",
+		        timer_type_to_string(timer->Type()), timer);
+		timer->Dispatch(new_t, false);
+		delete timer;
+
+		timer = static_cast<Timer*>(ready.Top());
+		}
+
+	return num_expired;
+	}
+
+void TimerWheelMgr::Expire()
+	{
+	// Funnel everything into the ready queue, including timers that get
+	// added while dispatching, so that all of them fire in time order.
+	expiring = true;
+
+	for ( auto& wheel : wheels )
+		for ( auto& slot : wheel )
+			{
+			for ( auto timer : slot )
+				Place(timer);
+
+			slot.clear();
+			}
+
+	for ( auto& size : level_size )
+		size = 0;
+
+	while ( Timer* timer = static_cast<Timer*>(overflow.Remove()) )
+		Place(timer);
+
+	while ( Timer* timer = static_cast<Timer*>(ready.Remove()) )
+		{
+		DBG_LOG(DBG_TM, "Dispatching timer %s (%p)",
+		        timer_type_to_string(timer->Type()), timer);
+		timer->Dispatch(t, true);
+		--current_timers[timer->Type()];
+		--num_timers;
+		delete timer;
+		}
+
+	expiring = false;
+	}
+
+void TimerWheelMgr::Remove(Timer* timer)
+	{
+	Unlink(timer);
+
+	--current_timers[timer->Type()];
+	--num_timers;
+	delete timer;
+	}
+
+double TimerWheelMgr::GetNextTimeout()
+	{
+	if ( Timer* top = static_cast<Timer*>(ready.Top()) )
+		return std::max(0.0, top->Time() - run_state::network_time);
+
+	uint64_t next = 0;
+
+	if ( level_size[0] )
+		{
+		// Innermost timers share all higher tick bits with the
+		// current tick, so the first non-empty slot gives the tick.
+		for ( uint64_t i = (current_tick & SLOT_MASK) + 1; i < SLOTS; ++i )
+			if ( ! wheels[0][i].empty() )
+				{
+				next = (current_tick & ~SLOT_MASK) | i;
+				break;
+				}
+		}
+
+	else if ( num_timers > overflow.Size() )
+		// Wake up no later than the next cascade. That may be too
+		// early, which is harmless.
+		next = ((current_tick >> BITS) + 1) << BITS;
+
+	else if ( Timer* top = static_cast<Timer*>(overflow.Top()) )
+		return std::max(0.0, top->Time() - run_state::network_time);
+
+	if ( ! next )
+		return -1;
+
+	return std::max(0.0, next * resolution - run_state::network_time);
+	}
+
 } // namespace zeek::detail
@@ -3,6 +3,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <vector>
 
 #include "zeek/PriorityQueue.h"
 #include "zeek/iosource/IOSource.h"
@@ -46,8 +47,9 @@ enum TimerType : uint8_t {
 	TIMER_TIMERMGR_EXPIRE,
 	TIMER_THREAD_HEARTBEAT,
 	TIMER_UNKNOWN_PROTOCOL_EXPIRE,
+	TIMER_SCRIPT_COVERAGE,
 };
-constexpr int NUM_TIMER_TYPES = int(TIMER_UNKNOWN_PROTOCOL_EXPIRE) + 1;
+constexpr int NUM_TIMER_TYPES = int(TIMER_SCRIPT_COVERAGE) + 1;
 
 extern const char* timer_type_to_string(TimerType type);
 
@@ -66,8 +68,13 @@ public:
 	void Describe(ODesc* d) const;
 
 protected:
+	friend class TimerWheelMgr;
 
 	TimerType type{};
+
+	// Where a TimerWheelMgr currently keeps this timer.  Fits into
+	// the padding after the type, so it doesn't grow the object.
+	uint8_t wheel_level = 0;
 };
 
 class TimerMgr : public iosource::IOSource {
@@ -171,6 +178,86 @@ protected:
 	PriorityQueue* q;
 };
 
+/**
+ * A timer manager built on a hierarchical timing wheel.  Inserting and
+ * canceling timers takes constant time, independent of the number of
+ * pending timers.
+ *
+ * Time is divided into ticks of a fixed resolution.  Timers due within
+ * the next 256 ticks live in the innermost wheel, and each of the outer
+ * wheels covers 256 times the span of the one inside it.  Whenever the
+ * clock crosses the boundary of an outer wheel slot, that slot's timers
+ * cascade inwards.  Timers due beyond the outermost wheel's span wait in
+ * an overflow priority queue.
+ *
+ * Timers due in the current tick move into a small priority queue before
+ * dispatching, so timers fire in exactly the same order as with
+ * PQ_TimerMgr.
+ */
+class TimerWheelMgr : public TimerMgr {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param resolution the length of a tick in seconds.
+	 */
+	explicit TimerWheelMgr(double resolution = DEFAULT_RESOLUTION);
+	~TimerWheelMgr() override;
+
+	void Add(Timer* timer) override;
+	void Expire() override;
+
+	int Size() const override { return num_timers; }
+	int PeakSize() const override { return peak_num_timers; }
+	uint64_t CumulativeNum() const override { return cumulative_num; }
+	double GetNextTimeout() override;
+
+	static constexpr double DEFAULT_RESOLUTION = 0.01;
+
+protected:
+	int DoAdvance(double t, int max_expire) override;
+	void Remove(Timer* timer) override;
+
+private:
+	static constexpr int LEVELS = 4;
+	static constexpr int BITS = 8;
+	static constexpr int SLOTS = 1 << BITS;
+	static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+
+	// Values of Timer::wheel_level beyond the wheels themselves.
+	static constexpr uint8_t LEVEL_READY = LEVELS;
+	static constexpr uint8_t LEVEL_OVERFLOW = LEVELS + 1;
+
+	using Slot = std::vector<Timer*>;
+
+	uint64_t Tick(double time) const;
+
+	// Files the timer into the ready queue, a wheel slot, or the
+	// overflow queue, depending on how far ahead of the clock it is.
+	void Place(Timer* timer);
+	void Unlink(Timer* timer);
+
+	// Moves the wheels' clock forward to the given tick, moving all
+	// timers due by then into the ready queue.
+	void AdvanceTo(uint64_t target);
+	void Cascade(int level);
+	void PromoteOverflow();
+
+	double resolution;
+	uint64_t current_tick = 0;
+
+	Slot wheels[LEVELS][SLOTS];
+	int level_size[LEVELS] = { };
+
+	PriorityQueue ready;
+	PriorityQueue overflow;
+
+	int num_timers = 0;
+	int peak_num_timers = 0;
+	uint64_t cumulative_num = 0;
+	bool expiring = false;
+};
+
 extern TimerMgr* timer_mgr;
 
 } // namespace zeek::detail
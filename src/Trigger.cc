@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <algorithm>
+#include <set>
 
 #include "zeek/Traverse.h"
 #include "zeek/Expr.h"
@@ -33,9 +34,56 @@ public:
 	virtual TraversalCode PreExpr(const Expr*) override;
 
 private:
+	// Registers the trigger for changes of a table's entry, if the
+	// expression indexes a global table with constants and locals.
+	// Returns false if it doesn't, or if the table's lookups aren't
+	// confined to a single entry, as with subnet indices.
+	bool RegisterEntry(const Expr* table, const Expr* index);
+
 	Trigger* trigger;
+
+	// The table names that RegisterEntry() took care of.
+	std::set<const Expr*> entry_tables;
 };
 
+bool TriggerTraversalCallback::RegisterEntry(const Expr* table, const Expr* index)
+	{
+	if ( table->Tag() != EXPR_NAME || index->Tag() != EXPR_LIST )
+		return false;
+
+	const ID* id = static_cast<const NameExpr*>(table)->Id();
+	const auto& v = id->GetVal();
+
+	if ( ! id->IsGlobal() || ! v || v->GetType()->Tag() != TYPE_TABLE ||
+	     v->GetType()->AsTableType()->IsSubNetIndex() )
+		return false;
+
+	for ( const auto& e : index->AsListExpr()->Exprs() )
+		if ( e->Tag() != EXPR_NAME && e->Tag() != EXPR_CONST )
+			return false;
+
+	ValPtr index_val;
+
+	try
+		{
+		index_val = index->Eval(trigger->frame);
+		}
+	catch ( InterpreterException& )
+		{ /* Already reported */ }
+
+	if ( ! index_val )
+		return false;
+
+	auto k = v->AsTableVal()->MakeHashKey(*index_val);
+
+	if ( ! k )
+		return false;
+
+	trigger->Register(v.get(), k->Hash());
+	return true;
+	}
+
+
 TraversalCode trigger::TriggerTraversalCallback::PreExpr(const Expr* expr)
 	{
 	// We catch all expressions here which in some way reference global
@@ -50,11 +98,26 @@ TraversalCode trigger::TriggerTraversalCallback::PreExpr(const Expr* expr)
 
 		Val* v = e->Id()->GetVal().get();
 
-		if ( v && v->Modifiable() )
+		if ( v && v->Modifiable() && entry_tables.count(expr) == 0 )
 			trigger->Register(v);
 		break;
 		};
 
+	case EXPR_IN:
+	case EXPR_INDEX:
+		{
+		// Membership tests and lookups of a particular entry only
+		// need to look again once that entry changes, rather than
+		// with every change of the table.
+		const auto* e = static_cast<const BinaryExpr*>(expr);
+		const Expr* table = expr->Tag() == EXPR_IN ? e->Op2() : e->Op1();
+		const Expr* index = expr->Tag() == EXPR_IN ? e->Op1() : e->Op2();
+
+		if ( RegisterEntry(table, index) )
+			entry_tables.insert(table);
+		break;
+		};
+
 	default:
 		// All others are uninteresting.
 		break;
@@ -63,6 +126,96 @@ TraversalCode trigger::TriggerTraversalCallback::PreExpr(const Expr* expr)
 	return TC_CONTINUE;
 	}
 
+// Callback class to find out whether evaluating an expression may modify
+// values of the frame in place.  Assigning a local only replaces the frame's
+// element, but modifying an aggregate, or handing it to a function, an event
+// or a lambda may change it.
+class FrameModificationCallback : public TraversalCallback {
+public:
+	TraversalCode PreExpr(const Expr*) override;
+
+	bool modifies = false;
+
+private:
+	static bool IsImmutable(const TypePtr& t);
+};
+
+bool FrameModificationCallback::IsImmutable(const TypePtr& t)
+	{
+	switch ( t->Tag() ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+	case TYPE_COUNT:
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+	case TYPE_STRING:
+	case TYPE_PATTERN:
+	case TYPE_ENUM:
+	case TYPE_PORT:
+	case TYPE_ADDR:
+	case TYPE_SUBNET:
+		return true;
+
+	default:
+		return false;
+	}
+	}
+
+TraversalCode FrameModificationCallback::PreExpr(const Expr* expr)
+	{
+	switch ( expr->Tag() ) {
+	case EXPR_INCR:
+	case EXPR_DECR:
+	case EXPR_ADD_TO:
+	case EXPR_REMOVE_FROM:
+	case EXPR_LAMBDA:
+	case EXPR_EVENT:
+	case EXPR_SCHEDULE:
+		modifies = true;
+		break;
+
+	case EXPR_ASSIGN:
+		{
+		const Expr* lhs = static_cast<const AssignExpr*>(expr)->Op1();
+
+		if ( lhs->Tag() == EXPR_REF )
+			lhs = static_cast<const RefExpr*>(lhs)->Op();
+
+		if ( lhs->Tag() != EXPR_NAME )
+			modifies = true;
+		break;
+		}
+
+	case EXPR_CALL:
+		{
+		const auto* c = static_cast<const CallExpr*>(expr);
+		const Expr* func = c->Func();
+
+		if ( func->Tag() != EXPR_NAME ||
+		     ! static_cast<const NameExpr*>(func)->Id()->IsGlobal() )
+			{
+			modifies = true;
+			break;
+			}
+
+		for ( const auto& arg : c->Args()->Exprs() )
+			if ( ! IsImmutable(arg->GetType()) )
+				{
+				modifies = true;
+				break;
+				}
+
+		break;
+		}
+
+	default:
+		break;
+	}
+
+	return modifies ? TC_ABORTALL : TC_CONTINUE;
+	}
+
 class TriggerTimer final : public Timer {
 public:
 	TriggerTimer(double arg_timeout, Trigger* arg_trigger)
@@ -105,12 +258,18 @@ Trigger::Trigger(Expr* arg_cond, Stmt* arg_body,
 	{
 	cond = arg_cond;
 	body = arg_body;
+
+	trigger::FrameModificationCallback cb;
+	cond->Traverse(&cb);
+	cond_modifies_frame = cb.modifies;
+
 	timeout_stmts = arg_timeout_stmts;
 	timeout = arg_timeout;
 	frame = arg_frame->Clone();
 	timer = nullptr;
 	delayed = false;
 	disabled = false;
+	queued = false;
 	attached = nullptr;
 	is_return = arg_is_return;
 	location = arg_location;
@@ -223,9 +382,11 @@ bool Trigger::Eval()
 		return false;
 		}
 
-	// It's unfortunate that we have to copy the frame again here but
-	// otherwise changes to any of the locals would propagate to later
-	// evaluations.
+	// Changes to any of the locals mustn't propagate to later
+	// evaluations.  Assignments only touch the new frame's elements, so
+	// the values only need copying if the condition may modify them in
+	// place.  The body runs at most once, after which the frame's values
+	// aren't needed anymore.
 	//
 	// An alternative approach to copying the frame would be to deep-copy
 	// the expression itself, replacing all references to locals with
@@ -235,7 +396,7 @@ bool Trigger::Eval()
 
 	try
 		{
-		f = frame->Clone();
+		f = cond_modifies_frame ? frame->Clone() : frame->ShareClone();
 		}
 	catch ( InterpreterException& )
 		{
@@ -336,7 +497,8 @@ void Trigger::Timeout()
 	if ( timeout_stmts )
 		{
 		StmtFlowType flow;
-		FramePtr f{AdoptRef{}, frame->Clone()};
+		// The trigger ends with this, so its values needn't be copied.
+		FramePtr f{AdoptRef{}, frame->ShareClone()};
 		ValPtr v;
 
 		try
@@ -394,6 +556,15 @@ void Trigger::Register(Val* val)
 	objs.emplace_back(val, val->Modifiable());
 	}
 
+void Trigger::Register(Val* val, uint64_t key)
+	{
+	assert(! disabled);
+	notifier::detail::registry.Register(val->Modifiable(), key, this);
+
+	Ref(val);
+	keyed_objs.emplace_back(val, key);
+	}
+
 void Trigger::UnregisterAll()
 	{
 	DBG_LOG(DBG_NOTIFIERS, "%s: unregistering all", Name());
@@ -405,6 +576,14 @@ void Trigger::UnregisterAll()
 		}
 
 	objs.clear();
+
+	for ( const auto& o : keyed_objs )
+		{
+		notifier::detail::registry.Unregister(o.first->Modifiable(), o.second, this);
+		Unref(o.first);
+		}
+
+	keyed_objs.clear();
 	}
 
 void Trigger::Attach(Trigger *trigger)
@@ -511,7 +690,8 @@ void Manager::Process()
 	for ( TriggerList::iterator i = orig->begin(); i != orig->end(); ++i )
 		{
 		Trigger* t = *i;
-		(*i)->Eval();
+		t->queued = false;
+		t->Eval();
 		Unref(t);
 		}
 
@@ -523,8 +703,9 @@ void Manager::Process()
 
 void Manager::Queue(Trigger* trigger)
 	{
-	if ( std::find(pending->begin(), pending->end(), trigger) == pending->end() )
+	if ( ! trigger->queued )
 		{
+		trigger->queued = true;
 		Ref(trigger);
 		pending->push_back(trigger);
 		total_triggers++;
@@ -90,13 +90,18 @@ public:
 private:
 	friend class TriggerTraversalCallback;
 	friend class TriggerTimer;
+	friend class Manager;
 
 	void Init(std::vector<IntrusivePtr<Val>> index_expr_results);
 	void Register(ID* id);
 	void Register(Val* val);
+	void Register(Val* val, uint64_t key);
 	void UnregisterAll();
 
 	Expr* cond;
+	// Whether evaluating the condition may modify values of the frame in
+	// place, so that each evaluation needs a copy of them.
+	bool cond_modifies_frame;
 	Stmt* body;
 	Stmt* timeout_stmts;
 	Expr* timeout;
@@ -110,9 +115,14 @@ private:
 
 	bool delayed; // true if a function call is currently being delayed
 	bool disabled;
+	bool queued; // true if waiting in the manager's list of pending triggers
 
 	std::vector<std::pair<Obj *, notifier::detail::Modifiable*>> objs;
 
+	// Tables we only watch for changes of particular entries, with the
+	// hash of the entry's index.
+	std::vector<std::pair<Val*, uint64_t>> keyed_objs;
+
 	using ValCache = std::map<const CallExpr*, Val*>;
 	ValCache cache;
 };
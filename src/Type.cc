@@ -836,6 +836,48 @@ RecordType::RecordType(type_decl_list* arg_types) : Type(TYPE_RECORD)
 	{
 	types = arg_types;
 	num_fields = types ? types->length() : 0;
+	ExtendUnboxedLayout();
+	}
+
+// Returns the number of bytes a value of the given type takes when stored
+// unboxed in a record, or 0 if it can't be.
+static int unboxed_field_size(TypeTag t)
+	{
+	switch ( t ) {
+	case TYPE_INT:
+		return sizeof(bro_int_t);
+
+	case TYPE_COUNT:
+		return sizeof(bro_uint_t);
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		return sizeof(double);
+
+	case TYPE_ADDR:
+		return sizeof(in6_addr);
+
+	default:
+		return 0;
+	}
+	}
+
+void RecordType::ExtendUnboxedLayout()
+	{
+	for ( int i = unboxed_offsets.size(); i < num_fields; ++i )
+		{
+		int size = unboxed_field_size(GetFieldType(i)->Tag());
+
+		if ( size == 0 )
+			{
+			unboxed_offsets.push_back(-1);
+			continue;
+			}
+
+		unboxed_offsets.push_back(unboxed_size);
+		unboxed_size += size;
+		}
 	}
 
 // in this case the clone is actually not so shallow, since
@@ -1036,6 +1078,7 @@ const char* RecordType::AddFields(const type_decl_list& others,
 		}
 
 	num_fields = types->length();
+	ExtendUnboxedLayout();
 	RecordVal::ResizeParseTimeRecords(this);
 	TableVal::RebuildParseTimeTables();
 	return nullptr;
@@ -688,11 +688,33 @@ public:
 
 	std::string GetFieldDeprecationWarning(int field, bool has_check) const;
 
+	/**
+	 * Returns where RecordVal instances store the value of a field
+	 * unboxed, as an offset into their unboxed storage, or -1 if values
+	 * of the field's type are always stored as Vals.  Fields of types
+	 * int, count, double, time, interval and addr get unboxed storage.
+	 */
+	int UnboxedOffset(int field) const	{ return unboxed_offsets[field]; }
+
+	/**
+	 * Returns the number of bytes of unboxed storage that RecordVal
+	 * instances need.
+	 */
+	int UnboxedSize() const	{ return unboxed_size; }
+
 protected:
 	RecordType() { types = nullptr; }
 
+	// Assigns unboxed storage to fields that don't have it yet.  Offsets
+	// of existing fields never change, so that instances created before
+	// adding fields only need to grow their storage.
+	void ExtendUnboxedLayout();
+
 	int num_fields;
 	type_decl_list* types;
+
+	std::vector<int> unboxed_offsets;
+	int unboxed_size = 0;
 };
 
 class SubNetType final : public Type {
@@ -937,11 +959,14 @@ extern zeek::OpaqueTypePtr sha1_type;
 extern zeek::OpaqueTypePtr sha256_type;
 extern zeek::OpaqueTypePtr entropy_type;
 extern zeek::OpaqueTypePtr cardinality_type;
+extern zeek::OpaqueTypePtr countminsketch_type;
 extern zeek::OpaqueTypePtr topk_type;
 extern zeek::OpaqueTypePtr bloomfilter_type;
 extern zeek::OpaqueTypePtr x509_opaque_type;
 extern zeek::OpaqueTypePtr ocsp_resp_opaque_type;
 extern zeek::OpaqueTypePtr paraglob_type;
+extern zeek::OpaqueTypePtr shared_table_type;
+extern zeek::OpaqueTypePtr packet_header_type;
 
 using BroType [[deprecated("Remove in v4.1. Use zeek::Type instead.")]] = zeek::Type;
 using TypeList [[deprecated("Remove in v4.1. Use zeek::TypeList instead.")]] = zeek::TypeList;
@@ -0,0 +1,267 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/UDPTunnelCache.h"
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <algorithm>
+
+extern "C" {
+#include <pcap.h>	// for the DLT_EN10MB constant definition
+}
+
+#include "zeek/Conn.h"
+#include "zeek/IP.h"
+#include "zeek/NetVar.h"
+#include "zeek/RunState.h"
+#include "zeek/Sessions.h"
+#include "zeek/analyzer/Manager.h"
+#include "zeek/analyzer/protocol/conn-size/ConnSize.h"
+#include "zeek/analyzer/protocol/pia/PIA.h"
+#include "zeek/analyzer/protocol/udp/UDP.h"
+#include "zeek/iosource/Packet.h"
+#include "zeek/packet_analysis/protocol/iptunnel/IPTunnel.h"
+#include "zeek/3rdparty/doctest.h"
+
+#include "const.bif.h"
+#include "event.bif.h"
+#include "analyzer/protocol/udp/events.bif.h"
+#include "analyzer/protocol/vxlan/events.bif.h"
+#include "analyzer/protocol/gtpv1/events.bif.h"
+
+namespace zeek::detail {
+
+void UDPTunnelCache::Add(Connection* c, analyzer::Analyzer* tunnel, BifEnum::Tunnel::Type type)
+	{
+	if ( ! c->IsKeyValid() || entries.find(c->Key()) != entries.end() )
+		return;
+
+	// Events for the individual outer packets need the regular path.
+	if ( new_packet || new_packet_header || packet_contents || ipv6_ext_headers ||
+	     udp_request || udp_reply || udp_contents ||
+	     vxlan_packet || gtpv1_g_pdu_packet || gtpv1_message )
+		return;
+
+	auto root = c->GetRootAnalyzer();
+
+	if ( ! root || ! root->IsAnalyzer("UDP") || tunnel->Parent() != root )
+		return;
+
+	analyzer::conn_size::ConnSize_Analyzer* size = nullptr;
+	auto pia = c->GetPrimaryPIA();
+
+	for ( auto* child : root->GetChildren() )
+		{
+		if ( child == tunnel )
+			continue;
+
+		if ( child->IsAnalyzer("CONNSIZE") )
+			size = static_cast<analyzer::conn_size::ConnSize_Analyzer*>(child);
+
+		// The PIA may stay as long as it no longer matches signatures.
+		else if ( ! (pia && child == pia->AsAnalyzer() && ! pia->PacketMatching()) )
+			return;
+		}
+
+	Entry e;
+	e.conn = c;
+	e.tunnel = tunnel;
+	e.udp = static_cast<analyzer::udp::UDP_Analyzer*>(root);
+	e.size = size;
+	e.type = type;
+	e.outer = c->GetEncapsulation();
+	e.stack = packet_analysis::IPTunnel::IPTunnelAnalyzer::Encapsulate(e.outer,
+	                                                                   EncapsulatingConn(c, type));
+
+	entries.emplace(c->Key(), std::move(e));
+	}
+
+bool UDPTunnelCache::Process(double t, const Packet* pkt, const ConnIDKey& key,
+                             const ConnID& id, const u_char* data, uint32_t len,
+                             size_t caplen)
+	{
+	auto it = entries.find(key);
+
+	if ( it == entries.end() )
+		return false;
+
+	Entry& e = it->second;
+	Connection* c = e.conn;
+
+	// Changes of the analyzers or of the outer encapsulation end the
+	// fast path for the connection.
+	if ( pkt->encap != e.outer || c->Skipping() || e.udp->Skipping() ||
+	     e.tunnel->Skipping() || e.tunnel->IsFinished() || e.tunnel->Removing() )
+		{
+		entries.erase(it);
+		return false;
+		}
+
+	// Packets the UDP analyzer would complain about take the regular
+	// path, too.
+	const struct udphdr* up = reinterpret_cast<const struct udphdr*>(data);
+
+	if ( caplen < len || ntohs(up->uh_ulen) != len || ! ChecksumExempt(e, pkt, data) )
+		return false;
+
+	const u_char* payload = data + sizeof(struct udphdr);
+	int plen = len - sizeof(struct udphdr);
+	IP_Hdr* inner = nullptr;
+
+	if ( e.type == BifEnum::Tunnel::VXLAN )
+		{
+		constexpr auto vxlan_len = 8;
+
+		if ( plen < vxlan_len || (payload[0] & 0x08) == 0 )
+			return false;
+		}
+	else
+		{
+		int offset = GTPv1PayloadOffset(payload, plen);
+
+		if ( offset < 0 )
+			return false;
+
+		int ip_len = plen - offset;
+		int version = ip_len > 0 ? payload[offset] >> 4 : 0;
+
+		if ( version != 4 && version != 6 )
+			return false;
+
+		if ( sessions->ParseIPPacket(ip_len, payload + offset,
+		                             version == 6 ? IPPROTO_IPV6 : IPPROTO_IPV4,
+		                             inner) != 0 )
+			{
+			delete inner;
+			return false;
+			}
+		}
+
+	const auto& ip = pkt->ip_hdr;
+	bool is_orig = (id.src_addr == c->OrigAddr()) && (id.src_port == c->OrigPort());
+
+	c->CheckFlowLabel(is_orig, ip->FlowLabel());
+
+	run_state::current_timestamp = t;
+	run_state::current_pkt = pkt;
+
+	e.udp->CountDatagram(is_orig, plen);
+
+	if ( e.size )
+		e.size->CountPacket(is_orig, ip->TotalLen());
+
+	c->SetLastTime(t);
+	c->ConnValChanged();
+
+	if ( ! ip->reassembled )
+		const_cast<Packet*>(pkt)->dump_packet = true;
+
+	// Processing the inner packet may remove entries, so the entry
+	// doesn't get used past this point.
+	auto stack = e.stack;
+	auto tunnel = e.tunnel;
+	auto ip_tunnel = packet_analysis::IPTunnel::ip_tunnel_analyzer;
+
+	if ( e.type == BifEnum::Tunnel::VXLAN )
+		{
+		constexpr auto vxlan_len = 8;
+
+		if ( ! ip_tunnel->ForwardLinkPacket(pkt, plen - vxlan_len, plen - vxlan_len,
+		                                    payload + vxlan_len, DLT_EN10MB,
+		                                    std::move(stack)) )
+			{
+			Remove(key);
+			tunnel->ProtocolViolation("VXLAN invalid inner packet");
+			}
+		}
+	else
+		ip_tunnel->ForwardIPPacket(pkt, inner, std::move(stack));
+
+	run_state::current_timestamp = 0;
+	run_state::current_pkt = nullptr;
+
+	return true;
+	}
+
+bool UDPTunnelCache::ChecksumExempt(const Entry& e, const Packet* pkt, const u_char* data)
+	{
+	if ( pkt->l3_checksummed || ignore_checksums || (pkt->l4_checksummed && ! e.outer) )
+		return true;
+
+	const struct udphdr* up = reinterpret_cast<const struct udphdr*>(data);
+	bool vxlan_port = false;
+
+	if ( e.type == BifEnum::Tunnel::VXLAN )
+		{
+		const auto& ports = analyzer_mgr->GetVxlanPorts();
+		vxlan_port = std::find(ports.begin(), ports.end(), ntohs(up->uh_dport)) != ports.end();
+		}
+
+	// A zero checksum means there is none, except for IPv6.
+	if ( up->uh_sum == 0 )
+		return pkt->ip_hdr->IP4_Hdr() || vxlan_port;
+
+	return vxlan_port && ! BifConst::Tunnel::validate_vxlan_checksums;
+	}
+
+int UDPTunnelCache::GTPv1PayloadOffset(const u_char* data, int len)
+	{
+	if ( len < 8 )
+		return -1;
+
+	uint8_t flags = data[0];
+
+	// Version 1, not GTP', and a G-PDU.
+	if ( (flags >> 5) != 1 || ! (flags & 0x10) || data[1] != 255 )
+		return -1;
+
+	int offset = (flags & 0x07) ? 12 : 8;
+
+	// The extension headers each give their length in units of four
+	// bytes and end with the type of the next one.
+	if ( flags & 0x04 )
+		{
+		do
+			{
+			if ( offset >= len || data[offset] == 0 )
+				return -1;
+
+			offset += data[offset] * 4;
+
+			if ( offset > len )
+				return -1;
+			}
+		while ( data[offset - 1] != 0 );
+		}
+
+	return offset <= len ? offset : -1;
+	}
+
+} // namespace zeek::detail
+
+TEST_CASE("udp tunnel gtpv1 payload offset")
+	{
+	using zeek::detail::UDPTunnelCache;
+
+	u_char plain[] = { 0x30, 0xff, 0x00, 0x04, 0, 0, 0, 1, 0x45, 0, 0, 0 };
+	CHECK(UDPTunnelCache::GTPv1PayloadOffset(plain, sizeof(plain)) == 8);
+
+	// Not a G-PDU, then GTP'.
+	plain[1] = 0x10;
+	CHECK(UDPTunnelCache::GTPv1PayloadOffset(plain, sizeof(plain)) == -1);
+	plain[1] = 0xff;
+	plain[0] = 0x20;
+	CHECK(UDPTunnelCache::GTPv1PayloadOffset(plain, sizeof(plain)) == -1);
+
+	// With optional fields and a single extension header of 4 bytes.
+	u_char ext[] = { 0x34, 0xff, 0x00, 0x08, 0, 0, 0, 1,
+	                 0, 0, 0, 0x85,
+	                 0x01, 0x00, 0x09, 0x00,
+	                 0x45, 0, 0, 0 };
+	CHECK(UDPTunnelCache::GTPv1PayloadOffset(ext, sizeof(ext)) == 16);
+
+	// Extension headers running past the payload.
+	ext[12] = 0x05;
+	CHECK(UDPTunnelCache::GTPv1PayloadOffset(ext, sizeof(ext)) == -1);
+	}
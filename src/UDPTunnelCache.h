@@ -0,0 +1,120 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// The outer connections of established UDP tunnels, whose packets get
+// decapsulated without passing through the outer connection's analyzers.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+#include "zeek/ConnMap.h"
+#include "zeek/TunnelEncapsulation.h"
+
+ZEEK_FORWARD_DECLARE_NAMESPACED(Packet, zeek);
+ZEEK_FORWARD_DECLARE_NAMESPACED(Connection, zeek);
+ZEEK_FORWARD_DECLARE_NAMESPACED(Analyzer, zeek, analyzer);
+ZEEK_FORWARD_DECLARE_NAMESPACED(UDP_Analyzer, zeek, analyzer::udp);
+ZEEK_FORWARD_DECLARE_NAMESPACED(ConnSize_Analyzer, zeek, analyzer::conn_size);
+
+namespace zeek { struct ConnID; }
+
+namespace zeek::detail {
+
+/**
+ * Tracks the outer connections of confirmed VXLAN and GTPv1 tunnels for which
+ * nothing but the tunnel's analyzer looks at the outer packets.  Their
+ * packets get decapsulated right after the lookup of the outer connection,
+ * skipping the analyzer tree and the repeated building of the inner
+ * encapsulation stack.  Anything out of the ordinary sends a packet down
+ * the regular path instead.
+ */
+class UDPTunnelCache {
+public:
+	/**
+	 * Adds the outer connection of a tunnel, if its packets qualify for
+	 * the fast path.  The tunnel analyzers call this once they have
+	 * confirmed the tunnel.
+	 *
+	 * @param c  The outer connection.
+	 *
+	 * @param tunnel  The tunnel's analyzer.
+	 *
+	 * @param type  The type of the tunnel, either VXLAN or GTPv1.
+	 */
+	void Add(Connection* c, analyzer::Analyzer* tunnel, BifEnum::Tunnel::Type type);
+
+	/**
+	 * Removes a connection, which must happen before the connection
+	 * goes away.
+	 */
+	void Remove(const ConnIDKey& key)	{ entries.erase(key); }
+
+	/**
+	 * Removes all connections.
+	 */
+	void Clear()	{ entries.clear(); }
+
+	/**
+	 * Processes a UDP packet if it belongs to one of the connections.
+	 *
+	 * @param t  The packet's time.
+	 *
+	 * @param pkt  The packet.
+	 *
+	 * @param key  The key of the packet's outer connection.
+	 *
+	 * @param id  The 5-tuple of the packet.
+	 *
+	 * @param data  The UDP header.
+	 *
+	 * @param len  The length of the UDP datagram, per the IP header.
+	 *
+	 * @param caplen  The captured length of the UDP datagram.
+	 *
+	 * @return True if the packet has been processed, and false if it
+	 * needs to take the regular path.
+	 */
+	bool Process(double t, const Packet* pkt, const ConnIDKey& key, const ConnID& id,
+	             const u_char* data, uint32_t len, size_t caplen);
+
+	/**
+	 * Returns the number of connections.
+	 */
+	size_t Size() const	{ return entries.size(); }
+
+	/**
+	 * Returns the offset of the inner IP packet within the payload of a
+	 * GTPv1 G-PDU, or -1 if the payload isn't one.
+	 */
+	static int GTPv1PayloadOffset(const u_char* data, int len);
+
+private:
+	struct Entry {
+		Connection* conn;	// Not Ref()'d; removed along with it.
+		analyzer::Analyzer* tunnel;
+		analyzer::udp::UDP_Analyzer* udp;
+		analyzer::conn_size::ConnSize_Analyzer* size;
+		BifEnum::Tunnel::Type type;
+
+		// The encapsulation of the outer connection, and that of the
+		// inner packets.
+		std::shared_ptr<EncapsulationStack> outer;
+		std::shared_ptr<EncapsulationStack> stack;
+	};
+
+	struct KeyHash {
+		size_t operator()(const ConnIDKey& k) const
+			{ return FlatConnMap::HashKey(k); }
+	};
+
+	// Returns whether the UDP analyzer would skip validating the
+	// checksum of the packet.
+	static bool ChecksumExempt(const Entry& e, const Packet* pkt, const u_char* data);
+
+	std::unordered_map<ConnIDKey, Entry, KeyHash> entries;
+};
+
+} // namespace zeek::detail
@@ -4,6 +4,7 @@
 
 #include <cstdlib>
 
+#include "zeek/NetVar.h"
 #include "zeek/Reporter.h"
 #include "zeek/util.h"
 
@@ -11,6 +12,65 @@ using namespace std;
 
 namespace zeek {
 
+namespace {
+
+// The state of counter_based_uids, per thread.
+struct CounterState {
+	static constexpr int ROUNDS = 4;
+
+	bool needs_init = true;
+	uint64_t counter = 0;
+	uint64_t keys[BRO_UID_LEN][ROUNDS];
+};
+
+thread_local CounterState counter_state;
+
+// A keyed permutation of 64-bit values, as a Feistel network over their
+// halves.  Being a permutation, it maps distinct counters to distinct
+// values.
+uint64_t permute(uint64_t x, const uint64_t* keys)
+	{
+	uint32_t l = x >> 32;
+	uint32_t r = static_cast<uint32_t>(x);
+
+	for ( int i = 0; i < CounterState::ROUNDS; ++i )
+		{
+		uint64_t f = (r ^ keys[i]) * 0x9e3779b97f4a7c15ULL;
+		f ^= f >> 29;
+
+		uint32_t t = l ^ static_cast<uint32_t>(f >> 32);
+		l = r;
+		r = t;
+		}
+
+	return (static_cast<uint64_t>(l) << 32) | r;
+	}
+
+// Returns the i-th value of a UID, drawing the UID's counter on the
+// first call, with *counter zero.
+uint64_t counter_based_id(size_t i, uint64_t* counter)
+	{
+	auto& s = counter_state;
+
+	if ( s.needs_init )
+		{
+		// The keys come from the regular UIDs, which are seeded the
+		// same way the hashed ones are.
+		for ( auto& word_keys : s.keys )
+			for ( auto& k : word_keys )
+				k = util::calculate_unique_id();
+
+		s.needs_init = false;
+		}
+
+	if ( *counter == 0 )
+		*counter = ++s.counter;
+
+	return permute(*counter, s.keys[i]);
+	}
+
+} // namespace
+
 void UID::Set(bro_uint_t bits, const uint64_t* v, size_t n)
 	{
 	initialized = true;
@@ -24,8 +84,17 @@ void UID::Set(bro_uint_t bits, const uint64_t* v, size_t n)
 	div_t res = div(bits, 64);
 	size_t size = res.rem ? res.quot + 1 : res.quot;
 
+	uint64_t counter = 0;
+
 	for ( size_t i = 0; i < size; ++i )
-		uid[i] = v && i < n ? v[i] : util::calculate_unique_id();
+		{
+		if ( v && i < n )
+			uid[i] = v[i];
+		else if ( zeek::detail::counter_based_uids )
+			uid[i] = counter_based_id(i, &counter);
+		else
+			uid[i] = util::calculate_unique_id();
+		}
 
 	if ( res.rem )
 		uid[0] >>= 64 - res.rem;
@@ -36,10 +105,17 @@ std::string UID::Base62(std::string prefix) const
 	if ( ! initialized )
 		reporter->InternalError("use of uninitialized UID");
 
-	char tmp[sizeof(uid) * 8 + 1];  // enough for even binary representation
+	// Up to 11 digits per value in base 62.
+	char tmp[BRO_UID_LEN * 11 + 1];
+	char* p = tmp;
+
 	for ( size_t i = 0; i < BRO_UID_LEN; ++i )
-		prefix.append(util::uitoa_n(uid[i], tmp, sizeof(tmp), 62));
+		{
+		util::uitoa_n(uid[i], p, tmp + sizeof(tmp) - p, 62);
+		p += strlen(p);
+		}
 
+	prefix.append(tmp, p - tmp);
 	return prefix;
 	}
 
@@ -62,6 +62,13 @@ public:
 	explicit operator bool() const
 		{ return initialized; }
 
+	/**
+	 * @return the BRO_UID_LEN values of the UID, for recreating it with
+	 *         Set().
+	 */
+	const uint64_t* Value() const
+		{ return uid; }
+
 	/**
 	 * Assignment operator.
 	 */
@@ -14,7 +14,10 @@
 #include <stdlib.h>
 
 #include <cmath>
+#include <map>
+#include <memory>
 #include <set>
+#include <vector>
 
 #include "zeek/Attr.h"
 #include "zeek/ZeekString.h"
@@ -34,6 +37,7 @@
 #include "zeek/Conn.h"
 #include "zeek/Reporter.h"
 #include "zeek/IPAddr.h"
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/ID.h"
 
 #include "zeek/broker/Data.h"
@@ -1335,6 +1339,30 @@ unsigned int ListVal::MemoryAllocation() const
 	return size + padded_sizeof(*this) + type->MemoryAllocation();
 	}
 
+namespace detail {
+
+// The entries of a table with expiration, grouped by the second of their
+// last expiration-relevant access, as of when they got added to the
+// index. Accesses leave the index alone: once an entry's group comes due,
+// the entry moves on to the group of its current access time if that's
+// later. That way, an expiration round only looks at entries that may be
+// due.
+class TableExpireIndex {
+public:
+	struct Item {
+		std::unique_ptr<HashKey> key;
+		// Tells whether the entry got removed or replaced since.
+		const TableEntryVal* entry;
+	};
+
+	void Add(std::unique_ptr<HashKey> key, const TableEntryVal* entry, int access)
+		{ groups[access].push_back({std::move(key), entry}); }
+
+	std::map<int, std::vector<Item>> groups;
+};
+
+} // namespace detail
+
 TableEntryVal* TableEntryVal::Clone(Val::CloneState* state)
 	{
 	auto rval = new TableEntryVal(val ? val->Clone(state) : nullptr);
@@ -1432,7 +1460,7 @@ void TableVal::Init(TableTypePtr t)
 	table_type = std::move(t);
 	expire_func = nullptr;
 	expire_time = nullptr;
-	expire_cookie = nullptr;
+	expire_index = nullptr;
 	timer = nullptr;
 	def_val = nullptr;
 
@@ -1454,6 +1482,7 @@ TableVal::~TableVal()
 	delete table_hash;
 	delete AsTable();
 	delete subnets;
+	delete expire_index;
 	}
 
 void TableVal::RemoveAll()
@@ -1462,6 +1491,9 @@ void TableVal::RemoveAll()
 	delete AsTable();
 	val.table_val = new PDict<TableEntryVal>;
 	val.table_val->SetDeleteFunc(table_entry_val_delete_func);
+
+	if ( expire_index )
+		expire_index->groups.clear();
 	}
 
 int TableVal::Size() const
@@ -1599,7 +1631,11 @@ bool TableVal::Assign(ValPtr index, std::unique_ptr<detail::HashKey> k,
 	if ( old_entry_val && attrs && attrs->Find(detail::ATTR_EXPIRE_CREATE) )
 		new_entry_val->SetExpireAccess(old_entry_val->ExpireAccessTime());
 
-	Modified();
+	if ( expire_index )
+		expire_index->Add(std::make_unique<detail::HashKey>(k_copy.Key(), k_copy.Size(), k_copy.Hash()),
+		                  new_entry_val, new_entry_val->expire_access_time);
+
+	Modified(k_copy.Hash());
 
 	if ( change_func || ( broker_forward && ! broker_store.empty() ) )
 		{
@@ -1962,22 +1998,17 @@ const ValPtr& TableVal::Find(const ValPtr& index)
 
 	if ( tbl->Length() > 0 )
 		{
-		auto k = MakeHashKey(*index);
+		TableEntryVal* v = FindEntry(*index);
 
-		if ( k )
+		if ( v )
 			{
-			TableEntryVal* v = AsTable()->Lookup(k.get());
-
-			if ( v )
-				{
-				if ( attrs && attrs->Find(detail::ATTR_EXPIRE_READ) )
-					v->SetExpireAccess(run_state::network_time);
+			if ( attrs && attrs->Find(detail::ATTR_EXPIRE_READ) )
+				v->SetExpireAccess(run_state::network_time);
 
-				if ( v->GetVal() )
-					return v->GetVal();
+			if ( v->GetVal() )
+				return v->GetVal();
 
-				return val_mgr->True();
-				}
+			return val_mgr->True();
 			}
 		}
 
@@ -2068,14 +2099,7 @@ bool TableVal::UpdateTimestamp(Val* index)
 	if ( subnets )
 		v = (TableEntryVal*) subnets->Lookup(index);
 	else
-		{
-		auto k = MakeHashKey(*index);
-
-		if ( ! k )
-			return false;
-
-		v = AsTable()->Lookup(k.get());
-		}
+		v = FindEntry(*index);
 
 	if ( ! v )
 		return false;
@@ -2090,6 +2114,11 @@ ListValPtr TableVal::RecreateIndex(const detail::HashKey& k) const
 	return table_hash->RecoverVals(k);
 	}
 
+void TableVal::RecreateIndex(const detail::HashKey& k, std::vector<ValPtr>& vals) const
+	{
+	table_hash->RecoverVals(k, vals);
+	}
+
 void TableVal::CallChangeFunc(const ValPtr& index,
                               const ValPtr& old_value,
                               OnChangeType tpe)
@@ -2279,7 +2308,10 @@ ValPtr TableVal::Remove(const Val& index, bool broker_forward, bool* iterators_i
 
 	delete v;
 
-	Modified();
+	if ( k )
+		Modified(k->Hash());
+	else
+		Modified();
 
 	if ( broker_forward && ! broker_store.empty() )
 		SendToStore(&index, nullptr, ELEMENT_REMOVED);
@@ -2312,7 +2344,7 @@ ValPtr TableVal::Remove(const detail::HashKey& k, bool* iterators_invalidated)
 
 	delete v;
 
-	Modified();
+	Modified(k.Hash());
 
 	if ( va && ( change_func || ! broker_store.empty() ) )
 		{
@@ -2542,6 +2574,20 @@ void TableVal::InitTimer(double delay)
 	detail::timer_mgr->Add(timer);
 	}
 
+void TableVal::BuildExpireIndex()
+	{
+	expire_index = new detail::TableExpireIndex;
+
+	const PDict<TableEntryVal>* tbl = AsTable();
+	IterCookie* c = tbl->InitForIteration();
+
+	detail::HashKey* k;
+	TableEntryVal* v;
+
+	while ( (v = tbl->NextEntry(k, c)) )
+		expire_index->Add(std::unique_ptr<detail::HashKey>(k), v, v->expire_access_time);
+	}
+
 void TableVal::DoExpire(double t)
 	{
 	if ( ! type )
@@ -2556,96 +2602,113 @@ void TableVal::DoExpire(double t)
 		// error, it has been reported already.
 		return;
 
-	if ( ! expire_cookie )
+	if ( ! expire_index )
+		BuildExpireIndex();
+
+	auto& groups = expire_index->groups;
+
+	auto due = [&](double access)
 		{
-		expire_cookie = tbl->InitForIteration();
-		tbl->MakeRobustCookie(expire_cookie);
-		}
+		// An access time of 0 happens when we insert val while
+		// network_time hasn't been initialized yet (e.g. in
+		// zeek_init()), and also when bro_start_network_time hasn't
+		// been initialized (e.g. before first packet). The
+		// expire_access_time is correct, so we just need to wait.
+		return access != 0 && access + timeout < t;
+		};
 
-	detail::HashKey* k = nullptr;
-	TableEntryVal* v = nullptr;
-	TableEntryVal* v_saved = nullptr;
-	bool modified = false;
+	auto regroup = [&](detail::TableExpireIndex::Item item, const TableEntryVal* v)
+		{
+		expire_index->Add(std::move(item.key), v, v->expire_access_time);
+		};
 
-	for ( int i = 0; i < zeek::detail::table_incremental_step &&
-		      (v = tbl->NextEntry(k, expire_cookie)); ++i )
+	for ( int i = 0; i < zeek::detail::table_incremental_step; ++i )
 		{
-		if ( v->ExpireAccessTime() == 0 )
+		// Expire functions may change the table, and with it the
+		// index, so each round starts over at the earliest group.
+		auto g = groups.begin();
+
+		if ( g == groups.end() ||
+		     ! due(run_state::zeek_start_network_time + g->first) )
+			break;
+
+		auto item = std::move(g->second.back());
+		g->second.pop_back();
+
+		if ( g->second.empty() )
+			groups.erase(g);
+
+		detail::HashKey* k = item.key.get();
+		TableEntryVal* v = tbl->Lookup(k);
+
+		if ( v != item.entry )
+			// Gone, or replaced by an entry with its own item.
+			continue;
+
+		if ( ! due(v->ExpireAccessTime()) )
 			{
-			// This happens when we insert val while network_time
-			// hasn't been initialized yet (e.g. in zeek_init()), and
-			// also when bro_start_network_time hasn't been initialized
-			// (e.g. before first packet).  The expire_access_time is
-			// correct, so we just need to wait.
+			// Accessed since it got grouped.
+			regroup(std::move(item), v);
+			continue;
 			}
 
-		else if ( v->ExpireAccessTime() + timeout < t )
+		ListValPtr idx = nullptr;
+
+		if ( expire_func )
 			{
-			ListValPtr idx = nullptr;
+			idx = RecreateIndex(*k);
+			double secs = CallExpireFunc(idx);
+
+			// It's possible that the user-provided
+			// function modified or deleted the table
+			// value, so look it up again.
+			v = tbl->Lookup(k);
 
-			if ( expire_func )
+			if ( ! v )
+				// user-provided function deleted it
+				continue;
+
+			if ( secs > 0 )
 				{
-				idx = RecreateIndex(*k);
-				double secs = CallExpireFunc(idx);
-
-				// It's possible that the user-provided
-				// function modified or deleted the table
-				// value, so look it up again.
-				v_saved = v;
-				v = tbl->Lookup(k);
-
-				if ( ! v )
-					{ // user-provided function deleted it
-					v = v_saved;
-					delete k;
-					continue;
-					}
+				// User doesn't want us to expire
+				// this now.
+				v->SetExpireAccess(run_state::network_time - timeout + secs);
 
-				if ( secs > 0 )
-					{
-					// User doesn't want us to expire
-					// this now.
-					v->SetExpireAccess(run_state::network_time - timeout + secs);
-					delete k;
-					continue;
-					}
+				if ( v == item.entry )
+					regroup(std::move(item), v);
 
+				continue;
 				}
 
-			if ( subnets )
-				{
-				if ( ! idx )
-					idx = RecreateIndex(*k);
-				if ( ! subnets->Remove(idx.get()) )
-					reporter->InternalWarning("index not in prefix table");
-				}
+			}
 
-			tbl->RemoveEntry(k);
-			if ( change_func )
-				{
-				if ( ! idx )
-					idx = RecreateIndex(*k);
+		if ( subnets )
+			{
+			if ( ! idx )
+				idx = RecreateIndex(*k);
+			if ( ! subnets->Remove(idx.get()) )
+				reporter->InternalWarning("index not in prefix table");
+			}
 
-				CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
-				}
+		tbl->RemoveEntry(k);
+		if ( change_func )
+			{
+			if ( ! idx )
+				idx = RecreateIndex(*k);
 
-			delete v;
-			modified = true;
+			CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
 			}
 
-		delete k;
+		delete v;
+		Modified(k->Hash());
 		}
 
-	if ( modified )
-		Modified();
+	auto g = groups.begin();
 
-	if ( ! v )
-		{
-		expire_cookie = nullptr;
-		InitTimer(zeek::detail::table_expire_interval);
-		}
-	else
+	if ( g != groups.end() && due(run_state::zeek_start_network_time + g->first) )
 		InitTimer(zeek::detail::table_expire_delay);
+	else
+		InitTimer(zeek::detail::table_expire_interval);
 	}
 
 double TableVal::GetExpireTime()
@@ -2811,6 +2874,20 @@ std::unique_ptr<detail::HashKey> TableVal::MakeHashKey(const Val& index) const
 	return table_hash->MakeHashKey(index, true);
 	}
 
+TableEntryVal* TableVal::FindEntry(const Val& index) const
+	{
+	if ( table_hash->HasFixedLayout() )
+		{
+		alignas(bro_int_t) char buf[detail::CompositeHash::MAX_FIXED_KEY_SIZE];
+
+		if ( int sz = table_hash->FixedHashKey(index, buf) )
+			return AsTable()->Lookup(buf, sz, detail::HashKey::HashBytes(buf, sz));
+		}
+
+	auto k = MakeHashKey(index);
+	return k ? AsTable()->Lookup(k.get()) : nullptr;
+	}
+
 void TableVal::SaveParseTimeTableState(RecordType* rt)
 	{
 	auto it = parse_time_table_record_dependencies.find(rt);
@@ -2881,8 +2958,7 @@ RecordVal::RecordVal(RecordTypePtr t, bool init_fields) : Val(std::move(t))
 	origin = nullptr;
 	auto rt = GetType()->AsRecordType();
 	int n = rt->NumFields();
-	auto vl = val.record_val = new std::vector<ValPtr>;
-	vl->reserve(n);
+	AllocFields(n, rt->UnboxedSize());
 
 	if ( run_state::is_parsing )
 		parse_time_records[rt].emplace_back(NewRef{}, this);
@@ -2908,7 +2984,7 @@ RecordVal::RecordVal(RecordTypePtr t, bool init_fields) : Val(std::move(t))
 				if ( run_state::is_parsing )
 					parse_time_records[rt].pop_back();
 
-				delete AsNonConstRecord();
+				FreeFields();
 				throw;
 				}
 
@@ -2939,13 +3015,121 @@ RecordVal::RecordVal(RecordTypePtr t, bool init_fields) : Val(std::move(t))
 				def = make_intrusive<VectorVal>(cast_intrusive<VectorType>(type));
 			}
 
-		vl->emplace_back(std::move(def));
+		fields[i] = std::move(def);
 		}
 	}
 
 RecordVal::~RecordVal()
 	{
-	delete AsNonConstRecord();
+	FreeFields();
+	}
+
+void RecordVal::AllocFields(int n, int unboxed_size)
+	{
+	size_t vals_size = n * sizeof(ValPtr);
+	auto block = static_cast<char*>(::operator new(vals_size + unboxed_size + n));
+	auto new_fields = reinterpret_cast<ValPtr*>(block);
+	auto new_unboxed = block + vals_size;
+	auto new_is_unboxed = reinterpret_cast<bool*>(new_unboxed + unboxed_size);
+
+	for ( int i = 0; i < n; ++i )
+		{
+		if ( i < num_fields )
+			{
+			new (&new_fields[i]) ValPtr(std::move(fields[i]));
+			new_is_unboxed[i] = is_unboxed[i];
+			}
+		else
+			{
+			new (&new_fields[i]) ValPtr();
+			new_is_unboxed[i] = false;
+			}
+		}
+
+	if ( fields )
+		// The unboxed storage immediately precedes the flags.
+		memcpy(new_unboxed, unboxed,
+		       reinterpret_cast<char*>(is_unboxed) - unboxed);
+
+	FreeFields();
+
+	fields = new_fields;
+	unboxed = new_unboxed;
+	is_unboxed = new_is_unboxed;
+	num_fields = n;
+	}
+
+void RecordVal::FreeFields()
+	{
+	if ( ! fields )
+		return;
+
+	for ( int i = 0; i < num_fields; ++i )
+		fields[i].~ValPtr();
+
+	::operator delete(fields);
+	fields = nullptr;
+	unboxed = nullptr;
+	is_unboxed = nullptr;
+	num_fields = 0;
+	}
+
+char* RecordVal::UnboxedSlot(int field, InternalTypeTag it) const
+	{
+	auto rt = GetType()->AsRecordType();
+	int offset = rt->UnboxedOffset(field);
+
+	if ( offset < 0 || rt->GetFieldType(field)->InternalType() != it )
+		return nullptr;
+
+	return unboxed + offset;
+	}
+
+ValPtr RecordVal::BoxField(int field) const
+	{
+	const auto& t = GetType()->AsRecordType()->GetFieldType(field);
+	const char* slot = unboxed + GetType()->AsRecordType()->UnboxedOffset(field);
+
+	switch ( t->Tag() ) {
+	case TYPE_INT:
+		{
+		bro_int_t i;
+		memcpy(&i, slot, sizeof(i));
+		return val_mgr->Int(i);
+		}
+
+	case TYPE_COUNT:
+		{
+		bro_uint_t u;
+		memcpy(&u, slot, sizeof(u));
+		return val_mgr->Count(u);
+		}
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		{
+		double d;
+		memcpy(&d, slot, sizeof(d));
+
+		if ( t->Tag() == TYPE_TIME )
+			return make_intrusive<TimeVal>(d);
+		if ( t->Tag() == TYPE_INTERVAL )
+			return make_intrusive<IntervalVal>(d);
+
+		return make_intrusive<DoubleVal>(d);
+		}
+
+	case TYPE_ADDR:
+		{
+		in6_addr a;
+		memcpy(&a, slot, sizeof(a));
+		return make_intrusive<AddrVal>(IPAddr(a));
+		}
+
+	default:
+		reporter->InternalError("bad unboxed record field type");
+	}
 	}
 
 ValPtr RecordVal::SizeVal() const
@@ -2955,8 +3139,165 @@ ValPtr RecordVal::SizeVal() const
 
 void RecordVal::Assign(int field, ValPtr new_val)
 	{
-	(*AsNonConstRecord())[field] = std::move(new_val);
+	fields[field] = std::move(new_val);
+	is_unboxed[field] = false;
+	Modified();
+	}
+
+bool RecordVal::AssignUnboxed(int field, const void* v, size_t len, InternalTypeTag it)
+	{
+	char* slot = UnboxedSlot(field, it);
+
+	if ( ! slot )
+		return false;
+
+	memcpy(slot, v, len);
+	fields[field] = nullptr;
+	is_unboxed[field] = true;
 	Modified();
+	return true;
+	}
+
+void RecordVal::AssignInt(int field, bro_int_t v)
+	{
+	if ( ! AssignUnboxed(field, &v, sizeof(v), TYPE_INTERNAL_INT) )
+		Assign(field, val_mgr->Int(v));
+	}
+
+void RecordVal::AssignCount(int field, bro_uint_t v)
+	{
+	if ( ! AssignUnboxed(field, &v, sizeof(v), TYPE_INTERNAL_UNSIGNED) )
+		Assign(field, val_mgr->Count(v));
+	}
+
+void RecordVal::AssignDouble(int field, double v)
+	{
+	if ( ! AssignUnboxed(field, &v, sizeof(v), TYPE_INTERNAL_DOUBLE) )
+		Assign(field, make_intrusive<DoubleVal>(v));
+	}
+
+void RecordVal::AssignTime(int field, double v)
+	{
+	if ( ! AssignUnboxed(field, &v, sizeof(v), TYPE_INTERNAL_DOUBLE) )
+		Assign(field, make_intrusive<TimeVal>(v));
+	}
+
+void RecordVal::AssignInterval(int field, double v)
+	{
+	if ( ! AssignUnboxed(field, &v, sizeof(v), TYPE_INTERNAL_DOUBLE) )
+		Assign(field, make_intrusive<IntervalVal>(v));
+	}
+
+void RecordVal::AssignAddr(int field, const IPAddr& v)
+	{
+	in6_addr a;
+	v.CopyIPv6(&a);
+
+	if ( ! AssignUnboxed(field, &a, sizeof(a), TYPE_INTERNAL_ADDR) )
+		Assign(field, make_intrusive<AddrVal>(v));
+	}
+
+bro_int_t RecordVal::GetIntField(int field) const
+	{
+	if ( ! is_unboxed[field] )
+		return fields[field]->InternalInt();
+
+	bro_int_t i;
+	memcpy(&i, UnboxedSlot(field, TYPE_INTERNAL_INT), sizeof(i));
+	return i;
+	}
+
+bro_uint_t RecordVal::GetCountField(int field) const
+	{
+	if ( ! is_unboxed[field] )
+		return fields[field]->InternalUnsigned();
+
+	bro_uint_t u;
+	memcpy(&u, UnboxedSlot(field, TYPE_INTERNAL_UNSIGNED), sizeof(u));
+	return u;
+	}
+
+double RecordVal::GetDoubleField(int field) const
+	{
+	if ( ! is_unboxed[field] )
+		return fields[field]->InternalDouble();
+
+	double d;
+	memcpy(&d, UnboxedSlot(field, TYPE_INTERNAL_DOUBLE), sizeof(d));
+	return d;
+	}
+
+IPAddr RecordVal::GetAddrField(int field) const
+	{
+	if ( ! is_unboxed[field] )
+		return fields[field]->AsAddr();
+
+	in6_addr a;
+	memcpy(&a, UnboxedSlot(field, TYPE_INTERNAL_ADDR), sizeof(a));
+	return IPAddr(a);
+	}
+
+TEST_CASE("record unboxed fields")
+	{
+	// Unit tests run before Zeek sets up its value manager.
+	std::unique_ptr<ValManager> test_val_mgr;
+
+	if ( ! val_mgr )
+		{
+		test_val_mgr = std::make_unique<ValManager>();
+		val_mgr = test_val_mgr.get();
+		}
+
+	auto decls = new type_decl_list();
+	decls->push_back(new TypeDecl(util::copy_string("c"), base_type(TYPE_COUNT)));
+	decls->push_back(new TypeDecl(util::copy_string("t"), base_type(TYPE_TIME)));
+	decls->push_back(new TypeDecl(util::copy_string("a"), base_type(TYPE_ADDR)));
+	decls->push_back(new TypeDecl(util::copy_string("s"), base_type(TYPE_STRING)));
+	auto rt = make_intrusive<RecordType>(decls);
+
+	CHECK(rt->UnboxedOffset(0) >= 0);
+	CHECK(rt->UnboxedOffset(2) >= 0);
+	CHECK(rt->UnboxedOffset(3) == -1);
+
+		{
+		auto rv = make_intrusive<RecordVal>(rt);
+		CHECK(! rv->HasField(0));
+
+		rv->AssignCount(0, 42);
+		CHECK(rv->HasField(0));
+		CHECK(rv->GetCountField(0) == 42);
+
+		// Boxing happens once, the Val gets kept.
+		const auto& boxed = rv->GetField(0);
+		CHECK(boxed->AsCount() == 42);
+		CHECK(rv->GetField(0).get() == boxed.get());
+		CHECK(rv->GetCountField(0) == 42);
+
+		// Overwriting an unboxed field with a Val, and back.
+		rv->Assign(0, val_mgr->Count(7));
+		CHECK(rv->GetCountField(0) == 7);
+		rv->AssignCount(0, 9);
+		CHECK(rv->GetField(0)->AsCount() == 9);
+
+		rv->AssignTime(1, 1.5);
+		CHECK(rv->GetDoubleField(1) == 1.5);
+		CHECK(rv->GetField(1)->GetType()->Tag() == TYPE_TIME);
+
+		IPAddr addr("192.168.1.1");
+		rv->AssignAddr(2, addr);
+		CHECK(rv->GetAddrField(2) == addr);
+		CHECK(rv->GetField(2)->AsAddr() == addr);
+
+		auto clone = rv->Clone();
+		auto crv = clone->AsRecordVal();
+		CHECK(crv->GetCountField(0) == 9);
+		CHECK(crv->GetDoubleField(1) == 1.5);
+		CHECK(crv->GetAddrField(2) == addr);
+		CHECK(! crv->HasField(3));
+		}
+
+	if ( test_val_mgr )
+		val_mgr = nullptr;
 	}
 
 void RecordVal::Assign(int field, Val* new_val)
@@ -2966,10 +3307,8 @@ void RecordVal::Assign(int field, Val* new_val)
 
 ValPtr RecordVal::GetFieldOrDefault(int field) const
 	{
-	const auto& val = (*AsRecord())[field];
-
-	if ( val )
-		return val;
+	if ( HasField(field) )
+		return GetField(field);
 
 	return GetType()->AsRecordType()->FieldDefault(field);
 	}
@@ -2985,16 +3324,15 @@ void RecordVal::ResizeParseTimeRecords(RecordType* rt)
 
 	for ( auto& rv : rvs )
 		{
-		auto vs = rv->val.record_val;
-		int current_length = vs->size();
+		int current_length = rv->num_fields;
 		auto required_length = rt->NumFields();
 
 		if ( required_length > current_length )
 			{
-			vs->reserve(required_length);
+			rv->AllocFields(required_length, rt->UnboxedSize());
 
 			for ( auto i = current_length; i < required_length; ++i )
-				vs->emplace_back(rt->FieldDefault(i));
+				rv->fields[i] = rt->FieldDefault(i);
 			}
 		}
 	}
@@ -3103,8 +3441,7 @@ TableValPtr RecordVal::GetRecordFieldsVal() const
 
 void RecordVal::Describe(ODesc* d) const
 	{
-	auto vl = AsRecord();
-	auto n = vl->size();
+	auto n = num_fields;
 	auto record_type = GetType()->AsRecordType();
 
 	if ( d->IsBinary() || d->IsPortable() )
@@ -3117,7 +3454,7 @@ void RecordVal::Describe(ODesc* d) const
 	else
 		d->Add("[");
 
-	for ( size_t i = 0; i < n; ++i )
+	for ( int i = 0; i < n; ++i )
 		{
 		if ( ! d->IsBinary() && i > 0 )
 			d->Add(", ");
@@ -3127,7 +3464,7 @@ void RecordVal::Describe(ODesc* d) const
 		if ( ! d->IsBinary() )
 			d->Add("=");
 
-		const auto& v = (*vl)[i];
+		const auto& v = GetField(i);
 
 		if ( v )
 			v->Describe(d);
@@ -3141,14 +3478,13 @@ void RecordVal::Describe(ODesc* d) const
 
 void RecordVal::DescribeReST(ODesc* d) const
 	{
-	auto vl = AsRecord();
-	auto n = vl->size();
+	auto n = num_fields;
 	auto record_type = GetType()->AsRecordType();
 
 	d->Add("{");
 	d->PushIndent();
 
-	for ( size_t i = 0; i < n; ++i )
+	for ( int i = 0; i < n; ++i )
 		{
 		if ( i > 0 )
 			d->NL();
@@ -3156,7 +3492,7 @@ void RecordVal::DescribeReST(ODesc* d) const
 		d->Add(record_type->FieldName(i));
 		d->Add("=");
 
-		const auto& v = (*vl)[i];
+		const auto& v = GetField(i);
 
 		if ( v )
 			v->Describe(d);
@@ -3179,10 +3515,15 @@ ValPtr RecordVal::DoClone(CloneState* state)
 	rv->origin = nullptr;
 	state->NewClone(this, rv);
 
-	for ( const auto& vlv : *val.record_val)
+	// The clone has the same layout, so unboxed values copy over as-is.
+	memcpy(rv->unboxed, unboxed, reinterpret_cast<char*>(is_unboxed) - unboxed);
+
+	for ( int i = 0; i < num_fields; ++i )
 		{
-		auto v = vlv ? vlv->Clone(state) : nullptr;
-  		rv->val.record_val->emplace_back(std::move(v));
+		rv->is_unboxed[i] = is_unboxed[i];
+
+		if ( fields[i] && ! is_unboxed[i] )
+			rv->fields[i] = fields[i]->Clone(state);
 		}
 
 	return rv;
@@ -3191,16 +3532,15 @@ ValPtr RecordVal::DoClone(CloneState* state)
 unsigned int RecordVal::MemoryAllocation() const
 	{
 	unsigned int size = 0;
-	const auto& vl = *AsRecord();
 
-	for ( const auto& v : vl )
+	for ( int i = 0; i < num_fields; ++i )
 		{
-		if ( v )
-		    size += v->MemoryAllocation();
+		if ( fields[i] )
+		    size += fields[i]->MemoryAllocation();
 		}
 
-	size += util::pad_size(vl.capacity() * sizeof(ValPtr));
-	size += padded_sizeof(vl);
+	size += util::pad_size(reinterpret_cast<char*>(is_unboxed + num_fields) -
+	                       reinterpret_cast<char*>(fields));
 	return size + padded_sizeof(*this);
 	}
 
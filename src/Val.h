@@ -44,6 +44,7 @@ using BroFile [[deprecated("Remove in v4.1. Use zeek::File.")]] = zeek::File;
 using BroFilePtr [[deprecated("Remove in v4.1. Use zeek::FilePtr.")]] = zeek::FilePtr;
 
 namespace zeek::detail { class ScriptFunc; }
+namespace zeek::detail { class TableExpireIndex; }
 using BroFunc [[deprecated("Remove in v4.1. Use zeek::detail::ScriptFunc instead.")]] = zeek::detail::ScriptFunc;
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(PrefixTable, zeek::detail);
@@ -109,7 +110,6 @@ union BroValUnion {
 	File* file_val;
 	RE_Matcher* re_val;
 	PDict<TableEntryVal>* table_val;
-	std::vector<ValPtr>* record_val;
 	std::vector<ValPtr>* vector_val;
 
 	BroValUnion() = default;
@@ -246,7 +246,6 @@ public:
 	CONST_ACCESSOR(TYPE_STRING, String*, string_val, AsString)
 	CONST_ACCESSOR(TYPE_FUNC, Func*, func_val, AsFunc)
 	CONST_ACCESSOR(TYPE_TABLE, PDict<TableEntryVal>*, table_val, AsTable)
-	CONST_ACCESSOR(TYPE_RECORD, std::vector<ValPtr>*, record_val, AsRecord)
 	CONST_ACCESSOR(TYPE_FILE, File*, file_val, AsFile)
 	CONST_ACCESSOR(TYPE_PATTERN, RE_Matcher*, re_val, AsPattern)
 	CONST_ACCESSOR(TYPE_VECTOR, std::vector<ValPtr>*, vector_val, AsVector)
@@ -390,7 +389,6 @@ protected:
 		{}
 
 	ACCESSOR(TYPE_TABLE, PDict<TableEntryVal>*, table_val, AsNonConstTable)
-	ACCESSOR(TYPE_RECORD, std::vector<ValPtr>*, record_val, AsNonConstRecord)
 
 	// For internal use by the Val::Clone() methods.
 	struct CloneState {
@@ -940,6 +938,14 @@ public:
 	 */
 	ListValPtr RecreateIndex(const detail::HashKey& k) const;
 
+	/**
+	 * Stores the index corresponding to the given HashKey in a vector,
+	 * which avoids building a ListVal.
+	 * @param k  The HashKey.
+	 * @param vals  The vector that receives the index's values.
+	 */
+	void RecreateIndex(const detail::HashKey& k, std::vector<ValPtr>& vals) const;
+
 	[[deprecated("Remove in v4.1.  Use RecreateIndex().")]]
 	ListVal* RecoverIndex(const detail::HashKey* k) const
 		{ return RecreateIndex(*k).release(); }
@@ -1011,6 +1017,9 @@ public:
 	void InitTimer(double delay);
 	void DoExpire(double t);
 
+	// Groups all entries by their access time, for DoExpire().
+	void BuildExpireIndex();
+
 	// If the &default attribute is not a function, or the functon has
 	// already been initialized, this does nothing. Otherwise, evaluates
 	// the function in the frame allowing it to capture its closure.
@@ -1091,6 +1100,11 @@ protected:
 	// error will have been reported.
 	double GetExpireTime();
 
+	// Returns the entry for the given index, or nullptr if there's none
+	// or the index doesn't match the table.  Keys of fixed-width indices
+	// get built on the stack.
+	TableEntryVal* FindEntry(const Val& index) const;
+
 	// Calls &expire_func and returns its return interval;
 	double CallExpireFunc(ListValPtr idx);
 
@@ -1112,7 +1126,7 @@ protected:
 	detail::ExprPtr expire_time;
 	detail::ExprPtr expire_func;
 	TableValTimer* timer;
-	IterCookie* expire_cookie;
+	detail::TableExpireIndex* expire_index;
 	detail::PrefixTable* subnets;
 	ValPtr def_val;
 	detail::ExprPtr change_func;
@@ -1158,17 +1172,58 @@ public:
 	void Assign(int field, std::nullptr_t)
 		{ Assign(field, ValPtr{}); }
 
+	/**
+	 * Assign a value to a record field without boxing it into a Val, if
+	 * the field's type supports unboxed storage (see
+	 * RecordType::UnboxedOffset()).  Otherwise, this boxes the value as
+	 * the named type and assigns that.
+	 * @param field  The field index to assign.
+	 * @param v  The value to assign.
+	 */
+	void AssignInt(int field, bro_int_t v);
+	void AssignCount(int field, bro_uint_t v);
+	void AssignDouble(int field, double v);
+	void AssignTime(int field, double v);
+	void AssignInterval(int field, double v);
+	void AssignAddr(int field, const IPAddr& v);
+
 	[[deprecated("Remove in v4.1.  Use GetField().")]]
 	Val* Lookup(int field) const	// Does not Ref() value.
-		{ return (*AsRecord())[field].get(); }
+		{ return GetField(field).get(); }
+
+	/**
+	 * Returns whether a given field index has a value.
+	 * @param field  The field index to check.
+	 * @return  True if the field has been assigned a value.
+	 */
+	bool HasField(int field) const
+		{ return is_unboxed[field] || fields[field]; }
 
 	/**
-	 * Returns the value of a given field index.
+	 * Returns the value of a given field index.  A field stored unboxed
+	 * gets boxed upon the first call, and the Val kept from then on.
 	 * @param field  The field index to retrieve.
 	 * @return  The value at the given field index.
 	 */
 	const ValPtr& GetField(int field) const
-		{ return (*AsRecord())[field]; }
+		{
+		if ( is_unboxed[field] && ! fields[field] )
+			fields[field] = BoxField(field);
+
+		return fields[field];
+		}
+
+	/**
+	 * Returns the value of a given int, count, double (or time/interval)
+	 * or addr field, without boxing an unboxed value.  The field must
+	 * have a value, see HasField().
+	 * @param field  The field index to retrieve.
+	 * @return  The value at the given field index.
+	 */
+	bro_int_t GetIntField(int field) const;
+	bro_uint_t GetCountField(int field) const;
+	double GetDoubleField(int field) const;
+	IPAddr GetAddrField(int field) const;
 
 	/**
 	 * Returns the value of a given field index as cast to type @c T.
@@ -1293,6 +1348,32 @@ protected:
 
 	using RecordTypeValMap = std::unordered_map<RecordType*, std::vector<RecordValPtr>>;
 	static RecordTypeValMap parse_time_records;
+
+private:
+	// Provides storage for n fields, keeping the values of the current
+	// ones.
+	void AllocFields(int n, int unboxed_size);
+	void FreeFields();
+
+	// Returns where the given field's value lives when unboxed, or
+	// nullptr if the field has no unboxed storage for values of the
+	// given internal type.
+	char* UnboxedSlot(int field, InternalTypeTag it) const;
+
+	// Stores a value in the field's unboxed storage, if it has one
+	// for the internal type.  Returns false if it doesn't.
+	bool AssignUnboxed(int field, const void* v, size_t len, InternalTypeTag it);
+
+	ValPtr BoxField(int field) const;
+
+	// The fields live in a single allocation: a Val per field, then the
+	// unboxed storage of the record type's layout, then a flag per field
+	// telling whether its value is held unboxed.  For an unboxed field,
+	// the Val caches the boxed value once GetField() has created it.
+	ValPtr* fields = nullptr;
+	char* unboxed = nullptr;
+	bool* is_unboxed = nullptr;
+	int num_fields = 0;
 };
 
 class EnumVal final : public Val {
@@ -1,13 +1,25 @@
 #include "zeek/WeirdState.h"
+
+#include <algorithm>
+
+#include "zeek/Reporter.h"
 #include "zeek/RunState.h"
 #include "zeek/util.h"
 
+#include "zeek/3rdparty/doctest.h"
+
 namespace zeek::detail {
 
-bool PermitWeird(WeirdStateMap& wsm, const char* name, uint64_t threshold,
+bool PermitWeird(WeirdStateMap& wsm, uint32_t id, uint64_t threshold,
                  uint64_t rate, double duration)
     {
-	auto& state = wsm[name];
+	auto it = std::find_if(wsm.begin(), wsm.end(),
+	                       [id](const auto& e) { return e.first == id; });
+
+	if ( it == wsm.end() )
+		it = wsm.emplace(wsm.end(), id, WeirdState());
+
+	auto& state = it->second;
 	++state.count;
 
 	if ( state.count <= threshold )
@@ -32,4 +44,63 @@ bool PermitWeird(WeirdStateMap& wsm, const char* name, uint64_t threshold,
 		return false;
     }
 
+uint32_t WeirdName::Resolve() const
+	{
+	return reporter->WeirdID(name);
+	}
+
+uint64_t WeirdCounts::Increment(uint64_t h)
+	{
+	if ( counts.empty() )
+		counts.resize(2 * WIDTH);
+
+	uint32_t& c1 = counts[h % WIDTH];
+	uint32_t& c2 = counts[WIDTH + (h >> 32) % WIDTH];
+	uint32_t min = std::min(c1, c2);
+
+	if ( min == UINT32_MAX )
+		return min;
+
+	// Conservative update, raising only the counters that are below the
+	// key's new count.
+	++min;
+	c1 = std::max(c1, min);
+	c2 = std::max(c2, min);
+
+	return min;
+	}
+
+void WeirdCounts::Expire(double now, double duration)
+	{
+	if ( now < period_start + duration )
+		return;
+
+	Clear();
+	period_start = now;
+	}
+
+void WeirdCounts::Clear()
+	{
+	std::fill(counts.begin(), counts.end(), 0);
+	}
+
+TEST_CASE("weird counts")
+	{
+	WeirdCounts wc;
+	wc.Expire(100.0, 10.0);
+
+	for ( int i = 0; i < 5; ++i )
+		wc.Increment(0x0000000100000001);
+
+	// Shares the first row's counter with the key above.
+	CHECK(wc.Increment(0x0000000200000001) == 1);
+	CHECK(wc.Increment(0x0000000100000001) == 6);
+
+	wc.Expire(105.0, 10.0);
+	CHECK(wc.Increment(0x0000000100000001) == 7);
+
+	wc.Expire(110.0, 10.0);
+	CHECK(wc.Increment(0x0000000100000001) == 1);
+	}
+
 } // namespace zeek::detail
@@ -2,8 +2,10 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
-#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace zeek::detail {
 
@@ -13,9 +15,94 @@ struct WeirdState {
 	double sampling_start_time = 0;
 };
 
-using WeirdStateMap = std::unordered_map<std::string, WeirdState>;
+// Sampling state by the reporter's IDs of weird names.  Few connections or
+// files see more than a handful of distinct weirds, so searching a vector
+// beats hashing.
+using WeirdStateMap = std::vector<std::pair<uint32_t, WeirdState>>;
 
-bool PermitWeird(WeirdStateMap& wsm, const char* name, uint64_t threshold,
+bool PermitWeird(WeirdStateMap& wsm, uint32_t id, uint64_t threshold,
                  uint64_t rate, double duration);
 
+/**
+ * A weird name known at compile time, which resolves to the reporter's ID
+ * for the name at first use rather than getting looked up with every
+ * weird.  Declare these with static storage duration, such as at file
+ * scope, so that they get initialized at compile time:
+ *
+ *     static const zeek::detail::WeirdName bad_checksum{"bad_TCP_checksum"};
+ *     ...
+ *     Weird(bad_checksum);
+ */
+class WeirdName {
+public:
+	constexpr explicit WeirdName(const char* arg_name) : name(arg_name)	{ }
+
+	/**
+	 * Returns the name.
+	 */
+	const char* Name() const	{ return name; }
+
+	/**
+	 * Returns the name's ID, as assigned by Reporter::WeirdID().
+	 */
+	uint32_t ID() const
+		{
+		if ( id == UNRESOLVED )
+			id = Resolve();
+
+		return id;
+		}
+
+private:
+	static constexpr uint32_t UNRESOLVED = UINT32_MAX;
+
+	uint32_t Resolve() const;
+
+	const char* name;
+	mutable uint32_t id = UNRESOLVED;
+};
+
+/**
+ * Approximate counts of weirds in fixed memory, for keys such as flows that
+ * have no state of their own to keep their counts in.  The counts form a
+ * count-min sketch with two rows and conservative update, so they never
+ * fall below the true ones, and match them as long as the table isn't
+ * crowded.  All counts expire together at the end of each sampling period.
+ */
+class WeirdCounts {
+public:
+	/** The number of counters per row. */
+	static constexpr size_t WIDTH = 1 << 16;
+
+	/**
+	 * Counts a weird.
+	 *
+	 * @param h  A hash of the weird's key, including its name.
+	 *
+	 * @return  The key's count in the current period, including this
+	 * weird.
+	 */
+	uint64_t Increment(uint64_t h);
+
+	/**
+	 * Resets all counts if the current period has ended, and starts a new
+	 * one.
+	 *
+	 * @param now  The current network time.
+	 *
+	 * @param duration  The length of a period.
+	 */
+	void Expire(double now, double duration);
+
+	/**
+	 * Resets all counts.
+	 */
+	void Clear();
+
+private:
+	// Both rows, allocated at first use.
+	std::vector<uint32_t> counts;
+	double period_start = 0;
+};
+
 } // namespace zeek::detail
@@ -3,9 +3,22 @@
 #include "zeek/Type.h"
 #include "zeek/ID.h"
 #include "zeek/Desc.h"
+#include "zeek/3rdparty/doctest.h"
 
 namespace zeek {
 
+// Storage of released argument lists, for reuse by acquire_args().  Only
+// small lists are kept, as event arguments typically are.  Never freed, as
+// lists may get released during static destruction.
+static std::vector<Args>& spare_args()
+	{
+	static auto* spare = new std::vector<Args>();
+	return *spare;
+	}
+
+constexpr size_t MAX_SPARE_ARGS = 4096;
+constexpr size_t MAX_SPARE_ARGS_CAPACITY = 32;
+
 Args val_list_to_args(const ValPList& vl)
 	{
 	Args rval;
@@ -51,4 +64,59 @@ VectorValPtr MakeCallArgumentVector(const Args& vals,
 	return rval;
     }
 
+namespace detail {
+
+Args acquire_args(size_t n)
+	{
+	Args rval;
+	auto& spare = spare_args();
+
+	if ( ! spare.empty() )
+		{
+		rval = std::move(spare.back());
+		spare.pop_back();
+		}
+
+	rval.reserve(n);
+	return rval;
+	}
+
+void release_args(Args&& args)
+	{
+	auto& spare = spare_args();
+
+	if ( args.capacity() == 0 || args.capacity() > MAX_SPARE_ARGS_CAPACITY ||
+	     spare.size() >= MAX_SPARE_ARGS )
+		return;
+
+	args.clear();
+	spare.push_back(std::move(args));
+	}
+
+TEST_CASE("argument list pool")
+	{
+	auto args = make_args(ValPtr{}, ValPtr{}, ValPtr{});
+	CHECK(args.size() == 3);
+	auto data = args.data();
+
+	release_args(std::move(args));
+	auto reused = acquire_args(2);
+	CHECK(reused.empty());
+	CHECK(reused.capacity() >= 3);
+	CHECK(reused.data() == data);
+	release_args(std::move(reused));
+
+	// Large lists aren't kept, and release_args() leaves them alone.
+	Args large;
+	large.reserve(MAX_SPARE_ARGS_CAPACITY + 1);
+	release_args(std::move(large));
+	CHECK(large.capacity() > MAX_SPARE_ARGS_CAPACITY);
+	auto other = acquire_args(1);
+	CHECK(other.data() != large.data());
+	CHECK(other.data() == data);
+	release_args(std::move(other));
+	}
+
+} // namespace detail
+
 } // namespace zeek
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <functional>
+#include <utility>
 #include <vector>
 #include "zeek/ZeekList.h"
 
@@ -17,6 +19,14 @@ using RecordTypePtr = IntrusivePtr<RecordType>;
 
 using Args = std::vector<ValPtr>;
 
+/**
+ * Builds the arguments of an event by appending them to the given list.
+ * It runs only once the event gets dispatched, or something else first
+ * asks for its arguments, so it must capture by value whatever it needs,
+ * except for the event's cookie object, which the event keeps alive.
+ */
+using ArgsGenerator = std::function<void(Args& args)>;
+
 /**
  * Converts a legacy-style argument list for use in modern Zeek function
  * calling or event queueing APIs.
@@ -37,4 +47,31 @@ Args val_list_to_args(const ValPList& vl);
  */
 VectorValPtr MakeCallArgumentVector(const Args& vals, const RecordTypePtr& types);
 
+namespace detail {
+
+/**
+ * Returns an empty argument list with room for at least n elements.  This
+ * reuses the storage of lists given to release_args() where possible.
+ */
+Args acquire_args(size_t n);
+
+/**
+ * Clears an argument list, keeping its storage around for acquire_args().
+ */
+void release_args(Args&& args);
+
+} // namespace detail
+
+/**
+ * Builds an argument list from the given values.  As the list's storage
+ * usually comes from acquire_args(), this mostly avoids allocating.
+ */
+template <class... T>
+Args make_args(T&&... vals)
+	{
+	Args rval = detail::acquire_args(sizeof...(T));
+	(rval.emplace_back(std::forward<T>(vals)), ...);
+	return rval;
+	}
+
 } // namespace zeek
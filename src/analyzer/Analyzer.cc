@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <binpac.h>
 
+#include "zeek/analyzer/AnalyzerCost.h"
 #include "zeek/analyzer/Manager.h"
 #include "zeek/analyzer/protocol/pia/PIA.h"
 #include "zeek/ZeekString.h"
@@ -221,6 +222,8 @@ void Analyzer::NextPacket(int len, const u_char* data, bool is_orig, uint64_t se
 
 	else
 		{
+		zeek::detail::AnalyzerCostTimer cost_timer(this);
+
 		try
 			{
 			DeliverPacket(len, data, is_orig, seq, ip, caplen);
@@ -244,6 +247,8 @@ void Analyzer::NextStream(int len, const u_char* data, bool is_orig)
 
 	else
 		{
+		zeek::detail::AnalyzerCostTimer cost_timer(this);
+
 		try
 			{
 			DeliverStream(len, data, is_orig);
@@ -700,6 +705,16 @@ void Analyzer::ProtocolConfirmation(Tag arg_tag)
 	event_mgr.Enqueue(protocol_confirmation, ConnVal(), tval, val_mgr->Count(id));
 	}
 
+void Analyzer::TransactionStarted()
+	{
+	conn->TransactionStarted();
+	}
+
+void Analyzer::TransactionFinished()
+	{
+	conn->TransactionFinished();
+	}
+
 void Analyzer::ProtocolViolation(const char* reason, const char* data, int len)
 	{
 	if ( ! protocol_violation )
@@ -778,6 +793,27 @@ unsigned int Analyzer::MemoryAllocation() const
 	return mem;
 	}
 
+uint64_t Analyzer::AddMemoryUsage(MemoryReport* report) const
+	{
+	uint64_t children_mem = 0;
+
+	LOOP_OVER_CONST_CHILDREN(i)
+		children_mem += (*i)->AddMemoryUsage(report);
+
+	for ( SupportAnalyzer* a = orig_supporters; a; a = a->sibling )
+		children_mem += a->AddMemoryUsage(report);
+
+	for ( SupportAnalyzer* a = resp_supporters; a; a = a->sibling )
+		children_mem += a->AddMemoryUsage(report);
+
+	uint64_t mem = MemoryAllocation();
+	auto& usage = (*report)[GetAnalyzerName()];
+	++usage.instances;
+	usage.bytes += mem - std::min(mem, children_mem);
+
+	return mem;
+	}
+
 void Analyzer::UpdateConnVal(RecordVal *conn_val)
 	{
 	LOOP_OVER_CHILDREN(i)
@@ -836,11 +872,21 @@ void Analyzer::EnqueueConnEvent(EventHandlerPtr f, Args args)
 	conn->EnqueueEvent(f, this, std::move(args));
 	}
 
+void Analyzer::EnqueueConnEventLazy(EventHandlerPtr f, ArgsGenerator args_gen)
+	{
+	conn->EnqueueEventLazy(f, this, std::move(args_gen));
+	}
+
 void Analyzer::Weird(const char* name, const char* addl)
 	{
 	conn->Weird(name, addl, GetAnalyzerName());
 	}
 
+void Analyzer::Weird(const zeek::detail::WeirdName& name, const char* addl)
+	{
+	conn->Weird(name, addl, GetAnalyzerName());
+	}
+
 SupportAnalyzer* SupportAnalyzer::Sibling(bool only_active) const
 	{
 	if ( ! only_active )
@@ -871,8 +917,11 @@ void SupportAnalyzer::ForwardPacket(int len, const u_char* data, bool is_orig,
 		// Pass to next in chain.
 		next_sibling->NextPacket(len, data, is_orig, seq, ip, caplen);
 	else
+		{
 		// Finished with preprocessing - now it's the parent's turn.
+		zeek::detail::AnalyzerCostTimer cost_timer(Parent());
 		Parent()->DeliverPacket(len, data, is_orig, seq, ip, caplen);
+		}
 	}
 
 void SupportAnalyzer::ForwardStream(int len, const u_char* data, bool is_orig)
@@ -891,8 +940,11 @@ void SupportAnalyzer::ForwardStream(int len, const u_char* data, bool is_orig)
 		// Pass to next in chain.
 		next_sibling->NextStream(len, data, is_orig);
 	else
+		{
 		// Finished with preprocessing - now it's the parent's turn.
+		zeek::detail::AnalyzerCostTimer cost_timer(Parent());
 		Parent()->DeliverStream(len, data, is_orig);
+		}
 	}
 
 void SupportAnalyzer::ForwardUndelivered(uint64_t seq, int len, bool is_orig)
@@ -5,10 +5,13 @@
 #include <sys/types.h> // for u_char
 
 #include <list>
+#include <map>
+#include <string>
 #include <vector>
 #include <tuple>
 #include <type_traits>
 
+#include "zeek/analyzer/AnalyzerPool.h"
 #include "zeek/analyzer/Tag.h"
 
 #include "zeek/Obj.h"
@@ -26,6 +29,7 @@ namespace zeek {
 using RecordValPtr = zeek::IntrusivePtr<RecordVal>;
 class File;
 using FilePtr = zeek::IntrusivePtr<File>;
+namespace detail { class WeirdName; }
 }
 
 using BroFile [[deprecated("Remove in v4.1. Use zeek::File.")]] = zeek::File;
@@ -42,6 +46,18 @@ using analyzer_list = std::list<Analyzer*>;
 typedef uint32_t ID;
 typedef void (Analyzer::*analyzer_timer_func)(double t);
 
+/**
+ * The memory that the instances of one kind of object use, see
+ * Analyzer::AddMemoryUsage().
+ */
+struct MemoryUsage {
+	uint64_t instances = 0;
+	uint64_t bytes = 0;
+};
+
+// Memory usage by analyzer name.
+using MemoryReport = std::map<std::string, MemoryUsage>;
+
 /**
  * Class to receive processed output from an anlyzer.
  */
@@ -541,6 +557,22 @@ public:
 	bool ProtocolConfirmed() const
 		{ return protocol_confirmed; }
 
+	/**
+	 * Signals that the analyzer has seen a request that expects a
+	 * response, for protocols that consist of request/response
+	 * exchanges.  Forwards to Connection::TransactionStarted().
+	 */
+	void TransactionStarted();
+
+	/**
+	 * Signals that the analyzer has seen the response to a request that
+	 * it reported through TransactionStarted().  Once all requests have
+	 * been answered, a UDP connection times out after
+	 * \c udp_transaction_linger.  Forwards to
+	 * Connection::TransactionFinished().
+	 */
+	void TransactionFinished();
+
 	/**
 	 * Called whenever the connection value is updated. Per default, this
 	 * method will be called for each analyzer in the tree. Analyzers can
@@ -613,19 +645,38 @@ public:
 		std::is_convertible_v<
 			std::tuple_element_t<0, std::tuple<Args...>>, ValPtr>>
 	EnqueueConnEvent(EventHandlerPtr h, Args&&... args)
-		{ return EnqueueConnEvent(h, zeek::Args{std::forward<Args>(args)...}); }
+		{ return EnqueueConnEvent(h, make_args(std::forward<Args>(args)...)); }
+
+	/**
+	 * Convenience function that forwards directly to
+	 * Connection::EnqueueEventLazy().  The generator may use the
+	 * connection, but not the analyzer, which may be gone by then.
+	 */
+	void EnqueueConnEventLazy(EventHandlerPtr f, ArgsGenerator args_gen);
 
 	/**
 	 * Convenience function that forwards directly to the corresponding
 	 * Connection::Weird().
 	 */
 	void Weird(const char* name, const char* addl = "");
+	void Weird(const zeek::detail::WeirdName& name, const char* addl = "");
 
 	/**
 	 * Internal method.
 	 */
 	virtual unsigned int MemoryAllocation() const;
 
+	/**
+	 * Adds the memory of this analyzer and of its children and support
+	 * analyzers to a report, under their names.  Each analyzer counts
+	 * only its own share of what MemoryAllocation() returns.
+	 *
+	 * @param report The report to add to.
+	 *
+	 * @return The bytes added, i.e., MemoryAllocation().
+	 */
+	uint64_t AddMemoryUsage(MemoryReport* report) const;
+
 protected:
 	friend class AnalyzerTimer;
 	friend class Manager;
@@ -0,0 +1,96 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/analyzer/AnalyzerCost.h"
+
+#include "zeek/analyzer/Analyzer.h"
+
+namespace zeek::detail {
+
+uint32_t AnalyzerCost::sampling = 0;
+uint32_t AnalyzerCost::countdown = 0;
+AnalyzerCostTimer* AnalyzerCost::current = nullptr;
+std::vector<AnalyzerCost::Entry> AnalyzerCost::entries;
+
+// The clocks at the start of accounting, for calibrating ticks.
+static uint64_t start_ticks = 0;
+static uint64_t start_ns = 0;
+
+static uint64_t monotonic_ns()
+	{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+	}
+
+void AnalyzerCost::SetSampling(uint32_t rate)
+	{
+	sampling = countdown = rate;
+
+	if ( rate && ! start_ticks )
+		{
+		start_ticks = Ticks();
+		start_ns = monotonic_ns();
+		}
+	}
+
+void AnalyzerCost::Reset()
+	{
+	for ( auto& e : entries )
+		e.calls = e.inclusive = e.exclusive = 0;
+	}
+
+double AnalyzerCost::TicksToSeconds(uint64_t ticks)
+	{
+	uint64_t elapsed_ticks = Ticks() - start_ticks;
+	uint64_t elapsed_ns = monotonic_ns() - start_ns;
+
+	// Assume a tick per nanosecond until there's been time to tell.
+	if ( ! start_ticks || elapsed_ns < 1000000 )
+		return ticks / 1e9;
+
+	return ticks * (double(elapsed_ns) / elapsed_ticks) / 1e9;
+	}
+
+void AnalyzerCostTimer::Start(const analyzer::Analyzer* a)
+	{
+	if ( ! AnalyzerCost::current )
+		AnalyzerCost::countdown = AnalyzerCost::sampling;
+
+	// The analyzer may be gone by the time the timer stops.
+	const auto& tag = a->GetAnalyzerTag();
+	auto& entries = AnalyzerCost::entries;
+
+	if ( tag.Type() >= entries.size() )
+		entries.resize(tag.Type() + 1);
+
+	auto& e = entries[tag.Type()];
+
+	if ( ! e.seen )
+		{
+		e.tag = tag;
+		e.seen = true;
+		}
+
+	entry = tag.Type() + 1;
+	parent = AnalyzerCost::current;
+	AnalyzerCost::current = this;
+	start = AnalyzerCost::Ticks();
+	}
+
+void AnalyzerCostTimer::Stop()
+	{
+	uint64_t elapsed = AnalyzerCost::Ticks() - start;
+	auto& e = AnalyzerCost::entries[entry - 1];
+	++e.calls;
+	e.inclusive += elapsed;
+	e.exclusive += elapsed > children ? elapsed - children : 0;
+
+	if ( parent )
+		parent->children += elapsed;
+
+	AnalyzerCost::current = parent;
+	entry = 0;
+	}
+
+} // namespace zeek::detail
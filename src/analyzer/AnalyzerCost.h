@@ -0,0 +1,124 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Accounting of the CPU time that each type of analyzer takes, for finding
+// out which protocols are expensive on a network's traffic.
+
+#pragma once
+
+#include <time.h>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "zeek/analyzer/Tag.h"
+
+namespace zeek::analyzer {
+class Analyzer;
+}
+
+namespace zeek::detail {
+
+class AnalyzerCostTimer;
+
+/**
+ * The time that analyzers take to process their input, by analyzer type,
+ * collected while :zeek:see:`analyzer_cost_sampling` is set.  Timing goes
+ * by the CPU's time stamp counter where there is one.  Only one in that
+ * many deliveries from outside of analyzers gets timed, together with all
+ * deliveries between analyzers that it leads to, and the totals get
+ * scaled up accordingly.  An analyzer's inclusive time includes that of
+ * the analyzers it forwards its input to, and its exclusive time doesn't.
+ */
+class AnalyzerCost {
+public:
+	struct Entry {
+		analyzer::Tag tag;
+		bool seen = false;	// Whether tag is set.
+		uint64_t calls = 0;
+		uint64_t inclusive = 0;	// ticks
+		uint64_t exclusive = 0;	// ticks
+	};
+
+	/**
+	 * Starts accounting with the given sampling rate, zero to stop.
+	 */
+	static void SetSampling(uint32_t rate);
+
+	static uint32_t Sampling()	{ return sampling; }
+
+	/**
+	 * Returns the sampled entries, indexed by analyzer type.  Not all
+	 * of them may have seen any calls.
+	 */
+	static const std::vector<Entry>& Entries()	{ return entries; }
+
+	static void Reset();
+
+	/**
+	 * Converts ticks into seconds, calibrated against the monotonic
+	 * clock since accounting started.
+	 */
+	static double TicksToSeconds(uint64_t ticks);
+
+	static uint64_t Ticks()
+		{
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+		}
+
+private:
+	friend class AnalyzerCostTimer;
+
+	static uint32_t sampling;
+	static uint32_t countdown;	// Until the next sampled delivery.
+	static AnalyzerCostTimer* current;	// Innermost running timer.
+	static std::vector<Entry> entries;
+};
+
+/**
+ * Times an analyzer's processing of a delivery for as long as it's in
+ * scope, if the delivery gets sampled.
+ */
+class AnalyzerCostTimer {
+public:
+	explicit AnalyzerCostTimer(const analyzer::Analyzer* a)
+		{
+		if ( ! AnalyzerCost::sampling )
+			return;
+
+		// Deliveries within a sampled one always get timed, or the
+		// exclusive times would be off.
+		if ( ! AnalyzerCost::current && --AnalyzerCost::countdown > 0 )
+			return;
+
+		Start(a);
+		}
+
+	~AnalyzerCostTimer()
+		{
+		if ( entry )
+			Stop();
+		}
+
+	AnalyzerCostTimer(const AnalyzerCostTimer&) = delete;
+	AnalyzerCostTimer& operator=(const AnalyzerCostTimer&) = delete;
+
+private:
+	void Start(const analyzer::Analyzer* a);
+	void Stop();
+
+	size_t entry = 0;	// One more than the index of the entry, once started.
+	AnalyzerCostTimer* parent = nullptr;
+	uint64_t start = 0;
+	uint64_t children = 0;	// Ticks of the timers nested in this one.
+};
+
+} // namespace zeek::detail
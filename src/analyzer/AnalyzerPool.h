@@ -0,0 +1,64 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace zeek::detail {
+
+/**
+ * Recycles the memory of deleted analyzers of one type through a free list.
+ * Each connection instantiates the same few transport-layer analyzers, and
+ * scans and failed handshakes delete them again right away, so reusing
+ * their memory keeps the allocator out of that churn.
+ *
+ * A type opts in by forwarding its class-specific operator new and delete
+ * to Allocate() and Release().  Derived types of a different size fall
+ * through to the global operators.
+ */
+template <typename T>
+class AnalyzerPool {
+public:
+	// The most instances kept for reuse.
+	static constexpr size_t MAX_FREE = 4096;
+
+	static void* Allocate(size_t size)
+		{
+		auto& free = FreeList();
+
+		if ( size == sizeof(T) && ! free.empty() )
+			{
+			void* ptr = free.back();
+			free.pop_back();
+			return ptr;
+			}
+
+		return ::operator new(size);
+		}
+
+	static void Release(void* ptr, size_t size)
+		{
+		auto& free = FreeList();
+
+		if ( size == sizeof(T) && free.size() < MAX_FREE )
+			{
+			free.push_back(ptr);
+			return;
+			}
+
+		::operator delete(ptr);
+		}
+
+private:
+	// Never freed, as analyzers may get deleted during static
+	// destruction.
+	static std::vector<void*>& FreeList()
+		{
+		static auto* free = new std::vector<void*>();
+		return *free;
+		}
+};
+
+} // namespace zeek::detail
@@ -2,6 +2,8 @@
 
 #include "zeek/analyzer/Manager.h"
 
+#include <algorithm>
+
 #include "zeek/Hash.h"
 #include "zeek/Val.h"
 #include "zeek/IntrusivePtr.h"
@@ -59,6 +61,23 @@ bool Manager::ConnIndex::operator<(const ConnIndex& other) const
 	return false;
 	}
 
+size_t Manager::ConnIndexHash::operator()(const ConnIndex& c) const
+	{
+	struct {
+		uint32_t orig[4];
+		uint32_t resp[4];
+		uint16_t resp_p;
+		uint16_t proto;
+	} key;
+
+	c.orig.CopyIPv6(key.orig);
+	c.resp.CopyIPv6(key.resp);
+	key.resp_p = c.resp_p;
+	key.proto = c.proto;
+
+	return detail::KeyedHash::Hash64(&key, sizeof(key), detail::HASH_TIER_FAST);
+	}
+
 Manager::Manager()
 	: plugin::ComponentManager<analyzer::Tag, analyzer::Component>("Analyzer", "Tag")
 	{
@@ -66,12 +85,6 @@ Manager::Manager()
 
 Manager::~Manager()
 	{
-	for ( analyzer_map_by_port::const_iterator i = analyzers_by_port_tcp.begin(); i != analyzers_by_port_tcp.end(); i++ )
-		delete i->second;
-
-	for ( analyzer_map_by_port::const_iterator i = analyzers_by_port_udp.begin(); i != analyzers_by_port_udp.end(); i++ )
-		delete i->second;
-
 	// Clean up expected-connection table.
 	while ( conns_by_timeout.size() )
 		{
@@ -115,24 +128,34 @@ void Manager::DumpDebug()
 	DBG_LOG(DBG_ANALYZER, " ");
 	DBG_LOG(DBG_ANALYZER, "Analyzers by port:");
 
-	for ( analyzer_map_by_port::const_iterator i = analyzers_by_port_tcp.begin(); i != analyzers_by_port_tcp.end(); i++ )
+	for ( uint32_t port = 0; port < analyzers_by_port_tcp.index.size(); ++port )
 		{
+		const tag_list* l = LookupPort(TRANSPORT_TCP, port, false);
+
+		if ( ! l || l->empty() )
+			continue;
+
 		std::string s;
 
-		for ( tag_set::const_iterator j = i->second->begin(); j != i->second->end(); j++ )
-			s += std::string(GetComponentName(*j)) + " ";
+		for ( const auto& tag : *l )
+			s += std::string(GetComponentName(tag)) + " ";
 
-		DBG_LOG(DBG_ANALYZER, "    %d/tcp: %s", i->first, s.c_str());
+		DBG_LOG(DBG_ANALYZER, "    %d/tcp: %s", port, s.c_str());
 		}
 
-	for ( analyzer_map_by_port::const_iterator i = analyzers_by_port_udp.begin(); i != analyzers_by_port_udp.end(); i++ )
+	for ( uint32_t port = 0; port < analyzers_by_port_udp.index.size(); ++port )
 		{
+		const tag_list* l = LookupPort(TRANSPORT_UDP, port, false);
+
+		if ( ! l || l->empty() )
+			continue;
+
 		std::string s;
 
-		for ( tag_set::const_iterator j = i->second->begin(); j != i->second->end(); j++ )
-			s += std::string(GetComponentName(*j)) + " ";
+		for ( const auto& tag : *l )
+			s += std::string(GetComponentName(tag)) + " ";
 
-		DBG_LOG(DBG_ANALYZER, "    %d/udp: %s", i->first, s.c_str());
+		DBG_LOG(DBG_ANALYZER, "    %d/udp: %s", port, s.c_str());
 		}
 
 #endif
@@ -254,7 +277,7 @@ bool Manager::UnregisterAnalyzerForPort(EnumVal* val, PortVal* port)
 
 bool Manager::RegisterAnalyzerForPort(const Tag& tag, TransportProto proto, uint32_t port)
 	{
-	tag_set* l = LookupPort(proto, port, true);
+	tag_list* l = LookupPort(proto, port, true);
 
 	if ( ! l )
 		return false;
@@ -264,13 +287,17 @@ bool Manager::RegisterAnalyzerForPort(const Tag& tag, TransportProto proto, uint
 	DBG_LOG(DBG_ANALYZER, "Registering analyzer %s for port %" PRIu32 "/%d", name, port, proto);
 #endif
 
-	l->insert(tag);
+	auto i = std::lower_bound(l->begin(), l->end(), tag);
+
+	if ( i == l->end() || ! (*i == tag) )
+		l->insert(i, tag);
+
 	return true;
 	}
 
 bool Manager::UnregisterAnalyzerForPort(const Tag& tag, TransportProto proto, uint32_t port)
 	{
-	tag_set* l = LookupPort(proto, port, true);
+	tag_list* l = LookupPort(proto, port, false);
 
 	if ( ! l )
 		return true;  // still a "successful" unregistration
@@ -280,7 +307,11 @@ bool Manager::UnregisterAnalyzerForPort(const Tag& tag, TransportProto proto, ui
 	DBG_LOG(DBG_ANALYZER, "Unregistering analyzer %s for port %" PRIu32 "/%d", name, port, proto);
 #endif
 
-	l->erase(tag);
+	auto i = std::lower_bound(l->begin(), l->end(), tag);
+
+	if ( i != l->end() && *i == tag )
+		l->erase(i);
+
 	return true;
 	}
 
@@ -323,9 +354,9 @@ Analyzer* Manager::InstantiateAnalyzer(const char* name, Connection* conn)
 	return tag ? InstantiateAnalyzer(tag, conn) : nullptr;
 	}
 
-Manager::tag_set* Manager::LookupPort(TransportProto proto, uint32_t port, bool add_if_not_found)
+Manager::tag_list* Manager::LookupPort(TransportProto proto, uint32_t port, bool add_if_not_found)
 	{
-	analyzer_map_by_port* m = nullptr;
+	PortMap* m = nullptr;
 
 	switch ( proto ) {
 	case TRANSPORT_TCP:
@@ -341,20 +372,21 @@ Manager::tag_set* Manager::LookupPort(TransportProto proto, uint32_t port, bool
 		return nullptr;
 	}
 
-	analyzer_map_by_port::const_iterator i = m->find(port);
+	if ( port >= m->index.size() )
+		return nullptr;
 
-	if ( i != m->end() )
-		return i->second;
+	if ( auto i = m->index[port] )
+		return &m->lists[i - 1];
 
 	if ( ! add_if_not_found )
 		return nullptr;
 
-	tag_set* l = new tag_set;
-	m->insert(std::make_pair(port, l));
-	return l;
+	m->lists.emplace_back();
+	m->index[port] = m->lists.size();
+	return &m->lists.back();
 	}
 
-Manager::tag_set* Manager::LookupPort(PortVal* val, bool add_if_not_found)
+Manager::tag_list* Manager::LookupPort(PortVal* val, bool add_if_not_found)
 	{
 	return LookupPort(val->PortType(), val->Port(), add_if_not_found);
 	}
@@ -403,20 +435,20 @@ bool Manager::BuildInitialAnalyzerTree(Connection* conn)
 		if ( check_port && ! zeek::detail::dpd_ignore_ports )
 			{
 			int resp_port = ntohs(conn->RespPort());
-			tag_set* ports = LookupPort(conn->ConnTransport(), resp_port, false);
+			tag_list* ports = LookupPort(conn->ConnTransport(), resp_port, false);
 
 			if ( ports )
 				{
-				for ( tag_set::const_iterator j = ports->begin(); j != ports->end(); ++j )
+				for ( const auto& tag : *ports )
 					{
-					Analyzer* analyzer = analyzer_mgr->InstantiateAnalyzer(*j, conn);
+					Analyzer* analyzer = analyzer_mgr->InstantiateAnalyzer(tag, conn);
 
 					if ( ! analyzer )
 						continue;
 
 					root->AddChildAnalyzer(analyzer, false);
 					DBG_ANALYZER_ARGS(conn, "activated %s analyzer due to port %d",
-					                  analyzer_mgr->GetComponentName(*j).c_str(), resp_port);
+					                  analyzer_mgr->GetComponentName(tag).c_str(), resp_port);
 					}
 				}
 			}
@@ -500,9 +532,13 @@ bool Manager::BuildInitialAnalyzerTree(Connection* conn)
 
 void Manager::ExpireScheduledAnalyzers()
 	{
-	if ( ! run_state::network_time )
+	if ( ! run_state::network_time || run_state::network_time < next_expire )
 		return;
 
+	// Expire in batches, as lookups skip entries that have timed out
+	// anyway.
+	next_expire = run_state::network_time + 1.0;
+
 	while ( conns_by_timeout.size() )
 		{
 		ScheduledAnalyzer* a = conns_by_timeout.top();
@@ -590,7 +626,10 @@ Manager::tag_set Manager::GetScheduled(const Connection* conn)
 	tag_set result;
 
 	for ( conns_map::iterator i = all.first; i != all.second; i++ )
-		result.insert(i->second->analyzer);
+		{
+		if ( i->second->timeout > run_state::network_time )
+			result.insert(i->second->analyzer);
+		}
 
 	// Try wildcard for originator.
 	c.orig = IPAddr::v6_unspecified;
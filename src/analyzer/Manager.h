@@ -21,6 +21,7 @@
 #pragma once
 
 #include <queue>
+#include <unordered_map>
 #include <vector>
 
 #include "zeek/analyzer/Analyzer.h"
@@ -346,16 +347,30 @@ public:
 private:
 
 	using tag_set = std::set<Tag>;
-	using analyzer_map_by_port = std::map<uint32_t, tag_set*>;
 
-	tag_set* LookupPort(PortVal* val, bool add_if_not_found);
-	tag_set* LookupPort(TransportProto proto, uint32_t port, bool add_if_not_found);
+	// The analyzers of a port, kept sorted like a tag_set.  Most ports
+	// have at most a couple.
+	using tag_list = std::vector<Tag>;
+
+	// The analyzers of the ports of one transport, indexed directly by
+	// port number so that looking them up takes no search.
+	struct PortMap {
+		PortMap() : index(65536, 0)	{ }
+
+		// For each port, one plus the position of its analyzers in
+		// lists, or 0 if it has none.
+		std::vector<uint32_t> index;
+		std::vector<tag_list> lists;
+	};
+
+	tag_list* LookupPort(PortVal* val, bool add_if_not_found);
+	tag_list* LookupPort(TransportProto proto, uint32_t port, bool add_if_not_found);
 
 	tag_set GetScheduled(const Connection* conn);
 	void ExpireScheduledAnalyzers();
 
-	analyzer_map_by_port analyzers_by_port_tcp;
-	analyzer_map_by_port analyzers_by_port_udp;
+	PortMap analyzers_by_port_tcp;
+	PortMap analyzers_by_port_udp;
 
 	Tag analyzer_connsize;
 	Tag analyzer_stepping;
@@ -375,6 +390,16 @@ private:
 		ConnIndex();
 
 		bool operator<(const ConnIndex& other) const;
+
+		bool operator==(const ConnIndex& other) const
+			{
+			return resp_p == other.resp_p && proto == other.proto &&
+				orig == other.orig && resp == other.resp;
+			}
+	};
+
+	struct ConnIndexHash {
+		size_t operator()(const ConnIndex& c) const;
 	};
 
 	// Information associated with a scheduled connection.
@@ -390,13 +415,16 @@ private:
 		};
 	};
 
-	using conns_map = std::multimap<ConnIndex, ScheduledAnalyzer*>;
+	using conns_map = std::unordered_multimap<ConnIndex, ScheduledAnalyzer*, ConnIndexHash>;
 	using conns_queue = std::priority_queue<ScheduledAnalyzer*,
 	                                        std::vector<ScheduledAnalyzer*>,
 	                                        ScheduledAnalyzer::Comparator>;
 
 	conns_map conns;
 	conns_queue conns_by_timeout;
+	// When to next expire scheduled analyzers, which happens at most
+	// once per second of network time.
+	double next_expire = 0.0;
 	std::vector<uint16_t> vxlan_ports;
 };
 
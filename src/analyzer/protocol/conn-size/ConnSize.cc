@@ -106,15 +106,19 @@ void ConnSize_Analyzer::CheckThresholds(bool is_orig)
 void ConnSize_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig, uint64_t seq, const IP_Hdr* ip, int caplen)
 	{
 	Analyzer::DeliverPacket(len, data, is_orig, seq, ip, caplen);
+	CountPacket(is_orig, ip->TotalLen());
+	}
 
+void ConnSize_Analyzer::CountPacket(bool is_orig, uint64_t ip_len)
+	{
 	if ( is_orig )
 		{
-		orig_bytes += ip->TotalLen();
+		orig_bytes += ip_len;
 		orig_pkts ++;
 		}
 	else
 		{
-		resp_bytes += ip->TotalLen();
+		resp_bytes += ip_len;
 		resp_pkts ++;
 		}
 
@@ -170,24 +174,16 @@ void ConnSize_Analyzer::SetDurationThreshold(double duration)
 
 void ConnSize_Analyzer::UpdateConnVal(RecordVal *conn_val)
 	{
-	// RecordType *connection_type is decleared in NetVar.h
-	RecordVal* orig_endp = conn_val->GetField("orig")->AsRecordVal();
-	RecordVal* resp_endp = conn_val->GetField("resp")->AsRecordVal();
-
-	// endpoint is the RecordType from NetVar.h
-	int pktidx = id::endpoint->FieldOffset("num_pkts");
-	int bytesidx = id::endpoint->FieldOffset("num_bytes_ip");
-
-	if ( pktidx < 0 )
-		reporter->InternalError("'endpoint' record missing 'num_pkts' field");
+	RecordVal* orig_endp = conn_val->GetField(id::field::connection.orig)->AsRecordVal();
+	RecordVal* resp_endp = conn_val->GetField(id::field::connection.resp)->AsRecordVal();
 
-	if ( bytesidx < 0 )
-		reporter->InternalError("'endpoint' record missing 'num_bytes_ip' field");
+	int pktidx = id::field::endpoint.num_pkts;
+	int bytesidx = id::field::endpoint.num_bytes_ip;
 
-	orig_endp->Assign(pktidx, val_mgr->Count(orig_pkts));
-	orig_endp->Assign(bytesidx, val_mgr->Count(orig_bytes));
-	resp_endp->Assign(pktidx, val_mgr->Count(resp_pkts));
-	resp_endp->Assign(bytesidx, val_mgr->Count(resp_bytes));
+	orig_endp->AssignCount(pktidx, orig_pkts);
+	orig_endp->AssignCount(bytesidx, orig_bytes);
+	resp_endp->AssignCount(pktidx, resp_pkts);
+	resp_endp->AssignCount(bytesidx, resp_bytes);
 
 	Analyzer::UpdateConnVal(conn_val);
 	}
@@ -12,6 +12,12 @@ public:
 	explicit ConnSize_Analyzer(Connection* c);
 	~ConnSize_Analyzer() override;
 
+	// Instances get recycled, see AnalyzerPool.
+	static void* operator new(size_t size)
+		{ return zeek::detail::AnalyzerPool<ConnSize_Analyzer>::Allocate(size); }
+	static void operator delete(void* ptr, size_t size)
+		{ zeek::detail::AnalyzerPool<ConnSize_Analyzer>::Release(ptr, size); }
+
 	void Init() override;
 	void Done() override;
 
@@ -25,6 +31,9 @@ public:
 	void SetDurationThreshold(double duration);
 	double GetDurationThreshold() { return duration_thresh; };
 
+	// Counts a packet with an IP datagram of the given length.
+	void CountPacket(bool is_orig, uint64_t ip_len);
+
 	static analyzer::Analyzer* Instantiate(Connection* conn)
 		{ return new ConnSize_Analyzer(conn); }
 
@@ -25,6 +25,8 @@ DNS_Interpreter::DNS_Interpreter(analyzer::Analyzer* arg_analyzer)
 	{
 	analyzer = arg_analyzer;
 	first_message = true;
+	name_weirds = 0;
+	name_complete = false;
 	}
 
 void DNS_Interpreter::ParseMessage(const u_char* data, int len, int is_query)
@@ -49,13 +51,20 @@ void DNS_Interpreter::ParseMessage(const u_char* data, int len, int is_query)
 
 	first_message = false;
 
-	if ( dns_message )
-		analyzer->EnqueueConnEvent(dns_message,
-			analyzer->ConnVal(),
-			val_mgr->Bool(is_query),
-			msg.BuildHdrVal(),
-			val_mgr->Count(len)
-		);
+	// Queries expect a response, whatever their direction.
+	if ( msg.QR )
+		analyzer->TransactionFinished();
+	else
+		analyzer->TransactionStarted();
+
+	analyzer->EnqueueConnEventLazy(dns_message,
+		[c = analyzer->Conn(), is_query, msg, len](Args& args) mutable
+			{
+			args.emplace_back(c->ConnVal());
+			args.emplace_back(val_mgr->Bool(is_query));
+			args.emplace_back(msg.BuildHdrVal());
+			args.emplace_back(val_mgr->Count(len));
+			});
 
 	// There is a great deal of non-DNS traffic that runs on port 53.
 	// This should weed out most of it.
@@ -68,6 +77,8 @@ void DNS_Interpreter::ParseMessage(const u_char* data, int len, int is_query)
 		}
 
 	const u_char* msg_start = data;	// needed for interpreting compression
+	name_cache.clear();
+	name_arena.clear();
 
 	data += hdr_len;
 	len -= hdr_len;
@@ -240,7 +251,7 @@ bool DNS_Interpreter::ParseAnswer(detail::DNS_MsgInfo* msg,
 	// Note that the exact meaning of some of these fields will be
 	// re-interpreted by other, more adventurous RR types.
 
-	msg->query_name = make_intrusive<StringVal>(new String(name, name_end - name, true));
+	msg->SetQueryName(name, name_end - name);
 	msg->atype = detail::RR_Type(ExtractShort(data, len));
 	msg->aclass = ExtractShort(data, len);
 	msg->ttl = ExtractLong(data, len);
@@ -390,7 +401,7 @@ u_char* DNS_Interpreter::ExtractName(const u_char*& data, int& len,
 	int n = name - name_start;
 
 	if ( n >= 255 )
-		analyzer->Weird("DNS_NAME_too_long");
+		NameWeird("DNS_NAME_too_long");
 
 	if ( n >= 2 && name[-1] == '.' )
 		{
@@ -424,9 +435,14 @@ bool DNS_Interpreter::ExtractLabel(const u_char*& data, int& len,
 	if ( len <= 0 )
 		return false;
 
+	name_complete = false;
+
 	if ( label_len == 0 )
+		{
 		// Found terminating label.
+		name_complete = true;
 		return false;
+		}
 
 	if ( (label_len & 0xc0) == 0xc0 )
 		{
@@ -447,17 +463,40 @@ bool DNS_Interpreter::ExtractLabel(const u_char*& data, int& len,
 			//  But actually this turns out not to be the case -
 			//  sometimes compression points to compression.)
 
-			analyzer->Weird("DNS_label_forward_compress_offset");
+			NameWeird("DNS_label_forward_compress_offset");
 			return false;
 			}
 
+		// Messages tend to point to the same few names over and over,
+		// so reuse how we decoded them before.  Decoding can come out
+		// differently only where it had problems, so those don't get
+		// cached.
+		for ( const auto& n : name_cache )
+			if ( n.offset == offset && int(n.len) < name_len )
+				{
+				memcpy(name, name_arena.data() + n.start, n.len);
+				name += n.len;
+				name_len -= n.len;
+				name[0] = 0;
+				name_complete = true;
+				return false;
+				}
+
 		// Recursively resolve name.
 		const u_char* recurse_data = msg_start + offset;
 		int recurse_max_len = orig_data - recurse_data;
+		int weirds = name_weirds;
 
 		u_char* name_end = ExtractName(recurse_data, recurse_max_len,
 						name, name_len, msg_start);
 
+		if ( name_complete && name_weirds == weirds )
+			{
+			name_cache.push_back({offset, static_cast<uint32_t>(name_arena.size()),
+			                      static_cast<uint32_t>(name_end - name)});
+			name_arena.append(reinterpret_cast<const char*>(name), name_end - name);
+			}
+
 		name_len -= name_end - name;
 		name = name_end;
 
@@ -466,7 +505,7 @@ bool DNS_Interpreter::ExtractLabel(const u_char*& data, int& len,
 
 	if ( label_len > len )
 		{
-		analyzer->Weird("DNS_label_len_gt_pkt");
+		NameWeird("DNS_label_len_gt_pkt");
 		data += len;	// consume the rest of the packet
 		len = 0;
 		return false;
@@ -476,13 +515,13 @@ bool DNS_Interpreter::ExtractLabel(const u_char*& data, int& len,
 		// NetBIOS name service look ups can use longer labels.
 		ntohs(analyzer->Conn()->RespPort()) != 137 )
 		{
-		analyzer->Weird("DNS_label_too_long");
+		NameWeird("DNS_label_too_long");
 		return false;
 		}
 
 	if ( label_len >= name_len )
 		{
-		analyzer->Weird("DNS_label_len_gt_name_len");
+		NameWeird("DNS_label_len_gt_name_len");
 		return false;
 		}
 
@@ -1872,7 +1911,7 @@ RecordValPtr DNS_MsgInfo::BuildAnswerVal()
 	auto r = make_intrusive<RecordVal>(dns_answer);
 
 	r->Assign(0, val_mgr->Count(int(answer_type)));
-	r->Assign(1, query_name);
+	r->Assign(1, QueryName());
 	r->Assign(2, val_mgr->Count(atype));
 	r->Assign(3, val_mgr->Count(aclass));
 	r->Assign(4, make_intrusive<IntervalVal>(double(ttl), Seconds));
@@ -1888,7 +1927,7 @@ RecordValPtr DNS_MsgInfo::BuildEDNS_Val()
 	auto r = make_intrusive<RecordVal>(dns_edns_additional);
 
 	r->Assign(0, val_mgr->Count(int(answer_type)));
-	r->Assign(1, query_name);
+	r->Assign(1, QueryName());
 
 	// type = 0x29 or 41 = EDNS
 	r->Assign(2, val_mgr->Count(atype));
@@ -1960,7 +1999,7 @@ RecordValPtr DNS_MsgInfo::BuildTSIG_Val(struct TSIG_DATA* tsig)
 	double rtime = tsig->time_s + tsig->time_ms / 1000.0;
 
 	// r->Assign(0, val_mgr->Count(int(answer_type)));
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, val_mgr->Count(int(answer_type)));
 	r->Assign(2, make_intrusive<StringVal>(tsig->alg_name));
 	r->Assign(3, make_intrusive<StringVal>(tsig->sig));
@@ -1978,7 +2017,7 @@ RecordValPtr DNS_MsgInfo::BuildRRSIG_Val(RRSIG_DATA* rrsig)
 	static auto dns_rrsig_rr = id::find_type<RecordType>("dns_rrsig_rr");
 	auto r = make_intrusive<RecordVal>(dns_rrsig_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, val_mgr->Count(int(answer_type)));
 	r->Assign(2, val_mgr->Count(rrsig->type_covered));
 	r->Assign(3, val_mgr->Count(rrsig->algorithm));
@@ -1999,7 +2038,7 @@ RecordValPtr DNS_MsgInfo::BuildDNSKEY_Val(DNSKEY_DATA* dnskey)
 	static auto dns_dnskey_rr = id::find_type<RecordType>("dns_dnskey_rr");
 	auto r = make_intrusive<RecordVal>(dns_dnskey_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, val_mgr->Count(int(answer_type)));
 	r->Assign(2, val_mgr->Count(dnskey->dflags));
 	r->Assign(3, val_mgr->Count(dnskey->dprotocol));
@@ -2015,7 +2054,7 @@ RecordValPtr DNS_MsgInfo::BuildNSEC3_Val(NSEC3_DATA* nsec3)
 	static auto dns_nsec3_rr = id::find_type<RecordType>("dns_nsec3_rr");
 	auto r = make_intrusive<RecordVal>(dns_nsec3_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, val_mgr->Count(int(answer_type)));
 	r->Assign(2, val_mgr->Count(nsec3->nsec_flags));
 	r->Assign(3, val_mgr->Count(nsec3->nsec_hash_algo));
@@ -2035,7 +2074,7 @@ RecordValPtr DNS_MsgInfo::BuildNSEC3PARAM_Val(NSEC3PARAM_DATA* nsec3param)
 	static auto dns_nsec3param_rr = id::find_type<RecordType>("dns_nsec3param_rr");
 	auto r = make_intrusive<RecordVal>(dns_nsec3param_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, val_mgr->Count(int(answer_type)));
 	r->Assign(2, val_mgr->Count(nsec3param->nsec_flags));
 	r->Assign(3, val_mgr->Count(nsec3param->nsec_hash_algo));
@@ -2052,7 +2091,7 @@ RecordValPtr DNS_MsgInfo::BuildDS_Val(DS_DATA* ds)
 	static auto dns_ds_rr = id::find_type<RecordType>("dns_ds_rr");
 	auto r = make_intrusive<RecordVal>(dns_ds_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, val_mgr->Count(int(answer_type)));
 	r->Assign(2, val_mgr->Count(ds->key_tag));
 	r->Assign(3, val_mgr->Count(ds->algorithm));
@@ -2068,7 +2107,7 @@ RecordValPtr DNS_MsgInfo::BuildBINDS_Val(BINDS_DATA* binds)
 	static auto dns_binds_rr = id::find_type<RecordType>("dns_binds_rr");
 	auto r = make_intrusive<RecordVal>(dns_binds_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, val_mgr->Count(int(answer_type)));
 	r->Assign(2, val_mgr->Count(binds->algorithm));
 	r->Assign(3, val_mgr->Count(binds->key_id));
@@ -2084,7 +2123,7 @@ RecordValPtr DNS_MsgInfo::BuildLOC_Val(LOC_DATA* loc)
 	static auto dns_loc_rr = id::find_type<RecordType>("dns_loc_rr");
 	auto r = make_intrusive<RecordVal>(dns_loc_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, val_mgr->Count(int(answer_type)));
 	r->Assign(2, val_mgr->Count(loc->version));
 	r->Assign(3, val_mgr->Count(loc->size));
@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "zeek/analyzer/protocol/tcp/TCP.h"
 #include "zeek/binpac_zeek.h"
 
@@ -279,7 +282,24 @@ public:
 	int arcount;	///< number of additional RRs
 	int is_query;	///< whether it came from the session initiator
 
+	// Sets the name of the current resource record.  Its StringVal gets
+	// built only if an event needs it.
+	void SetQueryName(const u_char* name, int len)
+		{
+		query_name_data.assign(reinterpret_cast<const char*>(name), len);
+		query_name = nullptr;
+		}
+
+	const StringValPtr& QueryName()
+		{
+		if ( ! query_name )
+			query_name = make_intrusive<StringVal>(query_name_data.size(),
+			                                       query_name_data.data());
+		return query_name;
+		}
+
 	StringValPtr query_name;
+	std::string query_name_data;
 	RR_Type atype;
 	int aclass;	///< normally = 1, inet
 	uint32_t ttl;
@@ -402,6 +422,27 @@ protected:
 	                            String* question_name,
 	                            String* original_name);
 
+	void NameWeird(const char* name)
+		{
+		++name_weirds;
+		analyzer->Weird(name);
+		}
+
+	// The names compression pointers of the current message led to so
+	// far, by the offset they point to.  Their bytes are in name_arena.
+	// Both keep their storage across messages.
+	struct CachedName {
+		uint16_t offset;
+		uint32_t start;
+		uint32_t len;
+	};
+
+	std::vector<CachedName> name_cache;
+	std::string name_arena;
+
+	int name_weirds;	// Weirds while decoding names.
+	bool name_complete;	// Whether the last name had a proper end.
+
 	analyzer::Analyzer* analyzer;
 	bool first_message;
 };
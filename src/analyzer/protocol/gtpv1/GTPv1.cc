@@ -66,6 +66,11 @@ void GTPv1_Analyzer::DeliverPacket(int len, const u_char* data, bool orig, uint6
 		EncapsulatingConn ec(Conn(), BifEnum::Tunnel::GTPv1);
 		zeek::packet_analysis::IPTunnel::ip_tunnel_analyzer->ProcessEncapsulatedPacket(
 			run_state::network_time, nullptr, inner, e, ec);
+
+		auto cache = sessions->GetUDPTunnelCache();
+
+		if ( cache && ProtocolConfirmed() )
+			cache->Add(Conn(), this, BifEnum::Tunnel::GTPv1);
 		}
 	else if ( result == -2 )
 		ProtocolViolation("Invalid IP version in wrapped packet",
@@ -56,7 +56,7 @@ HTTP_Entity::HTTP_Entity(HTTP_Message* arg_message, analyzer::mime::MIME_Entity*
 	send_size = true;
 	// Always override what MIME_Entity set for want_all_headers: HTTP doesn't
 	// raise the generic MIME events, but rather it's own specific ones.
-	want_all_headers = (bool)http_all_headers;
+	want_all_headers = http_message->MyHTTP_Analyzer()->Wants(HTTP_Analyzer::WANT_ALL_HEADERS);
 	}
 
 void HTTP_Entity::EndOfData()
@@ -187,11 +187,12 @@ private:
 
 void HTTP_Entity::DeliverBody(int len, const char* data, bool trailing_CRLF)
 	{
-	if ( encoding == GZIP || encoding == DEFLATE )
+	if ( IsCompressed() )
 		{
 		analyzer::zip::ZIP_Analyzer::Method method =
-			encoding == GZIP ?
-			analyzer::zip::ZIP_Analyzer::GZIP : analyzer::zip::ZIP_Analyzer::DEFLATE;
+			encoding == GZIP ? analyzer::zip::ZIP_Analyzer::GZIP :
+			encoding == ZSTD ? analyzer::zip::ZIP_Analyzer::ZSTD :
+			analyzer::zip::ZIP_Analyzer::DEFLATE;
 
 		if ( ! zip )
 			{
@@ -310,7 +311,7 @@ void HTTP_Entity::SubmitData(int len, const char* buf)
 	if ( deliver_body )
 		analyzer::mime::MIME_Entity::SubmitData(len, buf);
 
-	if ( send_size && ( encoding == GZIP || encoding == DEFLATE ) )
+	if ( send_size && IsCompressed() )
 		// Auto-decompress in DeliverBody invalidates sizes derived from headers
 		send_size = false;
 
@@ -500,6 +501,10 @@ void HTTP_Entity::SubmitHeader(analyzer::mime::MIME_Header* h)
 			encoding = GZIP;
 		if ( analyzer::mime::istrequal(vt, "deflate") )
 			encoding = DEFLATE;
+#ifdef USE_ZSTD
+		if ( analyzer::mime::istrequal(vt, "zstd") )
+			encoding = ZSTD;
+#endif
 		}
 
 	analyzer::mime::MIME_Entity::SubmitHeader(h);
@@ -577,7 +582,7 @@ void HTTP_Entity::SubmitAllHeaders()
 	// content-length headers or if connection is to be closed afterwards
 	// anyway.
 	else if ( http_message->MyHTTP_Analyzer()->IsConnectionClose ()
-		  || encoding == GZIP || encoding == DEFLATE
+		  || IsCompressed()
 		 )
 		{
 		// FIXME: Using INT_MAX is kind of a hack here.  Better
@@ -745,7 +750,7 @@ void HTTP_Message::SubmitHeader(analyzer::mime::MIME_Header* h)
 
 void HTTP_Message::SubmitAllHeaders(analyzer::mime::MIME_HeaderList& hlist)
 	{
-	if ( http_all_headers )
+	if ( MyHTTP_Analyzer()->Wants(HTTP_Analyzer::WANT_ALL_HEADERS) )
 		analyzer->EnqueueConnEvent(http_all_headers,
 			analyzer->ConnVal(),
 			val_mgr->Bool(is_orig),
@@ -771,7 +776,7 @@ void HTTP_Message::SubmitTrailingHeaders(analyzer::mime::MIME_HeaderList& /* hli
 
 void HTTP_Message::SubmitData(int len, const char* buf)
 	{
-	if ( http_entity_data )
+	if ( MyHTTP_Analyzer()->Wants(HTTP_Analyzer::WANT_ENTITY_DATA) )
 		MyHTTP_Analyzer()->HTTP_EntityData(is_orig,
 		        new String(reinterpret_cast<const u_char*>(buf), len, false));
 	}
@@ -844,6 +849,17 @@ HTTP_Analyzer::HTTP_Analyzer(Connection* conn)
 	keep_alive = 0;
 	connection_close = 0;
 
+	features = 0;
+
+	if ( http_header )
+		features |= WANT_HEADER;
+	if ( http_all_headers )
+		features |= WANT_ALL_HEADERS;
+	if ( http_entity_data )
+		features |= WANT_ENTITY_DATA;
+	if ( http_event )
+		features |= WANT_EVENT;
+
 	request_message = reply_message = nullptr;
 	request_state = EXPECT_REQUEST_LINE;
 	reply_state = EXPECT_REPLY_LINE;
@@ -860,10 +876,12 @@ HTTP_Analyzer::HTTP_Analyzer(Connection* conn)
 	upgrade_protocol.clear();
 
 	content_line_orig = new analyzer::tcp::ContentLine_Analyzer(conn, true);
+	content_line_orig->SetDeliverInPlace(true);
 	AddSupportAnalyzer(content_line_orig);
 
 	content_line_resp = new analyzer::tcp::ContentLine_Analyzer(conn, false);
 	content_line_resp->SetSkipPartial(true);
+	content_line_resp->SetDeliverInPlace(true);
 	AddSupportAnalyzer(content_line_resp);
 	}
 
@@ -1363,12 +1381,13 @@ void HTTP_Analyzer::SetVersion(HTTP_VersionNumber* version, HTTP_VersionNumber n
 
 void HTTP_Analyzer::HTTP_Event(const char* category, const char* detail)
 	{
-	HTTP_Event(category, make_intrusive<StringVal>(detail));
+	if ( Wants(WANT_EVENT) )
+		HTTP_Event(category, make_intrusive<StringVal>(detail));
 	}
 
 void HTTP_Analyzer::HTTP_Event(const char* category, StringValPtr detail)
 	{
-	if ( http_event )
+	if ( Wants(WANT_EVENT) )
 		// DEBUG_MSG("%.6f http_event\n", run_state::network_time);
 		EnqueueConnEvent(http_event,
 			ConnVal(),
@@ -1627,7 +1646,7 @@ void HTTP_Analyzer::HTTP_Header(bool is_orig, analyzer::mime::MIME_Header* h)
 	     analyzer::mime::istrequal(h->get_name(), "upgrade") )
 	     upgrade_protocol.assign(h->get_value_token().data, h->get_value_token().length);
 
-	if ( http_header )
+	if ( Wants(WANT_HEADER) )
 		{
 		zeek::detail::Rule::PatternType rule =
 			is_orig ?  zeek::detail::Rule::HTTP_REQUEST_HEADER :
@@ -1661,7 +1680,7 @@ void HTTP_Analyzer::HTTP_Header(bool is_orig, analyzer::mime::MIME_Header* h)
 
 void HTTP_Analyzer::HTTP_EntityData(bool is_orig, String* entity_data)
 	{
-	if ( http_entity_data )
+	if ( Wants(WANT_ENTITY_DATA) )
 		EnqueueConnEvent(http_entity_data,
 			ConnVal(),
 			val_mgr->Bool(is_orig),
@@ -58,7 +58,10 @@ protected:
 	int expect_body;
 	int64_t body_length;
 	int64_t header_length;
-	enum { IDENTITY, GZIP, COMPRESS, DEFLATE } encoding;
+	enum { IDENTITY, GZIP, COMPRESS, DEFLATE, ZSTD } encoding;
+
+	bool IsCompressed() const
+		{ return encoding == GZIP || encoding == DEFLATE || encoding == ZSTD; }
 	analyzer::zip::ZIP_Analyzer* zip;
 	bool deliver_body;
 	bool is_partial_content;
@@ -153,6 +156,17 @@ class HTTP_Analyzer final : public analyzer::tcp::TCP_ApplicationAnalyzer {
 public:
 	HTTP_Analyzer(Connection* conn);
 
+	// Events that need data the analyzer can otherwise skip building.
+	// Whether they have handlers gets determined once per connection.
+	enum Feature {
+		WANT_HEADER = 1 << 0,	// http_header
+		WANT_ALL_HEADERS = 1 << 1,	// http_all_headers
+		WANT_ENTITY_DATA = 1 << 2,	// http_entity_data
+		WANT_EVENT = 1 << 3,	// http_event
+	};
+
+	bool Wants(Feature f) const	{ return features & f; }
+
 	void HTTP_Header(bool is_orig, analyzer::mime::MIME_Header* h);
 	void HTTP_EntityData(bool is_orig, String* entity_data);
 	void HTTP_MessageDone(bool is_orig, HTTP_Message* message);
@@ -247,6 +261,7 @@ protected:
 	int keep_alive;
 	int connection_close;
 	int request_ongoing, reply_ongoing;
+	unsigned int features;
 
 	bool connect_request;
 	analyzer::pia::PIA_TCP *pia;
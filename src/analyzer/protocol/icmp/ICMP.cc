@@ -47,7 +47,8 @@ void ICMP_Analyzer::DeliverPacket(int len, const u_char* data,
 
 	const struct icmp* icmpp = (const struct icmp*) data;
 
-	if ( ! zeek::detail::ignore_checksums &&
+	if ( ! (run_state::current_pkt->l4_checksummed && ! Conn()->GetEncapsulation()) &&
+	     ! zeek::detail::ignore_checksums &&
 	     ! zeek::id::find_val<TableVal>("ignore_checksums_nets")->Contains(ip->IPHeaderSrcAddr()) &&
 	     caplen >= len )
 		{
@@ -475,8 +476,8 @@ void ICMP_Analyzer::Describe(ODesc* d) const
 
 void ICMP_Analyzer::UpdateConnVal(RecordVal *conn_val)
 	{
-	const auto& orig_endp = conn_val->GetField("orig");
-	const auto& resp_endp = conn_val->GetField("resp");
+	const auto& orig_endp = conn_val->GetField(id::field::connection.orig);
+	const auto& resp_endp = conn_val->GetField(id::field::connection.resp);
 
 	UpdateEndpointVal(orig_endp, true);
 	UpdateEndpointVal(resp_endp, false);
@@ -494,14 +495,14 @@ void ICMP_Analyzer::UpdateEndpointVal(const ValPtr& endp_arg, bool is_orig)
 
 	if ( size < 0 )
 		{
-		endp->Assign(0, val_mgr->Count(0));
-		endp->Assign(1, val_mgr->Count(int(ICMP_INACTIVE)));
+		endp->AssignCount(id::field::endpoint.size, 0);
+		endp->AssignCount(id::field::endpoint.state, int(ICMP_INACTIVE));
 		}
 
 	else
 		{
-		endp->Assign(0, val_mgr->Count(size));
-		endp->Assign(1, val_mgr->Count(int(ICMP_ACTIVE)));
+		endp->AssignCount(id::field::endpoint.size, size);
+		endp->AssignCount(id::field::endpoint.state, int(ICMP_ACTIVE));
 		}
 	}
 
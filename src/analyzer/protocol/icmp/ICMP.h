@@ -24,6 +24,12 @@ class ICMP_Analyzer final : public analyzer::TransportLayerAnalyzer {
 public:
 	explicit ICMP_Analyzer(Connection* conn);
 
+	// Instances get recycled, see AnalyzerPool.
+	static void* operator new(size_t size)
+		{ return zeek::detail::AnalyzerPool<ICMP_Analyzer>::Allocate(size); }
+	static void operator delete(void* ptr, size_t size)
+		{ zeek::detail::AnalyzerPool<ICMP_Analyzer>::Release(ptr, size); }
+
 	void UpdateConnVal(RecordVal *conn_val) override;
 
 	static analyzer::Analyzer* Instantiate(Connection* conn)
@@ -447,21 +447,17 @@ MIME_Multiline::MIME_Multiline()
 MIME_Multiline::~MIME_Multiline()
 	{
 	delete line;
-	delete_strings(buffer);
 	}
 
 void MIME_Multiline::append(int len, const char* data)
 	{
-	buffer.push_back(new String((const u_char*) data, len, true));
+	buffer.append(data, len);
 	}
 
 String* MIME_Multiline::get_concatenated_line()
 	{
-	if ( buffer.empty() )
-		return nullptr;
-
 	delete line;
-	line = concatenate(buffer);
+	line = new String((const u_char*) buffer.data(), buffer.size(), true);
 
 	return line;
 	}
@@ -1134,11 +1130,33 @@ void MIME_Entity::DecodeBase64(int len, const char* data)
 
 	while ( len > 0 )
 		{
-		rlen = 128;
-		char* prbuf = rbuf;
+		if ( data_buf_offset < 0 && ! GetDataBuffer() )
+			return;
+
+		rlen = data_buf_length - data_buf_offset;
+
+		if ( rlen < 3 )
+			{
+			// Not room enough for a decoded group.
+			rlen = 128;
+			char* prbuf = rbuf;
+			int decoded = base64_decoder->Decode(len, data, &rlen, &prbuf);
+			DataOctets(rlen, rbuf);
+			len -= decoded; data += decoded;
+			continue;
+			}
+
+		// Decode straight into the data buffer.
+		char* prbuf = data_buf_data + data_buf_offset;
 		int decoded = base64_decoder->Decode(len, data, &rlen, &prbuf);
-		DataOctets(rlen, rbuf);
+		data_buf_offset += rlen;
 		len -= decoded; data += decoded;
+
+		if ( data_buf_offset == data_buf_length )
+			{
+			SubmitData(data_buf_length, data_buf_data);
+			data_buf_offset = -1;
+			}
 		}
 	}
 
@@ -1345,6 +1363,13 @@ MIME_Mail::MIME_Mail(analyzer::Analyzer* mail_analyzer, bool orig, int buf_size)
 	if ( length < max_chunk_length )
 		length = max_chunk_length;
 
+	// Without mime_segment_data, segments don't need to overlap, and
+	// the data goes to the file analysis in larger chunks.
+	streaming = ! mime_segment_data;
+
+	if ( streaming && length < STREAM_BUFFER_LENGTH )
+		length = STREAM_BUFFER_LENGTH;
+
 	buffer_start = data_start = 0;
 	data_buffer = new String(true, new u_char[length+1], length);
 
@@ -1389,7 +1414,7 @@ void MIME_Mail::Done()
 MIME_Mail::~MIME_Mail()
 	{
 	if ( md5_hash )
-		EVP_MD_CTX_free(md5_hash);
+		zeek::detail::hash_free(md5_hash);
 
 	delete_strings(all_content);
 	delete data_buffer;
@@ -1499,6 +1524,14 @@ void MIME_Mail::SubmitData(int len, const char* buf)
 
 bool MIME_Mail::RequestBuffer(int* plen, char** pbuf)
 	{
+	if ( streaming )
+		{
+		buffer_start = data_start = 0;
+		*plen = data_buffer->Len();
+		*pbuf = (char*) data_buffer->Bytes();
+		return true;
+		}
+
 	data_start = buffer_start - min_overlap_length;
 	if ( data_start < 0 )
 		data_start = 0;
@@ -3,6 +3,7 @@
 #include <assert.h>
 #include <openssl/evp.h>
 #include <stdio.h>
+#include <string>
 #include <vector>
 #include <queue>
 
@@ -64,7 +65,9 @@ public:
 	String* get_concatenated_line();
 
 protected:
-	std::vector<const String*> buffer;
+	// The lines so far, concatenated as they come in, so that a header
+	// gets copied only once more, into its String.
+	std::string buffer;
 	String* line;
 };
 
@@ -259,9 +262,14 @@ public:
 	void Undelivered(int len);
 
 protected:
+	// The size of the data buffer when it doesn't need to keep
+	// overlapping segments.
+	static constexpr int STREAM_BUFFER_LENGTH = 8192;
+
 	int min_overlap_length;
 	int max_chunk_length;
 	bool is_orig;
+	bool streaming;
 	int buffer_start;
 	int data_start;
 	int compute_content_hash;
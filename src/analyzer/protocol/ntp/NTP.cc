@@ -28,6 +28,17 @@ void NTP_Analyzer::DeliverPacket(int len, const u_char* data, bool orig,
 	{
 	Analyzer::DeliverPacket(len, data, orig, seq, ip, caplen);
 
+	if ( len > 0 )
+		{
+		// Client requests and the server's responses.
+		int mode = data[0] & 0x07;
+
+		if ( mode == 3 )
+			TransactionStarted();
+		else if ( mode == 4 )
+			TransactionFinished();
+		}
+
 	try
 		{
 		interp->NewData(orig, data, data + len);
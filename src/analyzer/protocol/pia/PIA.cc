@@ -7,11 +7,15 @@
 #include "zeek/DebugLogger.h"
 #include "zeek/Reporter.h"
 #include "zeek/RunState.h"
+#include "zeek/Reassem.h"
 #include "zeek/analyzer/protocol/tcp/TCP_Flags.h"
 #include "zeek/analyzer/protocol/tcp/TCP_Reassembler.h"
 
 namespace zeek::analyzer::pia {
 
+// The bytes of all PIA buffers together.
+static uint64_t total_buffered = 0;
+
 PIA::PIA(analyzer::Analyzer* arg_as_analyzer)
 	: state(INIT), as_analyzer(arg_as_analyzer), conn(), current_packet()
 	{
@@ -29,26 +33,85 @@ void PIA::ClearBuffer(Buffer* buffer)
 		{
 		next = b->next;
 		delete b->ip;
-		delete [] b->data;
-		delete b;
+
+		if ( b->lease )
+			b->lease->Release(this);
+		else if ( b->owns_data )
+			delete [] b->data;
+
+		total_buffered -= b->size;
+		zeek::detail::DataBlockPool::Free(reinterpret_cast<u_char*>(b), b->capacity);
 		}
 
 	buffer->head = buffer->tail = nullptr;
 	buffer->size = 0;
 	}
 
+void PIA::UnleaseBuffer(Buffer* buffer, const iosource::PacketLease* lease)
+	{
+	for ( DataBlock* b = buffer->head; b; b = b->next )
+		{
+		if ( b->lease != lease )
+			continue;
+
+		auto copy = new u_char[b->len];
+		memcpy(copy, b->data, b->len);
+		b->data = copy;
+		b->lease = nullptr;
+		b->owns_data = true;
+		}
+	}
+
+void PIA::DiscardBuffer(Buffer* buffer)
+	{
+	int size = buffer->size;
+	ClearBuffer(buffer);
+	buffer->size = size;
+	buffer->discard = true;
+	}
+
+PIA::State PIA::FullBufferState()
+	{
+	return zeek::detail::dpd_match_only_beginning ? SKIPPING : MATCHING_ONLY;
+	}
+
+bool PIA::TotalBufferFull()
+	{
+	return zeek::detail::dpd_buffer_total_size &&
+		total_buffered >= zeek::detail::dpd_buffer_total_size;
+	}
+
 void PIA::AddToBuffer(Buffer* buffer, uint64_t seq, int len, const u_char* data,
                       bool is_orig, const IP_Hdr* ip)
 	{
-	u_char* tmp = nullptr;
+	if ( buffer->discard )
+		{
+		buffer->size += len;
+		return;
+		}
 
-	if ( data )
+	// Unless the packet data can be leased, it follows the block in the
+	// same chunk, which comes from the slabs shared with reassembly.
+	auto lease = iosource::PacketLease::Acquire(this, data, len);
+	uint64_t copy_len = (data && ! lease) ? len : 0;
+	uint64_t capacity;
+	auto mem = zeek::detail::DataBlockPool::Allocate(sizeof(DataBlock) + copy_len,
+	                                                 &capacity);
+	DataBlock* b = new (mem) DataBlock;
+	b->capacity = capacity;
+	b->size = lease ? capacity + len : capacity;
+	b->lease = lease;
+	b->owns_data = false;
+	total_buffered += b->size;
+	const u_char* tmp = lease ? data : nullptr;
+
+	if ( copy_len )
 		{
-		tmp = new u_char[len];
-		memcpy(tmp, data, len);
+		u_char* copy = mem + sizeof(DataBlock);
+		memcpy(copy, data, len);
+		tmp = copy;
 		}
 
-	DataBlock* b = new DataBlock;
 	b->ip = ip ? ip->Copy() : nullptr;
 	b->data = tmp;
 	b->is_orig = is_orig;
@@ -105,10 +168,14 @@ void PIA::PIA_DeliverPacket(int len, const u_char* data, bool is_orig, uint64_t
 	if ( (pkt_buffer.state == BUFFERING || new_state == BUFFERING) &&
 	     len > 0 )
 		{
-		AddToBuffer(&pkt_buffer, seq, len, data, is_orig, ip);
-		if ( pkt_buffer.size > zeek::detail::dpd_buffer_size )
-			new_state = zeek::detail::dpd_match_only_beginning ?
-						SKIPPING : MATCHING_ONLY;
+		if ( ! pkt_buffer.discard && TotalBufferFull() )
+			new_state = FullBufferState();
+		else
+			{
+			AddToBuffer(&pkt_buffer, seq, len, data, is_orig, ip);
+			if ( pkt_buffer.size > zeek::detail::dpd_buffer_size )
+				new_state = FullBufferState();
+			}
 		}
 
 	// FIXME: I'm not sure why it does not work with eol=true...
@@ -268,6 +335,10 @@ void PIA_TCP::DeliverStream(int len, const u_char* data, bool is_orig)
 	if ( stream_buffer.state == SKIPPING )
 		return;
 
+	if ( ! stream_mode && ! pkt_buffer.discard )
+		// Analyzers get the stream buffer replayed from now on.
+		DiscardBuffer(&pkt_buffer);
+
 	stream_mode = true;
 
 	State new_state = stream_buffer.state;
@@ -280,15 +351,23 @@ void PIA_TCP::DeliverStream(int len, const u_char* data, bool is_orig)
 
 	if ( stream_buffer.state == BUFFERING || new_state == BUFFERING )
 		{
-		AddToBuffer(&stream_buffer, len, data, is_orig);
-		if ( stream_buffer.size > zeek::detail::dpd_buffer_size )
-			new_state = zeek::detail::dpd_match_only_beginning ?
-						SKIPPING : MATCHING_ONLY;
+		if ( TotalBufferFull() )
+			new_state = FullBufferState();
+		else
+			{
+			AddToBuffer(&stream_buffer, len, data, is_orig);
+			if ( stream_buffer.size > zeek::detail::dpd_buffer_size )
+				new_state = FullBufferState();
+			}
 		}
 
 	DoMatch(data, len, is_orig, false, false, false, nullptr);
 
 	stream_buffer.state = new_state;
+
+	// Analyzers activated from now on don't get the buffer replayed.
+	if ( new_state != BUFFERING )
+		ClearBuffer(&stream_buffer);
 	}
 
 void PIA_TCP::Undelivered(uint64_t seq, int len, bool is_orig)
@@ -417,6 +496,7 @@ void PIA_TCP::ActivateAnalyzer(analyzer::Tag tag, const zeek::detail::Rule* rule
 		}
 
 	ClearBuffer(&pkt_buffer);
+	pkt_buffer.discard = true;
 
 	ReplayStreamBuffer(a);
 	reass_orig->AckReceived(orig_seq);
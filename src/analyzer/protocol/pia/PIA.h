@@ -5,6 +5,7 @@
 #include "zeek/analyzer/Analyzer.h"
 #include "zeek/analyzer/protocol/tcp/TCP.h"
 #include "zeek/RuleMatcher.h"
+#include "zeek/iosource/PacketLease.h"
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(RuleEndpointState, zeek::detail);
 
@@ -17,7 +18,7 @@ namespace zeek::analyzer::pia {
 // also keeps the matching state.  This is because (i) it needs to match
 // itself, and (ii) in case of tunnel-decapsulation we may have multiple
 // PIAs and then each needs its own matching-state.
-class PIA : public zeek::detail::RuleMatcherState {
+class PIA : public zeek::detail::RuleMatcherState, public iosource::PacketLeaseHolder {
 public:
 	explicit PIA(analyzer::Analyzer* as_analyzer);
 	virtual ~PIA();
@@ -35,6 +36,9 @@ public:
 
 	void ReplayPacketBuffer(analyzer::Analyzer* analyzer);
 
+	// True unless signature matching on packets has stopped.
+	bool PacketMatching() const	{ return pkt_buffer.state != SKIPPING; }
+
 	// Children are also derived from Analyzer. Return this object
 	// as pointer to an Analyzer.
 	analyzer::Analyzer* AsAnalyzer()	{ return as_analyzer; }
@@ -55,15 +59,26 @@ protected:
 		int len;
 		uint64_t seq;
 		DataBlock* next;
+		uint64_t capacity;	// Of the DataBlockPool chunk holding it.
+		uint64_t size;	// Accounted in total_buffered.
+
+		// The lease on the packet data, if not copied. Once revoked,
+		// the data is a copy of its own.
+		iosource::PacketLease* lease;
+		bool owns_data;
 	};
 
 	struct Buffer {
-		Buffer() { head = tail = nullptr; size = 0; state = INIT; }
+		Buffer() { head = tail = nullptr; size = 0; state = INIT; discard = false; }
 
 		DataBlock* head;
 		DataBlock* tail;
 		int size;
 		State state;
+
+		// True once the data won't be replayed anymore, so only the
+		// size gets tracked.
+		bool discard;
 	};
 
 	void AddToBuffer(Buffer* buffer, uint64_t seq, int len,
@@ -72,6 +87,23 @@ protected:
 	                 const u_char* data, bool is_orig, const IP_Hdr* ip = nullptr);
 	void ClearBuffer(Buffer* buffer);
 
+	// Copies the data of the buffer's blocks under the given lease.
+	static void UnleaseBuffer(Buffer* buffer, const iosource::PacketLease* lease);
+
+	// PacketLeaseHolder interface.
+	void LeaseRevoked(const iosource::PacketLease* lease) override
+		{ UnleaseBuffer(&pkt_buffer, lease); }
+
+	// Frees the buffered data for good, but keeps tracking the size.
+	void DiscardBuffer(Buffer* buffer);
+
+	// Returns the state a buffer moves to once it's full.
+	static State FullBufferState();
+
+	// True if the buffers of all connections together reached
+	// dpd_buffer_total_size.
+	static bool TotalBufferFull();
+
 	DataBlock* CurrentPacket()	{ return &current_packet; }
 
 	void DoMatch(const u_char* data, int len, bool is_orig, bool bol,
@@ -95,6 +127,12 @@ public:
 		{ SetConn(conn); }
 	~PIA_UDP() override { }
 
+	// Instances get recycled, see AnalyzerPool.
+	static void* operator new(size_t size)
+		{ return zeek::detail::AnalyzerPool<PIA_UDP>::Allocate(size); }
+	static void operator delete(void* ptr, size_t size)
+		{ zeek::detail::AnalyzerPool<PIA_UDP>::Release(ptr, size); }
+
 	static analyzer::Analyzer* Instantiate(Connection* conn)
 		{ return new PIA_UDP(conn); }
 
@@ -110,6 +148,11 @@ protected:
 		{
 		Analyzer::DeliverPacket(len, data, is_orig, seq, ip, caplen);
 		PIA_DeliverPacket(len, data, is_orig, seq, ip, caplen, true);
+
+		// Analyzers activated from now on don't get the buffer
+		// replayed.
+		if ( pkt_buffer.state != BUFFERING && pkt_buffer.head )
+			ClearBuffer(&pkt_buffer);
 		}
 
 	void ActivateAnalyzer(analyzer::Tag tag, const zeek::detail::Rule* rule) override;
@@ -126,6 +169,12 @@ public:
 
 	~PIA_TCP() override;
 
+	// Instances get recycled, see AnalyzerPool.
+	static void* operator new(size_t size)
+		{ return zeek::detail::AnalyzerPool<PIA_TCP>::Allocate(size); }
+	static void operator delete(void* ptr, size_t size)
+		{ zeek::detail::AnalyzerPool<PIA_TCP>::Release(ptr, size); }
+
 	void Init() override;
 
 	// The first packet for each direction of a connection is passed
@@ -140,6 +189,9 @@ public:
 
 	void ReplayStreamBuffer(analyzer::Analyzer* analyzer);
 
+	// True unless signature matching on the stream has stopped.
+	bool StreamMatching() const	{ return stream_buffer.state != SKIPPING; }
+
 	static analyzer::Analyzer* Instantiate(Connection* conn)
 		{ return new PIA_TCP(conn); }
 
@@ -160,6 +212,12 @@ protected:
 	void DeliverStream(int len, const u_char* data, bool is_orig) override;
 	void Undelivered(uint64_t seq, int len, bool is_orig) override;
 
+	void LeaseRevoked(const iosource::PacketLease* lease) override
+		{
+		PIA::LeaseRevoked(lease);
+		UnleaseBuffer(&stream_buffer, lease);
+		}
+
 	void ActivateAnalyzer(analyzer::Tag tag,
 	                      const zeek::detail::Rule* rule = nullptr) override;
 	void DeactivateAnalyzer(analyzer::Tag tag) override;
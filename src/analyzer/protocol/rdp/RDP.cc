@@ -4,6 +4,7 @@
 
 #include "analyzer/protocol/rdp/events.bif.h"
 #include "analyzer/protocol/rdp/types.bif.h"
+#include "analyzer/protocol/rdp/consts.bif.h"
 
 namespace zeek::analyzer::rdp {
 
@@ -72,6 +73,12 @@ void RDP_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 				}
 
 			ForwardStream(len, data, orig);
+
+			// The analyzer found inside, usually SSL, may have
+			// stopped parsing the encrypted data by now.
+			if ( BifConst::RDP::skip_encrypted_data &&
+			     ! analyzer::tcp::TCP_Analyzer::ChildrenConsumeContents(this, pia) )
+				SkipEncryptedData();
 			}
 		else
 			{
@@ -79,6 +86,9 @@ void RDP_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 				BifEvent::enqueue_rdp_native_encrypted_data(
 				        interp->zeek_analyzer(), interp->zeek_analyzer()->Conn(),
 				        orig, len);
+
+			else if ( BifConst::RDP::skip_encrypted_data )
+				SkipEncryptedData();
 			}
 		}
 	else // if not encrypted
@@ -94,6 +104,14 @@ void RDP_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 		}
 	}
 
+void RDP_Analyzer::SkipEncryptedData()
+	{
+	SetSkip(true);
+
+	if ( TCP() )
+		TCP()->SkipUnusedContents();
+	}
+
 void RDP_Analyzer::Undelivered(uint64_t seq, int len, bool orig)
 	{
 	analyzer::tcp::TCP_ApplicationAnalyzer::Undelivered(seq, len, orig);
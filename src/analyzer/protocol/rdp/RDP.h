@@ -26,6 +26,10 @@ public:
 protected:
 	binpac::RDP::RDP_Conn* interp;
 
+	// Stops parsing the connection, and its reassembly if nothing
+	// else needs the payload.
+	void SkipEncryptedData();
+
 	bool had_gap;
 	analyzer::pia::PIA_TCP *pia;
 };
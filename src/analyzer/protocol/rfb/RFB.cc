@@ -50,11 +50,16 @@ void RFB_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 	if ( invalid )
 		return;
 
-	if ( interp->saw_handshake() && ! orig )
-		// Don't try parsing server data after the handshake
-		// (it's not completely implemented and contains mostly
-		// uninteresting pixel data).
+	if ( interp->saw_handshake() )
+		{
+		// Don't try parsing data after the handshake: the server's is
+		// mostly uninteresting pixel data, and the client's messages
+		// don't raise events.  Reassembly can stop, too, if nothing
+		// else needs the payload.
+		SetSkip(true);
+		TCP()->SkipUnusedContents();
 		return;
+		}
 
 	try
 		{
@@ -7,6 +7,7 @@
 
 #include "analyzer/protocol/ssh/types.bif.h"
 #include "analyzer/protocol/ssh/events.bif.h"
+#include "analyzer/protocol/ssh/consts.bif.h"
 
 namespace zeek::analyzer::ssh {
 
@@ -96,6 +97,22 @@ void SSH_Analyzer::ProcessEncryptedSegment(int len, bool orig)
 
 	if ( ! auth_decision_made )
 		ProcessEncrypted(len, orig);
+
+	// Once both directions are encrypted and the authentication
+	// heuristics are done, nothing looks at the payload anymore.
+	// Connection sizes keep coming from the packet headers.
+	if ( BifConst::SSH::skip_encrypted_data && ! ssh_encrypted_packet &&
+	     (auth_decision_made || interp->get_version() != binpac::SSH::SSH2) &&
+	     interp->get_state(! orig) == binpac::SSH::ENCRYPTED )
+		SkipEncryptedData();
+	}
+
+void SSH_Analyzer::SkipEncryptedData()
+	{
+	SetSkip(true);
+
+	if ( TCP() )
+		TCP()->SkipUnusedContents();
 	}
 
 void SSH_Analyzer::ProcessEncrypted(int len, bool orig)
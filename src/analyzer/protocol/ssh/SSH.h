@@ -32,6 +32,10 @@ protected:
 	void ProcessEncrypted(int len, bool orig);
 	void ProcessEncryptedSegment(int len, bool orig);
 
+	// Stops parsing the connection, and its reassembly if nothing
+	// else needs the payload.
+	void SkipEncryptedData();
+
 	bool had_gap;
 
 	// Packet analysis stuff
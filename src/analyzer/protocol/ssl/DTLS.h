@@ -22,6 +22,9 @@ public:
 
 	void SendHandshake(uint16_t raw_tls_version, uint8_t msg_type, uint32_t length, const u_char* begin, const u_char* end, bool orig);
 
+	// Stops parsing once the handshake has completed.
+	void SkipEncryptedData()	{ SetSkip(true); }
+
 
 	static analyzer::Analyzer* Instantiate(Connection* conn)
 		{ return new DTLS_Analyzer(conn); }
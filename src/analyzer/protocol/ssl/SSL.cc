@@ -28,6 +28,11 @@ void SSL_Analyzer::Done()
 	{
 	analyzer::tcp::TCP_ApplicationAnalyzer::Done();
 
+	// The analyzer may have been disabled after the handshake, in which
+	// case the payload possibly isn't needed anymore.
+	if ( Removing() && TCP() )
+		TCP()->SkipUnusedContents();
+
 	interp->FlowEOF(true);
 	interp->FlowEOF(false);
 	handshake_interp->FlowEOF(true);
@@ -48,6 +53,14 @@ void SSL_Analyzer::StartEncryption()
 	interp->setEstablished();
 	}
 
+void SSL_Analyzer::SkipEncryptedData()
+	{
+	SetSkip(true);
+
+	if ( TCP() )
+		TCP()->SkipUnusedContents();
+	}
+
 void SSL_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 	{
 	analyzer::tcp::TCP_ApplicationAnalyzer::DeliverStream(len, data, orig);
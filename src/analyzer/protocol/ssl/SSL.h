@@ -25,6 +25,10 @@ public:
 	// Tell the analyzer that encryption has started.
 	void StartEncryption();
 
+	// Stops parsing once the handshake has completed, along with TCP
+	// reassembly if nothing else needs the payload.
+	void SkipEncryptedData();
+
 	// Overriden from analyzer::tcp::TCP_ApplicationAnalyzer.
 	void EndpointEOF(bool is_orig) override;
 
@@ -4,6 +4,7 @@
 #include "zeek/analyzer/protocol/stepping-stone/SteppingStone.h"
 
 #include <stdlib.h>
+#include <algorithm>
 
 #include "zeek/Event.h"
 #include "zeek/RunState.h"
@@ -80,6 +81,7 @@ bool SteppingStoneEndpoint::DataSent(double t, uint64_t seq, int len, int caplen
 		if ( e->stp_resume_time < tmin )
 			{
 			stp_manager->OrderedEndpoints().pop_front();
+			stp_manager->Expire(e, tmin);
 			e->Done();
 			Unref(e);
 			}
@@ -106,25 +108,22 @@ bool SteppingStoneEndpoint::DataSent(double t, uint64_t seq, int len, int caplen
 	stp_last_time = stp_resume_time = t;
 
 	Event(stp_resume_endp, stp_id);
-	for ( auto ep : stp_manager->OrderedEndpoints() )
+
+	for ( auto ep : stp_manager->Candidates(this, tmin) )
 		{
-		if ( ep->endp->TCP() != endp->TCP() )
+		// A pair correlated before keeps its references.
+		if ( stp_inbound_endps.emplace(ep->stp_id, ep).second )
 			{
 			Ref(ep);
 			Ref(this);
-
-			stp_inbound_endps[ep->stp_id] = ep;
 			ep->stp_outbound_endps[stp_id] = this;
-
-			Event(stp_correlate_pair, ep->stp_id, stp_id);
 			}
 
-		else
-			{ // ep and this belong to same connection
-			}
+		Event(stp_correlate_pair, ep->stp_id, stp_id);
 		}
 
 	stp_manager->OrderedEndpoints().push_back(this);
+	stp_manager->AddResume(this, t);
 	Ref(this);
 
 	return true;
@@ -204,6 +203,76 @@ void SteppingStone_Analyzer::DeliverStream(int len, const u_char* data,
 		}
 	}
 
+void SteppingStoneManager::AddResume(SteppingStoneEndpoint* e, double t)
+	{
+	auto max = std::max(BifConst::stp_max_candidates, static_cast<bro_uint_t>(1));
+
+	for ( const auto& a : {e->Conn()->OrigAddr(), e->Conn()->RespAddr()} )
+		{
+		auto& tl = timelines[a];
+		tl.push_back({e, t});
+
+		// Dropping the oldest is fine here, as the endpoints stay
+		// referenced by ordered_endps.
+		while ( tl.size() > max )
+			tl.pop_front();
+		}
+	}
+
+void SteppingStoneManager::ExpireHost(const IPAddr& a, double tmin)
+	{
+	auto it = timelines.find(a);
+
+	if ( it == timelines.end() )
+		return;
+
+	auto& tl = it->second;
+
+	while ( ! tl.empty() && tl.front().time < tmin )
+		tl.pop_front();
+
+	if ( tl.empty() )
+		timelines.erase(it);
+	}
+
+void SteppingStoneManager::Expire(const SteppingStoneEndpoint* e, double tmin)
+	{
+	ExpireHost(e->Conn()->OrigAddr(), tmin);
+	ExpireHost(e->Conn()->RespAddr(), tmin);
+	}
+
+void SteppingStoneManager::AddCandidates(const IPAddr& a, const SteppingStoneEndpoint* e,
+                                         double tmin)
+	{
+	ExpireHost(a, tmin);
+
+	auto it = timelines.find(a);
+
+	if ( it == timelines.end() )
+		return;
+
+	for ( const auto& r : it->second )
+		{
+		if ( r.endp->Conn() == e->Conn() )
+			continue;
+
+		// An endpoint resuming more than once is still one candidate.
+		if ( std::find(candidates.begin(), candidates.end(), r.endp) != candidates.end() )
+			continue;
+
+		candidates.push_back(r.endp);
+		}
+	}
+
+const std::vector<SteppingStoneEndpoint*>& SteppingStoneManager::Candidates(
+	const SteppingStoneEndpoint* e, double tmin)
+	{
+	candidates.clear();
+	AddCandidates(e->Conn()->OrigAddr(), e, tmin);
+	AddCandidates(e->Conn()->RespAddr(), e, tmin);
+	return candidates;
+	}
+
 void SteppingStone_Analyzer::Done()
 	{
 	analyzer::tcp::TCP_ApplicationAnalyzer::Done();
@@ -2,6 +2,12 @@
 
 #pragma once
 
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "zeek/IPAddr.h"
 #include "zeek/Queue.h"
 #include "zeek/analyzer/protocol/tcp/TCP.h"
 
@@ -21,6 +27,11 @@ public:
 	bool DataSent(double t, uint64_t seq, int len, int caplen, const u_char* data,
 	              const IP_Hdr* ip, const struct tcphdr* tp);
 
+	// The connection the endpoint belongs to.
+	const Connection* Conn() const	{ return endp->TCP()->Conn(); }
+
+	double ResumeTime() const	{ return stp_resume_time; }
+
 protected:
 	void Event(EventHandlerPtr f, int id1, int id2 = -1);
 	void CreateEndpEvent(bool is_orig);
@@ -66,7 +77,9 @@ protected:
 	SteppingStoneEndpoint* resp_endp;
 };
 
-// Manages ids for the possible stepping stone connections.
+// Manages ids for the possible stepping stone connections, and the recent
+// resumes of endpoints by host, for correlating only endpoints whose
+// connections share a host.
 class SteppingStoneManager {
 public:
 
@@ -76,9 +89,47 @@ public:
 	// Use postfix ++, since the first ID needs to be even.
 	int NextID()			{ return endp_cnt++; }
 
+	// Records that an endpoint resumed sending at time t, under both
+	// hosts of its connection.
+	void AddResume(SteppingStoneEndpoint* e, double t);
+
+	// Drops the resumes before tmin recorded for the hosts of an
+	// endpoint's connection.  Endpoints that resumed before tmin may be
+	// gone, so they must be expired before looking up candidates.
+	void Expire(const SteppingStoneEndpoint* e, double tmin);
+
+	// Returns the endpoints of other connections sharing a host with
+	// the endpoint's that resumed at tmin or later, each once.  Per
+	// host, only the last stp_max_candidates resumes count.
+	const std::vector<SteppingStoneEndpoint*>& Candidates(const SteppingStoneEndpoint* e,
+	                                                      double tmin);
+
 protected:
+	struct Resume {
+		SteppingStoneEndpoint* endp;
+		double time;
+	};
+
+	using Timeline = std::deque<Resume>;
+
+	struct AddrHash {
+		size_t operator()(const IPAddr& a) const
+			{
+			const uint32_t* bytes;
+			int n = a.GetBytes(&bytes);
+			return std::hash<std::string_view>()(
+				std::string_view(reinterpret_cast<const char*>(bytes), n * 4));
+			}
+	};
+
+	void ExpireHost(const IPAddr& a, double tmin);
+	void AddCandidates(const IPAddr& a, const SteppingStoneEndpoint* e, double tmin);
+
 	PQueue<SteppingStoneEndpoint> ordered_endps;
 	int endp_cnt = 0;
+
+	std::unordered_map<IPAddr, Timeline, AddrHash> timelines;
+	std::vector<SteppingStoneEndpoint*> candidates;
 };
 
 } // namespace zeek::analyzer::stepping_stone
@@ -1,5 +1,12 @@
 #include "zeek/analyzer/protocol/tcp/ContentLine.h"
 
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "zeek/analyzer/protocol/tcp/TCP.h"
 #include "zeek/Reporter.h"
 
@@ -25,6 +32,7 @@ void ContentLine_Analyzer::InitState()
 	CR_LF_as_EOL = (CR_as_EOL | LF_as_EOL);
 	skip_deliveries = false;
 	skip_partial = false;
+	deliver_in_place = false;
 	buf = nullptr;
 	seq_delivered_in_lines = 0;
 	skip_pending = 0;
@@ -191,6 +199,36 @@ void ContentLine_Analyzer::DoDeliver(int len, const u_char* data)
 		}
 	}
 
+// Returns the number of bytes at the beginning of data that don't need a
+// closer look when splitting lines, i.e., that aren't CR, LF or NUL.
+static int plain_run(const u_char* data, int len)
+	{
+	int i = 0;
+
+#ifdef __SSE2__
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i nul = _mm_setzero_si128();
+
+	for ( ; i + 16 <= len; i += 16 )
+		{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, cr),
+		                                            _mm_cmpeq_epi8(block, lf)),
+		                               _mm_cmpeq_epi8(block, nul));
+
+		if ( int mask = _mm_movemask_epi8(special) )
+			return i + __builtin_ctz(mask);
+		}
+#endif
+
+	for ( ; i < len; ++i )
+		if ( data[i] == '\r' || data[i] == '\n' || data[i] == '\0' )
+			break;
+
+	return i;
+	}
+
 int ContentLine_Analyzer::DoDeliverOnce(int len, const u_char* data)
 	{
 	const u_char* data_start = data;
@@ -198,8 +236,55 @@ int ContentLine_Analyzer::DoDeliverOnce(int len, const u_char* data)
 	if ( len <= 0 )
 		return 0;
 
+	// A line that starts and ends in this block can go out as is, if
+	// the analyzer allows.  Anything that needs a closer look, such as
+	// a NUL, a single CR or an overlong line, takes the regular path.
+	if ( deliver_in_place && offset == 0 && last_char != '\r' )
+		{
+		int n = plain_run(data, std::min(len, max_line_length));
+		int eol = 0;
+
+		if ( n < len && n < max_line_length )
+			{
+			if ( data[n] == '\n' && (CR_LF_as_EOL & LF_as_EOL) )
+				eol = 1;
+			else if ( data[n] == '\r' && n + 1 < len && data[n + 1] == '\n' )
+				eol = 2;
+			}
+
+		if ( eol )
+			{
+			seq_delivered_in_lines = seq + n + eol;
+			last_char = '\n';
+			ForwardStream(n, data, IsOrig());
+			return n + eol;
+			}
+		}
+
 	for ( ; len > 0; --len, ++data )
 		{
+		// Take the bytes up to the next one that may end the line in
+		// one go.  A preceding CR still needs the check below.
+		if ( last_char != '\r' )
+			{
+			int n = plain_run(data, std::min(len, max_line_length - offset));
+
+			if ( n > 0 )
+				{
+				if ( offset + n > buf_len )
+					InitBuffer(std::max(buf_len * 2, offset + n));
+
+				memcpy(buf + offset, data, n);
+				offset += n;
+				data += n;
+				len -= n;
+				last_char = data[-1];
+
+				if ( len == 0 )
+					break;
+				}
+			}
+
 		if ( offset >= buf_len )
 			InitBuffer(buf_len * 2);
 
@@ -17,6 +17,12 @@ public:
 	ContentLine_Analyzer(Connection* conn, bool orig, int max_line_length=DEFAULT_MAX_LINE_LENGTH);
 	~ContentLine_Analyzer() override;
 
+	// Instances get recycled, see AnalyzerPool.
+	static void* operator new(size_t size)
+		{ return zeek::detail::AnalyzerPool<ContentLine_Analyzer>::Allocate(size); }
+	static void operator delete(void* ptr, size_t size)
+		{ zeek::detail::AnalyzerPool<ContentLine_Analyzer>::Release(ptr, size); }
+
 	void SupressWeirds(bool enable)
 		{ suppress_weirds = enable; }
 
@@ -28,6 +34,13 @@ public:
 	void SetSkipPartial(bool enable)
 		{ skip_partial = enable; }
 
+	// If enabled, lines that arrive in one piece get passed on as
+	// pointers into the input rather than copied into the line buffer
+	// first.  These lines aren't NUL-terminated, so only analyzers
+	// that go by the length may turn it on.  Default off.
+	void SetDeliverInPlace(bool enable)
+		{ deliver_in_place = enable; }
+
 	// If true, single CR / LF are considered as EOL. Default on for both.
 	void SetCRLFAsEOL(int crlf = (CR_as_EOL | LF_as_EOL))
 		{ CR_LF_as_EOL = crlf; }
@@ -112,6 +125,9 @@ protected:
 
 	// Whether to skip partial conns.
 	bool skip_partial;
+
+	// Whether complete lines may get delivered from the input.
+	bool deliver_in_place;
 };
 
 } // namespace zeek::analyzer::tcp
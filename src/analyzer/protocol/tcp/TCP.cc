@@ -41,6 +41,16 @@ namespace zeek::analyzer::tcp {
 static const int ORIG = 1;
 static const int RESP = 2;
 
+// Weirds that broken or hostile traffic can trigger for every packet.
+static const zeek::detail::WeirdName weird_bad_TCP_header_len{"bad_TCP_header_len"};
+static const zeek::detail::WeirdName weird_truncated_header{"truncated_header"};
+static const zeek::detail::WeirdName weird_bad_TCP_checksum{"bad_TCP_checksum"};
+static const zeek::detail::WeirdName weird_data_before_established{"data_before_established"};
+static const zeek::detail::WeirdName weird_data_after_reset{"data_after_reset"};
+static const zeek::detail::WeirdName weird_possible_split_routing{"possible_split_routing"};
+static const zeek::detail::WeirdName weird_TCP_seq_underflow_or_misorder{"TCP_seq_underflow_or_misorder"};
+static const zeek::detail::WeirdName weird_TCP_ack_underflow_or_misorder{"TCP_ack_underflow_or_misorder"};
+
 static RecordVal* build_syn_packet_val(bool is_orig, const IP_Hdr* ip,
                                              const struct tcphdr* tcp)
 	{
@@ -252,7 +262,7 @@ const struct tcphdr* TCP_Analyzer::ExtractTCP_Header(const u_char*& data,
 
 	if ( tcp_hdr_len < sizeof(struct tcphdr) )
 		{
-		Weird("bad_TCP_header_len");
+		Weird(weird_bad_TCP_header_len);
 		return nullptr;
 		}
 
@@ -261,7 +271,7 @@ const struct tcphdr* TCP_Analyzer::ExtractTCP_Header(const u_char*& data,
 		{
 		// This can happen even with the above test, due to TCP
 		// options.
-		Weird("truncated_header");
+		Weird(weird_truncated_header);
 		return nullptr;
 		}
 
@@ -276,11 +286,12 @@ bool TCP_Analyzer::ValidateChecksum(const IP_Hdr* ip, const struct tcphdr* tp,
 				TCP_Endpoint* endpoint, int len, int caplen)
 	{
 	if ( ! run_state::current_pkt->l3_checksummed &&
+	     ! (run_state::current_pkt->l4_checksummed && ! Conn()->GetEncapsulation()) &&
 	     ! detail::ignore_checksums &&
 	     ! zeek::id::find_val<TableVal>("ignore_checksums_nets")->Contains(ip->IPHeaderSrcAddr()) &&
 	     caplen >= len && ! endpoint->ValidChecksum(tp, len, ip->IP4_Hdr()) )
 		{
-		Weird("bad_TCP_checksum");
+		Weird(weird_bad_TCP_checksum);
 		endpoint->ChecksumError();
 		return false;
 		}
@@ -658,7 +669,7 @@ void TCP_Analyzer::UpdateSYN_SentState(TCP_Endpoint* endpoint, TCP_Endpoint* pee
 		}
 
 	else if ( len > 0 )
-		Weird("data_before_established");
+		Weird(weird_data_before_established);
 	}
 
 void TCP_Analyzer::UpdateEstablishedState(
@@ -741,7 +752,7 @@ void TCP_Analyzer::UpdateResetState(int len, TCP_Flags flags)
 		Weird("FIN_after_reset");
 
 	if ( len > 0 && ! flags.RST() )
-		Weird("data_after_reset");
+		Weird(weird_data_after_reset);
 	}
 
 void TCP_Analyzer::UpdateStateMachine(double t,
@@ -982,7 +993,7 @@ static void init_peer(TCP_Endpoint* peer, TCP_Endpoint* endpoint,
 			// ack'ing their data.
 
 			if ( ! endpoint->Conn()->DidWeird() )
-				endpoint->Conn()->Weird("possible_split_routing");
+				endpoint->Conn()->Weird(weird_possible_split_routing);
 			}
 		}
 
@@ -1087,7 +1098,7 @@ void TCP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 		// before the sequence Bro initialized the endpoint at or the TCP is
 		// just broken and sending garbage sequences.  In either case, some
 		// standard analysis doesn't apply (e.g. reassembly).
-		Weird("TCP_seq_underflow_or_misorder");
+		Weird(weird_TCP_seq_underflow_or_misorder);
 
 	update_history(flags, endpoint, rel_seq, len);
 	update_window(endpoint, ntohs(tp->th_win), base_seq, ack_seq, flags);
@@ -1164,7 +1175,7 @@ void TCP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 			if ( ack_underflow )
 				{
 				rel_ack = 0;
-				Weird("TCP_ack_underflow_or_misorder");
+				Weird(weird_TCP_ack_underflow_or_misorder);
 				}
 			else if ( ! flags.RST() )
 				// Don't trust ack's in RST packets.
@@ -1280,15 +1291,31 @@ void TCP_Analyzer::FlipRoles()
 	resp->is_orig = !resp->is_orig;
 	}
 
+unsigned int TCP_Analyzer::MemoryAllocation() const
+	{
+	// The endpoints and their reassemblers, including the data they
+	// buffer, are part of the analyzer.
+	unsigned int mem = Analyzer::MemoryAllocation()
+		+ padded_sizeof(*this) - padded_sizeof(Analyzer)
+		+ 2 * padded_sizeof(TCP_Endpoint);
+
+	for ( const TCP_Endpoint* e : { orig, resp } )
+		if ( e->contents_processor )
+			mem += padded_sizeof(TCP_Reassembler) + e->contents_processor->TotalSize();
+
+	return mem;
+	}
+
 void TCP_Analyzer::UpdateConnVal(RecordVal *conn_val)
 	{
-	RecordVal* orig_endp_val = conn_val->GetField("orig")->AsRecordVal();
-	RecordVal* resp_endp_val = conn_val->GetField("resp")->AsRecordVal();
+	const auto& ef = id::field::endpoint;
+	RecordVal* orig_endp_val = conn_val->GetField(id::field::connection.orig)->AsRecordVal();
+	RecordVal* resp_endp_val = conn_val->GetField(id::field::connection.resp)->AsRecordVal();
 
-	orig_endp_val->Assign(0, val_mgr->Count(orig->Size()));
-	orig_endp_val->Assign(1, val_mgr->Count(int(orig->state)));
-	resp_endp_val->Assign(0, val_mgr->Count(resp->Size()));
-	resp_endp_val->Assign(1, val_mgr->Count(int(resp->state)));
+	orig_endp_val->AssignCount(ef.size, orig->Size());
+	orig_endp_val->AssignCount(ef.state, int(orig->state));
+	resp_endp_val->AssignCount(ef.size, resp->Size());
+	resp_endp_val->AssignCount(ef.state, int(resp->state));
 
 	// Call children's UpdateConnVal
 	Analyzer::UpdateConnVal(conn_val);
@@ -1773,6 +1800,37 @@ bool TCP_Analyzer::DataPending(TCP_Endpoint* closing_endp)
 	return closing_endp->DataPending();
 	}
 
+bool TCP_Analyzer::ChildrenConsumeContents(analyzer::Analyzer* parent,
+                                           analyzer::pia::PIA_TCP* pia)
+	{
+	for ( auto* a : parent->GetChildren() )
+		{
+		if ( a->Skipping() || a->Removing() || a->IsFinished() )
+			continue;
+
+		if ( pia && a == pia->AsAnalyzer() && ! pia->StreamMatching() )
+			continue;
+
+		return true;
+		}
+
+	return false;
+	}
+
+void TCP_Analyzer::SkipUnusedContents()
+	{
+	auto* pia = static_cast<analyzer::pia::PIA_TCP*>(Conn()->GetPrimaryPIA());
+
+	if ( ChildrenConsumeContents(this, pia) )
+		return;
+
+	if ( orig->contents_processor )
+		orig->contents_processor->StopDeliveries();
+
+	if ( resp->contents_processor )
+		resp->contents_processor->StopDeliveries();
+	}
+
 void TCP_Analyzer::EndpointEOF(TCP_Reassembler* endp)
 	{
 	if ( connection_EOF )
@@ -26,6 +26,12 @@ public:
 	explicit TCP_Analyzer(Connection* conn);
 	~TCP_Analyzer() override;
 
+	// Instances get recycled, see AnalyzerPool.
+	static void* operator new(size_t size)
+		{ return zeek::detail::AnalyzerPool<TCP_Analyzer>::Allocate(size); }
+	static void operator delete(void* ptr, size_t size)
+		{ zeek::detail::AnalyzerPool<TCP_Analyzer>::Release(ptr, size); }
+
 	void EnableReassembly();
 
 	// Add a child analyzer that will always get the packets,
@@ -60,11 +66,24 @@ public:
 	// the test is whether it has any outstanding, un-acked data.
 	bool DataPending(TCP_Endpoint* closing_endp);
 
+	// Stops reassembling payload once none of the child analyzers
+	// consumes it anymore, i.e., all of them are skipping input or
+	// being removed, and signature matching has stopped.  Sequence
+	// numbers continue to be tracked, so sizes remain accurate.
+	void SkipUnusedContents();
+
+	// Returns true if any of the children of the given analyzer still
+	// consumes payload, ignoring the given PIA once it no longer
+	// matches signatures.
+	static bool ChildrenConsumeContents(analyzer::Analyzer* parent,
+	                                    analyzer::pia::PIA_TCP* pia);
+
 	void SetContentsFile(unsigned int direction, FilePtr f) override;
 	FilePtr GetContentsFile(unsigned int direction) const override;
 
 	// From Analyzer.h
 	void UpdateConnVal(RecordVal *conn_val) override;
+	unsigned int MemoryAllocation() const override;
 
 	int ParseTCPOptions(const struct tcphdr* tcp, bool is_orig);
 
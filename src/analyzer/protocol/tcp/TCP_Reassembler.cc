@@ -4,6 +4,7 @@
 
 #include "zeek/analyzer/protocol/tcp/TCP_Endpoint.h"
 #include "zeek/File.h"
+#include "zeek/PipelineStats.h"
 #include "zeek/analyzer/Analyzer.h"
 #include "zeek/analyzer/protocol/tcp/TCP.h"
 #include "zeek/ZeekString.h"
@@ -35,6 +36,7 @@ TCP_Reassembler::TCP_Reassembler(analyzer::Analyzer* arg_dst_analyzer,
 	skip_deliveries = false;
 	did_EOF = false;
 	seq_to_skip = 0;
+	unbuffered_upper = 0;
 	in_delivery = false;
 
 	if ( zeek::detail::tcp_max_old_segments )
@@ -82,6 +84,7 @@ void TCP_Reassembler::SizeBufferedData(uint64_t& waiting_on_hole,
 	{
 	waiting_on_hole = waiting_on_ack = 0;
 	block_list.DataSize(last_reassem_seq, &waiting_on_ack, &waiting_on_hole);
+	waiting_on_ack += UnbufferedSize();
 	}
 
 uint64_t TCP_Reassembler::NumUndeliveredBytes() const
@@ -415,6 +418,16 @@ void TCP_Reassembler::BlockInserted(DataBlockMap::const_iterator it)
 		++it;
 		}
 
+	TrimDelivered();
+
+	// Note: don't make an EOF check here, because then we'd miss it
+	// for FIN packets that don't carry any payload (and thus
+	// endpoint->DataSent is not called).  Instead, do the check in
+	// TCP_Connection::NextPacket.
+	}
+
+void TCP_Reassembler::TrimDelivered()
+	{
 	TCP_Endpoint* e = endp;
 
 	if ( ! e->peer->HasContents() )
@@ -431,11 +444,40 @@ void TCP_Reassembler::BlockInserted(DataBlockMap::const_iterator it)
 		// don't hang onto the data further, as we may wind up
 		// carrying it all the way until this connection ends.
 		TrimToSeq(last_reassem_seq);
+	}
 
-	// Note: don't make an EOF check here, because then we'd miss it
-	// for FIN packets that don't carry any payload (and thus
-	// endpoint->DataSent is not called).  Instead, do the check in
-	// TCP_Connection::NextPacket.
+bool TCP_Reassembler::CanDeliverUnbuffered() const
+	{
+	return block_list.Empty() && ! rexmit_inconsistency &&
+	       ! record_contents_file && max_old_blocks == 0;
+	}
+
+void TCP_Reassembler::DeliverUnbuffered(double t, uint64_t seq, uint64_t len,
+                                        const u_char* data)
+	{
+	uint64_t upper_seq = seq + len;
+
+	if ( upper_seq <= last_reassem_seq )
+		// A retransmission of data we've already delivered.
+		return;
+
+	if ( seq > last_reassem_seq )
+		{
+		// There's a hole, so we need to hold on to this.
+		NewBlock(t, seq, len, data);
+		return;
+		}
+
+	uint64_t amount_old = last_reassem_seq - seq;
+	seq += amount_old;
+	data += amount_old;
+	len -= amount_old;
+
+	last_reassem_seq = upper_seq;
+	unbuffered_upper = upper_seq;
+	DeliverBlock(seq, len, data);
+
+	TrimDelivered();
 	}
 
 void TCP_Reassembler::Overlap(const u_char* b1, const u_char* b2, uint64_t n)
@@ -472,6 +514,7 @@ void TCP_Reassembler::Deliver(uint64_t seq, int len, const u_char* data)
 bool TCP_Reassembler::DataSent(double t, uint64_t seq, int len,
 				const u_char* data, TCP_Flags arg_flags, bool replaying)
 	{
+	zeek::detail::StageTimer timer(zeek::detail::PipelineStats::TCP_REASSEMBLY);
 	uint64_t ack = endp->ToRelativeSeqSpace(endp->AckSeq(), endp->AckWraps());
 	uint64_t upper_seq = seq + len;
 
@@ -502,7 +545,12 @@ bool TCP_Reassembler::DataSent(double t, uint64_t seq, int len,
 		}
 
 	flags = arg_flags;
-	NewBlock(t, seq, len, data);
+
+	if ( CanDeliverUnbuffered() )
+		DeliverUnbuffered(t, seq, len, data);
+	else
+		NewBlock(t, seq, len, data);
+
 	flags = TCP_Flags();
 
 	if ( Endpoint()->NoDataAcked() && zeek::detail::tcp_max_above_hole_without_any_acks &&
@@ -510,14 +558,16 @@ bool TCP_Reassembler::DataSent(double t, uint64_t seq, int len,
 		{
 		tcp_analyzer->Weird("above_hole_data_without_any_acks");
 		ClearBlocks();
+		unbuffered_upper = 0;
 		skip_deliveries = true;
 		}
 
 	if ( zeek::detail::tcp_excessive_data_without_further_acks &&
-	     block_list.DataSize() > static_cast<uint64_t>(zeek::detail::tcp_excessive_data_without_further_acks) )
+	     block_list.DataSize() + UnbufferedSize() > static_cast<uint64_t>(zeek::detail::tcp_excessive_data_without_further_acks) )
 		{
 		tcp_analyzer->Weird("excessive_data_without_further_acks");
 		ClearBlocks();
+		unbuffered_upper = 0;
 		skip_deliveries = true;
 		}
 
@@ -643,6 +693,15 @@ void TCP_Reassembler::SkipToSeq(uint64_t seq)
 		}
 	}
 
+void TCP_Reassembler::StopDeliveries()
+	{
+	if ( deliver_tcp_contents || record_contents_file )
+		return;
+
+	// Blocks still held get released as acks come in.
+	skip_deliveries = true;
+	}
+
 bool TCP_Reassembler::DataPending() const
 	{
 	// If we are skipping deliveries, the reassembler will not get called
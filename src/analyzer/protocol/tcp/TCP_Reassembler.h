@@ -55,6 +55,10 @@ public:
 	// Can be used to skip HTTP data for performance considerations.
 	void SkipToSeq(uint64_t seq);
 
+	// Stops delivering data, unless it gets recorded to a file or
+	// raised as tcp_contents.
+	void StopDeliveries();
+
 	bool DataSent(double t, uint64_t seq, int len, const u_char* data,
 		     analyzer::tcp::TCP_Flags flags, bool replaying=true);
 	void AckReceived(uint64_t seq);
@@ -64,7 +68,8 @@ public:
 	// when so.
 	void CheckEOF();
 
-	bool HasUndeliveredData() const	{ return HasBlocks(); }
+	bool HasUndeliveredData() const
+		{ return HasBlocks() || UnbufferedSize() > 0; }
 	bool HadGap() const	{ return had_gap; }
 	bool DataPending() const;
 	uint64_t DataSeq() const		{ return LastReassemSeq(); }
@@ -89,6 +94,24 @@ private:
 	void RecordBlock(const DataBlock& b, const FilePtr& f);
 	void RecordGap(uint64_t start_seq, uint64_t upper_seq, const FilePtr& f);
 
+	// True if in-order data can be delivered without buffering it
+	// first: nothing is currently held, and nobody needs delivered
+	// data kept around for overlap checks or for recording it.
+	bool CanDeliverUnbuffered() const;
+
+	// Delivers the data right away if it's in order, without adding it
+	// to the block list. Already delivered parts are skipped, and data
+	// above a hole gets buffered as usual.
+	void DeliverUnbuffered(double t, uint64_t seq, uint64_t len, const u_char* data);
+
+	// Trims delivered data if we don't expect to see it acked.
+	void TrimDelivered();
+
+	// The amount of delivered but not yet acked data that got delivered
+	// unbuffered, and which the block list would otherwise still hold.
+	uint64_t UnbufferedSize() const
+		{ return unbuffered_upper > trim_seq ? unbuffered_upper - trim_seq : 0; }
+
 	void BlockInserted(DataBlockMap::const_iterator it) override;
 	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override;
 
@@ -100,6 +123,7 @@ private:
 	bool skip_deliveries;
 
 	uint64_t seq_to_skip;
+	uint64_t unbuffered_upper;	// upper end of data delivered unbuffered
 
 	bool in_delivery;
 	analyzer::tcp::TCP_Flags flags;
@@ -64,6 +64,7 @@ void UDP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 
 	auto validate_checksum =
 		! run_state::current_pkt->l3_checksummed &&
+		! (run_state::current_pkt->l4_checksummed && ! Conn()->GetEncapsulation()) &&
 		! zeek::detail::ignore_checksums &&
 		! zeek::id::find_val<TableVal>("ignore_checksums_nets")->Contains(ip->IPHeaderSrcAddr()) &&
 		caplen >=len;
@@ -178,6 +179,15 @@ void UDP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 			                 make_intrusive<StringVal>(len, (const char*) data));
 		}
 
+	CountDatagram(is_orig, ulen);
+	Event(is_orig ? udp_request : udp_reply);
+
+	if ( caplen >= len )
+		ForwardPacket(len, data, is_orig, seq, ip, caplen);
+	}
+
+void UDP_Analyzer::CountDatagram(bool is_orig, int ulen)
+	{
 	if ( is_orig )
 		{
 		Conn()->CheckHistory(HIST_ORIG_DATA_PKT, 'D');
@@ -192,8 +202,6 @@ void UDP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 				reporter->Warning("wrapping around for UDP request length");
 #endif
 			}
-
-		Event(udp_request);
 		}
 
 	else
@@ -210,18 +218,13 @@ void UDP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 				reporter->Warning("wrapping around for UDP reply length");
 #endif
 			}
-
-		Event(udp_reply);
 		}
-
-	if ( caplen >= len )
-		ForwardPacket(len, data, is_orig, seq, ip, caplen);
 	}
 
 void UDP_Analyzer::UpdateConnVal(RecordVal* conn_val)
 	{
-	RecordVal* orig_endp = conn_val->GetField("orig")->AsRecordVal();
-	RecordVal* resp_endp = conn_val->GetField("resp")->AsRecordVal();
+	RecordVal* orig_endp = conn_val->GetField(id::field::connection.orig)->AsRecordVal();
+	RecordVal* resp_endp = conn_val->GetField(id::field::connection.resp)->AsRecordVal();
 
 	UpdateEndpointVal(orig_endp, true);
 	UpdateEndpointVal(resp_endp, false);
@@ -235,14 +238,14 @@ void UDP_Analyzer::UpdateEndpointVal(RecordVal* endp, bool is_orig)
 	bro_int_t size = is_orig ? request_len : reply_len;
 	if ( size < 0 )
 		{
-		endp->Assign(0, val_mgr->Count(0));
-		endp->Assign(1, val_mgr->Count(int(UDP_INACTIVE)));
+		endp->AssignCount(id::field::endpoint.size, 0);
+		endp->AssignCount(id::field::endpoint.state, int(UDP_INACTIVE));
 		}
 
 	else
 		{
-		endp->Assign(0, val_mgr->Count(size));
-		endp->Assign(1, val_mgr->Count(int(UDP_ACTIVE)));
+		endp->AssignCount(id::field::endpoint.size, size);
+		endp->AssignCount(id::field::endpoint.state, int(UDP_ACTIVE));
 		}
 	}
 
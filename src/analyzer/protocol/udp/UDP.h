@@ -20,9 +20,19 @@ public:
 	explicit UDP_Analyzer(Connection* conn);
 	~UDP_Analyzer() override;
 
+	// Instances get recycled, see AnalyzerPool.
+	static void* operator new(size_t size)
+		{ return zeek::detail::AnalyzerPool<UDP_Analyzer>::Allocate(size); }
+	static void operator delete(void* ptr, size_t size)
+		{ zeek::detail::AnalyzerPool<UDP_Analyzer>::Release(ptr, size); }
+
 	void Init() override;
 	void UpdateConnVal(RecordVal *conn_val) override;
 
+	// Accounts for a datagram's payload of the given length without
+	// analyzing it, for the fast path of known tunnels.
+	void CountDatagram(bool is_orig, int ulen);
+
 	static analyzer::Analyzer* Instantiate(Connection* conn)
 		{ return new UDP_Analyzer(conn); }
 
@@ -55,7 +55,10 @@ void VXLAN_Analyzer::DeliverPacket(int len, const u_char* data, bool orig,
 		return;
 		}
 
-	if ( ! outer )
+	// The connection's encapsulation must remain as is.
+	if ( outer )
+		outer = std::make_shared<EncapsulationStack>(*outer);
+	else
 		outer = std::make_shared<EncapsulationStack>();
 
 	EncapsulatingConn inner(Conn(), BifEnum::Tunnel::VXLAN);
@@ -90,6 +93,9 @@ void VXLAN_Analyzer::DeliverPacket(int len, const u_char* data, bool orig,
 	if ( vxlan_packet )
 		Conn()->EnqueueEvent(vxlan_packet, nullptr, ConnVal(),
 		                     pkt.ip_hdr->ToPktHdrVal(), val_mgr->Count(vni));
+
+	else if ( auto cache = sessions->GetUDPTunnelCache() )
+		cache->Add(Conn(), this, BifEnum::Tunnel::VXLAN);
 	}
 
 } // namespace zeek::analyzer::vxlan
@@ -2,14 +2,35 @@
 
 #include "zeek/analyzer/protocol/zip/ZIP.h"
 
+#include "zeek/NetVar.h"
+
 namespace zeek::analyzer::zip {
 
+// The output chunk size, matching zlib's largest window.
+static constexpr unsigned int unzip_size = 32768;
+
 ZIP_Analyzer::ZIP_Analyzer(Connection* conn, bool orig, Method arg_method)
 : analyzer::tcp::TCP_SupportAnalyzer("ZIP", conn, orig)
 	{
 	zip = nullptr;
 	zip_status = Z_OK;
 	method = arg_method;
+	inflated_size = 0;
+
+#ifdef USE_ZSTD
+	if ( method == ZSTD )
+		{
+		zstd = ZSTD_createDCtx();
+
+		if ( ! zstd )
+			{
+			Weird("zstd_init_failed");
+			zip_status = Z_MEM_ERROR;
+			}
+
+		return;
+		}
+#endif
 
 	zip = new z_stream;
 	zip->zalloc = 0;
@@ -32,6 +53,9 @@ ZIP_Analyzer::ZIP_Analyzer(Connection* conn, bool orig, Method arg_method)
 
 ZIP_Analyzer::~ZIP_Analyzer()
 	{
+#ifdef USE_ZSTD
+	ZSTD_freeDCtx(zstd);
+#endif
 	delete zip;
 	}
 
@@ -50,8 +74,16 @@ void ZIP_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 	if ( ! len || zip_status != Z_OK )
 		return;
 
-	static unsigned int unzip_size = 4096;
-	auto unzipbuf = std::make_unique<Bytef[]>(unzip_size);
+	if ( ! unzipbuf )
+		unzipbuf = std::make_unique<Bytef[]>(unzip_size);
+
+#ifdef USE_ZSTD
+	if ( method == ZSTD )
+		{
+		DeliverZstd(len, data);
+		return;
+		}
+#endif
 
 	int allow_restart = 1;
 
@@ -74,6 +106,16 @@ void ZIP_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 			allow_restart = 0;
 
 			int have = unzip_size - zip->avail_out;
+			inflated_size += have;
+
+			if ( BifConst::zip_max_inflated_size &&
+			     inflated_size > BifConst::zip_max_inflated_size )
+				{
+				Weird("inflate_size_exceeded");
+				zip_status = Z_BUF_ERROR;
+				return;
+				}
+
 			if ( have )
 				ForwardStream(have, unzipbuf.get(), IsOrig());
 
@@ -114,4 +156,42 @@ void ZIP_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 		}
 	}
 
+#ifdef USE_ZSTD
+void ZIP_Analyzer::DeliverZstd(int len, const u_char* data)
+	{
+	ZSTD_inBuffer in = {data, static_cast<size_t>(len), 0};
+
+	// Continue while there's input, or while the output filled up and
+	// the decoder may still hold more.
+	while ( true )
+		{
+		ZSTD_outBuffer out = {unzipbuf.get(), unzip_size, 0};
+		size_t rc = ZSTD_decompressStream(zstd, &out, &in);
+
+		if ( ZSTD_isError(rc) )
+			{
+			Weird("zstd_decompress_failed", ZSTD_getErrorName(rc));
+			zip_status = Z_DATA_ERROR;
+			return;
+			}
+
+		inflated_size += out.pos;
+
+		if ( BifConst::zip_max_inflated_size &&
+		     inflated_size > BifConst::zip_max_inflated_size )
+			{
+			Weird("inflate_size_exceeded");
+			zip_status = Z_BUF_ERROR;
+			return;
+			}
+
+		if ( out.pos )
+			ForwardStream(out.pos, unzipbuf.get(), IsOrig());
+
+		if ( in.pos == in.size && out.pos < out.size )
+			return;
+		}
+	}
+#endif
+
 } // namespace zeek::analyzer::zip
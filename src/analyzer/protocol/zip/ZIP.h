@@ -5,6 +5,11 @@
 #include "zeek-config.h"
 
 #include <zlib.h>
+#include <memory>
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "zeek/analyzer/protocol/tcp/TCP.h"
 
@@ -12,7 +17,7 @@ namespace zeek::analyzer::zip {
 
 class ZIP_Analyzer final : public analyzer::tcp::TCP_SupportAnalyzer {
 public:
-	enum Method { GZIP, DEFLATE };
+	enum Method { GZIP, DEFLATE, ZSTD };
 
 	ZIP_Analyzer(Connection* conn, bool orig, Method method = GZIP);
 	~ZIP_Analyzer() override;
@@ -22,10 +27,22 @@ public:
 	void DeliverStream(int len, const u_char* data, bool orig) override;
 
 protected:
+#ifdef USE_ZSTD
+	void DeliverZstd(int len, const u_char* data);
+
+	ZSTD_DCtx* zstd = nullptr;
+#endif
+
 	enum { NONE, ZIP_OK, ZIP_FAIL };
 	z_stream* zip;
 	int zip_status;
 	Method method;
+
+	// Receives the inflated data, allocated on first use and reused
+	// for all deliveries.
+	std::unique_ptr<Bytef[]> unzipbuf;
+
+	uint64_t inflated_size;	// total output so far
 };
 
 } // namespace zeek::analyzer::zip
@@ -0,0 +1,147 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/bench/Bench.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+namespace zeek::bench {
+
+// Function-local so that registrations from other files' static
+// initializers find it constructed.
+static std::vector<std::pair<std::string, Function>>& benchmarks()
+	{
+	static std::vector<std::pair<std::string, Function>> b;
+	return b;
+	}
+
+Registration::Registration(const char* name, Function f)
+	{
+	benchmarks().emplace_back(name, f);
+	}
+
+// Runs a benchmark with growing iteration counts until it takes long
+// enough to time reliably.
+static State measure(Function f, double min_time)
+	{
+	uint64_t n = 1;
+
+	while ( true )
+		{
+		State state(n);
+		f(state);
+
+		double secs = state.Elapsed();
+
+		if ( secs >= min_time || n >= 1000000000 )
+			return state;
+
+		// Aim a bit beyond min_time, but grow at least 2x and at most
+		// 100x per round.
+		double target = secs > 0 ? n * min_time * 1.2 / secs : n * 100.0;
+		n = static_cast<uint64_t>(std::min(std::max(target, n * 2.0), n * 100.0));
+		}
+	}
+
+int Run(const std::string& filter, double min_time, FILE* out)
+	{
+	auto& b = benchmarks();
+	std::sort(b.begin(), b.end());
+
+	fprintf(out, "{\"zeek_version\":\"%s\"}\n", VERSION);
+
+	int num = 0;
+
+	for ( const auto& [name, f] : b )
+		{
+		if ( name.find(filter) == std::string::npos )
+			continue;
+
+		State state = measure(f, min_time);
+		double ns = state.Elapsed() * 1e9 / state.Iterations();
+
+		fprintf(out, "{\"name\":\"%s\",\"iterations\":%" PRIu64 ",\"ns_per_iteration\":%.3f",
+		        name.c_str(), state.Iterations(), ns);
+
+		if ( state.ItemsPerIteration() )
+			fprintf(out, ",\"items_per_second\":%.1f",
+			        state.ItemsPerIteration() * state.Iterations() / state.Elapsed());
+
+		fprintf(out, "}\n");
+		fflush(out);
+
+		fprintf(stderr, "%-40s %14.1f ns %14" PRIu64 " iterations\n",
+		        name.c_str(), ns, state.Iterations());
+		++num;
+		}
+
+	return num;
+	}
+
+// Reads a results file into a map from benchmark name to time per
+// iteration.
+static bool read_results(const char* file, std::map<std::string, double>* results)
+	{
+	std::ifstream in(file);
+
+	if ( ! in )
+		{
+		fprintf(stderr, "cannot open %s\n", file);
+		return false;
+		}
+
+	std::string line;
+
+	while ( std::getline(in, line) )
+		{
+		rapidjson::Document d;
+		d.Parse(line.c_str());
+
+		if ( d.HasParseError() || ! d.IsObject() )
+			{
+			fprintf(stderr, "%s: invalid line: %s\n", file, line.c_str());
+			return false;
+			}
+
+		if ( d.HasMember("name") && d.HasMember("ns_per_iteration") )
+			(*results)[d["name"].GetString()] = d["ns_per_iteration"].GetDouble();
+		}
+
+	return true;
+	}
+
+bool Compare(const char* old_results, const char* new_results)
+	{
+	std::map<std::string, double> old_r;
+	std::map<std::string, double> new_r;
+
+	if ( ! read_results(old_results, &old_r) || ! read_results(new_results, &new_r) )
+		return false;
+
+	printf("%-40s %14s %14s %8s\n", "benchmark", "old ns", "new ns", "change");
+
+	for ( const auto& [name, ns] : new_r )
+		{
+		auto it = old_r.find(name);
+
+		if ( it == old_r.end() )
+			printf("%-40s %14s %14.1f %8s\n", name.c_str(), "-", ns, "new");
+		else
+			printf("%-40s %14.1f %14.1f %+7.1f%%\n", name.c_str(), it->second, ns,
+			       (ns - it->second) * 100.0 / it->second);
+		}
+
+	for ( const auto& [name, ns] : old_r )
+		if ( new_r.find(name) == new_r.end() )
+			printf("%-40s %14.1f %14s %8s\n", name.c_str(), ns, "-", "gone");
+
+	return true;
+	}
+
+} // namespace zeek::bench
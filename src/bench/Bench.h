@@ -0,0 +1,135 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A small harness for microbenchmarks of Zeek's data structures and hot
+// paths, in the style of Google Benchmark.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <string>
+
+namespace zeek::bench {
+
+/**
+ * Controls a benchmark's timed loop:
+ *
+ *     ZEEK_BENCHMARK(Foo)
+ *         {
+ *         // Setup, not timed.
+ *
+ *         while ( state.KeepRunning() )
+ *             // The work to time, once per iteration.
+ *         }
+ */
+class State {
+public:
+	explicit State(uint64_t arg_max_iterations) : max_iterations(arg_max_iterations)	{ }
+
+	/**
+	 * Returns true while there are iterations left to run.  The first
+	 * call starts the clock, the last one stops it.
+	 */
+	bool KeepRunning()
+		{
+		if ( iterations == 0 && ! running )
+			Resume();
+
+		if ( iterations < max_iterations )
+			{
+			++iterations;
+			return true;
+			}
+
+		Pause();
+		return false;
+		}
+
+	/**
+	 * Stops the clock, such as for per-iteration setup.
+	 */
+	void Pause()
+		{
+		if ( ! running )
+			return;
+
+		elapsed += std::chrono::steady_clock::now() - start;
+		running = false;
+		}
+
+	/**
+	 * Restarts the clock after Pause().
+	 */
+	void Resume()
+		{
+		start = std::chrono::steady_clock::now();
+		running = true;
+		}
+
+	/**
+	 * Sets how many items an iteration processes, for reporting
+	 * throughput.
+	 */
+	void SetItemsPerIteration(uint64_t n)	{ items_per_iteration = n; }
+
+	uint64_t Iterations() const	{ return iterations; }
+	uint64_t ItemsPerIteration() const	{ return items_per_iteration; }
+	double Elapsed() const	{ return std::chrono::duration<double>(elapsed).count(); }
+
+private:
+	uint64_t max_iterations;
+	uint64_t iterations = 0;
+	uint64_t items_per_iteration = 0;
+	bool running = false;
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::duration elapsed{0};
+};
+
+using Function = void (*)(State& state);
+
+/**
+ * Adds a benchmark to the ones zeek-bench runs.  Use ZEEK_BENCHMARK rather
+ * than creating these directly.
+ */
+class Registration {
+public:
+	Registration(const char* name, Function f);
+};
+
+/**
+ * Keeps the compiler from optimizing away the computation of a value.
+ */
+template <typename T>
+inline void DoNotOptimize(const T& value)
+	{
+	asm volatile("" : : "r,m"(value) : "memory");
+	}
+
+/**
+ * Runs the registered benchmarks.
+ *
+ * @param filter  Only benchmarks whose name contains this run.
+ *
+ * @param min_time  How long each benchmark runs at least, in seconds.
+ *
+ * @param out  The file to write results to, as one JSON object per line.
+ *
+ * @return  The number of benchmarks that ran.
+ */
+int Run(const std::string& filter, double min_time, FILE* out);
+
+/**
+ * Prints how the results in one file compare to those in another, as the
+ * relative change in the time per iteration.
+ *
+ * @return  False if a file couldn't be read.
+ */
+bool Compare(const char* old_results, const char* new_results);
+
+} // namespace zeek::bench
+
+#define ZEEK_BENCHMARK(name) \
+	static void name(zeek::bench::State& state); \
+	static zeek::bench::Registration name##_registration(#name, name); \
+	static void name(zeek::bench::State& state)
@@ -0,0 +1,136 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Benchmarks of Dictionary and CompositeHash.
+
+#include "zeek-config.h"
+
+#include <vector>
+
+#include "zeek/Dict.h"
+#include "zeek/CompHash.h"
+#include "zeek/Hash.h"
+#include "zeek/Type.h"
+#include "zeek/Val.h"
+#include "zeek/bench/Bench.h"
+
+namespace zeek {
+
+static constexpr int num_keys = 10000;
+
+static std::vector<detail::HashKey*> make_keys()
+	{
+	std::vector<detail::HashKey*> keys;
+
+	for ( bro_int_t i = 0; i < num_keys; ++i )
+		keys.push_back(new detail::HashKey(i * 7919));
+
+	return keys;
+	}
+
+// Inserts a copy of the key, so that it can be reused.
+static void insert(PDict<int>* d, const detail::HashKey* k, int* v)
+	{
+	d->Dictionary::Insert(const_cast<void*>(k->Key()), k->Size(), k->Hash(), v, true);
+	}
+
+ZEEK_BENCHMARK(Dictionary_Insert)
+	{
+	auto keys = make_keys();
+	int v = 0;
+	state.SetItemsPerIteration(num_keys);
+
+	while ( state.KeepRunning() )
+		{
+		state.Pause();
+		PDict<int> d;
+		state.Resume();
+
+		for ( auto k : keys )
+			insert(&d, k, &v);
+
+		state.Pause();
+		}
+
+	for ( auto k : keys )
+		delete k;
+	}
+
+ZEEK_BENCHMARK(Dictionary_Lookup)
+	{
+	auto keys = make_keys();
+	int v = 0;
+	PDict<int> d;
+
+	for ( auto k : keys )
+		insert(&d, k, &v);
+
+	state.SetItemsPerIteration(num_keys);
+
+	while ( state.KeepRunning() )
+		for ( auto k : keys )
+			bench::DoNotOptimize(d.Lookup(k));
+
+	for ( auto k : keys )
+		delete k;
+	}
+
+ZEEK_BENCHMARK(Dictionary_Iterate)
+	{
+	auto keys = make_keys();
+	int v = 0;
+	PDict<int> d;
+
+	for ( auto k : keys )
+		insert(&d, k, &v);
+
+	state.SetItemsPerIteration(num_keys);
+
+	while ( state.KeepRunning() )
+		{
+		IterCookie* c = d.InitForIteration();
+
+		while ( int* e = d.NextEntry(c) )
+			bench::DoNotOptimize(e);
+		}
+
+	for ( auto k : keys )
+		delete k;
+	}
+
+// An index as for a table[addr, port, count].
+static ListValPtr make_index(uint32_t i)
+	{
+	auto idx = make_intrusive<ListVal>(TYPE_ANY);
+	idx->Append(make_intrusive<AddrVal>(htonl(0x0a000000 | i)));
+	idx->Append(val_mgr->Port(i % 65536, TRANSPORT_TCP));
+	idx->Append(val_mgr->Count(i));
+	return idx;
+	}
+
+ZEEK_BENCHMARK(CompositeHash_MakeHashKey)
+	{
+	auto tl = make_intrusive<TypeList>();
+	tl->Append(base_type(TYPE_ADDR));
+	tl->Append(base_type(TYPE_PORT));
+	tl->Append(base_type(TYPE_COUNT));
+	detail::CompositeHash ch(tl);
+	auto idx = make_index(42);
+
+	while ( state.KeepRunning() )
+		bench::DoNotOptimize(ch.MakeHashKey(*idx, true));
+	}
+
+ZEEK_BENCHMARK(CompositeHash_RecoverVals)
+	{
+	auto tl = make_intrusive<TypeList>();
+	tl->Append(base_type(TYPE_ADDR));
+	tl->Append(base_type(TYPE_PORT));
+	tl->Append(base_type(TYPE_COUNT));
+	detail::CompositeHash ch(tl);
+	auto k = ch.MakeHashKey(*make_index(42), true);
+
+	while ( state.KeepRunning() )
+		bench::DoNotOptimize(ch.RecoverVals(*k));
+	}
+
+} // namespace zeek
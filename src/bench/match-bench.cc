@@ -0,0 +1,94 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Benchmarks of regular expression matching and of prefix lookups.
+
+#include "zeek-config.h"
+
+#include <string>
+#include <vector>
+
+#include "zeek/RE.h"
+#include "zeek/IPAddr.h"
+#include "zeek/PrefixTable.h"
+#include "zeek/bench/Bench.h"
+
+namespace zeek {
+
+static const char* pattern = "(GET|POST|HEAD) /[^ ]*\\.(php|asp|cgi) HTTP/1\\.[01]";
+
+// A typical HTTP request line, which the pattern doesn't match.
+static const char* request_line =
+	"GET /images/logos/company-logo-large.png?version=3 HTTP/1.1";
+
+ZEEK_BENCHMARK(RE_Matcher_Compile)
+	{
+	while ( state.KeepRunning() )
+		{
+		RE_Matcher re(pattern);
+		bench::DoNotOptimize(re.Compile());
+		}
+	}
+
+ZEEK_BENCHMARK(RE_Matcher_MatchExactly)
+	{
+	RE_Matcher re(pattern);
+	re.Compile();
+
+	// Warm up the lazily built DFA states.
+	re.MatchExactly(request_line);
+
+	while ( state.KeepRunning() )
+		bench::DoNotOptimize(re.MatchExactly(request_line));
+	}
+
+ZEEK_BENCHMARK(RE_Matcher_MatchAnywhere)
+	{
+	RE_Matcher re(pattern);
+	re.Compile();
+	re.MatchAnywhere(request_line);
+
+	while ( state.KeepRunning() )
+		bench::DoNotOptimize(re.MatchAnywhere(request_line));
+	}
+
+static constexpr int num_prefixes = 10000;
+
+static IPAddr make_addr(uint32_t i)
+	{
+	uint32_t a = htonl(0x0a000000 | (i * 7919 & 0xffffff));
+	return IPAddr(IPv4, &a, IPAddr::Network);
+	}
+
+ZEEK_BENCHMARK(PrefixTable_Insert)
+	{
+	state.SetItemsPerIteration(num_prefixes);
+
+	while ( state.KeepRunning() )
+		{
+		detail::PrefixTable pt;
+
+		for ( int i = 0; i < num_prefixes; ++i )
+			pt.Insert(make_addr(i), 96 + 24 + i % 9);
+		}
+	}
+
+ZEEK_BENCHMARK(PrefixTable_Lookup)
+	{
+	detail::PrefixTable pt;
+
+	for ( int i = 0; i < num_prefixes; ++i )
+		pt.Insert(make_addr(i), 96 + 24 + i % 9);
+
+	std::vector<IPAddr> addrs;
+
+	for ( int i = 0; i < num_prefixes; ++i )
+		addrs.push_back(make_addr(i * 3));
+
+	state.SetItemsPerIteration(num_prefixes);
+
+	while ( state.KeepRunning() )
+		for ( const auto& a : addrs )
+			bench::DoNotOptimize(pt.Lookup(a, 128));
+	}
+
+} // namespace zeek
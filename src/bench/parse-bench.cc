@@ -0,0 +1,180 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Benchmarks of parsing and formatting: addresses, base64, and the ASCII
+// and JSON formatters that the logging and input frameworks use.
+
+#include "zeek-config.h"
+
+#include <string>
+#include <vector>
+
+#include "zeek/Base64.h"
+#include "zeek/Desc.h"
+#include "zeek/IPAddr.h"
+#include "zeek/ZeekString.h"
+#include "zeek/threading/SerialTypes.h"
+#include "zeek/threading/formatters/Ascii.h"
+#include "zeek/threading/formatters/JSON.h"
+#include "zeek/bench/Bench.h"
+
+namespace zeek {
+
+ZEEK_BENCHMARK(IPAddr_ParseIPv4)
+	{
+	std::string s = "192.168.134.27";
+
+	while ( state.KeepRunning() )
+		bench::DoNotOptimize(IPAddr(s));
+	}
+
+ZEEK_BENCHMARK(IPAddr_ParseIPv6)
+	{
+	std::string s = "2001:db8:85a3::8a2e:370:7334";
+
+	while ( state.KeepRunning() )
+		bench::DoNotOptimize(IPAddr(s));
+	}
+
+ZEEK_BENCHMARK(IPAddr_AsString)
+	{
+	IPAddr a("2001:db8:85a3::8a2e:370:7334");
+
+	while ( state.KeepRunning() )
+		bench::DoNotOptimize(a.AsString());
+	}
+
+static constexpr int base64_size = 4096;
+
+static String make_data()
+	{
+	std::vector<u_char> data(base64_size);
+
+	for ( int i = 0; i < base64_size; ++i )
+		data[i] = i * 7919;
+
+	return String(data.data(), data.size(), false);
+	}
+
+ZEEK_BENCHMARK(Base64_Encode)
+	{
+	String data = make_data();
+	state.SetItemsPerIteration(base64_size);
+
+	while ( state.KeepRunning() )
+		delete detail::encode_base64(&data);
+	}
+
+ZEEK_BENCHMARK(Base64_Decode)
+	{
+	String data = make_data();
+	String* encoded = detail::encode_base64(&data);
+	state.SetItemsPerIteration(base64_size);
+
+	while ( state.KeepRunning() )
+		delete detail::decode_base64(encoded);
+
+	delete encoded;
+	}
+
+using threading::Field;
+using threading::Value;
+using threading::formatter::Ascii;
+using threading::formatter::JSON;
+
+// A row like those of conn.log, as the text of its fields.
+struct Row {
+	const char* name;
+	TypeTag type;
+	TypeTag subtype;
+	const char* text;
+};
+
+static const Row row[] = {
+	{ "ts", TYPE_TIME, TYPE_ERROR, "1600000000.123456" },
+	{ "uid", TYPE_STRING, TYPE_ERROR, "CHhAvVGS1DHFjwGM9" },
+	{ "orig_h", TYPE_ADDR, TYPE_ERROR, "192.168.1.100" },
+	{ "orig_p", TYPE_PORT, TYPE_ERROR, "52806" },
+	{ "resp_h", TYPE_ADDR, TYPE_ERROR, "2001:db8::1" },
+	{ "resp_p", TYPE_PORT, TYPE_ERROR, "443" },
+	{ "duration", TYPE_INTERVAL, TYPE_ERROR, "1.482386" },
+	{ "orig_bytes", TYPE_COUNT, TYPE_ERROR, "2417" },
+	{ "resp_bytes", TYPE_COUNT, TYPE_ERROR, "48263" },
+	{ "local_orig", TYPE_BOOL, TYPE_ERROR, "T" },
+	{ "history", TYPE_STRING, TYPE_ERROR, "ShADadFf" },
+	{ "services", TYPE_TABLE, TYPE_STRING, "ssl,http" },
+};
+
+static constexpr int num_fields = sizeof(row) / sizeof(row[0]);
+
+static Ascii::SeparatorInfo separators()
+	{
+	return Ascii::SeparatorInfo("\t", ",", "-", "(empty)");
+	}
+
+// Owns the fields and values of a parsed row.
+struct ParsedRow {
+	ParsedRow()
+		{
+		Ascii ascii(nullptr, separators());
+
+		for ( const auto& f : row )
+			{
+			fields.push_back(new Field(f.name, nullptr, f.type, f.subtype, false));
+			vals.push_back(ascii.ParseValue(f.text, f.name, f.type, f.subtype));
+			}
+		}
+
+	~ParsedRow()
+		{
+		for ( auto f : fields )
+			delete f;
+
+		for ( auto v : vals )
+			delete v;
+		}
+
+	std::vector<Field*> fields;
+	std::vector<Value*> vals;
+};
+
+ZEEK_BENCHMARK(AsciiFormatter_ParseRow)
+	{
+	Ascii ascii(nullptr, separators());
+	state.SetItemsPerIteration(num_fields);
+
+	while ( state.KeepRunning() )
+		for ( const auto& f : row )
+			delete ascii.ParseValue(f.text, f.name, f.type, f.subtype);
+	}
+
+ZEEK_BENCHMARK(AsciiFormatter_DescribeRow)
+	{
+	Ascii ascii(nullptr, separators());
+	ParsedRow r;
+	state.SetItemsPerIteration(num_fields);
+
+	while ( state.KeepRunning() )
+		{
+		ODesc desc;
+		desc.SetStyle(RAW_STYLE);
+		ascii.Describe(&desc, num_fields, r.fields.data(), r.vals.data());
+		bench::DoNotOptimize(desc.Len());
+		}
+	}
+
+ZEEK_BENCHMARK(JSONFormatter_DescribeRow)
+	{
+	JSON json(nullptr, JSON::TS_EPOCH);
+	ParsedRow r;
+	state.SetItemsPerIteration(num_fields);
+
+	while ( state.KeepRunning() )
+		{
+		ODesc desc;
+		desc.SetStyle(RAW_STYLE);
+		json.Describe(&desc, num_fields, r.fields.data(), r.vals.data());
+		bench::DoNotOptimize(desc.Len());
+		}
+	}
+
+} // namespace zeek
@@ -0,0 +1,97 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Benchmarks of the timer priority queue and of the queues between threads.
+
+#include "zeek-config.h"
+
+#include <vector>
+
+#include "zeek/PriorityQueue.h"
+#include "zeek/util.h"
+#include "zeek/threading/Queue.h"
+#include "zeek/bench/Bench.h"
+
+namespace zeek {
+
+static constexpr int num_elements = 10000;
+
+// Timers get added in roughly increasing order, with some jitter; this
+// mimics that.
+static std::vector<detail::PQ_Element*> make_elements()
+	{
+	std::vector<detail::PQ_Element*> elements;
+
+	for ( int i = 0; i < num_elements; ++i )
+		elements.push_back(new detail::PQ_Element(i + (i * 7919 % 100) / 10.0));
+
+	return elements;
+	}
+
+ZEEK_BENCHMARK(PriorityQueue_AddRemove)
+	{
+	auto elements = make_elements();
+	detail::PriorityQueue q;
+	state.SetItemsPerIteration(num_elements);
+
+	while ( state.KeepRunning() )
+		{
+		for ( auto e : elements )
+			q.Add(e);
+
+		while ( q.Size() )
+			bench::DoNotOptimize(q.Remove());
+		}
+
+	for ( auto e : elements )
+		delete e;
+	}
+
+ZEEK_BENCHMARK(PriorityQueue_RemoveElement)
+	{
+	// Like timers getting canceled, as when connections end.
+	auto elements = make_elements();
+	detail::PriorityQueue q;
+	state.SetItemsPerIteration(num_elements);
+
+	while ( state.KeepRunning() )
+		{
+		for ( auto e : elements )
+			q.Add(e);
+
+		for ( auto e : elements )
+			bench::DoNotOptimize(q.Remove(e));
+		}
+
+	for ( auto e : elements )
+		delete e;
+	}
+
+static constexpr int batch_size = 1000;
+
+static void put_get(bench::State& state, size_t ring_size)
+	{
+	threading::Queue<int*> q(nullptr, nullptr, ring_size);
+	int v = 0;
+	state.SetItemsPerIteration(batch_size);
+
+	while ( state.KeepRunning() )
+		{
+		for ( int i = 0; i < batch_size; ++i )
+			q.Put(&v);
+
+		for ( int i = 0; i < batch_size; ++i )
+			bench::DoNotOptimize(q.Get());
+		}
+	}
+
+ZEEK_BENCHMARK(ThreadingQueue_PutGet)
+	{
+	put_get(state, 0);
+	}
+
+ZEEK_BENCHMARK(ThreadingQueue_PutGetRing)
+	{
+	put_get(state, batch_size);
+	}
+
+} // namespace zeek
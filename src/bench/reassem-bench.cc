@@ -0,0 +1,98 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Benchmarks of the reassembler's DataBlockList.
+
+#include "zeek-config.h"
+
+#include <vector>
+
+#include "zeek/Reassem.h"
+#include "zeek/bench/Bench.h"
+
+namespace zeek {
+
+// Delivers contiguous data right away and trims it, like the TCP and file
+// reassemblers, without doing anything with it.
+class BenchReassembler final : public Reassembler {
+public:
+	BenchReassembler() : Reassembler(0, REASSEM_FILE)	{ }
+
+private:
+	void BlockInserted(DataBlockMap::const_iterator it) override
+		{
+		while ( it != block_list.End() )
+			{
+			const auto& b = it->second;
+
+			if ( b.seq > last_reassem_seq )
+				break;
+
+			if ( b.upper > last_reassem_seq )
+				last_reassem_seq = b.upper;
+
+			++it;
+			}
+
+		TrimToSeq(last_reassem_seq);
+		}
+
+	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override
+		{
+		}
+};
+
+static constexpr uint64_t block_size = 1460;
+static constexpr int num_blocks = 1000;
+
+ZEEK_BENCHMARK(Reassembler_InOrder)
+	{
+	std::vector<u_char> data(block_size);
+	state.SetItemsPerIteration(num_blocks);
+
+	while ( state.KeepRunning() )
+		{
+		BenchReassembler r;
+
+		for ( int i = 0; i < num_blocks; ++i )
+			r.NewBlock(0.0, i * block_size, block_size, data.data());
+		}
+	}
+
+ZEEK_BENCHMARK(Reassembler_Swapped)
+	{
+	// Every other pair of blocks arrives swapped, so that half of the
+	// blocks get buffered while waiting for the hole to be filled.
+	std::vector<u_char> data(block_size);
+	state.SetItemsPerIteration(num_blocks);
+
+	while ( state.KeepRunning() )
+		{
+		BenchReassembler r;
+
+		for ( int i = 0; i < num_blocks; i += 2 )
+			{
+			r.NewBlock(0.0, (i + 1) * block_size, block_size, data.data());
+			r.NewBlock(0.0, i * block_size, block_size, data.data());
+			}
+		}
+	}
+
+ZEEK_BENCHMARK(Reassembler_LargeHole)
+	{
+	// The first block arrives last, so that everything else piles up in
+	// the block list.
+	std::vector<u_char> data(block_size);
+	state.SetItemsPerIteration(num_blocks);
+
+	while ( state.KeepRunning() )
+		{
+		BenchReassembler r;
+
+		for ( int i = 1; i < num_blocks; ++i )
+			r.NewBlock(0.0, i * block_size, block_size, data.data());
+
+		r.NewBlock(0.0, 0, block_size, data.data());
+		}
+	}
+
+} // namespace zeek
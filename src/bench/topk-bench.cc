@@ -0,0 +1,64 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Benchmarks of the top-k data structure.
+
+#include "zeek-config.h"
+
+#include <vector>
+
+#include "zeek/Val.h"
+#include "zeek/probabilistic/Topk.h"
+#include "zeek/bench/Bench.h"
+
+namespace zeek {
+
+static constexpr int num_items = 10000;
+
+// A skewed stream of observations over many more keys than get tracked,
+// as with SumStats top-k over high-cardinality keys.
+static std::vector<ValPtr> make_stream()
+	{
+	std::vector<ValPtr> vals;
+	uint32_t x = 1;
+
+	for ( int i = 0; i < num_items; ++i )
+		{
+		x = x * 1103515245 + 12345;
+		uint32_t r = (x >> 8) % 100000;
+		vals.emplace_back(val_mgr->Count(r % (1 + r % 1000)));
+		}
+
+	return vals;
+	}
+
+ZEEK_BENCHMARK(Topk_Encountered)
+	{
+	auto vals = make_stream();
+	state.SetItemsPerIteration(num_items);
+
+	while ( state.KeepRunning() )
+		{
+		auto t = make_intrusive<probabilistic::detail::TopkVal>(500);
+
+		for ( const auto& v : vals )
+			t->Encountered(v);
+		}
+	}
+
+ZEEK_BENCHMARK(Topk_Merge)
+	{
+	auto vals = make_stream();
+	auto t = make_intrusive<probabilistic::detail::TopkVal>(500);
+
+	for ( const auto& v : vals )
+		t->Encountered(v);
+
+	while ( state.KeepRunning() )
+		{
+		auto merged = make_intrusive<probabilistic::detail::TopkVal>(500);
+		merged->Merge(t.get());
+		merged->Merge(t.get(), true);
+		}
+	}
+
+} // namespace zeek
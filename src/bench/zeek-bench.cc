@@ -0,0 +1,99 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include <getopt.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "zeek/zeek-setup.h"
+#include "zeek/bench/Bench.h"
+
+static void usage(const char* prog)
+	{
+	fprintf(stderr, "usage: %s [-f <filter>] [-t <min secs>] [-o <results file>]\n", prog);
+	fprintf(stderr, "       %s -c <old results> <new results>\n", prog);
+	fprintf(stderr, "    -f <filter>   only run benchmarks whose name contains <filter>\n");
+	fprintf(stderr, "    -t <secs>     run each benchmark for at least <secs> (default 0.5)\n");
+	fprintf(stderr, "    -o <file>     write results to <file> rather than stdout\n");
+	fprintf(stderr, "    -c            compare two results files\n");
+	exit(1);
+	}
+
+int main(int argc, char** argv)
+	{
+	std::string filter;
+	double min_time = 0.5;
+	const char* out_file = nullptr;
+	bool compare = false;
+	int c;
+
+	while ( (c = getopt(argc, argv, "f:t:o:ch")) != -1 )
+		{
+		switch ( c ) {
+		case 'f':
+			filter = optarg;
+			break;
+
+		case 't':
+			min_time = atof(optarg);
+			break;
+
+		case 'o':
+			out_file = optarg;
+			break;
+
+		case 'c':
+			compare = true;
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+		}
+
+	if ( compare )
+		{
+		if ( argc - optind != 2 )
+			usage(argv[0]);
+
+		return zeek::bench::Compare(argv[optind], argv[optind + 1]) ? 0 : 1;
+		}
+
+	if ( optind != argc )
+		usage(argv[0]);
+
+	FILE* out = stdout;
+
+	if ( out_file && ! (out = fopen(out_file, "w")) )
+		{
+		fprintf(stderr, "cannot open %s: %s\n", out_file, strerror(errno));
+		return 1;
+		}
+
+	// Benchmarks use much of Zeek's global state, such as types, hash
+	// seeds and the reporter, so set that up as for a bare-mode run
+	// without scripts of its own.
+	zeek::Options options;
+	options.bare_mode = true;
+	options.deterministic_mode = true;
+
+	if ( zeek::detail::setup(1, argv, &options).code )
+		return 1;
+
+	int num = zeek::bench::Run(filter, min_time, out);
+
+	if ( out != stdout )
+		fclose(out);
+
+	zeek::detail::cleanup(false);
+
+	if ( num == 0 )
+		{
+		fprintf(stderr, "no benchmarks match '%s'\n", filter.c_str());
+		return 1;
+		}
+
+	return 0;
+	}
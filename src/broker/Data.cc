@@ -54,6 +54,7 @@ TEST_CASE("converting Zeek to Broker protocol constants")
 namespace zeek::Broker::detail {
 
 static bool data_type_check(const broker::data& d, Type* t);
+static ValPtr to_val(broker::data& d, Type* type);
 
 TransportProto to_zeek_port_proto(broker::port::protocol tp)
 	{
@@ -211,9 +212,10 @@ struct val_converter {
 		auto tt = type->AsTableType();
 		auto rval = make_intrusive<TableVal>(IntrusivePtr{NewRef{}, tt});
 
+		const auto& expected_index_types = tt->GetIndices()->GetTypes();
+
 		for ( auto& item : a )
 			{
-			const auto& expected_index_types = tt->GetIndices()->GetTypes();
 			broker::vector composite_key;
 			auto indices = caf::get_if<broker::vector>(&item);
 
@@ -246,8 +248,8 @@ struct val_converter {
 
 			for ( size_t i = 0; i < indices->size(); ++i )
 				{
-				auto index_val = data_to_val(move((*indices)[i]),
-				                             expected_index_types[i].get());
+				auto index_val = to_val((*indices)[i],
+				                        expected_index_types[i].get());
 
 				if ( ! index_val )
 					return nullptr;
@@ -270,9 +272,10 @@ struct val_converter {
 		auto tt = type->AsTableType();
 		auto rval = make_intrusive<TableVal>(IntrusivePtr{NewRef{}, tt});
 
+		const auto& expected_index_types = tt->GetIndices()->GetTypes();
+
 		for ( auto& item : a )
 			{
-			const auto& expected_index_types = tt->GetIndices()->GetTypes();
 			broker::vector composite_key;
 			auto indices = caf::get_if<broker::vector>(&item.first);
 
@@ -305,8 +308,8 @@ struct val_converter {
 
 			for ( size_t i = 0; i < indices->size(); ++i )
 				{
-				auto index_val = data_to_val(move((*indices)[i]),
-				                             expected_index_types[i].get());
+				auto index_val = to_val((*indices)[i],
+				                        expected_index_types[i].get());
 
 				if ( ! index_val )
 					return nullptr;
@@ -314,8 +317,7 @@ struct val_converter {
 				list_val->Append(std::move(index_val));
 				}
 
-			auto value_val = data_to_val(move(item.second),
-			                             tt->Yield().get());
+			auto value_val = to_val(item.second, tt->Yield().get());
 
 			if ( ! value_val )
 				return nullptr;
@@ -335,7 +337,7 @@ struct val_converter {
 
 			for ( auto& item : a )
 				{
-				auto item_val = data_to_val(move(item), vt->Yield().get());
+				auto item_val = to_val(item, vt->Yield().get());
 
 				if ( ! item_val )
 					return nullptr;
@@ -361,7 +363,7 @@ struct val_converter {
 			unsigned int pos = 0;
 			for ( auto& item : a )
 				{
-				auto item_val = data_to_val(move(item), pure ? lt->GetPureType().get() : types[pos].get());
+				auto item_val = to_val(item, pure ? lt->GetPureType().get() : types[pos].get());
 				pos++;
 
 				if ( ! item_val )
@@ -429,7 +431,7 @@ struct val_converter {
 					continue;
 					}
 
-				auto item_val = data_to_val(move(a[idx]), rt->GetFieldType(i).get());
+				auto item_val = to_val(a[idx], rt->GetFieldType(i).get());
 
 				if ( ! item_val )
 					return nullptr;
@@ -807,38 +809,154 @@ static bool data_type_check(const broker::data& d, Type* t)
 	return caf::visit(type_checker{t}, d);
 	}
 
-ValPtr data_to_val(broker::data d, Type* type)
+// Like data_to_val(), but takes the data by reference, so that elements of
+// containers don't get moved into parameters on the way down.  d may be
+// left moved from.
+static ValPtr to_val(broker::data& d, Type* type)
 	{
 	if ( type->Tag() == TYPE_ANY )
 		return make_data_val(move(d));
 
-	return caf::visit(val_converter{type}, std::move(d));
+	return caf::visit(val_converter{type}, d);
 	}
 
-broker::expected<broker::data> val_to_data(const Val* v)
+ValPtr data_to_val(broker::data d, Type* type)
+	{
+	return to_val(d, type);
+	}
+
+static ValPtr convert_generic(broker::data& d, Type* type)
+	{
+	return to_val(d, type);
+	}
+
+static ValPtr convert_bool(broker::data& d, Type*)
+	{
+	auto a = caf::get_if<bool>(&d);
+	return a ? val_mgr->Bool(*a) : nullptr;
+	}
+
+static ValPtr convert_count(broker::data& d, Type*)
+	{
+	auto a = caf::get_if<uint64_t>(&d);
+	return a ? val_mgr->Count(*a) : nullptr;
+	}
+
+static ValPtr convert_int(broker::data& d, Type*)
+	{
+	auto a = caf::get_if<int64_t>(&d);
+	return a ? val_mgr->Int(*a) : nullptr;
+	}
+
+static ValPtr convert_double(broker::data& d, Type*)
+	{
+	auto a = caf::get_if<double>(&d);
+	return a ? make_intrusive<DoubleVal>(*a) : nullptr;
+	}
+
+static ValPtr convert_string(broker::data& d, Type*)
+	{
+	auto a = caf::get_if<std::string>(&d);
+	return a ? make_intrusive<StringVal>(a->size(), a->data()) : nullptr;
+	}
+
+static ValPtr convert_addr(broker::data& d, Type*)
+	{
+	auto a = caf::get_if<broker::address>(&d);
+
+	if ( ! a )
+		return nullptr;
+
+	auto bits = reinterpret_cast<const in6_addr*>(&a->bytes());
+	return make_intrusive<AddrVal>(IPAddr(*bits));
+	}
+
+static ValPtr convert_port(broker::data& d, Type*)
+	{
+	auto a = caf::get_if<broker::port>(&d);
+	return a ? val_mgr->Port(a->number(), to_zeek_port_proto(a->type())) : nullptr;
+	}
+
+static ValPtr convert_time(broker::data& d, Type*)
+	{
+	auto a = caf::get_if<broker::timestamp>(&d);
+
+	if ( ! a )
+		return nullptr;
+
+	using namespace std::chrono;
+	auto s = duration_cast<broker::fractional_seconds>(a->time_since_epoch());
+	return make_intrusive<TimeVal>(s.count());
+	}
+
+static ValPtr convert_interval(broker::data& d, Type*)
+	{
+	auto a = caf::get_if<broker::timespan>(&d);
+
+	if ( ! a )
+		return nullptr;
+
+	using namespace std::chrono;
+	auto s = duration_cast<broker::fractional_seconds>(*a);
+	return make_intrusive<IntervalVal>(s.count());
+	}
+
+DataConverter data_converter(const Type* type)
+	{
+	switch ( type->Tag() ) {
+	case TYPE_BOOL:
+		return convert_bool;
+	case TYPE_COUNT:
+		return convert_count;
+	case TYPE_INT:
+		return convert_int;
+	case TYPE_DOUBLE:
+		return convert_double;
+	case TYPE_STRING:
+		return convert_string;
+	case TYPE_ADDR:
+		return convert_addr;
+	case TYPE_PORT:
+		return convert_port;
+	case TYPE_TIME:
+		return convert_time;
+	case TYPE_INTERVAL:
+		return convert_interval;
+	default:
+		return convert_generic;
+	}
+	}
+
+// Converts v into rval, which is expected to be nil.  Containers get built
+// in place, so that their elements don't go through temporaries.
+static bool to_data(const Val* v, broker::data& rval)
 	{
 	switch ( v->GetType()->Tag() ) {
 	case TYPE_BOOL:
-		return {v->AsBool()};
+		rval = v->AsBool();
+		return true;
 	case TYPE_INT:
-		return {v->AsInt()};
+		rval = v->AsInt();
+		return true;
 	case TYPE_COUNT:
-		return {v->AsCount()};
+		rval = v->AsCount();
+		return true;
 	case TYPE_PORT:
 		{
 		auto p = v->AsPortVal();
-		return {broker::port(p->Port(), to_broker_port_proto(p->PortType()))};
+		rval = broker::port(p->Port(), to_broker_port_proto(p->PortType()));
+		return true;
 		}
 	case TYPE_ADDR:
 		{
 		auto a = v->AsAddr();
 		in6_addr tmp;
 		a.CopyIPv6(&tmp);
-		return {broker::address(reinterpret_cast<const uint32_t*>(&tmp),
-			                    broker::address::family::ipv6,
-			                    broker::address::byte_order::network)};
+		rval = broker::address(reinterpret_cast<const uint32_t*>(&tmp),
+		                       broker::address::family::ipv6,
+		                       broker::address::byte_order::network);
+		return true;
 		}
-		break;
 	case TYPE_SUBNET:
 		{
 		auto s = v->AsSubNet();
@@ -847,42 +965,48 @@ broker::expected<broker::data> val_to_data(const Val* v)
 		auto a = broker::address(reinterpret_cast<const uint32_t*>(&tmp),
 		                         broker::address::family::ipv6,
 		                         broker::address::byte_order::network);
-		return {broker::subnet(std::move(a), s.Length())};
+		rval = broker::subnet(std::move(a), s.Length());
+		return true;
 		}
-		break;
 	case TYPE_DOUBLE:
-		return {v->AsDouble()};
+		rval = v->AsDouble();
+		return true;
 	case TYPE_TIME:
 		{
 		auto secs = broker::fractional_seconds{v->AsTime()};
 		auto since_epoch = std::chrono::duration_cast<broker::timespan>(secs);
-		return {broker::timestamp{since_epoch}};
+		rval = broker::timestamp{since_epoch};
+		return true;
 		}
 	case TYPE_INTERVAL:
 		{
 		auto secs = broker::fractional_seconds{v->AsInterval()};
-		return {std::chrono::duration_cast<broker::timespan>(secs)};
+		rval = std::chrono::duration_cast<broker::timespan>(secs);
+		return true;
 		}
 	case TYPE_ENUM:
 		{
 		auto enum_type = v->GetType()->AsEnumType();
 		auto enum_name = enum_type->Lookup(v->AsEnum());
-		return {broker::enum_value(enum_name ? enum_name : "<unknown enum>")};
+		rval = broker::enum_value(enum_name ? enum_name : "<unknown enum>");
+		return true;
 		}
 	case TYPE_STRING:
 		{
 		auto s = v->AsString();
-		return {string(reinterpret_cast<const char*>(s->Bytes()), s->Len())};
+		rval = string(reinterpret_cast<const char*>(s->Bytes()), s->Len());
+		return true;
 		}
 	case TYPE_FILE:
-		return {string(v->AsFile()->Name())};
+		rval = string(v->AsFile()->Name());
+		return true;
 	case TYPE_FUNC:
 		{
 		const Func* f = v->AsFunc();
 		std::string name(f->Name());
 
-		broker::vector rval;
-		rval.push_back(name);
+		broker::vector vec;
+		vec.push_back(name);
 
 		if ( name.find("lambda_<") == 0 )
 			{
@@ -891,31 +1015,34 @@ broker::expected<broker::data> val_to_data(const Val* v)
 				{
 				auto bc = b->SerializeClosure();
 				if ( ! bc )
-					return broker::ec::invalid_data;
+					return false;
 
-				rval.emplace_back(std::move(*bc));
+				vec.emplace_back(std::move(*bc));
 				}
 			else
 				{
 				reporter->InternalWarning("Closure with non-ScriptFunc");
-				return broker::ec::invalid_data;
+				return false;
 				}
 			}
 
-		return {std::move(rval)};
+		rval = std::move(vec);
+		return true;
 		}
 	case TYPE_TABLE:
 		{
 		auto is_set = v->GetType()->IsSet();
 		auto table = v->AsTable();
 		auto table_val = v->AsTableVal();
-		broker::data rval;
 
 		if ( is_set )
 			rval = broker::set();
 		else
 			rval = broker::table();
 
+		auto set = caf::get_if<broker::set>(&rval);
+		auto tbl = caf::get_if<broker::table>(&rval);
+
 		zeek::detail::HashKey* hk;
 		TableEntryVal* entry;
 		auto c = table->InitForIteration();
@@ -925,46 +1052,45 @@ broker::expected<broker::data> val_to_data(const Val* v)
 			auto vl = table_val->RecreateIndex(*hk);
 			delete hk;
 
-			broker::vector composite_key;
-			composite_key.reserve(vl->Length());
+			broker::data key;
 
-			for ( auto k = 0; k < vl->Length(); ++k )
+			if ( vl->Length() == 1 )
 				{
-				auto key_part = val_to_data(vl->Idx(k).get());
-
-				if ( ! key_part )
-					return broker::ec::invalid_data;
-
-				composite_key.emplace_back(move(*key_part));
+				if ( ! to_data(vl->Idx(0).get(), key) )
+					return false;
 				}
+			else
+				{
+				broker::vector composite_key(vl->Length());
 
-			broker::data key;
+				for ( auto k = 0; k < vl->Length(); ++k )
+					if ( ! to_data(vl->Idx(k).get(), composite_key[k]) )
+						return false;
 
-			if ( composite_key.size() == 1 )
-				key = move(composite_key[0]);
-			else
 				key = move(composite_key);
+				}
 
 			if ( is_set )
-				caf::get<broker::set>(rval).emplace(move(key));
+				set->emplace(move(key));
 			else
 				{
-				auto val = val_to_data(entry->GetVal().get());
+				broker::data val;
 
-				if ( ! val )
-					return broker::ec::invalid_data;
+				if ( ! to_data(entry->GetVal().get(), val) )
+					return false;
 
-				caf::get<broker::table>(rval).emplace(move(key), move(*val));
+				tbl->emplace(move(key), move(val));
 				}
 			}
 
-		return {std::move(rval)};
+		return true;
 		}
 	case TYPE_VECTOR:
 		{
 		auto vec = v->AsVectorVal();
-		broker::vector rval;
-		rval.reserve(vec->Size());
+		rval = broker::vector();
+		auto& items = caf::get<broker::vector>(rval);
+		items.reserve(vec->Size());
 
 		for ( auto i = 0u; i < vec->Size(); ++i )
 			{
@@ -973,23 +1099,22 @@ broker::expected<broker::data> val_to_data(const Val* v)
 			if ( ! item_val )
 				continue;
 
-			auto item = val_to_data(item_val.get());
+			items.emplace_back();
 
-			if ( ! item )
-				return broker::ec::invalid_data;
-
-			rval.emplace_back(move(*item));
+			if ( ! to_data(item_val.get(), items.back()) )
+				return false;
 			}
 
-		return {std::move(rval)};
+		return true;
 		}
 	case TYPE_LIST:
 		{
 		// We don't really support lists on the broker side.
 		// So we just pretend that it is a vector instead.
 		auto list = v->AsListVal();
-		broker::vector rval;
-		rval.reserve(list->Length());
+		rval = broker::vector();
+		auto& items = caf::get<broker::vector>(rval);
+		items.reserve(list->Length());
 
 		for ( auto i = 0; i < list->Length(); ++i )
 			{
@@ -998,48 +1123,49 @@ broker::expected<broker::data> val_to_data(const Val* v)
 			if ( ! item_val )
 				continue;
 
-			auto item = val_to_data(item_val.get());
+			items.emplace_back();
 
-			if ( ! item )
-				return broker::ec::invalid_data;
-
-			rval.emplace_back(move(*item));
+			if ( ! to_data(item_val.get(), items.back()) )
+				return false;
 			}
 
-		return {std::move(rval)};
+		return true;
 		}
 	case TYPE_RECORD:
 		{
 		auto rec = v->AsRecordVal();
-		broker::vector rval;
 		size_t num_fields = v->GetType()->AsRecordType()->NumFields();
-		rval.reserve(num_fields);
+
+		// Fields left unset come out as nil.
+		rval = broker::vector(num_fields);
+		auto& fields = caf::get<broker::vector>(rval);
 
 		for ( size_t i = 0; i < num_fields; ++i )
 			{
-			auto item_val = rec->GetFieldOrDefault(i);
+			const auto& field = rec->GetField(i);
 
-			if ( ! item_val )
+			if ( field )
 				{
-				rval.emplace_back(broker::nil);
+				if ( ! to_data(field.get(), fields[i]) )
+					return false;
+
 				continue;
 				}
 
-			auto item = val_to_data(item_val.get());
-
-			if ( ! item )
-				return broker::ec::invalid_data;
+			// Only unset fields need a look at their defaults.
+			auto item_val = rec->GetFieldOrDefault(i);
 
-			rval.emplace_back(move(*item));
+			if ( item_val && ! to_data(item_val.get(), fields[i]) )
+				return false;
 			}
 
-		return {std::move(rval)};
+		return true;
 		}
 	case TYPE_PATTERN:
 		{
 		const RE_Matcher* p = v->AsPattern();
-		broker::vector rval = {p->PatternText(), p->AnywherePatternText()};
-		return {std::move(rval)};
+		rval = broker::vector{p->PatternText(), p->AnywherePatternText()};
+		return true;
 		}
 	case TYPE_OPAQUE:
 		{
@@ -1047,18 +1173,27 @@ broker::expected<broker::data> val_to_data(const Val* v)
 		if ( ! c )
 			{
 			reporter->Error("unsupported opaque type for serialization");
-			break;
+			return false;
 			}
 
-		return {c};
+		rval = std::move(*c);
+		return true;
 		}
 	default:
 		reporter->Error("unsupported Broker::Data type: %s",
 		                type_name(v->GetType()->Tag()));
-		break;
+		return false;
 	}
+	}
+
+broker::expected<broker::data> val_to_data(const Val* v)
+	{
+	broker::data rval;
+
+	if ( ! to_data(v, rval) )
+		return broker::ec::invalid_data;
 
-	return broker::ec::invalid_data;
+	return {std::move(rval)};
 	}
 
 RecordValPtr make_data_val(Val* v)
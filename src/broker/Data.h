@@ -67,6 +67,25 @@ broker::expected<broker::data> val_to_data(const Val* v);
  */
 ValPtr data_to_val(broker::data d, Type* type);
 
+/**
+ * A conversion of Broker data into a Zeek value of a particular type, for
+ * data that keeps arriving with the same expected type, such as the
+ * arguments of remote events.
+ * @param d the Broker value, possibly left moved from.
+ * @param type the expected type of the value to return.
+ * @return a pointer to a new Zeek value or a nullptr if the conversion was
+ * not possible.
+ */
+using DataConverter = ValPtr (*)(broker::data& d, Type* type);
+
+/**
+ * Picks the conversion of Broker data into values of a type.  Atomic types
+ * get converted directly, and all others like data_to_val() does.
+ * @param type the expected type of the values.
+ * @return the conversion.
+ */
+DataConverter data_converter(const Type* type);
+
 /**
  * Convert a zeek::threading::Field to a Broker data value.
  * @param f a zeek::threading::Field.
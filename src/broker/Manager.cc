@@ -1,5 +1,9 @@
 #include "zeek/broker/Manager.h"
 
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <unistd.h>
@@ -7,12 +11,19 @@
 #include <broker/broker.hh>
 #include <broker/zeek.hh>
 
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+
 #include "zeek/Func.h"
 #include "zeek/broker/Data.h"
+#include "zeek/broker/ShmRing.h"
 #include "zeek/broker/Store.h"
 #include "zeek/util.h"
 #include "zeek/Var.h"
 #include "zeek/Desc.h"
+#include "zeek/Dict.h"
+#include "zeek/MemoryArenas.h"
 #include "zeek/Reporter.h"
 #include "zeek/IntrusivePtr.h"
 #include "zeek/logging/Manager.h"
@@ -71,6 +82,37 @@ const broker::endpoint_info Manager::NoPeer{{}, {}};
 
 int Manager::script_scope = 0;
 
+// How often to check for room in the publisher buffers of topics whose
+// send queue has messages waiting.
+constexpr double topic_queue_poll_interval = 0.001;
+
+// How often to look for new rings in the shared memory inboxes, and for a
+// listener on topics that had none.
+constexpr double shm_scan_interval = 1.0;
+
+// How long a log batch from shared memory waits for Broker to deliver the
+// creation of its writer, and how often it checks in the meantime.
+constexpr double shm_writer_wait = 10.0;
+constexpr double shm_writer_poll_interval = 0.01;
+
+// Turns a topic into the name of its inbox directory.
+static std::string shm_inbox_name(const std::string& topic)
+	{
+	std::string rval;
+
+	for ( auto c : topic )
+		{
+		if ( c == '/' )
+			rval += "%2F";
+		else if ( c == '%' )
+			rval += "%25";
+		else
+			rval += c;
+		}
+
+	return rval;
+	}
+
 struct scoped_reporter_location {
 	scoped_reporter_location(zeek::detail::Frame* frame)
 		{
@@ -136,6 +178,9 @@ Manager::Manager(bool arg_use_real_time)
 	use_real_time = arg_use_real_time;
 	peer_count = 0;
 	log_batch_size = 0;
+	log_batch_compression = false;
+	event_batch_size = 0;
+	event_batch_interval = 0;
 	log_topic_func = nullptr;
 	log_id_type = nullptr;
 	writer_id_type = nullptr;
@@ -150,6 +195,9 @@ void Manager::InitPostScript()
 	DBG_LOG(DBG_BROKER, "Initializing");
 
 	log_batch_size = get_option("Broker::log_batch_size")->AsCount();
+	log_batch_compression = get_option("Broker::log_batch_compression")->AsBool();
+	event_batch_size = get_option("Broker::event_batch_size")->AsCount();
+	event_batch_interval = get_option("Broker::event_batch_interval")->AsInterval();
 	default_log_topic_prefix =
 	    get_option("Broker::default_log_topic_prefix")->AsString()->CheckString();
 	log_topic_func = get_option("Broker::log_topic")->AsFunc();
@@ -157,6 +205,46 @@ void Manager::InitPostScript()
 	writer_id_type = id::find_type("Log::Writer")->AsEnumType();
 	zeek_table_manager = get_option("Broker::table_store_master")->AsBool();
 	zeek_table_db_directory = get_option("Broker::table_store_db_directory")->AsString()->CheckString();
+	zeek_table_import_chunk_size = get_option("Broker::table_store_import_chunk_size")->AsCount();
+	shm_dir = get_option("Broker::shm_dir")->AsString()->CheckString();
+	shm_name = get_option("Broker::shm_name")->AsString()->CheckString();
+	shm_ring_size = get_option("Broker::shm_ring_size")->AsCount();
+
+	auto policies = get_option("Broker::topic_queue_policies")->AsTableVal();
+	auto policies_tbl = policies->AsTable();
+	IterCookie* c = policies_tbl->InitForIteration();
+	zeek::detail::HashKey* k;
+	TableEntryVal* v;
+
+	while ( (v = policies_tbl->NextEntry(k, c)) )
+		{
+		auto index = policies->RecreateIndex(*k);
+		delete k;
+
+		auto qp = v->GetVal()->AsRecordVal();
+		QueuePolicy p;
+		p.prefix = index->Idx(0)->AsString()->CheckString();
+		p.max_queued = qp->GetFieldOrDefault("max_queued")->AsCount();
+		p.threshold = qp->GetFieldOrDefault("threshold")->AsCount();
+
+		switch ( qp->GetFieldOrDefault("overflow")->AsEnum() ) {
+		case BifEnum::Broker::QUEUE_DROP_OLDEST:
+			p.overflow = QueueOverflow::DropOldest;
+			break;
+		case BifEnum::Broker::QUEUE_DROP_NEWEST:
+			p.overflow = QueueOverflow::DropNewest;
+			break;
+		default:
+			p.overflow = QueueOverflow::Block;
+			break;
+		}
+
+		queue_policies.push_back(std::move(p));
+		}
+
+	std::sort(queue_policies.begin(), queue_policies.end(),
+	          [](const QueuePolicy& a, const QueuePolicy& b)
+	          { return a.prefix.size() > b.prefix.size(); });
 
 	detail::opaque_of_data_type = make_intrusive<OpaqueType>("Broker::Data");
 	detail::opaque_of_set_iterator = make_intrusive<OpaqueType>("Broker::SetIterator");
@@ -268,10 +356,34 @@ void Manager::InitializeBrokerStoreForwarding()
 
 void Manager::Terminate()
 	{
+	FlushEventBuffers();
 	FlushLogBuffers();
 
+	for ( auto& tq : topic_queues )
+		if ( tq.second )
+			DrainTopicQueue(tq.first, *tq.second,
+			                tq.second->policy.overflow == QueueOverflow::Block);
+
 	iosource_mgr->UnregisterFd(bstate->subscriber.fd(), this);
 
+	// Batches left in the rings stay there for the next process listening
+	// on the topic, while senders switch to Broker.
+	for ( auto& inbox : shm_inboxes )
+		{
+		iosource_mgr->UnregisterFd(inbox.fifo, this);
+		unlink((inbox.dir + "/wakeup").c_str());
+		close(inbox.fifo);
+		close(inbox.fifo_writer);
+		}
+
+	shm_inboxes.clear();
+
+	for ( auto& out : shm_outboxes )
+		if ( out.second.fifo >= 0 )
+			close(out.second.fifo);
+
+	shm_outboxes.clear();
+
 	vector<string> stores_to_close;
 
 	for ( auto& x : data_stores )
@@ -395,6 +507,7 @@ void Manager::Unpeer(const string& addr, uint16_t port)
 	DBG_LOG(DBG_BROKER, "Stopping to peer with %s:%" PRIu16,
 	        addr.c_str(), port);
 
+	FlushEventBuffers();
 	FlushLogBuffers();
 	bstate->endpoint.unpeer_nosync(addr, port);
 	}
@@ -420,14 +533,276 @@ bool Manager::PublishEvent(string topic, std::string name, broker::vector args)
 	if ( peer_count == 0 )
 		return true;
 
-	DBG_LOG(DBG_BROKER, "Publishing event: %s",
+	if ( event_batch_size <= 1 )
+		{
+		DBG_LOG(DBG_BROKER, "Publishing event: %s",
+			RenderEvent(topic, name, args).c_str());
+		broker::zeek::Event ev(std::move(name), std::move(args));
+		Publish(move(topic), ev.move_data());
+		++statistics.num_events_outgoing;
+		return true;
+		}
+
+	DBG_LOG(DBG_BROKER, "Buffering event: %s",
 		RenderEvent(topic, name, args).c_str());
 	broker::zeek::Event ev(std::move(name), std::move(args));
-	bstate->endpoint.publish(move(topic), ev.move_data());
-	++statistics.num_events_outgoing;
+
+	auto& eb = event_buffers[topic];
+	double now = util::current_time();
+
+	if ( eb.msgs.empty() )
+		{
+		eb.msgs.reserve(event_batch_size);
+		eb.first_time = now;
+		}
+
+	eb.msgs.emplace_back(ev.move_data());
+
+	if ( eb.msgs.size() >= event_batch_size ||
+	     now - eb.first_time >= event_batch_interval )
+		{
+		FlushEventBuffer(topic, eb);
+		event_buffers.erase(topic);
+		}
+
 	return true;
 	}
 
+size_t Manager::FlushEventBuffer(const std::string& topic, EventBuffer& eb)
+	{
+	auto n = eb.msgs.size();
+
+	if ( ! n || bstate->endpoint.is_shutdown() )
+		return 0;
+
+	if ( n == 1 )
+		// Not worth the wrapping.
+		Publish(topic, std::move(eb.msgs[0]));
+	else
+		{
+		broker::zeek::Batch msg(std::move(eb.msgs));
+		Publish(topic, msg.move_data());
+		}
+
+	eb.msgs.clear();
+
+	size_t bucket = 0;
+
+	for ( auto i = n; i > 1; i >>= 1 )
+		++bucket;
+
+	if ( statistics.event_batch_sizes.size() <= bucket )
+		statistics.event_batch_sizes.resize(bucket + 1);
+
+	++statistics.event_batch_sizes[bucket];
+	++statistics.num_event_batches_outgoing;
+	statistics.num_events_outgoing += n;
+	return n;
+	}
+
+size_t Manager::FlushEventBuffers(bool expired_only)
+	{
+	if ( event_buffers.empty() )
+		return 0;
+
+	double now = util::current_time();
+	size_t rval = 0;
+
+	for ( auto it = event_buffers.begin(); it != event_buffers.end(); )
+		{
+		if ( expired_only && now - it->second.first_time < event_batch_interval )
+			{
+			++it;
+			continue;
+			}
+
+		rval += FlushEventBuffer(it->first, it->second);
+		it = event_buffers.erase(it);
+		}
+
+	return rval;
+	}
+
+double Manager::GetNextTimeout()
+	{
+	if ( ! store_imports.empty() )
+		// Keep importing.
+		return 0;
+
+	double timeout = -1;
+
+	for ( const auto& tq : topic_queues )
+		if ( tq.second && ! tq.second->pending.empty() )
+			{
+			// Check back soon for room in the publisher's buffer.
+			timeout = topic_queue_poll_interval;
+			break;
+			}
+
+	if ( ! shm_inboxes.empty() )
+		{
+		double now = util::current_time();
+
+		for ( const auto& inbox : shm_inboxes )
+			{
+			double t = std::max(0.0, inbox.next_scan - now);
+
+			for ( const auto& r : inbox.rings )
+				if ( r.second.stalled_since )
+					t = std::min(t, shm_writer_poll_interval);
+
+			if ( timeout < 0 || t < timeout )
+				timeout = t;
+			}
+		}
+
+	if ( event_buffers.empty() )
+		return timeout;
+
+	double first = -1;
+
+	for ( const auto& kv : event_buffers )
+		if ( first < 0 || kv.second.first_time < first )
+			first = kv.second.first_time;
+
+	auto rval = std::max(0.0, first + event_batch_interval - util::current_time());
+	return timeout < 0 ? rval : std::min(rval, timeout);
+	}
+
+void Manager::Publish(std::string topic, broker::data msg)
+	{
+	auto q = GetTopicQueue(topic);
+
+	if ( ! q )
+		{
+		bstate->endpoint.publish(std::move(topic), std::move(msg));
+		return;
+		}
+
+	DrainTopicQueue(topic, *q);
+
+	if ( q->pending.empty() && q->publisher.free_capacity() > 0 )
+		q->publisher.publish(std::move(msg));
+
+	else if ( q->pending.size() < q->policy.max_queued )
+		q->pending.push_back(std::move(msg));
+
+	else
+		{
+		switch ( q->policy.overflow ) {
+		case QueueOverflow::Block:
+			// Waits for the publisher to take the oldest message.
+			++q->blocked;
+
+			if ( q->pending.empty() )
+				q->publisher.publish(std::move(msg));
+			else
+				{
+				q->publisher.publish(std::move(q->pending.front()));
+				q->pending.pop_front();
+				q->pending.push_back(std::move(msg));
+				}
+			break;
+
+		case QueueOverflow::DropOldest:
+			++q->dropped;
+
+			if ( ! q->pending.empty() )
+				{
+				q->pending.pop_front();
+				q->pending.push_back(std::move(msg));
+				}
+			break;
+
+		case QueueOverflow::DropNewest:
+			++q->dropped;
+			break;
+		}
+		}
+
+	CheckTopicQueueThreshold(topic, *q);
+	}
+
+Manager::TopicQueue* Manager::GetTopicQueue(const std::string& topic)
+	{
+	if ( queue_policies.empty() )
+		return nullptr;
+
+	auto it = topic_queues.find(topic);
+
+	if ( it != topic_queues.end() )
+		return it->second.get();
+
+	std::unique_ptr<TopicQueue> q;
+
+	for ( const auto& p : queue_policies )
+		if ( topic.compare(0, p.prefix.size(), p.prefix) == 0 )
+			{
+			q = std::make_unique<TopicQueue>(bstate->endpoint.make_publisher(topic), p);
+			break;
+			}
+
+	auto rval = q.get();
+	topic_queues.emplace(topic, std::move(q));
+	return rval;
+	}
+
+void Manager::DrainTopicQueue(const std::string& topic, TopicQueue& q, bool block)
+	{
+	auto n = q.pending.size();
+
+	while ( ! q.pending.empty() && (block || q.publisher.free_capacity() > 0) )
+		{
+		q.publisher.publish(std::move(q.pending.front()));
+		q.pending.pop_front();
+		}
+
+	if ( q.pending.size() != n )
+		CheckTopicQueueThreshold(topic, q);
+	}
+
+void Manager::CheckTopicQueueThreshold(const std::string& topic, TopicQueue& q)
+	{
+	auto threshold = q.policy.threshold;
+
+	if ( ! threshold || ! ::Broker::send_queue_threshold_crossed )
+		return;
+
+	auto depth = q.pending.size() + q.publisher.buffered();
+
+	// Going back below the threshold takes draining to half of it, so
+	// that a queue hovering around it doesn't flood the event queue.
+	if ( q.above_threshold ? depth > threshold / 2 : depth < threshold )
+		return;
+
+	q.above_threshold = ! q.above_threshold;
+	event_mgr.Enqueue(::Broker::send_queue_threshold_crossed,
+	                  make_intrusive<StringVal>(topic),
+	                  val_mgr->Count(depth),
+	                  val_mgr->Bool(q.above_threshold));
+	}
+
+std::unordered_map<std::string, TopicQueueStats> Manager::GetTopicQueueStats() const
+	{
+	std::unordered_map<std::string, TopicQueueStats> rval;
+
+	for ( const auto& tq : topic_queues )
+		{
+		if ( ! tq.second )
+			continue;
+
+		const auto& q = *tq.second;
+		auto& s = rval[tq.first];
+		s.queued = q.pending.size();
+		s.buffered = q.publisher.buffered();
+		s.capacity = q.publisher.capacity();
+		s.dropped = q.dropped;
+		s.blocked = q.blocked;
+		}
+
+	return rval;
+	}
+
 bool Manager::PublishEvent(string topic, RecordVal* args)
 	{
 	if ( bstate->endpoint.is_shutdown() )
@@ -454,6 +829,372 @@ bool Manager::PublishEvent(string topic, RecordVal* args)
 	return PublishEvent(std::move(topic), event_name, std::move(xs));
 	}
 
+bool Manager::ShmListen(const std::string& topic)
+	{
+	if ( shm_dir.empty() )
+		{
+		reporter->Error("Broker::shm_listen needs Broker::shm_dir");
+		return false;
+		}
+
+	auto dir = shm_dir + "/" + shm_inbox_name(topic);
+
+	for ( const auto& inbox : shm_inboxes )
+		if ( inbox.dir == dir )
+			return true;
+
+	if ( ! util::detail::ensure_intermediate_dirs(dir.c_str()) )
+		return false;
+
+	// A FIFO left behind by a previous process may still be open in
+	// senders that haven't noticed it's gone.
+	auto fifo = dir + "/wakeup";
+	unlink(fifo.c_str());
+
+	if ( mkfifo(fifo.c_str(), 0600) < 0 )
+		{
+		reporter->Error("cannot create %s: %s", fifo.c_str(), strerror(errno));
+		return false;
+		}
+
+	ShmInbox inbox;
+	inbox.dir = dir;
+	inbox.fifo = open(fifo.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+	if ( inbox.fifo >= 0 )
+		inbox.fifo_writer = open(fifo.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+
+	if ( inbox.fifo_writer < 0 || ! iosource_mgr->RegisterFd(inbox.fifo, this) )
+		{
+		reporter->Error("cannot open %s: %s", fifo.c_str(), strerror(errno));
+
+		if ( inbox.fifo >= 0 )
+			close(inbox.fifo);
+
+		if ( inbox.fifo_writer >= 0 )
+			close(inbox.fifo_writer);
+
+		unlink(fifo.c_str());
+		return false;
+		}
+
+	DBG_LOG(DBG_BROKER, "Listening for log batches on topic %s in %s",
+	        topic.c_str(), dir.c_str());
+	ScanShmInbox(inbox);
+	shm_inboxes.emplace_back(std::move(inbox));
+	return true;
+	}
+
+void Manager::ScanShmInbox(ShmInbox& inbox)
+	{
+	inbox.next_scan = util::current_time() + shm_scan_interval;
+
+	auto d = opendir(inbox.dir.c_str());
+
+	if ( ! d )
+		return;
+
+	while ( auto e = readdir(d) )
+		{
+		std::string name = e->d_name;
+
+		if ( name.size() <= 5 || name.compare(name.size() - 5, 5, ".ring") != 0 ||
+		     inbox.rings.count(name) )
+			continue;
+
+		std::string error;
+		auto ring = detail::ShmRing::Open(inbox.dir + "/" + name, &error);
+
+		// Rings that can't be used stay in the map, so the warning comes
+		// only once.
+		if ( ! ring )
+			reporter->Warning("ignoring log batch ring: %s", error.c_str());
+
+		inbox.rings[name].ring = std::move(ring);
+		}
+
+	closedir(d);
+	}
+
+void Manager::ProcessShmInboxes()
+	{
+	double now = util::current_time();
+
+	for ( auto& inbox : shm_inboxes )
+		{
+		char buf[4096];
+
+		while ( read(inbox.fifo, buf, sizeof(buf)) > 0 )
+			;
+
+		if ( now >= inbox.next_scan )
+			ScanShmInbox(inbox);
+
+		for ( auto& r : inbox.rings )
+			{
+			auto& in = r.second;
+
+			if ( ! in.ring )
+				continue;
+
+			std::string_view header, data;
+
+			while ( in.ring->Read(&header, &data) )
+				{
+				// The header holds the stream, writer and path,
+				// separated by NULs.
+				auto s = header.find('\0');
+				auto w = s == std::string_view::npos ? s : header.find('\0', s + 1);
+
+				if ( w == std::string_view::npos )
+					{
+					reporter->Warning("malformed log batch in %s", in.ring->Path().c_str());
+					in.ring->Consume();
+					continue;
+					}
+
+				std::string stream_id_name{header.substr(0, s)};
+				broker::enum_value writer_name{std::string{header.substr(s + 1, w - s - 1)}};
+				std::string path{header.substr(w + 1)};
+
+				auto stream_id = detail::data_to_val(broker::enum_value{stream_id_name}, log_id_type);
+				auto writer_id = detail::data_to_val(std::move(writer_name), writer_id_type);
+
+				if ( ! stream_id || ! writer_id )
+					{
+					reporter->Warning("failed to unpack log stream or writer of batch for stream: %s",
+					                  stream_id_name.c_str());
+					in.ring->Consume();
+					continue;
+					}
+
+				// The writer's creation comes through Broker and
+				// may not have arrived yet.
+				if ( log_mgr->NeedsRemoteWriter(stream_id->AsEnumVal(), writer_id->AsEnumVal(), path) )
+					{
+					if ( ! in.stalled_since )
+						in.stalled_since = now;
+
+					if ( now - in.stalled_since < shm_writer_wait )
+						break;
+
+					reporter->Warning("dropping log batch for stream %s without writer for %s",
+					                  stream_id_name.c_str(), path.c_str());
+					in.stalled_since = 0;
+					in.ring->Consume();
+					continue;
+					}
+
+				in.stalled_since = 0;
+				ProcessLogBatch(stream_id->AsEnumVal(), writer_id->AsEnumVal(), path,
+				                data.data(), data.size(), stream_id_name);
+				in.ring->Consume();
+				}
+			}
+		}
+	}
+
+Manager::ShmOutbox* Manager::GetShmOutbox(const std::string& topic)
+	{
+	auto& out = shm_outboxes[topic];
+
+	if ( out.fifo >= 0 )
+		return &out;
+
+	double now = util::current_time();
+
+	if ( now < out.next_check )
+		return nullptr;
+
+	out.next_check = now + shm_scan_interval;
+
+	// Opening the FIFO fails while nobody has it open for reading.
+	auto dir = shm_dir + "/" + shm_inbox_name(topic);
+	int fd = open((dir + "/wakeup").c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+
+	if ( fd < 0 )
+		return nullptr;
+
+	if ( ! out.ring )
+		{
+		auto name = shm_name.empty() ? NodeID() : shm_name;
+		std::string error;
+		out.ring = detail::ShmRing::Create(dir + "/" + shm_inbox_name(name) + ".ring",
+		                                   shm_ring_size, &error);
+
+		if ( ! out.ring )
+			{
+			reporter->Warning("sending log batches for %s through Broker: %s",
+			                  topic.c_str(), error.c_str());
+			close(fd);
+			return nullptr;
+			}
+		}
+
+	DBG_LOG(DBG_BROKER, "Sending log batches for topic %s through %s",
+	        topic.c_str(), out.ring->Path().c_str());
+	out.fifo = fd;
+	return &out;
+	}
+
+bool Manager::ShmPublishLogBatch(const LogBuffer::PathBatch& pb, const std::string& encoded)
+	{
+	if ( shm_dir.empty() )
+		return false;
+
+	auto out = GetShmOutbox(pb.topic);
+
+	if ( ! out )
+		return false;
+
+	// The wakeup also tells whether the listener is still there.  A full
+	// FIFO means it has wakeups pending already.
+	char c = 0;
+
+	if ( write(out->fifo, &c, 1) < 0 && errno != EAGAIN )
+		{
+		close(out->fifo);
+		out->fifo = -1;
+		out->next_check = util::current_time() + shm_scan_interval;
+		return false;
+		}
+
+	std::string header;
+	header.reserve(pb.stream_id.size() + pb.writer_id.size() + pb.path.size() + 2);
+	header.append(pb.stream_id).append(1, '\0');
+	header.append(pb.writer_id).append(1, '\0');
+	header.append(pb.path);
+
+	// A full ring sends the batch through Broker, which may deliver it
+	// ahead of the batches still in the ring.
+	return out->ring->Write(header, encoded);
+	}
+
+bool Manager::HRWTopic(RecordVal* pool, Val* key, std::string& topic)
+	{
+	static int hrw_pool_offset =
+		id::find_type<RecordType>("Cluster::Pool")->FieldOffset("hrw_pool");
+	static int sites_offset =
+		id::find_type<RecordType>("HashHRW::Pool")->FieldOffset("sites");
+
+	auto hrw_pool = pool->GetFieldOrDefault(hrw_pool_offset);
+	auto sites = hrw_pool ? hrw_pool->AsRecordVal()->GetFieldOrDefault(sites_offset) : nullptr;
+
+	if ( ! sites )
+		return false;
+
+	auto it = hrw_pools.pools.find(sites->Modifiable());
+
+	if ( it == hrw_pools.pools.end() )
+		{
+		HRWNodes n;
+		n.sites = {NewRef{}, sites->AsTableVal()};
+		notifier::detail::registry.Register(sites->Modifiable(), &hrw_pools);
+		it = hrw_pools.pools.emplace(sites->Modifiable(), std::move(n)).first;
+		}
+
+	auto& n = it->second;
+
+	if ( ! n.current )
+		{
+		n.usable = BuildHRWNodes(n);
+		n.current = true;
+		}
+
+	if ( ! n.usable )
+		return false;
+
+	if ( n.nodes.empty() )
+		{
+		topic.clear();
+		return true;
+		}
+
+	ODesc desc(DESC_BINARY);
+	key->Describe(&desc);
+	auto digest = util::detail::fnv1a32(desc.Bytes(), desc.Len());
+
+	// Ties go to the larger site id, like in HashHRW::get_site().
+	const HRWNodes::Node* best = nullptr;
+	uint32_t best_weight = 0;
+
+	for ( const auto& node : n.nodes )
+		{
+		auto w = util::detail::hrw_weight(digest, node.site_id);
+
+		if ( ! best || w > best_weight ||
+		     (w == best_weight && node.site_id > best->site_id) )
+			{
+			best = &node;
+			best_weight = w;
+			}
+		}
+
+	topic = best->topic;
+	return true;
+	}
+
+bool Manager::BuildHRWNodes(HRWNodes& n)
+	{
+	static auto pool_node_type = id::find_type<RecordType>("Cluster::PoolNode");
+	static int user_data_offset =
+		id::find_type<RecordType>("HashHRW::Site")->FieldOffset("user_data");
+	static int name_offset = pool_node_type->FieldOffset("name");
+	static auto node_topic_func = id::find_func("Cluster::node_topic");
+
+	n.nodes.clear();
+
+	const PDict<TableEntryVal>* tbl = n.sites->AsTable();
+	IterCookie* c = tbl->InitForIteration();
+	zeek::detail::HashKey* k;
+	TableEntryVal* v;
+	bool usable = true;
+
+	while ( (v = tbl->NextEntry(k, c)) )
+		{
+		auto index = n.sites->RecreateIndex(*k);
+		delete k;
+
+		if ( ! usable )
+			continue;
+
+		const auto& user_data = v->GetVal()->AsRecordVal()->GetField(user_data_offset);
+
+		if ( ! user_data || ! same_type(user_data->GetType(), pool_node_type) )
+			{
+			usable = false;
+			continue;
+			}
+
+		const auto& name = user_data->AsRecordVal()->GetField(name_offset);
+		auto topic = node_topic_func->Invoke(name);
+
+		if ( ! topic )
+			{
+			usable = false;
+			continue;
+			}
+
+		n.nodes.push_back({index->Idx(0)->AsCount(), topic->AsString()->CheckString()});
+		}
+
+	return usable;
+	}
+
+Manager::HRWPools::~HRWPools()
+	{
+	for ( auto& p : pools )
+		notifier::detail::registry.Unregister(p.first, this);
+	}
+
+void Manager::HRWPools::Modified(notifier::detail::Modifiable* m)
+	{
+	auto it = pools.find(m);
+
+	if ( it != pools.end() )
+		it->second.current = false;
+	}
+
 bool Manager::PublishIdentifier(std::string topic, std::string id)
 	{
 	if ( bstate->endpoint.is_shutdown() )
@@ -486,7 +1227,7 @@ bool Manager::PublishIdentifier(std::string topic, std::string id)
 	broker::zeek::IdentifierUpdate msg(move(id), move(*data));
 	DBG_LOG(DBG_BROKER, "Publishing id-update: %s",
 	        RenderMessage(topic, msg.as_data()).c_str());
-	bstate->endpoint.publish(move(topic), msg.move_data());
+	Publish(move(topic), msg.move_data());
 	++statistics.num_ids_outgoing;
 	return true;
 	}
@@ -543,13 +1284,14 @@ bool Manager::PublishLogCreate(EnumVal* stream, EnumVal* writer,
 		bstate->endpoint.publish(peer, move(topic), msg.move_data());
 	else
 		// Broadcast.
-		bstate->endpoint.publish(move(topic), msg.move_data());
+		Publish(move(topic), msg.move_data());
 
 	return true;
 	}
 
 bool Manager::PublishLogWrite(EnumVal* stream, EnumVal* writer, string path,
-                              int num_fields, const threading::Value* const * vals)
+                              int num_fields, const threading::Value* const * vals,
+                              std::optional<uint64_t> shard)
 	{
 	if ( bstate->endpoint.is_shutdown() )
 		return true;
@@ -582,14 +1324,6 @@ bool Manager::PublishLogWrite(EnumVal* stream, EnumVal* writer, string path,
 
 	fmt.StartWrite();
 
-	bool success = fmt.Write(num_fields, "num_fields");
-
-	if ( ! success )
-		{
-		reporter->Error("Failed to remotely log stream %s: num_fields serialization failed", stream_id);
-		return false;
-		}
-
 	for ( int i = 0; i < num_fields; ++i )
 		{
 		if ( ! vals[i]->Write(&fmt) )
@@ -600,61 +1334,153 @@ bool Manager::PublishLogWrite(EnumVal* stream, EnumVal* writer, string path,
 		}
 
 	len = fmt.EndWrite(&data);
-	std::string serial_data(data, len);
-	free(data);
 
-	auto v = log_topic_func->Invoke(IntrusivePtr{NewRef{}, stream},
-	                                make_intrusive<StringVal>(path));
+	std::string topic;
 
-	if ( ! v )
+	if ( ! (shard && LogShardTopic(*shard, topic)) )
 		{
-		reporter->Error("Failed to remotely log: log_topic func did not return"
-		                " a value for stream %s at path %s", stream_id,
-		                path.data());
-		return false;
-		}
+		auto v = log_topic_func->Invoke(IntrusivePtr{NewRef{}, stream},
+		                                make_intrusive<StringVal>(path));
 
-	std::string topic = v->AsString()->CheckString();
+		if ( ! v )
+			{
+			free(data);
+			reporter->Error("Failed to remotely log: log_topic func did not return"
+			                " a value for stream %s at path %s", stream_id,
+			                path.data());
+			return false;
+			}
 
-	auto bstream_id = broker::enum_value(move(stream_id));
-	auto bwriter_id = broker::enum_value(move(writer_id));
-	broker::zeek::LogWrite msg(move(bstream_id), move(bwriter_id), move(path),
-	                           move(serial_data));
+		topic = v->AsString()->CheckString();
+		}
 
-	DBG_LOG(DBG_BROKER, "Buffering log record: %s", RenderMessage(topic, msg.as_data()).c_str());
+	DBG_LOG(DBG_BROKER, "Buffering log record for stream %s at path %s on topic %s",
+	        stream_id, path.data(), topic.data());
 
 	if ( log_buffers.size() <= (unsigned int)stream_id_num )
 		log_buffers.resize(stream_id_num + 1);
 
+	// Records of the same path travel together, so that its names get
+	// sent once per batch rather than once per record.
 	auto& lb = log_buffers[stream_id_num];
+	auto key = util::fmt("%s/%s/%d/", writer_id, topic.data(), num_fields) + path;
+	auto& pb = lb.batches[key];
+
+	if ( pb.num_records == 0 )
+		{
+		pb.topic = std::move(topic);
+		pb.stream_id = stream_id;
+		pb.writer_id = writer_id;
+		pb.path = std::move(path);
+		pb.num_fields = num_fields;
+		}
+
+	pb.records.append(data, len);
+	++pb.num_records;
+	free(data);
+
 	++lb.message_count;
-	auto& pending_batch = lb.msgs[topic];
-	pending_batch.emplace_back(msg.move_data());
 
 	if ( lb.message_count >= log_batch_size )
-		statistics.num_logs_outgoing += lb.Flush(bstate->endpoint, log_batch_size);
+		statistics.num_logs_outgoing += lb.Flush(*this, log_batch_compression);
 
 	return true;
 	}
 
-size_t Manager::LogBuffer::Flush(broker::endpoint& endpoint, size_t log_batch_size)
+bool Manager::LogShardTopic(uint64_t shard, std::string& topic)
+	{
+	// Without the cluster framework, sharding doesn't apply.
+	static const auto& logger_pool = id::find("Cluster::logger_pool");
+
+	if ( ! logger_pool || ! logger_pool->GetVal() )
+		return false;
+
+	auto key = val_mgr->Count(shard);
+
+	if ( ! HRWTopic(logger_pool->GetVal()->AsRecordVal(), key.get(), topic) )
+		return false;
+
+	// No logger's up, so leave it to Broker::log_topic.
+	return ! topic.empty();
+	}
+
+// Marks the serialized data of a LogWrite message as a batch of records,
+// in place of the number of fields of a single record.
+static constexpr int LOG_BATCH = -1;
+
+// Compressing smaller batches doesn't pay off.
+static constexpr size_t LOG_BATCH_MIN_COMPRESS = 1024;
+
+std::string Manager::LogBuffer::PathBatch::Encode(bool compress) const
+	{
+	zeek::detail::BinarySerializationFormat fmt;
+	fmt.StartWrite();
+	fmt.Write(LOG_BATCH, "batch");
+	fmt.Write(num_records, "num_records");
+	fmt.Write(num_fields, "num_fields");
+
+	std::string compressed;
+
+#ifdef USE_LZ4
+	if ( compress && records.size() >= LOG_BATCH_MIN_COMPRESS )
+		{
+		compressed.resize(LZ4_compressBound(records.size()));
+		int n = LZ4_compress_default(records.data(), &compressed[0],
+		                             records.size(), compressed.size());
+
+		if ( n > 0 && static_cast<size_t>(n) < records.size() )
+			compressed.resize(n);
+		else
+			compressed.clear();
+		}
+#endif
+
+	fmt.Write(! compressed.empty(), "compressed");
+
+	if ( ! compressed.empty() )
+		fmt.Write(static_cast<uint32_t>(records.size()), "raw_len");
+
+	char* data;
+	int len = fmt.EndWrite(&data);
+	std::string rval(data, len);
+	free(data);
+
+	rval.append(compressed.empty() ? records : compressed);
+	return rval;
+	}
+
+size_t Manager::LogBuffer::Flush(Manager& mgr, bool compress)
 	{
-	if ( endpoint.is_shutdown() )
+	if ( mgr.bstate->endpoint.is_shutdown() )
 		return 0;
 
 	if ( ! message_count )
 		// No logs buffered for this stream.
 		return 0;
 
+	// Indexed by topic string.
+	std::unordered_map<std::string, broker::vector> msgs;
+
+	for ( auto& kv : batches )
+		{
+		auto& pb = kv.second;
+		auto encoded = pb.Encode(compress);
+
+		if ( mgr.ShmPublishLogBatch(pb, encoded) )
+			continue;
+
+		broker::zeek::LogWrite msg(broker::enum_value(pb.stream_id),
+		                           broker::enum_value(pb.writer_id),
+		                           pb.path, std::move(encoded));
+		msgs[pb.topic].emplace_back(msg.move_data());
+		}
+
+	batches.clear();
+
 	for ( auto& kv : msgs )
 		{
-		auto& topic = kv.first;
-		auto& pending_batch = kv.second;
-		broker::vector batch;
-		batch.reserve(log_batch_size + 1);
-		pending_batch.swap(batch);
-		broker::zeek::Batch msg(std::move(batch));
-		endpoint.publish(topic, msg.move_data());
+		broker::zeek::Batch msg(std::move(kv.second));
+		mgr.Publish(kv.first, msg.move_data());
 		}
 
 	auto rval = message_count;
@@ -668,7 +1494,7 @@ size_t Manager::FlushLogBuffers()
 	auto rval = 0u;
 
 	for ( auto& lb : log_buffers )
-		rval += lb.Flush(bstate->endpoint, log_batch_size);
+		rval += lb.Flush(*this, log_batch_compression);
 
 	statistics.num_logs_outgoing += rval;
 	return rval;
@@ -919,11 +1745,22 @@ void Manager::DispatchMessage(const broker::topic& topic, broker::data msg)
 
 void Manager::Process()
 	{
+	zeek::detail::MemoryTagScope mem_tag(zeek::detail::MEMORY_BROKER);
+
 	// Ensure that time gets update before processing broker messages, or events
 	// based on them might get scheduled wrong.
 	if ( use_real_time )
 		run_state::detail::update_network_time(util::current_time());
 
+	FlushEventBuffers(true);
+
+	for ( auto& tq : topic_queues )
+		if ( tq.second && ! tq.second->pending.empty() )
+			DrainTopicQueue(tq.first, *tq.second);
+
+	if ( ! shm_inboxes.empty() )
+		ProcessShmInboxes();
+
 	auto messages = bstate->subscriber.poll();
 
 	bool had_input = ! messages.empty();
@@ -999,6 +1836,16 @@ void Manager::Process()
 			}
 		}
 
+	for ( auto it = store_imports.begin(); it != store_imports.end(); )
+		{
+		auto handle = LookupStore(it->first);
+
+		if ( ! handle || ImportStoreChunk(it->first, handle, it->second) )
+			it = store_imports.erase(it);
+		else
+			++it;
+		}
+
 	if ( had_input )
 		{
 		if ( run_state::network_time == 0 )
@@ -1081,6 +1928,7 @@ void Manager::ProcessStoreEvent(broker::data msg)
 		if ( insert.publisher() == storehandle->store_pid )
 			return;
 
+		NoteStoreKeyChanged(insert.store_id(), insert.key());
 		ProcessStoreEventInsertUpdate(table, insert.store_id(), insert.key(), insert.value(), {}, true);
 	}
 	else if ( auto update = broker::store_event::update::make(msg) )
@@ -1097,6 +1945,7 @@ void Manager::ProcessStoreEvent(broker::data msg)
 		if ( update.publisher() == storehandle->store_pid )
 			return;
 
+		NoteStoreKeyChanged(update.store_id(), update.key());
 		ProcessStoreEventInsertUpdate(table, update.store_id(), update.key(), update.new_value(), update.old_value(), false);
 		}
 	else if ( auto erase = broker::store_event::erase::make(msg) )
@@ -1114,6 +1963,7 @@ void Manager::ProcessStoreEvent(broker::data msg)
 			return;
 
 		auto key = erase.key();
+		NoteStoreKeyChanged(erase.store_id(), key);
 		DBG_LOG(DBG_BROKER, "Store %s: Erase key %s", erase.store_id().c_str(), to_string(key).c_str());
 		const auto& its = table->GetType()->AsTableType()->GetIndexTypes();
 		assert( its.size() == 1 );
@@ -1148,6 +1998,36 @@ void Manager::ProcessStoreEvent(broker::data msg)
 		}
 	}
 
+struct Manager::RemoteEvent {
+	EventHandlerPtr handler;
+	std::vector<TypePtr> arg_types;
+	std::vector<detail::DataConverter> converters;	// One per argument.
+};
+
+const Manager::RemoteEvent* Manager::LookupRemoteEvent(const std::string& name)
+	{
+	auto it = remote_events.find(name);
+
+	if ( it != remote_events.end() )
+		return it->second.get();
+
+	// Names without handlers don't get remembered, so that bogus ones
+	// can't fill up the map.
+	auto handler = event_registry->Lookup(name);
+
+	if ( ! handler )
+		return nullptr;
+
+	auto re = std::make_unique<RemoteEvent>();
+	re->handler = handler;
+	re->arg_types = handler->GetType(false)->ParamList()->GetTypes();
+
+	for ( const auto& t : re->arg_types )
+		re->converters.push_back(detail::data_converter(t.get()));
+
+	return remote_events.emplace(name, std::move(re)).first->second.get();
+	}
+
 void Manager::ProcessEvent(const broker::topic& topic, broker::zeek::Event ev)
 	{
 	if ( ! ev.valid() )
@@ -1163,9 +2043,13 @@ void Manager::ProcessEvent(const broker::topic& topic, broker::zeek::Event ev)
 	DBG_LOG(DBG_BROKER, "Process event: %s %s",
 			name.data(), RenderMessage(args).data());
 	++statistics.num_events_incoming;
-	auto handler = event_registry->Lookup(name);
 
-	if ( ! handler )
+	if ( EventHandler::TelemetryEnabled() )
+		++events_per_topic[topic.string()];
+
+	auto re = LookupRemoteEvent(name);
+
+	if ( ! re )
 		return;
 
 	auto& topic_string = topic.string();
@@ -1183,7 +2067,7 @@ void Manager::ProcessEvent(const broker::topic& topic, broker::zeek::Event ev)
 		return;
 		}
 
-	const auto& arg_types = handler->GetType(false)->ParamList()->GetTypes();
+	const auto& arg_types = re->arg_types;
 
 	if ( arg_types.size() != args.size() )
 		{
@@ -1200,7 +2084,7 @@ void Manager::ProcessEvent(const broker::topic& topic, broker::zeek::Event ev)
 		{
 		auto got_type = args[i].get_type_name();
 		const auto& expected_type = arg_types[i];
-		auto val = detail::data_to_val(std::move(args[i]), expected_type.get());
+		auto val = re->converters[i](args[i], expected_type.get());
 
 		if ( val )
 			vl.emplace_back(std::move(val));
@@ -1226,7 +2110,7 @@ void Manager::ProcessEvent(const broker::topic& topic, broker::zeek::Event ev)
 		}
 
 	if ( vl.size() == args.size() )
-		event_mgr.Enqueue(handler, std::move(vl), util::detail::SOURCE_BROKER);
+		event_mgr.Enqueue(re->handler, std::move(vl), util::detail::SOURCE_BROKER);
 	}
 
 bool Manager::ProcessLogCreate(broker::zeek::LogCreate lc)
@@ -1305,7 +2189,6 @@ bool Manager::ProcessLogWrite(broker::zeek::LogWrite lw)
 		return false;
 		}
 
-	++statistics.num_logs_incoming;
 	auto& stream_id_name = lw.stream_id().name;
 
 	// Get stream ID.
@@ -1342,8 +2225,15 @@ bool Manager::ProcessLogWrite(broker::zeek::LogWrite lw)
 		return false;
 		}
 
+	return ProcessLogBatch(stream_id->AsEnumVal(), writer_id->AsEnumVal(), *path,
+	                       serial_data->data(), serial_data->size(), stream_id_name);
+	}
+
+bool Manager::ProcessLogBatch(EnumVal* stream_id, EnumVal* writer_id, const std::string& path,
+                              const char* data, size_t len, const std::string& stream_id_name)
+	{
 	zeek::detail::BinarySerializationFormat fmt;
-	fmt.StartRead(serial_data->data(), serial_data->size());
+	fmt.StartRead(data, len);
 
 	int num_fields;
 	bool success = fmt.Read(&num_fields, "num_fields");
@@ -1354,26 +2244,76 @@ bool Manager::ProcessLogWrite(broker::zeek::LogWrite lw)
 		return false;
 		}
 
-	auto vals = new threading::Value* [num_fields];
+	int num_records = 1;
+	std::string raw;
 
-	for ( int i = 0; i < num_fields; ++i )
+	if ( num_fields == LOG_BATCH )
 		{
-		vals[i] = new threading::Value;
+		bool compressed;
+
+		if ( ! (fmt.Read(&num_records, "num_records") &&
+		        fmt.Read(&num_fields, "num_fields") &&
+		        fmt.Read(&compressed, "compressed")) ||
+		     num_records < 0 || num_fields < 0 )
+			{
+			reporter->Warning("failed to unserialize remote log batch for stream: %s", stream_id_name.data());
+			return false;
+			}
 
-		if ( ! vals[i]->Read(&fmt) )
+		if ( compressed )
 			{
-			for ( int j = 0; j <=i; ++j )
-				delete vals[j];
+#ifdef USE_LZ4
+			uint32_t raw_len;
+
+			if ( ! fmt.Read(&raw_len, "raw_len") )
+				{
+				reporter->Warning("failed to unserialize remote log batch for stream: %s", stream_id_name.data());
+				return false;
+				}
 
-			delete [] vals;
-			reporter->Warning("failed to unserialize remote log field %d for stream: %s", i, stream_id_name.data());
+			auto offset = fmt.BytesRead();
+			raw.resize(raw_len);
+			int n = LZ4_decompress_safe(data + offset, &raw[0], len - offset, raw_len);
+
+			if ( n < 0 || static_cast<uint32_t>(n) != raw_len )
+				{
+				reporter->Warning("failed to decompress remote log batch for stream: %s", stream_id_name.data());
+				return false;
+				}
 
+			fmt.EndRead();
+			fmt.StartRead(raw.data(), raw.size());
+#else
+			reporter->Warning("cannot decompress remote log batch for stream %s without lz4 support", stream_id_name.data());
 			return false;
+#endif
+			}
+		}
+
+	for ( int r = 0; r < num_records; ++r )
+		{
+		auto vals = new threading::Value* [num_fields];
+
+		for ( int i = 0; i < num_fields; ++i )
+			{
+			vals[i] = new threading::Value;
+
+			if ( ! vals[i]->Read(&fmt) )
+				{
+				for ( int j = 0; j <=i; ++j )
+					delete vals[j];
+
+				delete [] vals;
+				reporter->Warning("failed to unserialize remote log field %d for stream: %s", i, stream_id_name.data());
+
+				return false;
+				}
 			}
+
+		++statistics.num_logs_incoming;
+		log_mgr->WriteFromRemote(stream_id, writer_id, path, num_fields, vals);
 		}
 
-	log_mgr->WriteFromRemote(stream_id->AsEnumVal(), writer_id->AsEnumVal(),
-	                               std::move(*path), num_fields, vals);
 	fmt.EndRead();
 	return true;
 	}
@@ -1641,15 +2581,43 @@ void Manager::BrokerStoreToZeekTable(const std::string& name, const detail::Stor
 		return;
 
 	auto set = caf::get_if<broker::set>(&(keys->get_data()));
+	if ( ! set )
+		return;
+
+	auto& imp = store_imports[name];
+	imp.keys = std::move(*set);
+	imp.next = imp.keys.begin();
+	imp.changed.clear();
+	imp.resumed = false;
+
+	// Small stores load right away, larger ones continue in Process().
+	if ( ImportStoreChunk(name, handle, imp) )
+		store_imports.erase(name);
+	}
+
+bool Manager::ImportStoreChunk(const std::string& name, const detail::StoreHandleVal* handle,
+                               StoreImport& imp)
+	{
 	auto table = handle->forward_to;
+	if ( ! table )
+		return true;
+
 	const auto& its = table->GetType()->AsTableType()->GetIndexTypes();
 	bool is_set = table->GetType()->IsSet();
+	size_t n = 0;
 
 	// disable &on_change notifications while filling the table.
 	table->DisableChangeNotifications();
 
-	for ( const auto& key : *set )
+	auto chunk_size = zeek_table_import_chunk_size;
+
+	for ( ; imp.next != imp.keys.end() && ( ! chunk_size || n < chunk_size ); ++imp.next, ++n )
 		{
+		const auto& key = *imp.next;
+
+		if ( imp.changed.find(key) != imp.changed.end() )
+			continue;
+
 		ValPtr zeek_key;
 		if ( its.size() == 1 )
 			zeek_key = detail::data_to_val(key, its[0].get());
@@ -1661,7 +2629,7 @@ void Manager::BrokerStoreToZeekTable(const std::string& name, const detail::Stor
 			reporter->Error("Failed to convert key \"%s\" while importing broker store to table for store \"%s\". Aborting import.", to_string(key).c_str(), name.c_str());
 			// just abort - this probably means the types are incompatible
 			table->EnableChangeNotifications();
-			return;
+			return true;
 			}
 
 		if ( is_set )
@@ -1673,8 +2641,13 @@ void Manager::BrokerStoreToZeekTable(const std::string& name, const detail::Stor
 		auto value = handle->store.get(key);
 		if ( ! value )
 			{
-			reporter->Error("Failed to load value for key %s while importing Broker store %s to table", to_string(key).c_str(), name.c_str());
-			table->EnableChangeNotifications();
+			if ( imp.resumed )
+				// Erased while the import was going on.
+				DBG_LOG(DBG_BROKER, "Store %s: key %s vanished during import",
+				        name.c_str(), to_string(key).c_str());
+			else
+				reporter->Error("Failed to load value for key %s while importing Broker store %s to table", to_string(key).c_str(), name.c_str());
+
 			continue;
 			}
 
@@ -1683,14 +2656,30 @@ void Manager::BrokerStoreToZeekTable(const std::string& name, const detail::Stor
 			{
 			reporter->Error("Could not convert %s to table value while trying to import Broker store %s. Aborting import.", to_string(value).c_str(), name.c_str());
 			table->EnableChangeNotifications();
-			return;
+			return true;
 			}
 
 		table->Assign(zeek_key, zeek_value, false);
 		}
 
 	table->EnableChangeNotifications();
-	return;
+
+	if ( imp.next != imp.keys.end() )
+		{
+		DBG_LOG(DBG_BROKER, "Store %s: import paused after %zu keys", name.c_str(), n);
+		imp.resumed = true;
+		return false;
+		}
+
+	return true;
+	}
+
+void Manager::NoteStoreKeyChanged(const std::string& name, const broker::data& key)
+	{
+	auto it = store_imports.find(name);
+
+	if ( it != store_imports.end() )
+		it->second.changed.insert(key);
 	}
 
 detail::StoreHandleVal* Manager::MakeClone(const string& name, double resync_interval,
@@ -1752,6 +2741,7 @@ bool Manager::CloseStore(const string& name)
 		++i;
 		}
 
+	store_imports.erase(name);
 	Unref(s->second);
 	data_stores.erase(s);
 	return true;
@@ -1774,6 +2764,14 @@ const Stats& Manager::GetStatistics()
 	statistics.num_peers = peer_count;
 	statistics.num_stores = data_stores.size();
 	statistics.num_pending_queries = pending_queries.size();
+	statistics.num_events_buffered = 0;
+	statistics.num_logs_buffered = 0;
+
+	for ( const auto& eb : event_buffers )
+		statistics.num_events_buffered += eb.second.msgs.size();
+
+	for ( const auto& lb : log_buffers )
+		statistics.num_logs_buffered += lb.message_count;
 
 	// The other attributes are set as activity happens.
 
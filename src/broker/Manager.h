@@ -1,8 +1,12 @@
 #pragma once
 
+#include <deque>
+#include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <broker/topic.hh>
 #include <broker/data.hh>
@@ -12,6 +16,7 @@
 #include <broker/endpoint.hh>
 #include <broker/endpoint_info.hh>
 #include <broker/peer_info.hh>
+#include <broker/publisher.hh>
 #include <broker/publisher_id.hh>
 #include <broker/backend.hh>
 #include <broker/backend_options.hh>
@@ -19,6 +24,7 @@
 #include <broker/zeek.hh>
 
 #include "zeek/IntrusivePtr.h"
+#include "zeek/Notifier.h"
 #include "zeek/iosource/IOSource.h"
 #include "zeek/logging/WriterBackend.h"
 
@@ -34,6 +40,7 @@ using TableValPtr = IntrusivePtr<TableVal>;
 namespace Broker {
 
 namespace detail {
+class ShmRing;
 class StoreHandleVal;
 class StoreQueryCallback;
 };
@@ -62,6 +69,32 @@ struct Stats {
 	size_t num_ids_incoming = 0;
 	// Number of total identifiers sent.
 	size_t num_ids_outgoing = 0;
+	// Number of event batches sent.
+	size_t num_event_batches_outgoing = 0;
+	// Number of events buffered for sending.
+	size_t num_events_buffered = 0;
+	// Number of log records buffered for sending.
+	size_t num_logs_buffered = 0;
+	// Number of event batches sent by size: element i counts the batches
+	// of 2^i to 2^(i+1)-1 events.
+	std::vector<size_t> event_batch_sizes;
+};
+
+/**
+ * Statistics about the send queue of a topic that has a queue policy, see
+ * Broker::topic_queue_policies.
+ */
+struct TopicQueueStats {
+	// Number of messages waiting for room in Broker's buffer.
+	size_t queued = 0;
+	// Number of messages in Broker's buffer for the topic.
+	size_t buffered = 0;
+	// Capacity of Broker's buffer for the topic.
+	size_t capacity = 0;
+	// Number of messages discarded because the queue was full.
+	size_t dropped = 0;
+	// Number of times publishing stalled because the queue was full.
+	size_t blocked = 0;
 };
 
 /**
@@ -172,6 +205,21 @@ public:
 	 */
 	bool PublishEvent(std::string topic, RecordVal* ev);
 
+	/**
+	 * Selects the node of a cluster pool that a key maps to according to
+	 * Rendezvous (Highest Random Weight) hashing, with the same result
+	 * as the Cluster::hrw_topic() script function.  The manager keeps a
+	 * table of each pool's nodes and their topics, which it rebuilds once
+	 * the pool's sites change.
+	 * @param pool the Cluster::Pool record.
+	 * @param key the key to map to a node.
+	 * @param topic set to the topic of the selected node, or to an empty
+	 * string if the pool has no nodes.
+	 * @return false if the pool's sites don't all carry a Cluster::PoolNode,
+	 * in which case the selection is up to the script function.
+	 */
+	bool HRWTopic(RecordVal* pool, Val* key, std::string& topic);
+
 	/**
 	 * Send a message to create a log stream to any interested peers.
 	 * The log stream may or may not already exist on the receiving side.
@@ -199,12 +247,17 @@ public:
 	 * @param path the log path to output the log entry to.
 	 * @param num_vals the number of fields to log.
 	 * @param vals the log values to log, of size num_vals.
+	 * @param shard the hash of the record's Log::shard_fields column, if
+	 * the stream has one.  The topic is then that of the node of
+	 * Cluster::logger_pool that the hash maps to, rather than
+	 * Broker::log_topic's.
 	 * See the Broker::SendFlags record type.
 	 * @return true if the message is sent successfully.
 	 */
 	bool PublishLogWrite(EnumVal* stream, EnumVal* writer,
 	                     std::string path, int num_vals,
-	                     const threading::Value* const * vals);
+	                     const threading::Value* const * vals,
+	                     std::optional<uint64_t> shard = {});
 
 	/**
 	 * Automatically send an event to any interested peers whenever it is
@@ -336,6 +389,30 @@ public:
 	 */
 	size_t FlushLogBuffers();
 
+	/**
+	 * Send pending event batches.
+	 * @param expired_only if true, only the batches that have been
+	 * buffering for at least Broker::event_batch_interval go out.
+	 * @return the number of events sent.
+	 */
+	size_t FlushEventBuffers(bool expired_only = false);
+
+	/**
+	 * Lets processes on the same host send their log batches for a topic
+	 * through shared memory rather than Broker, see Broker::shm_dir.  The
+	 * topic should be one that no other process subscribes to, such as a
+	 * cluster logger's node topic.
+	 * @param topic the topic.
+	 * @return true if the topic's inbox got set up.
+	 */
+	bool ShmListen(const std::string& topic);
+
+	/**
+	 * @return send queue statistics of the topics that have been
+	 * published to and have a queue policy, indexed by topic.
+	 */
+	std::unordered_map<std::string, TopicQueueStats> GetTopicQueueStats() const;
+
 	/**
 	 * Flushes all pending data store queries and also clears all contents.
 	 */
@@ -346,6 +423,16 @@ public:
 	 */
 	const Stats& GetStatistics();
 
+	/**
+	 * @return the number of events received per topic while event
+	 * handler telemetry is on.
+	 */
+	const std::unordered_map<std::string, uint64_t>& EventsPerTopic() const
+		{ return events_per_topic; }
+
+	void ResetEventsPerTopic()
+		{ events_per_topic.clear(); }
+
 	/**
 	 * Creating an instance of this struct simply helps the manager
 	 * keep track of whether calls into its API are coming from script
@@ -364,6 +451,13 @@ private:
 	// Common functionality for processing insert and update events.
 	void ProcessStoreEventInsertUpdate(const TableValPtr& table, const std::string& store_id, const broker::data& key, const broker::data& data, const broker::data& old_value, bool insert);
 	void ProcessEvent(const broker::topic& topic, broker::zeek::Event ev);
+
+	// An incoming event's handler, with the conversions of its arguments.
+	struct RemoteEvent;
+
+	// Resolves an incoming event once per name.  Returns null for events
+	// without a handler.
+	const RemoteEvent* LookupRemoteEvent(const std::string& name);
 	bool ProcessLogCreate(broker::zeek::LogCreate lc);
 	bool ProcessLogWrite(broker::zeek::LogWrite lw);
 	bool ProcessIdentifierUpdate(broker::zeek::IdentifierUpdate iu);
@@ -379,22 +473,177 @@ private:
 	// when a master/clone is created.
 	void BrokerStoreToZeekTable(const std::string& name, const detail::StoreHandleVal* handle);
 
+	// The content of a Broker store that's still being copied into its
+	// table, see Broker::table_store_import_chunk_size.
+	struct StoreImport {
+		broker::set keys;
+		broker::set::const_iterator next;
+		// Keys that store events changed since the import started, and
+		// which it hence leaves alone.
+		broker::set changed;
+		// Whether the import continues from an earlier main loop
+		// iteration.
+		bool resumed = false;
+	};
+
+	// Copies the next chunk of a store's content into its table.  Returns
+	// true once there's nothing left to copy.
+	bool ImportStoreChunk(const std::string& name, const detail::StoreHandleVal* handle,
+	                      StoreImport& imp);
+	// Tells a pending import that a store event changed a key.
+	void NoteStoreKeyChanged(const std::string& name, const broker::data& key);
+
 	void Error(const char* format, ...)
 		__attribute__((format (printf, 2, 3)));
 
 	// IOSource interface overrides:
 	void Process() override;
 	const char* Tag() override	{ return "Broker::Manager"; }
-	double GetNextTimeout() override	{ return -1; }
+	double GetNextTimeout() override;
 
 	struct LogBuffer {
-		// Indexed by topic string.
-		std::unordered_map<std::string, broker::vector> msgs;
+		// The records of one path, serialized back to back.
+		struct PathBatch {
+			std::string topic;
+			std::string stream_id;
+			std::string writer_id;
+			std::string path;
+			int num_fields = 0;
+			int num_records = 0;
+			std::string records;
+
+			// Returns the serialized data of the LogWrite message
+			// that carries the records.
+			std::string Encode(bool compress) const;
+		};
+
+		// Indexed by writer, topic, number of fields and path.
+		std::unordered_map<std::string, PathBatch> batches;
 		size_t message_count;
 
-		size_t Flush(broker::endpoint& endpoint, size_t batch_size);
+		size_t Flush(Manager& mgr, bool compress);
+	};
+
+	struct EventBuffer {
+		broker::vector msgs;
+		// When the oldest of msgs got buffered.
+		double first_time = 0;
+	};
+
+	size_t FlushEventBuffer(const std::string& topic, EventBuffer& eb);
+
+	// A ring that carries log batches from another process.
+	struct ShmInRing {
+		std::unique_ptr<detail::ShmRing> ring;
+		// When the oldest batch started waiting for its writer.
+		double stalled_since = 0;
+	};
+
+	// The shared memory inbox of a topic that ShmListen() set up: a
+	// directory holding a ring per sending process, and a FIFO through
+	// which they signal new batches.
+	struct ShmInbox {
+		std::string dir;
+		int fifo = -1;
+		// Keeps the FIFO from signaling EOF while no sender has it open.
+		int fifo_writer = -1;
+		// Indexed by file name.
+		std::map<std::string, ShmInRing> rings;
+		double next_scan = 0;
+	};
+
+	// The ring through which this process sends log batches for a topic,
+	// if another process on the host listens on it.
+	struct ShmOutbox {
+		std::unique_ptr<detail::ShmRing> ring;
+		int fifo = -1;
+		// When to look for a listener again, if there's none.
+		double next_check = 0;
 	};
 
+	// Sends an encoded log batch through the topic's ring, if there's a
+	// listener.  Returns false if the batch needs to go through Broker.
+	bool ShmPublishLogBatch(const LogBuffer::PathBatch& pb, const std::string& encoded);
+	// Returns the outbox for a topic, or null if nobody listens on it.
+	ShmOutbox* GetShmOutbox(const std::string& topic);
+	// Maps the rings that have shown up in an inbox.
+	void ScanShmInbox(ShmInbox& inbox);
+	// Writes the log batches waiting in the inboxes.
+	void ProcessShmInboxes();
+	// Writes the records of an encoded log batch, as LogWrite messages and
+	// the inboxes carry them.
+	bool ProcessLogBatch(EnumVal* stream_id, EnumVal* writer_id, const std::string& path,
+	                     const char* data, size_t len, const std::string& stream_id_name);
+
+	// What happens to a message for a full send queue.
+	enum class QueueOverflow { Block, DropOldest, DropNewest };
+
+	// An entry of Broker::topic_queue_policies.
+	struct QueuePolicy {
+		std::string prefix;
+		size_t max_queued;
+		QueueOverflow overflow;
+		size_t threshold;
+	};
+
+	// The send queue of a topic with a queue policy.  Messages go to the
+	// topic's publisher while its buffer has room, and wait here
+	// otherwise.
+	struct TopicQueue {
+		TopicQueue(broker::publisher p, const QueuePolicy& qp)
+			: publisher(std::move(p)), policy(qp)
+			{}
+
+		broker::publisher publisher;
+		const QueuePolicy& policy;
+		std::deque<broker::data> pending;
+		bool above_threshold = false;
+		size_t dropped = 0;
+		size_t blocked = 0;
+	};
+
+	// Sends a message, going through the topic's send queue if it has a
+	// queue policy.
+	void Publish(std::string topic, broker::data msg);
+	// Returns the topic's send queue, or null if it has no queue policy.
+	TopicQueue* GetTopicQueue(const std::string& topic);
+	// Moves waiting messages to the publisher while its buffer has room.
+	// If block is true, all of them go, waiting for room as needed.
+	void DrainTopicQueue(const std::string& topic, TopicQueue& q, bool block = false);
+	// Raises Broker::send_queue_threshold_crossed if the queue's depth
+	// crossed the policy's threshold.
+	void CheckTopicQueueThreshold(const std::string& topic, TopicQueue& q);
+
+	// The nodes of a cluster pool, as HRWTopic() selects among them.
+	struct HRWNodes {
+		struct Node {
+			uint64_t site_id;
+			std::string topic;
+		};
+
+		TableValPtr sites; // The pool's HashHRW::SiteTable.
+		std::vector<Node> nodes;
+		bool current = false; // Whether nodes reflects sites.
+		bool usable = false; // Whether all sites carry a pool node.
+	};
+
+	// Tracks the pools' site tables, marking their nodes as outdated
+	// once they get modified.
+	struct HRWPools final : public notifier::detail::Receiver {
+		~HRWPools() override;
+		void Modified(notifier::detail::Modifiable* m) override;
+
+		std::unordered_map<notifier::detail::Modifiable*, HRWNodes> pools;
+	};
+
+	// Fills in the nodes from the pool's sites.  Returns false if a site
+	// doesn't carry a pool node.
+	bool BuildHRWNodes(HRWNodes& n);
+
+	// Picks the topic of a sharded log write from Cluster::logger_pool,
+	// returning false if the pool can't say.
+	bool LogShardTopic(uint64_t shard, std::string& topic);
+
 	// Data stores
 	using query_id = std::pair<broker::request_id, detail::StoreHandleVal*>;
 
@@ -409,27 +658,46 @@ private:
 	};
 
 	std::vector<LogBuffer> log_buffers; // Indexed by stream ID enum.
+	std::unordered_map<std::string, EventBuffer> event_buffers; // Indexed by topic.
 	std::string default_log_topic_prefix;
 	std::shared_ptr<BrokerState> bstate;
 	std::unordered_map<std::string, detail::StoreHandleVal*> data_stores;
 	std::unordered_map<std::string, TableValPtr> forwarded_stores;
+	std::unordered_map<std::string, StoreImport> store_imports;
 	std::unordered_map<query_id, detail::StoreQueryCallback*,
 	                   query_id_hasher> pending_queries;
 	std::vector<std::string> forwarded_prefixes;
+	std::unordered_map<std::string, std::unique_ptr<RemoteEvent>> remote_events;
 
 	Stats statistics;
+	std::unordered_map<std::string, uint64_t> events_per_topic;
+	HRWPools hrw_pools;
+	// Longest prefix first.
+	std::vector<QueuePolicy> queue_policies;
+	// Indexed by topic, null for topics without a queue policy.
+	std::unordered_map<std::string, std::unique_ptr<TopicQueue>> topic_queues;
+	std::string shm_dir;
+	std::string shm_name;
+	uint64_t shm_ring_size = 0;
+	std::vector<ShmInbox> shm_inboxes;
+	// Indexed by topic.
+	std::unordered_map<std::string, ShmOutbox> shm_outboxes;
 
 	uint16_t bound_port;
 	bool use_real_time;
 	int peer_count;
 
 	size_t log_batch_size;
+	bool log_batch_compression;
+	size_t event_batch_size;
+	double event_batch_interval;
 	Func* log_topic_func;
 	VectorTypePtr vector_of_data_type;
 	EnumType* log_id_type;
 	EnumType* writer_id_type;
 	bool zeek_table_manager = false;
 	std::string zeek_table_db_directory;
+	size_t zeek_table_import_chunk_size = 0;
 
 	static int script_scope;
 };
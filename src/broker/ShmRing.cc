@@ -0,0 +1,331 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/broker/ShmRing.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include "zeek/util.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::Broker::detail {
+
+static const char magic[8] = {'Z', 'E', 'E', 'K', 'R', 'N', 'G', '1'};
+
+// The smallest ring worth having.
+static constexpr uint64_t MIN_CAPACITY = 4096;
+
+struct ShmRing::Header {
+	char magic[8];
+	uint64_t capacity;
+
+	// The number of bytes the producer has written and the consumer has
+	// released since the ring's creation.  They sit on separate cache
+	// lines, as each process writes one of them.
+	alignas(64) std::atomic<uint64_t> head;
+	alignas(64) std::atomic<uint64_t> tail;
+};
+
+// Precedes every message; a header_len of PADDING marks the unused space
+// at the ring's end that the next message didn't fit into.
+struct MessageHeader {
+	uint32_t header_len;
+	uint32_t data_len;
+};
+
+static constexpr uint32_t PADDING = UINT32_MAX;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared memory rings need lock-free atomics");
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+              "shared memory rings need plain atomics");
+
+// Messages start at multiples of 8 bytes, keeping their headers aligned.
+static uint64_t message_size(uint64_t header_len, uint64_t data_len)
+	{
+	return (sizeof(MessageHeader) + header_len + data_len + 7) & ~uint64_t(7);
+	}
+
+ShmRing::ShmRing(std::string arg_path, char* arg_base, size_t arg_size)
+	: path(std::move(arg_path)), base(arg_base), size(arg_size)
+	{
+	}
+
+ShmRing::~ShmRing()
+	{
+	munmap(base, size);
+	}
+
+char* ShmRing::Data() const
+	{
+	return base + sizeof(Header);
+	}
+
+std::unique_ptr<ShmRing> ShmRing::Create(const std::string& path, uint64_t capacity,
+                                         std::string* error)
+	{
+	struct stat st;
+
+	if ( stat(path.c_str(), &st) == 0 )
+		return Map(path, error);
+
+	capacity = std::max(capacity, MIN_CAPACITY) & ~uint64_t(7);
+
+	auto tmp = util::fmt("%s.tmp.%d", path.c_str(), getpid());
+	int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+	if ( fd < 0 )
+		{
+		*error = util::fmt("cannot create %s: %s", tmp, strerror(errno));
+		return nullptr;
+		}
+
+	Header h;
+	memcpy(h.magic, magic, sizeof(magic));
+	h.capacity = capacity;
+	h.head = 0;
+	h.tail = 0;
+
+	if ( ftruncate(fd, sizeof(Header) + capacity) < 0 ||
+	     pwrite(fd, &h, sizeof(h), 0) != static_cast<ssize_t>(sizeof(h)) ||
+	     rename(tmp, path.c_str()) < 0 )
+		{
+		*error = util::fmt("cannot initialize %s: %s", path.c_str(), strerror(errno));
+		close(fd);
+		unlink(tmp);
+		return nullptr;
+		}
+
+	close(fd);
+	return Map(path, error);
+	}
+
+std::unique_ptr<ShmRing> ShmRing::Open(const std::string& path, std::string* error)
+	{
+	return Map(path, error);
+	}
+
+std::unique_ptr<ShmRing> ShmRing::Map(const std::string& path, std::string* error)
+	{
+	int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+
+	if ( fd < 0 )
+		{
+		*error = util::fmt("cannot open %s: %s", path.c_str(), strerror(errno));
+		return nullptr;
+		}
+
+	struct stat st;
+
+	if ( fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(Header) )
+		{
+		*error = util::fmt("%s is not a ring", path.c_str());
+		close(fd);
+		return nullptr;
+		}
+
+	size_t size = st.st_size;
+	void* m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if ( m == MAP_FAILED )
+		{
+		*error = util::fmt("cannot map %s: %s", path.c_str(), strerror(errno));
+		return nullptr;
+		}
+
+	std::unique_ptr<ShmRing> ring{new ShmRing(path, static_cast<char*>(m), size)};
+	auto h = ring->GetHeader();
+
+	if ( memcmp(h->magic, magic, sizeof(magic)) != 0 )
+		*error = util::fmt("%s is not a ring", path.c_str());
+
+	else if ( h->capacity != size - sizeof(Header) || h->capacity % 8 != 0 ||
+	          h->capacity < MIN_CAPACITY )
+		*error = util::fmt("%s was written by a different version of Zeek", path.c_str());
+
+	else
+		{
+		ring->capacity = h->capacity;
+		return ring;
+		}
+
+	return nullptr;
+	}
+
+bool ShmRing::Write(std::string_view header, std::string_view data)
+	{
+	auto len = message_size(header.size(), data.size());
+
+	// Larger messages could leave the ring unable to take them at all.
+	if ( len > capacity / 2 )
+		return false;
+
+	auto h = GetHeader();
+	auto head = h->head.load(std::memory_order_relaxed);
+	auto tail = h->tail.load(std::memory_order_acquire);
+	auto offset = head % capacity;
+	auto to_end = capacity - offset;
+	auto padding = to_end < len ? to_end : 0;
+
+	if ( head - tail + padding + len > capacity )
+		return false;
+
+	if ( padding )
+		{
+		// The space left is a multiple of 8 bytes, enough for the
+		// marker.
+		auto m = reinterpret_cast<MessageHeader*>(Data() + offset);
+		m->header_len = PADDING;
+		m->data_len = 0;
+		head += padding;
+		offset = 0;
+		}
+
+	auto m = reinterpret_cast<MessageHeader*>(Data() + offset);
+	m->header_len = header.size();
+	m->data_len = data.size();
+
+	auto p = reinterpret_cast<char*>(m + 1);
+	memcpy(p, header.data(), header.size());
+	memcpy(p + header.size(), data.data(), data.size());
+
+	h->head.store(head + len, std::memory_order_release);
+	return true;
+	}
+
+bool ShmRing::Read(std::string_view* header, std::string_view* data)
+	{
+	auto h = GetHeader();
+	auto tail = h->tail.load(std::memory_order_relaxed);
+	auto head = h->head.load(std::memory_order_acquire);
+
+	while ( tail != head )
+		{
+		auto offset = tail % capacity;
+		auto m = reinterpret_cast<const MessageHeader*>(Data() + offset);
+
+		if ( m->header_len == PADDING )
+			{
+			tail += capacity - offset;
+			h->tail.store(tail, std::memory_order_release);
+			continue;
+			}
+
+		auto len = message_size(m->header_len, m->data_len);
+
+		if ( len > capacity - offset || len > head - tail )
+			{
+			// The producer doesn't write such messages, so the
+			// ring got corrupted.  Skip what's in it.
+			h->tail.store(head, std::memory_order_release);
+			return false;
+			}
+
+		auto p = reinterpret_cast<const char*>(m + 1);
+		*header = std::string_view(p, m->header_len);
+		*data = std::string_view(p + m->header_len, m->data_len);
+		read_end = tail + len;
+		return true;
+		}
+
+	return false;
+	}
+
+void ShmRing::Consume()
+	{
+	GetHeader()->tail.store(read_end, std::memory_order_release);
+	}
+
+uint64_t ShmRing::Used() const
+	{
+	auto h = GetHeader();
+	return h->head.load(std::memory_order_acquire) - h->tail.load(std::memory_order_acquire);
+	}
+
+} // namespace zeek::Broker::detail
+
+TEST_CASE("shared memory ring")
+	{
+	using zeek::Broker::detail::ShmRing;
+
+	char dir[] = "/tmp/zeek-ring-XXXXXX";
+	REQUIRE(mkdtemp(dir));
+	std::string path = std::string(dir) + "/test.ring";
+	std::string error;
+
+	auto producer = ShmRing::Create(path, 4096, &error);
+	REQUIRE(producer);
+	auto consumer = ShmRing::Open(path, &error);
+	REQUIRE(consumer);
+	CHECK(consumer->Capacity() == 4096);
+
+	std::string_view header, data;
+	CHECK_FALSE(consumer->Read(&header, &data));
+
+	CHECK(producer->Write("conn", "first"));
+	CHECK(producer->Write("dns", "second"));
+	REQUIRE(consumer->Read(&header, &data));
+	CHECK(header == "conn");
+	CHECK(data == "first");
+
+	// Without consuming, the same message comes back.
+	REQUIRE(consumer->Read(&header, &data));
+	CHECK(header == "conn");
+	consumer->Consume();
+
+	REQUIRE(consumer->Read(&header, &data));
+	CHECK(data == "second");
+	consumer->Consume();
+	CHECK(consumer->Used() == 0);
+
+	// Messages of more than half the capacity don't go in, and filling
+	// the ring makes writes fail until the consumer catches up.
+	CHECK_FALSE(producer->Write("big", std::string(3000, 'x')));
+
+	std::string chunk(1000, 'y');
+	int n = 0;
+
+	while ( producer->Write("chunk", chunk) )
+		++n;
+
+	CHECK(n == 3);
+
+	for ( int i = 0; i < n; ++i )
+		{
+		REQUIRE(consumer->Read(&header, &data));
+		CHECK(data == chunk);
+		consumer->Consume();
+		}
+
+	// Writing past the end wraps around.
+	CHECK(producer->Write("chunk", chunk));
+	CHECK(producer->Write("chunk", chunk));
+	REQUIRE(consumer->Read(&header, &data));
+	CHECK(data == chunk);
+	consumer->Consume();
+	REQUIRE(consumer->Read(&header, &data));
+	CHECK(data == chunk);
+	consumer->Consume();
+	CHECK_FALSE(consumer->Read(&header, &data));
+
+	// An existing ring keeps its size and contents.
+	CHECK(producer->Write("after", "restart"));
+	producer.reset();
+	producer = ShmRing::Create(path, 65536, &error);
+	REQUIRE(producer);
+	CHECK(producer->Capacity() == 4096);
+	REQUIRE(consumer->Read(&header, &data));
+	CHECK(data == "restart");
+
+	unlink(path.c_str());
+	rmdir(dir);
+	}
@@ -0,0 +1,109 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A ring buffer in a memory-mapped file that carries messages from one Zeek
+// process to another one on the same host.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace zeek::Broker::detail {
+
+/**
+ * A single-producer, single-consumer ring of messages in a file that both
+ * processes map read-write.  The producer appends messages and the consumer
+ * reads them in place, each side advancing its own position: neither takes
+ * a lock, and the consumer doesn't copy a message before it's done with it.
+ * Messages consist of a short header part and a data part, and take up
+ * contiguous space in the ring, with padding at its end where one doesn't
+ * fit anymore.
+ *
+ * The file outlives both processes, so a producer that restarts continues
+ * the ring, and a consumer that restarts picks up the messages it hasn't
+ * read yet.
+ */
+class ShmRing {
+public:
+	/**
+	 * Maps a ring file, creating it if it doesn't exist yet.  A new file
+	 * gets written under a temporary name and then renamed, so that the
+	 * consumer doesn't see it before it's complete.
+	 *
+	 * @param path  The file.
+	 *
+	 * @param capacity  The number of bytes the ring holds, if it gets
+	 * created.  An existing file keeps its own size.
+	 *
+	 * @return  The mapped file, or null with an error message in
+	 * *error*.
+	 */
+	static std::unique_ptr<ShmRing> Create(const std::string& path, uint64_t capacity,
+	                                       std::string* error);
+
+	/**
+	 * Maps an existing ring file.
+	 *
+	 * @return  The mapped file, or null with an error message in
+	 * *error*.
+	 */
+	static std::unique_ptr<ShmRing> Open(const std::string& path, std::string* error);
+
+	~ShmRing();
+
+	/**
+	 * Appends a message.  Only the producer calls this.
+	 *
+	 * @return  False if the ring doesn't have room for the message.
+	 */
+	bool Write(std::string_view header, std::string_view data);
+
+	/**
+	 * Returns the oldest message not consumed yet.  Only the consumer
+	 * calls this.  The views point into the ring and remain valid until
+	 * Consume().
+	 *
+	 * @return  False if there's no message.
+	 */
+	bool Read(std::string_view* header, std::string_view* data);
+
+	/**
+	 * Releases the message that Read() returned, making its space
+	 * available to the producer.
+	 */
+	void Consume();
+
+	/**
+	 * Returns the number of bytes the ring holds.
+	 */
+	uint64_t Capacity() const	{ return capacity; }
+
+	/**
+	 * Returns the number of bytes taken by messages not consumed yet.
+	 */
+	uint64_t Used() const;
+
+	const std::string& Path() const	{ return path; }
+
+private:
+	struct Header;
+
+	ShmRing(std::string path, char* base, size_t size);
+
+	static std::unique_ptr<ShmRing> Map(const std::string& path, std::string* error);
+
+	Header* GetHeader() const	{ return reinterpret_cast<Header*>(base); }
+	char* Data() const;
+
+	std::string path;
+	char* base;
+	size_t size;
+	uint64_t capacity = 0;
+
+	// The position after the message that Read() returned.
+	uint64_t read_end = 0;
+};
+
+} // namespace zeek::Broker::detail
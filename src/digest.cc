@@ -6,41 +6,120 @@
 
 #include "zeek/digest.h"
 
+#include <vector>
+
 #include "zeek/Reporter.h"
 
 namespace zeek::detail {
 
+static constexpr int num_hash_algorithms = Hash_SHA512 + 1;
+
+// Contexts only get this many per algorithm waiting for reuse.
+static constexpr size_t max_pooled_contexts = 32;
+
+// Contexts released for reuse, by algorithm.  A context that gets set up
+// with the same algorithm again keeps its internal state, so OpenSSL
+// needn't allocate that anew for every digest.
+struct DigestContextPool {
+	std::vector<EVP_MD_CTX*> free[num_hash_algorithms];
+
+	~DigestContextPool()
+		{
+		for ( auto& f : free )
+			for ( auto c : f )
+				EVP_MD_CTX_free(c);
+		}
+};
+
+static thread_local DigestContextPool context_pool;
+
+// The digests, by algorithm, once used.
+static const EVP_MD* mds[num_hash_algorithms];
+
+static const EVP_MD* hash_md(HashAlgorithm alg)
+	{
+	if ( alg < 0 || alg >= num_hash_algorithms )
+		reporter->InternalError("Unknown hash algorithm passed to hash_init");
+
+	if ( mds[alg] )
+		return mds[alg];
+
+	const EVP_MD* md = nullptr;
+
+	switch ( alg ) {
+	case Hash_MD5:
+		md = EVP_md5();
+		break;
+	case Hash_SHA1:
+		md = EVP_sha1();
+		break;
+	case Hash_SHA224:
+		md = EVP_sha224();
+		break;
+	case Hash_SHA256:
+		md = EVP_sha256();
+		break;
+	case Hash_SHA384:
+		md = EVP_sha384();
+		break;
+	case Hash_SHA512:
+		md = EVP_sha512();
+		break;
+	}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	// Passing a legacy digest makes OpenSSL 3 fetch its implementation
+	// from a provider each time a context gets set up, so we do that
+	// just once.  MD5 keeps the legacy digest, as only that honors
+	// EVP_MD_CTX_FLAG_NON_FIPS_ALLOW.
+	if ( alg != Hash_MD5 )
+		{
+		if ( const EVP_MD* fetched = EVP_MD_fetch(nullptr, EVP_MD_get0_name(md), nullptr) )
+			md = fetched;
+		}
+#endif
+
+	mds[alg] = md;
+	return md;
+	}
+
+// Returns the algorithm a context has been set up with, or -1 if that's
+// none of ours.
+static int hash_algorithm_of(const EVP_MD_CTX* c)
+	{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	const EVP_MD* md = EVP_MD_CTX_get0_md(c);
+#else
+	const EVP_MD* md = EVP_MD_CTX_md(c);
+#endif
+
+	for ( int i = 0; i < num_hash_algorithms; ++i )
+		if ( md && md == mds[i] )
+			return i;
+
+	return -1;
+	}
+
 EVP_MD_CTX* hash_init(HashAlgorithm alg)
 	{
-	EVP_MD_CTX* c = EVP_MD_CTX_new();
-	const EVP_MD* md;
+	const EVP_MD* md = hash_md(alg);
+	auto& f = context_pool.free[alg];
+	EVP_MD_CTX* c;
 
-	switch (alg)
+	if ( f.empty() )
 		{
-		case Hash_MD5:
+		c = EVP_MD_CTX_new();
+
 #ifdef EVP_MD_CTX_FLAG_NON_FIPS_ALLOW
+		if ( alg == Hash_MD5 )
 			/* Allow this to work even if FIPS disables it */
 			EVP_MD_CTX_set_flags(c, EVP_MD_CTX_FLAG_NON_FIPS_ALLOW);
 #endif
-			md = EVP_md5();
-			break;
-		case Hash_SHA1:
-			md = EVP_sha1();
-			break;
-		case Hash_SHA224:
-			md = EVP_sha224();
-			break;
-		case Hash_SHA256:
-			md = EVP_sha256();
-			break;
-		case Hash_SHA384:
-			md = EVP_sha384();
-			break;
-		case Hash_SHA512:
-			md = EVP_sha512();
-			break;
-		default:
-			reporter->InternalError("Unknown hash algorithm passed to hash_init");
+		}
+	else
+		{
+		c = f.back();
+		f.pop_back();
 		}
 
 	if ( ! EVP_DigestInit_ex(c, md, NULL) )
@@ -57,10 +136,25 @@ void hash_update(EVP_MD_CTX* c, const void* data, unsigned long len)
 
 void hash_final(EVP_MD_CTX* c, u_char* md)
 	{
-	if ( ! EVP_DigestFinal(c, md, NULL) )
+	// Unlike EVP_DigestFinal(), this leaves the context set up for
+	// reuse.
+	if ( ! EVP_DigestFinal_ex(c, md, NULL) )
 		reporter->InternalError("EVP_DigestFinal failed");
 
-	EVP_MD_CTX_free(c);
+	hash_free(c);
+	}
+
+void hash_free(EVP_MD_CTX* c)
+	{
+	int alg = hash_algorithm_of(c);
+
+	if ( alg < 0 || context_pool.free[alg].size() >= max_pooled_contexts )
+		{
+		EVP_MD_CTX_free(c);
+		return;
+		}
+
+	context_pool.free[alg].push_back(c);
 	}
 
 unsigned char* internal_md5(const unsigned char* data, unsigned long len, unsigned char* out)
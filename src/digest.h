@@ -52,12 +52,26 @@ inline const char* sha256_digest_print(const u_char digest[SHA256_DIGEST_LENGTH]
 	return digest_print(digest, SHA256_DIGEST_LENGTH);
 	}
 
+/**
+ * Returns a context for computing a digest.  Contexts get recycled: pass
+ * them to hash_final() or, to abandon the computation, to hash_free(),
+ * rather than releasing them directly.
+ * @param alg Digest algorithm to use.
+ */
 EVP_MD_CTX* hash_init(HashAlgorithm alg);
 
 void hash_update(EVP_MD_CTX* c, const void* data, unsigned long len);
 
+/**
+ * Writes the digest to md and releases the context.
+ */
 void hash_final(EVP_MD_CTX* c, u_char* md);
 
+/**
+ * Releases a context without computing its digest.
+ */
+void hash_free(EVP_MD_CTX* c);
+
 unsigned char* internal_md5(const unsigned char* data, unsigned long len, unsigned char* out);
 
 /**
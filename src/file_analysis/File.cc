@@ -8,10 +8,13 @@
 #include "zeek/file_analysis/FileTimer.h"
 #include "zeek/file_analysis/Analyzer.h"
 #include "zeek/file_analysis/Manager.h"
+#include "zeek/file_analysis/ResultCache.h"
+#include "zeek/MemoryArenas.h"
 #include "zeek/Reporter.h"
 #include "zeek/Val.h"
 #include "zeek/Type.h"
 #include "zeek/Event.h"
+#include "zeek/NetVar.h"
 #include "zeek/RuleMatcher.h"
 
 #include "zeek/analyzer/Analyzer.h"
@@ -82,7 +85,8 @@ void File::StaticInit()
 
 File::File(const std::string& file_id, const std::string& source_name, Connection* conn,
            analyzer::Tag tag, bool is_orig)
-	: id(file_id), val(nullptr), file_reassembler(nullptr), stream_offset(0),
+	: id(file_id), val(nullptr), file_reassembler(nullptr),
+	  cached_contents(nullptr), cache_declined(false), stream_offset(0),
 	  reassembly_max_buffer(0), did_metadata_inference(false),
 	  reassembly_enabled(false), postpone_timeout(false), done(false),
 	  analyzers(this)
@@ -108,6 +112,7 @@ File::~File()
 	{
 	DBG_LOG(DBG_FILE_ANALYSIS, "[%s] Destroying File object", id.c_str());
 	delete file_reassembler;
+	delete cached_contents;
 
 	for ( auto a : done_analyzers )
 		delete a;
@@ -442,10 +447,49 @@ void File::DeliverStream(const u_char* data, uint64_t len)
 			}
 		}
 
+	if ( cached_contents )
+		cached_contents->Add(data, len);
+
 	stream_offset += len;
 	IncrementByteCount(len, seen_bytes_idx);
 	}
 
+detail::CachedContents* File::CacheContents(const file_analysis::Tag& tag)
+	{
+	if ( cached_contents )
+		return cached_contents->Collecting() ? cached_contents : nullptr;
+
+	if ( cache_declined || ! detail::result_cache ||
+	     ! detail::result_cache->Enabled(tag) )
+		return nullptr;
+
+	uint64_t max_size = BifConst::file_result_cache_max_file_size;
+
+	// The BOF buffer must still hold everything delivered so far.
+	if ( done || bof_buffer.size < stream_offset || stream_offset > max_size ||
+	     LookupFieldDefaultCount(missing_bytes_idx) > 0 ||
+	     LookupFieldDefaultCount(total_bytes_idx) > max_size )
+		{
+		cache_declined = true;
+		return nullptr;
+		}
+
+	cached_contents = new detail::CachedContents(max_size);
+	uint64_t n = 0;
+
+	for ( auto chunk : bof_buffer.chunks )
+		{
+		if ( n >= stream_offset )
+			break;
+
+		uint64_t len = std::min(static_cast<uint64_t>(chunk->Len()), stream_offset - n);
+		cached_contents->Add(chunk->Bytes(), len);
+		n += len;
+		}
+
+	return cached_contents;
+	}
+
 void File::DeliverChunk(const u_char* data, uint64_t len, uint64_t offset)
 	{
 	// Potentially handle reassembly and deliver to the stream analyzers.
@@ -524,6 +568,7 @@ void File::DoneWithAnalyzer(Analyzer* analyzer)
 
 void File::DataIn(const u_char* data, uint64_t len, uint64_t offset)
 	{
+	zeek::detail::MemoryTagScope mem_tag(zeek::detail::MEMORY_FILES);
 	analyzers.DrainModifications();
 	DeliverChunk(data, len, offset);
 	analyzers.DrainModifications();
@@ -531,6 +576,7 @@ void File::DataIn(const u_char* data, uint64_t len, uint64_t offset)
 
 void File::DataIn(const u_char* data, uint64_t len)
 	{
+	zeek::detail::MemoryTagScope mem_tag(zeek::detail::MEMORY_FILES);
 	analyzers.DrainModifications();
 	DeliverChunk(data, len, stream_offset);
 	analyzers.DrainModifications();
@@ -561,6 +607,9 @@ void File::EndOfFile()
 
 	done = true;
 
+	if ( cached_contents )
+		cached_contents->Finish();
+
 	file_analysis::Analyzer* a = nullptr;
 	IterCookie* c = analyzers.InitForIteration();
 
@@ -570,6 +619,10 @@ void File::EndOfFile()
 			analyzers.QueueRemove(a->Tag(), a->GetArgs());
 		}
 
+	delete cached_contents;
+	cached_contents = nullptr;
+	cache_declined = true;
+
 	FileEvent(file_state_remove);
 
 	analyzers.DrainModifications();
@@ -587,6 +640,9 @@ void File::Gap(uint64_t offset, uint64_t len)
 		return;
 		}
 
+	if ( cached_contents )
+		cached_contents->Abandon();
+
 	if ( ! bof_buffer.full )
 		{
 		DBG_LOG(DBG_FILE_ANALYSIS, "[%s] File gap before bof_buffer filled, continued without attempting to fill bof_buffer.", id.c_str());
@@ -650,10 +706,16 @@ void File::FileEvent(EventHandlerPtr h, Args args)
 		}
 	}
 
+bool File::PermitWeird(uint32_t id, uint64_t threshold, uint64_t rate,
+                       double duration)
+	{
+	return zeek::detail::PermitWeird(weird_state, id, threshold, rate, duration);
+	}
+
 bool File::PermitWeird(const char* name, uint64_t threshold, uint64_t rate,
                        double duration)
 	{
-	return zeek::detail::PermitWeird(weird_state, name, threshold, rate, duration);
+	return PermitWeird(reporter->WeirdID(name), threshold, rate, duration);
 	}
 
 } // namespace zeek::file_analysis
@@ -23,6 +23,7 @@ using RecordTypePtr = IntrusivePtr<RecordType>;
 }
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(FileReassembler, zeek, file_analysis);
+ZEEK_FORWARD_DECLARE_NAMESPACED(CachedContents, zeek, file_analysis, detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Tag, zeek, file_analysis);
 
 namespace zeek::file_analysis {
@@ -233,10 +234,32 @@ public:
 	/**
 	 * Whether to permit a weird to carry on through the full reporter/weird
 	 * framework.
+	 *
+	 * @param id  The weird's name, as a Reporter::WeirdID().
 	 */
+	bool PermitWeird(uint32_t id, uint64_t threshold, uint64_t rate,
+	                 double duration);
+
+	[[deprecated("Remove in v5.1. Use PermitWeird() with the name's Reporter::WeirdID().")]]
 	bool PermitWeird(const char* name, uint64_t threshold, uint64_t rate,
 	                 double duration);
 
+	/**
+	 * Has the file's contents collected for the result cache on behalf of
+	 * an analyzer, if the analyzer may use the cache and all contents
+	 * seen so far are still at hand.
+	 * @param tag the analyzer tag of the file analyzer asking.
+	 * @return the contents, or a null pointer if they're not collected.
+	 */
+	detail::CachedContents* CacheContents(const file_analysis::Tag& tag);
+
+	/**
+	 * @return the contents collected for the result cache, or a null
+	 *         pointer if there are none.
+	 */
+	detail::CachedContents* GetCachedContents() const
+		{ return cached_contents; }
+
 protected:
 	friend class Manager;
 	friend class FileReassembler;
@@ -353,6 +376,8 @@ protected:
 	std::string id;                 /**< A pretty hash that likely identifies file */
 	RecordValPtr val;            /**< \c fa_file from script layer. */
 	FileReassembler* file_reassembler; /**< A reassembler for the file if it's needed. */
+	detail::CachedContents* cached_contents; /**< Contents collected for the result cache. */
+	bool cache_declined;       /**< Whether the contents are unfit for the result cache. */
 	uint64_t stream_offset;      /**< The offset of the file which has been forwarded. */
 	uint64_t reassembly_max_buffer;      /**< Maximum allowed buffer for reassembly. */
 	bool did_metadata_inference;        /**< Whether the metadata inference has already been attempted. */
@@ -41,6 +41,12 @@ uint64_t FileReassembler::FlushTo(uint64_t sequence)
 	return rval;
 	}
 
+void FileReassembler::Evict()
+	{
+	ClearOldBlocks();
+	Flush();
+	}
+
 void FileReassembler::BlockInserted(DataBlockMap::const_iterator it)
 	{
 	const auto& start_block = it->second;
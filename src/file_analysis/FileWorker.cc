@@ -0,0 +1,242 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/file_analysis/FileWorker.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "zeek/util.h"
+
+namespace zeek::file_analysis::detail {
+
+// Streams hand over contents in chunks of this size by default, to keep
+// synchronization rare.
+static constexpr size_t default_flush_size = 64 * 1024;
+
+// Submitting to an analysis worker blocks once it has this much queued.
+static constexpr uint64_t max_analysis_queued = 16 * 1024 * 1024;
+
+static std::vector<FileWorker*> workers;
+static size_t next_worker = 0;
+static FileWorker* writer = nullptr;
+
+OffloadedStream::OffloadedStream()
+	: OffloadedStream(FileWorker::Next(), default_flush_size)
+	{
+	}
+
+OffloadedStream::OffloadedStream(FileWorker* arg_worker, size_t arg_flush_size)
+	: worker(arg_worker), flush_size(arg_flush_size)
+	{
+	}
+
+OffloadedStream::~OffloadedStream()
+	{
+	}
+
+void OffloadedStream::Deliver(const u_char* data, uint64_t len)
+	{
+	if ( ! worker )
+		{
+		Process(data, len);
+		return;
+		}
+
+	while ( len > 0 )
+		{
+		uint64_t n = std::min(len, static_cast<uint64_t>(flush_size - pending.size()));
+		pending.append(reinterpret_cast<const char*>(data), n);
+		data += n;
+		len -= n;
+
+		if ( pending.size() == flush_size )
+			Flush();
+		}
+	}
+
+void OffloadedStream::DeliverHole(uint64_t len)
+	{
+	if ( ! worker )
+		{
+		Process(nullptr, len);
+		return;
+		}
+
+	Flush();
+	++submitted;
+	worker->Submit(this, {}, len);
+	}
+
+void OffloadedStream::Flush()
+	{
+	if ( pending.empty() )
+		return;
+
+	std::string data;
+	data.swap(pending);
+	uint64_t len = data.size();
+
+	++submitted;
+
+	if ( ! worker->Submit(this, std::move(data)) )
+		{
+		// Keep the offsets of what follows intact.
+		dropped += len;
+		worker->Submit(this, {}, len);
+		}
+	}
+
+void OffloadedStream::Wait()
+	{
+	if ( ! worker )
+		return;
+
+	Flush();
+
+	if ( completed.load(std::memory_order_acquire) != submitted )
+		worker->WaitFor(this);
+	}
+
+FileWorker::FileWorker(uint64_t arg_max_queued, bool arg_drop)
+	: max_queued(arg_max_queued), drop(arg_drop)
+	{
+	}
+
+FileWorker::~FileWorker()
+	{
+	}
+
+void FileWorker::StartWorkers(int num)
+	{
+	for ( int i = 0; i < num; ++i )
+		{
+		auto w = new FileWorker(max_analysis_queued, false);
+		w->SetName(util::fmt("file-worker/%d", i));
+		workers.push_back(w);
+		w->Start();
+		w->SetOSName(w->Name());
+		}
+	}
+
+FileWorker* FileWorker::Next()
+	{
+	if ( workers.empty() )
+		return nullptr;
+
+	auto w = workers[next_worker];
+	next_worker = (next_worker + 1) % workers.size();
+	return w;
+	}
+
+void FileWorker::StartWriter(uint64_t max_queued)
+	{
+	writer = new FileWorker(max_queued, true);
+	writer->SetName("file-writer");
+	writer->Start();
+	writer->SetOSName(writer->Name());
+	}
+
+FileWorker* FileWorker::Writer()
+	{
+	return writer;
+	}
+
+bool FileWorker::Submit(OffloadedStream* s, std::string data, uint64_t hole)
+	{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if ( ! data.empty() )
+		{
+		if ( drop && queued_bytes + data.size() > max_queued && ! stopping )
+			return false;
+
+		done_cv.wait(lock, [this]
+			{ return queued_bytes < max_queued || stopping; });
+		}
+
+	s->max_queued = std::max(s->max_queued, queued_bytes);
+
+	Job job{s, std::move(data), hole};
+
+	if ( stopping )
+		{
+		// The thread may be gone once it has finished its jobs, so
+		// we process the data ourselves after that.
+		done_cv.wait(lock, [this] { return jobs.empty(); });
+		lock.unlock();
+
+		Process(job);
+		s->completed.fetch_add(1, std::memory_order_release);
+		return true;
+		}
+
+	queued_bytes += job.data.size();
+	jobs.push_back(std::move(job));
+	work_cv.notify_one();
+	return true;
+	}
+
+void FileWorker::WaitFor(const OffloadedStream* s)
+	{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	done_cv.wait(lock, [s]
+		{ return s->completed.load(std::memory_order_acquire) == s->submitted; });
+	}
+
+void FileWorker::Process(const Job& job)
+	{
+	if ( job.data.empty() )
+		job.stream->Process(nullptr, job.hole);
+	else
+		job.stream->Process(reinterpret_cast<const u_char*>(job.data.data()), job.data.size());
+	}
+
+void FileWorker::Run()
+	{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while ( true )
+		{
+		work_cv.wait(lock, [this] { return ! jobs.empty() || stopping; });
+
+		// Finish what's queued even when stopping, so that nobody
+		// waits forever.
+		if ( jobs.empty() )
+			break;
+
+		// The job stays queued while it's being processed, so that
+		// an empty queue means that nothing is in progress.
+		Job& job = jobs.front();
+
+		lock.unlock();
+		Process(job);
+		lock.lock();
+
+		queued_bytes -= job.data.size();
+		job.stream->completed.fetch_add(1, std::memory_order_release);
+		jobs.pop_front();
+		done_cv.notify_all();
+		}
+	}
+
+void FileWorker::OnSignalStop()
+	{
+	std::lock_guard<std::mutex> lock(mutex);
+	stopping = true;
+	work_cv.notify_all();
+	done_cv.notify_all();
+	}
+
+void FileWorker::OnWaitForStop()
+	{
+	OnSignalStop();
+	}
+
+void FileWorker::OnKill()
+	{
+	OnSignalStop();
+	}
+
+} // namespace zeek::file_analysis::detail
@@ -0,0 +1,199 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Threads that file analyzers can hand the processing of file contents to,
+// so that expensive analysis or slow disks don't hold up packet processing.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include "zeek/threading/BasicThread.h"
+
+namespace zeek::file_analysis::detail {
+
+class FileWorker;
+
+/**
+ * The contents of a file as one analyzer processes them off the main
+ * thread.  Data passed to Deliver() reaches Process() in order, on a worker
+ * thread if there is one, or right away otherwise.  Whatever Process()
+ * computes may only be picked up once Wait() has returned, so analyzers
+ * raise their events at the same points as when running inline, keeping
+ * results deterministic.
+ *
+ * Process() must only touch state of its own, not Zeek's.  Derived classes
+ * must call Wait() in their destructor.
+ */
+class OffloadedStream {
+public:
+	/**
+	 * Constructor.  Assigns the stream to the next of the workers that
+	 * file_analysis_threads started.
+	 */
+	OffloadedStream();
+
+	/**
+	 * Constructor.
+	 *
+	 * @param worker  The worker to process the contents on, or null for
+	 * processing them inline.
+	 *
+	 * @param flush_size  The size of the chunks the contents get handed
+	 * over in.  Except for the last one, chunks start at multiples of it.
+	 */
+	OffloadedStream(FileWorker* worker, size_t flush_size);
+
+	virtual ~OffloadedStream();
+
+	/**
+	 * Passes on the next chunk of the contents.
+	 */
+	void Deliver(const u_char* data, uint64_t len);
+
+	/**
+	 * Passes on a chunk of the contents that's missing.
+	 */
+	void DeliverHole(uint64_t len);
+
+	/**
+	 * Returns once all delivered contents have been processed.
+	 */
+	void Wait();
+
+	/**
+	 * Returns the number of bytes that the worker had no room for, and
+	 * which reached Process() as holes instead.
+	 */
+	uint64_t Dropped() const	{ return dropped; }
+
+	/**
+	 * Returns the largest amount of data that was queued on the worker
+	 * when this stream handed over a chunk.
+	 */
+	uint64_t MaxQueued() const	{ return max_queued; }
+
+	/**
+	 * Returns true if the contents get processed on a worker thread.
+	 */
+	bool Offloaded() const	{ return worker != nullptr; }
+
+protected:
+	/**
+	 * Processes a chunk of the contents.  May run on a worker thread.
+	 *
+	 * @param data  The chunk, or null if it's missing.
+	 *
+	 * @param len  The chunk's length.
+	 */
+	virtual void Process(const u_char* data, uint64_t len) = 0;
+
+private:
+	friend class FileWorker;
+
+	void Flush();
+
+	FileWorker* worker;	// Null if processing inline.
+	size_t flush_size;
+	std::string pending;	// Contents not yet handed to the worker.
+	uint64_t submitted = 0;
+	uint64_t dropped = 0;
+	uint64_t max_queued = 0;
+	std::atomic<uint64_t> completed{0};
+};
+
+/**
+ * A thread processing the contents handed to it by OffloadedStreams.
+ */
+class FileWorker : public threading::BasicThread {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param max_queued  The amount of data the worker queues at most.
+	 *
+	 * @param drop  If true, data that doesn't fit into the queue gets
+	 * dropped.  Otherwise, submitting blocks until there's room.
+	 */
+	FileWorker(uint64_t max_queued, bool drop);
+	~FileWorker() override;
+
+	/**
+	 * Starts the given number of workers for analysis.  OffloadedStreams
+	 * created afterwards get assigned to them in turn.
+	 */
+	static void StartWorkers(int num);
+
+	/**
+	 * Returns the analysis worker for the next stream, or null if there
+	 * are none.
+	 */
+	static FileWorker* Next();
+
+	/**
+	 * Starts the worker that writes extracted files.
+	 *
+	 * @param max_queued  The amount of data waiting to be written at
+	 * most, across all files.
+	 */
+	static void StartWriter(uint64_t max_queued);
+
+	/**
+	 * Returns the worker that writes extracted files, or null if there's
+	 * none.
+	 */
+	static FileWorker* Writer();
+
+	/**
+	 * Queues a chunk of contents.  Blocks while the queue is full, unless
+	 * the worker drops data.
+	 *
+	 * @param s  The stream the chunk belongs to.
+	 *
+	 * @param data  The chunk.  If empty, the chunk is a hole of the given
+	 * length.
+	 *
+	 * @param hole  The length of a missing chunk.
+	 *
+	 * @return  False if the chunk got dropped.  Holes always get queued.
+	 */
+	bool Submit(OffloadedStream* s, std::string data, uint64_t hole = 0);
+
+	/**
+	 * Blocks until all contents queued for a stream have been
+	 * processed.
+	 */
+	void WaitFor(const OffloadedStream* s);
+
+protected:
+	void Run() override;
+	void OnSignalStop() override;
+	void OnWaitForStop() override;
+	void OnKill() override;
+
+private:
+	struct Job {
+		OffloadedStream* stream;
+		std::string data;
+		uint64_t hole;
+	};
+
+	void Process(const Job& job);
+
+	uint64_t max_queued;
+	bool drop;
+
+	std::mutex mutex;
+	std::condition_variable work_cv;	// Signals new jobs, or stopping.
+	std::condition_variable done_cv;	// Signals completed jobs.
+	std::deque<Job> jobs;
+	uint64_t queued_bytes = 0;
+	bool stopping = false;
+};
+
+} // namespace zeek::file_analysis::detail
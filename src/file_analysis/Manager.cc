@@ -3,14 +3,18 @@
 #include "zeek/file_analysis/Manager.h"
 
 #include <openssl/md5.h>
+#include <algorithm>
 
 #include "zeek/file_analysis/File.h"
 #include "zeek/file_analysis/Analyzer.h"
+#include "zeek/file_analysis/FileWorker.h"
+#include "zeek/file_analysis/ResultCache.h"
 #include "zeek/Event.h"
 #include "zeek/UID.h"
 #include "zeek/digest.h"
 #include "zeek/plugin/Manager.h"
 #include "zeek/analyzer/Manager.h"
+#include "zeek/NetVar.h"
 
 #include "file_analysis/file_analysis.bif.h"
 
@@ -44,6 +48,13 @@ void Manager::InitPreScript()
 
 void Manager::InitPostScript()
 	{
+	detail::FileWorker::StartWorkers(BifConst::file_analysis_threads);
+
+	if ( BifConst::file_extraction_buffer > 0 )
+		detail::FileWorker::StartWriter(BifConst::file_extraction_buffer);
+
+	if ( BifConst::file_result_cache_size > 0 )
+		detail::result_cache = new detail::ResultCache(BifConst::file_result_cache_size);
 	}
 
 void Manager::InitMagic()
@@ -60,6 +71,9 @@ void Manager::Terminate()
 	for ( const auto& entry : id_map )
 		keys.push_back(entry.first);
 
+	// Time out the files in a stable order.
+	std::sort(keys.begin(), keys.end());
+
 	for ( const string& key : keys )
 		Timeout(key, true);
 
@@ -5,6 +5,7 @@
 #include <string>
 #include <set>
 #include <map>
+#include <unordered_map>
 
 #include "zeek/file_analysis/Component.h"
 #include "zeek/RunState.h"
@@ -415,11 +416,11 @@ protected:
 
 private:
 	typedef std::set<Tag> TagSet;
-	typedef std::map<std::string, TagSet*> MIMEMap;
+	typedef std::unordered_map<std::string, TagSet*> MIMEMap;
 
 	TagSet* LookupMIMEType(const std::string& mtype, bool add_if_not_found);
 
-	std::map<std::string, File*> id_map;  /**< Map file ID to file_analysis::File records. */
+	std::unordered_map<std::string, File*> id_map;  /**< Map file ID to file_analysis::File records. */
 	std::set<std::string> ignored; /**< Ignored files.  Will be finally removed on EOF. */
 	std::string current_file_id;	/**< Hash of what get_file_handle event sets. */
 	zeek::detail::RuleFileMagicState* magic_state;	/**< File magic signature match state. */
@@ -0,0 +1,113 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/file_analysis/ResultCache.h"
+
+#include <tuple>
+
+#include "zeek/Hash.h"
+
+namespace zeek::file_analysis::detail {
+
+ResultCache* result_cache = nullptr;
+
+bool ResultCache::Key::operator<(const Key& other) const
+	{
+	return std::tie(size, digest[0], digest[1]) <
+	       std::tie(other.size, other.digest[0], other.digest[1]);
+	}
+
+ResultCache::ResultCache(size_t arg_max_entries)
+	: max_entries(arg_max_entries)
+	{
+	}
+
+ResultCache::Key ResultCache::MakeKey(const std::string& contents)
+	{
+	Key key;
+	key.size = contents.size();
+	zeek::detail::KeyedHash::Hash128(contents.data(), contents.size(), &key.digest);
+	return key;
+	}
+
+void ResultCache::Touch(const Key& key)
+	{
+	auto it = entries.find(key);
+
+	if ( it == entries.end() )
+		{
+		++misses;
+		return;
+		}
+
+	++hits;
+	lru.splice(lru.begin(), lru, it->second.lru_pos);
+	}
+
+const std::string* ResultCache::Lookup(const Key& key, const std::string& name) const
+	{
+	auto it = entries.find(key);
+
+	if ( it == entries.end() )
+		return nullptr;
+
+	auto r = it->second.results.find(name);
+
+	if ( r == it->second.results.end() )
+		return nullptr;
+
+	return &r->second;
+	}
+
+void ResultCache::Insert(const Key& key, const std::string& name, std::string result)
+	{
+	auto it = entries.find(key);
+
+	if ( it == entries.end() )
+		{
+		if ( entries.size() >= max_entries )
+			{
+			entries.erase(lru.back());
+			lru.pop_back();
+			}
+
+		lru.push_front(key);
+		it = entries.emplace(key, Entry{{}, lru.begin()}).first;
+		}
+
+	it->second.results[name] = std::move(result);
+	}
+
+void CachedContents::Add(const u_char* arg_data, uint64_t len)
+	{
+	if ( state != COLLECTING )
+		return;
+
+	data.append(reinterpret_cast<const char*>(arg_data), len);
+
+	if ( data.size() > max_size )
+		state = ABANDONED;
+	}
+
+void CachedContents::Finish()
+	{
+	if ( state != COLLECTING )
+		return;
+
+	state = COMPLETE;
+	key = ResultCache::MakeKey(data);
+	result_cache->Touch(key);
+	}
+
+const std::string* CachedContents::Lookup(const std::string& name) const
+	{
+	return state == COMPLETE ? result_cache->Lookup(key, name) : nullptr;
+	}
+
+void CachedContents::Insert(const std::string& name, std::string result)
+	{
+	if ( state == COMPLETE )
+		result_cache->Insert(key, name, std::move(result));
+	}
+
+} // namespace zeek::file_analysis::detail
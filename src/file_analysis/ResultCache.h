@@ -0,0 +1,165 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A cache of file analysis results by file contents, so that analyzers can
+// replay them for files seen before rather than analyzing them again.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+
+#include "zeek/file_analysis/Tag.h"
+
+namespace zeek::file_analysis::detail {
+
+/**
+ * Maps file contents to the results that analyzers computed for them.
+ * Contents are identified by their size and a keyed 128-bit hash of them,
+ * which is much cheaper to compute than the cryptographic hashes it often
+ * stands in for, yet can't be made to collide without knowing the key.  The
+ * least recently used contents get evicted first.
+ */
+class ResultCache {
+public:
+	struct Key {
+		uint64_t size;
+		uint64_t digest[2];
+
+		bool operator<(const Key& other) const;
+	};
+
+	/**
+	 * Constructor.
+	 *
+	 * @param max_entries  The number of files to keep results for.
+	 */
+	explicit ResultCache(size_t max_entries);
+
+	/**
+	 * Allows an analyzer to use the cache.
+	 */
+	void Enable(const file_analysis::Tag& tag)	{ enabled.insert(tag); }
+
+	/**
+	 * Returns true if an analyzer may use the cache.
+	 */
+	bool Enabled(const file_analysis::Tag& tag) const
+		{ return enabled.find(tag) != enabled.end(); }
+
+	/**
+	 * Returns the key for file contents.
+	 */
+	static Key MakeKey(const std::string& contents);
+
+	/**
+	 * Marks contents as used, counting a hit if there are results for
+	 * them and a miss otherwise.
+	 */
+	void Touch(const Key& key);
+
+	/**
+	 * Returns the result an analyzer stored for contents, or null if
+	 * there's none.
+	 *
+	 * @param name  The name the analyzer stored the result under.
+	 */
+	const std::string* Lookup(const Key& key, const std::string& name) const;
+
+	/**
+	 * Stores an analyzer's result for contents.
+	 */
+	void Insert(const Key& key, const std::string& name, std::string result);
+
+	uint64_t Hits() const	{ return hits; }
+	uint64_t Misses() const	{ return misses; }
+
+private:
+	struct Entry {
+		std::map<std::string, std::string> results;
+		std::list<Key>::iterator lru_pos;
+	};
+
+	size_t max_entries;
+	std::set<file_analysis::Tag> enabled;
+	std::map<Key, Entry> entries;
+	std::list<Key> lru;	// Most recently used first.
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+};
+
+// Null if file_result_cache_size is zero.
+extern ResultCache* result_cache;
+
+/**
+ * The contents of a file, collected while it's small enough for the result
+ * cache.  Analyzers using the cache leave the contents to it while it's
+ * collecting them, and then either replay results once the file is
+ * complete, or catch up on the collected data.
+ */
+class CachedContents {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param max_size  The size up to which files get collected.
+	 */
+	explicit CachedContents(uint64_t arg_max_size) : max_size(arg_max_size)	{ }
+
+	/**
+	 * Adds the next chunk.  Collecting stops once the file gets too
+	 * large, though the data collected so far, including this chunk,
+	 * remains available for analyzers to catch up on.
+	 */
+	void Add(const u_char* data, uint64_t len);
+
+	/**
+	 * Stops collecting, such as when contents are missing.
+	 */
+	void Abandon()	{ if ( state == COLLECTING ) state = ABANDONED; }
+
+	/**
+	 * Marks the contents as complete, and looks them up in the cache.
+	 */
+	void Finish();
+
+	/**
+	 * Returns true while more contents may get collected.
+	 */
+	bool Collecting() const	{ return state == COLLECTING; }
+
+	/**
+	 * Returns true if the contents are complete, so that results for
+	 * them may be looked up and stored.
+	 */
+	bool Complete() const	{ return state == COMPLETE; }
+
+	/**
+	 * Returns the contents collected.
+	 */
+	const std::string& Data() const	{ return data; }
+
+	/**
+	 * Returns an analyzer's result for the complete contents, or null if
+	 * there's none cached.
+	 */
+	const std::string* Lookup(const std::string& name) const;
+
+	/**
+	 * Stores an analyzer's result for the complete contents.
+	 */
+	void Insert(const std::string& name, std::string result);
+
+private:
+	enum State { COLLECTING, ABANDONED, COMPLETE };
+
+	uint64_t max_size;
+	State state = COLLECTING;
+	std::string data;
+	ResultCache::Key key;
+};
+
+} // namespace zeek::file_analysis::detail
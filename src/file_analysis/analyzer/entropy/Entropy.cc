@@ -20,6 +20,7 @@ Entropy::Entropy(RecordValPtr args, file_analysis::File* file)
 
 Entropy::~Entropy()
 	{
+	Wait();
 	Unref(entropy);
 	}
 
@@ -34,10 +35,15 @@ bool Entropy::DeliverStream(const u_char* data, uint64_t len)
 	if ( ! fed )
 		fed = len > 0;
 
-	entropy->Feed(data, len);
+	Deliver(data, len);
 	return true;
 	}
 
+void Entropy::Process(const u_char* data, uint64_t len)
+	{
+	entropy->Feed(data, len);
+	}
+
 bool Entropy::EndOfFile()
 	{
 	Finalize();
@@ -51,6 +57,8 @@ bool Entropy::Undelivered(uint64_t offset, uint64_t len)
 
 void Entropy::Finalize()
 	{
+	Wait();
+
 	if ( ! fed )
 		return;
 
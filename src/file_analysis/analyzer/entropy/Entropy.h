@@ -8,15 +8,17 @@
 #include "zeek/OpaqueVal.h"
 #include "zeek/file_analysis/File.h"
 #include "zeek/file_analysis/Analyzer.h"
+#include "zeek/file_analysis/FileWorker.h"
 
 #include "file_analysis/analyzer/entropy/events.bif.h"
 
 namespace zeek::file_analysis::detail {
 
 /**
- * An analyzer to produce entropy of file contents.
+ * An analyzer to produce entropy of file contents.  The entropy gets
+ * computed on a worker thread, if there are any.
  */
-class Entropy : public file_analysis::Analyzer {
+class Entropy : public file_analysis::Analyzer, private OffloadedStream {
 public:
 
 	/**
@@ -75,6 +77,8 @@ protected:
 	void Finalize();
 
 private:
+	void Process(const u_char* data, uint64_t len) override;
+
 	EntropyVal* entropy;
 	bool fed;
 };
@@ -2,7 +2,9 @@
 
 #include "zeek/file_analysis/analyzer/extract/Extract.h"
 
+#include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <string>
 
 #include "zeek/util.h"
@@ -11,10 +13,15 @@
 
 namespace zeek::file_analysis::detail {
 
+// Extracted contents get written in blocks of this size, at offsets that
+// are multiples of it.
+static constexpr size_t write_block_size = 256 * 1024;
+
 Extract::Extract(RecordValPtr args, file_analysis::File* file,
                  const std::string& arg_filename, uint64_t arg_limit)
     : file_analysis::Analyzer(file_mgr->GetComponentTag("EXTRACT"),
                               std::move(args), file),
+      OffloadedStream(FileWorker::Writer(), write_block_size),
       filename(arg_filename), limit(arg_limit), depth(0)
 	{
 	fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666);
@@ -30,6 +37,8 @@ Extract::Extract(RecordValPtr args, file_analysis::File* file,
 
 Extract::~Extract()
 	{
+	Wait();
+
 	if ( fd )
 		util::safe_close(fd);
 	}
@@ -108,24 +117,72 @@ bool Extract::DeliverStream(const u_char* data, uint64_t len)
 
 	if ( towrite > 0 )
 		{
-		util::safe_write(fd, reinterpret_cast<const char*>(data), towrite);
+		Deliver(data, towrite);
 		depth += towrite;
 		}
 
+	if ( limit_exceeded )
+		ReportStats();
+
 	return ( ! limit_exceeded );
 	}
 
 bool Extract::Undelivered(uint64_t offset, uint64_t len)
 	{
+	if ( ! fd )
+		return true;
+
 	if ( depth == offset )
 		{
-		char* tmp = new char[len]();
-		util::safe_write(fd, tmp, len);
-		delete [] tmp;
+		DeliverHole(len);
 		depth += len;
 		}
 
 	return true;
 	}
 
+bool Extract::EndOfFile()
+	{
+	ReportStats();
+	return true;
+	}
+
+void Extract::Process(const u_char* data, uint64_t len)
+	{
+	if ( data )
+		{
+		util::safe_write(fd, reinterpret_cast<const char*>(data), len);
+		return;
+		}
+
+	// Missing data reads back as zeros; extending the file gets us there
+	// without writing them out.
+	struct stat st;
+
+	if ( fstat(fd, &st) < 0 || ftruncate(fd, st.st_size + len) < 0 )
+		{
+		char buf[128];
+		util::zeek_strerror_r(errno, buf, sizeof(buf));
+		fprintf(stderr, "cannot extend %s: %s\n", filename.c_str(), buf);
+		}
+	}
+
+void Extract::ReportStats()
+	{
+	Wait();
+
+	if ( reported || ! Offloaded() || ! file_extraction_stats )
+		return;
+
+	reported = true;
+
+	file_analysis::File* f = GetFile();
+	f->FileEvent(file_extraction_stats, {
+		f->ToVal(),
+		GetArgs(),
+		val_mgr->Count(Dropped()),
+		val_mgr->Count(MaxQueued())
+	});
+	}
+
 } // namespace zeek::file_analysis::detail
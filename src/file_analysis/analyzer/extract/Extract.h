@@ -7,15 +7,17 @@
 #include "zeek/Val.h"
 #include "zeek/file_analysis/File.h"
 #include "zeek/file_analysis/Analyzer.h"
+#include "zeek/file_analysis/FileWorker.h"
 
 #include "file_analysis/analyzer/extract/events.bif.h"
 
 namespace zeek::file_analysis::detail {
 
 /**
- * An analyzer to extract content of files to local disk.
+ * An analyzer to extract content of files to local disk.  If
+ * file_extraction_buffer is set, the writing happens on a separate thread.
  */
-class Extract : public file_analysis::Analyzer {
+class Extract : public file_analysis::Analyzer, private OffloadedStream {
 public:
 
 	/**
@@ -40,6 +42,12 @@ public:
 	 */
 	bool Undelivered(uint64_t offset, uint64_t len) override;
 
+	/**
+	 * Waits for the extraction file to be fully written.
+	 * @return true
+	 */
+	bool EndOfFile() override;
+
 	/**
 	 * Create a new instance of an Extract analyzer.
 	 * @param args the \c AnalyzerArgs value which represents the analyzer.
@@ -71,10 +79,16 @@ protected:
 	        const std::string& arg_filename, uint64_t arg_limit);
 
 private:
+	void Process(const u_char* data, uint64_t len) override;
+
+	// Raises file_extraction_stats once the file is written.
+	void ReportStats();
+
 	std::string filename;
 	int fd;
 	uint64_t limit;
 	uint64_t depth;
+	bool reported = false;
 };
 
 } // namespace zeek::file_analysis::detail
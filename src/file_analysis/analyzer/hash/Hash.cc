@@ -7,6 +7,7 @@
 #include "zeek/util.h"
 #include "zeek/Event.h"
 #include "zeek/file_analysis/Manager.h"
+#include "zeek/file_analysis/ResultCache.h"
 
 namespace zeek::file_analysis::detail {
 
@@ -14,13 +15,14 @@ Hash::Hash(RecordValPtr args, file_analysis::File* file,
            HashVal* hv, const char* arg_kind)
 	: file_analysis::Analyzer(file_mgr->GetComponentTag(util::to_upper(arg_kind).c_str()),
 	                                std::move(args), file),
-	  hash(hv), fed(false), kind(arg_kind)
+	  hash(hv), fed(false), started(false), deferred(false), kind(arg_kind)
 	{
 	hash->Init();
 	}
 
 Hash::~Hash()
 	{
+	Wait();
 	Unref(hash);
 	}
 
@@ -32,13 +34,67 @@ bool Hash::DeliverStream(const u_char* data, uint64_t len)
 	if ( ! fed )
 		fed = len > 0;
 
-	hash->Feed(data, len);
+	if ( ! started )
+		{
+		started = true;
+		deferred = GetFile()->CacheContents(Tag()) != nullptr;
+		}
+
+	if ( deferred && ! CatchUp() )
+		return true;
+
+	Deliver(data, len);
+	return true;
+	}
+
+bool Hash::CatchUp()
+	{
+	auto contents = GetFile()->GetCachedContents();
+
+	if ( contents->Collecting() )
+		return false;
+
+	const auto& data = contents->Data();
+	Deliver(reinterpret_cast<const u_char*>(data.data()), data.size());
+	deferred = false;
 	return true;
 	}
 
+void Hash::Process(const u_char* data, uint64_t len)
+	{
+	hash->Feed(data, len);
+	}
+
 bool Hash::EndOfFile()
 	{
-	Finalize();
+	if ( ! deferred )
+		{
+		Finalize();
+		return false;
+		}
+
+	auto contents = GetFile()->GetCachedContents();
+
+	if ( ! contents->Complete() )
+		{
+		CatchUp();
+		Finalize();
+		return false;
+		}
+
+	if ( const auto* cached = contents->Lookup(kind) )
+		{
+		if ( hash->IsValid() && fed )
+			Report(make_intrusive<StringVal>(*cached));
+
+		return false;
+		}
+
+	CatchUp();
+
+	if ( auto h = Finalize() )
+		contents->Insert(kind, h->ToStdString());
+
 	return false;
 	}
 
@@ -47,18 +103,30 @@ bool Hash::Undelivered(uint64_t offset, uint64_t len)
 	return false;
 	}
 
-void Hash::Finalize()
+StringValPtr Hash::Finalize()
 	{
+	Wait();
+
 	if ( ! hash->IsValid() || ! fed )
-		return;
+		return nullptr;
+
+	if ( ! file_hash )
+		return nullptr;
 
+	auto h = hash->Get();
+	Report(h);
+	return h;
+	}
+
+void Hash::Report(StringValPtr h)
+	{
 	if ( ! file_hash )
 		return;
 
 	event_mgr.Enqueue(file_hash,
 	                  GetFile()->ToVal(),
 	                  make_intrusive<StringVal>(kind),
-	                  hash->Get()
+	                  std::move(h)
 	);
 	}
 
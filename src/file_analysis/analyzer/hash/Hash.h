@@ -8,15 +8,18 @@
 #include "zeek/OpaqueVal.h"
 #include "zeek/file_analysis/File.h"
 #include "zeek/file_analysis/Analyzer.h"
+#include "zeek/file_analysis/FileWorker.h"
 
 #include "file_analysis/analyzer/hash/events.bif.h"
 
 namespace zeek::file_analysis::detail {
 
 /**
- * An analyzer to produce a hash of file contents.
+ * An analyzer to produce a hash of file contents.  The hash gets computed
+ * on a worker thread, if there are any.  With the result cache enabled for
+ * it, the hash of contents seen before gets replayed from there.
  */
-class Hash : public file_analysis::Analyzer {
+class Hash : public file_analysis::Analyzer, private OffloadedStream {
 public:
 
 	/**
@@ -61,12 +64,25 @@ protected:
 	/**
 	 * If some file contents have been seen, finalizes the hash of them and
 	 * raises the "file_hash" event with the results.
+	 * @return the hash, or a null pointer if there's none.
 	 */
-	void Finalize();
+	StringValPtr Finalize();
 
 private:
+	void Process(const u_char* data, uint64_t len) override;
+
+	// Returns false while the file's contents are collected for the result
+	// cache.  Once that stops short of the complete file, hashes what was
+	// collected meanwhile.
+	bool CatchUp();
+
+	// Raises the "file_hash" event.
+	void Report(StringValPtr h);
+
 	HashVal* hash;
 	bool fed;
+	bool started;	// Whether the analyzer has seen any stream delivery.
+	bool deferred;	// Whether the file's contents are left to the cache.
 	const char* kind;
 };
 
@@ -1,6 +1,8 @@
 #include "zeek/file_analysis/analyzer/pe/PE.h"
 #include "zeek/file_analysis/Manager.h"
 
+#include "file_analysis/analyzer/pe/events.bif.h"
+
 namespace zeek::file_analysis::detail {
 
 PE::PE(RecordValPtr args, file_analysis::File* file)
@@ -11,6 +13,22 @@ PE::PE(RecordValPtr args, file_analysis::File* file)
 	conn = new binpac::PE::MockConnection(this);
 	interp = new binpac::PE::File(conn);
 	done = false;
+
+	// Only parse as far as there are handlers for.
+	int last_stage = binpac::PE::PE_NO_STAGE;
+
+	if ( pe_dos_header )
+		last_stage = binpac::PE::PE_DOS_HEADER;
+	if ( pe_dos_code )
+		last_stage = binpac::PE::PE_DOS_CODE;
+	if ( pe_file_header )
+		last_stage = binpac::PE::PE_FILE_HEADER;
+	if ( pe_optional_header )
+		last_stage = binpac::PE::PE_OPTIONAL_HEADER;
+	if ( pe_section_header )
+		last_stage = binpac::PE::PE_SECTION_HEADERS;
+
+	conn->set_last_stage(last_stage);
 	}
 
 PE::~PE()
@@ -24,6 +42,13 @@ bool PE::DeliverStream(const u_char* data, uint64_t len)
 	if ( conn->is_done() )
 		return false;
 
+	if ( conn->last_stage() == binpac::PE::PE_NO_STAGE )
+		{
+		// Nothing to do with the file.
+		conn->mark_done();
+		return false;
+		}
+
 	try
 		{
 		interp->NewData(data, data + len);
@@ -2,7 +2,9 @@
 
 #include "zeek/file_analysis/analyzer/x509/X509.h"
 
+#include <list>
 #include <string>
+#include <unordered_map>
 
 #include <broker/error.hh>
 #include <broker/expected.hh>
@@ -20,9 +22,27 @@
 
 #include "file_analysis/analyzer/x509/events.bif.h"
 #include "file_analysis/analyzer/x509/types.bif.h"
+#include "file_analysis/analyzer/x509/consts.bif.h"
 
 namespace zeek::file_analysis::detail {
 
+namespace {
+
+struct ParsedCertificate {
+	std::string sha1;
+	IntrusivePtr<X509Val> val;
+	RecordValPtr record;
+};
+
+}
+
+// Certificates parsed before, by the SHA1 of their encoding, most recently
+// used first.  The same certificates recur on many connections, and for
+// those we pass on the previous X509Val and record rather than having
+// OpenSSL parse them again.
+static std::list<ParsedCertificate> parsed_certs;
+static std::unordered_map<std::string, std::list<ParsedCertificate>::iterator> parsed_certs_index;
+
 X509::X509(RecordValPtr args, file_analysis::File* file)
 	: X509Common::X509Common(file_mgr->GetComponentTag("X509"),
 	                         std::move(args), file)
@@ -70,25 +90,65 @@ bool X509::EndOfFile()
 			}
 		}
 
-	// ok, now we can try to parse the certificate with openssl. Should
-	// be rather straightforward...
-	::X509* ssl_cert = d2i_X509(NULL, &cert_char, cert_data.size());
-	if ( ! ssl_cert )
+	IntrusivePtr<X509Val> cert_val;
+	RecordValPtr cert_record;
+	std::string cert_sha1;
+
+	if ( BifConst::X509::parse_cache_size > 0 )
 		{
-		reporter->Weird(GetFile(), "x509_cert_parse_error");
-		return false;
+		unsigned char buf[SHA_DIGEST_LENGTH];
+		auto ctx = zeek::detail::hash_init(zeek::detail::Hash_SHA1);
+		zeek::detail::hash_update(ctx, cert_char, cert_data.size());
+		zeek::detail::hash_final(ctx, buf);
+		cert_sha1.assign(reinterpret_cast<const char*>(buf), sizeof(buf));
+
+		auto it = parsed_certs_index.find(cert_sha1);
+
+		if ( it != parsed_certs_index.end() )
+			{
+			parsed_certs.splice(parsed_certs.begin(), parsed_certs, it->second);
+			cert_val = it->second->val;
+			cert_record = it->second->record;
+			}
 		}
 
-	X509Val* cert_val = new X509Val(ssl_cert); // cert_val takes ownership of ssl_cert
+	if ( ! cert_val )
+		{
+		// ok, now we can try to parse the certificate with openssl. Should
+		// be rather straightforward...
+		::X509* ssl_cert = d2i_X509(NULL, &cert_char, cert_data.size());
+		if ( ! ssl_cert )
+			{
+			reporter->Weird(GetFile(), "x509_cert_parse_error");
+			return false;
+			}
+
+		// cert_val takes ownership of ssl_cert
+		cert_val = make_intrusive<X509Val>(ssl_cert);
 
-	// parse basic information into record.
-	auto cert_record = ParseCertificate(cert_val, GetFile());
+		// parse basic information into record.
+		cert_record = ParseCertificate(cert_val.get(), GetFile());
+
+		if ( ! cert_sha1.empty() )
+			{
+			if ( parsed_certs.size() >= BifConst::X509::parse_cache_size )
+				{
+				parsed_certs_index.erase(parsed_certs.back().sha1);
+				parsed_certs.pop_back();
+				}
+
+			parsed_certs.push_front({cert_sha1, cert_val, cert_record});
+			parsed_certs_index[cert_sha1] = parsed_certs.begin();
+			}
+		}
+
+	::X509* ssl_cert = cert_val->GetCertificate();
 
 	// and send the record on to scriptland
 	if ( x509_certificate )
 		event_mgr.Enqueue(x509_certificate,
 		                  GetFile()->ToVal(),
-		                  IntrusivePtr{NewRef{}, cert_val},
+		                  cert_val,
 		                  cert_record);
 
 	// after parsing the certificate - parse the extensions...
@@ -108,8 +168,6 @@ bool X509::EndOfFile()
 	//
 	// The certificate will be freed when the last X509Val is Unref'd.
 
-	Unref(cert_val); // Same for cert_val
-
 	return false;
 	}
 
@@ -281,6 +339,12 @@ void X509::FreeRootStore()
 		X509_STORE_free(e.second);
 	}
 
+void X509::FreeParseCache()
+	{
+	parsed_certs_index.clear();
+	parsed_certs.clear();
+	}
+
 void X509::ParseBasicConstraints(X509_EXTENSION* ex)
 	{
 	assert(OBJ_obj2nid(X509_EXTENSION_get_object(ex)) == NID_basic_constraints);
@@ -114,6 +114,12 @@ public:
 	 */
 	static void FreeRootStore();
 
+	/**
+	 * Frees the certificates kept around for recurring certificates to
+	 * skip parsing.
+	 */
+	static void FreeParseCache();
+
 	/**
 	 * Sets the table[string] that used as the certificate cache inside of Zeek.
 	 */
@@ -5,17 +5,157 @@
 #include <cstring>
 #include <memory>
 #include <chrono>
+#include <vector>
 
 #include "zeek/zeek-setup.h"
+#include "zeek/PipelineStats.h"
 
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
 extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv);
 
+struct Input {
+	const char* file_name;
+	std::unique_ptr<uint8_t[]> buffer;
+	size_t length = 0;
+	double total_time = 0;	// Over all timed iterations.
+};
+
+static Input read_input(const char* input_file_name)
+	{
+	auto f = fopen(input_file_name, "r");
+
+	if ( ! f )
+		{
+		printf(" failed to open file: %s\n", strerror(errno));
+		abort();
+		}
+
+	fseek(f, 0, SEEK_END);
+	auto input_length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	Input in;
+	in.file_name = input_file_name;
+	in.buffer = std::make_unique<uint8_t[]>(input_length);
+	in.length = input_length;
+	auto bytes_read = fread(in.buffer.get(), 1, input_length, f);
+
+	if ( bytes_read != static_cast<size_t>(input_length) )
+		{
+		printf(" failed to read full file: %zu/%ld\n",
+		       bytes_read, input_length);
+		abort();
+		}
+
+	fclose(f);
+	return in;
+	}
+
+// Parses a "-<name>=<number>" option.
+static bool parse_option(const char* arg, const char* name, int* val)
+	{
+	auto n = strlen(name);
+
+	if ( arg[0] != '-' || strncmp(arg + 1, name, n) != 0 || arg[n + 1] != '=' )
+		return false;
+
+	*val = atoi(arg + n + 2);
+	return true;
+	}
+
+// Runs the whole corpus repeatedly and reports throughput, after first
+// running every input a number of times to warm up caches and lazily
+// built state like DFAs.
+static void benchmark(std::vector<Input>& inputs, int iterations, int warmup)
+	{
+	using namespace std::chrono;
+	using zeek::detail::PipelineStats;
+
+	printf("Benchmarking %zu inputs, %d iterations after %d warm-up\n",
+	       inputs.size(), iterations, warmup);
+
+	for ( auto i = 0; i < warmup; ++i )
+		for ( const auto& in : inputs )
+			LLVMFuzzerTestOneInput(in.buffer.get(), in.length);
+
+	PipelineStats::Reset();
+	PipelineStats::SetEnabled(true);
+
+	size_t total_bytes = 0;
+	auto bench_start = high_resolution_clock::now();
+
+	for ( auto i = 0; i < iterations; ++i )
+		for ( auto& in : inputs )
+			{
+			auto start = high_resolution_clock::now();
+			LLVMFuzzerTestOneInput(in.buffer.get(), in.length);
+			auto stop = high_resolution_clock::now();
+			in.total_time += duration<double>(stop - start).count();
+			total_bytes += in.length;
+			}
+
+	auto bench_dt = duration<double>(high_resolution_clock::now() - bench_start).count();
+	PipelineStats::SetEnabled(false);
+
+	for ( const auto& in : inputs )
+		printf("  %s: %6zu bytes, %f seconds avg, %.1f execs/s\n",
+		       in.file_name, in.length, in.total_time / iterations,
+		       in.total_time > 0 ? iterations / in.total_time : 0.0);
+
+	auto execs = static_cast<double>(iterations) * inputs.size();
+	printf("Processed %.0f execs in %fs, %.1f execs/s, %.2f MB/s\n",
+	       execs, bench_dt, execs / bench_dt, total_bytes / bench_dt / 1e6);
+
+	// Stages nest, so their times overlap.
+	printf("Time by processing stage:\n");
+
+	for ( int s = 0; s < PipelineStats::NUM_STAGES; ++s )
+		{
+		auto stage = static_cast<PipelineStats::Stage>(s);
+		const auto& h = PipelineStats::Get(stage);
+
+		if ( ! h.count )
+			continue;
+
+		printf("  %-16s %10llu calls, %fs, %5.1f%%\n", PipelineStats::StageName(stage),
+		       static_cast<unsigned long long>(h.count), h.total / 1e9,
+		       h.total / 1e9 / bench_dt * 100);
+		}
+	}
+
 int main(int argc, char** argv)
 	{
 	using namespace std::chrono;
 	auto agg_start = high_resolution_clock::now();
-	auto num_inputs = argc - 1;
+
+	// Options come before the inputs.
+	int iterations = 0;
+	int warmup = 1;
+	int first_input = 1;
+
+	for ( ; first_input < argc; ++first_input )
+		{
+		auto arg = argv[first_input];
+
+		if ( ! parse_option(arg, "iterations", &iterations) &&
+		     ! parse_option(arg, "warmup", &warmup) )
+			break;
+		}
+
+	auto num_inputs = argc - first_input;
+
+	if ( iterations > 0 )
+		{
+		std::vector<Input> inputs;
+
+		for ( auto i = 0; i < num_inputs; ++i )
+			inputs.emplace_back(read_input(argv[first_input + i]));
+
+		LLVMFuzzerInitialize(&argc, &argv);
+		benchmark(inputs, iterations, warmup);
+		return zeek::detail::cleanup(false);
+		}
+
 	printf("Standalone fuzzer processing %d inputs\n", num_inputs);
 
 	LLVMFuzzerInitialize(&argc, &argv);
@@ -23,42 +163,21 @@ int main(int argc, char** argv)
 
 	for ( auto i = 0; i < num_inputs; ++i )
 		{
-		auto input_file_name = argv[i + 1];
+		auto input_file_name = argv[first_input + i];
 		printf("  %s:", input_file_name);
 		// If ASan ends up aborting, the previous stdout output may not
 		// be flushed, so make sure to that and make it easier to see
 		// what input caused the crash.
 		fflush(stdout);
 
-		auto f = fopen(input_file_name, "r");
-
-		if ( ! f )
-			{
-			printf(" failed to open file: %s\n", strerror(errno));
-			abort();
-			}
-
-		fseek(f, 0, SEEK_END);
-		auto input_length = ftell(f);
-		fseek(f, 0, SEEK_SET);
-
-		auto input_buffer = std::make_unique<uint8_t[]>(input_length);
-		auto bytes_read = fread(input_buffer.get(), 1, input_length, f);
-
-		if ( bytes_read != static_cast<size_t>(input_length) )
-			{
-			printf(" failed to read full file: %zu/%ld\n",
-			       bytes_read, input_length);
-			abort();
-			}
+		auto in = read_input(input_file_name);
 
 		auto start = high_resolution_clock::now();
-		LLVMFuzzerTestOneInput(input_buffer.get(), input_length);
+		LLVMFuzzerTestOneInput(in.buffer.get(), in.length);
 		auto stop = high_resolution_clock::now();
 		auto dt = duration<double>(stop - start).count();
 
-		printf(" %6zu bytes, %f seconds\n", input_length, dt);
-		fclose(f);
+		printf(" %6zu bytes, %f seconds\n", in.length, dt);
 		}
 
 	auto agg_stop = high_resolution_clock::now();
@@ -40,8 +40,112 @@
 
 #include "zeek/net_util.h"
 
+#include <algorithm>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_WIDE_SUM
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_WIDE_SUM
+#endif
+
 namespace zeek::detail {
 
+#ifdef HAVE_WIDE_SUM
+#if defined(__x86_64__)
+/*
+ * The AVX2 kernel gets compiled regardless of the build's target and picked
+ * at runtime, as the compiler already vectorizes the plain loop below as far
+ * as baseline SSE2 allows.
+ */
+static bool use_wide_sum = [] {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}();
+
+/*
+ * Adds up the 16-bit words at w, in blocks of 32, into *sum.  Returns the
+ * number of words it consumed.
+ */
+__attribute__((target("avx2")))
+static int wide_sum(const uint16_t *w, int n, uint64_t *sum)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	int i = 0;
+
+	while (i + 32 <= n) {
+		/*
+		 * Each 32-bit lane takes at most 0xffff per round, so
+		 * flush before they could overflow.  Separate
+		 * accumulators keep the additions independent.
+		 */
+		__m256i a0 = zero, a1 = zero, a2 = zero, a3 = zero;
+		int end = std::min(n - 31, i + 32 * 0xffff);
+		uint64_t lanes[4];
+
+		for (; i < end; i += 32) {
+			__m256i v0 = _mm256_loadu_si256((const __m256i *)(const void *)(w + i));
+			__m256i v1 = _mm256_loadu_si256((const __m256i *)(const void *)(w + i + 16));
+			a0 = _mm256_add_epi32(a0, _mm256_unpacklo_epi16(v0, zero));
+			a1 = _mm256_add_epi32(a1, _mm256_unpackhi_epi16(v0, zero));
+			a2 = _mm256_add_epi32(a2, _mm256_unpacklo_epi16(v1, zero));
+			a3 = _mm256_add_epi32(a3, _mm256_unpackhi_epi16(v1, zero));
+		}
+
+		__m256i a = _mm256_add_epi64(_mm256_unpacklo_epi32(a0, zero),
+		                             _mm256_unpackhi_epi32(a0, zero));
+		a = _mm256_add_epi64(a, _mm256_unpacklo_epi32(a1, zero));
+		a = _mm256_add_epi64(a, _mm256_unpackhi_epi32(a1, zero));
+		a = _mm256_add_epi64(a, _mm256_unpacklo_epi32(a2, zero));
+		a = _mm256_add_epi64(a, _mm256_unpackhi_epi32(a2, zero));
+		a = _mm256_add_epi64(a, _mm256_unpacklo_epi32(a3, zero));
+		a = _mm256_add_epi64(a, _mm256_unpackhi_epi32(a3, zero));
+
+		_mm256_storeu_si256((__m256i *)(void *)lanes, a);
+		*sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+
+	return i;
+}
+#else
+static constexpr bool use_wide_sum = true;
+
+/*
+ * Adds up the 16-bit words at w, in blocks of 32, into *sum.  Returns the
+ * number of words it consumed.
+ */
+static int wide_sum(const uint16_t *w, int n, uint64_t *sum)
+{
+	int i = 0;
+
+	while (i + 32 <= n) {
+		/*
+		 * Each 32-bit lane takes at most 0x1fffe per round, so
+		 * flush before they could overflow.
+		 */
+		uint32x4_t a0 = vdupq_n_u32(0), a1 = a0, a2 = a0, a3 = a0;
+		int end = std::min(n - 31, i + 32 * 0x7fff);
+
+		for (; i < end; i += 32) {
+			a0 = vpadalq_u16(a0, vld1q_u16(w + i));
+			a1 = vpadalq_u16(a1, vld1q_u16(w + i + 8));
+			a2 = vpadalq_u16(a2, vld1q_u16(w + i + 16));
+			a3 = vpadalq_u16(a3, vld1q_u16(w + i + 24));
+		}
+
+		uint64x2_t a = vpaddlq_u32(a0);
+		a = vpadalq_u32(a, a1);
+		a = vpadalq_u32(a, a2);
+		a = vpadalq_u32(a, a3);
+		*sum += vgetq_lane_u64(a, 0) + vgetq_lane_u64(a, 1);
+	}
+
+	return i;
+}
+#endif
+#endif
+
 #define ADDCARRY(x)  {if ((x) > 65535) (x) -= 65535;}
 #define REDUCE {l_util.l = sum; sum = l_util.s[0] + l_util.s[1]; ADDCARRY(sum);}
 
@@ -91,6 +195,23 @@ uint16_t in_cksum(const struct checksum_block *vec, int veclen)
 			mlen--;
 			byte_swapped = 1;
 		}
+#ifdef HAVE_WIDE_SUM
+		/*
+		 * Sum the bulk of long chunks in wide blocks.
+		 */
+		if (use_wide_sum && mlen >= 64) {
+			uint64_t wsum = 0;
+			int n = wide_sum(w, mlen / 2, &wsum);
+
+			while (wsum >> 16)
+				wsum = (wsum & 0xffff) + (wsum >> 16);
+
+			REDUCE;
+			sum += wsum;
+			w += n;
+			mlen -= 2 * n;
+		}
+#endif
 		/*
 		 * Unroll the loop to make overhead from
 		 * branches &c small.
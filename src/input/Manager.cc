@@ -108,6 +108,19 @@ public:
 
 	EventHandlerPtr event;
 
+	// Without a predicate or event nothing can observe single entries
+	// changing, so new and changed ones get collected here and then
+	// assigned all at once by EndCurrentSend.
+	struct PendingEntry {
+		ValPtr idx;
+		std::unique_ptr<zeek::detail::HashKey> key;
+		ValPtr val;
+	};
+
+	std::vector<PendingEntry> pending;
+
+	bool Bulk() const	{ return ! pred && ! event; }
+
 	TableStream();
 	~TableStream() override;
 };
@@ -288,6 +301,11 @@ bool Manager::CreateStream(Stream* info, RecordVal* description)
 			}
 		}
 
+	// A predicate may reject entries that get sent again unchanged, and
+	// keep ones that are gone, so it needs to see every entry each time.
+	rinfo.want_deltas = info->stream_type == TABLE_STREAM &&
+	                    ! description->GetField("pred");
+
 	ReaderFrontend* reader_obj = new ReaderFrontend(rinfo, reader->AsEnumVal());
 	assert(reader_obj);
 
@@ -1085,6 +1103,33 @@ void Manager::SendEntry(ReaderFrontend* reader, Value* *vals)
 		return;
 		}
 
+	SendEntry(i, vals);
+	}
+
+void Manager::SendEntries(ReaderFrontend* reader, std::vector<Value**> vals)
+	{
+	Stream *i = FindStream(reader);
+	if ( i == nullptr )
+		{
+		reporter->InternalWarning("Unknown reader %s in SendEntries", reader->Name());
+		return;
+		}
+
+	if ( i->stream_type == TABLE_STREAM )
+		{
+		TableStream* stream = (TableStream*) i;
+
+		if ( stream->Bulk() && stream->pending.empty() )
+			stream->pending.reserve(std::max(vals.size(),
+			                                 static_cast<size_t>(stream->lastDict->Length())));
+		}
+
+	for ( auto v : vals )
+		SendEntry(i, v);
+	}
+
+void Manager::SendEntry(Stream* i, Value* *vals)
+	{
 	int readFields = 0;
 
 	if ( i->stream_type == TABLE_STREAM )
@@ -1258,7 +1303,7 @@ int Manager::SendEntryTable(Stream* i, const Value* const *vals)
 	assert(idxval);
 
 	ValPtr oldval;
-	if ( updated == true )
+	if ( updated == true && stream->event )
 		{
 		assert(stream->num_val_fields > 0);
 		// in that case, we need the old value to send the event (if we send an event).
@@ -1274,7 +1319,10 @@ int Manager::SendEntryTable(Stream* i, const Value* const *vals)
 	ih->idxkey = new zeek::detail::HashKey(k->Key(), k->Size(), k->Hash());
 	ih->valhash = valhash;
 
-	stream->tab->Assign({AdoptRef{}, idxval}, std::move(k), {AdoptRef{}, valval});
+	if ( stream->Bulk() )
+		stream->pending.push_back({{AdoptRef{}, idxval}, std::move(k), {AdoptRef{}, valval}});
+	else
+		stream->tab->Assign({AdoptRef{}, idxval}, std::move(k), {AdoptRef{}, valval});
 
 	if ( predidx != nullptr )
 		Unref(predidx);
@@ -1350,49 +1398,15 @@ void Manager::EndCurrentSend(ReaderFrontend* reader)
 
 	while ( ( ih = stream->lastDict->NextEntry(lastDictIdxKey, c) ) )
 		{
-		ValPtr val;
-		ValPtr predidx;
-		EnumValPtr ev;
-		int startpos = 0;
-
-		if ( stream->pred || stream->event )
-			{
-			auto idx = stream->tab->RecreateIndex(*ih->idxkey);
-			assert(idx != nullptr);
-			val = stream->tab->FindOrDefault(idx);
-			assert(val != nullptr);
-			predidx = {AdoptRef{}, ListValToRecordVal(idx.get(), stream->itype, &startpos)};
-			ev = BifType::Enum::Input::Event->GetEnumVal(BifEnum::Input::EVENT_REMOVED);
-			}
-
-		if ( stream->pred )
+		if ( ! RemoveTableEntry(i, ih) )
 			{
-			// ask predicate, if we want to expire this element...
-
-			bool result = CallPred(stream->pred, 3, ev->Ref(), predidx->Ref(),
-			                       val->Ref());
-
-			if ( result == false )
-				{
-				// Keep it. Hence - we quit and simply go to the next entry of lastDict
-				// ah well - and we have to add the entry to currDict...
-				stream->currDict->Insert(lastDictIdxKey, stream->lastDict->RemoveEntry(lastDictIdxKey));
-				delete lastDictIdxKey;
-				continue;
-				}
-			}
-
-		if ( stream->event )
-			{
-			if ( stream->num_val_fields == 0 )
-				SendEvent(stream->event, 3, stream->description->Ref(), ev->Ref(),
-				          predidx->Ref());
-			else
-				SendEvent(stream->event, 4, stream->description->Ref(), ev->Ref(),
-				          predidx->Ref(), val->Ref());
+			// Keep it. Hence - we quit and simply go to the next entry of lastDict
+			// ah well - and we have to add the entry to currDict...
+			stream->currDict->Insert(lastDictIdxKey, stream->lastDict->RemoveEntry(lastDictIdxKey));
+			delete lastDictIdxKey;
+			continue;
 			}
 
-		stream->tab->Remove(*ih->idxkey);
 		stream->lastDict->Remove(lastDictIdxKey); // delete in next line
 		delete lastDictIdxKey;
 		delete(ih);
@@ -1401,8 +1415,11 @@ void Manager::EndCurrentSend(ReaderFrontend* reader)
 	stream->lastDict->Clear(); // should be empt. buti- well... who knows...
 	delete(stream->lastDict);
 
+	ApplyPending(i);
+
+	// The next send will most likely have as many entries.
 	stream->lastDict = stream->currDict;
-	stream->currDict = new PDict<InputHash>;
+	stream->currDict = new PDict<InputHash>(UNORDERED, stream->lastDict->Length());
 	stream->currDict->SetDeleteFunc(input_hash_delete_func);
 
 #ifdef DEBUG
@@ -1413,6 +1430,140 @@ void Manager::EndCurrentSend(ReaderFrontend* reader)
 	SendEndOfData(i);
 	}
 
+void Manager::SendDelta(ReaderFrontend* reader, std::vector<Value**> added,
+                        std::vector<Value**> removed)
+	{
+	Stream *i = FindStream(reader);
+
+	if ( i == nullptr )
+		{
+		reporter->InternalWarning("Unknown reader %s in SendDelta",
+		                                reader->Name());
+		return;
+		}
+
+	if ( i->stream_type != TABLE_STREAM )
+		{
+		reporter->InternalWarning("Reader %s sent a delta for non-table stream %s",
+		                          reader->Name(), i->name.c_str());
+		return;
+		}
+
+	TableStream* stream = (TableStream*) i;
+	int num_fields = stream->num_idx_fields + stream->num_val_fields;
+
+	// The added entries include the new versions of changed ones, so
+	// they go first: anything they touch ends up in currDict, and the
+	// removal of its old version must leave it alone.
+	for ( auto vals : added )
+		SendEntry(i, vals);
+
+	for ( auto vals : removed )
+		{
+		zeek::detail::HashKey* idxhash = HashValues(stream->num_idx_fields, vals);
+
+		if ( idxhash && ! stream->currDict->Lookup(idxhash) )
+			{
+			InputHash* h = stream->lastDict->Lookup(idxhash);
+			zeek::detail::hash_t valhash = 0;
+
+			if ( h && stream->num_val_fields > 0 )
+				{
+				if ( zeek::detail::HashKey* valhashkey = HashValues(stream->num_val_fields, vals+stream->num_idx_fields) )
+					{
+					valhash = valhashkey->Hash();
+					delete valhashkey;
+					}
+				}
+
+			// With duplicate indices, the line removed may not be
+			// the one that the table has.
+			if ( h && (stream->num_val_fields == 0 || h->valhash == valhash) &&
+			     RemoveTableEntry(i, h) )
+				{
+				stream->lastDict->Remove(idxhash);
+				delete h;
+				}
+			}
+
+		delete idxhash;
+		Value::delete_value_ptr_array(vals, num_fields);
+		}
+
+	// Unlike after a full send, lastDict keeps describing the whole
+	// table, including the entries this delta didn't touch.
+	IterCookie *c = stream->currDict->InitForIteration();
+	stream->currDict->MakeRobustCookie(c);
+	InputHash* ih;
+	zeek::detail::HashKey *currDictIdxKey;
+
+	while ( ( ih = stream->currDict->NextEntry(currDictIdxKey, c) ) )
+		{
+		delete stream->lastDict->Insert(currDictIdxKey, stream->currDict->RemoveEntry(currDictIdxKey));
+		delete currDictIdxKey;
+		}
+
+	ApplyPending(i);
+
+	SendEndOfData(i);
+	}
+
+bool Manager::RemoveTableEntry(Stream* i, const InputHash* ih)
+	{
+	assert(i->stream_type == TABLE_STREAM);
+	TableStream* stream = (TableStream*) i;
+
+	ValPtr val;
+	ValPtr predidx;
+	EnumValPtr ev;
+	int startpos = 0;
+
+	if ( stream->pred || stream->event )
+		{
+		auto idx = stream->tab->RecreateIndex(*ih->idxkey);
+		assert(idx != nullptr);
+		val = stream->tab->FindOrDefault(idx);
+		assert(val != nullptr);
+		predidx = {AdoptRef{}, ListValToRecordVal(idx.get(), stream->itype, &startpos)};
+		ev = BifType::Enum::Input::Event->GetEnumVal(BifEnum::Input::EVENT_REMOVED);
+		}
+
+	if ( stream->pred )
+		{
+		// ask predicate, if we want to expire this element...
+
+		bool result = CallPred(stream->pred, 3, ev->Ref(), predidx->Ref(),
+		                       val->Ref());
+
+		if ( result == false )
+			return false;
+		}
+
+	if ( stream->event )
+		{
+		if ( stream->num_val_fields == 0 )
+			SendEvent(stream->event, 3, stream->description->Ref(), ev->Ref(),
+			          predidx->Ref());
+		else
+			SendEvent(stream->event, 4, stream->description->Ref(), ev->Ref(),
+			          predidx->Ref(), val->Ref());
+		}
+
+	stream->tab->Remove(*ih->idxkey);
+	return true;
+	}
+
+void Manager::ApplyPending(Stream* i)
+	{
+	assert(i->stream_type == TABLE_STREAM);
+	TableStream* stream = (TableStream*) i;
+
+	for ( auto& e : stream->pending )
+		stream->tab->Assign(std::move(e.idx), std::move(e.key), std::move(e.val));
+
+	std::vector<TableStream::PendingEntry>().swap(stream->pending);
+	}
+
 void Manager::SendEndOfData(ReaderFrontend* reader)
 	{
 	Stream *i = FindStream(reader);
@@ -1450,6 +1601,24 @@ void Manager::Put(ReaderFrontend* reader, Value* *vals)
 		return;
 		}
 
+	Put(i, vals);
+	}
+
+void Manager::PutEntries(ReaderFrontend* reader, std::vector<Value**> vals)
+	{
+	Stream *i = FindStream(reader);
+	if ( i == nullptr )
+		{
+		reporter->InternalWarning("Unknown reader %s in PutEntries", reader->Name());
+		return;
+		}
+
+	for ( auto v : vals )
+		Put(i, v);
+	}
+
+void Manager::Put(Stream* i, Value* *vals)
+	{
 #ifdef DEBUG
 	DBG_LOG(DBG_INPUT, "Put for stream %s",
 		i->name.c_str());
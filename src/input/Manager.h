@@ -5,6 +5,7 @@
 #pragma once
 
 #include <map>
+#include <vector>
 
 #include "zeek/input/Component.h"
 #include "zeek/EventHandler.h"
@@ -19,6 +20,8 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(ReaderBackend, zeek, input);
 namespace zeek {
 namespace input {
 
+struct InputHash;
+
 /**
  * Singleton class for managing input streams.
  */
@@ -116,10 +119,13 @@ public:
 protected:
 	friend class ReaderFrontend;
 	friend class PutMessage;
+	friend class PutEntriesMessage;
 	friend class DeleteMessage;
 	friend class ClearMessage;
 	friend class SendEntryMessage;
+	friend class SendEntriesMessage;
 	friend class EndCurrentSendMessage;
+	friend class SendDeltaMessage;
 	friend class ReaderClosedMessage;
 	friend class DisableMessage;
 	friend class EndOfDataMessage;
@@ -129,6 +135,7 @@ protected:
 	// new/deleted values directly). Functions take ownership of
 	// threading::Value fields.
 	void Put(ReaderFrontend* reader, threading::Value* *vals);
+	void PutEntries(ReaderFrontend* reader, std::vector<threading::Value**> vals);
 	void Clear(ReaderFrontend* reader);
 	bool Delete(ReaderFrontend* reader, threading::Value* *vals);
 	// Trigger sending the End-of-Data event when the input source has
@@ -139,8 +146,15 @@ protected:
 	// monitoring new/deleted values) Functions take ownership of
 	// threading::Value fields.
 	void SendEntry(ReaderFrontend* reader, threading::Value* *vals);
+	void SendEntries(ReaderFrontend* reader, std::vector<threading::Value**> vals);
 	void EndCurrentSend(ReaderFrontend* reader);
 
+	// For readers of table streams that asked for deltas: adds and
+	// changes the entries in added, and removes those of removed, as if
+	// the current contents had been sent in full.
+	void SendDelta(ReaderFrontend* reader, std::vector<threading::Value**> added,
+	               std::vector<threading::Value**> removed);
+
 	// Instantiates a new ReaderBackend of the given type (note that
 	// doing so creates a new thread!).
 	ReaderBackend* CreateBackend(ReaderFrontend* frontend, EnumVal* tag);
@@ -187,6 +201,19 @@ private:
 	// type.
 	bool CheckErrorEventTypes(const std::string& stream_name, const Func* error_event, bool table) const;
 
+	// SendEntry implementation for all streams.
+	void SendEntry(Stream* i, threading::Value* *vals);
+
+	// Put implementation for all streams.
+	void Put(Stream* i, threading::Value* *vals);
+
+	// Removes an entry from a table stream, unless its predicate keeps
+	// it. Returns false in that case.
+	bool RemoveTableEntry(Stream* i, const InputHash* ih);
+
+	// Assigns the table entries that SendEntryTable collected.
+	void ApplyPending(Stream* i);
+
 	// SendEntry implementation for Table stream.
 	int SendEntryTable(Stream* i, const threading::Value* const *vals);
 
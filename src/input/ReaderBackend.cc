@@ -25,6 +25,22 @@ private:
 	Value* *val;
 };
 
+class PutEntriesMessage final : public threading::OutputMessage<ReaderFrontend> {
+public:
+	PutEntriesMessage(ReaderFrontend* reader, std::vector<Value**> vals)
+		: threading::OutputMessage<ReaderFrontend>("PutEntries", reader),
+		vals(std::move(vals)) { }
+
+	bool Process() override
+		{
+		input_mgr->PutEntries(Object(), std::move(vals));
+		return true;
+		}
+
+private:
+	std::vector<Value**> vals;
+};
+
 class DeleteMessage final : public threading::OutputMessage<ReaderFrontend> {
 public:
 	DeleteMessage(ReaderFrontend* reader, Value* *val)
@@ -90,6 +106,40 @@ private:
 	Value* *val;
 };
 
+class SendEntriesMessage final : public threading::OutputMessage<ReaderFrontend> {
+public:
+	SendEntriesMessage(ReaderFrontend* reader, std::vector<Value**> vals)
+		: threading::OutputMessage<ReaderFrontend>("SendEntries", reader),
+		vals(std::move(vals)) { }
+
+	bool Process() override
+		{
+		input_mgr->SendEntries(Object(), std::move(vals));
+		return true;
+		}
+
+private:
+	std::vector<Value**> vals;
+};
+
+class SendDeltaMessage final : public threading::OutputMessage<ReaderFrontend> {
+public:
+	SendDeltaMessage(ReaderFrontend* reader, std::vector<Value**> added,
+	                 std::vector<Value**> removed)
+		: threading::OutputMessage<ReaderFrontend>("SendDelta", reader),
+		added(std::move(added)), removed(std::move(removed)) { }
+
+	bool Process() override
+		{
+		input_mgr->SendDelta(Object(), std::move(added), std::move(removed));
+		return true;
+		}
+
+private:
+	std::vector<Value**> added;
+	std::vector<Value**> removed;
+};
+
 class EndCurrentSendMessage final : public threading::OutputMessage<ReaderFrontend> {
 public:
 	EndCurrentSendMessage(ReaderFrontend* reader)
@@ -195,6 +245,11 @@ void ReaderBackend::Put(Value* *val)
 	SendOut(new PutMessage(frontend, val));
 	}
 
+void ReaderBackend::PutEntries(std::vector<Value**> vals)
+	{
+	SendOut(new PutEntriesMessage(frontend, std::move(vals)));
+	}
+
 void ReaderBackend::Delete(Value* *val)
 	{
 	SendOut(new DeleteMessage(frontend, val));
@@ -210,6 +265,11 @@ void ReaderBackend::EndCurrentSend()
 	SendOut(new EndCurrentSendMessage(frontend));
 	}
 
+void ReaderBackend::SendDelta(std::vector<Value**> added, std::vector<Value**> removed)
+	{
+	SendOut(new SendDeltaMessage(frontend, std::move(added), std::move(removed)));
+	}
+
 void ReaderBackend::EndOfData()
 	{
 	SendOut(new EndOfDataMessage(frontend));
@@ -220,6 +280,11 @@ void ReaderBackend::SendEntry(Value* *vals)
 	SendOut(new SendEntryMessage(frontend, vals));
 	}
 
+void ReaderBackend::SendEntries(std::vector<Value**> vals)
+	{
+	SendOut(new SendEntriesMessage(frontend, std::move(vals)));
+	}
+
 bool ReaderBackend::Init(const int arg_num_fields,
 		         const threading::Field* const* arg_fields)
 	{
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "zeek/ZeekString.h"
 
 #include "zeek/threading/SerialTypes.h"
@@ -102,11 +104,18 @@ public:
 		 */
 		ReaderMode mode;
 
+		/**
+		 * True if the stream accepts only the changes in tracking
+		 * mode, through SendDelta().
+		 */
+		bool want_deltas;
+
 		ReaderInfo()
 			{
 			source = nullptr;
 			name = nullptr;
 			mode = MODE_NONE;
+			want_deltas = false;
 			}
 
 		ReaderInfo(const ReaderInfo& other)
@@ -114,6 +123,7 @@ public:
 			source = other.source ? util::copy_string(other.source) : nullptr;
 			name = other.name ? util::copy_string(other.name) : nullptr;
 			mode = other.mode;
+			want_deltas = other.want_deltas;
 
 			for ( config_map::const_iterator i = other.config.begin(); i != other.config.end(); i++ )
 				config.insert(std::make_pair(util::copy_string(i->first), util::copy_string(i->second)));
@@ -295,6 +305,16 @@ protected:
 	 */
 	void Put(threading::Value** val);
 
+	/**
+	 * Like Put(), for a batch of values at once. Readers producing many
+	 * of them quickly can use this to spare the main thread processing
+	 * a message for each of them.
+	 *
+	 * @param vals The values, in the order Put() would have been called
+	 * for them.
+	 */
+	void PutEntries(std::vector<threading::Value**> vals);
+
 	/**
 	 * Method allowing a reader to delete a specific value from a Bro
 	 * table.
@@ -339,6 +359,16 @@ protected:
 	 */
 	void SendEntry(threading::Value** vals);
 
+	/**
+	 * Like SendEntry(), for a batch of entries at once. Readers producing
+	 * many entries quickly can use this to spare the main thread
+	 * processing a message for each of them.
+	 *
+	 * @param vals The entries, in the order SendEntry() would have been
+	 * called for them.
+	 */
+	void SendEntries(std::vector<threading::Value**> vals);
+
 	/**
 	 * Method telling the manager, that the current list of entries sent
 	 * by SendEntry is finished.
@@ -349,6 +379,20 @@ protected:
 	 */
 	void EndCurrentSend();
 
+	/**
+	 * Method allowing a reader to send only what changed since its last
+	 * send in tracking mode, if ReaderInfo::want_deltas is set. It takes
+	 * the place of the SendEntry() calls and the EndCurrentSend() of a
+	 * full send.
+	 *
+	 * @param added The entries that are new or changed.
+	 *
+	 * @param removed The entries that are gone, as they were sent. For
+	 * changed entries, that's their previous version.
+	 */
+	void SendDelta(std::vector<threading::Value**> added,
+	               std::vector<threading::Value**> removed);
+
 private:
 	// Frontend that instantiated us. This object must not be accessed
 	// from this class, it's running in a different thread!
@@ -4,9 +4,13 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <cstring>
 #include <sstream>
+#include <thread>
 
 #include "zeek/threading/SerialTypes.h"
 
@@ -53,6 +57,8 @@ Ascii::Ascii(ReaderFrontend *frontend) : ReaderBackend(frontend)
 	ino = 0;
 	fail_on_file_problem = false;
 	fail_on_invalid_lines = false;
+	parse_threads = 0;
+	incremental_reread = false;
 	}
 
 Ascii::~Ascii()
@@ -81,6 +87,8 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 
 	fail_on_invalid_lines = BifConst::InputAscii::fail_on_invalid_lines;
 	fail_on_file_problem = BifConst::InputAscii::fail_on_file_problem;
+	parse_threads = BifConst::InputAscii::parse_threads;
+	incremental_reread = BifConst::InputAscii::incremental_reread;
 
 	path_prefix.assign((const char*) BifConst::InputAscii::path_prefix->Bytes(),
 	                   BifConst::InputAscii::path_prefix->Len());
@@ -105,6 +113,12 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 
 		else if ( strcmp(i->first, "fail_on_file_problem") == 0 )
 			fail_on_file_problem = (strncmp(i->second, "T", 1) == 0);
+
+		else if ( strcmp(i->first, "parse_threads") == 0 )
+			parse_threads = atoi(i->second);
+
+		else if ( strcmp(i->first, "incremental_reread") == 0 )
+			incremental_reread = (strncmp(i->second, "T", 1) == 0);
 		}
 
 	if ( separator.size() != 1 )
@@ -248,20 +262,29 @@ bool Ascii::GetLine(string& str)
 	{
 	while ( getline(file, str) )
 		{
-		if ( ! str.size() )
-			continue;
+		if ( FilterLine(&str) )
+			return true;
+		}
 
-		if ( str.back() == '\r' ) // deal with \r\n by removing \r
-			str.pop_back();
+	return false;
+	}
 
-		if ( str[0] != '#' )
-			return true;
+// Returns false for lines to skip, adjusting others into what to parse.
+bool Ascii::FilterLine(string* str) const
+	{
+	if ( ! str->size() )
+		return false;
 
-		if ( ( str.length() > 8 ) && ( str.compare(0,7, "#fields") == 0 ) && ( str[7] == separator[0] ) )
-			{
-			str = str.substr(8);
-			return true;
-			}
+	if ( str->back() == '\r' ) // deal with \r\n by removing \r
+		str->pop_back();
+
+	if ( (*str)[0] != '#' )
+		return true;
+
+	if ( ( str->length() > 8 ) && ( str->compare(0,7, "#fields") == 0 ) && ( (*str)[7] == separator[0] ) )
+		{
+		*str = str->substr(8);
+		return true;
 		}
 
 	return false;
@@ -332,117 +355,381 @@ bool Ascii::DoUpdate()
 
 		}
 
+	if ( incremental_reread && Info().want_deltas && Info().mode == MODE_REREAD )
+		return ReadDelta();
+
+	if ( parse_threads > 1 && Info().mode != MODE_STREAM )
+		return ReadParallel();
+
 	string line;
 
 	file.sync();
 
 	while ( GetLine(line) )
 		{
-		// split on tabs
-		bool error = false;
-		istringstream splitstream(line);
+		Value** fields = nullptr;
+		string problem;
+		LineStatus status = ParseLine(line, formatter.get(), &fields, &problem);
 
-		map<int, string> stringfields;
-		int pos = 0;
-		while ( splitstream )
-			{
-			string s;
-			if ( ! getline(splitstream, s, separator[0]) )
-				break;
+		if ( ! ReportLine(status, problem) )
+			return false;
+
+		if ( status != LINE_OK )
+			continue;
+
+		if ( Info().mode == MODE_STREAM )
+			Put(fields);
+		else
+			SendEntry(fields);
+		}
+
+	if ( Info().mode != MODE_STREAM )
+		EndCurrentSend();
+
+	return true;
+	}
+
+Ascii::LineStatus Ascii::ParseLine(const string& line, const threading::Formatter* f,
+                                   Value*** vals, string* problem) const
+	{
+	// split on tabs
+	istringstream splitstream(line);
+
+	map<int, string> stringfields;
+	int pos = 0;
+	while ( splitstream )
+		{
+		string s;
+		if ( ! getline(splitstream, s, separator[0]) )
+			break;
+
+		stringfields[pos] = s;
+		pos++;
+		}
 
-			stringfields[pos] = s;
-			pos++;
+	pos--; // for easy comparisons of max element.
+
+	Value** fields = new Value*[NumFields()];
+
+	int fpos = 0;
+	for ( vector<FieldMapping>::const_iterator fit = columnMap.begin();
+		fit != columnMap.end();
+		fit++ )
+		{
+
+		if ( ! fit->present )
+			{
+			// add non-present field
+			fields[fpos] = new Value((*fit).type, false);
+			fpos++;
+			continue;
 			}
 
-		pos--; // for easy comparisons of max element.
+		assert(fit->position >= 0 );
+
+		LineStatus status = LINE_OK;
+
+		if ( (*fit).position > pos || (*fit).secondary_position > pos )
+			{
+			*problem = "Not enough fields in line '" + line + "' of " + fname +
+			           ". Found " + to_string(pos) + " fields, want positions " +
+			           to_string((*fit).position) + " and " +
+			           to_string((*fit).secondary_position);
+			status = LINE_INVALID;
+			}
 
-		Value** fields = new Value*[NumFields()];
+		Value* val = nullptr;
 
-		int fpos = 0;
-		for ( vector<FieldMapping>::iterator fit = columnMap.begin();
-			fit != columnMap.end();
-			fit++ )
+		if ( status == LINE_OK )
 			{
+			val = f->ParseValue(stringfields[(*fit).position], (*fit).name, (*fit).type, (*fit).subtype);
 
-			if ( ! fit->present )
+			if ( ! val )
 				{
-				// add non-present field
-				fields[fpos] = new Value((*fit).type, false);
-				fpos++;
-				continue;
+				*problem = "Could not convert line '" + line + "' of " + fname +
+				           " to Val. Ignoring line.";
+				status = LINE_UNCONVERTIBLE;
 				}
+			}
 
-			assert(fit->position >= 0 );
+		if ( status != LINE_OK )
+			{
+			// Delete all successfully read fields and the array
+			// structure.
+			for ( int i = 0; i < fpos; i++ )
+				delete fields[i];
 
-			if ( (*fit).position > pos || (*fit).secondary_position > pos )
-				{
-				FailWarn(fail_on_invalid_lines, Fmt("Not enough fields in line '%s' of %s. Found %d fields, want positions %d and %d",
-				                                    line.c_str(), fname.c_str(), pos, (*fit).position, (*fit).secondary_position));
+			delete [] fields;
+			return status;
+			}
 
-				if ( fail_on_invalid_lines )
-					{
-					for ( int i = 0; i < fpos; i++ )
-						delete fields[i];
+		if ( (*fit).secondary_position != -1 )
+			{
+			// we have a port definition :)
+			assert(val->type == TYPE_PORT );
+			//	Error(Fmt("Got type %d != PORT with secondary position!", val->type));
+
+			val->val.port_val.proto = f->ParseProto(stringfields[(*fit).secondary_position]);
+			}
 
-					delete [] fields;
+		fields[fpos] = val;
 
-					return false;
-					}
-				else
-					{
-					error = true;
-					break;
-					}
-				}
+		fpos++;
+		}
 
-			Value* val = formatter->ParseValue(stringfields[(*fit).position], (*fit).name, (*fit).type, (*fit).subtype);
+	//printf("fpos: %d, second.num_fields: %d\n", fpos, (*it).second.num_fields);
+	assert ( fpos == NumFields() );
 
-			if ( ! val )
+	*vals = fields;
+	return LINE_OK;
+	}
+
+bool Ascii::ReportLine(LineStatus status, const string& problem)
+	{
+	switch ( status ) {
+	case LINE_OK:
+		break;
+
+	case LINE_INVALID:
+		FailWarn(fail_on_invalid_lines, problem.c_str());
+		return ! fail_on_invalid_lines;
+
+	case LINE_UNCONVERTIBLE:
+		Warning(problem.c_str());
+		break;
+	}
+
+	return true;
+	}
+
+// Entries sent to the main thread per message when parsing in parallel.
+static constexpr size_t max_batch_size = 1000;
+
+bool Ascii::ReadParallel()
+	{
+	// Parse whatever follows the header.
+	if ( file.eof() )
+		{
+		EndCurrentSend();
+		return true;
+		}
+
+	streamoff start = file.tellg();
+	int fd = open(fname.c_str(), O_RDONLY);
+	struct stat sb;
+
+	if ( start < 0 || fd < 0 || fstat(fd, &sb) < 0 )
+		{
+		if ( fd >= 0 )
+			close(fd);
+
+		FailWarn(fail_on_file_problem, Fmt("Could not read input data file %s", fname.c_str()), true);
+		return ! fail_on_file_problem;
+		}
+
+	size_t size = sb.st_size;
+
+	if ( static_cast<size_t>(start) >= size )
+		{
+		close(fd);
+		EndCurrentSend();
+		return true;
+		}
+
+	void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if ( map == MAP_FAILED )
+		{
+		FailWarn(fail_on_file_problem, Fmt("Could not map input data file %s", fname.c_str()), true);
+		return ! fail_on_file_problem;
+		}
+
+	const char* begin = static_cast<const char*>(map) + start;
+	const char* end = static_cast<const char*>(map) + size;
+
+	// Split into roughly equal chunks, each ending after a newline.
+	vector<pair<const char*, const char*>> chunks;
+	const char* p = begin;
+
+	for ( unsigned int i = 1; i <= parse_threads && p < end; ++i )
+		{
+		const char* e = i == parse_threads ? end : begin + (end - begin) * i / parse_threads;
+
+		if ( e < p )
+			e = p;
+
+		e = static_cast<const char*>(memchr(e, '\n', end - e));
+		e = e ? e + 1 : end;
+
+		chunks.emplace_back(p, e);
+		p = e;
+		}
+
+	threading::formatter::Ascii::SeparatorInfo sep_info(separator, set_separator,
+	                                                     unset_field, empty_field);
+	vector<vector<ParsedLine>> results(chunks.size());
+	vector<std::thread> workers;
+
+	for ( size_t i = 0; i < chunks.size(); ++i )
+		workers.emplace_back([this, &chunks, &results, &sep_info, i]
+			{
+			threading::formatter::Ascii f(this, sep_info);
+			const char* p = chunks[i].first;
+			const char* end = chunks[i].second;
+			vector<string> warnings;
+			f.CollectWarnings(&warnings);
+
+			while ( p < end )
 				{
-				Warning(Fmt("Could not convert line '%s' of %s to Val. Ignoring line.", line.c_str(), fname.c_str()));
-				error = true;
-				break;
+				const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+				const char* e = nl ? nl : end;
+				string line(p, e - p);
+				p = e + 1;
+
+				if ( ! FilterLine(&line) )
+					continue;
+
+				ParsedLine l;
+				l.status = ParseLine(line, &f, &l.fields, &l.problem);
+				l.warnings.swap(warnings);
+
+				results[i].push_back(std::move(l));
 				}
+			});
+
+	// Report in order, each chunk as soon as it's done.
+	bool failed = false;
+	vector<Value**> batch;
 
-			if ( (*fit).secondary_position != -1 )
+	for ( size_t i = 0; i < workers.size(); ++i )
+		{
+		workers[i].join();
+
+		for ( auto& l : results[i] )
+			{
+			if ( failed )
 				{
-				// we have a port definition :)
-				assert(val->type == TYPE_PORT );
-				//	Error(Fmt("Got type %d != PORT with secondary position!", val->type));
+				if ( l.status == LINE_OK )
+					Value::delete_value_ptr_array(l.fields, NumFields());
 
-				val->val.port_val.proto = formatter->ParseProto(stringfields[(*fit).secondary_position]);
+				continue;
 				}
 
-			fields[fpos] = val;
+			for ( const auto& w : l.warnings )
+				Warning(w.c_str());
 
-			fpos++;
+			failed = ! ReportLine(l.status, l.problem);
+
+			if ( l.status == LINE_OK )
+				batch.push_back(l.fields);
+
+			if ( batch.size() >= max_batch_size || (failed && ! batch.empty()) )
+				{
+				SendEntries(std::move(batch));
+				batch.clear();
+				}
 			}
 
-		if ( error )
-			{
-			// Encountered non-fatal error, ignoring line. But
-			// first, delete all successfully read fields and the
-			// array structure.
+		results[i].clear();
+		}
 
-			for ( int i = 0; i < fpos; i++ )
-				delete fields[i];
+	munmap(map, size);
+
+	if ( failed )
+		return false;
+
+	if ( ! batch.empty() )
+		SendEntries(std::move(batch));
+
+	EndCurrentSend();
+	return true;
+	}
+
+bool Ascii::ReadDelta()
+	{
+	// The lines of the last read are only comparable if the columns
+	// still mean the same. If not, send everything.
+	bool full = headerline != sent_header;
+	sent_header = headerline;
+
+	// Lines of the last read, unless they've shown up again.
+	unordered_map<string, unsigned int> gone;
+	gone.swap(sent_lines);
+
+	if ( full )
+		gone.clear();
+
+	vector<Value**> added;
+	string line;
+
+	file.sync();
+
+	while ( GetLine(line) )
+		{
+		++sent_lines[line];
+
+		auto it = gone.find(line);
+
+		if ( it != gone.end() )
+			{
+			if ( --it->second == 0 )
+				gone.erase(it);
 
-			delete [] fields;
 			continue;
 			}
 
-		//printf("fpos: %d, second.num_fields: %d\n", fpos, (*it).second.num_fields);
-		assert ( fpos == NumFields() );
+		Value** fields = nullptr;
+		string problem;
+		LineStatus status = ParseLine(line, formatter.get(), &fields, &problem);
 
-		if ( Info().mode == MODE_STREAM )
-			Put(fields);
-		else
-			SendEntry(fields);
+		if ( ! ReportLine(status, problem) )
+			{
+			for ( auto v : added )
+				Value::delete_value_ptr_array(v, NumFields());
+
+			sent_header.clear();
+			return false;
+			}
+
+		if ( status == LINE_OK )
+			added.push_back(fields);
 		}
 
-	if ( Info().mode != MODE_STREAM )
+	if ( full )
+		{
+		if ( ! added.empty() )
+			SendEntries(std::move(added));
+
 		EndCurrentSend();
+		return true;
+		}
+
+	// Lines that are gone got reported when they were added.
+	vector<Value**> removed;
+	vector<string> ignored;
+	formatter->CollectWarnings(&ignored);
+
+	for ( const auto& g : gone )
+		{
+		Value** fields = nullptr;
+		string problem;
+
+		if ( ParseLine(g.first, formatter.get(), &fields, &problem) != LINE_OK )
+			continue;
+
+		removed.push_back(fields);
+
+		for ( unsigned int i = 1; i < g.second; ++i )
+			{
+			ParseLine(g.first, formatter.get(), &fields, &problem);
+			removed.push_back(fields);
+			}
+		}
+
+	formatter->CollectWarnings(nullptr);
 
+	SendDelta(std::move(added), std::move(removed));
 	return true;
 	}
 
@@ -7,6 +7,7 @@
 #include <vector>
 #include <fstream>
 #include <memory>
+#include <unordered_map>
 
 #include "zeek/input/ReaderBackend.h"
 #include "zeek/threading/formatters/Ascii.h"
@@ -54,10 +55,37 @@ protected:
 	bool DoHeartbeat(double network_time, double current_time) override;
 
 private:
+	enum LineStatus { LINE_OK, LINE_INVALID, LINE_UNCONVERTIBLE };
+
+	// A line parsed by ReadParallel(), waiting to be reported.
+	struct ParsedLine {
+		threading::Value** fields;
+		LineStatus status;
+		std::string problem;
+		std::vector<std::string> warnings; // From the formatter.
+	};
+
 	bool ReadHeader(bool useCached);
 	bool GetLine(std::string& str);
+	bool FilterLine(std::string* str) const;
 	bool OpenFile();
 
+	// Converts a line into the stream's fields. Doesn't report
+	// problems itself, so that it can run on other threads than the
+	// reader's.
+	LineStatus ParseLine(const std::string& line, const threading::Formatter* f,
+	                     threading::Value*** vals, std::string* problem) const;
+
+	// Parses the rest of the file on parse_threads threads.
+	bool ReadParallel();
+
+	// Reports a problem ParseLine() found. Returns false if reading
+	// has to stop.
+	bool ReportLine(LineStatus status, const std::string& problem);
+
+	// Sends only the lines that changed since the last read.
+	bool ReadDelta();
+
 	std::ifstream file;
 	time_t mtime;
 	ino_t ino;
@@ -81,8 +109,15 @@ private:
 	bool fail_on_invalid_lines;
 	bool fail_on_file_problem;
 	std::string path_prefix;
+	unsigned int parse_threads;
+	bool incremental_reread;
 
 	std::unique_ptr<threading::Formatter> formatter;
+
+	// For ReadDelta(): the lines of the last read, with how often each
+	// occurred, and the header they went with.
+	std::unordered_map<std::string, unsigned int> sent_lines;
+	std::string sent_header;
 };
 
 } // namespace zeek::input::reader::detail
@@ -10,23 +10,24 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "zeek/input/readers/raw/Plugin.h"
 #include "zeek/threading/SerialTypes.h"
 
 #include "input/readers/raw/raw.bif.h"
 
-extern "C" {
-#include "zeek/setsignal.h"
-}
+extern char** environ;
 
 using zeek::threading::Value;
 using zeek::threading::Field;
 
 namespace zeek::input::reader::detail {
 
-const int Raw::block_size = 4096; // how big do we expect our chunks of data to be.
+const int Raw::block_size = 65536; // how much to read at once; buffers grow for longer lines.
+const size_t Raw::max_batch_size = 1000; // lines per message to the main thread.
 
 Raw::Raw(ReaderFrontend *frontend) : ReaderBackend(frontend), file(nullptr, fclose), stderrfile(nullptr, fclose)
 	{
@@ -41,8 +42,6 @@ Raw::Raw(ReaderFrontend *frontend) : ReaderBackend(frontend), file(nullptr, fclo
 
 	sep_length = BifConst::InputRaw::record_separator->Len();
 
-	bufpos = 0;
-
 	stdin_fileno = fileno(stdin);
 	stdout_fileno = fileno(stdout);
 	stderr_fileno = fileno(stderr);
@@ -134,77 +133,67 @@ bool Raw::Execute()
 		return false;
 		}
 
-	childpid = fork();
-	if ( childpid < 0 )
-		{
-		Error(Fmt("Could not create child process: %d", errno));
-		return false;
-		}
-
-	else if ( childpid == 0 )
-		{
-		// we are the child.
-
-		// Obtain a process group w/ child's PID.
-		if ( setpgid(0, 0) == -1 )
-			_exit(251);
-
-		close(pipes[stdout_in]);
-		if ( dup2(pipes[stdout_out], stdout_fileno) == -1 )
-			_exit(252);
-
-		close(pipes[stdout_out]);
-
-		close(pipes[stdin_out]);
-		if ( stdin_towrite && dup2(pipes[stdin_in], stdin_fileno) == -1 )
-			_exit(253);
+	// Spawning rather than forking spares copying the page tables of
+	// what may be a large process just to exec right away.
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawnattr_init(&attr);
 
-		close(pipes[stdin_in]);
+	posix_spawn_file_actions_addclose(&actions, pipes[stdout_in]);
+	posix_spawn_file_actions_adddup2(&actions, pipes[stdout_out], stdout_fileno);
+	posix_spawn_file_actions_addclose(&actions, pipes[stdout_out]);
 
-		close(pipes[stderr_in]);
-		if ( use_stderr && dup2(pipes[stderr_out], stderr_fileno) == -1 )
-			_exit(254);
+	posix_spawn_file_actions_addclose(&actions, pipes[stdin_out]);
+	if ( stdin_towrite )
+		posix_spawn_file_actions_adddup2(&actions, pipes[stdin_in], stdin_fileno);
+	posix_spawn_file_actions_addclose(&actions, pipes[stdin_in]);
 
-		close(pipes[stderr_out]);
+	posix_spawn_file_actions_addclose(&actions, pipes[stderr_in]);
+	if ( use_stderr )
+		posix_spawn_file_actions_adddup2(&actions, pipes[stderr_out], stderr_fileno);
+	posix_spawn_file_actions_addclose(&actions, pipes[stderr_out]);
+
+	// Give the child a process group of its own, w/ its PID, before it
+	// execs, so that killing the group can't miss it.  Signal
+	// dispositions and the mask are inherited, so reset SIGPIPE (may be
+	// ignored when debugging scripts) to default behavior and unblock
+	// any blocked signals.
+	sigset_t def, mask;
+	sigemptyset(&def);
+	sigaddset(&def, SIGPIPE);
+	sigemptyset(&mask);
+	posix_spawnattr_setpgroup(&attr, 0);
+	posix_spawnattr_setsigdefault(&attr, &def);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF |
+	                         POSIX_SPAWN_SETSIGMASK);
+
+	const char* argv[] = {"sh", "-c", fname.c_str(), nullptr};
+	int rc = posix_spawn(&childpid, "/bin/sh", &actions, &attr,
+	                     const_cast<char* const*>(argv), environ);
+
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+
+	if ( rc != 0 )
+		{
+		childpid = -1;
+		lock.unlock();
 
-		// Signal mask is inherited over fork-exec, so reset any ignored
-		// signals to default behavior and unblock any blocked signals.
-		setsignal(SIGPIPE, SIG_DFL); // May be ignored when debugging scripts.
-		sigset_t mask;
-		sigfillset(&mask);
-		// Assuming the fork-one model of pthreads' fork(), using sigprocmask()
-		// makes sense over pthread_sigmask() here.
-		sigprocmask(SIG_UNBLOCK, &mask, 0);
+		for ( int i = 0; i < 6; i ++ )
+			ClosePipeEnd(i);
 
-		execl("/bin/sh", "sh", "-c", fname.c_str(), (char*) NULL);
-		fprintf(stderr, "Exec failed :(......\n");
-		_exit(255);
+		char buf[256];
+		util::zeek_strerror_r(rc, buf, sizeof(buf));
+		Error(Fmt("Could not create child process: %s", buf));
+		return false;
 		}
+
 	else
 		{
 		// we are the parent
 
-		// Parent also sets child process group immediately to avoid a race.
-		if ( setpgid(childpid, childpid) == -1 )
-			{
-			if ( errno == EACCES )
-				// Child already did exec. That's fine since then it must have
-				// already done the setpgid() itself.
-				;
-
-			else if ( errno == ESRCH && kill(childpid, 0) == 0 )
-				// Sometimes (e.g. FreeBSD) this error is reported even though
-				// child exists, so do extra sanity check of whether it exists.
-				;
-
-			else
-				{
-				char buf[256];
-				util::zeek_strerror_r(errno, buf, sizeof(buf));
-				Warning(Fmt("Could not set child process group: %s", buf));
-				}
-			}
-
 		lock.unlock();
 
 		ClosePipeEnd(stdout_out);
@@ -272,6 +261,9 @@ bool Raw::Execute()
 
 bool Raw::OpenInput()
 	{
+	stdout_buf.Reset();
+	stderr_buf.Reset();
+
 	if ( execute )
 		return Execute();
 
@@ -436,74 +428,92 @@ bool Raw::DoInit(const ReaderInfo& info, int num_fields, const Field* const* fie
 	return true;
 	}
 
-int64_t Raw::GetLine(FILE* arg_file)
+int64_t Raw::GetLine(FILE* arg_file, LineBuffer* lb)
 	{
-	errno = 0;
-	int pos = 0; // strstr_n only works on ints - so no use to use something different here
-	int offset = 0;
-
-	if ( ! buf )
-		buf = std::unique_ptr<char[]>(new char[block_size]);
-
-	int repeats = 1;
+	if ( ! lb->data )
+		{
+		lb->data = std::unique_ptr<char[]>(new char[block_size]);
+		lb->size = block_size;
+		}
 
 	for ( ;; )
 		{
-		size_t readbytes = fread(buf.get()+bufpos+offset, 1, block_size-bufpos, arg_file);
-		pos += bufpos + readbytes;
-		//printf("Pos: %d\n", pos);
-		bufpos = offset = 0; // read full block size in next read...
-
-		if ( pos == 0 && errno != 0 )
-			break;
-
-		// researching everything each time is a bit... cpu-intensive. But otherwhise we have
-		// to deal with situations where the separator is multi-character and split over multiple
-		// reads...
-		int found = util::strstr_n(pos, (unsigned char*) buf.get(),
-		                           separator.size(), (unsigned char*) separator.c_str());
-
-		if ( found == -1 )
+		// Look for a separator in what we haven't searched yet.  A
+		// multi-character one may be split over reads, so the last
+		// bytes get searched again once more data comes in.
+		const char* data = lb->data.get();
+		const char* p = data + lb->start + lb->scanned;
+		const char* end = data + lb->end;
+		const char* found = nullptr;
+
+		while ( sep_length && p < end &&
+		        (p = static_cast<const char*>(memchr(p, separator[0], end - p))) )
 			{
-			// we did not find it and have to search again in the next try. resize buffer....
-			// but first check if we encountered the file end - because if we did this was it.
-			if ( feof(arg_file) != 0 )
+			if ( static_cast<size_t>(end - p) < sep_length )
+				break;
+
+			if ( memcmp(p, separator.data(), sep_length) == 0 )
 				{
-				if ( pos == 0 )
-					return -1; // signal EOF - and that we had no more data.
-				else
-					{
-					outbuf = std::move(buf); // buf is null after this
-					return pos;
-					}
+				found = p;
+				break;
 				}
 
-			repeats++;
-			// bah, we cannot use realloc because we would have to change the delete in the manager to a free.
-			std::unique_ptr<char[]> newbuf = std::unique_ptr<char[]>(new char[block_size*repeats]);
-			memcpy(newbuf.get(), buf.get(), block_size*(repeats-1));
-			buf = std::move(newbuf);
-			offset = block_size*(repeats-1);
+			++p;
 			}
-		else
+
+		if ( found || (feof(arg_file) && lb->start < lb->end) )
 			{
-			outbuf = std::move(buf);
+			// A line, or what's left at the end of the file.
+			size_t length = (found ? found : end) - (data + lb->start);
+			outbuf = std::unique_ptr<char[]>(new char[length ? length : 1]);
+			memcpy(outbuf.get(), data + lb->start, length);
 
-			if ( found < pos )
-				{
-				// we have leftovers. copy them into the buffer for the next line
-				buf = std::unique_ptr<char[]>(new char[block_size]);
-				memcpy(buf.get(), outbuf.get() + found + sep_length, pos - found - sep_length);
-				bufpos = pos - found - sep_length;
-				}
+			lb->start += length + (found ? sep_length : 0);
+			lb->scanned = 0;
+
+			if ( lb->start == lb->end )
+				lb->Reset();
 
-			return found;
+			return length;
 			}
 
+		if ( feof(arg_file) )
+			return -1; // signal EOF - and that we had no more data.
+
+		size_t pending = lb->end - lb->start;
+		lb->scanned = pending >= sep_length ? pending - sep_length + 1 : 0;
+
+		// Make room for reading more: move what's pending to the front,
+		// and grow the buffer if it's full of a single partial line.
+		if ( lb->start > 0 )
+			{
+			memmove(lb->data.get(), data + lb->start, pending);
+			lb->start = 0;
+			lb->end = pending;
+			}
+
+		if ( lb->end == lb->size )
+			{
+			auto newbuf = std::unique_ptr<char[]>(new char[lb->size * 2]);
+			memcpy(newbuf.get(), lb->data.get(), lb->end);
+			lb->data = std::move(newbuf);
+			lb->size *= 2;
+			}
+
+		errno = 0;
+		size_t readbytes = fread(lb->data.get() + lb->end, 1, lb->size - lb->end, arg_file);
+		lb->end += readbytes;
+
+		if ( readbytes == 0 && ! feof(arg_file) )
+			break;
 		}
 
 	if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR )
+		{
+		// Keep what we have of a partial line for the next try.
+		clearerr(arg_file);
 		return -2;
+		}
 
 	else
 		{
@@ -589,18 +599,27 @@ bool Raw::DoUpdate()
 		}
 		}
 
-	std::string line;
 	assert ( (NumFields() == 1 && !use_stderr) || (NumFields() == 2 && use_stderr));
+
+	// Lines go to the main thread in batches, rather than in a message
+	// each.
+	std::vector<Value**> batch;
+
 	for ( ;; )
 		{
 		if ( stdin_towrite > 0 )
 			WriteToStdin();
 
-		int64_t length = GetLine(file.get());
+		int64_t length = GetLine(file.get(), &stdout_buf);
 		//printf("Read %lld bytes\n", length);
 
 		if ( length == -3 )
+			{
+			if ( ! batch.empty() )
+				PutEntries(std::move(batch));
+
 			return false;
+			}
 
 		else if ( length == -2 || length == -1 )
 			// no data ready or eof
@@ -621,17 +640,34 @@ bool Raw::DoUpdate()
 			fields[1] = bval;
 			}
 
-		Put(fields);
+		batch.push_back(fields);
+
+		if ( batch.size() >= max_batch_size )
+			{
+			PutEntries(std::move(batch));
+			batch.clear();
+			}
+		}
+
+	if ( ! batch.empty() )
+		{
+		PutEntries(std::move(batch));
+		batch.clear();
 		}
 
 	if ( use_stderr )
 		{
 		for ( ;; )
 			{
-			int64_t length = GetLine(stderrfile.get());
+			int64_t length = GetLine(stderrfile.get(), &stderr_buf);
 			//printf("Read stderr %lld bytes\n", length);
 			if ( length == -3 )
+				{
+				if ( ! batch.empty() )
+					PutEntries(std::move(batch));
+
 				return false;
+				}
 
 			else if ( length == -2 || length == -1 )
 				break;
@@ -645,8 +681,17 @@ bool Raw::DoUpdate()
 			bval->val.int_val = 1; // yes, we are stderr
 			fields[1] = bval;
 
-			Put(fields);
+			batch.push_back(fields);
+
+			if ( batch.size() >= max_batch_size )
+				{
+				PutEntries(std::move(batch));
+				batch.clear();
+				}
 			}
+
+		if ( ! batch.empty() )
+			PutEntries(std::move(batch));
 		}
 
 	if ( ( Info().mode == MODE_MANUAL ) || ( Info().mode == MODE_REREAD ) )
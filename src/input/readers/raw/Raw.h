@@ -35,13 +35,24 @@ protected:
 	bool DoHeartbeat(double network_time, double current_time) override;
 
 private:
+	// Data read from a source but not yet split into lines.
+	struct LineBuffer {
+		std::unique_ptr<char[]> data;
+		size_t size = 0;	// Allocated bytes.
+		size_t start = 0;	// Start of the data not yet returned.
+		size_t end = 0;	// End of the data read.
+		size_t scanned = 0;	// Bytes after start known to not begin a separator.
+
+		void Reset()	{ start = end = scanned = 0; }
+	};
+
 	void ClosePipeEnd(int i);
 	bool SetFDFlags(int fd, int cmd, int flags);
 	std::unique_lock<std::mutex> AcquireForkMutex();
 
 	bool OpenInput();
 	bool CloseInput();
-	int64_t GetLine(FILE* file);
+	int64_t GetLine(FILE* file, LineBuffer* lb);
 	bool Execute();
 	void WriteToStdin();
 
@@ -57,9 +68,9 @@ private:
 	std::string separator;
 	unsigned int sep_length; // length of the separator
 
-	int bufpos;
-	std::unique_ptr<char[]> buf;
-	std::unique_ptr<char[]> outbuf;
+	LineBuffer stdout_buf;
+	LineBuffer stderr_buf;
+	std::unique_ptr<char[]> outbuf;	// The line GetLine() returned.
 
 	int stdin_fileno;
 	int stdout_fileno;
@@ -87,6 +98,7 @@ private:
 	};
 
 	static const int block_size;
+	static const size_t max_batch_size;
 };
 
 } // namespace zeek::input::reader::detail
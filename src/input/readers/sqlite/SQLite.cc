@@ -6,6 +6,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
 #include <sstream>
 
@@ -22,8 +24,11 @@ namespace zeek::input::reader::detail {
 
 SQLite::SQLite(ReaderFrontend *frontend)
 	: ReaderBackend(frontend),
-	  fields(), num_fields(), mode(), started(), query(), db(), st()
+	  fields(), num_fields(), mode(), started(), query(), db(), st(),
+	  chunk_size(), last_seen()
 	{
+	chunk_size = std::max(BifConst::InputSQLite::chunk_size, uint64_t(1));
+
 	set_separator.assign(
 			(const char*) BifConst::LogSQLite::set_separator->Bytes(),
 			BifConst::InputSQLite::set_separator->Len()
@@ -54,6 +59,9 @@ void SQLite::DoClose()
 	sqlite3_finalize(st);
 	st = nullptr;
 
+	sqlite3_value_free(last_seen);
+	last_seen = nullptr;
+
 	if ( db != 0 )
 		{
 		sqlite3_close(db);
@@ -105,6 +113,10 @@ bool SQLite::DoInit(const ReaderInfo& info, int arg_num_fields, const threading:
 	else
 		query = it->second;
 
+	it = info.config.find("incremental_column");
+	if ( it != info.config.end() )
+		incremental_column = it->second;
+
 	if ( checkError(sqlite3_open_v2(
 					fullpath.c_str(),
 					&db,
@@ -123,6 +135,12 @@ bool SQLite::DoInit(const ReaderInfo& info, int arg_num_fields, const threading:
 		return false;
 		}
 
+	if ( ! incremental_column.empty() && sqlite3_bind_parameter_count(st) != 1 )
+		{
+		Error(Fmt("Incremental query for SQLite data source %s needs exactly one parameter. Aborting.", info.source));
+		return false;
+		}
+
 	DoUpdate();
 
 	return true;
@@ -307,6 +325,39 @@ bool SQLite::DoUpdate()
 			}
 		}
 
+	int incremental_pos = -1;
+
+	if ( ! incremental_column.empty() )
+		{
+		for ( int i = 0; i < numcolumns; ++i )
+			{
+			if ( incremental_column == sqlite3_column_name(st, i) )
+				incremental_pos = i;
+			}
+
+		if ( incremental_pos == -1 )
+			{
+			Error(Fmt("Incremental column %s not found after SQLite statement", incremental_column.c_str()));
+			delete [] mapping;
+			delete [] submapping;
+			return false;
+			}
+
+		// The first update starts below all numbers and strings.
+		int rc = last_seen ? sqlite3_bind_value(st, 1, last_seen)
+		                   : sqlite3_bind_int64(st, 1, INT64_MIN);
+
+		if ( checkError(rc) )
+			{
+			delete [] mapping;
+			delete [] submapping;
+			return false;
+			}
+		}
+
+	std::vector<Value**> chunk;
+	chunk.reserve(chunk_size);
+
 	int errorcode;
 	while ( ( errorcode = sqlite3_step(st)) == SQLITE_ROW )
 		{
@@ -320,23 +371,59 @@ bool SQLite::DoUpdate()
 				for ( unsigned int k = 0; k < j; ++k )
 					delete ofields[k];
 
+				for ( auto row : chunk )
+					Value::delete_value_ptr_array(row, num_fields);
+
 				delete [] ofields;
 				delete [] mapping;
 				delete [] submapping;
+				sqlite3_reset(st);
 				return false;
 				}
 			}
 
-		SendEntry(ofields);
+		if ( incremental_pos != -1 &&
+		     sqlite3_column_type(st, incremental_pos) != SQLITE_NULL )
+			{
+			sqlite3_value_free(last_seen);
+			last_seen = sqlite3_value_dup(sqlite3_column_value(st, incremental_pos));
+			}
+
+		chunk.push_back(ofields);
+
+		if ( chunk.size() >= chunk_size )
+			{
+			if ( incremental_pos != -1 )
+				SendIncremental(std::move(chunk), false);
+			else
+				SendEntries(std::move(chunk));
+
+			chunk.clear();
+			chunk.reserve(chunk_size);
+			}
 		}
 
 	delete [] mapping;
 	delete [] submapping;
 
 	if ( checkError(errorcode) ) // check the last error code returned by sqlite
+		{
+		for ( auto row : chunk )
+			Value::delete_value_ptr_array(row, num_fields);
+
+		sqlite3_reset(st);
 		return false;
+		}
 
-	EndCurrentSend();
+	if ( incremental_pos != -1 )
+		SendIncremental(std::move(chunk), true);
+	else
+		{
+		if ( ! chunk.empty() )
+			SendEntries(std::move(chunk));
+
+		EndCurrentSend();
+		}
 
 	if ( checkError(sqlite3_reset(st)) )
 		return false;
@@ -344,4 +431,27 @@ bool SQLite::DoUpdate()
 	return true;
 	}
 
+void SQLite::SendIncremental(std::vector<Value**> rows, bool last)
+	{
+	// Table streams that take deltas keep the entries that an update
+	// doesn't mention. The others get the rows in simple mode, which
+	// never removes any.
+	if ( Info().want_deltas )
+		{
+		if ( ! rows.empty() )
+			SendEntries(std::move(rows));
+
+		if ( last )
+			SendDelta({}, {});
+
+		return;
+		}
+
+	for ( auto row : rows )
+		Put(row);
+
+	if ( last )
+		EndOfData();
+	}
+
 } // namespace zeek::input::reader::detail
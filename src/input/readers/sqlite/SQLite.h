@@ -31,6 +31,10 @@ private:
 
 	threading::Value* EntryToVal(sqlite3_stmt *st, const threading::Field *field, int pos, int subpos);
 
+	// Sends the rows of an incremental query, which add to what got
+	// sent before.
+	void SendIncremental(std::vector<threading::Value**> rows, bool last);
+
 	const threading::Field* const * fields; // raw mapping
 	unsigned int num_fields;
 	int mode;
@@ -40,6 +44,14 @@ private:
 	sqlite3_stmt *st;
 	threading::formatter::Ascii* io;
 
+	// The rows get delivered in chunks of this many.
+	size_t chunk_size;
+
+	// For incremental queries, the column whose value in the last row
+	// the query's parameter gets bound to for the next update.
+	std::string incremental_column;
+	sqlite3_value* last_seen;
+
 	std::string set_separator;
 	std::string unset_field;
 	std::string empty_field;
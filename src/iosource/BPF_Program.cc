@@ -3,6 +3,7 @@
 #include "zeek-config.h"
 #include "zeek/iosource/BPF_Program.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #ifdef DONT_HAVE_LIBPCAP_PCAP_FREECODE
@@ -137,11 +138,56 @@ bool BPF_Program::Compile(int snaplen, int linktype, const char* filter,
 		{
 		m_compiled = true;
 		m_matches_anything = filter_matches_anything(filter);
+		m_has_source = true;
+		m_filter = filter;
+		m_snaplen = snaplen;
+		m_linktype = linktype;
+		m_netmask = netmask;
 		}
 
 	return err == 0;
 	}
 
+bool BPF_Program::CopyFrom(const BPF_Program& other)
+	{
+	FreeCode();
+
+	if ( ! other.m_compiled )
+		return false;
+
+	m_program.bf_len = other.m_program.bf_len;
+	m_program.bf_insns = nullptr;
+
+	if ( other.m_program.bf_insns )
+		{
+		// Allocated like libpcap does, for pcap_freecode().
+		size_t size = m_program.bf_len * sizeof(struct bpf_insn);
+		m_program.bf_insns = static_cast<struct bpf_insn*>(malloc(size));
+
+		if ( ! m_program.bf_insns )
+			return false;
+
+		memcpy(m_program.bf_insns, other.m_program.bf_insns, size);
+		}
+
+	m_compiled = true;
+	m_matches_anything = other.m_matches_anything;
+	m_has_source = other.m_has_source;
+	m_filter = other.m_filter;
+	m_snaplen = other.m_snaplen;
+	m_linktype = other.m_linktype;
+	m_netmask = other.m_netmask;
+
+	return true;
+	}
+
+bool BPF_Program::CompiledFrom(int snaplen, int linktype, const char* filter,
+                               uint32_t netmask) const
+	{
+	return m_compiled && m_has_source && snaplen == m_snaplen &&
+		linktype == m_linktype && netmask == m_netmask && m_filter == filter;
+	}
+
 bpf_program* BPF_Program::GetProgram()
 	{
 	return m_compiled ? &m_program : nullptr;
@@ -158,6 +204,8 @@ void BPF_Program::FreeCode()
 #endif
 		m_compiled = false;
 		}
+
+	m_has_source = false;
 	}
 
 } // namespace zeek::iosource::detail
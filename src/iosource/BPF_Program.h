@@ -3,6 +3,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <string>
 
 extern "C" {
 #include <pcap.h>
@@ -34,6 +35,15 @@ public:
 		uint32_t netmask, char* errbuf = nullptr, unsigned int errbuf_len = 0,
 		bool optimize = true);
 
+	// Replaces this program with a copy of another's compiled code.
+	// Returns true on success.
+	bool CopyFrom(const BPF_Program& other);
+
+	// Returns true if this program holds the code that compiling the
+	// given filter without a pcap handle would produce.
+	bool CompiledFrom(int snaplen, int linktype, const char* filter,
+	                  uint32_t netmask) const;
+
 	// Returns true if this program currently contains compiled
 	// code, false otherwise.
 	bool IsCompiled()	{ return m_compiled; }
@@ -54,6 +64,13 @@ protected:
 	bool m_compiled;
 	bool m_matches_anything;
 	struct bpf_program m_program;
+
+	// What the program got compiled from, if without a pcap handle.
+	bool m_has_source = false;
+	std::string m_filter;
+	int m_snaplen = 0;
+	int m_linktype = 0;
+	uint32_t m_netmask = 0;
 };
 
 } // namespace zeek::iosource::detail
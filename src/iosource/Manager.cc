@@ -3,10 +3,16 @@
 #include "zeek/iosource/Manager.h"
 
 #include <sys/types.h>
-#include <sys/event.h>
 #include <sys/time.h>
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#else
+#include <sys/event.h>
+#endif
 #include <unistd.h>
 #include <assert.h>
+#include <algorithm>
+#include <chrono>
 
 #include "zeek/iosource/Component.h"
 #include "zeek/iosource/IOSource.h"
@@ -46,9 +52,19 @@ void Manager::WakeupHandler::Ping(const std::string& where)
 
 Manager::Manager()
 	{
+#ifdef USE_EPOLL
+	event_queue = epoll_create1(EPOLL_CLOEXEC);
+	if ( event_queue == -1 )
+		reporter->FatalError("Failed to initialize epoll: %s", strerror(errno));
+
+	// epoll_wait() fails when given no room for events, even before
+	// the first registration.
+	events.resize(1);
+#else
 	event_queue = kqueue();
 	if ( event_queue == -1 )
 		reporter->FatalError("Failed to initialize kqueue: %s", strerror(errno));
+#endif
 	}
 
 Manager::~Manager()
@@ -107,6 +123,7 @@ void Manager::FindReadySources(std::vector<IOSource*>* ready)
 	for ( SourceList::iterator i = sources.begin(); i != sources.end(); ++i )
 		if ( ! (*i)->src->IsOpen() )
 			{
+			service_stats.erase((*i)->src);
 			(*i)->src->Done();
 			delete *i;
 			sources.erase(i);
@@ -154,8 +171,10 @@ void Manager::FindReadySources(std::vector<IOSource*>* ready)
 					}
 				}
 
-			if ( iosource == pkt_src && ! added )
+			if ( ! added && IsPktSrc(iosource) )
 				{
+				auto pkt_src = static_cast<PktSrc*>(iosource);
+
 				if ( pkt_src->IsLive() )
 					{
 					if ( ! time_to_poll )
@@ -182,6 +201,58 @@ void Manager::FindReadySources(std::vector<IOSource*>* ready)
 	// sources that we have.
 	if ( ready->empty() || time_to_poll )
 		Poll(ready, timeout, timeout_src);
+
+	if ( time_to_poll )
+		{
+		++forced_polls;
+
+		bool found = std::any_of(ready->begin(), ready->end(),
+		                         [this](IOSource* s) { return ! IsPktSrc(s); });
+
+		if ( found )
+			++forced_polls_ready;
+
+		// With live traffic, poll more often while other sources
+		// keep having data, so that their latency doesn't depend
+		// on the packet rate, and back off again once they're idle.
+		if ( max_poll_interval > 0 )
+			{
+			if ( found )
+				poll_interval = std::max(poll_interval / 2, 1);
+			else if ( poll_interval < max_poll_interval )
+				++poll_interval;
+			}
+		}
+	}
+
+void Manager::ProcessSource(IOSource* src)
+	{
+	auto start = std::chrono::steady_clock::now();
+	src->Process();
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+
+	auto& s = service_stats[src];
+	++s.processed;
+	s.time += d.count();
+	}
+
+std::map<std::string, Manager::ServiceStats> Manager::GetServiceStats() const
+	{
+	std::map<std::string, ServiceStats> rval;
+
+	for ( const auto& s : sources )
+		{
+		auto i = service_stats.find(s->src);
+
+		if ( i == service_stats.end() )
+			continue;
+
+		auto& r = rval[s->src->Tag()];
+		r.processed += i->second.processed;
+		r.time += i->second.time;
+		}
+
+	return rval;
 	}
 
 void Manager::Poll(std::vector<IOSource*>* ready, double timeout, IOSource* timeout_src)
@@ -189,13 +260,24 @@ void Manager::Poll(std::vector<IOSource*>* ready, double timeout, IOSource* time
 	struct timespec kqueue_timeout;
 	ConvertTimeout(timeout, kqueue_timeout);
 
+#ifdef USE_EPOLL
+	// epoll_wait() takes milliseconds. Round up so that a pending
+	// timeout doesn't turn into a busy loop.
+	int epoll_timeout = kqueue_timeout.tv_sec * 1000 + (kqueue_timeout.tv_nsec + 999999) / 1000000;
+	int ret = epoll_wait(event_queue, events.data(), events.size(), epoll_timeout);
+#else
 	int ret = kevent(event_queue, NULL, 0, events.data(), events.size(), &kqueue_timeout);
+#endif
 	if ( ret == -1 )
 		{
 		// Ignore interrupts since we may catch one during shutdown and we don't want the
 		// error to get printed.
 		if ( errno != EINTR )
+#ifdef USE_EPOLL
+			reporter->InternalWarning("Error calling epoll_wait: %s", strerror(errno));
+#else
 			reporter->InternalWarning("Error calling kevent: %s", strerror(errno));
+#endif
 		}
 	else if ( ret == 0 )
 		{
@@ -208,9 +290,17 @@ void Manager::Poll(std::vector<IOSource*>* ready, double timeout, IOSource* time
 		// over that many of them.
 		for ( int i = 0; i < ret; i++ )
 			{
+#ifdef USE_EPOLL
+			// Like kqueue's read filter, count hangups and errors as
+			// readable so that the source gets to see them.
+			if ( events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR) )
+				{
+				std::map<int, IOSource*>::const_iterator it = fd_map.find(events[i].data.fd);
+#else
 			if ( events[i].filter == EVFILT_READ )
 				{
 				std::map<int, IOSource*>::const_iterator it = fd_map.find(events[i].ident);
+#endif
 				if ( it != fd_map.end() )
 					ready->push_back(it->second);
 				}
@@ -237,9 +327,16 @@ void Manager::ConvertTimeout(double timeout, struct timespec& spec)
 
 bool Manager::RegisterFd(int fd, IOSource* src)
 	{
+#ifdef USE_EPOLL
+	struct epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = fd;
+	int ret = epoll_ctl(event_queue, EPOLL_CTL_ADD, fd, &event);
+#else
 	struct kevent event;
 	EV_SET(&event, fd, EVFILT_READ, EV_ADD, 0, 0, NULL);
 	int ret = kevent(event_queue, &event, 1, NULL, 0, NULL);
+#endif
 	if ( ret != -1 )
 		{
 		events.push_back({});
@@ -260,9 +357,13 @@ bool Manager::UnregisterFd(int fd, IOSource* src)
 	{
 	if ( fd_map.find(fd) != fd_map.end() )
 		{
+#ifdef USE_EPOLL
+		int ret = epoll_ctl(event_queue, EPOLL_CTL_DEL, fd, nullptr);
+#else
 		struct kevent event;
 		EV_SET(&event, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
 		int ret = kevent(event_queue, &event, 1, NULL, 0, NULL);
+#endif
 		if ( ret != -1 )
 			DBG_LOG(DBG_MAINLOOP, "Unregistered fd %d from %s", fd, src->Tag());
 
@@ -305,16 +406,21 @@ void Manager::Register(IOSource* src, bool dont_count, bool manage_lifetime)
 	sources.push_back(s);
 	}
 
+bool Manager::IsPktSrc(const IOSource* src) const
+	{
+	return std::find(pkt_srcs.begin(), pkt_srcs.end(), src) != pkt_srcs.end();
+	}
+
 void Manager::Register(PktSrc* src)
 	{
-	pkt_src = src;
+	pkt_srcs.push_back(src);
 
 	// The poll interval gets defaulted to 100 which is good for cases like reading
 	// from pcap files and when there isn't a packet source, but is a little too
 	// infrequent for live sources (especially fast live sources). Set it down a
 	// little bit for those sources.
 	if ( src->IsLive() )
-		poll_interval = 10;
+		poll_interval = max_poll_interval = 10;
 	else if ( run_state::pseudo_realtime )
 		poll_interval = 1;
 
@@ -7,12 +7,18 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 
 #include "zeek/iosource/IOSource.h"
 #include "zeek/Flare.h"
 
 struct timespec;
+
+#ifdef USE_EPOLL
+struct epoll_event;
+#else
 struct kevent;
+#endif
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(PktSrc, zeek, iosource);
 ZEEK_FORWARD_DECLARE_NAMESPACED(PktDumper, zeek, iosource);
@@ -69,9 +75,18 @@ public:
 
 	/**
 	 * Returns the registered PktSrc. If not source is registered yet,
-	 * returns a nullptr.
+	 * returns a nullptr. With several sources, returns the first one.
 	 */
-	PktSrc* GetPktSrc() const	{ return pkt_src; }
+	PktSrc* GetPktSrc() const
+		{ return pkt_srcs.empty() ? nullptr : pkt_srcs.front(); }
+
+	using PktSrcList = std::vector<PktSrc*>;
+
+	/**
+	 * Returns all registered packet sources, in the order of their
+	 * registration.
+	 */
+	const PktSrcList& GetPktSrcs() const	{ return pkt_srcs; }
 
 	/**
 	 * Terminate all processing immediately by removing all sources (and
@@ -109,6 +124,43 @@ public:
 	 */
 	void FindReadySources(std::vector<IOSource*>* ready);
 
+	/**
+	 * Processes a source that FindReadySources() returned, keeping track
+	 * of the time that takes.
+	 *
+	 * @param src The source.
+	 */
+	void ProcessSource(IOSource* src);
+
+	/**
+	 * Time spent processing a source, as reported by GetServiceStats().
+	 */
+	struct ServiceStats {
+		uint64_t processed = 0;	// calls to Process()
+		double time = 0.0;	// seconds spent in them
+	};
+
+	/**
+	 * Returns the accumulated processing statistics of the open
+	 * sources, by tag.  Sources with the same tag get added up.
+	 */
+	std::map<std::string, ServiceStats> GetServiceStats() const;
+
+	/**
+	 * Returns the number of main loop iterations between forced polls of
+	 * all sources that the manager currently uses.  With a live packet
+	 * source, this adapts to how often the forced polls find other
+	 * sources ready.
+	 */
+	int PollInterval() const	{ return poll_interval; }
+
+	/**
+	 * Returns the number of forced polls so far, and the number of those
+	 * that found a source other than the packet source ready.
+	 */
+	std::pair<uint64_t, uint64_t> ForcedPolls() const
+		{ return {forced_polls, forced_polls_ready}; }
+
 	/**
 	 * Registers a file descriptor and associated IOSource with the manager
 	 * to be checked during FindReadySources.
@@ -158,6 +210,9 @@ private:
 	 */
 	void Register(PktSrc* src);
 
+	// Whether the source is one of the registered packet sources.
+	bool IsPktSrc(const IOSource* src) const;
+
 	void RemoveAll();
 
 	class WakeupHandler final : public IOSource {
@@ -194,7 +249,7 @@ private:
 	using PktDumperList = std::vector<PktDumper*>;
 	PktDumperList pkt_dumpers;
 
-	PktSrc* pkt_src = nullptr;
+	PktSrcList pkt_srcs;
 
 	int dont_counts = 0;
 	int zero_timeout_count = 0;
@@ -202,12 +257,25 @@ private:
 	int poll_counter = 0;
 	int poll_interval = 100;
 
+	// The largest poll interval that the adaptation for live packet
+	// sources goes to; zero if it doesn't apply.
+	int max_poll_interval = 0;
+
+	uint64_t forced_polls = 0;
+	uint64_t forced_polls_ready = 0;
+
+	std::unordered_map<IOSource*, ServiceStats> service_stats;
+
 	int event_queue = -1;
 	std::map<int, IOSource*> fd_map;
 
-	// This is only used for the output of the call to kqueue in FindReadySources().
+	// This is only used for the output of the call to kqueue (or epoll) in FindReadySources().
 	// The actual events are stored as part of the queue.
+#ifdef USE_EPOLL
+	std::vector<struct epoll_event> events;
+#else
 	std::vector<struct kevent> events;
+#endif
 };
 
 } // namespace iosource
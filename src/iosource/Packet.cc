@@ -60,6 +60,7 @@ void Packet::Init(int arg_link_type, pkt_timeval *arg_ts, uint32_t arg_caplen,
 
 	l3_proto = L3_UNKNOWN;
 	l3_checksummed = false;
+	l4_checksummed = false;
 
 	encap.reset();
 	ip_hdr.reset();
@@ -187,6 +187,17 @@ public:
 	 */
 	bool l3_checksummed;
 
+	/**
+	 * Indicates whether the transport-layer (TCP/UDP/ICMP) checksum was
+	 * validated by the hardware/kernel before being received by zeek, or
+	 * isn't meaningful because it's left to be computed by the NIC, as
+	 * with checksum offloading for locally sent packets.  Packet sources
+	 * set this per packet, e.g. from PACKET_STATUS_CSUM_VALID or
+	 * TP_STATUS_CSUMNOTREADY.  It only applies to the outermost headers,
+	 * not to tunneled packets.
+	 */
+	bool l4_checksummed;
+
 	/**
 	 * Indicates whether this packet should be recorded.
 	 */
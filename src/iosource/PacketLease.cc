@@ -0,0 +1,63 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/iosource/PacketLease.h"
+
+#include <algorithm>
+
+#include "zeek/iosource/PktSrc.h"
+
+namespace zeek::iosource {
+
+PacketLease* PacketLease::Acquire(PacketLeaseHolder* holder, const u_char* data, uint64_t len)
+	{
+	auto src = PktSrc::leasing_src;
+
+	if ( ! src || ! data || ! len )
+		return nullptr;
+
+	auto lease = src->LeaseData(data, len);
+
+	if ( lease )
+		lease->holders.push_back(holder);
+
+	return lease;
+	}
+
+void PacketLease::Release(PacketLeaseHolder* holder)
+	{
+	// The holds taken last tend to go first.
+	for ( auto i = holders.size(); i > 0; --i )
+		{
+		if ( holders[i - 1] != holder )
+			continue;
+
+		holders[i - 1] = holders.back();
+		holders.pop_back();
+
+		if ( holders.empty() )
+			src->ReleaseLease(this);
+
+		return;
+		}
+	}
+
+void PacketLease::Revoke()
+	{
+	auto revoked = std::move(holders);
+	holders.clear();
+
+	if ( revoked.empty() )
+		return;
+
+	// Each holder gets told just once, however often it holds the lease.
+	std::sort(revoked.begin(), revoked.end());
+	revoked.erase(std::unique(revoked.begin(), revoked.end()), revoked.end());
+
+	for ( auto h : revoked )
+		h->LeaseRevoked(this);
+
+	src->ReleaseLease(this);
+	}
+
+} // namespace zeek::iosource
@@ -0,0 +1,79 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Leases on packet source memory, for referring to packet data past a
+// packet's processing instead of copying it.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+#include <vector>
+
+namespace zeek::iosource {
+
+class PktSrc;
+class PacketLease;
+
+/**
+ * Something that keeps referring to packet data through a PacketLease.
+ */
+class PacketLeaseHolder {
+public:
+	virtual ~PacketLeaseHolder() = default;
+
+	/**
+	 * Called when the packet source takes back the memory of a lease,
+	 * because the packet is done or the source is running short of
+	 * memory. The holder must copy whatever it still refers to within
+	 * the lease's memory. It doesn't hold the lease anymore afterwards,
+	 * and must not release it.
+	 */
+	virtual void LeaseRevoked(const PacketLease* lease) = 0;
+};
+
+/**
+ * The right to keep referring to some of a packet source's memory. A lease
+ * stays valid until all of its holders have released it, or until the
+ * source revokes it. Holders hold the lease once for every reference they
+ * keep, and release it as often.
+ */
+class PacketLease {
+public:
+	PacketLease(PktSrc* src, size_t id) : src(src), id(id)	{ }
+
+	PacketLease(const PacketLease&) = delete;
+	PacketLease& operator=(const PacketLease&) = delete;
+
+	/**
+	 * Returns a held lease on the memory that the given data lies in,
+	 * if the packet being processed comes from a source that lends its
+	 * memory, and the data is part of it. Returns null if the data
+	 * needs to be copied instead.
+	 */
+	static PacketLease* Acquire(PacketLeaseHolder* holder, const u_char* data, uint64_t len);
+
+	/**
+	 * Releases one hold of the given holder.
+	 */
+	void Release(PacketLeaseHolder* holder);
+
+	/**
+	 * Takes the lease back from all holders, after letting them copy
+	 * their data.
+	 */
+	void Revoke();
+
+	bool Held() const	{ return ! holders.empty(); }
+
+	/**
+	 * Returns the source-specific ID that the lease was created with.
+	 */
+	size_t ID() const	{ return id; }
+
+private:
+	PktSrc* src;
+	size_t id;
+	std::vector<PacketLeaseHolder*> holders;
+};
+
+} // namespace zeek::iosource
@@ -4,9 +4,13 @@
 #include "zeek/iosource/PktSrc.h"
 
 #include <sys/stat.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include "zeek/util.h"
+#include "zeek/Flare.h"
 #include "zeek/Hash.h"
+#include "zeek/PipelineStats.h"
 #include "zeek/RunState.h"
 #include "zeek/Sessions.h"
 #include "zeek/broker/Manager.h"
@@ -18,6 +22,11 @@
 
 namespace zeek::iosource {
 
+PktSrc* PktSrc::leasing_src = nullptr;
+
+// Whether the running thread is a source's capture thread.
+static thread_local bool in_capture_thread = false;
+
 PktSrc::Properties::Properties()
 	{
 	selectable_fd = -1;
@@ -35,6 +44,8 @@ PktSrc::PktSrc()
 
 PktSrc::~PktSrc()
 	{
+	StopCaptureThread();
+
 	for ( auto code : filters )
 		delete code;
 	}
@@ -96,6 +107,13 @@ void PktSrc::Opened(const Properties& arg_props)
 		{
 		Info(util::fmt("listening on %s\n", props.path.c_str()));
 
+		if ( WantCaptureThread() )
+			{
+			StartCaptureThread();
+			DBG_LOG(DBG_PKTIO, "Opened source %s with a capture thread", props.path.c_str());
+			return;
+			}
+
 		// We only register the file descriptor if we're in live
 		// mode because libpcap's file descriptor for trace files
 		// isn't a reliable way to know whether we actually have
@@ -110,9 +128,23 @@ void PktSrc::Opened(const Properties& arg_props)
 
 void PktSrc::Closed()
 	{
+	// The main thread finishes closing once it has processed the
+	// packets that the capture thread extracted before.
+	if ( in_capture_thread )
+		{
+		capture_closed = true;
+		capture_flare->Fire();
+		return;
+		}
+
 	SetClosed(true);
 
-	if ( props.is_live && props.selectable_fd != -1 )
+	if ( capture_flare )
+		{
+		capture_done = true;
+		iosource_mgr->UnregisterFd(capture_flare->FD(), this);
+		}
+	else if ( props.is_live && props.selectable_fd != -1 )
 		iosource_mgr->UnregisterFd(props.selectable_fd, this);
 
 	DBG_LOG(DBG_PKTIO, "Closed source %s", props.path.c_str());
@@ -130,12 +162,31 @@ void PktSrc::Error(const std::string& msg)
 
 void PktSrc::Info(const std::string& msg)
 	{
-	reporter->Info("%s", msg.c_str());
+	if ( ! DeferMessage(CAPTURE_INFO, msg) )
+		reporter->Info("%s", msg.c_str());
 	}
 
 void PktSrc::Weird(const std::string& msg, const Packet* p)
 	{
-	sessions->Weird(msg.c_str(), p);
+	// A deferred weird loses its packet, which is gone by then.
+	if ( ! DeferMessage(CAPTURE_WEIRD, msg) )
+		sessions->Weird(msg.c_str(), p);
+	}
+
+void PktSrc::ReadError(const std::string& msg)
+	{
+	if ( ! DeferMessage(CAPTURE_READ_ERROR, msg) )
+		reporter->Error("%s", msg.c_str());
+	}
+
+bool PktSrc::DeferMessage(CaptureMessageType type, const std::string& msg)
+	{
+	if ( ! in_capture_thread )
+		return false;
+
+	std::lock_guard<std::mutex> lock(capture_msgs_mutex);
+	capture_msgs.push_back({type, msg});
+	return true;
 	}
 
 void PktSrc::InternalError(const std::string& msg)
@@ -150,24 +201,332 @@ void PktSrc::InitSource()
 
 void PktSrc::Done()
 	{
-	if ( IsOpen() )
+	StopCaptureThread();
+
+	// A source that closed in its capture thread is done already.
+	if ( capture_closed && IsOpen() )
+		Closed();
+	else if ( IsOpen() )
 		Close();
 	}
 
+void PktSrc::GetStatistics(Stats* stats)
+	{
+	auto lock = LockSource();
+	Statistics(stats);
+	stats->dropped += capture_drops;
+	}
+
+bool PktSrc::WantCaptureThread() const
+	{
+	return BifConst::packet_capture_threads && props.is_live && ! run_state::pseudo_realtime;
+	}
+
+void PktSrc::StartCaptureThread()
+	{
+	auto size = std::max(BifConst::packet_capture_queue_size, static_cast<bro_uint_t>(1));
+	capture_ring.assign(size, CaptureBatch());
+	capture_head = capture_tail = 0;
+	capture_drops = 0;
+	capture_done = capture_closed = false;
+
+	capture_flare = std::make_unique<zeek::detail::Flare>();
+
+	if ( ! iosource_mgr->RegisterFd(capture_flare->FD(), this) )
+		reporter->FatalError("Failed to register pktsrc flare with iosource_mgr");
+
+	capture_thread = std::thread(&PktSrc::Capture, this);
+	}
+
+void PktSrc::StopCaptureThread()
+	{
+	if ( ! capture_thread.joinable() )
+		return;
+
+	capture_done = true;
+	capture_thread.join();
+	}
+
+void PktSrc::Capture()
+	{
+	in_capture_thread = true;
+
+	// Just for the fields that extraction fills in.
+	Packet pkt;
+
+	size_t max = std::max(BifConst::packet_source_batch_size, static_cast<bro_uint_t>(1));
+	size_t ring_size = capture_ring.size();
+
+	while ( ! capture_done && ! capture_closed )
+		{
+		size_t tail = capture_tail.load(std::memory_order_relaxed);
+		size_t head = capture_head.load(std::memory_order_acquire);
+
+		// With the ring full, packets still get read so that the
+		// kernel's buffer doesn't fill up too, but dropped.
+		CaptureBatch* b = nullptr;
+
+		if ( tail - head < ring_size )
+			{
+			b = &capture_ring[tail % ring_size];
+			b->packets.clear();
+			b->data.clear();
+			}
+
+		size_t n = 0;
+
+			{
+			std::lock_guard<std::mutex> lock(source_mutex);
+
+			if ( capture_done )
+				break;
+
+			while ( n < max && ! capture_closed && ExtractNextPacket(&pkt) )
+				{
+				if ( b )
+					{
+					b->packets.push_back({pkt.ts, pkt.len, pkt.cap_len,
+					                      static_cast<uint32_t>(pkt.link_type),
+					                      b->data.size(), pkt.l2_checksummed,
+					                      pkt.l3_checksummed, pkt.l4_checksummed});
+					b->data.insert(b->data.end(), pkt.data, pkt.data + pkt.cap_len);
+					}
+				else
+					++capture_drops;
+
+				++n;
+				DoneWithPacket();
+				}
+			}
+
+		if ( b && ! b->packets.empty() )
+			{
+			capture_tail.store(tail + 1, std::memory_order_release);
+			capture_flare->Fire();
+			}
+
+		if ( n == 0 )
+			WaitForPackets();
+		}
+	}
+
+void PktSrc::WaitForPackets()
+	{
+	if ( props.selectable_fd == -1 )
+		{
+		usleep(20);
+		return;
+		}
+
+	// Short enough for noticing a stop request.
+	struct pollfd pfd = {props.selectable_fd, POLLIN, 0};
+	poll(&pfd, 1, 10);
+	}
+
+void PktSrc::ProcessCaptured()
+	{
+	if ( run_state::is_processing_suspended() && run_state::detail::first_timestamp )
+		return;
+
+	capture_flare->Extinguish();
+
+	std::vector<CaptureMessage> msgs;
+
+		{
+		std::lock_guard<std::mutex> lock(capture_msgs_mutex);
+		msgs.swap(capture_msgs);
+		}
+
+	for ( const auto& m : msgs )
+		{
+		switch ( m.type ) {
+		case CAPTURE_INFO:
+			reporter->Info("%s", m.msg.c_str());
+			break;
+		case CAPTURE_WEIRD:
+			sessions->Weird(m.msg.c_str(), static_cast<const Packet*>(nullptr));
+			break;
+		case CAPTURE_READ_ERROR:
+			reporter->Error("%s", m.msg.c_str());
+			break;
+		}
+		}
+
+	size_t head = capture_head.load(std::memory_order_relaxed);
+
+	if ( head != capture_tail.load(std::memory_order_acquire) )
+		{
+		auto& b = capture_ring[head % capture_ring.size()];
+		size_t n = b.packets.size();
+
+		if ( batch_capacity < n )
+			{
+			batch = std::make_unique<Packet[]>(n);
+			batch_capacity = n;
+			}
+
+		for ( size_t i = 0; i < n; ++i )
+			{
+			auto& c = b.packets[i];
+			Packet* pkt = &batch[i];
+			pkt->Init(c.link_type, &c.ts, c.cap_len, c.len, b.data.data() + c.offset);
+			pkt->l2_checksummed = c.l2_checksummed;
+			pkt->l3_checksummed = c.l3_checksummed;
+			pkt->l4_checksummed = c.l4_checksummed;
+			}
+
+		for ( size_t i = 0; i < n; ++i )
+			{
+			Packet* pkt = &batch[i];
+
+			if ( ! CheckPacket(pkt) )
+				continue;
+
+			batch_packet = pkt;
+			DispatchPacket(pkt);
+			}
+
+		batch_packet = nullptr;
+		RevokePacketLease();
+		capture_head.store(++head, std::memory_order_release);
+		}
+
+	if ( head != capture_tail.load(std::memory_order_acquire) )
+		capture_flare->Fire();
+	else if ( capture_closed )
+		Closed();
+	}
+
 void PktSrc::Process()
 	{
 	if ( ! IsOpen() )
 		return;
 
-	if ( ! ExtractNextPacketInternal() )
+	if ( IsThreaded() )
+		{
+		ProcessCaptured();
+		return;
+		}
+
+	// Offline input goes packet by packet so that other sources and
+	// termination requests are considered in between, as they always
+	// have been.
+	size_t max = 1;
+
+	if ( props.is_live && ! run_state::pseudo_realtime )
+		max = std::max(BifConst::packet_source_batch_size, static_cast<bro_uint_t>(1));
+
+	if ( max > 1 && SupportsPacketBatches() && ! have_packet )
+		{
+		ProcessBatch(max);
 		return;
+		}
 
-	run_state::detail::dispatch_packet(&current_packet, this);
+	for ( size_t i = 0; i < max; ++i )
+		{
+		if ( ! ExtractNextPacketInternal() )
+			return;
 
-	have_packet = false;
+		DispatchPacket(&current_packet);
+
+		have_packet = false;
+		RevokePacketLease();
+		DoneWithPacket();
+
+		if ( run_state::terminating || ! IsOpen() )
+			return;
+		}
+	}
+
+void PktSrc::ProcessBatch(size_t max)
+	{
+	if ( run_state::is_processing_suspended() && run_state::detail::first_timestamp )
+		return;
+
+	if ( batch_capacity < max )
+		{
+		batch = std::make_unique<Packet[]>(max);
+		batch_capacity = max;
+		}
+
+	size_t n = 0;
+
+		{
+		zeek::detail::StageTimer timer(zeek::detail::PipelineStats::PKTSRC_EXTRACT);
+		n = ExtractPacketBatch(batch.get(), max);
+		}
+
+	if ( n == 0 )
+		return;
+
+	for ( size_t i = 0; i < n; ++i )
+		{
+		Packet* pkt = &batch[i];
+
+		// Packets extracted already still get processed after a
+		// termination request, as they can only be released together.
+		if ( ! CheckPacket(pkt) )
+			continue;
+
+		batch_packet = pkt;
+		DispatchPacket(pkt);
+		}
+
+	batch_packet = nullptr;
+	RevokePacketLease();
 	DoneWithPacket();
 	}
 
+void PktSrc::DispatchPacket(Packet* pkt)
+	{
+	if ( BifConst::packet_data_leases )
+		{
+		leasing_src = this;
+		leased_packet = pkt;
+		}
+
+	run_state::detail::dispatch_packet(pkt, this);
+
+	leasing_src = nullptr;
+	leased_packet = nullptr;
+	}
+
+PacketLease* PktSrc::LeaseData(const u_char* data, uint64_t len)
+	{
+	if ( ! leased_packet )
+		return nullptr;
+
+	// A capture thread hands over copies of the source's packets.
+	if ( ! IsThreaded() )
+		if ( auto lease = DoLeaseData(data, len) )
+			return lease;
+
+	// Otherwise the data is good until DoneWithPacket().
+	const u_char* start = leased_packet->data;
+
+	if ( data < start || data + len > start + leased_packet->cap_len )
+		return nullptr;
+
+	if ( ! packet_lease )
+		packet_lease = std::make_unique<PacketLease>(this, 0);
+
+	return packet_lease.get();
+	}
+
+bool PktSrc::CheckPacket(Packet* pkt)
+	{
+	if ( pkt->time < 0 )
+		{
+		Weird("negative_packet_timestamp", pkt);
+		return false;
+		}
+
+	if ( ! run_state::detail::first_timestamp )
+		run_state::detail::first_timestamp = pkt->time;
+
+	return true;
+	}
+
 const char* PktSrc::Tag()
 	{
 	return "PktSrc";
@@ -188,16 +547,12 @@ bool PktSrc::ExtractNextPacketInternal()
 	if ( run_state::pseudo_realtime )
 		run_state::detail::current_wallclock = util::current_time(true);
 
+	zeek::detail::StageTimer timer(zeek::detail::PipelineStats::PKTSRC_EXTRACT);
+
 	if ( ExtractNextPacket(&current_packet) )
 		{
-		if ( current_packet.time < 0 )
-			{
-			Weird("negative_packet_timestamp", &current_packet);
+		if ( ! CheckPacket(&current_packet) )
 			return false;
-			}
-
-		if ( ! run_state::detail::first_timestamp )
-			run_state::detail::first_timestamp = current_packet.time;
 
 		have_packet = true;
 		return true;
@@ -217,12 +572,33 @@ bool PktSrc::PrecompileBPFFilter(int index, const std::string& filter)
 	if ( index < 0 )
 		return false;
 
+	int snaplen = BifConst::Pcap::snaplen;
+
+	// Scripts precompile their filters again whenever they reinstall
+	// them, usually unchanged.
+	if ( auto old = GetBPFFilter(index);
+	     old && old->CompiledFrom(snaplen, LinkType(), filter.c_str(), Netmask()) )
+		return true;
+
 	char errbuf[PCAP_ERRBUF_SIZE];
+	*errbuf = '\0';
 
-	// Compile filter.
 	auto* code = new detail::BPF_Program();
+	bool have_code = false;
+
+	// Reuse the code of another index with the same filter, if any.
+	for ( auto f : filters )
+		{
+		if ( f && f->CompiledFrom(snaplen, LinkType(), filter.c_str(), Netmask()) )
+			{
+			have_code = code->CopyFrom(*f);
+			break;
+			}
+		}
 
-	if ( ! code->Compile(BifConst::Pcap::snaplen, LinkType(), filter.c_str(), Netmask(), errbuf, sizeof(errbuf)) )
+	// Compile filter.
+	if ( ! have_code &&
+	     ! code->Compile(snaplen, LinkType(), filter.c_str(), Netmask(), errbuf, sizeof(errbuf)) )
 		{
 		std::string msg = util::fmt("cannot compile BPF filter \"%s\"", filter.c_str());
 
@@ -274,6 +650,12 @@ bool PktSrc::ApplyBPFFilter(int index, const struct pcap_pkthdr *hdr, const u_ch
 
 bool PktSrc::GetCurrentPacket(const Packet** pkt)
 	{
+	if ( batch_packet )
+		{
+		*pkt = batch_packet;
+		return true;
+		}
+
 	if ( ! have_packet )
 		return false;
 
@@ -283,6 +665,10 @@ bool PktSrc::GetCurrentPacket(const Packet** pkt)
 
 double PktSrc::GetNextTimeout()
 	{
+	// The capture thread's flare signals new batches.
+	if ( IsThreaded() )
+		return -1;
+
 	// If there's no file descriptor for the source, which is the case for some interfaces like
 	// myricom, we can't rely on the polling mechanism to wait for data to be available. As gross
 	// as it is, just spin with a short timeout here so that it will continually poll the
@@ -3,13 +3,19 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "zeek/iosource/IOSource.h"
 #include "zeek/iosource/Packet.h"
+#include "zeek/iosource/PacketLease.h"
 
 struct pcap_pkthdr;
 ZEEK_FORWARD_DECLARE_NAMESPACED(BPF_Program, zeek::iosource::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(Flare, zeek::detail);
 
 namespace zeek::iosource {
 
@@ -202,6 +208,47 @@ public:
 	 */
 	virtual void Statistics(Stats* stats) = 0;
 
+	/**
+	 * Fills in the source's statistics like \a Statistics(), but safely
+	 * while a capture thread is running, and counting the packets that
+	 * got dropped with the thread's queue full.
+	 *
+	 * @param stats A statistics structure that the method fill out.
+	 */
+	void GetStatistics(Stats* stats);
+
+	/**
+	 * Returns a lock that keeps the source's capture thread, if any,
+	 * from using the source meanwhile. Calls from the main thread into
+	 * the source's implementation, like \a SetFilter(), must hold it.
+	 */
+	std::unique_lock<std::mutex> LockSource()
+		{ return std::unique_lock<std::mutex>(source_mutex); }
+
+	/**
+	 * Returns true if a thread of its own extracts the source's packets,
+	 * see :zeek:see:`packet_capture_threads`.
+	 */
+	bool IsThreaded() const	{ return capture_thread.joinable(); }
+
+	/**
+	 * Asks the source to stop delivering the packets of a flow, in both
+	 * directions, e.g. by updating a kernel filter.  Zeek drops such
+	 * packets itself either way, so sources only need to override this
+	 * if they can do it more cheaply.
+	 *
+	 * @param orig_h, orig_p, resp_h, resp_p, proto The flow's 5-tuple.
+	 *
+	 * @param duration How long to drop the flow's packets for, or 0 for
+	 * indefinitely.
+	 *
+	 * @return True if the source now drops the flow's packets.
+	 */
+	virtual bool ShuntFlow(const IPAddr& orig_h, uint32_t orig_p,
+	                       const IPAddr& resp_h, uint32_t resp_p,
+	                       TransportProto proto, double duration)
+		{ return false; }
+
 	/**
 	 * Return the next timeout value for this source. This should be
 	 * overridden by source classes where they have a timeout value
@@ -294,6 +341,14 @@ protected:
 	 */
 	void Weird(const std::string& msg, const Packet* pkt);
 
+	/**
+	 * Can be called from derived classes to report a failure to read a
+	 * packet that the source recovers from.
+	 *
+	 * @param msg The message to pass on.
+	 */
+	void ReadError(const std::string& msg);
+
 	/**
 	 * Can be called from derived classes to flag an internal error,
 	 * which will abort execution.
@@ -343,11 +398,137 @@ protected:
 	 */
 	virtual void DoneWithPacket() = 0;
 
+	/**
+	 * Returns true if the source implements \a ExtractPacketBatch().
+	 * Live sources that can hand out several packets at once cheaply
+	 * override this to opt in.
+	 */
+	virtual bool SupportsPacketBatches() const	{ return false; }
+
+	/**
+	 * Provides up to \a n packets at once. Only called if \a
+	 * SupportsPacketBatches() returns true, and only for live input
+	 * outside of pseudo-realtime mode.
+	 *
+	 * The semantics follow \a ExtractNextPacket(), except that the data
+	 * of all returned packets must stay available until \a
+	 * DoneWithPacket() is called, which happens once, after the last of
+	 * them has been processed.
+	 *
+	 * @param pkts An array of \a n packet structures to fill in.
+	 *
+	 * @param n The maximum number of packets to return.
+	 *
+	 * @return The number of packets filled in, which may be zero.
+	 */
+	virtual size_t ExtractPacketBatch(Packet* pkts, size_t n)	{ return 0; }
+
+	/**
+	 * Returns a lease on source memory that the given data lies in, for
+	 * holders to keep referring to beyond \a DoneWithPacket(). Sources
+	 * reading into memory that they can lend out, like a ring shared
+	 * with the kernel, override this. They must keep the memory of a
+	 * lease available until \a LeaseReleased() is called for it, and
+	 * should return null when they're short on memory, so that the data
+	 * gets copied instead.
+	 *
+	 * @param data The start of the data, which is part of the packet
+	 * being processed, or of another one extracted together with it.
+	 *
+	 * @param len The length of the data.
+	 */
+	virtual PacketLease* DoLeaseData(const u_char* data, uint64_t len)
+		{ return nullptr; }
+
+	/**
+	 * Signals that a lease returned by \a DoLeaseData() isn't held
+	 * anymore.
+	 */
+	virtual void LeaseReleased(PacketLease* lease)	{ }
+
 private:
+	friend class PacketLease;
+
+	// Returns a lease on the data of the packet being processed, see
+	// PacketLease::Acquire(). Without one from DoLeaseData(), it's one
+	// that gets revoked before DoneWithPacket().
+	PacketLease* LeaseData(const u_char* data, uint64_t len);
+
+	// Called by a lease that's no longer held.
+	void ReleaseLease(PacketLease* lease)
+		{
+		if ( lease != packet_lease.get() )
+			LeaseReleased(lease);
+		}
+
+	// Dispatches a packet, letting analyzers lease its data meanwhile.
+	void DispatchPacket(Packet* pkt);
+
+	// A packet extracted by the capture thread. Its data follows that of
+	// the previous packet in the batch.
+	struct CapturedPacket {
+		pkt_timeval ts;
+		uint32_t len;
+		uint32_t cap_len;
+		uint32_t link_type;
+		size_t offset;	// Of the data in the batch.
+		bool l2_checksummed;
+		bool l3_checksummed;
+		bool l4_checksummed;
+	};
+
+	struct CaptureBatch {
+		std::vector<CapturedPacket> packets;
+		std::vector<u_char> data;
+	};
+
+	// A message that the capture thread leaves for the main thread.
+	enum CaptureMessageType { CAPTURE_INFO, CAPTURE_WEIRD, CAPTURE_READ_ERROR };
+
+	struct CaptureMessage {
+		CaptureMessageType type;
+		std::string msg;
+	};
+
+	// Whether to extract packets in a thread of their own once open.
+	bool WantCaptureThread() const;
+
+	void StartCaptureThread();
+	void StopCaptureThread();
+
+	// The body of the capture thread.
+	void Capture();
+
+	// Waits a little for the source to have packets.
+	void WaitForPackets();
+
+	// Dispatches the packets of the next batch from the capture thread.
+	void ProcessCaptured();
+
+	// Hands a message to the main thread if called from the capture
+	// thread, returning false otherwise.
+	bool DeferMessage(CaptureMessageType type, const std::string& msg);
+
+	// Revokes the lease on the packets about to be done.
+	void RevokePacketLease()
+		{
+		if ( packet_lease && packet_lease->Held() )
+			packet_lease->Revoke();
+		}
+
+	// The source of the packet being dispatched, if any.
+	static PktSrc* leasing_src;
 
 	// Internal helper for ExtractNextPacket().
 	bool ExtractNextPacketInternal();
 
+	// Processes up to the given number of packets obtained through
+	// ExtractPacketBatch().
+	void ProcessBatch(size_t max);
+
+	// Checks an extracted packet before dispatching it.
+	bool CheckPacket(Packet* pkt);
+
 	// IOSource interface implementation.
 	void InitSource() override;
 	void Done() override;
@@ -359,6 +540,30 @@ private:
 	bool have_packet;
 	Packet current_packet;
 
+	std::unique_ptr<Packet[]> batch;
+	size_t batch_capacity = 0;
+	const Packet* batch_packet = nullptr;	// The batch's packet being dispatched.
+
+	const Packet* leased_packet = nullptr;	// The packet that LeaseData() lends.
+	std::unique_ptr<PacketLease> packet_lease;
+
+	// With packet_capture_threads, a thread extracts the packets of a
+	// live source and hands them over in batches through a ring with a
+	// single producer and a single consumer, so that capture keeps up
+	// while the main thread is busy.
+	std::thread capture_thread;
+	std::thread::id capture_thread_id;
+	std::mutex source_mutex;	// Held by the thread while extracting.
+	std::vector<CaptureBatch> capture_ring;
+	std::atomic<size_t> capture_head{0};	// Next batch to process.
+	std::atomic<size_t> capture_tail{0};	// Next batch to fill.
+	std::atomic<uint64_t> capture_drops{0};	// Packets dropped with the ring full.
+	std::atomic<bool> capture_done{false};	// Tells the thread to stop.
+	std::atomic<bool> capture_closed{false};	// The source closed in the thread.
+	std::unique_ptr<zeek::detail::Flare> capture_flare;
+	std::mutex capture_msgs_mutex;
+	std::vector<CaptureMessage> capture_msgs;
+
 	// For BPF filtering support.
 	std::vector<detail::BPF_Program *> filters;
 
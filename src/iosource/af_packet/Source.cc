@@ -0,0 +1,562 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/iosource/af_packet/Source.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <algorithm>
+#include <atomic>
+
+extern "C" {
+#include <pcap.h>
+}
+
+#include "zeek/iosource/Packet.h"
+#include "zeek/iosource/BPF_Program.h"
+#include "zeek/ID.h"
+#include "zeek/Val.h"
+
+// Room the kernel leaves in front of each packet, so that a stripped
+// VLAN tag can be put back in place.
+static constexpr int VLAN_TAG_LEN = 4;
+
+// Mirrors the values of the script-level AF_Packet::FanoutMode.
+enum FanoutMode { FANOUT_HASH, FANOUT_CPU, FANOUT_QM };
+
+namespace zeek::iosource::af_packet {
+
+// The options are looked up by name rather than through BIF constants, as
+// this source only exists on Linux while the script-level definitions
+// are always there.
+static const ValPtr& option(const char* name)
+	{
+	return id::find_const(util::fmt("AF_Packet::%s", name));
+	}
+
+AF_PacketSource::~AF_PacketSource()
+	{
+	Close();
+	}
+
+AF_PacketSource::AF_PacketSource(const std::string& path, bool is_live)
+	{
+	props.path = path;
+	props.is_live = is_live;
+	}
+
+void AF_PacketSource::Open()
+	{
+	if ( props.path.empty() )
+		{
+		Error("af_packet: no interface given");
+		return;
+		}
+
+	int ifindex = if_nametoindex(props.path.c_str());
+
+	if ( ! ifindex )
+		{
+		Error(util::fmt("af_packet: unknown interface %s", props.path.c_str()));
+		return;
+		}
+
+	fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+
+	if ( fd < 0 )
+		{
+		SocketError("socket");
+		return;
+		}
+
+	if ( ! ConfigureSocket(ifindex) )
+		return;
+
+	props.selectable_fd = fd;
+	props.netmask = NETMASK_UNKNOWN;
+	props.is_live = true;
+
+	Opened(props);
+	}
+
+bool AF_PacketSource::ConfigureSocket(int ifindex)
+	{
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, props.path.c_str(), sizeof(ifr.ifr_name) - 1);
+
+	if ( ioctl(fd, SIOCGIFHWADDR, &ifr) < 0 )
+		{
+		SocketError("SIOCGIFHWADDR");
+		return false;
+		}
+
+	switch ( ifr.ifr_hwaddr.sa_family ) {
+	case ARPHRD_ETHER:
+	case ARPHRD_LOOPBACK:
+		props.link_type = DLT_EN10MB;
+		break;
+
+	case ARPHRD_NONE:
+		props.link_type = DLT_RAW;
+		break;
+
+	default:
+		Error(util::fmt("af_packet: unsupported link type %d on %s",
+		                ifr.ifr_hwaddr.sa_family, props.path.c_str()));
+		Close();
+		return false;
+	}
+
+	int version = TPACKET_V3;
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 )
+		{
+		SocketError("PACKET_VERSION");
+		return false;
+		}
+
+	int reserve = VLAN_TAG_LEN;
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_RESERVE, &reserve, sizeof(reserve)) < 0 )
+		{
+		SocketError("PACKET_RESERVE");
+		return false;
+		}
+
+	if ( option("enable_hw_timestamping")->AsBool() && ! EnableHWTimestamping() )
+		return false;
+
+	if ( ! SetupRing() )
+		return false;
+
+	struct sockaddr_ll addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sll_family = AF_PACKET;
+	addr.sll_protocol = htons(ETH_P_ALL);
+	addr.sll_ifindex = ifindex;
+
+	if ( bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 )
+		{
+		SocketError("bind");
+		return false;
+		}
+
+	if ( ! EnablePromisc(ifindex) )
+		return false;
+
+	// The fanout group can only be joined once the socket is bound.
+	if ( option("enable_fanout")->AsBool() && ! JoinFanout() )
+		return false;
+
+	return true;
+	}
+
+bool AF_PacketSource::SetupRing()
+	{
+	block_size = option("block_size")->AsCount();
+	size_t page_size = sysconf(_SC_PAGESIZE);
+
+	if ( block_size == 0 || block_size % page_size != 0 )
+		{
+		Error(util::fmt("af_packet: block size %zu is not a multiple of the page size %zu",
+		                block_size, page_size));
+		Close();
+		return false;
+		}
+
+	num_blocks = option("buffer_size")->AsCount() / block_size;
+
+	if ( num_blocks == 0 )
+		{
+		Error("af_packet: buffer size is smaller than the block size");
+		Close();
+		return false;
+		}
+
+	struct tpacket_req3 req;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = block_size;
+	req.tp_block_nr = num_blocks;
+	// With TPACKET_V3, packets are packed into blocks regardless of
+	// their size; the frame size only serves as a sanity check.
+	req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+	req.tp_frame_nr = (block_size * num_blocks) / req.tp_frame_size;
+	req.tp_retire_blk_tov = std::max(1.0, option("block_timeout")->AsInterval() * 1000);
+	req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0 )
+		{
+		SocketError("PACKET_RX_RING");
+		return false;
+		}
+
+	ring_size = block_size * num_blocks;
+	void* mem = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE,
+	                 MAP_SHARED | MAP_POPULATE, fd, 0);
+
+	if ( mem == MAP_FAILED )
+		{
+		ring_size = 0;
+		SocketError("mmap");
+		return false;
+		}
+
+	ring = static_cast<u_char*>(mem);
+	current_block = 0;
+	block_in_use = false;
+
+	return true;
+	}
+
+bool AF_PacketSource::JoinFanout()
+	{
+	int mode;
+
+	switch ( option("fanout_mode")->AsEnum() ) {
+	case FANOUT_CPU:
+		mode = PACKET_FANOUT_CPU;
+		break;
+
+	case FANOUT_QM:
+		mode = PACKET_FANOUT_QM;
+		break;
+
+	default:
+		mode = PACKET_FANOUT_HASH;
+		break;
+	}
+
+	if ( option("enable_defrag")->AsBool() )
+		mode |= PACKET_FANOUT_FLAG_DEFRAG;
+
+	bro_uint_t fanout_id = option("fanout_id")->AsCount();
+
+	if ( fanout_id > 0xffff )
+		{
+		Error("af_packet: fanout ID must be less than 65536");
+		Close();
+		return false;
+		}
+
+	int arg = fanout_id | (mode << 16);
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0 )
+		{
+		SocketError("PACKET_FANOUT");
+		return false;
+		}
+
+	return true;
+	}
+
+bool AF_PacketSource::EnablePromisc(int ifindex)
+	{
+	struct packet_mreq mreq;
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.mr_ifindex = ifindex;
+	mreq.mr_type = PACKET_MR_PROMISC;
+
+	// Membership ends with the socket, leaving the interface's own
+	// promiscuous setting untouched.
+	if ( setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 )
+		{
+		SocketError("PACKET_ADD_MEMBERSHIP");
+		return false;
+		}
+
+	return true;
+	}
+
+bool AF_PacketSource::EnableHWTimestamping()
+	{
+	struct hwtstamp_config config;
+	memset(&config, 0, sizeof(config));
+	config.tx_type = HWTSTAMP_TX_OFF;
+	config.rx_filter = HWTSTAMP_FILTER_ALL;
+
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, props.path.c_str(), sizeof(ifr.ifr_name) - 1);
+	ifr.ifr_data = reinterpret_cast<char*>(&config);
+
+	if ( ioctl(fd, SIOCSHWTSTAMP, &ifr) < 0 )
+		{
+		// Not an error, the kernel's own timestamps work just as well
+		// for most purposes.
+		Info(util::fmt("af_packet: hardware timestamping not available on %s: %s",
+		               props.path.c_str(), strerror(errno)));
+		return true;
+		}
+
+	int req = SOF_TIMESTAMPING_RAW_HARDWARE;
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_TIMESTAMP, &req, sizeof(req)) < 0 )
+		{
+		SocketError("PACKET_TIMESTAMP");
+		return false;
+		}
+
+	return true;
+	}
+
+void AF_PacketSource::Close()
+	{
+	if ( fd < 0 )
+		return;
+
+	// Analyzers copy what they still refer to while the ring is there.
+	for ( auto& l : leases )
+		if ( l && l->Held() )
+			l->Revoke();
+
+	leases.clear();
+
+	if ( ring )
+		{
+		munmap(ring, ring_size);
+		ring = nullptr;
+		ring_size = 0;
+		}
+
+	close(fd);
+	fd = -1;
+	block_in_use = false;
+
+	Closed();
+	}
+
+bool AF_PacketSource::ExtractNextPacket(Packet* pkt)
+	{
+	if ( ! ring )
+		return false;
+
+	if ( ! block_in_use )
+		{
+		tpacket_block_desc* block = CurrentBlock();
+
+		if ( ! (block->hdr.bh1.block_status & TP_STATUS_USER) )
+			// Nothing available yet.
+			return false;
+
+		// Make sure we don't see the block's content from before the
+		// kernel handed it over.
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		packets_left = block->hdr.bh1.num_pkts;
+		next_packet = reinterpret_cast<tpacket3_hdr*>(
+			reinterpret_cast<u_char*>(block) + block->hdr.bh1.offset_to_first_pkt);
+		block_in_use = true;
+
+		if ( packets_left == 0 )
+			{
+			ReleaseBlock();
+			return false;
+			}
+		}
+
+	tpacket3_hdr* hdr = next_packet;
+	u_char* data = reinterpret_cast<u_char*>(hdr) + hdr->tp_mac;
+	uint32_t caplen = hdr->tp_snaplen;
+	uint32_t len = hdr->tp_len;
+
+	// The kernel strips VLAN tags and reports them separately. Put the
+	// tag back into the space reserved in front of the packet, so that
+	// the packet reaches the analyzers as it appeared on the wire.
+	if ( props.link_type == DLT_EN10MB &&
+	     (hdr->hv1.tp_vlan_tci || (hdr->tp_status & TP_STATUS_VLAN_VALID)) &&
+	     caplen >= 2 * ETH_ALEN )
+		{
+		data -= VLAN_TAG_LEN;
+		memmove(data, data + VLAN_TAG_LEN, 2 * ETH_ALEN);
+
+		uint16_t tpid = (hdr->tp_status & TP_STATUS_VLAN_TPID_VALID) ?
+			hdr->hv1.tp_vlan_tpid : ETH_P_8021Q;
+		uint16_t tag[2] = { htons(tpid), htons(hdr->hv1.tp_vlan_tci) };
+		memcpy(data + 2 * ETH_ALEN, tag, sizeof(tag));
+
+		caplen += VLAN_TAG_LEN;
+		len += VLAN_TAG_LEN;
+		}
+
+	// With hardware timestamping active, the kernel places the NIC's
+	// timestamp here.
+	pkt_timeval ts = { static_cast<time_t>(hdr->tp_sec),
+	                   static_cast<suseconds_t>(hdr->tp_nsec / 1000) };
+
+	pkt->Init(props.link_type, &ts, caplen, len, data);
+
+	if ( --packets_left > 0 )
+		next_packet = reinterpret_cast<tpacket3_hdr*>(
+			reinterpret_cast<u_char*>(hdr) + hdr->tp_next_offset);
+
+	++stats.received;
+	stats.bytes_received += len;
+
+	return true;
+	}
+
+size_t AF_PacketSource::ExtractPacketBatch(Packet* pkts, size_t n)
+	{
+	size_t i = 0;
+
+	// A batch ends with the current block, as that's the unit in which
+	// DoneWithPacket() gives memory back to the kernel.
+	while ( i < n && ExtractNextPacket(&pkts[i]) )
+		{
+		++i;
+
+		if ( packets_left == 0 )
+			break;
+		}
+
+	return i;
+	}
+
+void AF_PacketSource::DoneWithPacket()
+	{
+	// The packet data lives in the block, so it can only go back to the
+	// kernel once its last packet has been processed.
+	if ( block_in_use && packets_left == 0 )
+		ReleaseBlock();
+	}
+
+void AF_PacketSource::ReleaseBlock()
+	{
+	if ( current_block >= leases.size() || ! leases[current_block] ||
+	     ! leases[current_block]->Held() )
+		ReturnBlock(current_block);
+
+	block_in_use = false;
+	current_block = (current_block + 1) % num_blocks;
+
+	if ( leases.empty() )
+		return;
+
+	// The kernel fills the blocks in turn, so one still leased when it
+	// comes around again would stall the ring.
+	auto& old = leases[(current_block + num_blocks - num_blocks / 2) % num_blocks];
+
+	if ( old && old->Held() )
+		old->Revoke();
+	}
+
+void AF_PacketSource::ReturnBlock(unsigned int index)
+	{
+	std::atomic_thread_fence(std::memory_order_release);
+	reinterpret_cast<tpacket_block_desc*>(ring + index * block_size)->hdr.bh1.block_status =
+		TP_STATUS_KERNEL;
+	}
+
+PacketLease* AF_PacketSource::DoLeaseData(const u_char* data, uint64_t len)
+	{
+	// With only a few blocks, there's no room for holding on to any.
+	if ( ! ring || num_blocks < 4 || data < ring || data + len > ring + ring_size )
+		return nullptr;
+
+	size_t index = (data - ring) / block_size;
+
+	if ( (data + len - 1 - ring) / block_size != index )
+		return nullptr;
+
+	// The block must not be back with the kernel.
+	bool current = index == current_block && block_in_use;
+
+	if ( ! current && ! (index < leases.size() && leases[index] && leases[index]->Held()) )
+		return nullptr;
+
+	if ( leases.empty() )
+		leases.resize(num_blocks);
+
+	if ( ! leases[index] )
+		leases[index] = std::make_unique<PacketLease>(this, index);
+
+	return leases[index].get();
+	}
+
+void AF_PacketSource::LeaseReleased(PacketLease* lease)
+	{
+	auto index = lease->ID();
+
+	// Otherwise ReleaseBlock() returns it once its packets are done.
+	if ( index != current_block || ! block_in_use )
+		ReturnBlock(index);
+	}
+
+bool AF_PacketSource::PrecompileFilter(int index, const std::string& filter)
+	{
+	return PktSrc::PrecompileBPFFilter(index, filter);
+	}
+
+bool AF_PacketSource::SetFilter(int index)
+	{
+	if ( fd < 0 )
+		return true; // Prevent error message
+
+	iosource::detail::BPF_Program* code = GetBPFFilter(index);
+
+	if ( ! code )
+		{
+		Error(util::fmt("No precompiled pcap filter for index %d", index));
+		return false;
+		}
+
+	// Filtering in the kernel keeps unwanted packets out of the ring.
+	// A classic BPF instruction has the same layout as the kernel's
+	// sock_filter.
+	struct bpf_program* program = code->GetProgram();
+	struct sock_fprog fprog;
+	fprog.len = program->bf_len;
+	fprog.filter = reinterpret_cast<struct sock_filter*>(program->bf_insns);
+
+	if ( setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0 )
+		{
+		SocketError("SO_ATTACH_FILTER");
+		return false;
+		}
+
+	return true;
+	}
+
+void AF_PacketSource::Statistics(Stats* s)
+	{
+	if ( fd >= 0 )
+		{
+		struct tpacket_stats_v3 tp_stats;
+		socklen_t optlen = sizeof(tp_stats);
+
+		// The kernel resets its counters with every query, so they
+		// need to be accumulated here.
+		if ( getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &tp_stats, &optlen) == 0 )
+			{
+			stats.link += tp_stats.tp_packets;
+			stats.dropped += tp_stats.tp_drops;
+			}
+		}
+
+	*s = stats;
+	}
+
+void AF_PacketSource::SocketError(const char* where)
+	{
+	Error(util::fmt("af_packet: %s failed on %s: %s", where, props.path.c_str(), strerror(errno)));
+	Close();
+	}
+
+iosource::PktSrc* AF_PacketSource::Instantiate(const std::string& path, bool is_live)
+	{
+	return new AF_PacketSource(path, is_live);
+	}
+
+} // namespace zeek::iosource::af_packet
@@ -0,0 +1,87 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <linux/if_packet.h>
+#include <memory>
+#include <vector>
+
+#include "zeek/iosource/PktSrc.h"
+
+namespace zeek::iosource::af_packet {
+
+/**
+ * A live packet source reading from a Linux AF_PACKET socket through a
+ * TPACKET_V3 memory-mapped receive ring.
+ *
+ * Packets are handed out directly from the ring's blocks, without copying.
+ * A block goes back to the kernel once all of its packets have been
+ * processed, and analyzers have released their leases on it. With fanout enabled, all sources using the same fanout ID on
+ * an interface split its traffic between them.
+ */
+class AF_PacketSource : public PktSrc {
+public:
+	AF_PacketSource(const std::string& path, bool is_live);
+	~AF_PacketSource() override;
+
+	static PktSrc* Instantiate(const std::string& path, bool is_live);
+
+protected:
+	// PktSrc interface.
+	void Open() override;
+	void Close() override;
+	bool ExtractNextPacket(Packet* pkt) override;
+	void DoneWithPacket() override;
+	bool SupportsPacketBatches() const override	{ return true; }
+	size_t ExtractPacketBatch(Packet* pkts, size_t n) override;
+	bool PrecompileFilter(int index, const std::string& filter) override;
+	bool SetFilter(int index) override;
+	void Statistics(Stats* stats) override;
+	PacketLease* DoLeaseData(const u_char* data, uint64_t len) override;
+	void LeaseReleased(PacketLease* lease) override;
+
+private:
+	bool ConfigureSocket(int ifindex);
+	bool SetupRing();
+	bool JoinFanout();
+	bool EnablePromisc(int ifindex);
+	bool EnableHWTimestamping();
+
+	// Closes the source, flagging an error from the given location and
+	// the current errno.
+	void SocketError(const char* where);
+
+	// Returns the block the source is currently positioned at.
+	tpacket_block_desc* CurrentBlock() const
+		{ return reinterpret_cast<tpacket_block_desc*>(ring + current_block * block_size); }
+
+	// Hands the current block back to the kernel, unless it's leased, and
+	// moves to the next.
+	void ReleaseBlock();
+
+	// Hands a block back to the kernel.
+	void ReturnBlock(unsigned int index);
+
+	Properties props;
+	Stats stats;
+
+	int fd = -1;
+
+	u_char* ring = nullptr;
+	size_t ring_size = 0;
+	size_t block_size = 0;
+	unsigned int num_blocks = 0;
+
+	unsigned int current_block = 0;
+	tpacket3_hdr* next_packet = nullptr;	// Next packet in the current block.
+	uint32_t packets_left = 0;	// Packets of the current block not yet extracted.
+	bool block_in_use = false;	// True while a block is being worked through.
+
+	// Leases on blocks, by index, created as needed. A block that's
+	// still leased once its packets are done stays out of the kernel's
+	// hands until released, or until the source has moved on by half
+	// of the ring, at which point the lease gets revoked.
+	std::vector<std::unique_ptr<PacketLease>> leases;
+};
+
+} // namespace zeek::iosource::af_packet
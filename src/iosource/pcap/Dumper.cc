@@ -4,14 +4,26 @@
 
 #include <sys/stat.h>
 #include <errno.h>
+#include <algorithm>
+#include <cstring>
 
 #include "zeek/iosource/PktSrc.h"
+#include "zeek/Reporter.h"
 #include "zeek/RunState.h"
 
 #include "iosource/pcap/pcap.bif.h"
 
 namespace zeek::iosource::pcap {
 
+// The header of a packet in a pcap file, which unlike pcap_pkthdr has
+// 32-bit timestamps.
+struct FilePktHdr {
+	uint32_t sec;
+	uint32_t usec;
+	uint32_t caplen;
+	uint32_t len;
+};
+
 PcapDumper::PcapDumper(const std::string& path, bool arg_append)
 	{
 	append = arg_append;
@@ -82,6 +94,16 @@ void PcapDumper::Open()
 			}
 		}
 
+	buffer_size = BifConst::Pcap::dump_buffer_size;
+
+	if ( buffer_size > 0 )
+		{
+		block_size = std::min(buffer_size, size_t(1024 * 1024));
+		block.reserve(block_size);
+		done = false;
+		writer = std::thread(&PcapDumper::WriteBlocks, this);
+		}
+
 	props.open_time = run_state::network_time;
 	Opened(props);
 	}
@@ -91,6 +113,25 @@ void PcapDumper::Close()
 	if ( ! dumper )
 		return;
 
+	if ( writer.joinable() )
+		{
+		QueueBlock();
+
+			{
+			std::lock_guard<std::mutex> lock(mutex);
+			done = true;
+			}
+
+		have_block.notify_one();
+		writer.join();
+
+		if ( dropped )
+			reporter->Warning("%s: dropped %" PRIu64 " packets with the dump buffer full",
+			                  props.path.c_str(), dropped);
+
+		dropped = 0;
+		}
+
 	pcap_dump_close(dumper);
 	pcap_close(pd);
 	dumper = nullptr;
@@ -109,10 +150,84 @@ bool PcapDumper::Dump(const Packet* pkt)
 		.ts = pkt->ts, .caplen = pkt->cap_len, .len = pkt->len
 	};
 
-	pcap_dump((u_char*) dumper, &phdr, pkt->data);
+	if ( buffer_size == 0 )
+		{
+		pcap_dump((u_char*) dumper, &phdr, pkt->data);
+		return true;
+		}
+
+	size_t need = sizeof(FilePktHdr) + pkt->cap_len;
+
+	if ( block.size() + need > block_size && ! block.empty() )
+		QueueBlock();
+
+	if ( queued + block.size() + need > buffer_size )
+		{
+		if ( BifConst::Pcap::dump_drop_when_full )
+			{
+			++dropped;
+			return true;
+			}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		have_space.wait(lock, [&]{ return queued == 0 || queued + need <= buffer_size; });
+		}
+
+	FilePktHdr hdr = {
+		static_cast<uint32_t>(pkt->ts.tv_sec), static_cast<uint32_t>(pkt->ts.tv_usec),
+		pkt->cap_len, pkt->len
+	};
+
+	auto p = reinterpret_cast<const char*>(&hdr);
+	block.insert(block.end(), p, p + sizeof(hdr));
+	block.insert(block.end(), pkt->data, pkt->data + pkt->cap_len);
 	return true;
 	}
 
+void PcapDumper::QueueBlock()
+	{
+	if ( block.empty() )
+		return;
+
+	std::vector<char> b;
+	b.reserve(block_size);
+	b.swap(block);
+
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued += b.size();
+		blocks.push_back(std::move(b));
+		}
+
+	have_block.notify_one();
+	}
+
+void PcapDumper::WriteBlocks()
+	{
+	FILE* f = pcap_dump_file(dumper);
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for ( ;; )
+		{
+		have_block.wait(lock, [&]{ return done || ! blocks.empty(); });
+
+		if ( blocks.empty() )
+			break;
+
+		auto b = std::move(blocks.front());
+		blocks.pop_front();
+		lock.unlock();
+
+		fwrite(b.data(), 1, b.size(), f);
+
+		lock.lock();
+		queued -= b.size();
+		have_space.notify_one();
+		}
+
+	fflush(f);
+	}
+
 iosource::PktDumper* PcapDumper::Instantiate(const std::string& path, bool append)
 	{
 	return new PcapDumper(path, append);
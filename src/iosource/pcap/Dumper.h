@@ -6,6 +6,13 @@ extern "C" {
 #include <pcap.h>
 }
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "zeek/iosource/PktDumper.h"
 
 namespace zeek::iosource::pcap {
@@ -24,11 +31,31 @@ protected:
 	bool Dump(const Packet* pkt) override;
 
 private:
+	// Hands the current block to the writer thread.
+	void QueueBlock();
+
+	// The body of the writer thread.
+	void WriteBlocks();
+
 	Properties props;
 
 	bool append;
 	pcap_dumper_t* dumper;
 	pcap_t* pd;
+
+	// With Pcap::dump_buffer_size set, packets collect in blocks that a
+	// thread writes out, so that slow disks don't stall the analysis.
+	size_t buffer_size = 0;
+	size_t block_size = 0;
+	std::vector<char> block;
+	std::deque<std::vector<char>> blocks;
+	std::atomic<size_t> queued{0};	// Bytes in blocks.
+	uint64_t dropped = 0;
+	bool done = false;
+	std::mutex mutex;
+	std::condition_variable have_block;
+	std::condition_variable have_space;
+	std::thread writer;
 };
 
 } // namespace zeek::iosource::pcap
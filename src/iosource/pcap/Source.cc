@@ -7,6 +7,19 @@
 #include <pcap-int.h>
 #endif
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "zeek/iosource/Packet.h"
 #include "zeek/iosource/BPF_Program.h"
 #include "zeek/Event.h"
@@ -15,6 +28,109 @@
 
 namespace zeek::iosource::pcap {
 
+// The amount of decompressed data per write into the pipe.
+static constexpr size_t DECOMPRESS_CHUNK = 256 * 1024;
+
+static bool has_suffix(const std::string& s, const char* suffix)
+	{
+	size_t n = strlen(suffix);
+	return s.size() > n && s.compare(s.size() - n, n, suffix) == 0;
+	}
+
+// Writes all of a buffer into the pipe, returning false once the reading
+// side has gone away.
+static bool write_all(int fd, const char* data, size_t len)
+	{
+	while ( len > 0 )
+		{
+		ssize_t n = write(fd, data, len);
+
+		if ( n < 0 )
+			{
+			if ( errno == EINTR )
+				continue;
+
+			return false;
+			}
+
+		data += n;
+		len -= n;
+		}
+
+	return true;
+	}
+
+static void decompress_gzip(int in, int out)
+	{
+	gzFile gz = gzdopen(in, "rb");
+
+	if ( ! gz )
+		{
+		close(in);
+		return;
+		}
+
+	gzbuffer(gz, DECOMPRESS_CHUNK);
+	auto buf = std::make_unique<char[]>(DECOMPRESS_CHUNK);
+	int n;
+
+	while ( (n = gzread(gz, buf.get(), DECOMPRESS_CHUNK)) > 0 )
+		if ( ! write_all(out, buf.get(), n) )
+			break;
+
+	gzclose(gz);
+	}
+
+#ifdef USE_ZSTD
+static void decompress_zstd(int in, int out)
+	{
+	ZSTD_DCtx* ctx = ZSTD_createDCtx();
+	size_t in_size = ZSTD_DStreamInSize();
+	auto ibuf = std::make_unique<char[]>(in_size);
+	auto obuf = std::make_unique<char[]>(DECOMPRESS_CHUNK);
+	ssize_t n;
+
+	while ( ctx && (n = read(in, ibuf.get(), in_size)) > 0 )
+		{
+		ZSTD_inBuffer ib = {ibuf.get(), static_cast<size_t>(n), 0};
+
+		while ( ib.pos < ib.size )
+			{
+			ZSTD_outBuffer ob = {obuf.get(), DECOMPRESS_CHUNK, 0};
+
+			if ( ZSTD_isError(ZSTD_decompressStream(ctx, &ob, &ib)) ||
+			     ! write_all(out, obuf.get(), ob.pos) )
+				goto done;
+			}
+		}
+
+done:
+	ZSTD_freeDCtx(ctx);
+	close(in);
+	}
+#endif
+
+// The body of the decompression thread.  A truncated or corrupt file
+// ends the stream early, which libpcap then reports.
+static void decompress(int in, int out, bool zstd)
+	{
+	// Let writes fail with EPIPE once the source closes, rather than
+	// raising a signal.
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+#ifdef USE_ZSTD
+	if ( zstd )
+		decompress_zstd(in, out);
+	else
+#endif
+		decompress_gzip(in, out);
+
+	close(out);
+	}
+
 PcapSource::~PcapSource()
 	{
 	Close();
@@ -43,9 +159,14 @@ void PcapSource::Close()
 	pcap_close(pd);
 	pd = nullptr;
 
+	// Closing the pipe above ends the decompression, if any.
+	if ( decompressor.joinable() )
+		decompressor.join();
+
 	Closed();
 
-	if ( Pcap::file_done )
+	// Live sources may close in their capture thread.
+	if ( Pcap::file_done && ! props.is_live )
 		event_mgr.Enqueue(Pcap::file_done, make_intrusive<StringVal>(props.path));
 	}
 
@@ -167,11 +288,75 @@ void PcapSource::OpenLive()
 	Opened(props);
 	}
 
+FILE* PcapSource::OpenDecompressed()
+	{
+	int in = open(props.path.c_str(), O_RDONLY);
+
+	if ( in < 0 )
+		{
+		Error(util::fmt("cannot open %s: %s", props.path.c_str(), strerror(errno)));
+		return nullptr;
+		}
+
+	posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	int fds[2];
+
+	if ( pipe(fds) < 0 )
+		{
+		Error(util::fmt("cannot create pipe: %s", strerror(errno)));
+		close(in);
+		return nullptr;
+		}
+
+#ifdef F_SETPIPE_SZ
+	// A larger pipe lets the decompression run further ahead.
+	fcntl(fds[1], F_SETPIPE_SZ, 1024 * 1024);
+#endif
+
+	FILE* f = fdopen(fds[0], "r");
+
+	if ( ! f )
+		{
+		Error(util::fmt("cannot open pipe: %s", strerror(errno)));
+		close(fds[0]);
+		close(fds[1]);
+		close(in);
+		return nullptr;
+		}
+
+	decompressor = std::thread(decompress, in, fds[1], has_suffix(props.path, ".zst"));
+	return f;
+	}
+
 void PcapSource::OpenOffline()
 	{
 	char errbuf[PCAP_ERRBUF_SIZE];
 
-	pd = pcap_open_offline(props.path.c_str(), errbuf);
+	bool compressed = has_suffix(props.path, ".gz");
+#ifdef USE_ZSTD
+	compressed = compressed || has_suffix(props.path, ".zst");
+#endif
+
+	if ( compressed )
+		{
+		// Decompress in a thread of its own, which also reads ahead
+		// of the analysis.
+		FILE* f = OpenDecompressed();
+
+		if ( ! f )
+			return;
+
+		pd = pcap_fopen_offline(f, errbuf);
+
+		if ( ! pd )
+			{
+			fclose(f);
+			decompressor.join();
+			}
+		}
+	else
+		pd = pcap_open_offline(props.path.c_str(), errbuf);
 
 	if ( ! pd )
 		{
@@ -179,6 +364,9 @@ void PcapSource::OpenOffline()
 		return;
 		}
 
+	if ( ! compressed )
+		posix_fadvise(fileno(pcap_file(pd)), 0, 0, POSIX_FADV_SEQUENTIAL);
+
 	props.selectable_fd = fileno(pcap_file(pd));
 
 	if ( props.selectable_fd < 0 )
@@ -209,8 +397,9 @@ bool PcapSource::ExtractNextPacket(Packet* pkt)
 	case PCAP_ERROR: // -1
 		// Error occurred while reading the packet.
 		if ( props.is_live )
-			reporter->Error("failed to read a packet from %s: %s",
-			                props.path.data(), pcap_geterr(pd));
+			// Not using util::fmt(), which isn't thread-safe.
+			ReadError(std::string("failed to read a packet from ") +
+			          props.path + ": " + pcap_geterr(pd));
 		else
 			reporter->FatalError("failed to read a packet from %s: %s",
 			                     props.path.data(), pcap_geterr(pd));
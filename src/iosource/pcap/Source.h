@@ -3,6 +3,8 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
+#include <cstdio>
+#include <thread>
 
 extern "C" {
 #include <pcap.h>
@@ -34,10 +36,19 @@ private:
 	void OpenOffline();
 	void PcapError(const char* where = nullptr);
 
+	// Starts decompressing a gzip or zstd trace file in the background.
+	// Returns the stream of the decompressed data, or null after
+	// reporting an error.
+	FILE* OpenDecompressed();
+
 	Properties props;
 	Stats stats;
 
 	pcap_t *pd;
+
+	// Decompresses the trace file into a pipe that libpcap reads, if
+	// it's compressed.
+	std::thread decompressor;
 };
 
 } // namespace zeek::iosource::pcap
@@ -2,6 +2,7 @@
 
 #include "zeek/logging/Manager.h"
 
+#include <unordered_map>
 #include <utility>
 
 #include <broker/endpoint_info.hh>
@@ -16,10 +17,12 @@
 #include "zeek/IntrusivePtr.h"
 #include "zeek/Func.h"
 #include "zeek/Desc.h"
+#include "zeek/MemoryArenas.h"
 
 #include "zeek/broker/Manager.h"
 #include "zeek/threading/Manager.h"
 #include "zeek/threading/SerialTypes.h"
+#include "zeek/threading/ValueArena.h"
 
 #include "zeek/logging/WriterFrontend.h"
 #include "zeek/logging/WriterBackend.h"
@@ -61,6 +64,17 @@ struct Manager::Filter {
 	// sub-records.
 	vector<list<int> > indices;
 
+	// The same paths, flattened once the filter is set up: the path of
+	// field i is field_path[field_path_start[i]] up to the start of the
+	// next field's.  Writes walk these instead of the lists.
+	vector<int> field_path;
+	vector<int> field_path_start;
+
+	// True if another filter of the stream logs the same fields, without
+	// extension fields, so that their writers can share the values of a
+	// record.
+	bool shares_projection = false;
+
 	~Filter();
 };
 
@@ -94,6 +108,18 @@ struct Manager::Stream {
 
 	bool enable_remote;
 
+	// The offset of the column from Log::shard_fields, or -1.
+	int shard_field = -1;
+
+	// Size of the last arena of values that filters shared, to start
+	// the next one with.
+	size_t shared_arena_size = 1024;
+
+	// Record types other than the columns' that writes have used, with
+	// whether they need coercing to the columns' type.  Holding a
+	// reference keeps the addresses from getting reused.
+	std::unordered_map<const Type*, std::pair<TypePtr, bool>> record_types;
+
 	~Stream();
 	};
 
@@ -327,6 +353,20 @@ bool Manager::CreateStream(EnumVal* id, RecordVal* sval)
 
 	streams[idx]->enable_remote = id::find_val("Log::enable_remote_logging")->AsBool();
 
+	static auto shard_fields = id::find_val<TableVal>("Log::shard_fields");
+
+	if ( auto f = shard_fields->FindOrDefault({NewRef{}, id}) )
+		{
+		const char* name = f->AsString()->CheckString();
+		int offset = columns->FieldOffset(name);
+
+		if ( offset < 0 )
+			reporter->Error("Log::shard_fields names unknown field '%s' of stream %s",
+			                name, streams[idx]->name.c_str());
+		else
+			streams[idx]->shard_field = offset;
+		}
+
 	DBG_LOG(DBG_LOGGING, "Created new logging stream '%s', raising event %s",
 		streams[idx]->name.c_str(), event ? streams[idx]->event->Name() : "<none>");
 
@@ -627,6 +667,14 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval)
 		return false;
 		}
 
+	for ( const auto& path : filter->indices )
+		{
+		filter->field_path_start.push_back(filter->field_path.size());
+		filter->field_path.insert(filter->field_path.end(), path.begin(), path.end());
+		}
+
+	filter->field_path_start.push_back(filter->field_path.size());
+
 	// Get the path for the filter.
 	auto path_val = fval->GetField("path");
 
@@ -648,6 +696,7 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval)
 
 	// Add the new one.
 	stream->filters.push_back(filter);
+	UpdateSharedProjections(stream);
 
 #ifdef DEBUG
 	ODesc desc;
@@ -694,6 +743,7 @@ bool Manager::RemoveFilter(EnumVal* id, const string& name)
 			DBG_LOG(DBG_LOGGING, "Removed filter '%s' from stream '%s'",
 				filter->name.c_str(), stream->name.c_str());
 			delete filter;
+			UpdateSharedProjections(stream);
 			return true;
 			}
 		}
@@ -705,8 +755,72 @@ bool Manager::RemoveFilter(EnumVal* id, const string& name)
 	return true;
 	}
 
+void Manager::UpdateSharedProjections(Stream* stream)
+	{
+	for ( auto* f : stream->filters )
+		{
+		f->shares_projection = false;
+
+		if ( f->num_ext_fields > 0 )
+			continue;
+
+		for ( auto* g : stream->filters )
+			if ( g != f && g->num_ext_fields == 0 && g->indices == f->indices )
+				{
+				f->shares_projection = true;
+				break;
+				}
+		}
+	}
+
+// Returns true if calling the function may run script code, which could
+// change the record being logged.
+static bool may_run_script(const Func* f)
+	{
+	return f && (f->HasBodies() || f->HasPluginHooks() ||
+	             plugin_mgr->HavePluginForHook(plugin::HOOK_CALL_FUNCTION));
+	}
+
+// Hashes the value of a stream's shard field.  The hash has to be the same
+// on all nodes, so it can't use the keyed hashes.
+static uint64_t ShardHash(const Val* v)
+	{
+	switch ( v->GetType()->Tag() ) {
+	case TYPE_STRING:
+		{
+		auto s = v->AsString();
+		return util::detail::fnv1a32(s->Bytes(), s->Len());
+		}
+
+	case TYPE_ADDR:
+		{
+		uint32_t words[4];
+		v->AsAddr().CopyIPv6(words);
+		return util::detail::fnv1a32(reinterpret_cast<const u_char*>(words), sizeof(words));
+		}
+
+	case TYPE_BOOL:
+	case TYPE_COUNT:
+	case TYPE_INT:
+	case TYPE_ENUM:
+	case TYPE_PORT:
+		{
+		auto n = v->ForceAsUInt();
+		return util::detail::fnv1a32(reinterpret_cast<const u_char*>(&n), sizeof(n));
+		}
+
+	default:
+		{
+		ODesc d;
+		v->Describe(&d);
+		return util::detail::fnv1a32(d.Bytes(), d.Len());
+		}
+	}
+	}
+
 bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 	{
+	zeek::detail::MemoryTagScope mem_tag(zeek::detail::MEMORY_LOGGING);
 	Stream* stream = FindStream(id);
 	if ( ! stream )
 		return false;
@@ -714,7 +828,28 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 	if ( ! stream->enabled )
 		return true;
 
-	auto columns = columns_arg->CoerceTo({NewRef{}, stream->columns});
+	// Most writes pass the columns' type itself, and the others tend to
+	// repeat, so the type checks only run for the first record of a type.
+	RecordValPtr columns;
+	const auto& rt = columns_arg->GetType();
+
+	if ( rt.get() == stream->columns )
+		columns = {NewRef{}, columns_arg};
+	else
+		{
+		auto known = stream->record_types.find(rt.get());
+
+		if ( known == stream->record_types.end() )
+			{
+			bool coerce = ! same_type(rt.get(), stream->columns);
+			known = stream->record_types.emplace(rt.get(), std::make_pair(rt, coerce)).first;
+			}
+
+		if ( known->second.second )
+			columns = columns_arg->CoerceTo({NewRef{}, stream->columns}, nullptr);
+		else
+			columns = {NewRef{}, columns_arg};
+		}
 
 	if ( ! columns )
 		{
@@ -726,6 +861,27 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 	if ( stream->event )
 		event_mgr.Enqueue(stream->event, columns);
 
+	// Spread remote writes across loggers by the shard field, which
+	// needs deciding before the record gets serialized.
+	std::optional<uint64_t> shard;
+
+	if ( stream->shard_field >= 0 && stream->enable_remote )
+		{
+		if ( const auto& v = columns->GetField(stream->shard_field) )
+			shard = ShardHash(v.get());
+		}
+
+	// Conversions of the record for filters that share them. Each lives
+	// in its own arena, which the writers keep until their threads are
+	// done with the values.
+	struct SharedVals {
+		const Filter* filter;
+		threading::Value** vals;
+		std::shared_ptr<threading::ValueArena> arena;
+	};
+
+	std::vector<SharedVals> shared_vals;
+
 	// Send to each of our filters.
 	for ( list<Filter*>::iterator i = stream->filters.begin();
 	      i != stream->filters.end(); ++i )
@@ -733,6 +889,13 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 		Filter* filter = *i;
 		string path = filter->path;
 
+		// Script code may change the record, after which earlier
+		// conversions no longer apply.
+		if ( ! shared_vals.empty() &&
+		     (may_run_script(filter->policy) || may_run_script(filter->pred) ||
+		      may_run_script(filter->path_func)) )
+			shared_vals.clear();
+
 		// Policy hooks may veto the logging or alter the log
 		// record if really necessary. Potential optimization:
 		// don't invoke the hook at all when it has no
@@ -914,7 +1077,45 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 
 		// Alright, can do the write now.
 
-		threading::Value** vals = RecordToFilterVals(stream, filter, columns.get());
+		// Build the values inside the writer's arena, unless a plugin
+		// hook gets to see them and could try to free or replace them.
+		WriterFrontend* arena_writer = nullptr;
+
+		if ( ! plugin_mgr->HavePluginForHook(plugin::HOOK_LOG_WRITE) )
+			arena_writer = writer;
+
+		// Writers can only share values that no plugin hook touches.
+		if ( filter->shares_projection && arena_writer )
+			{
+			const SharedVals* shared = nullptr;
+
+			for ( const auto& s : shared_vals )
+				if ( s.filter->indices == filter->indices )
+					{
+					shared = &s;
+					break;
+					}
+
+			if ( ! shared )
+				{
+				auto arena = std::make_shared<threading::ValueArena>(stream->shared_arena_size);
+				auto vals = RecordToFilterVals(stream, filter, columns.get(),
+				                               arena.get(), nullptr);
+				stream->shared_arena_size = arena->MemoryAllocation();
+				shared_vals.push_back({filter, vals, std::move(arena)});
+				shared = &shared_vals.back();
+				}
+
+			writer->Write(filter->num_fields, shared->vals, shared->arena, shard);
+
+#ifdef DEBUG
+			DBG_LOG(DBG_LOGGING, "Wrote shared record to filter '%s' on stream '%s'",
+				filter->name.c_str(), stream->name.c_str());
+#endif
+			continue;
+			}
+
+		threading::Value** vals = RecordToFilterVals(stream, filter, columns.get(), arena_writer);
 
 		if ( ! PLUGIN_HOOK_WITH_RESULT(HOOK_LOG_WRITE,
 		                               HookLogWrite(filter->writer->GetType()->AsEnumType()->Lookup(filter->writer->InternalInt()),
@@ -934,7 +1135,7 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 
 		// Write takes ownership of vals.
 		assert(writer);
-		writer->Write(filter->num_fields, vals);
+		writer->Write(filter->num_fields, vals, nullptr, shard);
 
 #ifdef DEBUG
 		DBG_LOG(DBG_LOGGING, "Wrote record to filter '%s' on stream '%s'",
@@ -945,15 +1146,40 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 	return true;
 	}
 
-threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
+static threading::Value* new_log_val(threading::ValueArena* arena, TypeTag type,
+                                     bool present = true)
+	{
+	if ( arena )
+		return arena->NewValue(type, present);
+
+	return new threading::Value(type, present);
+	}
+
+static char* copy_log_string(threading::ValueArena* arena, const char* s, size_t len)
+	{
+	if ( arena )
+		return arena->CopyString(s, len);
+
+	char* buf = new char[len + 1];
+	memcpy(buf, s, len);
+	buf[len] = '\0';
+	return buf;
+	}
+
+static threading::Value** new_log_val_array(threading::ValueArena* arena, size_t n)
+	{
+	return arena ? arena->NewValueArray(n) : new threading::Value*[n];
+	}
+
+threading::Value* Manager::ValToLogVal(Val* val, Type* ty, threading::ValueArena* arena)
 	{
 	if ( ! ty )
 		ty = val->GetType().get();
 
 	if ( ! val )
-		return new threading::Value(ty->Tag(), false);
+		return new_log_val(arena, ty->Tag(), false);
 
-	threading::Value* lval = new threading::Value(ty->Tag());
+	threading::Value* lval = new_log_val(arena, ty->Tag());
 
 	switch ( lval->type ) {
 	case TYPE_BOOL:
@@ -968,14 +1194,14 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 
 		if ( s )
 			{
-			lval->val.string_val.data = util::copy_string(s);
 			lval->val.string_val.length = strlen(s);
+			lval->val.string_val.data = copy_log_string(arena, s, lval->val.string_val.length);
 			}
 
 		else
 			{
 			val->GetType()->Error("enum type does not contain value", val);
-			lval->val.string_val.data = util::copy_string("");
+			lval->val.string_val.data = copy_log_string(arena, "", 0);
 			lval->val.string_val.length = 0;
 			}
 		break;
@@ -1007,10 +1233,17 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 	case TYPE_STRING:
 		{
 		const String* s = val->AsString();
-		char* buf = new char[s->Len()];
-		memcpy(buf, s->Bytes(), s->Len());
 
-		lval->val.string_val.data = buf;
+		if ( arena )
+			lval->val.string_val.data =
+				arena->CopyString(reinterpret_cast<const char*>(s->Bytes()), s->Len());
+		else
+			{
+			char* buf = new char[s->Len()];
+			memcpy(buf, s->Bytes(), s->Len());
+			lval->val.string_val.data = buf;
+			}
+
 		lval->val.string_val.length = s->Len();
 		break;
 		}
@@ -1019,7 +1252,7 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 		{
 		const File* f = val->AsFile();
 		string s = f->Name();
-		lval->val.string_val.data = util::copy_string(s.c_str());
+		lval->val.string_val.data = copy_log_string(arena, s.c_str(), s.size());
 		lval->val.string_val.length = s.size();
 		break;
 		}
@@ -1030,8 +1263,8 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 		const Func* f = val->AsFunc();
 		f->Describe(&d);
 		const char* s = d.Description();
-		lval->val.string_val.data = util::copy_string(s);
 		lval->val.string_val.length = strlen(s);
+		lval->val.string_val.data = copy_log_string(arena, s, lval->val.string_val.length);
 		break;
 		}
 
@@ -1044,10 +1277,10 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 			set = make_intrusive<ListVal>(TYPE_INT);
 
 		lval->val.set_val.size = set->Length();
-		lval->val.set_val.vals = new threading::Value* [lval->val.set_val.size];
+		lval->val.set_val.vals = new_log_val_array(arena, lval->val.set_val.size);
 
 		for ( bro_int_t i = 0; i < lval->val.set_val.size; i++ )
-			lval->val.set_val.vals[i] = ValToLogVal(set->Idx(i).get());
+			lval->val.set_val.vals[i] = ValToLogVal(set->Idx(i).get(), nullptr, arena);
 
 		break;
 		}
@@ -1057,13 +1290,13 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 		VectorVal* vec = val->AsVectorVal();
 		lval->val.vector_val.size = vec->Size();
 		lval->val.vector_val.vals =
-			new threading::Value* [lval->val.vector_val.size];
+			new_log_val_array(arena, lval->val.vector_val.size);
 
 		for ( bro_int_t i = 0; i < lval->val.vector_val.size; i++ )
 			{
 			lval->val.vector_val.vals[i] =
 				ValToLogVal(vec->At(i).get(),
-					    vec->GetType()->Yield().get());
+					    vec->GetType()->Yield().get(), arena);
 			}
 
 		break;
@@ -1077,7 +1310,8 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 	}
 
 threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
-                                               RecordVal* columns)
+                                               RecordVal* columns,
+                                               WriterFrontend* arena_writer)
 	{
 	RecordValPtr ext_rec;
 
@@ -1089,7 +1323,19 @@ threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
 			ext_rec = {AdoptRef{}, res.release()->AsRecordVal()};
 		}
 
-	threading::Value** vals = new threading::Value*[filter->num_fields];
+	// Only grab the arena now, the extension function may have caused
+	// further writes flushing the previous one.
+	threading::ValueArena* arena = arena_writer ? arena_writer->WriteArena() : nullptr;
+
+	return RecordToFilterVals(stream, filter, columns, arena, ext_rec.get());
+	}
+
+threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
+                                               RecordVal* columns,
+                                               threading::ValueArena* arena,
+                                               RecordVal* ext_rec)
+	{
+	threading::Value** vals = new_log_val_array(arena, filter->num_fields);
 
 	for ( int i = 0; i < filter->num_fields; ++i )
 		{
@@ -1099,33 +1345,33 @@ threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
 			if ( ! ext_rec )
 				{
 				// executing function did not return record. Send empty for all vals.
-				vals[i] = new threading::Value(filter->fields[i]->type, false);
+				vals[i] = new_log_val(arena, filter->fields[i]->type, false);
 				continue;
 				}
 
-			val = ext_rec.get();
+			val = ext_rec;
 			}
 		else
 			val = columns;
 
 		// For each field, first find the right value, which can
 		// potentially be nested inside other records.
-		list<int>& indices = filter->indices[i];
+		int end = filter->field_path_start[i + 1];
 
-		for ( list<int>::iterator j = indices.begin(); j != indices.end(); ++j )
+		for ( int j = filter->field_path_start[i]; j < end; ++j )
 			{
-			val = val->AsRecordVal()->GetField(*j).get();
+			val = val->AsRecordVal()->GetField(filter->field_path[j]).get();
 
 			if ( ! val )
 				{
 				// Value, or any of its parents, is not set.
-				vals[i] = new threading::Value(filter->fields[i]->type, false);
+				vals[i] = new_log_val(arena, filter->fields[i]->type, false);
 				break;
 				}
 			}
 
 		if ( val )
-			vals[i] = ValToLogVal(val);
+			vals[i] = ValToLogVal(val, nullptr, arena);
 		}
 
 	return vals;
@@ -1316,6 +1562,17 @@ bool Manager::WriteFromRemote(EnumVal* id, EnumVal* writer, const string& path,
 	return true;
 	}
 
+bool Manager::NeedsRemoteWriter(EnumVal* id, EnumVal* writer, const string& path)
+	{
+	Stream* stream = FindStream(id);
+
+	if ( ! stream || ! stream->enabled )
+		return false;
+
+	return stream->writers.find(Stream::WriterPathPair(writer->AsEnum(), path)) ==
+		stream->writers.end();
+	}
+
 void Manager::SendAllWritersTo(const broker::endpoint_info& ei)
 	{
 	auto et = id::find_type("Log::Writer")->AsEnumType();
@@ -19,6 +19,7 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(SerializationFormat, zeek::detail);
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(WriterFrontend, zeek, logging);
 ZEEK_FORWARD_DECLARE_NAMESPACED(RotationFinishedMessage, zeek, logging);
+ZEEK_FORWARD_DECLARE_NAMESPACED(ValueArena, zeek, threading);
 
 namespace zeek {
 namespace logging {
@@ -191,6 +192,13 @@ public:
 	bool WriteFromRemote(EnumVal* stream, EnumVal* writer, const std::string& path,
 	                     int num_fields, threading::Value** vals);
 
+	/**
+	 * Returns true if WriteFromRemote() would drop log entries only for
+	 * lack of a writer, i.e. if the stream exists and is enabled but
+	 * CreateWriterForRemoteLog() hasn't created a writer for the path yet.
+	 */
+	bool NeedsRemoteWriter(EnumVal* stream, EnumVal* writer, const std::string& path);
+
 	/**
 	 * Announces all instantiated writers to a given Broker peer.
 	 */
@@ -283,10 +291,25 @@ private:
 	                    TableVal* include, TableVal* exclude,
 	                    const std::string& path, const std::list<int>& indices);
 
+	// If a writer is given, the values are allocated from its write
+	// arena and must not be deleted individually.
 	threading::Value** RecordToFilterVals(Stream* stream, Filter* filter,
-	                                      RecordVal* columns);
+	                                      RecordVal* columns,
+	                                      WriterFrontend* arena_writer = nullptr);
+
+	// Like RecordToFilterVals(), but with the values from the given
+	// arena, or the heap if null, and the extension fields from ext_rec.
+	threading::Value** RecordToFilterVals(Stream* stream, Filter* filter,
+	                                      RecordVal* columns,
+	                                      threading::ValueArena* arena,
+	                                      RecordVal* ext_rec);
+
+	// Flags the filters of a stream that log the same fields as another
+	// one, and can share the conversion of records with it.
+	void UpdateSharedProjections(Stream* stream);
 
-	threading::Value* ValToLogVal(Val* val, Type* ty = nullptr);
+	threading::Value* ValToLogVal(Val* val, Type* ty = nullptr,
+	                              threading::ValueArena* arena = nullptr);
 	Stream* FindStream(EnumVal* id);
 	void RemoveDisabledWriters(Stream* stream);
 	void InstallRotationTimer(WriterInfo* winfo);
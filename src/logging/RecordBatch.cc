@@ -0,0 +1,282 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/RecordBatch.h"
+
+#include <cstring>
+
+#include "zeek/Reporter.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+using zeek::threading::Value;
+using zeek::threading::Field;
+
+namespace zeek::logging {
+
+TEST_CASE("record batch round trip")
+	{
+	Field f1("a", nullptr, TYPE_COUNT, TYPE_VOID, false);
+	Field f2("b", nullptr, TYPE_STRING, TYPE_VOID, true);
+	Field f3("c", nullptr, TYPE_VECTOR, TYPE_STRING, false);
+	const Field* fields[] = { &f1, &f2, &f3 };
+
+	RecordBatch batch(3, fields);
+
+	for ( int i = 0; i < 2; ++i )
+		{
+		Value* vals[3];
+		vals[0] = new Value(TYPE_COUNT);
+		vals[0]->val.uint_val = 42 + i;
+
+		vals[1] = new Value(TYPE_STRING, i == 0);
+
+		if ( i == 0 )
+			{
+			vals[1]->val.string_val.data = util::copy_string("foo");
+			vals[1]->val.string_val.length = 3;
+			}
+
+		vals[2] = new Value(TYPE_VECTOR, TYPE_STRING);
+		vals[2]->val.vector_val.size = 2;
+		vals[2]->val.vector_val.vals = new Value*[2];
+
+		for ( int j = 0; j < 2; ++j )
+			{
+			auto e = new Value(TYPE_STRING);
+			e->val.string_val.data = util::copy_string(j ? "yz" : "x");
+			e->val.string_val.length = j ? 2 : 1;
+			vals[2]->val.vector_val.vals[j] = e;
+			}
+
+		batch.AppendRow(vals);
+
+		for ( auto v : vals )
+			delete v;
+		}
+
+	CHECK(batch.NumRows() == 2);
+	CHECK(batch.NumFields() == 3);
+	CHECK(batch.GetCell(0, 1).uint_val == 43);
+	CHECK(batch.String(batch.GetCell(1, 0)) == "foo");
+	CHECK(! batch.GetCell(1, 1).present);
+
+	const auto& vec = batch.GetCell(2, 1);
+	CHECK(vec.span.length == 2);
+	CHECK(batch.String(batch.Elements(vec)[1]) == "yz");
+
+	Value** row = batch.MaterializeRow(0);
+	CHECK(row[0]->type == TYPE_COUNT);
+	CHECK(row[0]->val.uint_val == 42);
+	CHECK(std::string(row[1]->val.string_val.data, row[1]->val.string_val.length) == "foo");
+	CHECK(row[2]->subtype == TYPE_STRING);
+	CHECK(row[2]->val.vector_val.size == 2);
+	CHECK(row[2]->val.vector_val.vals[0]->val.string_val.length == 1);
+
+	Value::delete_value_ptr_array(row, 3);
+	}
+
+RecordBatch::RecordBatch(int num_fields, const Field* const* fields, int expected_rows)
+	{
+	columns.resize(num_fields);
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		columns[i].type = fields[i]->type;
+		columns[i].subtype = fields[i]->subtype;
+		columns[i].cells.reserve(expected_rows);
+		}
+	}
+
+RecordBatch::Cell::span_t RecordBatch::StoreString(const char* data, size_t len)
+	{
+	Cell::span_t span{strings.size(), len};
+	strings.insert(strings.end(), data, data + len);
+	return span;
+	}
+
+void RecordBatch::StoreAtomic(Cell* c, const Value* v)
+	{
+	c->present = v->present;
+
+	if ( ! v->present )
+		return;
+
+	switch ( v->type ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		c->int_val = v->val.int_val;
+		break;
+
+	case TYPE_COUNT:
+		c->uint_val = v->val.uint_val;
+		break;
+
+	case TYPE_PORT:
+		c->port_val = v->val.port_val;
+		break;
+
+	case TYPE_ADDR:
+		c->addr_val = v->val.addr_val;
+		break;
+
+	case TYPE_SUBNET:
+		c->subnet_val = v->val.subnet_val;
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		c->double_val = v->val.double_val;
+		break;
+
+	case TYPE_PATTERN:
+		c->span = StoreString(v->val.pattern_text_val, strlen(v->val.pattern_text_val));
+		break;
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		c->span = StoreString(v->val.string_val.data, v->val.string_val.length);
+		break;
+
+	default:
+		reporter->InternalError("unsupported type %s in record batch", type_name(v->type));
+	}
+	}
+
+void RecordBatch::AppendRow(const Value* const* vals)
+	{
+	for ( size_t i = 0; i < columns.size(); ++i )
+		{
+		const Value* v = vals[i];
+		Cell c;
+
+		if ( v->present && (v->type == TYPE_TABLE || v->type == TYPE_VECTOR) )
+			{
+			// Both use the same layout.
+			const Value::set_t& s = v->val.set_val;
+			c.present = true;
+			c.span = {elements.size(), static_cast<size_t>(s.size)};
+
+			for ( bro_int_t j = 0; j < s.size; ++j )
+				{
+				Cell e;
+				StoreAtomic(&e, s.vals[j]);
+				elements.push_back(e);
+				}
+			}
+		else
+			StoreAtomic(&c, v);
+
+		columns[i].cells.push_back(c);
+		}
+
+	++num_rows;
+	}
+
+Value* RecordBatch::LoadAtomic(TypeTag type, const Cell& c) const
+	{
+	Value* v = new Value(type, c.present);
+
+	if ( ! c.present )
+		return v;
+
+	switch ( type ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		v->val.int_val = c.int_val;
+		break;
+
+	case TYPE_COUNT:
+		v->val.uint_val = c.uint_val;
+		break;
+
+	case TYPE_PORT:
+		v->val.port_val = c.port_val;
+		break;
+
+	case TYPE_ADDR:
+		v->val.addr_val = c.addr_val;
+		break;
+
+	case TYPE_SUBNET:
+		v->val.subnet_val = c.subnet_val;
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		v->val.double_val = c.double_val;
+		break;
+
+	case TYPE_PATTERN:
+		{
+		char* buf = new char[c.span.length + 1];
+		memcpy(buf, strings.data() + c.span.offset, c.span.length);
+		buf[c.span.length] = '\0';
+		v->val.pattern_text_val = buf;
+		break;
+		}
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		{
+		// Keep the terminating NUL that the log manager provides for
+		// most of these types.
+		char* buf = new char[c.span.length + 1];
+		memcpy(buf, strings.data() + c.span.offset, c.span.length);
+		buf[c.span.length] = '\0';
+		v->val.string_val.data = buf;
+		v->val.string_val.length = c.span.length;
+		break;
+		}
+
+	default:
+		reporter->InternalError("unsupported type %s in record batch", type_name(type));
+	}
+
+	return v;
+	}
+
+Value** RecordBatch::MaterializeRow(int row) const
+	{
+	Value** vals = new Value*[columns.size()];
+
+	for ( size_t i = 0; i < columns.size(); ++i )
+		{
+		const Column& col = columns[i];
+		const Cell& c = col.cells[row];
+
+		if ( c.present && (col.type == TYPE_TABLE || col.type == TYPE_VECTOR) )
+			{
+			Value* v = new Value(col.type, col.subtype);
+			Value::set_t& s = v->val.set_val;
+			s.size = c.span.length;
+			s.vals = new Value*[s.size];
+
+			for ( bro_int_t j = 0; j < s.size; ++j )
+				s.vals[j] = LoadAtomic(col.subtype, elements[c.span.offset + j]);
+
+			vals[i] = v;
+			}
+		else
+			vals[i] = LoadAtomic(col.type, c);
+		}
+
+	return vals;
+	}
+
+size_t RecordBatch::MemoryAllocation() const
+	{
+	size_t size = sizeof(*this) + strings.capacity() + elements.capacity() * sizeof(Cell);
+
+	for ( const auto& col : columns )
+		size += sizeof(Column) + col.cells.capacity() * sizeof(Cell);
+
+	return size;
+	}
+
+} // namespace zeek::logging
@@ -0,0 +1,148 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "zeek/threading/SerialTypes.h"
+
+namespace zeek::logging {
+
+/**
+ * A batch of log records stored column by column.
+ *
+ * The WriterFrontend collects records into a batch and hands the whole
+ * batch over to the backend with a single message. Each column keeps one
+ * fixed-size cell per record. Strings of all columns live back to back in
+ * one shared buffer, and the elements of set and vector values in one
+ * shared element array, so that a batch consists of just a handful of
+ * allocations regardless of how many records it holds.
+ *
+ * Writers that override WriterBackend::DoWriteBatch() receive the batch
+ * as-is; for all others, the backend rebuilds the individual records via
+ * MaterializeRow().
+ */
+class RecordBatch {
+public:
+	/**
+	 * A single value inside the batch. Strings (including enums, files,
+	 * functions and patterns) are stored as a span into the batch's
+	 * string buffer, sets and vectors as a span into its element array.
+	 */
+	struct Cell {
+		bool present = false;
+
+		struct span_t { size_t offset; size_t length; };
+
+		union {
+			bro_int_t int_val;
+			bro_uint_t uint_val;
+			threading::Value::port_t port_val;
+			double double_val;
+			threading::Value::addr_t addr_val;
+			threading::Value::subnet_t subnet_val;
+			span_t span;
+		};
+
+		Cell() : span{0, 0}	{ }
+	};
+
+	/**
+	 * The cells of one log field, one per record in the batch.
+	 */
+	struct Column {
+		TypeTag type;
+		TypeTag subtype;	// Element type for sets and vectors.
+		std::vector<Cell> cells;
+	};
+
+	/**
+	 * Constructor.
+	 *
+	 * @param num_fields The number of log fields.
+	 *
+	 * @param fields The log fields. The batch doesn't take ownership and
+	 * only looks at them during construction.
+	 *
+	 * @param expected_rows Capacity to reserve upfront.
+	 */
+	RecordBatch(int num_fields, const threading::Field* const* fields, int expected_rows = 0);
+
+	RecordBatch(const RecordBatch&) = delete;
+	RecordBatch& operator=(const RecordBatch&) = delete;
+
+	/**
+	 * Appends one record. The values are copied, so the caller retains
+	 * ownership of \a vals. Their types must match the fields passed to
+	 * the constructor.
+	 */
+	void AppendRow(const threading::Value* const* vals);
+
+	/**
+	 * Returns the number of log fields, i.e., columns.
+	 */
+	int NumFields() const	{ return columns.size(); }
+
+	/**
+	 * Returns the number of records in the batch.
+	 */
+	int NumRows() const	{ return num_rows; }
+
+	/**
+	 * Returns a column.
+	 */
+	const Column& GetColumn(int field) const	{ return columns[field]; }
+
+	/**
+	 * Returns the cell of one record within a column.
+	 */
+	const Cell& GetCell(int field, int row) const	{ return columns[field].cells[row]; }
+
+	/**
+	 * Returns the content of a cell storing a string-like value.
+	 */
+	std::string_view String(const Cell& c) const
+		{ return {strings.data() + c.span.offset, c.span.length}; }
+
+	/**
+	 * Returns the elements of a cell storing a set or vector. The number
+	 * of elements is \a c.span.length.
+	 */
+	const Cell* Elements(const Cell& c) const
+		{ return elements.data() + c.span.offset; }
+
+	/**
+	 * Rebuilds one record in the traditional row representation. The
+	 * caller takes ownership of the returned values, which need to be
+	 * deleted like any other set of log values.
+	 */
+	threading::Value** MaterializeRow(int row) const;
+
+	/**
+	 * Returns the memory allocated by the batch.
+	 */
+	size_t MemoryAllocation() const;
+
+private:
+	static bool IsStringType(TypeTag t)
+		{
+		return t == TYPE_ENUM || t == TYPE_STRING || t == TYPE_FILE ||
+			t == TYPE_FUNC || t == TYPE_PATTERN;
+		}
+
+	// Converts an atomic value into a cell.
+	void StoreAtomic(Cell* c, const threading::Value* v);
+
+	// Reverses StoreAtomic().
+	threading::Value* LoadAtomic(TypeTag type, const Cell& c) const;
+
+	Cell::span_t StoreString(const char* data, size_t len);
+
+	std::vector<Column> columns;
+	std::vector<Cell> elements;
+	std::vector<char> strings;
+	int num_rows = 0;
+};
+
+} // namespace zeek::logging
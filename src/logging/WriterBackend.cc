@@ -5,7 +5,9 @@
 #include <broker/data.hh>
 
 #include "zeek/util.h"
+#include "zeek/MemoryArenas.h"
 #include "zeek/threading/SerialTypes.h"
+#include "zeek/threading/ValueArena.h"
 #include "zeek/logging/Manager.h"
 #include "zeek/logging/WriterFrontend.h"
 
@@ -143,10 +145,34 @@ WriterBackend::~WriterBackend()
 	delete info;
 	}
 
-void WriterBackend::DeleteVals(int num_writes, Value*** vals)
+void WriterBackend::DeleteVals(int num_writes, Value*** vals, threading::ValueArena* arena,
+                               const SharedArenas* shared)
 	{
+	// The shared arena that the next shared record may come from. Since
+	// the arenas are in the order of the writes, it's either this one or
+	// the one after.
+	size_t next_shared = 0;
+
 	for ( int j = 0; j < num_writes; ++j )
 		{
+		// Records built inside the arena go away with it.
+		if ( arena && arena->Owns(vals[j]) )
+			continue;
+
+		// Shared records go away with the last reference to their arena.
+		if ( shared )
+			{
+			if ( next_shared < shared->size() && (*shared)[next_shared]->Owns(vals[j]) )
+				continue;
+
+			if ( next_shared + 1 < shared->size() &&
+			     (*shared)[next_shared + 1]->Owns(vals[j]) )
+				{
+				++next_shared;
+				continue;
+				}
+			}
+
 		// Note this code is duplicated in Manager::DeleteVals().
 		for ( int i = 0; i < num_fields; i++ )
 			delete vals[j][i];
@@ -155,6 +181,7 @@ void WriterBackend::DeleteVals(int num_writes, Value*** vals)
 		}
 
 	delete [] vals;
+	delete arena;
 	}
 
 bool WriterBackend::FinishedRotation(const char* new_name, const char* old_name,
@@ -172,6 +199,27 @@ bool WriterBackend::FinishedRotation()
 	return true;
 	}
 
+void WriterBackend::DeferRotation()
+	{
+	--rotation_counter;
+	++deferred_rotations;
+	}
+
+bool WriterBackend::FinishedDeferredRotation(const char* new_name, const char* old_name,
+                                             double open, double close, bool terminating)
+	{
+	--deferred_rotations;
+	SendOut(new RotationFinishedMessage(frontend, new_name, old_name, open, close, true, terminating));
+	return true;
+	}
+
+bool WriterBackend::FinishedDeferredRotation()
+	{
+	--deferred_rotations;
+	SendOut(new RotationFinishedMessage(frontend, nullptr, nullptr, 0, 0, false, false));
+	return true;
+	}
+
 void WriterBackend::DisableFrontend()
 	{
 	SendOut(new DisableMessage(frontend));
@@ -180,6 +228,7 @@ void WriterBackend::DisableFrontend()
 bool WriterBackend::Init(int arg_num_fields, const Field* const* arg_fields)
 	{
 	SetOSName(Fmt("zk.%s", Name()));
+	zeek::detail::MemoryArenas::BindThread(zeek::detail::MEMORY_LOGGING);
 	num_fields = arg_num_fields;
 	fields = arg_fields;
 
@@ -195,7 +244,8 @@ bool WriterBackend::Init(int arg_num_fields, const Field* const* arg_fields)
 	return true;
 	}
 
-bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
+bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals,
+                          threading::ValueArena* arena, const SharedArenas* shared)
 	{
 	// Double-check that the arguments match. If we get this from remote,
 	// something might be mixed up.
@@ -208,7 +258,7 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 		Debug(DBG_LOGGING, msg);
 #endif
 
-		DeleteVals(num_writes, vals);
+		DeleteVals(num_writes, vals, arena, shared);
 		DisableFrontend();
 		return false;
 		}
@@ -226,7 +276,7 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 				Debug(DBG_LOGGING, msg);
 #endif
 				DisableFrontend();
-				DeleteVals(num_writes, vals);
+				DeleteVals(num_writes, vals, arena, shared);
 				return false;
 				}
 			}
@@ -245,7 +295,7 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 			}
 		}
 
-	DeleteVals(num_writes, vals);
+	DeleteVals(num_writes, vals, arena, shared);
 
 	if ( ! success )
 		DisableFrontend();
@@ -253,6 +303,59 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 	return success;
 	}
 
+bool WriterBackend::WriteBatch(RecordBatch* batch)
+	{
+	// Double-check that the layout matches, as in Write().
+	bool match = (batch->NumFields() == num_fields);
+
+	for ( int i = 0; match && i < num_fields; ++i )
+		{
+		if ( batch->GetColumn(i).type != fields[i]->type )
+			{
+#ifdef DEBUG
+			const char* msg = Fmt("Field #%d type doesn't match in WriterBackend::WriteBatch() (%d vs. %d)",
+					      i, batch->GetColumn(i).type, fields[i]->type);
+			Debug(DBG_LOGGING, msg);
+#endif
+			match = false;
+			}
+		}
+
+	if ( ! match )
+		{
+		delete batch;
+		DisableFrontend();
+		return false;
+		}
+
+	bool success = true;
+
+	if ( ! Failed() )
+		success = DoWriteBatch(*batch);
+
+	delete batch;
+
+	if ( ! success )
+		DisableFrontend();
+
+	return success;
+	}
+
+bool WriterBackend::DoWriteBatch(const RecordBatch& batch)
+	{
+	for ( int j = 0; j < batch.NumRows(); j++ )
+		{
+		Value** vals = batch.MaterializeRow(j);
+		bool success = DoWrite(num_fields, fields, vals);
+		Value::delete_value_ptr_array(vals, num_fields);
+
+		if ( ! success )
+			return false;
+		}
+
+	return true;
+	}
+
 bool WriterBackend::SetBuf(bool enabled)
 	{
 	if ( enabled == buffering )
@@ -316,7 +419,20 @@ bool WriterBackend::OnFinish(double network_time)
 	if ( Failed() )
 		return true;
 
-	return DoFinish(network_time);
+	bool result = DoFinish(network_time);
+
+	// Insurance against broken writers, so that the log manager doesn't
+	// keep waiting for the rotations.
+	if ( deferred_rotations > 0 )
+		{
+		InternalWarning(Fmt("writer %s did not finish %d deferred rotations", Name(),
+		                    deferred_rotations));
+
+		while ( deferred_rotations > 0 )
+			FinishedDeferredRotation();
+		}
+
+	return result;
 	}
 
 bool WriterBackend::OnHeartbeat(double network_time, double current_time)
@@ -4,8 +4,14 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include "zeek/threading/MsgThread.h"
 #include "zeek/logging/Component.h"
+#include "zeek/logging/RecordBatch.h"
+
+ZEEK_FORWARD_DECLARE_NAMESPACED(ValueArena, zeek, threading);
 
 namespace broker { class data; }
 
@@ -43,6 +49,12 @@ public:
 	 */
 	~WriterBackend() override;
 
+	/**
+	 * Arenas holding values that several writers share, in the order of
+	 * the writes that use them.
+	 */
+	typedef std::vector<std::shared_ptr<threading::ValueArena>> SharedArenas;
+
 	/**
 	 * A struct passing information to the writer at initialization time.
 	 */
@@ -153,12 +165,45 @@ public:
 	 * types musst match with the field passed to Init(). The method
 	 * takes ownership of \a vals..
 	 *
+	 * @param arena If given, the arena that some or all of the values
+	 * have been allocated from. The method takes ownership and releases
+	 * all of the arena's values at once.
+	 *
+	 * @param shared If given, arenas holding values that other writers
+	 * use as well. The method doesn't free those values, and they must
+	 * not be modified.
+	 *
 	 * Returns false if an error occured, in which case the writer must
 	 * not be used any further.
 	 *
 	 * @return False if an error occured.
 	 */
-	bool Write(int num_fields, int num_writes, threading::Value*** vals);
+	bool Write(int num_fields, int num_writes, threading::Value*** vals,
+	           threading::ValueArena* arena = nullptr,
+	           const SharedArenas* shared = nullptr);
+
+	/**
+	 * Writes a batch of log entries stored column by column. Writers
+	 * that don't override DoWriteBatch() get the entries passed to
+	 * DoWrite() one by one.
+	 *
+	 * @param batch The entries. Its fields must match with what was
+	 * passed to Init(). The method takes ownership.
+	 *
+	 * @return False if an error occured.
+	 */
+	bool WriteBatch(RecordBatch* batch);
+
+	/**
+	 * Returns true if the writer wants to receive its log entries as
+	 * RecordBatch instances. The frontend then assembles batches right
+	 * away instead of buffering individual records. Writers overriding
+	 * DoWriteBatch() should override this to return true.
+	 *
+	 * This method is called from the main thread and must not depend on
+	 * any state that may change once the writer has been constructed.
+	 */
+	virtual bool SupportsBatches() const	{ return false; }
 
 	/**
 	 * Sets the buffering status for the writer, assuming the writer
@@ -255,6 +300,29 @@ public:
 	 */
 	bool FinishedRotation();
 
+	/**
+	 * Signals that DoRotate() has set the current file aside and
+	 * finishes it in the background. Instead of FinishedRotation(),
+	 * the writer calls one of the FinishedDeferredRotation() methods
+	 * later from its thread, once the file is complete, and before
+	 * DoFinish() returns.
+	 */
+	void DeferRotation();
+
+	/**
+	 * Like FinishedRotation(), for a rotation that DeferRotation()
+	 * set aside. Rotations must finish in the order they were
+	 * deferred.
+	 */
+	bool FinishedDeferredRotation(const char* new_name, const char* old_name,
+	                              double open, double close, bool terminating);
+
+	/**
+	 * Like FinishedRotation() without arguments, for a rotation that
+	 * DeferRotation() set aside.
+	 */
+	bool FinishedDeferredRotation();
+
 	// Overridden from MsgThread.
 	bool OnHeartbeat(double network_time, double current_time) override;
 	bool OnFinish(double network_time) override;
@@ -291,6 +359,17 @@ protected:
 	virtual bool DoWrite(int num_fields, const threading::Field* const*  fields,
 			     threading::Value** vals) = 0;
 
+	/**
+	 * Writer-specific output method implementing recording of a whole
+	 * batch of log entries at once, without requiring them to be
+	 * converted into individual records first. Only called if
+	 * SupportsBatches() returns true.
+	 *
+	 * The default implementation rebuilds each entry and passes it on
+	 * to DoWrite(). Return values are interpreted as with DoWrite().
+	 */
+	virtual bool DoWriteBatch(const RecordBatch& batch);
+
 	/**
 	 * Writer-specific method implementing a change of fthe buffering
 	 * state.  If buffering is disabled, the writer should attempt to
@@ -382,9 +461,10 @@ protected:
 
 private:
 	/**
-	 * Deletes the values as passed into Write().
+	 * Deletes the values as passed into Write(), along with the arena.
 	 */
-	void DeleteVals(int num_writes, threading::Value*** vals);
+	void DeleteVals(int num_writes, threading::Value*** vals, threading::ValueArena* arena,
+	                const SharedArenas* shared);
 
 	// Frontend that instantiated us. This object must not be access from
 	// this class, it's running in a different thread!
@@ -396,6 +476,7 @@ private:
 	bool buffering;	// True if buffering is enabled.
 
 	int rotation_counter; // Tracks FinishedRotation() calls.
+	int deferred_rotations = 0; // Rotations deferred but not finished.
 };
 
 } // namespace zeek::logging
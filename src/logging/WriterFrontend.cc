@@ -2,6 +2,8 @@
 
 #include "zeek/RunState.h"
 #include "zeek/threading/SerialTypes.h"
+#include "zeek/threading/Manager.h"
+#include "zeek/threading/ValueArena.h"
 #include "zeek/broker/Manager.h"
 #include "zeek/logging/Manager.h"
 #include "zeek/logging/WriterBackend.h"
@@ -53,16 +55,34 @@ private:
 class WriteMessage final : public threading::InputMessage<WriterBackend>
 {
 public:
-	WriteMessage(WriterBackend* backend, int num_fields, int num_writes, Value*** vals)
+	WriteMessage(WriterBackend* backend, int num_fields, int num_writes, Value*** vals,
+	             threading::ValueArena* arena, WriterBackend::SharedArenas shared)
 		: threading::InputMessage<WriterBackend>("Write", backend),
-		num_fields(num_fields), num_writes(num_writes), vals(vals)	{}
+		num_fields(num_fields), num_writes(num_writes), vals(vals), arena(arena),
+		shared(std::move(shared))	{}
 
-	bool Process() override { return Object()->Write(num_fields, num_writes, vals); }
+	bool Process() override
+		{ return Object()->Write(num_fields, num_writes, vals, arena, &shared); }
 
 private:
 	int num_fields;
 	int num_writes;
 	Value ***vals;
+	threading::ValueArena* arena;
+	WriterBackend::SharedArenas shared;
+};
+
+class WriteBatchMessage final : public threading::InputMessage<WriterBackend>
+{
+public:
+	WriteBatchMessage(WriterBackend* backend, RecordBatch* batch)
+		: threading::InputMessage<WriterBackend>("WriteBatch", backend),
+		batch(batch)	{}
+
+	bool Process() override { return Object()->WriteBatch(batch); }
+
+private:
+	RecordBatch* batch;
 };
 
 class SetBufMessage final : public threading::InputMessage<WriterBackend>
@@ -106,6 +126,8 @@ WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, EnumVa
 	remote = arg_remote;
 	write_buffer = nullptr;
 	write_buffer_pos = 0;
+	write_batch = nullptr;
+	write_arena = nullptr;
 	info = new WriterBackend::WriterInfo(arg_info);
 
 	num_fields = 0;
@@ -119,11 +141,18 @@ WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, EnumVa
 		backend = log_mgr->CreateBackend(this, writer);
 
 		if ( backend )
+			{
+			if ( auto pool = thread_mgr->WriterPool() )
+				backend->SetPool(pool);
+
 			backend->Start();
+			}
 		}
 
 	else
 		backend = nullptr;
+
+	batching = backend && backend->SupportsBatches();
 	}
 
 WriterFrontend::~WriterFrontend()
@@ -133,6 +162,9 @@ WriterFrontend::~WriterFrontend()
 
 	delete [] fields;
 
+	delete write_batch;
+	delete write_arena;
+
 	Unref(stream);
 	Unref(writer);
 	delete info;
@@ -187,9 +219,17 @@ void WriterFrontend::Init(int arg_num_fields, const Field* const * arg_fields)
 
 void WriterFrontend::Write(int arg_num_fields, Value** vals)
 	{
+	Write(arg_num_fields, vals, nullptr);
+	}
+
+void WriterFrontend::Write(int arg_num_fields, Value** vals,
+                           std::shared_ptr<threading::ValueArena> shared,
+                           std::optional<uint64_t> shard)
+	{
 	if ( disabled )
 		{
-		DeleteVals(arg_num_fields, vals);
+		if ( ! shared )
+			ReleaseVals(arg_num_fields, vals);
 		return;
 		}
 
@@ -197,7 +237,8 @@ void WriterFrontend::Write(int arg_num_fields, Value** vals)
 		{
 		reporter->Warning("WriterFrontend %s expected %d fields in write, got %d. Skipping line.",
 		                  name, num_fields, arg_num_fields);
-		DeleteVals(arg_num_fields, vals);
+		if ( ! shared )
+			ReleaseVals(arg_num_fields, vals);
 		return;
 		}
 
@@ -207,23 +248,45 @@ void WriterFrontend::Write(int arg_num_fields, Value** vals)
 				writer,
 				info->path,
 				num_fields,
-				vals);
+				vals,
+				shard);
 		}
 
 	if ( ! backend )
 		{
-		DeleteVals(arg_num_fields, vals);
+		if ( ! shared )
+			ReleaseVals(arg_num_fields, vals);
 		return;
 		}
 
-	if ( ! write_buffer )
+	if ( batching )
 		{
-		// Need new buffer.
-		write_buffer = new Value**[WRITER_BUFFER_SIZE];
-		write_buffer_pos = 0;
+		if ( ! write_batch )
+			write_batch = new RecordBatch(num_fields, fields, WRITER_BUFFER_SIZE);
+
+		// The batch keeps its own copy.
+		write_batch->AppendRow(vals);
+		write_buffer_pos = write_batch->NumRows();
+		if ( ! shared )
+			ReleaseVals(arg_num_fields, vals);
 		}
 
-	write_buffer[write_buffer_pos++] = vals;
+	else
+		{
+		if ( ! write_buffer )
+			{
+			// Need new buffer.
+			write_buffer = new Value**[WRITER_BUFFER_SIZE];
+			write_buffer_pos = 0;
+			}
+
+		write_buffer[write_buffer_pos++] = vals;
+
+		// Keep the values alive until the backend has written them.
+		// Records sharing an arena arrive one after the other.
+		if ( shared && (shared_arenas.empty() || shared_arenas.back() != shared) )
+			shared_arenas.push_back(std::move(shared));
+		}
 
 	if ( write_buffer_pos >= WRITER_BUFFER_SIZE || ! buf || run_state::terminating )
 		// Buffer full (or no bufferin desired or termiating).
@@ -238,10 +301,23 @@ void WriterFrontend::FlushWriteBuffer()
 		return;
 
 	if ( backend )
-		backend->SendIn(new WriteMessage(backend, num_fields, write_buffer_pos, write_buffer));
+		{
+		if ( write_batch )
+			backend->SendIn(new WriteBatchMessage(backend, write_batch));
+		else
+			backend->SendIn(new WriteMessage(backend, num_fields, write_buffer_pos,
+			                                 write_buffer, write_arena,
+			                                 std::move(shared_arenas)));
+		}
+
+	shared_arenas.clear();
 
 	// Clear buffer (no delete, we pass ownership to child thread.)
 	write_buffer = nullptr;
+	write_batch = nullptr;
+
+	if ( ! batching )
+		write_arena = nullptr;
 	write_buffer_pos = 0;
 	}
 
@@ -285,6 +361,29 @@ void WriterFrontend::Rotate(const char* rotated_path, double open, double close,
 		log_mgr->FinishedRotation(this, nullptr, nullptr, 0, 0, false, terminating);
 	}
 
+threading::ValueArena* WriterFrontend::WriteArena()
+	{
+	if ( ! write_arena )
+		write_arena = new threading::ValueArena();
+
+	return write_arena;
+	}
+
+void WriterFrontend::ReleaseVals(int num_fields, Value** vals)
+	{
+	if ( write_arena && write_arena->Owns(vals) )
+		{
+		// The memory can be reused right away if no buffered records
+		// point into the arena.
+		if ( ! write_buffer )
+			write_arena->Reset();
+
+		return;
+		}
+
+	DeleteVals(num_fields, vals);
+	}
+
 void WriterFrontend::DeleteVals(int num_fields, Value** vals)
 	{
 	// Note this code is duplicated in Manager::DeleteVals().
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <optional>
+
 #include "zeek/logging/WriterBackend.h"
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(Manager, zeek, logging);
@@ -93,6 +95,37 @@ public:
 	 */
 	void Write(int num_fields, threading::Value** vals);
 
+	/**
+	 * Returns an arena that the values for the next Write() can be
+	 * allocated from. Doing so turns freeing the values into a no-op;
+	 * the frontend releases the arena's memory as a whole once the
+	 * backend has processed the corresponding batch of writes.
+	 *
+	 * Values from the arena must not be deleted by the caller. The
+	 * arena is only good until the next Write() or flush, so callers
+	 * need to build a record right before passing it on.
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	threading::ValueArena* WriteArena();
+
+	/**
+	 * Like Write(), but for values that other frontends write as well.
+	 * The values live in the given arena and must not be modified;
+	 * the frontend and its backend only keep a reference to the arena
+	 * until the backend has written them, rather than taking ownership
+	 * of \a vals.  A null \a shared means the frontend owns them as with
+	 * the other Write().
+	 *
+	 * \a shard, if given, is the hash that picks the topic of the remote
+	 * write; see Broker::Manager::PublishLogWrite().
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	void Write(int num_fields, threading::Value** vals,
+	           std::shared_ptr<threading::ValueArena> shared,
+	           std::optional<uint64_t> shard = {});
+
 	/**
 	 * Sets the buffering state.
 	 *
@@ -188,6 +221,9 @@ protected:
 
 	void DeleteVals(int num_fields, threading::Value** vals);
 
+	// Like DeleteVals(), but aware of values living in write_arena.
+	void ReleaseVals(int num_fields, threading::Value** vals);
+
 	EnumVal* stream;
 	EnumVal* writer;
 
@@ -197,6 +233,7 @@ protected:
 	bool buf;	// True if buffering is enabled (default).
 	bool local;	// True if logging locally.
 	bool remote;	// True if loggin remotely.
+	bool batching;	// True if the backend takes RecordBatch instances.
 
 	const char* name;	// Descriptive name of the
 	WriterBackend::WriterInfo* info;	// The writer information.
@@ -207,6 +244,9 @@ protected:
 	static const int WRITER_BUFFER_SIZE = 1000;
 	int write_buffer_pos;	// Position of next write in buffer.
 	threading::Value*** write_buffer;	// Buffer of size WRITER_BUFFER_SIZE.
+	RecordBatch* write_batch;	// Used instead of write_buffer if batching.
+	threading::ValueArena* write_arena;	// Arena for the current batch.
+	WriterBackend::SharedArenas shared_arenas;	// Shared arenas of the current batch.
 };
 
 } // namespace zeek::logging
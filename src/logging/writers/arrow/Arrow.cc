@@ -0,0 +1,504 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/writers/arrow/Arrow.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <arrow/util/compression.h>
+
+#include "zeek/threading/Formatter.h"
+#include "zeek/threading/SerialTypes.h"
+#include "zeek/util.h"
+
+using zeek::threading::Field;
+using zeek::threading::Value;
+
+namespace zeek::logging::writer::detail {
+
+Arrow::Arrow(WriterFrontend* frontend) : WriterBackend(frontend)
+	{
+	}
+
+Arrow::~Arrow()
+	{
+	if ( file_open )
+		// In case of errors aborting the logging altogether,
+		// DoFinish() may not have been called.
+		CloseFile();
+	}
+
+bool Arrow::CheckStatus(const arrow::Status& status, const char* what)
+	{
+	if ( status.ok() )
+		return true;
+
+	Error(Fmt("%s for %s failed: %s", what, fname.c_str(), status.ToString().c_str()));
+	return false;
+	}
+
+bool Arrow::InitOptions(const WriterInfo& info)
+	{
+	for ( const auto& [key, val] : info.config )
+		{
+		if ( strcmp(key, "format") == 0 )
+			{
+			if ( strcmp(val, "parquet") == 0 )
+				parquet = true;
+			else if ( strcmp(val, "arrow") == 0 )
+				parquet = false;
+			else
+				{
+				Error("invalid value for 'format', must be either \"parquet\" or \"arrow\"");
+				return false;
+				}
+			}
+
+		else if ( strcmp(key, "row_group_size") == 0 )
+			{
+			row_group_size = atoll(val);
+
+			if ( row_group_size <= 0 )
+				{
+				Error("invalid value for 'row_group_size', must be a positive number");
+				return false;
+				}
+			}
+
+		else if ( strcmp(key, "dictionary_strings") == 0 )
+			{
+			if ( strcmp(val, "T") == 0 )
+				dictionary_strings = true;
+			else if ( strcmp(val, "F") == 0 )
+				dictionary_strings = false;
+			else
+				{
+				Error("invalid value for 'dictionary_strings', must be a string and either \"T\" or \"F\"");
+				return false;
+				}
+			}
+
+		else if ( strcmp(key, "compression") == 0 )
+			compression = val;
+		}
+
+#ifndef USE_PARQUET
+	if ( parquet )
+		{
+		Error("Parquet output is not available, Zeek was built without Parquet support; use format \"arrow\"");
+		return false;
+		}
+#endif
+
+	return true;
+	}
+
+static bool is_string_type(TypeTag t)
+	{
+	return t == TYPE_ENUM || t == TYPE_STRING || t == TYPE_FILE ||
+		t == TYPE_FUNC || t == TYPE_PATTERN;
+	}
+
+std::shared_ptr<arrow::ArrayBuilder> Arrow::MakeBuilder(TypeTag type, TypeTag subtype,
+                                                        bool dictionary)
+	{
+	switch ( type ) {
+	case TYPE_BOOL:
+		return std::make_shared<arrow::BooleanBuilder>();
+
+	case TYPE_INT:
+		return std::make_shared<arrow::Int64Builder>();
+
+	case TYPE_COUNT:
+		return std::make_shared<arrow::UInt64Builder>();
+
+	case TYPE_PORT:
+		return std::make_shared<arrow::UInt16Builder>();
+
+	case TYPE_DOUBLE:
+	case TYPE_INTERVAL:
+		return std::make_shared<arrow::DoubleBuilder>();
+
+	case TYPE_TIME:
+		return std::make_shared<arrow::TimestampBuilder>(
+			arrow::timestamp(arrow::TimeUnit::MICRO, "UTC"), arrow::default_memory_pool());
+
+	case TYPE_ADDR:
+	case TYPE_SUBNET:
+		return std::make_shared<arrow::StringBuilder>();
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+	case TYPE_PATTERN:
+		if ( dictionary )
+			return std::make_shared<arrow::StringDictionary32Builder>();
+
+		return std::make_shared<arrow::StringBuilder>();
+
+	case TYPE_TABLE:
+	case TYPE_VECTOR:
+		{
+		// Container elements always use plain encoding, as not all
+		// consumers support nested dictionaries.
+		auto values = MakeBuilder(subtype, TYPE_VOID, false);
+
+		if ( ! values )
+			return nullptr;
+
+		return std::make_shared<arrow::ListBuilder>(arrow::default_memory_pool(), values,
+		                                            arrow::list(values->type()));
+		}
+
+	default:
+		return nullptr;
+	}
+	}
+
+static arrow::Status append_string(arrow::ArrayBuilder* builder, bool dictionary,
+                                   const char* data, size_t len)
+	{
+	std::string escaped;
+
+	// Arrow strings must be valid UTF-8, so escape anything that isn't.
+	for ( size_t i = 0; i < len; ++i )
+		{
+		if ( static_cast<unsigned char>(data[i]) >= 0x80 )
+			{
+			escaped = util::json_escape_utf8(std::string(data, len));
+			data = escaped.data();
+			len = escaped.size();
+			break;
+			}
+		}
+
+	if ( dictionary )
+		return static_cast<arrow::StringDictionary32Builder*>(builder)->Append(data, len);
+
+	return static_cast<arrow::StringBuilder*>(builder)->Append(data, len);
+	}
+
+arrow::Status Arrow::AppendAtomic(arrow::ArrayBuilder* builder, TypeTag type, bool dictionary,
+                                  const RecordBatch& batch, const RecordBatch::Cell& c)
+	{
+	if ( ! c.present )
+		return builder->AppendNull();
+
+	switch ( type ) {
+	case TYPE_BOOL:
+		return static_cast<arrow::BooleanBuilder*>(builder)->Append(c.int_val != 0);
+
+	case TYPE_INT:
+		return static_cast<arrow::Int64Builder*>(builder)->Append(c.int_val);
+
+	case TYPE_COUNT:
+		return static_cast<arrow::UInt64Builder*>(builder)->Append(c.uint_val);
+
+	case TYPE_PORT:
+		return static_cast<arrow::UInt16Builder*>(builder)->Append(c.port_val.port);
+
+	case TYPE_DOUBLE:
+	case TYPE_INTERVAL:
+		return static_cast<arrow::DoubleBuilder*>(builder)->Append(c.double_val);
+
+	case TYPE_TIME:
+		return static_cast<arrow::TimestampBuilder*>(builder)->Append(
+			static_cast<int64_t>(std::llround(c.double_val * 1e6)));
+
+	case TYPE_ADDR:
+		{
+		auto s = threading::Formatter::Render(c.addr_val);
+		return static_cast<arrow::StringBuilder*>(builder)->Append(s.data(), s.size());
+		}
+
+	case TYPE_SUBNET:
+		{
+		auto s = threading::Formatter::Render(c.subnet_val);
+		return static_cast<arrow::StringBuilder*>(builder)->Append(s.data(), s.size());
+		}
+
+	default:
+		if ( is_string_type(type) )
+			{
+			auto s = batch.String(c);
+			return append_string(builder, dictionary, s.data(), s.size());
+			}
+
+		return arrow::Status::TypeError("unsupported log type ", type_name(type));
+	}
+	}
+
+arrow::Status Arrow::AppendCell(const Column& col, const RecordBatch& batch,
+                                const RecordBatch::Cell& c)
+	{
+	if ( col.type != TYPE_TABLE && col.type != TYPE_VECTOR )
+		return AppendAtomic(col.builder.get(), col.type, col.dictionary, batch, c);
+
+	auto list = static_cast<arrow::ListBuilder*>(col.builder.get());
+
+	if ( ! c.present )
+		return list->AppendNull();
+
+	auto status = list->Append();
+
+	const RecordBatch::Cell* elements = batch.Elements(c);
+
+	for ( size_t i = 0; status.ok() && i < c.span.length; ++i )
+		status = AppendAtomic(list->value_builder(), col.subtype, false, batch, elements[i]);
+
+	return status;
+	}
+
+bool Arrow::DoInit(const WriterInfo& info, int num_fields, const Field* const* fields)
+	{
+	if ( ! InitOptions(info) )
+		return false;
+
+	arrow::FieldVector schema_fields;
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		const Field* f = fields[i];
+		bool dict = dictionary_strings && is_string_type(f->type);
+		auto builder = MakeBuilder(f->type, f->subtype, dict);
+
+		if ( ! builder )
+			{
+			Error(Fmt("unsupported type %s for field %s", f->TypeName().c_str(), f->name));
+			return false;
+			}
+
+		// Every field may be unset, not just optional ones.
+		schema_fields.push_back(arrow::field(f->name, builder->type(), true));
+		columns.push_back({f->type, f->subtype, dict, std::move(builder)});
+		}
+
+	schema = arrow::schema(schema_fields);
+	fname = std::string(info.path) + "." + FileExt();
+
+	return OpenFile();
+	}
+
+bool Arrow::OpenFile()
+	{
+	auto sink_result = arrow::io::FileOutputStream::Open(fname);
+
+	if ( ! CheckStatus(sink_result.status(), "opening") )
+		return false;
+
+	sink = *std::move(sink_result);
+
+	if ( parquet )
+		{
+#ifdef USE_PARQUET
+		auto codec = arrow::util::Codec::GetCompressionType(compression);
+
+		if ( ! CheckStatus(codec.status(), "selecting compression") )
+			return false;
+
+		auto props = parquet::WriterProperties::Builder().compression(*codec)->build();
+
+		// Storing the Arrow schema lets readers restore the dictionary
+		// and timestamp types exactly.
+		auto arrow_props = parquet::ArrowWriterProperties::Builder().store_schema()->build();
+
+		auto writer = parquet::arrow::FileWriter::Open(*schema, arrow::default_memory_pool(),
+		                                               sink, props, arrow_props);
+
+		if ( ! CheckStatus(writer.status(), "creating Parquet writer") )
+			return false;
+
+		parquet_writer = *std::move(writer);
+#endif
+		}
+	else
+		{
+		// The stream format permits dictionaries to change from one
+		// record batch to the next, unlike the IPC file format.
+		auto writer = arrow::ipc::MakeStreamWriter(sink, schema);
+
+		if ( ! CheckStatus(writer.status(), "creating Arrow IPC writer") )
+			return false;
+
+		ipc_writer = *std::move(writer);
+		}
+
+	file_open = true;
+	return true;
+	}
+
+bool Arrow::WriteRowGroup()
+	{
+	if ( ! pending_rows )
+		return true;
+
+	arrow::ArrayVector arrays;
+
+	for ( auto& col : columns )
+		{
+		std::shared_ptr<arrow::Array> array;
+
+		if ( ! CheckStatus(col.builder->Finish(&array), "finishing column") )
+			return false;
+
+		// Start the next batch with an empty dictionary so that it
+		// doesn't keep accumulating all values seen so far.
+		if ( col.dictionary )
+			static_cast<arrow::StringDictionary32Builder*>(col.builder.get())->ResetFull();
+
+		arrays.push_back(std::move(array));
+		}
+
+	auto rb = arrow::RecordBatch::Make(schema, pending_rows, std::move(arrays));
+	pending_rows = 0;
+
+	if ( ipc_writer )
+		return CheckStatus(ipc_writer->WriteRecordBatch(*rb), "writing record batch");
+
+#ifdef USE_PARQUET
+	if ( parquet_writer )
+		{
+		auto table = arrow::Table::FromRecordBatches(schema, {rb});
+
+		if ( ! CheckStatus(table.status(), "building table") )
+			return false;
+
+		// A chunk size covering the whole table yields exactly one
+		// row group per call.
+		return CheckStatus(parquet_writer->WriteTable(**table, rb->num_rows()),
+		                   "writing row group");
+		}
+#endif
+
+	return true;
+	}
+
+bool Arrow::CloseFile()
+	{
+	bool success = WriteRowGroup();
+	file_open = false;
+
+	if ( ipc_writer )
+		{
+		success = CheckStatus(ipc_writer->Close(), "closing Arrow IPC writer") && success;
+		ipc_writer = nullptr;
+		}
+
+#ifdef USE_PARQUET
+	if ( parquet_writer )
+		{
+		success = CheckStatus(parquet_writer->Close(), "closing Parquet writer") && success;
+		parquet_writer = nullptr;
+		}
+#endif
+
+	if ( sink )
+		{
+		success = CheckStatus(sink->Close(), "closing") && success;
+		sink = nullptr;
+		}
+
+	return success;
+	}
+
+bool Arrow::DoWriteBatch(const RecordBatch& batch)
+	{
+	if ( ! file_open && ! OpenFile() )
+		return false;
+
+	int row = 0;
+
+	while ( row < batch.NumRows() )
+		{
+		// Fill up the current row group, column by column.
+		int n = std::min(static_cast<int64_t>(batch.NumRows() - row),
+		                 row_group_size - pending_rows);
+
+		for ( size_t i = 0; i < columns.size(); ++i )
+			{
+			const Column& col = columns[i];
+
+			for ( int j = row; j < row + n; ++j )
+				{
+				if ( ! CheckStatus(AppendCell(col, batch, batch.GetCell(i, j)), "appending value") )
+					return false;
+				}
+			}
+
+		row += n;
+		pending_rows += n;
+
+		if ( pending_rows >= row_group_size && ! WriteRowGroup() )
+			return false;
+		}
+
+	return true;
+	}
+
+bool Arrow::DoWrite(int num_fields, const Field* const* fields, Value** vals)
+	{
+	// Only used if records reach us individually; go through a batch of
+	// one to share the conversion logic.
+	RecordBatch batch(num_fields, fields, 1);
+	batch.AppendRow(vals);
+	return DoWriteBatch(batch);
+	}
+
+bool Arrow::DoFlush(double network_time)
+	{
+	// Parquet files aren't readable before their footer has been written,
+	// so there's no point in producing small row groups early.
+	if ( parquet || ! file_open )
+		return true;
+
+	return WriteRowGroup() && CheckStatus(sink->Flush(), "flushing");
+	}
+
+bool Arrow::DoRotate(const char* rotated_path, double open, double close, bool terminating)
+	{
+	// Don't rotate if there's not a file currently open.
+	if ( ! file_open )
+		{
+		FinishedRotation();
+		return true;
+		}
+
+	// Closing writes out the pending records as a final, possibly
+	// smaller, row group, so row groups never span files.
+	if ( ! CloseFile() )
+		{
+		FinishedRotation();
+		return false;
+		}
+
+	std::string nname = std::string(rotated_path) + "." + FileExt();
+
+	if ( rename(fname.c_str(), nname.c_str()) != 0 )
+		{
+		char buf[256];
+		util::zeek_strerror_r(errno, buf, sizeof(buf));
+		Error(Fmt("failed to rename %s to %s: %s", fname.c_str(),
+		          nname.c_str(), buf));
+		FinishedRotation();
+		return false;
+		}
+
+	if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) )
+		{
+		Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
+		return false;
+		}
+
+	return true;
+	}
+
+bool Arrow::DoFinish(double network_time)
+	{
+	return ! file_open || CloseFile();
+	}
+
+} // namespace zeek::logging::writer::detail
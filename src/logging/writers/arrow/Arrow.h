@@ -0,0 +1,108 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Log writer producing columnar output in Apache Parquet or Arrow IPC
+// stream format.
+//
+// The writer supports the following filter options via ``$config``:
+//
+//     format              "parquet" (default) or "arrow" (IPC stream).
+//     row_group_size      Number of records per Parquet row group or Arrow
+//                         record batch (default 65536).
+//     dictionary_strings  "T" (default) to dictionary-encode string, enum
+//                         and similar columns, "F" to store them plainly.
+//     compression         Parquet column compression codec, e.g. "snappy"
+//                         (default), "zstd", "gzip", or "uncompressed".
+
+#pragma once
+
+#include "zeek-config.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <arrow/api.h>
+#include <arrow/io/api.h>
+#include <arrow/ipc/api.h>
+
+#ifdef USE_PARQUET
+#include <parquet/arrow/writer.h>
+#endif
+
+#include "zeek/logging/WriterBackend.h"
+
+namespace zeek::logging::writer::detail {
+
+class Arrow : public WriterBackend {
+public:
+	explicit Arrow(WriterFrontend* frontend);
+	~Arrow() override;
+
+	static WriterBackend* Instantiate(WriterFrontend* frontend)
+		{ return new Arrow(frontend); }
+
+	bool SupportsBatches() const override	{ return true; }
+
+protected:
+	bool DoInit(const WriterInfo& info, int num_fields,
+	            const threading::Field* const* fields) override;
+	bool DoWrite(int num_fields, const threading::Field* const* fields,
+	             threading::Value** vals) override;
+	bool DoWriteBatch(const RecordBatch& batch) override;
+	bool DoSetBuf(bool enabled) override	{ return true; }
+	bool DoRotate(const char* rotated_path, double open,
+	              double close, bool terminating) override;
+	bool DoFlush(double network_time) override;
+	bool DoFinish(double network_time) override;
+	bool DoHeartbeat(double network_time, double current_time) override	{ return true; }
+
+private:
+	// One output column: the builder accumulating the current row group,
+	// plus what's needed to feed it.
+	struct Column {
+		TypeTag type;
+		TypeTag subtype;
+		bool dictionary;
+		std::shared_ptr<arrow::ArrayBuilder> builder;
+	};
+
+	bool InitOptions(const WriterInfo& info);
+
+	// Maps a Zeek log type to an Arrow type and a matching builder.
+	std::shared_ptr<arrow::ArrayBuilder> MakeBuilder(TypeTag type, TypeTag subtype,
+	                                                 bool dictionary);
+
+	arrow::Status AppendAtomic(arrow::ArrayBuilder* builder, TypeTag type, bool dictionary,
+	                           const RecordBatch& batch, const RecordBatch::Cell& c);
+	arrow::Status AppendCell(const Column& col, const RecordBatch& batch,
+	                         const RecordBatch::Cell& c);
+
+	bool OpenFile();
+	bool CloseFile();
+
+	// Turns the buffered records into a row group or record batch.
+	bool WriteRowGroup();
+
+	bool CheckStatus(const arrow::Status& status, const char* what);
+
+	std::string FileExt() const	{ return parquet ? "parquet" : "arrows"; }
+
+	std::string fname;
+	bool file_open = false;
+	bool parquet = true;
+	bool dictionary_strings = true;
+	int64_t row_group_size = 65536;
+	int64_t pending_rows = 0;
+	std::string compression = "snappy";
+
+	std::vector<Column> columns;
+	std::shared_ptr<arrow::Schema> schema;
+	std::shared_ptr<arrow::io::FileOutputStream> sink;
+	std::shared_ptr<arrow::ipc::RecordBatchWriter> ipc_writer;
+
+#ifdef USE_PARQUET
+	std::unique_ptr<parquet::arrow::FileWriter> parquet_writer;
+#endif
+};
+
+} // namespace zeek::logging::writer::detail
@@ -0,0 +1,21 @@
+// See the file  in the main distribution directory for copyright.
+
+#include "zeek/plugin/Plugin.h"
+#include "zeek/logging/writers/arrow/Arrow.h"
+
+namespace zeek::plugin::detail::Zeek_ArrowWriter {
+
+class Plugin : public zeek::plugin::Plugin {
+public:
+	zeek::plugin::Configuration Configure() override
+		{
+		AddComponent(new zeek::logging::Component("Arrow", zeek::logging::writer::detail::Arrow::Instantiate));
+
+		zeek::plugin::Configuration config;
+		config.name = "Zeek::ArrowWriter";
+		config.description = "Parquet and Arrow IPC log writer";
+		return config;
+		}
+} plugin;
+
+} // namespace zeek::plugin::detail::Zeek_ArrowWriter
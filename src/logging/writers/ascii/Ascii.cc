@@ -9,9 +9,17 @@
 #include <unistd.h>
 #include <dirent.h>
 
+#include <signal.h>
+#include <pthread.h>
+
 #include <ctime>
 #include <cstdio>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <memory>
 #include <optional>
@@ -31,6 +39,119 @@ static constexpr auto shadow_file_prefix = ".shadow.";
 
 namespace zeek::logging::writer::detail {
 
+/**
+ * Finishes rotated log files in the background, on a bounded number of
+ * threads that all ASCII writers share.
+ */
+class FileFinisher {
+public:
+	~FileFinisher()
+		{
+			{
+			std::unique_lock<std::mutex> lock(mutex);
+			stopping = true;
+			}
+
+		has_jobs.notify_all();
+
+		for ( auto& t : threads )
+			t.join();
+		}
+
+	/**
+	 * Queues a job, starting another thread for it if all are busy and
+	 * there are fewer than max_threads.
+	 *
+	 * @return The job's result, an error message or empty.
+	 */
+	std::future<std::string> Submit(int max_threads, std::function<std::string()> job)
+		{
+		std::packaged_task<std::string()> task(std::move(job));
+		auto result = task.get_future();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		jobs.push_back(std::move(task));
+
+		if ( idle == 0 && static_cast<int>(threads.size()) < max_threads )
+			threads.emplace_back(&FileFinisher::Run, this);
+		else
+			has_jobs.notify_one();
+
+		return result;
+		}
+
+private:
+	void Run()
+		{
+		// Signals are for the main thread only.
+		sigset_t mask_set;
+		sigfillset(&mask_set);
+		sigdelset(&mask_set, SIGFPE);
+		sigdelset(&mask_set, SIGILL);
+		sigdelset(&mask_set, SIGSEGV);
+		sigdelset(&mask_set, SIGBUS);
+		pthread_sigmask(SIG_BLOCK, &mask_set, 0);
+
+		util::detail::set_thread_name("zk.ascii-finish");
+
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while ( true )
+			{
+			if ( jobs.empty() )
+				{
+				if ( stopping )
+					break;
+
+				++idle;
+				has_jobs.wait(lock);
+				--idle;
+				continue;
+				}
+
+			auto task = std::move(jobs.front());
+			jobs.pop_front();
+
+			lock.unlock();
+			task();
+			lock.lock();
+			}
+		}
+
+	std::mutex mutex;
+	std::condition_variable has_jobs;
+	std::deque<std::packaged_task<std::string()>> jobs;
+	std::vector<std::thread> threads;
+	int idle = 0;
+	bool stopping = false;
+};
+
+static FileFinisher file_finisher;
+
+// Completes a rotated file that may still have data in flight, and makes
+// it durable. Safe to call from any thread.
+static std::string finish_file(int fd, gzFile gz, const std::string& name)
+	{
+	char buf[256];
+	std::string error;
+
+	if ( gz && gzflush(gz, Z_FINISH) != Z_OK )
+		error = util::fmt("cannot finish compressing %s", name.c_str());
+
+	if ( fsync(fd) < 0 && error.empty() )
+		{
+		util::zeek_strerror_r(errno, buf, sizeof(buf));
+		error = std::string("cannot sync ") + name + ": " + buf;
+		}
+
+	if ( gz )
+		gzclose(gz);
+	else
+		util::safe_close(fd);
+
+	return error;
+	}
+
 /**
  * Information about an leftover log file: that is, one that a previous
  * process was in the middle of writing, but never completed a rotation
@@ -203,6 +324,12 @@ Ascii::Ascii(WriterFrontend* frontend) : WriterBackend(frontend)
 	formatter = nullptr;
 	gzip_level = 0;
 	gzfile = nullptr;
+	zstd_level = 0;
+	lz4_level = 0;
+	compression_threads = 0;
+	compression_frame_size = 0;
+	rotation_finish_threads = BifConst::LogAscii::rotation_finish_threads;
+	write_buffer_len = 0;
 
 	InitConfigOptions();
 	init_options = InitFilterOptions();
@@ -215,6 +342,10 @@ void Ascii::InitConfigOptions()
 	use_json = BifConst::LogAscii::use_json;
 	enable_utf_8 = BifConst::LogAscii::enable_utf_8;
 	gzip_level = BifConst::LogAscii::gzip_level;
+	zstd_level = BifConst::LogAscii::zstd_level;
+	lz4_level = BifConst::LogAscii::lz4_level;
+	compression_threads = BifConst::LogAscii::compression_threads;
+	compression_frame_size = BifConst::LogAscii::compression_frame_size;
 
 	separator.assign(
 			(const char*) BifConst::LogAscii::separator->Bytes(),
@@ -252,6 +383,16 @@ void Ascii::InitConfigOptions()
 		(const char*) BifConst::LogAscii::gzip_file_extension->Bytes(),
 		BifConst::LogAscii::gzip_file_extension->Len()
 		);
+
+	zstd_file_extension.assign(
+		(const char*) BifConst::LogAscii::zstd_file_extension->Bytes(),
+		BifConst::LogAscii::zstd_file_extension->Len()
+		);
+
+	lz4_file_extension.assign(
+		(const char*) BifConst::LogAscii::lz4_file_extension->Bytes(),
+		BifConst::LogAscii::lz4_file_extension->Len()
+		);
 	}
 
 bool Ascii::InitFilterOptions()
@@ -285,6 +426,19 @@ bool Ascii::InitFilterOptions()
 				return false;
 				}
 			}
+
+		else if ( strcmp(i->first, "zstd_level" ) == 0 )
+			zstd_level = atoi(i->second);
+
+		else if ( strcmp(i->first, "lz4_level" ) == 0 )
+			lz4_level = atoi(i->second);
+
+		else if ( strcmp(i->first, "compression_threads" ) == 0 )
+			compression_threads = atoi(i->second);
+
+		else if ( strcmp(i->first, "compression_frame_size" ) == 0 )
+			compression_frame_size = strtoull(i->second, nullptr, 10);
+
 		else if ( strcmp(i->first, "use_json") == 0 )
 			{
 			if ( strcmp(i->second, "T") == 0 )
@@ -344,14 +498,86 @@ bool Ascii::InitFilterOptions()
 
 		else if ( strcmp(i->first, "gzip_file_extension") == 0 )
 			gzip_file_extension.assign(i->second);
+
+		else if ( strcmp(i->first, "zstd_file_extension") == 0 )
+			zstd_file_extension.assign(i->second);
+
+		else if ( strcmp(i->first, "lz4_file_extension") == 0 )
+			lz4_file_extension.assign(i->second);
 		}
 
 	if ( ! InitFormatter() )
 		return false;
 
+	if ( ! InitCompression() )
+		return false;
+
+	return true;
+	}
+
+bool Ascii::InitCompression()
+	{
+	if ( (gzip_level > 0) + (zstd_level > 0) + (lz4_level > 0) > 1 )
+		{
+		Error("only one of 'gzip_level', 'zstd_level' and 'lz4_level' can be set.");
+		return false;
+		}
+
+	if ( zstd_level < 0 || zstd_level > 22 )
+		{
+		Error("invalid value for 'zstd_level', must be a number between 0 and 22.");
+		return false;
+		}
+
+	if ( lz4_level < 0 || lz4_level > 12 )
+		{
+		Error("invalid value for 'lz4_level', must be a number between 0 and 12.");
+		return false;
+		}
+
+	if ( compression_threads < 0 )
+		{
+		Error("invalid value for 'compression_threads', must not be negative.");
+		return false;
+		}
+
+	compressor = nullptr;
+
+	if ( zstd_level <= 0 && lz4_level <= 0 )
+		return true;
+
+	// The context gets created once here and reused for each file.
+	StreamCompressor::Options opts;
+	opts.level = zstd_level > 0 ? zstd_level : lz4_level;
+	opts.threads = compression_threads;
+	opts.frame_size = compression_frame_size;
+
+	std::string err;
+	compressor = StreamCompressor::Create(zstd_level > 0 ? "zstd" : "lz4", opts, &err);
+
+	if ( ! compressor )
+		{
+		Error(Fmt("cannot set up compression: %s", err.c_str()));
+		return false;
+		}
+
 	return true;
 	}
 
+std::string Ascii::CompressionExt() const
+	{
+	if ( gzip_level > 0 )
+		return "." + (gzip_file_extension.empty() ? "gz" : gzip_file_extension);
+
+	if ( zstd_level > 0 )
+		return "." + (zstd_file_extension.empty() ? "zst" : zstd_file_extension);
+
+	if ( lz4_level > 0 )
+		return "." + (lz4_file_extension.empty() ? "lz4" : lz4_file_extension);
+
+	return "";
+	}
+
 bool Ascii::InitFormatter()
 	{
 	delete formatter;
@@ -440,14 +666,7 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
 
 	if ( ! IsSpecial(fname) )
 		{
-		std::string ext = "." + LogExt();
-
-		if ( gzip_level > 0 )
-			{
-			ext += ".";
-			ext += gzip_file_extension.empty() ? "gz" : gzip_file_extension;
-			}
-
+		std::string ext = "." + LogExt() + CompressionExt();
 		fname += ext;
 
 		bool use_shadow = BifConst::LogAscii::enable_leftover_log_rotation && Info().rotation_interval > 0;
@@ -524,6 +743,22 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
 		gzfile = nullptr;
 		}
 
+	if ( compressor && ! compressor->Open(fd) )
+		{
+		Error(Fmt("cannot compress %s: %s", fname.c_str(),
+		          compressor->LastError().c_str()));
+		return false;
+		}
+
+	// gzip and the stream compressors batch their output already.
+	// Special files, like stdout, stay unbuffered.
+	if ( ! gzfile && ! compressor && ! IsSpecial(fname) )
+		write_buffer.resize(BifConst::LogAscii::write_buffer_size);
+	else
+		write_buffer.clear();
+
+	write_buffer_len = 0;
+
 	if ( ! WriteHeader(path) )
 		{
 		Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
@@ -587,6 +822,18 @@ bool Ascii::WriteHeader(const string& path)
 
 bool Ascii::DoFlush(double network_time)
 	{
+	FinishRotations(false);
+
+	if ( fd )
+		FlushWriteBuffer();
+
+	if ( fd && compressor && ! compressor->Flush() )
+		{
+		Error(Fmt("error flushing %s: %s", fname.c_str(),
+		          compressor->LastError().c_str()));
+		return false;
+		}
+
 	fsync(fd);
 	return true;
 	}
@@ -605,6 +852,8 @@ bool Ascii::DoFinish(double network_time)
 
 	CloseFile(network_time);
 
+	FinishRotations(true);
+
 	return true;
 	}
 
@@ -612,7 +861,10 @@ bool Ascii::DoWrite(int num_fields, const threading::Field* const * fields,
                     threading::Value** vals)
 	{
 	if ( ! fd )
+		{
+		FinishRotations(false);
 		DoInit(Info(), NumFields(), Fields());
+		}
 
 	desc.Clear();
 
@@ -640,8 +892,15 @@ bool Ascii::DoWrite(int num_fields, const threading::Field* const * fields,
 	if ( ! InternalWrite(fd, bytes, len) )
 		goto write_error;
 
-        if ( ! IsBuf() )
+	if ( ! IsBuf() )
+		{
+		FlushWriteBuffer();
+
+		if ( compressor && ! compressor->Flush() )
+			goto write_error;
+
 		fsync(fd);
+		}
 
 	return true;
 
@@ -652,6 +911,10 @@ write_error:
 
 bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool terminating)
 	{
+	// Earlier rotations must get reported first. At termination, that
+	// includes waiting for them, as this one finishes inline.
+	FinishRotations(terminating);
+
 	// Don't rotate special files or if there's not one currently open.
 	if ( ! fd || IsSpecial(Info().path) )
 		{
@@ -659,15 +922,33 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 		return true;
 		}
 
-	CloseFile(close);
+	string nname = string(rotated_path) + "." + LogExt() + CompressionExt();
 
-	string nname = string(rotated_path) + "." + LogExt();
+	// Finishing the file in the background lets writes go on right away,
+	// into a new file once this one has its new name.
+	bool finish_later = rotation_finish_threads > 0 && ! terminating;
+	int old_fd = 0;
+	gzFile old_gzfile = nullptr;
 
-	if ( gzip_level > 0 )
+	if ( finish_later )
 		{
-		nname += ".";
-		nname += gzip_file_extension.empty() ? "gz" : gzip_file_extension;
+		if ( include_meta && ! tsv )
+			WriteHeaderField("close", Timestamp(0));
+
+		// The compressor stays with the writer, so its stream ends
+		// here.
+		if ( compressor && ! compressor->Close() )
+			Error(Fmt("Ascii::InternalClose error: %s\n", compressor->LastError().c_str()));
+
+		FlushWriteBuffer();
+
+		old_fd = fd;
+		old_gzfile = gzfile;
+		fd = 0;
+		gzfile = nullptr;
 		}
+	else
+		CloseFile(close);
 
 	if ( rename(fname.c_str(), nname.c_str()) != 0 )
 		{
@@ -675,6 +956,10 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 		util::zeek_strerror_r(errno, buf, sizeof(buf));
 		Error(Fmt("failed to rename %s to %s: %s", fname.c_str(),
 		          nname.c_str(), buf));
+
+		if ( finish_later )
+			finish_file(old_fd, old_gzfile, fname);
+
 		FinishedRotation();
 		return false;
 		}
@@ -688,11 +973,25 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 		if ( unlink(sfname.data()) != 0 )
 			{
 			Error(Fmt("cannot unlink %s: %s", sfname.data(), Strerror(errno)));
+
+			if ( finish_later )
+				finish_file(old_fd, old_gzfile, nname);
+
 			FinishedRotation();
 			return false;
 			}
 		}
 
+	if ( finish_later )
+		{
+		auto result = file_finisher.Submit(rotation_finish_threads,
+			[old_fd, old_gzfile, nname]() { return finish_file(old_fd, old_gzfile, nname); });
+
+		pending_rotations.push_back({nname, fname, open, close, terminating, std::move(result)});
+		DeferRotation();
+		return true;
+		}
+
 	if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) )
 		{
 		Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
@@ -710,10 +1009,39 @@ bool Ascii::DoSetBuf(bool enabled)
 
 bool Ascii::DoHeartbeat(double network_time, double current_time)
 	{
-	// Nothing to do.
+	FinishRotations(false);
+
+	// Bounds how long buffered lines wait for the file.
+	if ( fd )
+		FlushWriteBuffer();
+
 	return true;
 	}
 
+void Ascii::FinishRotations(bool wait)
+	{
+	while ( ! pending_rotations.empty() )
+		{
+		auto& p = pending_rotations.front();
+
+		if ( ! wait && p.result.wait_for(std::chrono::seconds(0)) != std::future_status::ready )
+			break;
+
+		auto error = p.result.get();
+
+		if ( error.empty() )
+			FinishedDeferredRotation(p.new_name.c_str(), p.old_name.c_str(),
+			                         p.open, p.close, p.terminating);
+		else
+			{
+			Error(error.c_str());
+			FinishedDeferredRotation();
+			}
+
+		pending_rotations.pop_front();
+		}
+	}
+
 static std::vector<LeftoverLog> find_leftover_logs()
 	{
 	std::vector<LeftoverLog> rval;
@@ -884,8 +1212,37 @@ string Ascii::Timestamp(double t)
 
 bool Ascii::InternalWrite(int fd, const char* data, int len)
 	{
+	if ( compressor )
+		{
+		if ( compressor->Write(data, len) )
+			return true;
+
+		Error(Fmt("Ascii::InternalWrite error: %s\n", compressor->LastError().c_str()));
+		return false;
+		}
+
 	if ( ! gzfile )
-		return util::safe_write(fd, data, len);
+		{
+		if ( write_buffer.empty() )
+			return util::safe_write(fd, data, len);
+
+		if ( write_buffer_len + len <= write_buffer.size() )
+			{
+			memcpy(write_buffer.data() + write_buffer_len, data, len);
+			write_buffer_len += len;
+			return true;
+			}
+
+		// Writes what's buffered along with the new data in one go.
+		struct iovec iov[2];
+		iov[0].iov_base = write_buffer.data();
+		iov[0].iov_len = write_buffer_len;
+		iov[1].iov_base = const_cast<char*>(data);
+		iov[1].iov_len = len;
+
+		write_buffer_len = 0;
+		return util::safe_writev(fd, iov, 2);
+		}
 
 	while ( len > 0 )
 		{
@@ -905,8 +1262,30 @@ bool Ascii::InternalWrite(int fd, const char* data, int len)
 	return true;
 	}
 
+void Ascii::FlushWriteBuffer()
+	{
+	if ( write_buffer_len == 0 )
+		return;
+
+	util::safe_write(fd, write_buffer.data(), write_buffer_len);
+	write_buffer_len = 0;
+	}
+
 bool Ascii::InternalClose(int fd)
 	{
+	FlushWriteBuffer();
+
+	if ( compressor )
+		{
+		bool success = compressor->Close();
+
+		if ( ! success )
+			Error(Fmt("Ascii::InternalClose error: %s\n", compressor->LastError().c_str()));
+
+		util::safe_close(fd);
+		return success;
+		}
+
 	if ( ! gzfile )
 		{
 		util::safe_close(fd);
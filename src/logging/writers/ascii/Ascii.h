@@ -6,7 +6,12 @@
 
 #include <zlib.h>
 
+#include <deque>
+#include <future>
+#include <vector>
+
 #include "zeek/logging/WriterBackend.h"
+#include "zeek/logging/writers/ascii/Compression.h"
 #include "zeek/threading/formatters/Ascii.h"
 #include "zeek/threading/formatters/JSON.h"
 #include "zeek/Desc.h"
@@ -50,9 +55,18 @@ private:
 	void InitConfigOptions();
 	bool InitFilterOptions();
 	bool InitFormatter();
+	bool InitCompression();
+	std::string CompressionExt() const;
 	bool InternalWrite(int fd, const char* data, int len);
 	bool InternalClose(int fd);
 
+	// Writes out the lines that InternalWrite() buffered.
+	void FlushWriteBuffer();
+
+	// Reports the rotations whose files got finished in the background,
+	// in order. If wait is true, waits for all of them.
+	void FinishRotations(bool wait);
+
 	int fd;
 	gzFile gzfile;
 	std::string fname;
@@ -72,12 +86,36 @@ private:
 
 	int gzip_level; // level > 0 enables gzip compression
 	std::string gzip_file_extension;
+	int zstd_level; // level > 0 enables zstd compression
+	std::string zstd_file_extension;
+	int lz4_level; // level > 0 enables lz4 compression
+	std::string lz4_file_extension;
+	int compression_threads;
+	size_t compression_frame_size;
 	bool use_json;
 	bool enable_utf_8;
 	std::string json_timestamps;
 
 	threading::Formatter* formatter;
+	std::unique_ptr<StreamCompressor> compressor; // Set for zstd and lz4.
 	bool init_options;
+
+	// A rotated file that gets finished in the background.
+	struct PendingRotation {
+		std::string new_name;
+		std::string old_name;
+		double open;
+		double close;
+		bool terminating;
+		std::future<std::string> result;	// An error message, or empty.
+	};
+
+	int rotation_finish_threads;
+	std::deque<PendingRotation> pending_rotations;
+
+	// Lines waiting to get written to an uncompressed file.
+	std::vector<char> write_buffer;
+	size_t write_buffer_len;
 };
 
 } // namespace zeek::logging::writer::detail
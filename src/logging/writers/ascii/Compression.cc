@@ -0,0 +1,327 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "zeek/logging/writers/ascii/Compression.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef USE_LZ4
+#include <lz4frame.h>
+#endif
+
+#include "zeek/util.h"
+
+namespace zeek::logging::writer::detail {
+
+bool StreamCompressor::WriteOut(size_t len)
+	{
+	if ( len == 0 )
+		return true;
+
+	if ( ! util::safe_write(fd, out.data(), len) )
+		{
+		char buf[256];
+		util::zeek_strerror_r(errno, buf, sizeof(buf));
+		return SetError(std::string("write failed: ") + buf);
+		}
+
+	return true;
+	}
+
+#ifdef USE_ZSTD
+
+class ZstdCompressor final : public StreamCompressor {
+public:
+	explicit ZstdCompressor(const Options& options) : StreamCompressor(options)	{ }
+	~ZstdCompressor() override	{ ZSTD_freeCCtx(ctx); }
+
+	bool Init();
+
+	bool Open(int arg_fd) override;
+	bool Write(const char* data, size_t len) override;
+	bool Flush() override	{ return Finish(ZSTD_e_flush); }
+	bool Close() override;
+
+private:
+	// Runs the compressor once and writes out whatever it produced.
+	bool Step(ZSTD_inBuffer* in, ZSTD_EndDirective mode, size_t* remaining);
+
+	// Flushes or ends the current frame completely.
+	bool Finish(ZSTD_EndDirective mode);
+
+	ZSTD_CCtx* ctx = nullptr;
+	bool frame_done = false;	// True if at least one frame has been ended.
+};
+
+bool ZstdCompressor::Init()
+	{
+	ctx = ZSTD_createCCtx();
+
+	if ( ! ctx )
+		return SetError("cannot create zstd context");
+
+	size_t rc = ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, options.level);
+
+	if ( ZSTD_isError(rc) )
+		return SetError("invalid zstd level " + std::to_string(options.level) +
+		                ": " + ZSTD_getErrorName(rc));
+
+	if ( options.threads > 0 )
+		{
+		rc = ZSTD_CCtx_setParameter(ctx, ZSTD_c_nbWorkers, options.threads);
+
+		if ( ZSTD_isError(rc) )
+			return SetError("cannot use " + std::to_string(options.threads) +
+			                " zstd threads: " + ZSTD_getErrorName(rc));
+		}
+
+	out.resize(ZSTD_CStreamOutSize());
+	return true;
+	}
+
+bool ZstdCompressor::Open(int arg_fd)
+	{
+	// Keeps the parameters, so the context is ready for another stream.
+	ZSTD_CCtx_reset(ctx, ZSTD_reset_session_only);
+	fd = arg_fd;
+	frame_bytes = 0;
+	frame_done = false;
+	return true;
+	}
+
+bool ZstdCompressor::Step(ZSTD_inBuffer* in, ZSTD_EndDirective mode, size_t* remaining)
+	{
+	ZSTD_outBuffer o = { out.data(), out.size(), 0 };
+	size_t rc = ZSTD_compressStream2(ctx, &o, in, mode);
+
+	if ( ZSTD_isError(rc) )
+		return SetError(std::string("zstd compression failed: ") + ZSTD_getErrorName(rc));
+
+	*remaining = rc;
+	return WriteOut(o.pos);
+	}
+
+bool ZstdCompressor::Finish(ZSTD_EndDirective mode)
+	{
+	ZSTD_inBuffer in = { nullptr, 0, 0 };
+	size_t remaining;
+
+	do
+		{
+		if ( ! Step(&in, mode, &remaining) )
+			return false;
+		}
+	while ( remaining > 0 );
+
+	return true;
+	}
+
+bool ZstdCompressor::Write(const char* data, size_t len)
+	{
+	while ( len > 0 )
+		{
+		size_t n = len;
+
+		if ( options.frame_size )
+			n = std::min(n, options.frame_size - frame_bytes);
+
+		ZSTD_inBuffer in = { data, n, 0 };
+		size_t remaining;
+
+		while ( in.pos < in.size )
+			{
+			if ( ! Step(&in, ZSTD_e_continue, &remaining) )
+				return false;
+			}
+
+		data += n;
+		len -= n;
+		frame_bytes += n;
+
+		if ( options.frame_size && frame_bytes >= options.frame_size )
+			{
+			// The next input implicitly starts a new frame.
+			if ( ! Finish(ZSTD_e_end) )
+				return false;
+
+			frame_bytes = 0;
+			frame_done = true;
+			}
+		}
+
+	return true;
+	}
+
+bool ZstdCompressor::Close()
+	{
+	bool success = true;
+
+	// Avoid a trailing empty frame if the last frame just got ended.
+	if ( frame_bytes > 0 || ! frame_done )
+		success = Finish(ZSTD_e_end);
+
+	fd = -1;
+	return success;
+	}
+
+#endif
+
+#ifdef USE_LZ4
+
+class Lz4Compressor final : public StreamCompressor {
+public:
+	explicit Lz4Compressor(const Options& options) : StreamCompressor(options)	{ }
+	~Lz4Compressor() override	{ LZ4F_freeCompressionContext(ctx); }
+
+	bool Init();
+
+	bool Open(int arg_fd) override;
+	bool Write(const char* data, size_t len) override;
+	bool Flush() override;
+	bool Close() override;
+
+private:
+	// Input is fed in pieces of at most this size so that the output
+	// buffer can be sized once for the worst case.
+	static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+	bool BeginFrame();
+	bool EndFrame();
+
+	bool Check(size_t rc, const char* what)
+		{
+		if ( LZ4F_isError(rc) )
+			return SetError(std::string("lz4 ") + what + " failed: " + LZ4F_getErrorName(rc));
+
+		return WriteOut(rc);
+		}
+
+	LZ4F_cctx* ctx = nullptr;
+	LZ4F_preferences_t prefs;
+	bool in_frame = false;
+};
+
+bool Lz4Compressor::Init()
+	{
+	if ( LZ4F_isError(LZ4F_createCompressionContext(&ctx, LZ4F_VERSION)) )
+		return SetError("cannot create lz4 context");
+
+	memset(&prefs, 0, sizeof(prefs));
+	prefs.compressionLevel = options.level;
+
+	// The bound includes what's needed for flushing and ending a frame.
+	out.resize(std::max(LZ4F_compressBound(CHUNK_SIZE, &prefs),
+	                    static_cast<size_t>(LZ4F_HEADER_SIZE_MAX)));
+	return true;
+	}
+
+bool Lz4Compressor::BeginFrame()
+	{
+	in_frame = true;
+	frame_bytes = 0;
+	return Check(LZ4F_compressBegin(ctx, out.data(), out.size(), &prefs), "frame setup");
+	}
+
+bool Lz4Compressor::EndFrame()
+	{
+	in_frame = false;
+	return Check(LZ4F_compressEnd(ctx, out.data(), out.size(), nullptr), "frame end");
+	}
+
+bool Lz4Compressor::Open(int arg_fd)
+	{
+	fd = arg_fd;
+	return BeginFrame();
+	}
+
+bool Lz4Compressor::Write(const char* data, size_t len)
+	{
+	while ( len > 0 )
+		{
+		if ( ! in_frame && ! BeginFrame() )
+			return false;
+
+		size_t n = std::min(len, CHUNK_SIZE);
+
+		if ( options.frame_size )
+			n = std::min(n, options.frame_size - frame_bytes);
+
+		if ( ! Check(LZ4F_compressUpdate(ctx, out.data(), out.size(), data, n, nullptr),
+		             "compression") )
+			return false;
+
+		data += n;
+		len -= n;
+		frame_bytes += n;
+
+		// The next frame only begins with further input, so that
+		// there's no trailing empty frame.
+		if ( options.frame_size && frame_bytes >= options.frame_size && ! EndFrame() )
+			return false;
+		}
+
+	return true;
+	}
+
+bool Lz4Compressor::Flush()
+	{
+	if ( ! in_frame )
+		return true;
+
+	return Check(LZ4F_flush(ctx, out.data(), out.size(), nullptr), "flush");
+	}
+
+bool Lz4Compressor::Close()
+	{
+	bool success = ! in_frame || EndFrame();
+	fd = -1;
+	return success;
+	}
+
+#endif
+
+std::unique_ptr<StreamCompressor> StreamCompressor::Create(const std::string& format,
+                                                           const Options& options,
+                                                           std::string* error)
+	{
+	if ( format == "zstd" )
+		{
+#ifdef USE_ZSTD
+		auto c = std::make_unique<ZstdCompressor>(options);
+
+		if ( c->Init() )
+			return c;
+
+		*error = c->LastError();
+#else
+		*error = "zstd compression is not available, Zeek was built without libzstd";
+#endif
+		return nullptr;
+		}
+
+	if ( format == "lz4" )
+		{
+#ifdef USE_LZ4
+		auto c = std::make_unique<Lz4Compressor>(options);
+
+		if ( c->Init() )
+			return c;
+
+		*error = c->LastError();
+#else
+		*error = "lz4 compression is not available, Zeek was built without liblz4";
+#endif
+		return nullptr;
+		}
+
+	*error = "unknown compression format '" + format + "'";
+	return nullptr;
+	}
+
+} // namespace zeek::logging::writer::detail
@@ -0,0 +1,90 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Streaming compressors for the ASCII writer's zstd and lz4 output.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace zeek::logging::writer::detail {
+
+/**
+ * Base class for compressing a log file's content on the fly.
+ *
+ * A compressor instance keeps its compression context across files, so
+ * that rotation doesn't need to set up a new one each time. All methods
+ * are called from the writer thread only.
+ */
+class StreamCompressor {
+public:
+	/**
+	 * Configuration shared by all compressors.
+	 */
+	struct Options {
+		int level = 0;	//! Compression level, with 0 meaning the default.
+		int threads = 0;	//! Worker threads, if supported; 0 compresses inline.
+		size_t frame_size = 0;	//! Input bytes per frame; 0 for a single frame per file.
+	};
+
+	virtual ~StreamCompressor() = default;
+
+	/**
+	 * Instantiates the compressor for the given format ("zstd" or
+	 * "lz4").
+	 *
+	 * @return The compressor, or null with \a error set if the format is
+	 * unknown or not available in this build.
+	 */
+	static std::unique_ptr<StreamCompressor> Create(const std::string& format,
+	                                                const Options& options,
+	                                                std::string* error);
+
+	/**
+	 * Begins a new compressed stream written to the given file
+	 * descriptor. Any previous stream must have been closed.
+	 */
+	virtual bool Open(int fd) = 0;
+
+	/**
+	 * Compresses data into the current stream.
+	 */
+	virtual bool Write(const char* data, size_t len) = 0;
+
+	/**
+	 * Writes out everything compressed so far, so that a reader of the
+	 * file can decompress it.
+	 */
+	virtual bool Flush() = 0;
+
+	/**
+	 * Finishes the current stream. The file descriptor remains open.
+	 */
+	virtual bool Close() = 0;
+
+	/**
+	 * Returns a description of the most recent error.
+	 */
+	const std::string& LastError() const	{ return error; }
+
+protected:
+	explicit StreamCompressor(const Options& options) : options(options)	{ }
+
+	// Writes the output buffer's first len bytes to the file.
+	bool WriteOut(size_t len);
+
+	bool SetError(std::string msg)
+		{
+		error = std::move(msg);
+		return false;
+		}
+
+	Options options;
+	int fd = -1;
+	size_t frame_bytes = 0;	// Input bytes in the current frame.
+	std::vector<char> out;
+	std::string error;
+};
+
+} // namespace zeek::logging::writer::detail
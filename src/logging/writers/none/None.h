@@ -16,11 +16,14 @@ public:
 	static WriterBackend* Instantiate(WriterFrontend* frontend)
 		{ return new None(frontend); }
 
+	bool SupportsBatches() const override	{ return true; }
+
 protected:
 	bool DoInit(const WriterInfo& info, int num_fields,
 			    const threading::Field* const * fields) override;
 	bool DoWrite(int num_fields, const threading::Field* const* fields,
 			     threading::Value** vals) override { return true; }
+	bool DoWriteBatch(const RecordBatch& batch) override { return true; }
 	bool DoSetBuf(bool enabled) override { return true; }
 	bool DoRotate(const char* rotated_path, double open,
 			      double close, bool terminating) override;
@@ -4,10 +4,12 @@
 #include "zeek/logging/writers/sqlite/SQLite.h"
 
 #include <errno.h>
+#include <cstdlib>
 #include <string>
 #include <vector>
 
 #include "zeek/threading/SerialTypes.h"
+#include "zeek/util.h"
 
 #include "logging/writers/sqlite/sqlite.bif.h"
 
@@ -19,8 +21,12 @@ namespace zeek::logging::writer::detail {
 
 SQLite::SQLite(WriterFrontend* frontend)
 	: WriterBackend(frontend),
-	  fields(), num_fields(), db(), st()
+	  fields(), num_fields(), db(), st(), begin_st(), commit_st(),
+	  batch_rows(), batch_start()
 	{
+	batch_size = BifConst::LogSQLite::batch_size;
+	batch_interval = BifConst::LogSQLite::batch_interval;
+
 	set_separator.assign(
 			(const char*) BifConst::LogSQLite::set_separator->Bytes(),
 			BifConst::LogSQLite::set_separator->Len()
@@ -45,6 +51,8 @@ SQLite::~SQLite()
 	if ( db != 0 )
 		{
 		sqlite3_finalize(st);
+		sqlite3_finalize(begin_st);
+		sqlite3_finalize(commit_st);
 		if ( ! sqlite3_close(db) )
 			Error("Sqlite could not close connection");
 
@@ -140,6 +148,16 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 	else
 		tablename = it->second;
 
+	it = info.config.find("batch_size");
+	if ( it != info.config.end() )
+		batch_size = strtoull(it->second, nullptr, 10);
+
+	string journal_mode(BifConst::LogSQLite::journal_mode->CheckString());
+
+	it = info.config.find("journal_mode");
+	if ( it != info.config.end() )
+		journal_mode = it->second;
+
 	if ( checkError(sqlite3_open_v2(
 					fullpath.c_str(),
 					&db,
@@ -150,6 +168,19 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 					NULL)) )
 		return false;
 
+	if ( ! journal_mode.empty() )
+		{
+		string pragma = "PRAGMA journal_mode=" + journal_mode + ";";
+		char *errorMsg = 0;
+
+		if ( sqlite3_exec(db, pragma.c_str(), NULL, NULL, &errorMsg) != SQLITE_OK )
+			{
+			Error(Fmt("Error setting journal mode %s: %s", journal_mode.c_str(), errorMsg));
+			sqlite3_free(errorMsg);
+			return false;
+			}
+		}
+
 	string create = "CREATE TABLE IF NOT EXISTS " + tablename + " (\n";
 		//"id SERIAL UNIQUE NOT NULL"; // SQLite has rowids, we do not need a counter here.
 
@@ -233,6 +264,10 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 	if ( checkError(sqlite3_prepare_v2(db, insert.c_str(), insert.size()+1, &st, NULL)) )
 		return false;
 
+	if ( checkError(sqlite3_prepare_v2(db, "BEGIN;", -1, &begin_st, NULL)) ||
+	     checkError(sqlite3_prepare_v2(db, "COMMIT;", -1, &commit_st, NULL)) )
+		return false;
+
 	return true;
 	}
 
@@ -334,6 +369,14 @@ int SQLite::AddParams(Value* val, int pos)
 
 bool SQLite::DoWrite(int num_fields, const Field* const * fields, Value** vals)
 	{
+	if ( batch_size > 0 && batch_rows == 0 )
+		{
+		if ( ! Exec(begin_st) )
+			return false;
+
+		batch_start = util::current_time();
+		}
+
 	// bind parameters
 	for ( int i = 0; i < num_fields; i++ )
 		{
@@ -352,11 +395,41 @@ bool SQLite::DoWrite(int num_fields, const Field* const * fields, Value** vals)
 	if ( checkError(sqlite3_reset(st)) )
 		return false;
 
+	if ( batch_size > 0 && ++batch_rows >= batch_size )
+		return Commit();
+
+	return true;
+	}
+
+bool SQLite::Exec(sqlite3_stmt* stmt)
+	{
+	int rc = sqlite3_step(stmt);
+	sqlite3_reset(stmt);
+	return ! checkError(rc);
+	}
+
+bool SQLite::Commit()
+	{
+	if ( batch_rows == 0 )
+		return true;
+
+	batch_rows = 0;
+	return Exec(commit_st);
+	}
+
+bool SQLite::DoHeartbeat(double network_time, double current_time)
+	{
+	if ( batch_rows > 0 && current_time - batch_start >= batch_interval )
+		return Commit();
+
 	return true;
 	}
 
 bool SQLite::DoRotate(const char* rotated_path, double open, double close, bool terminating)
 	{
+	if ( ! Commit() )
+		return false;
+
 	if ( ! FinishedRotation("/dev/null", Info().path, open, close, terminating))
 		{
 		Error(Fmt("error rotating %s", Info().path));
@@ -29,13 +29,19 @@ protected:
 	bool DoSetBuf(bool enabled) override { return true; }
 	bool DoRotate(const char* rotated_path, double open,
 			      double close, bool terminating) override;
-	bool DoFlush(double network_time) override { return true; }
-	bool DoFinish(double network_time) override { return true; }
-	bool DoHeartbeat(double network_time, double current_time) override { return true; }
+	bool DoFlush(double network_time) override { return Commit(); }
+	bool DoFinish(double network_time) override { return Commit(); }
+	bool DoHeartbeat(double network_time, double current_time) override;
 
 private:
 	bool checkError(int code);
 
+	// Runs one of the prepared transaction statements.
+	bool Exec(sqlite3_stmt* stmt);
+
+	// Commits the open transaction, if any.
+	bool Commit();
+
 	int AddParams(threading::Value* val, int pos);
 	std::string GetTableType(int, int);
 
@@ -44,6 +50,16 @@ private:
 
 	sqlite3 *db;
 	sqlite3_stmt *st;
+	sqlite3_stmt *begin_st;
+	sqlite3_stmt *commit_st;
+
+	// Writes get grouped into transactions of up to batch_size rows,
+	// which stay open for at most batch_interval. If batch_size is 0,
+	// each row commits by itself.
+	uint64_t batch_size;
+	double batch_interval;
+	uint64_t batch_rows;
+	double batch_start;
 
 	std::string set_separator;
 	std::string unset_field;
@@ -124,4 +124,9 @@ void Analyzer::Weird(const char* name, Packet* packet, const char* addl) const
 	sessions->Weird(name, packet, addl, GetAnalyzerName());
 	}
 
+void Analyzer::Weird(const zeek::detail::WeirdName& name, Packet* packet, const char* addl) const
+	{
+	sessions->Weird(name, packet, addl, GetAnalyzerName());
+	}
+
 } // namespace zeek::packet_analysis
@@ -5,6 +5,8 @@
 #include "zeek/packet_analysis/Tag.h"
 #include "zeek/iosource/Packet.h"
 
+namespace zeek::detail { class WeirdName; }
+
 namespace zeek::packet_analysis {
 
 /**
@@ -159,6 +161,8 @@ protected:
 	 * it before output.
 	 */
 	void Weird(const char* name, Packet* packet=nullptr, const char* addl="") const;
+	void Weird(const zeek::detail::WeirdName& name, Packet* packet=nullptr,
+	           const char* addl="") const;
 
 private:
 	Tag tag;
@@ -9,6 +9,9 @@
 #include "zeek/Sessions.h"
 #include "zeek/RunState.h"
 #include "zeek/iosource/PktDumper.h"
+#include "zeek/Anon.h"
+#include "zeek/IP.h"
+#include "zeek/NetVar.h"
 
 using namespace zeek::packet_analysis;
 
@@ -54,6 +57,93 @@ void Manager::Done()
 	{
 	}
 
+void Manager::SetupFastPath()
+	{
+	fast_path_ip = nullptr;
+
+	if ( ! id::find_val("PacketAnalyzer::fast_path")->AsBool() )
+		return;
+
+	auto eth = GetAnalyzer("Ethernet");
+	auto vlan = GetAnalyzer("VLAN");
+	auto ip = GetAnalyzer("IP");
+
+	if ( ! root_analyzer || ! eth || ! ip || root_analyzer->Lookup(DLT_EN10MB) != eth )
+		return;
+
+	if ( eth->Lookup(0x0800) != ip || eth->Lookup(0x86DD) != ip )
+		return;
+
+	fast_path_outer_vlans = fast_path_inner_vlans = 0;
+	fast_path_vlan_ip = false;
+
+	if ( vlan )
+		{
+		for ( uint32_t tpid : {0x8100, 0x88A8, 0x9100} )
+			{
+			if ( eth->Lookup(tpid) == vlan )
+				fast_path_outer_vlans |= VLANBit(tpid);
+
+			if ( vlan->Lookup(tpid) == vlan )
+				fast_path_inner_vlans |= VLANBit(tpid);
+			}
+
+		fast_path_vlan_ip = vlan->Lookup(0x0800) == ip && vlan->Lookup(0x86DD) == ip;
+		}
+
+	fast_path_ip = ip;
+	DBG_LOG(DBG_PACKET_ANALYSIS, "Fast path enabled for Ethernet%s/IP",
+	        fast_path_vlan_ip ? "[/VLAN[/VLAN]]" : "");
+	}
+
+bool Manager::ProcessFastPath(Packet* packet)
+	{
+	// Mirrors what the Ethernet and VLAN analyzers do for these frames.
+	// Anything they'd treat in any other way, including all that's
+	// truncated, goes the regular way.
+	const uint8_t* data = packet->data;
+	size_t len = packet->cap_len;
+
+	if ( len <= 16 )
+		return false;
+
+	uint32_t eth_type = (data[12] << 8) + data[13];
+	uint32_t vlan = packet->vlan;
+	uint32_t inner_vlan = packet->inner_vlan;
+	const uint8_t* l3 = data + 14;
+	size_t l3_len = len - 14;
+
+	if ( eth_type != 0x0800 && eth_type != 0x86DD )
+		{
+		if ( ! fast_path_vlan_ip || ! (VLANBit(eth_type) & fast_path_outer_vlans) )
+			return false;
+
+		for ( int tags = 0; eth_type != 0x0800 && eth_type != 0x86DD; ++tags )
+			{
+			if ( tags == 2 || l3_len <= 4 )
+				return false;
+
+			if ( tags == 1 && ! (VLANBit(eth_type) & fast_path_inner_vlans) )
+				return false;
+
+			auto& vlan_ref = vlan != 0 ? inner_vlan : vlan;
+			vlan_ref = ((l3[0] << 8u) + l3[1]) & 0xfff;
+			eth_type = (l3[2] << 8u) + l3[3];
+			l3 += 4;
+			l3_len -= 4;
+			}
+		}
+
+	packet->l2_dst = data;
+	packet->l2_src = data + 6;
+	packet->eth_type = eth_type;
+	packet->vlan = vlan;
+	packet->inner_vlan = inner_vlan;
+
+	fast_path_ip->AnalyzePacket(l3_len, l3, packet);
+	return true;
+	}
+
 void Manager::DumpDebug()
 	{
 #ifdef DEBUG
@@ -99,21 +189,24 @@ void Manager::ProcessPacket(Packet* packet)
 	++num_packets_processed;
 
 	bool dumped_packet = false;
-	if ( packet->dump_packet || zeek::detail::record_all_packets )
+	// Anonymizing needs the IP header that the analysis locates.
+	if ( (packet->dump_packet || zeek::detail::record_all_packets) &&
+	     ! zeek::detail::anonymize_dumped_packets )
 		{
 		DumpPacket(packet);
 		dumped_packet = true;
 		}
 
 	// Start packet analysis
-	root_analyzer->ForwardPacket(packet->cap_len, packet->data,
-	                             packet, packet->link_type);
+	if ( ! fast_path_ip || packet->link_type != DLT_EN10MB || ! ProcessFastPath(packet) )
+		root_analyzer->ForwardPacket(packet->cap_len, packet->data,
+		                             packet, packet->link_type);
 
 	if ( raw_packet )
 		event_mgr.Enqueue(raw_packet, packet->ToRawPktHdrVal());
 
 	// Check whether packet should be recorded based on session analysis
-	if ( packet->dump_packet && ! dumped_packet )
+	if ( (packet->dump_packet || zeek::detail::record_all_packets) && ! dumped_packet )
 		DumpPacket(packet);
 	}
 
@@ -174,6 +267,32 @@ void Manager::DumpPacket(const Packet *pkt, int len)
 			const_cast<Packet *>(pkt)->cap_len = len;
 		}
 
+	if ( zeek::detail::anonymize_dumped_packets )
+		{
+		const u_char* ip = nullptr;
+
+		if ( pkt->ip_hdr && ! pkt->ip_hdr->reassembled )
+			ip = pkt->ip_hdr->IP4_Hdr() ? reinterpret_cast<const u_char*>(pkt->ip_hdr->IP4_Hdr())
+			                            : reinterpret_cast<const u_char*>(pkt->ip_hdr->IP6_Hdr());
+
+		// Packets without an IP header within their data don't get
+		// written, as they couldn't be anonymized.
+		if ( ! ip || ip < pkt->data || ip >= pkt->data + pkt->cap_len )
+			return;
+
+		std::vector<u_char> buf(pkt->data, pkt->data + pkt->cap_len);
+		uint32_t offset = ip - pkt->data;
+
+		if ( ! zeek::detail::anonymize_packet_addrs(buf.data() + offset, pkt->cap_len - offset) )
+			return;
+
+		pkt_timeval ts = pkt->ts;
+		Packet anon;
+		anon.Init(pkt->link_type, &ts, pkt->cap_len, pkt->len, buf.data(), false, "");
+		run_state::detail::pkt_dumper->Dump(&anon);
+		return;
+		}
+
 	run_state::detail::pkt_dumper->Dump(pkt);
 	}
 
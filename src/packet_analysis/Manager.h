@@ -46,6 +46,13 @@ public:
 	 */
 	void DumpDebug(); // Called after zeek_init() events.
 
+	/**
+	 * Enables the shortcut for common encapsulations, if the analyzers'
+	 * configuration permits it.  Called after zeek_init() events, once
+	 * the analyzers' mappings are final.
+	 */
+	void SetupFastPath();
+
 	/**
 	 * Looks up an analyzer instance.
 	 *
@@ -134,9 +141,32 @@ private:
 
 	bool PermitUnknownProtocol(const std::string& analyzer, uint32_t protocol);
 
+	bool ProcessFastPath(Packet* packet);
+
+	// Returns the bit for one of the TPIDs the fast path understands, or
+	// 0 for any other EtherType.
+	static uint8_t VLANBit(uint32_t eth_type)
+		{
+		switch ( eth_type ) {
+		case 0x8100: return 1;
+		case 0x88A8: return 2;
+		case 0x9100: return 4;
+		default: return 0;
+		}
+		}
+
 	std::map<std::string, AnalyzerPtr> analyzers;
 	AnalyzerPtr root_analyzer = nullptr;
 
+	// The IP analyzer, if the fast path is active.
+	AnalyzerPtr fast_path_ip = nullptr;
+	// The TPIDs that Ethernet, and VLAN respectively, hand to the VLAN
+	// analyzer, as VLANBit()s.
+	uint8_t fast_path_outer_vlans = 0;
+	uint8_t fast_path_inner_vlans = 0;
+	// Whether VLAN hands IP to the IP analyzer.
+	bool fast_path_vlan_ip = false;
+
 	uint64_t num_packets_processed = 0;
 	detail::PacketProfiler* pkt_profiler = nullptr;
 
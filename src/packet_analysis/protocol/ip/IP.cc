@@ -8,6 +8,7 @@
 #include "zeek/Sessions.h"
 #include "zeek/RunState.h"
 #include "zeek/Frag.h"
+#include "zeek/ParallelReplay.h"
 #include "zeek/Event.h"
 #include "zeek/TunnelEncapsulation.h"
 
@@ -39,6 +40,11 @@ bool IPAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* packet)
 		return false;
 		}
 
+	// Drop shunted flows before doing any work on them.
+	detail::FlowShunt* flow_shunt = sessions->GetFlowShunt(false);
+	if ( flow_shunt && flow_shunt->Match(data, len) )
+		return true;
+
 	int32_t hdr_size = static_cast<int32_t>(data - packet->data);
 
 	// Cast the current data pointer to an IP header pointer so we can use it to get some
@@ -156,6 +162,11 @@ bool IPAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* packet)
 			{
 			f = detail::fragment_mgr->NextFragment(run_state::processing_start_time, packet->ip_hdr,
 			                                       packet->data + hdr_size);
+
+			if ( ! f )
+				// Dropped due to the fragment reassembly limits.
+				return true;
+
 			std::unique_ptr<IP_Hdr> ih = f->ReassembledPkt();
 
 			if ( ! ih )
@@ -182,6 +193,13 @@ bool IPAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* packet)
 
 	detail::FragReassemblerTracker frt(f);
 
+	// With --parallel, analyze only this process's flows, as determined by
+	// the outermost IP header so that tunnels stay in one process.
+	if ( zeek::detail::num_shards > 1 && ! (packet->encap && packet->encap->Depth() > 0) &&
+	     zeek::detail::flow_shard(packet->ip_hdr.get(), packet->ip_hdr->Payload(),
+	                              len - ip_hdr_len) != zeek::detail::shard_index )
+		return true;
+
 	// We stop building the chain when seeing IPPROTO_ESP so if it's
 	// there, it's always the last.
 	if ( packet->ip_hdr->LastHeader() == IPPROTO_ESP )
@@ -262,8 +280,5 @@ bool IPAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* packet)
 		break;
 	}
 
-	if ( f )
-		f->DeleteTimer();
-
 	return return_val;
 	}
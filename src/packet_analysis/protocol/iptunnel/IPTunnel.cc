@@ -3,11 +3,13 @@
 #include "zeek/packet_analysis/protocol/iptunnel/IPTunnel.h"
 
 #include <pcap.h> // For DLT_ constants
+#include <algorithm>
 
 #include "zeek/Sessions.h"
 #include "zeek/RunState.h"
 #include "zeek/IP.h"
 #include "zeek/TunnelEncapsulation.h"
+#include "zeek/Hash.h"
 
 namespace zeek::packet_analysis::IPTunnel {
 
@@ -80,35 +82,60 @@ bool IPTunnelAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* pa
 		{
 		EncapsulatingConn ec(packet->ip_hdr->SrcAddr(), packet->ip_hdr->DstAddr(),
 		                     tunnel_type);
-		ip_tunnels[tunnel_idx] = TunnelActivity(ec, run_state::network_time);
-		zeek::detail::timer_mgr->Add(new detail::IPTunnelTimer(run_state::network_time, tunnel_idx, this));
+		tunnel_it = ip_tunnels.emplace(tunnel_idx,
+		                               TunnelActivity{ec, run_state::network_time}).first;
+		ScheduleExpiration(tunnel_idx,
+		                   run_state::network_time + BifConst::Tunnel::ip_tunnel_timeout,
+		                   next_tick);
 		}
 	else
-		tunnel_it->second.second = zeek::run_state::network_time;
+		tunnel_it->second.last_active = zeek::run_state::network_time;
+
+	// The outer packets of a tunnel mostly share their encapsulation, so
+	// the inner packets can share theirs, too.
+	auto& activity = tunnel_it->second;
+
+	if ( ! activity.stack || activity.prev != packet->encap )
+		{
+		activity.prev = packet->encap;
+		activity.stack = Encapsulate(packet->encap, activity.ec);
+		}
 
 	if ( gre_version == 0 )
-		ProcessEncapsulatedPacket(run_state::processing_start_time, packet, len, len, data, gre_link_type,
-		                          packet->encap, ip_tunnels[tunnel_idx].first);
+		ForwardLinkPacket(packet, len, len, data, gre_link_type, activity.stack);
 	else
-		ProcessEncapsulatedPacket(run_state::processing_start_time, packet, inner, packet->encap,
-		                          ip_tunnels[tunnel_idx].first);
+		ForwardIPPacket(packet, inner, activity.stack);
 
 	return true;
 	}
 
+std::shared_ptr<EncapsulationStack> IPTunnelAnalyzer::Encapsulate(const std::shared_ptr<EncapsulationStack>& prev,
+                                                                  const EncapsulatingConn& ec)
+	{
+	auto rval = prev ? std::make_shared<EncapsulationStack>(*prev)
+	                 : std::make_shared<EncapsulationStack>();
+	rval->Add(ec);
+	return rval;
+	}
+
 /**
  * Handles a packet that contains an IP header directly after the tunnel header.
  */
 bool IPTunnelAnalyzer::ProcessEncapsulatedPacket(double t, const Packet* pkt,
                                                  const IP_Hdr* inner,
-                                                 std::shared_ptr<EncapsulationStack> prev,
+                                                 const std::shared_ptr<EncapsulationStack>& prev,
                                                  const EncapsulatingConn& ec)
 	{
+	return ForwardIPPacket(pkt, inner, Encapsulate(prev, ec));
+	}
+
+bool IPTunnelAnalyzer::ForwardIPPacket(const Packet* pkt, const IP_Hdr* inner,
+                                       std::shared_ptr<EncapsulationStack> encap)
+	{
 	uint32_t caplen, len;
 	caplen = len = inner->TotalLen();
 
 	pkt_timeval ts;
-	int link_type;
 
 	if ( pkt )
 		ts = pkt->ts;
@@ -126,14 +153,11 @@ bool IPTunnelAnalyzer::ProcessEncapsulatedPacket(double t, const Packet* pkt,
 	else
 		data = (const u_char*) inner->IP6_Hdr();
 
-	auto outer = prev ? prev : std::make_shared<EncapsulationStack>();
-	outer->Add(ec);
-
 	// Construct fake packet containing the inner packet so it can be processed
 	// like a normal one.
 	Packet p;
 	p.Init(DLT_RAW, &ts, caplen, len, data, false, "");
-	p.encap = outer;
+	p.encap = std::move(encap);
 
 	// Forward the packet back to the IP analyzer.
 	bool return_val = ForwardPacket(len, data, &p);
@@ -149,9 +173,16 @@ bool IPTunnelAnalyzer::ProcessEncapsulatedPacket(double t, const Packet* pkt,
 bool IPTunnelAnalyzer::ProcessEncapsulatedPacket(double t, const Packet* pkt,
                                                  uint32_t caplen, uint32_t len,
                                                  const u_char* data, int link_type,
-                                                 std::shared_ptr<EncapsulationStack> prev,
+                                                 const std::shared_ptr<EncapsulationStack>& prev,
                                                  const EncapsulatingConn& ec)
 	{
+	return ForwardLinkPacket(pkt, caplen, len, data, link_type, Encapsulate(prev, ec));
+	}
+
+bool IPTunnelAnalyzer::ForwardLinkPacket(const Packet* pkt, uint32_t caplen, uint32_t len,
+                                         const u_char* data, int link_type,
+                                         std::shared_ptr<EncapsulationStack> encap)
+	{
 	pkt_timeval ts;
 
 	if ( pkt )
@@ -163,14 +194,11 @@ bool IPTunnelAnalyzer::ProcessEncapsulatedPacket(double t, const Packet* pkt,
 		    ((run_state::network_time - (double)ts.tv_sec) * 1000000);
 		}
 
-	auto outer = prev ? prev : std::make_shared<EncapsulationStack>();
-	outer->Add(ec);
-
 	// Construct fake packet containing the inner packet so it can be processed
 	// like a normal one.
 	Packet p;
 	p.Init(link_type, &ts, caplen, len, data, false, "");
-	p.encap = outer;
+	p.encap = std::move(encap);
 
 	// Process the packet as if it was a brand new packet by passing it back
 	// to the packet manager.
@@ -179,33 +207,89 @@ bool IPTunnelAnalyzer::ProcessEncapsulatedPacket(double t, const Packet* pkt,
 	return return_val;
 	}
 
-namespace detail {
+size_t IPTunnelAnalyzer::IPPairHash::operator()(const IPPair& p) const
+	{
+	uint32_t key[8];
+	p.first.CopyIPv6(key);
+	p.second.CopyIPv6(key + 4);
+	return zeek::detail::KeyedHash::Hash64(key, sizeof(key), zeek::detail::HASH_TIER_FAST);
+	}
 
-IPTunnelTimer::IPTunnelTimer(double t, IPTunnelAnalyzer::IPPair p, IPTunnelAnalyzer* analyzer)
-	: Timer(t + BifConst::Tunnel::ip_tunnel_timeout,
-	        zeek::detail::TIMER_IP_TUNNEL_INACTIVITY),
-	  tunnel_idx(p), analyzer(analyzer)
+void IPTunnelAnalyzer::ScheduleExpiration(const IPPair& tunnel, double expiration,
+                                          int64_t min_tick)
 	{
+	if ( tick_length <= 0 )
+		{
+		tick_length = BifConst::Tunnel::ip_tunnel_timeout / WHEEL_SLOTS;
+
+		if ( tick_length <= 0 )
+			tick_length = 1.0;
+		}
+
+	auto tick = std::max(static_cast<int64_t>(expiration / tick_length), min_tick);
+	wheel[tick % WHEEL_SLOTS].push_back(tunnel);
+
+	if ( ! timer_pending )
+		{
+		// Start with the tick of the current time.
+		next_tick = static_cast<int64_t>(run_state::network_time / tick_length);
+		timer_pending = true;
+		zeek::detail::timer_mgr->Add(new detail::IPTunnelTimer((next_tick + 1) * tick_length, this));
+		}
 	}
 
-void IPTunnelTimer::Dispatch(double t, bool is_expire)
+void IPTunnelAnalyzer::ExpireTunnels(double t, bool is_expire)
 	{
-	IPTunnelAnalyzer::IPTunnelMap::const_iterator it =
-		analyzer->ip_tunnels.find(tunnel_idx);
+	// The timer that called us still counts as pending, so that moving
+	// tunnels on doesn't schedule another.
+	auto now_tick = static_cast<int64_t>(t / tick_length);
+
+	// One pass over all slots checks all tunnels, however late the timer
+	// fired.
+	auto tick = std::max(next_tick, now_tick - WHEEL_SLOTS + 1);
+
+	for ( ; tick <= now_tick; ++tick )
+		{
+		std::vector<IPPair> due;
+		due.swap(wheel[tick % WHEEL_SLOTS]);
+
+		for ( const auto& tunnel : due )
+			{
+			auto it = ip_tunnels.find(tunnel);
+
+			if ( it == ip_tunnels.end() )
+				continue;
+
+			double expiration = it->second.last_active + BifConst::Tunnel::ip_tunnel_timeout;
+
+			if ( expiration <= t )
+				// tunnel activity timed out, delete it from map
+				ip_tunnels.erase(it);
+			else if ( ! is_expire )
+				ScheduleExpiration(tunnel, expiration, now_tick + 1);
+			}
+		}
 
-	if ( it == analyzer->ip_tunnels.end() )
-		return;
+	next_tick = now_tick + 1;
+	timer_pending = false;
 
-	double last_active = it->second.second;
-	double inactive_time = t > last_active ? t - last_active : 0;
+	if ( ! is_expire && ! ip_tunnels.empty() )
+		{
+		timer_pending = true;
+		zeek::detail::timer_mgr->Add(new detail::IPTunnelTimer(next_tick * tick_length, this));
+		}
+	}
 
-	if ( inactive_time >= BifConst::Tunnel::ip_tunnel_timeout )
-		// tunnel activity timed out, delete it from map
-		analyzer->ip_tunnels.erase(tunnel_idx);
+namespace detail {
 
-	else if ( ! is_expire )
-		// tunnel activity didn't timeout, schedule another timer
-		zeek::detail::timer_mgr->Add(new IPTunnelTimer(t, tunnel_idx, analyzer));
+IPTunnelTimer::IPTunnelTimer(double t, IPTunnelAnalyzer* analyzer)
+	: Timer(t, zeek::detail::TIMER_IP_TUNNEL_INACTIVITY), analyzer(analyzer)
+	{
+	}
+
+void IPTunnelTimer::Dispatch(double t, bool is_expire)
+	{
+	analyzer->ExpireTunnels(t, is_expire);
 	}
 
 } // namespace detail
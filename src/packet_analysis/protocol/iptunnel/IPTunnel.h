@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include <unordered_map>
+#include <vector>
+
 #include "zeek/packet_analysis/Analyzer.h"
 #include "zeek/packet_analysis/Component.h"
 #include "zeek/IPAddr.h"
@@ -36,12 +39,13 @@ public:
 	 * @param inner Pointer to IP header wrapper of the inner packet, ownership
 	 *        of the pointer's memory is assumed by this function.
 	 * @param prev Any previous encapsulation stack of the caller, not including
-	 *        the most-recently found depth of encapsulation.
+	 *        the most-recently found depth of encapsulation. It remains
+	 *        unchanged.
 	 * @param ec The most-recently found depth of encapsulation.
 	 */
 	bool ProcessEncapsulatedPacket(double t, const Packet *pkt,
 	                               const IP_Hdr* inner,
-	                               std::shared_ptr<EncapsulationStack> prev,
+	                               const std::shared_ptr<EncapsulationStack>& prev,
 	                               const EncapsulatingConn& ec);
 
 	/**
@@ -57,37 +61,84 @@ public:
 	 * @param data The remaining packet data
 	 * @param link_type Layer 2 link type used for initializing inner packet
 	 * @param prev Any previous encapsulation stack of the caller, not
-	 *        including the most-recently found depth of encapsulation.
+	 *        including the most-recently found depth of encapsulation. It
+	 *        remains unchanged.
 	 * @param ec The most-recently found depth of encapsulation.
 	 */
 	bool ProcessEncapsulatedPacket(double t, const Packet* pkt,
 	                               uint32_t caplen, uint32_t len,
 	                               const u_char* data, int link_type,
-	                               std::shared_ptr<EncapsulationStack> prev,
+	                               const std::shared_ptr<EncapsulationStack>& prev,
 	                               const EncapsulatingConn& ec);
 
+	/**
+	 * Returns the given stack with the new innermost encapsulation added,
+	 * as a new stack.
+	 */
+	static std::shared_ptr<EncapsulationStack> Encapsulate(const std::shared_ptr<EncapsulationStack>& prev,
+	                                                       const EncapsulatingConn& ec);
+
+	/**
+	 * Same as the ProcessEncapsulatedPacket() methods, but with the
+	 * complete encapsulation of the inner packet given, for callers that
+	 * keep it around between packets.
+	 */
+	bool ForwardIPPacket(const Packet* pkt, const IP_Hdr* inner,
+	                     std::shared_ptr<EncapsulationStack> encap);
+	bool ForwardLinkPacket(const Packet* pkt, uint32_t caplen, uint32_t len,
+	                       const u_char* data, int link_type,
+	                       std::shared_ptr<EncapsulationStack> encap);
+
 protected:
 
 	friend class detail::IPTunnelTimer;
 
 	using IPPair = std::pair<IPAddr, IPAddr>;
-	using TunnelActivity = std::pair<EncapsulatingConn, double>;
-	using IPTunnelMap = std::map<IPPair, TunnelActivity>;
+
+	struct IPPairHash {
+		size_t operator()(const IPPair& p) const;
+	};
+
+	struct TunnelActivity {
+		EncapsulatingConn ec;
+		double last_active;
+
+		// The encapsulation of the tunnel's inner packets, which gets
+		// reused for as long as the outer packets have the same one.
+		std::shared_ptr<EncapsulationStack> prev;
+		std::shared_ptr<EncapsulationStack> stack;
+	};
+
+	using IPTunnelMap = std::unordered_map<IPPair, TunnelActivity, IPPairHash>;
 	IPTunnelMap ip_tunnels;
 
+	// Inactive tunnels get expired through a wheel of slots that each
+	// cover a tick of 1/WHEEL_SLOTS of the timeout.  A tunnel sits in
+	// the slot of the tick in which it would expire if idle from when
+	// it last got checked, and when that tick comes, gets removed or
+	// moved on according to its latest activity.
+	static constexpr int WHEEL_SLOTS = 64;
+
+	void ScheduleExpiration(const IPPair& tunnel, double expiration, int64_t min_tick);
+	void ExpireTunnels(double t, bool is_expire);
+
+	std::vector<IPPair> wheel[WHEEL_SLOTS];
+	double tick_length = 0;
+	int64_t next_tick = 0;	// The first tick not yet processed.
+	bool timer_pending = false;
 };
 
 namespace detail {
 
+// Fires at the wheel's ticks while there are tunnels.
 class IPTunnelTimer final : public zeek::detail::Timer {
 public:
-	IPTunnelTimer(double t, IPTunnelAnalyzer::IPPair p, IPTunnelAnalyzer* analyzer);
+	IPTunnelTimer(double t, IPTunnelAnalyzer* analyzer);
 	~IPTunnelTimer() override = default;
 
 	void Dispatch(double t, bool is_expire) override;
 
 protected:
-	IPTunnelAnalyzer::IPPair tunnel_idx;
 	IPTunnelAnalyzer* analyzer;
 };
 
@@ -7,6 +7,7 @@
 #include <dlfcn.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <algorithm>
 #include <optional>
 #include <sstream>
 #include <fstream>
@@ -569,13 +570,8 @@ std::list<std::pair<HookType, int> > Manager::HooksEnabledForPlugin(const Plugin
 	return enabled;
 	}
 
-void Manager::EnableHook(HookType hook, Plugin* plugin, int prio)
+void Manager::AddHook(hook_list* l, Plugin* plugin, int prio)
 	{
-	if ( ! hooks[hook] )
-		hooks[hook] = new hook_list;
-
-	hook_list* l = hooks[hook];
-
 	for ( hook_list::iterator i = l->begin(); i != l->end(); i++ )
 		{
 		// Already enabled for this plugin.
@@ -587,13 +583,8 @@ void Manager::EnableHook(HookType hook, Plugin* plugin, int prio)
 	l->sort(hook_cmp);
 	}
 
-void Manager::DisableHook(HookType hook, Plugin* plugin)
+bool Manager::RemoveHook(hook_list* l, Plugin* plugin)
 	{
-	hook_list* l = hooks[hook];
-
-	if ( ! l )
-		return;
-
 	for ( hook_list::iterator i = l->begin(); i != l->end(); i++ )
 		{
 		if ( (*i).second == plugin )
@@ -603,13 +594,99 @@ void Manager::DisableHook(HookType hook, Plugin* plugin)
 			}
 		}
 
-	if ( l->empty() )
+	return l->empty();
+	}
+
+const Manager::hook_list* Manager::MergeHooks(const hook_list* global, const hook_list* scoped,
+                                              hook_list* merged)
+	{
+	if ( ! scoped )
+		return global;
+
+	if ( ! global )
+		return scoped;
+
+	*merged = *global;
+
+	for ( const auto& h : *scoped )
+		{
+		auto same_plugin = [&h](const std::pair<int, Plugin*>& g)
+			{ return g.second == h.second; };
+
+		if ( std::none_of(global->begin(), global->end(), same_plugin) )
+			merged->push_back(h);
+		}
+
+	merged->sort(hook_cmp);
+	return merged;
+	}
+
+void Manager::EnableHook(HookType hook, Plugin* plugin, int prio)
+	{
+	if ( ! hooks[hook] )
+		hooks[hook] = new hook_list;
+
+	AddHook(hooks[hook], plugin, prio);
+	}
+
+void Manager::DisableHook(HookType hook, Plugin* plugin)
+	{
+	hook_list* l = hooks[hook];
+
+	if ( ! l )
+		return;
+
+	if ( RemoveHook(l, plugin) )
 		{
 		delete l;
 		hooks[hook] = nullptr;
 		}
 	}
 
+void Manager::EnableFunctionHook(Func* func, Plugin* plugin, int prio)
+	{
+	DBG_LOG(DBG_PLUGINS, "Plugin %s hooks calls of %s",
+	        plugin->Name().c_str(), func->Name());
+	AddHook(&func_hooks[func], plugin, prio);
+	func->SetPluginHooks(true);
+	}
+
+void Manager::DisableFunctionHook(Func* func, Plugin* plugin)
+	{
+	auto i = func_hooks.find(func);
+
+	if ( i == func_hooks.end() )
+		return;
+
+	if ( RemoveHook(&i->second, plugin) )
+		{
+		func_hooks.erase(i);
+		func->SetPluginHooks(false);
+		}
+	}
+
+void Manager::EnableEventHook(EventHandlerPtr handler, Plugin* plugin, int prio)
+	{
+	DBG_LOG(DBG_PLUGINS, "Plugin %s hooks event %s",
+	        plugin->Name().c_str(), handler->Name());
+	AddHook(&event_hooks[handler.Ptr()], plugin, prio);
+	handler->SetPluginHooks(true);
+	}
+
+void Manager::DisableEventHook(EventHandlerPtr handler, Plugin* plugin)
+	{
+	auto i = event_hooks.find(handler.Ptr());
+
+	if ( i == event_hooks.end() )
+		return;
+
+	if ( RemoveHook(&i->second, plugin) )
+		{
+		event_hooks.erase(i);
+		handler->SetPluginHooks(false);
+		}
+	}
+
 void Manager::RequestEvent(EventHandlerPtr handler, Plugin* plugin)
 	{
 	DBG_LOG(DBG_PLUGINS, "Plugin %s requested event %s",
@@ -675,13 +752,24 @@ Manager::HookCallFunction(const Func* func, zeek::detail::Frame* parent,
 		MetaHookPre(HOOK_CALL_FUNCTION, args);
 		}
 
-	hook_list* l = hooks[HOOK_CALL_FUNCTION];
+	hook_list merged;
+	const hook_list* scoped = nullptr;
+
+	if ( func->HasPluginHooks() )
+		{
+		auto i = func_hooks.find(func);
+
+		if ( i != func_hooks.end() )
+			scoped = &i->second;
+		}
+
+	const hook_list* l = MergeHooks(hooks[HOOK_CALL_FUNCTION], scoped, &merged);
 
 	std::pair<bool, ValPtr> rval{false, nullptr};
 
 	if ( l )
 		{
-		for ( hook_list::iterator i = l->begin(); i != l->end(); ++i )
+		for ( hook_list::const_iterator i = l->begin(); i != l->end(); ++i )
 			{
 			Plugin* p = (*i).second;
 
@@ -709,12 +797,24 @@ bool Manager::HookQueueEvent(Event* event) const
 		MetaHookPre(HOOK_QUEUE_EVENT, args);
 		}
 
-	hook_list* l = hooks[HOOK_QUEUE_EVENT];
+	hook_list merged;
+	const hook_list* scoped = nullptr;
+	auto handler = event->Handler();
+
+	if ( handler.Ptr() && handler->HasPluginHooks() )
+		{
+		auto i = event_hooks.find(handler.Ptr());
+
+		if ( i != event_hooks.end() )
+			scoped = &i->second;
+		}
+
+	const hook_list* l = MergeHooks(hooks[HOOK_QUEUE_EVENT], scoped, &merged);
 
 	bool result = false;
 
 	if ( l )
-		for ( hook_list::iterator i = l->begin(); i != l->end(); ++i )
+		for ( hook_list::const_iterator i = l->begin(); i != l->end(); ++i )
 			{
 			Plugin* p = (*i).second;
 
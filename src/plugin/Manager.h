@@ -5,6 +5,7 @@
 #include <map>
 #include <set>
 #include <string_view>
+#include <unordered_map>
 #include <utility>
 
 #include "zeek/plugin/Plugin.h"
@@ -12,6 +13,8 @@
 #include "zeek/Reporter.h"
 #include "zeek/ZeekArgs.h"
 
+ZEEK_FORWARD_DECLARE_NAMESPACED(EventHandler, zeek);
+
 namespace zeek {
 namespace plugin {
 
@@ -197,6 +200,40 @@ public:
 	 */
 	void DisableHook(HookType hook, Plugin* plugin);
 
+	/**
+	 * Enables \c HOOK_CALL_FUNCTION for a given plugin, but only for the
+	 * calls of one function.
+	 *
+	 * func: The function to hook.
+	 *
+	 * plugin: The plugin defining the hook.
+	 *
+	 * prio: The priority to associate with the plugin for this hook.
+	 */
+	void EnableFunctionHook(Func* func, Plugin* plugin, int prio);
+
+	/**
+	 * Disables a hook enabled through EnableFunctionHook().
+	 */
+	void DisableFunctionHook(Func* func, Plugin* plugin);
+
+	/**
+	 * Enables \c HOOK_QUEUE_EVENT for a given plugin, but only for one
+	 * event.
+	 *
+	 * handler: The event to hook.
+	 *
+	 * plugin: The plugin defining the hook.
+	 *
+	 * prio: The priority to associate with the plugin for this hook.
+	 */
+	void EnableEventHook(EventHandlerPtr handler, Plugin* plugin, int prio);
+
+	/**
+	 * Disables a hook enabled through EnableEventHook().
+	 */
+	void DisableEventHook(EventHandlerPtr handler, Plugin* plugin);
+
 	/**
 	 * Registers interest in an event by a plugin, even if there's no handler
 	 * for it. Normally a plugin receives events through HookQueueEvent()
@@ -439,6 +476,20 @@ private:
 	// of that type enabled.
 	hook_list** hooks;
 
+	// The hooks enabled for single functions and events only.  Those
+	// carry a flag, so that the others don't need a lookup.
+	std::unordered_map<const Func*, hook_list> func_hooks;
+	std::unordered_map<const EventHandler*, hook_list> event_hooks;
+
+	// Returns the hooks to run for a call or an event, given the global
+	// ones and the scoped ones, either of which may be null. If both
+	// exist, they get merged into *merged.
+	static const hook_list* MergeHooks(const hook_list* global, const hook_list* scoped,
+	                                   hook_list* merged);
+
+	static void AddHook(hook_list* l, Plugin* plugin, int prio);
+	static bool RemoveHook(hook_list* l, Plugin* plugin);
+
 	// A map of all the top-level plugin directories.
 	std::map<std::string, Plugin*> plugins_by_path;
 
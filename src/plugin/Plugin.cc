@@ -357,6 +357,26 @@ void Plugin::DisableHook(HookType hook)
 	plugin_mgr->DisableHook(hook, this);
 	}
 
+void Plugin::EnableFunctionHook(Func* func, int priority)
+	{
+	plugin_mgr->EnableFunctionHook(func, this, priority);
+	}
+
+void Plugin::DisableFunctionHook(Func* func)
+	{
+	plugin_mgr->DisableFunctionHook(func, this);
+	}
+
+void Plugin::EnableEventHook(EventHandlerPtr handler, int priority)
+	{
+	plugin_mgr->EnableEventHook(handler, this, priority);
+	}
+
+void Plugin::DisableEventHook(EventHandlerPtr handler)
+	{
+	plugin_mgr->DisableEventHook(handler, this);
+	}
+
 void Plugin::RequestEvent(EventHandlerPtr handler)
 	{
 	plugin_mgr->RequestEvent(handler, this);
@@ -601,6 +601,46 @@ protected:
 	 */
 	void DisableHook(HookType hook);
 
+	/**
+	 * Enables HookFunctionCall() for the calls of a single function.
+	 * Unlike enabling \c HOOK_CALL_FUNCTION, this leaves the calls of
+	 * all other functions without any hook overhead. A plugin usually
+	 * calls this from InitPostScript(), once the functions exist.
+	 *
+	 * @param func The function to hook. For events and hooks, this is
+	 * the function holding their bodies. It must remain valid while the
+	 * hook is enabled.
+	 *
+	 * @param priority The priority, as for EnableHook().
+	 */
+	void EnableFunctionHook(Func* func, int priority = 0);
+
+	/**
+	 * Disables HookFunctionCall() for the calls of a single function.
+	 *
+	 * @param func The function previously passed to EnableFunctionHook().
+	 */
+	void DisableFunctionHook(Func* func);
+
+	/**
+	 * Enables HookQueueEvent() for a single event. Unlike enabling \c
+	 * HOOK_QUEUE_EVENT, this leaves the queueing of all other events
+	 * without any hook overhead. Like RequestEvent(), this also makes
+	 * Bro raise the event if there's no handler for it.
+	 *
+	 * @param handler The event to hook.
+	 *
+	 * @param priority The priority, as for EnableHook().
+	 */
+	void EnableEventHook(EventHandlerPtr handler, int priority = 0);
+
+	/**
+	 * Disables HookQueueEvent() for a single event.
+	 *
+	 * @param handler The event previously passed to EnableEventHook().
+	 */
+	void DisableEventHook(EventHandlerPtr handler);
+
 	/**
 	 * Returns a list of hooks that are currently enabled for the plugin,
 	 * along with their priorities.
@@ -1,8 +1,10 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
+#include "zeek-config.h"
 #include "zeek/probabilistic/BitVector.h"
 
 #include <cassert>
+#include <cstring>
 #include <limits>
 #include <openssl/sha.h>
 #include <broker/data.hh>
@@ -505,13 +507,22 @@ uint64_t BitVector::Hash() const
 
 broker::expected<broker::data> BitVector::Serialize() const
 	{
-	broker::vector v = {static_cast<uint64_t>(num_bits), static_cast<uint64_t>(bits.size())};
-	v.reserve(2 + bits.size());
+	static_assert(sizeof(block_type) == 8, "packed blocks assume 64-bit words");
 
-	for ( size_t i = 0; i < bits.size(); ++i )
-		v.emplace_back(static_cast<uint64_t>(bits[i]));
+	std::string packed(1 + bits.size() * sizeof(block_type), '\0');
+	packed[0] = PACKED_BLOCKS;
+	auto p = &packed[1];
+
+#ifdef WORDS_BIGENDIAN
+	for ( auto b : bits )
+		for ( size_t i = 0; i < sizeof(block_type); ++i )
+			*p++ = static_cast<char>(b >> (8 * i));
+#else
+	if ( ! bits.empty() )
+		memcpy(p, bits.data(), bits.size() * sizeof(block_type));
+#endif
 
-	return {std::move(v)};
+	return {broker::vector{static_cast<uint64_t>(num_bits), std::move(packed)}};
 	}
 
 std::unique_ptr<BitVector> BitVector::Unserialize(const broker::data& data)
@@ -521,9 +532,42 @@ std::unique_ptr<BitVector> BitVector::Unserialize(const broker::data& data)
 		return nullptr;
 
 	auto num_bits = caf::get_if<uint64_t>(&(*v)[0]);
+
+	if ( ! num_bits )
+		return nullptr;
+
+	if ( auto packed = caf::get_if<std::string>(&(*v)[1]) )
+		{
+		auto n = bits_to_blocks(*num_bits);
+
+		if ( v->size() != 2 || packed->size() != 1 + n * sizeof(block_type) ||
+		     static_cast<uint8_t>((*packed)[0]) != PACKED_BLOCKS )
+			return nullptr;
+
+		auto bv = std::unique_ptr<BitVector>(new BitVector());
+		bv->num_bits = *num_bits;
+		bv->bits.resize(n);
+		auto p = reinterpret_cast<const uint8_t*>(packed->data() + 1);
+
+#ifdef WORDS_BIGENDIAN
+		for ( auto& b : bv->bits )
+			{
+			b = 0;
+
+			for ( size_t i = 0; i < sizeof(block_type); ++i )
+				b |= static_cast<block_type>(*p++) << (8 * i);
+			}
+#else
+		if ( n )
+			memcpy(bv->bits.data(), p, n * sizeof(block_type));
+#endif
+
+		return bv;
+		}
+
 	auto size = caf::get_if<uint64_t>(&(*v)[1]);
 
-	if ( ! (num_bits && size) )
+	if ( ! size )
 		return nullptr;
 
 	if ( v->size() != 2 + *size )
@@ -285,7 +285,17 @@ public:
 	  */
 	uint64_t Hash() const;
 
+	/**
+	 * Serializes the bits as their number plus a string that packs the
+	 * blocks as little-endian words behind a format tag, so that they
+	 * travel as a single blob rather than one value per block.
+	 */
 	broker::expected<broker::data> Serialize() const;
+
+	/**
+	 * Unserializes both the packed form and the older one, which had a
+	 * separate value for every block.
+	 */
 	static std::unique_ptr<BitVector> Unserialize(const broker::data& data);
 
 private:
@@ -352,6 +362,9 @@ private:
 	 */
 	static size_type lowest_bit(block_type block);
 
+	// Tag of the first byte of the packed blocks.
+	static constexpr uint8_t PACKED_BLOCKS = 1;
+
 	std::vector<block_type> bits;
 	size_type num_bits;
 };
@@ -2,6 +2,7 @@
 
 #include "zeek/probabilistic/BloomFilter.h"
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
 
@@ -9,6 +10,8 @@
 #include <broker/error.hh>
 
 #include "zeek/probabilistic/CounterVector.h"
+#include "zeek/Hash.h"
+#include "zeek/digest.h"
 #include "zeek/util.h"
 #include "zeek/Reporter.h"
 
@@ -29,6 +32,16 @@ BloomFilter::~BloomFilter()
 	delete hasher;
 	}
 
+void BloomFilter::Add(const zeek::detail::HashKey* key)
+	{
+	Add(key->Key(), key->Size());
+	}
+
+size_t BloomFilter::Count(const zeek::detail::HashKey* key) const
+	{
+	return Count(key->Key(), key->Size());
+	}
+
 broker::expected<broker::data> BloomFilter::Serialize() const
 	{
 	auto h = hasher->Serialize();
@@ -69,12 +82,26 @@ std::unique_ptr<BloomFilter> BloomFilter::Unserialize(const broker::data& data)
 	case Counting:
 		bf = std::unique_ptr<BloomFilter>(new CountingBloomFilter());
 		break;
+
+	case Blocked:
+		bf = std::unique_ptr<BloomFilter>(new BlockedBloomFilter());
+		break;
 	}
 
+	// The type doubles as the version of the filter's format, so types
+	// that this version doesn't know about, such as new ones from a
+	// newer peer, get rejected here.
+	if ( ! bf )
+		return nullptr;
+
 	if ( ! bf->DoUnserialize((*v)[2]) )
 		return nullptr;
 
 	bf->hasher = hasher_.release();
+
+	if ( *type == Blocked )
+		static_cast<BlockedBloomFilter*>(bf.get())->Init();
+
 	return bf;
 	}
 
@@ -155,17 +182,17 @@ BasicBloomFilter::~BasicBloomFilter()
 	delete bits;
 	}
 
-void BasicBloomFilter::Add(const zeek::detail::HashKey* key)
+void BasicBloomFilter::Add(const void* key, size_t size)
 	{
-	detail::Hasher::digest_vector h = hasher->Hash(key);
+	detail::Hasher::digest_vector h = hasher->Hash(key, size);
 
 	for ( size_t i = 0; i < h.size(); ++i )
 		bits->Set(h[i] % bits->Size());
 	}
 
-size_t BasicBloomFilter::Count(const zeek::detail::HashKey* key) const
+size_t BasicBloomFilter::Count(const void* key, size_t size) const
 	{
-	detail::Hasher::digest_vector h = hasher->Hash(key);
+	detail::Hasher::digest_vector h = hasher->Hash(key, size);
 
 	for ( size_t i = 0; i < h.size(); ++i )
 		{
@@ -259,17 +286,17 @@ std::string CountingBloomFilter::InternalState() const
 	}
 
 // TODO: Use partitioning in add/count to allow for reusing CMS bounds.
-void CountingBloomFilter::Add(const zeek::detail::HashKey* key)
+void CountingBloomFilter::Add(const void* key, size_t size)
 	{
-	detail::Hasher::digest_vector h = hasher->Hash(key);
+	detail::Hasher::digest_vector h = hasher->Hash(key, size);
 
 	for ( size_t i = 0; i < h.size(); ++i )
 		cells->Increment(h[i] % cells->Size());
 	}
 
-size_t CountingBloomFilter::Count(const zeek::detail::HashKey* key) const
+size_t CountingBloomFilter::Count(const void* key, size_t size) const
 	{
-	detail::Hasher::digest_vector h = hasher->Hash(key);
+	detail::Hasher::digest_vector h = hasher->Hash(key, size);
 
 	detail::CounterVector::size_type min =
 		std::numeric_limits<detail::CounterVector::size_type>::max();
@@ -300,4 +327,172 @@ bool CountingBloomFilter::DoUnserialize(const broker::data& data)
 	return true;
 	}
 
+BlockedBloomFilter::BlockedBloomFilter()
+	{
+	}
+
+BlockedBloomFilter::BlockedBloomFilter(const detail::Hasher* hasher, size_t cells)
+	: BloomFilter(hasher)
+	{
+	size_t n = (cells + BLOCK_BITS - 1) / BLOCK_BITS;
+	blocks.resize(n > 0 ? n : 1);
+	Clear();
+	Init();
+	}
+
+void BlockedBloomFilter::Init()
+	{
+	uhf = detail::UHF(hasher->Seed());
+	k = std::min(std::max(hasher->K(), size_t(1)), MAX_K);
+	}
+
+bool BlockedBloomFilter::Empty() const
+	{
+	for ( const auto& b : blocks )
+		for ( auto w : b.words )
+			if ( w )
+				return false;
+
+	return true;
+	}
+
+void BlockedBloomFilter::Clear()
+	{
+	for ( auto& b : blocks )
+		for ( auto& w : b.words )
+			w = 0;
+	}
+
+bool BlockedBloomFilter::Merge(const BloomFilter* other)
+	{
+	if ( typeid(*this) != typeid(*other) )
+		return false;
+
+	const BlockedBloomFilter* o = static_cast<const BlockedBloomFilter*>(other);
+
+	if ( ! hasher->Equals(o->hasher) )
+		{
+		reporter->Error("incompatible hashers in BlockedBloomFilter merge");
+		return false;
+		}
+
+	else if ( blocks.size() != o->blocks.size() )
+		{
+		reporter->Error("different number of blocks in BlockedBloomFilter merge");
+		return false;
+		}
+
+	for ( size_t i = 0; i < blocks.size(); ++i )
+		for ( size_t j = 0; j < BLOCK_WORDS; ++j )
+			blocks[i].words[j] |= o->blocks[i].words[j];
+
+	return true;
+	}
+
+BlockedBloomFilter* BlockedBloomFilter::Clone() const
+	{
+	BlockedBloomFilter* copy = new BlockedBloomFilter();
+
+	copy->hasher = hasher->Clone();
+	copy->blocks = blocks;
+	copy->Init();
+
+	return copy;
+	}
+
+std::string BlockedBloomFilter::InternalState() const
+	{
+	u_char buf[SHA256_DIGEST_LENGTH];
+	uint64_t digest;
+	EVP_MD_CTX* ctx = zeek::detail::hash_init(zeek::detail::Hash_SHA256);
+
+	for ( const auto& b : blocks )
+		zeek::detail::hash_update(ctx, b.words, sizeof(b.words));
+
+	zeek::detail::hash_final(ctx, buf);
+	memcpy(&digest, buf, sizeof(digest));
+	return util::fmt("%" PRIu64, digest);
+	}
+
+size_t BlockedBloomFilter::Probe(const void* key, size_t size, uint64_t* mask) const
+	{
+	detail::Hasher::digest d = uhf(key, size);
+
+	// The upper half of the digest picks the block, via a multiply
+	// rather than a modulo.  The lower half yields the bits within the
+	// block through double hashing, stepping by its rotation, made odd
+	// so that the k positions differ.
+	size_t block = ((d >> 32) * blocks.size()) >> 32;
+	uint32_t h1 = d;
+	uint32_t h2 = ((h1 >> 16) | (h1 << 16)) | 1;
+
+	for ( size_t i = 0; i < BLOCK_WORDS; ++i )
+		mask[i] = 0;
+
+	for ( size_t i = 0; i < k; ++i )
+		{
+		uint32_t bit = (h1 + i * h2) % BLOCK_BITS;
+		mask[bit / 64] |= uint64_t(1) << (bit % 64);
+		}
+
+	return block;
+	}
+
+void BlockedBloomFilter::Add(const void* key, size_t size)
+	{
+	uint64_t mask[BLOCK_WORDS];
+	Block& b = blocks[Probe(key, size, mask)];
+
+	for ( size_t i = 0; i < BLOCK_WORDS; ++i )
+		b.words[i] |= mask[i];
+	}
+
+size_t BlockedBloomFilter::Count(const void* key, size_t size) const
+	{
+	uint64_t mask[BLOCK_WORDS];
+	const Block& b = blocks[Probe(key, size, mask)];
+
+	// Tests all bits at once without branching, which compilers turn
+	// into a few vector instructions on the aligned block.
+	uint64_t missing = 0;
+
+	for ( size_t i = 0; i < BLOCK_WORDS; ++i )
+		missing |= mask[i] & ~b.words[i];
+
+	return missing == 0 ? 1 : 0;
+	}
+
+broker::expected<broker::data> BlockedBloomFilter::DoSerialize() const
+	{
+	broker::vector v;
+	v.reserve(blocks.size() * BLOCK_WORDS);
+
+	for ( const auto& b : blocks )
+		for ( auto w : b.words )
+			v.emplace_back(static_cast<uint64_t>(w));
+
+	return {std::move(v)};
+	}
+
+bool BlockedBloomFilter::DoUnserialize(const broker::data& data)
+	{
+	auto v = caf::get_if<broker::vector>(&data);
+
+	if ( ! (v && ! v->empty() && v->size() % BLOCK_WORDS == 0) )
+		return false;
+
+	blocks.resize(v->size() / BLOCK_WORDS);
+
+	for ( size_t i = 0; i < v->size(); ++i )
+		{
+		auto w = caf::get_if<uint64_t>(&(*v)[i]);
+		if ( ! w )
+			return false;
+
+		blocks[i / BLOCK_WORDS].words[i % BLOCK_WORDS] = *w;
+		}
+
+	return true;
+	}
+
 } // namespace zeek::probabilistic
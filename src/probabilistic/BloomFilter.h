@@ -20,7 +20,7 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(CounterVector, zeek, probabilistic, detail);
 namespace zeek::probabilistic {
 
 /** Types of derived BloomFilter classes. */
-enum BloomFilterType { Basic, Counting };
+enum BloomFilterType { Basic, Counting, Blocked };
 
 /**
  * The abstract base class for Bloom filters.
@@ -37,7 +37,17 @@ public:
 	 *
 	 * @param key The key associated with the element to add.
 	 */
-	virtual void Add(const zeek::detail::HashKey* key) = 0;
+	void Add(const zeek::detail::HashKey* key);
+
+	/**
+	 * Adds an element to the Bloom filter, given the bytes of its key.
+	 * This saves building a HashKey when the caller has the key at hand.
+	 *
+	 * @param key The bytes of the key associated with the element to add.
+	 *
+	 * @param size The number of bytes in *key*.
+	 */
+	virtual void Add(const void* key, size_t size) = 0;
 
 	/**
 	 * Retrieves the associated count of a given value.
@@ -46,7 +56,19 @@ public:
 	 *
 	 * @return The counter associated with *key*.
 	 */
-	virtual size_t Count(const zeek::detail::HashKey* key) const = 0;
+	size_t Count(const zeek::detail::HashKey* key) const;
+
+	/**
+	 * Retrieves the associated count of a given value, given the bytes
+	 * of its key.
+	 *
+	 * @param key The bytes of the key associated with the element to check.
+	 *
+	 * @param size The number of bytes in *key*.
+	 *
+	 * @return The counter associated with *key*.
+	 */
+	virtual size_t Count(const void* key, size_t size) const = 0;
 
 	/**
 	 * Checks whether the Bloom filter is empty.
@@ -170,8 +192,8 @@ protected:
 	BasicBloomFilter();
 
 	// Overridden from BloomFilter.
-	void Add(const zeek::detail::HashKey* key) override;
-	size_t Count(const zeek::detail::HashKey* key) const override;
+	void Add(const void* key, size_t size) override;
+	size_t Count(const void* key, size_t size) const override;
 	broker::expected<broker::data> DoSerialize() const override;
 	bool DoUnserialize(const broker::data& data) override;
 	BloomFilterType Type() const override
@@ -219,8 +241,8 @@ protected:
 	CountingBloomFilter();
 
 	// Overridden from BloomFilter.
-	void Add(const zeek::detail::HashKey* key) override;
-	size_t Count(const zeek::detail::HashKey* key) const override;
+	void Add(const void* key, size_t size) override;
+	size_t Count(const void* key, size_t size) const override;
 	broker::expected<broker::data> DoSerialize() const override;
 	bool DoUnserialize(const broker::data& data) override;
 	BloomFilterType Type() const override
@@ -230,6 +252,75 @@ private:
 	detail::CounterVector* cells;
 };
 
+/**
+ * A blocked Bloom filter, which sets all bits of an element within a single
+ * 64-byte block, so that adding or looking up an element touches only one
+ * cache line.  For the same number of cells, its false-positive rate is
+ * slightly higher than that of a BasicBloomFilter.
+ */
+class BlockedBloomFilter : public BloomFilter {
+public:
+	/** The number of bits in a block. */
+	static constexpr size_t BLOCK_BITS = 512;
+
+	/** The largest number of bits that an element can set. */
+	static constexpr size_t MAX_K = 16;
+
+	/**
+	 * Constructs a blocked Bloom filter.
+	 *
+	 * @param hasher The hasher to use. Its *K* determines the number of
+	 * bits that an element sets, which gets capped at MAX_K. Only its
+	 * seed matters otherwise, since the filter derives all bits from a
+	 * single hash of the key.
+	 *
+	 * @param cells The number of cells, which gets rounded up to a
+	 * multiple of BLOCK_BITS.
+	 */
+	BlockedBloomFilter(const detail::Hasher* hasher, size_t cells);
+
+	// Overridden from BloomFilter.
+	bool Empty() const override;
+	void Clear() override;
+	bool Merge(const BloomFilter* other) override;
+	BlockedBloomFilter* Clone() const override;
+	std::string InternalState() const override;
+
+protected:
+	friend class BloomFilter;
+
+	/**
+	 * Default constructor.
+	 */
+	BlockedBloomFilter();
+
+	// Overridden from BloomFilter.
+	void Add(const void* key, size_t size) override;
+	size_t Count(const void* key, size_t size) const override;
+	broker::expected<broker::data> DoSerialize() const override;
+	bool DoUnserialize(const broker::data& data) override;
+	BloomFilterType Type() const override
+		{ return BloomFilterType::Blocked; }
+
+private:
+	static constexpr size_t BLOCK_WORDS = BLOCK_BITS / 64;
+
+	struct alignas(64) Block {
+		uint64_t words[BLOCK_WORDS];
+	};
+
+	// Sets up the hash function after the hasher is known.
+	void Init();
+
+	// Returns the block for a key's digest and fills mask with the bits
+	// that the key sets within it.
+	size_t Probe(const void* key, size_t size, uint64_t* mask) const;
+
+	std::vector<Block> blocks;
+	detail::UHF uhf;
+	size_t k = 0;
+};
+
 } // namespace zeek::probabilistic
 
 namespace probabilistic {
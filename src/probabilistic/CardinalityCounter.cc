@@ -4,6 +4,8 @@
 
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
+#include <algorithm>
 #include <utility>
 
 #include <broker/data.hh>
@@ -58,17 +60,15 @@ void CardinalityCounter::Init(uint64_t size)
 
 	p = calc_p;
 
-	buckets.reserve(m);
-	for ( uint64_t i = 0; i < m; i++ )
-		buckets.push_back(0);
-
-	assert(buckets.size() == m);
+	// Start out sparse where the encoding allows.
+	if ( p > MAX_SPARSE_P )
+		buckets.assign(m, 0);
 
 	V = m;
 	}
 
 CardinalityCounter::CardinalityCounter(CardinalityCounter& other)
-	: buckets(other.buckets)
+	: buckets(other.buckets), sparse(other.sparse)
 	{
 	V = other.V;
 	alpha_m = other.alpha_m;
@@ -85,6 +85,7 @@ CardinalityCounter::CardinalityCounter(CardinalityCounter&& o) noexcept
 
 	o.m = 0;
 	buckets = std::move(o.buckets);
+	sparse = std::move(o.sparse);
 	}
 
 CardinalityCounter::CardinalityCounter(double error_margin, double confidence)
@@ -102,12 +103,8 @@ CardinalityCounter::CardinalityCounter(uint64_t size)
 
 CardinalityCounter::CardinalityCounter(uint64_t arg_size, uint64_t arg_V, double arg_alpha_m)
 	{
+	// Unserialize() fills in either form of the buckets.
 	m = arg_size;
-
-	buckets.reserve(m);
-	for ( uint64_t i = 0; i < m; i++ )
-		buckets.push_back(0);
-
 	alpha_m = arg_alpha_m;
 	V = arg_V;
 	p = log2(m);
@@ -131,15 +128,61 @@ void CardinalityCounter::AddElement(uint64_t hash)
 	uint64_t index = hash % m;
 	hash = hash-index;
 
+	uint8_t temp = Rank(hash);
+
+	if ( IsSparse() )
+		{
+		SparseUpdate(index, temp);
+		return;
+		}
+
 	if( buckets[index] == 0 )
 		V--;
 
-	uint8_t temp = Rank(hash);
-
 	if ( temp > buckets[index] )
 		buckets[index] = temp;
 	}
 
+void CardinalityCounter::SparseUpdate(uint64_t index, uint8_t rank)
+	{
+	uint32_t entry = (index << SPARSE_RANK_BITS) | rank;
+	auto it = std::lower_bound(sparse.begin(), sparse.end(),
+	                           static_cast<uint32_t>(index << SPARSE_RANK_BITS));
+
+	if ( it != sparse.end() && (*it >> SPARSE_RANK_BITS) == index )
+		{
+		if ( entry > *it )
+			*it = entry;
+
+		return;
+		}
+
+	// A new non-zero bucket.  Once the sparse form would take more
+	// space than the full array, switch to that.
+	V--;
+
+	if ( (sparse.size() + 1) * sizeof(uint32_t) > m )
+		{
+		Densify();
+		buckets[index] = rank;
+		return;
+		}
+
+	sparse.insert(it, entry);
+	}
+
+void CardinalityCounter::Densify()
+	{
+	const uint32_t rank_mask = (1 << SPARSE_RANK_BITS) - 1;
+
+	buckets.assign(m, 0);
+
+	for ( auto e : sparse )
+		buckets[e >> SPARSE_RANK_BITS] = e & rank_mask;
+
+	std::vector<uint32_t>().swap(sparse);
+	}
+
 /**
  * Estimate the size by using the the "raw" HyperLogLog estimate. Then,
  * check if it's too "large" or "small" because the raw estimate doesn't
@@ -152,15 +195,34 @@ void CardinalityCounter::AddElement(uint64_t hash)
 double CardinalityCounter::Size() const
 	{
 	double answer = 0;
-	for ( unsigned int i = 0; i < m; i++ )
-		answer += pow(2, -((int)buckets[i]));
+
+	if ( IsSparse() )
+		{
+		// All but the sparse buckets are 0.
+		const uint32_t rank_mask = (1 << SPARSE_RANK_BITS) - 1;
+		answer = V;
+
+		for ( auto e : sparse )
+			answer += pow(2, -((int)(e & rank_mask)));
+		}
+	else
+		{
+		for ( unsigned int i = 0; i < m; i++ )
+			answer += pow(2, -((int)buckets[i]));
+		}
 
 	answer = 1 / answer;
 	answer = (alpha_m * m * m * answer);
 
-	if ( answer <= 5.0 * (m/2) )
+	if ( answer <= 5.0 * (m/2) && V > 0 )
 		return m * log(((double)m) / V);
 
+	// Between here and 5m, the raw estimate is noticeably too large.
+	// HyperLogLog++ corrects it with empirical bias tables; the
+	// improved estimator needs none.
+	else if ( answer <= 5.0 * m )
+		return ImprovedEstimate();
+
 	else if ( answer <= (pow(2, 64) / 30) )
 		return answer;
 
@@ -168,24 +230,152 @@ double CardinalityCounter::Size() const
 		return -pow(2, 64) * log(1 - (answer / pow(2, 64)));
 	}
 
+// These two are sigma() and tau() from Ertl's paper.
+static double ertl_sigma(double x)
+	{
+	if ( x == 1.0 )
+		return INFINITY;
+
+	double y = 1;
+	double z = x;
+	double z_prev;
+
+	do {
+		x *= x;
+		z_prev = z;
+		z += x * y;
+		y += y;
+	} while ( z != z_prev );
+
+	return z;
+	}
+
+static double ertl_tau(double x)
+	{
+	if ( x == 0.0 || x == 1.0 )
+		return 0;
+
+	double y = 1;
+	double z = 1 - x;
+	double z_prev;
+
+	do {
+		x = sqrt(x);
+		z_prev = z;
+		y *= 0.5;
+		z -= (1 - x) * (1 - x) * y;
+	} while ( z != z_prev );
+
+	return z / 3;
+	}
+
+double CardinalityCounter::ImprovedEstimate() const
+	{
+	// Bucket values range from 0 to q + 1.
+	int q = 64 - p;
+	uint64_t histogram[66] = { 0 };
+
+	if ( IsSparse() )
+		{
+		const uint32_t rank_mask = (1 << SPARSE_RANK_BITS) - 1;
+		histogram[0] = V;
+
+		for ( auto e : sparse )
+			++histogram[e & rank_mask];
+		}
+	else
+		{
+		for ( auto b : buckets )
+			++histogram[b];
+		}
+
+	double z = m * ertl_tau(1 - (double)histogram[q + 1] / m);
+
+	for ( int k = q; k >= 1; --k )
+		z = 0.5 * (z + histogram[k]);
+
+	z += m * ertl_sigma((double)histogram[0] / m);
+
+	// The constant is the limit of alpha_m for large m.
+	return m / (2 * log(2)) * m / z;
+	}
+
 bool CardinalityCounter::Merge(CardinalityCounter* c)
 	{
 	if ( m != c->GetM() )
 		return false;
 
-	const std::vector<uint8_t>& temp = c->GetBuckets();
+	const uint32_t rank_mask = (1 << SPARSE_RANK_BITS) - 1;
 
-	V = 0;
+	if ( c->IsSparse() && IsSparse() )
+		{
+		// Union of the two sorted lists, keeping the larger value of
+		// buckets in both.
+		std::vector<uint32_t> merged;
+		merged.reserve(sparse.size() + c->sparse.size());
+
+		auto a = sparse.begin();
+		auto b = c->sparse.begin();
+
+		while ( a != sparse.end() || b != c->sparse.end() )
+			{
+			if ( b == c->sparse.end() ||
+			     (a != sparse.end() && (*a >> SPARSE_RANK_BITS) < (*b >> SPARSE_RANK_BITS)) )
+				merged.push_back(*a++);
+
+			else if ( a == sparse.end() || (*b >> SPARSE_RANK_BITS) < (*a >> SPARSE_RANK_BITS) )
+				merged.push_back(*b++);
+
+			else
+				{
+				merged.push_back(std::max(*a, *b));
+				++a;
+				++b;
+				}
+			}
+
+		sparse = std::move(merged);
+		V = m - sparse.size();
+
+		if ( sparse.size() * sizeof(uint32_t) > m )
+			Densify();
+
+		return true;
+		}
 
-	for ( size_t i = 0; i < m; i++ )
+	if ( c->IsSparse() )
 		{
-		if ( temp[i] > buckets[i] )
-			buckets[i] = temp[i];
+		for ( auto e : c->sparse )
+			{
+			uint8_t& bucket = buckets[e >> SPARSE_RANK_BITS];
+			uint8_t rank = e & rank_mask;
+
+			if ( bucket == 0 )
+				--V;
 
-		if ( buckets[i] == 0 )
-			++V;
+			if ( rank > bucket )
+				bucket = rank;
+			}
+
+		return true;
 		}
 
+	if ( IsSparse() )
+		Densify();
+
+	// Kept as two simple loops over the arrays, which compilers turn
+	// into vector max and compare instructions.
+	uint8_t* dst = buckets.data();
+	const uint8_t* src = c->GetBuckets().data();
+
+	for ( size_t i = 0; i < m; i++ )
+		dst[i] = std::max(dst[i], src[i]);
+
+	V = 0;
+
+	for ( size_t i = 0; i < m; i++ )
+		V += (dst[i] == 0);
+
 	return true;
 	}
 
@@ -201,13 +391,25 @@ uint64_t CardinalityCounter::GetM() const
 
 broker::expected<broker::data> CardinalityCounter::Serialize() const
 	{
-	broker::vector v = {m, V, alpha_m};
-	v.reserve(3 + m);
+	std::string packed;
 
-	for ( size_t i = 0; i < m; ++i )
-		v.emplace_back(static_cast<uint64_t>(buckets[i]));
+	if ( IsSparse() )
+		{
+		packed.reserve(1 + sparse.size() * sizeof(uint32_t));
+		packed.push_back(PACKED_SPARSE);
 
-	return {std::move(v)};
+		for ( auto e : sparse )
+			for ( size_t i = 0; i < sizeof(uint32_t); ++i )
+				packed.push_back(static_cast<char>(e >> (8 * i)));
+		}
+	else
+		{
+		packed.resize(1 + m);
+		packed[0] = PACKED_FULL;
+		memcpy(&packed[1], buckets.data(), m);
+		}
+
+	return {broker::vector{m, V, alpha_m, std::move(packed)}};
 	}
 
 std::unique_ptr<CardinalityCounter> CardinalityCounter::Unserialize(const broker::data& data)
@@ -222,14 +424,77 @@ std::unique_ptr<CardinalityCounter> CardinalityCounter::Unserialize(const broker
 
 	if ( ! (m && V && alpha_m) )
 		return nullptr;
+
+	if ( v->size() == 4 )
+		{
+		if ( auto packed = caf::get_if<std::string>(&(*v)[3]) )
+			{
+			if ( packed->empty() )
+				return nullptr;
+
+			auto p = reinterpret_cast<const uint8_t*>(packed->data() + 1);
+			auto n = packed->size() - 1;
+
+			if ( static_cast<uint8_t>((*packed)[0]) == PACKED_SPARSE )
+				{
+				if ( n % sizeof(uint32_t) )
+					return nullptr;
+
+				std::vector<uint32_t> entries(n / sizeof(uint32_t));
+
+				for ( auto& e : entries )
+					{
+					e = 0;
+
+					for ( size_t i = 0; i < sizeof(uint32_t); ++i )
+						e |= static_cast<uint32_t>(*p++) << (8 * i);
+					}
+
+				return UnserializeSparse(*m, *V, *alpha_m, std::move(entries));
+				}
+
+			if ( static_cast<uint8_t>((*packed)[0]) != PACKED_FULL || n != *m )
+				return nullptr;
+
+			auto cc = std::unique_ptr<CardinalityCounter>(new CardinalityCounter(*m, *V, *alpha_m));
+			if ( *m != cc->m )
+				return nullptr;
+
+			cc->buckets.assign(p, p + n);
+			return cc;
+			}
+
+		// The older form sent the sparse list as a vector, as the
+		// fourth element that full arrays never have, since m is at
+		// least 16.
+		auto old_entries = caf::get_if<broker::vector>(&(*v)[3]);
+		if ( ! old_entries )
+			return nullptr;
+
+		std::vector<uint32_t> entries;
+		entries.reserve(old_entries->size());
+
+		for ( const auto& d : *old_entries )
+			{
+			auto x = caf::get_if<uint64_t>(&d);
+
+			if ( ! (x && *x <= UINT32_MAX) )
+				return nullptr;
+
+			entries.push_back(*x);
+			}
+
+		return UnserializeSparse(*m, *V, *alpha_m, std::move(entries));
+		}
+
 	if ( v->size() != 3 + *m )
 		return nullptr;
 
 	auto cc = std::unique_ptr<CardinalityCounter>(new CardinalityCounter(*m, *V, *alpha_m));
 	if ( *m != cc->m )
 		return nullptr;
-	if ( cc->buckets.size() != * m )
-		return nullptr;
+
+	cc->buckets.assign(*m, 0);
 
 	for ( size_t i = 0; i < *m; ++i )
 		{
@@ -243,6 +508,33 @@ std::unique_ptr<CardinalityCounter> CardinalityCounter::Unserialize(const broker
 	return cc;
 	}
 
+std::unique_ptr<CardinalityCounter> CardinalityCounter::UnserializeSparse(uint64_t m, uint64_t V,
+                                                                          double alpha_m,
+                                                                          std::vector<uint32_t> entries)
+	{
+	// Sparse counters only exist for the sizes that Init() accepts.
+	if ( ! (m >= 16 && (m & (m - 1)) == 0 &&
+	        log2(m) <= MAX_SPARSE_P && V == m - entries.size()) )
+		return nullptr;
+
+	const uint32_t rank_mask = (1 << SPARSE_RANK_BITS) - 1;
+
+	for ( size_t i = 0; i < entries.size(); ++i )
+		{
+		uint32_t e = entries[i];
+
+		// Indices need to be in range and strictly increasing, and
+		// values non-zero.
+		if ( (e >> SPARSE_RANK_BITS) >= m || (e & rank_mask) == 0 ||
+		     (i > 0 && (e >> SPARSE_RANK_BITS) <= (entries[i - 1] >> SPARSE_RANK_BITS)) )
+			return nullptr;
+		}
+
+	auto cc = std::unique_ptr<CardinalityCounter>(new CardinalityCounter(m, V, alpha_m));
+	cc->sparse = std::move(entries);
+	return cc;
+	}
+
 /**
  * The following function is copied from libc/string/flsll.c from the FreeBSD source
  * tree. Original copyright message follows
@@ -15,6 +15,11 @@ namespace zeek::probabilistic::detail {
 
 /**
  * A probabilistic cardinality counter using the HyperLogLog algorithm.
+ *
+ * As in HyperLogLog++, a counter starts out sparse, keeping only its
+ * non-zero buckets in a sorted list, and switches to the full array of
+ * buckets once that list would take more space.  Both forms hold the same
+ * buckets, so they yield the same estimates.
  */
 class CardinalityCounter {
 public:
@@ -89,7 +94,17 @@ public:
 	 */
 	bool Merge(CardinalityCounter* c);
 
+	/**
+	 * Serializes the counter's parameters plus a string that packs its
+	 * buckets, behind a tag telling whether they're the full array or
+	 * the sparse list in little-endian words.
+	 */
 	broker::expected<broker::data> Serialize() const;
+
+	/**
+	 * Unserializes both the packed form and the older one, which had a
+	 * separate value for every bucket.
+	 */
 	static std::unique_ptr<CardinalityCounter> Unserialize(const broker::data& data);
 
 protected:
@@ -102,7 +117,7 @@ protected:
 
 	/**
 	 * Returns the buckets array that holds all of the rough cardinality
-	 * estimates.
+	 * estimates. It's empty while the counter is sparse.
 	 *
 	 * Use GetM() to determine the size.
 	 *
@@ -110,6 +125,11 @@ protected:
 	 */
 	const std::vector<uint8_t>& GetBuckets() const;
 
+	/**
+	 * Returns true while the counter keeps only its non-zero buckets.
+	 */
+	bool IsSparse() const	{ return buckets.empty(); }
+
 private:
 	/**
 	 * Constructor used when unserializing, i.e., all parameters are
@@ -117,6 +137,18 @@ private:
 	 */
 	explicit CardinalityCounter(uint64_t size, uint64_t V, double alpha_m);
 
+	/**
+	 * Builds a sparse counter from its unserialized list of buckets,
+	 * checking that the list is valid.
+	 */
+	static std::unique_ptr<CardinalityCounter> UnserializeSparse(uint64_t m, uint64_t V,
+	                                                             double alpha_m,
+	                                                             std::vector<uint32_t> entries);
+
+	// Tags of the first byte of the packed buckets.
+	static constexpr uint8_t PACKED_FULL = 1;
+	static constexpr uint8_t PACKED_SPARSE = 2;
+
 	/**
 	 * Helper function with code used jointly by multiple constructors.
 	 *
@@ -160,6 +192,35 @@ private:
 	 */
 	static int flsll(uint64_t mask);
 
+	/**
+	 * Sets a bucket to a rank if that's larger than its current one,
+	 * in sparse form, switching to the full array when the sparse form
+	 * grows too large.
+	 */
+	void SparseUpdate(uint64_t index, uint8_t rank);
+
+	/**
+	 * Switches from the sparse form to the full array of buckets.
+	 */
+	void Densify();
+
+	/**
+	 * Estimates the size in the range where the raw HyperLogLog
+	 * estimate is biased, with Ertl's improved estimator ("New
+	 * cardinality estimation algorithms for HyperLogLog sketches",
+	 * 2017). That uses the histogram of the bucket values rather than
+	 * HyperLogLog++'s empirically determined bias tables.
+	 */
+	double ImprovedEstimate() const;
+
+	/**
+	 * Sparse buckets hold the index of a bucket in the upper bits and
+	 * its value in the lower SPARSE_RANK_BITS.  Larger counters always
+	 * use the full array.
+	 */
+	static constexpr int SPARSE_RANK_BITS = 6;
+	static constexpr int MAX_SPARSE_P = 32 - SPARSE_RANK_BITS;
+
 	/**
 	 * This is the number of buckets that will be stored. The standard
 	 * error is 1.04/sqrt(m), so the actual cardinality will be the
@@ -175,6 +236,11 @@ private:
 	 */
 	std::vector<uint8_t> buckets;
 
+	/**
+	 * The non-zero buckets, sorted by index, while buckets is empty.
+	 */
+	std::vector<uint32_t> sparse;
+
 	/**
 	 * There are some state constants that need to be kept track of to
 	 * make the final estimate easier. V is the number of values in
@@ -0,0 +1,157 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/probabilistic/CountMinSketch.h"
+
+#include <math.h>
+#include <algorithm>
+
+#include <broker/data.hh>
+
+#include "zeek/Reporter.h"
+
+namespace zeek::probabilistic::detail {
+
+CountMinSketch::CountMinSketch(uint64_t arg_width, uint64_t arg_depth,
+                               Hasher::seed_t arg_seed)
+	: seed(arg_seed), uhf(arg_seed)
+	{
+	width = std::max(arg_width, uint64_t(1));
+	depth = std::min(std::max(arg_depth, uint64_t(1)), MAX_DEPTH);
+	counters.resize(width * depth);
+	}
+
+uint64_t CountMinSketch::Width(double epsilon)
+	{
+	return static_cast<uint64_t>(ceil(M_E / epsilon));
+	}
+
+uint64_t CountMinSketch::Depth(double delta)
+	{
+	return static_cast<uint64_t>(ceil(log(1 / delta)));
+	}
+
+void CountMinSketch::Columns(const void* key, size_t size, uint64_t* col) const
+	{
+	// Derives the rows' counters from a single hash through double
+	// hashing, stepping by the hash's rotation, made odd so that the
+	// rows don't all repeat a collision.
+	Hasher::digest h1 = uhf(key, size);
+	Hasher::digest h2 = ((h1 >> 32) | (h1 << 32)) | 1;
+
+	for ( uint64_t i = 0; i < depth; ++i )
+		col[i] = i * width + (h1 + i * h2) % width;
+	}
+
+void CountMinSketch::Add(const void* key, size_t size, uint64_t n)
+	{
+	uint64_t col[MAX_DEPTH];
+	Columns(key, size, col);
+
+	uint64_t min = counters[col[0]];
+
+	for ( uint64_t i = 1; i < depth; ++i )
+		min = std::min(min, counters[col[i]]);
+
+	// Conservative update: the new estimate is min + n, and no counter
+	// needs to exceed that.
+	uint64_t estimate = min + n;
+
+	for ( uint64_t i = 0; i < depth; ++i )
+		counters[col[i]] = std::max(counters[col[i]], estimate);
+
+	total += n;
+	}
+
+uint64_t CountMinSketch::Estimate(const void* key, size_t size) const
+	{
+	uint64_t col[MAX_DEPTH];
+	Columns(key, size, col);
+
+	uint64_t min = counters[col[0]];
+
+	for ( uint64_t i = 1; i < depth; ++i )
+		min = std::min(min, counters[col[i]]);
+
+	return min;
+	}
+
+void CountMinSketch::Clear()
+	{
+	std::fill(counters.begin(), counters.end(), 0);
+	total = 0;
+	}
+
+bool CountMinSketch::Merge(const CountMinSketch* other)
+	{
+	if ( width != other->width || depth != other->depth )
+		{
+		reporter->Error("different dimensions in count-min sketch merge");
+		return false;
+		}
+
+	if ( seed.h[0] != other->seed.h[0] || seed.h[1] != other->seed.h[1] )
+		{
+		reporter->Error("different seeds in count-min sketch merge");
+		return false;
+		}
+
+	for ( size_t i = 0; i < counters.size(); ++i )
+		counters[i] += other->counters[i];
+
+	total += other->total;
+	return true;
+	}
+
+broker::expected<broker::data> CountMinSketch::Serialize() const
+	{
+	broker::vector v = {width, depth, total,
+	                    static_cast<uint64_t>(seed.h[0]),
+	                    static_cast<uint64_t>(seed.h[1])};
+
+	v.reserve(5 + counters.size());
+
+	for ( auto c : counters )
+		v.emplace_back(c);
+
+	return {std::move(v)};
+	}
+
+std::unique_ptr<CountMinSketch> CountMinSketch::Unserialize(const broker::data& data)
+	{
+	auto v = caf::get_if<broker::vector>(&data);
+	if ( ! (v && v->size() >= 5) )
+		return nullptr;
+
+	auto width = caf::get_if<uint64_t>(&(*v)[0]);
+	auto depth = caf::get_if<uint64_t>(&(*v)[1]);
+	auto total = caf::get_if<uint64_t>(&(*v)[2]);
+	auto h0 = caf::get_if<uint64_t>(&(*v)[3]);
+	auto h1 = caf::get_if<uint64_t>(&(*v)[4]);
+
+	if ( ! (width && depth && total && h0 && h1) )
+		return nullptr;
+
+	if ( *width == 0 || *width > v->size() || *depth == 0 || *depth > MAX_DEPTH ||
+	     v->size() - 5 != *width * *depth )
+		return nullptr;
+
+	Hasher::seed_t seed;
+	seed.h[0] = *h0;
+	seed.h[1] = *h1;
+
+	auto cms = std::make_unique<CountMinSketch>(*width, *depth, seed);
+	cms->total = *total;
+
+	for ( size_t i = 0; i < cms->counters.size(); ++i )
+		{
+		auto c = caf::get_if<uint64_t>(&(*v)[5 + i]);
+		if ( ! c )
+			return nullptr;
+
+		cms->counters[i] = *c;
+		}
+
+	return cms;
+	}
+
+} // namespace zeek::probabilistic::detail
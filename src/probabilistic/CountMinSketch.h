@@ -0,0 +1,122 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include <broker/expected.hh>
+
+#include "zeek/probabilistic/Hasher.h"
+
+namespace broker { class data; }
+
+namespace zeek::probabilistic::detail {
+
+/**
+ * A count-min sketch (Cormode and Muthukrishnan, "An Improved Data Stream
+ * Summary: The Count-Min Sketch and its Applications", 2005), which
+ * estimates how often elements occur in fixed memory.  Estimates never
+ * fall below the true counts, and exceed them by at most epsilon times the
+ * total of all counts with probability 1 - delta.
+ *
+ * Adding elements uses conservative update: it raises only those of an
+ * element's counters that fall below its new estimate, which tightens the
+ * estimates of the rare elements.
+ */
+class CountMinSketch {
+public:
+	/** The largest number of rows. */
+	static constexpr uint64_t MAX_DEPTH = 32;
+
+	/**
+	 * Constructor.
+	 *
+	 * @param width The number of counters per row.
+	 *
+	 * @param depth The number of rows, i.e., of counters per element,
+	 * which gets capped at MAX_DEPTH.
+	 *
+	 * @param seed The seed of the hash function.  Only sketches with the
+	 * same seed and dimensions can be merged.
+	 */
+	CountMinSketch(uint64_t width, uint64_t depth, Hasher::seed_t seed);
+
+	/**
+	 * Computes the width that keeps the error of estimates within
+	 * *epsilon* times the total of all counts.
+	 */
+	static uint64_t Width(double epsilon);
+
+	/**
+	 * Computes the depth that keeps estimates within their error bound
+	 * with probability 1 - *delta*.
+	 */
+	static uint64_t Depth(double delta);
+
+	/**
+	 * Adds occurrences of an element.
+	 *
+	 * @param key The bytes that identify the element.
+	 *
+	 * @param size The number of bytes.
+	 *
+	 * @param n The number of occurrences.
+	 */
+	void Add(const void* key, size_t size, uint64_t n = 1);
+
+	/**
+	 * Estimates how often an element occurred.
+	 *
+	 * @param key The bytes that identify the element.
+	 *
+	 * @param size The number of bytes.
+	 *
+	 * @return The estimate, which is at least the true count.
+	 */
+	uint64_t Estimate(const void* key, size_t size) const;
+
+	/**
+	 * Returns the total of all counts that got added.
+	 */
+	uint64_t Total() const	{ return total; }
+
+	/**
+	 * Resets all counters.
+	 */
+	void Clear();
+
+	/**
+	 * Adds the counters of another sketch to this one.  Estimates of the
+	 * result remain upper bounds of the combined counts, though without
+	 * the benefit of conservative update across the two.
+	 *
+	 * @param other The sketch to merge, with the same dimensions and seed.
+	 *
+	 * @return True if successful.
+	 */
+	bool Merge(const CountMinSketch* other);
+
+	uint64_t GetWidth() const	{ return width; }
+	uint64_t GetDepth() const	{ return depth; }
+
+	broker::expected<broker::data> Serialize() const;
+	static std::unique_ptr<CountMinSketch> Unserialize(const broker::data& data);
+
+private:
+	// Fills col with the counter of the element in each row.
+	void Columns(const void* key, size_t size, uint64_t* col) const;
+
+	uint64_t width;
+	uint64_t depth;
+	uint64_t total = 0;
+	Hasher::seed_t seed;
+	UHF uhf;
+
+	// The rows, one after the other.
+	std::vector<uint64_t> counters;
+};
+
+} // namespace zeek::probabilistic::detail
@@ -2,21 +2,16 @@
 
 #include "zeek/probabilistic/Topk.h"
 
+#include <cstring>
+
 #include <broker/error.hh>
 
 #include "zeek/broker/Data.h"
 #include "zeek/CompHash.h"
 #include "zeek/Reporter.h"
-#include "zeek/Dict.h"
 
 namespace zeek::probabilistic::detail {
 
-static void topk_element_hash_delete_func(void* val)
-	{
-	Element* e = (Element*) val;
-	delete e;
-	}
-
 void TopkVal::Typify(TypePtr t)
 	{
 	assert(!hash && !type);
@@ -26,17 +21,15 @@ void TopkVal::Typify(TypePtr t)
 	hash = new zeek::detail::CompositeHash(std::move(tl));
 	}
 
-zeek::detail::HashKey* TopkVal::GetHash(Val* v) const
+std::unique_ptr<zeek::detail::HashKey> TopkVal::GetHash(Val* v) const
 	{
 	auto key = hash->MakeHashKey(*v, true);
 	assert(key);
-	return key.release();
+	return key;
 	}
 
 TopkVal::TopkVal(uint64_t arg_size) : OpaqueVal(topk_type)
 	{
-	elementDict = new PDict<Element>;
-	elementDict->SetDeleteFunc(topk_element_hash_delete_func);
 	size = arg_size;
 	numElements = 0;
 	pruned = false;
@@ -45,27 +38,247 @@ TopkVal::TopkVal(uint64_t arg_size) : OpaqueVal(topk_type)
 
 TopkVal::TopkVal() : OpaqueVal(topk_type)
 	{
-	elementDict = new PDict<Element>;
-	elementDict->SetDeleteFunc(topk_element_hash_delete_func);
 	size = 0;
 	numElements = 0;
+	pruned = false;
 	hash = nullptr;
 	}
 
 TopkVal::~TopkVal()
 	{
-	elementDict->Clear();
-	delete elementDict;
+	delete hash;
+	}
+
+TopkIndex TopkVal::Find(const void* key, size_t key_size, uint64_t h) const
+	{
+	if ( slots.empty() )
+		return TOPK_NONE;
+
+	size_t mask = slots.size() - 1;
 
-	// now all elements are already gone - delete the buckets
-	std::list<Bucket*>::iterator bi = buckets.begin();
-	while ( bi != buckets.end() )
+	for ( size_t i = h & mask; slots[i] != TOPK_NONE; i = (i + 1) & mask )
 		{
-		delete *bi;
-		bi++;
+		const Element& e = elements[slots[i]];
+
+		if ( e.hash == h && e.key.size() == key_size &&
+		     memcmp(e.key.data(), key, key_size) == 0 )
+			return slots[i];
 		}
 
-	delete hash;
+	return TOPK_NONE;
+	}
+
+TopkIndex TopkVal::Find(const zeek::detail::HashKey& key) const
+	{
+	return Find(key.Key(), key.Size(), key.Hash());
+	}
+
+void TopkVal::IndexInsert(TopkIndex e)
+	{
+	// Keep the table at most half full, which numElements bounds from
+	// above while elements come and go.
+	if ( (numElements + 1) * 2 > slots.size() )
+		{
+		size_t n = 16;
+
+		while ( n < (numElements + 1) * 2 )
+			n *= 2;
+
+		std::vector<TopkIndex> old(n, TOPK_NONE);
+		old.swap(slots);
+
+		for ( auto i : old )
+			if ( i != TOPK_NONE )
+				IndexInsert(i);
+		}
+
+	size_t mask = slots.size() - 1;
+	size_t i = elements[e].hash & mask;
+
+	while ( slots[i] != TOPK_NONE )
+		i = (i + 1) & mask;
+
+	slots[i] = e;
+	}
+
+void TopkVal::IndexRemove(TopkIndex e)
+	{
+	size_t mask = slots.size() - 1;
+	size_t i = elements[e].hash & mask;
+
+	while ( slots[i] != e )
+		i = (i + 1) & mask;
+
+	// Shift later entries of the probe sequence back into the hole, so
+	// that lookups don't need tombstones.
+	for ( size_t j = (i + 1) & mask; slots[j] != TOPK_NONE; j = (j + 1) & mask )
+		{
+		size_t home = elements[slots[j]].hash & mask;
+
+		// Entries whose home lies cyclically within (i, j] stay.
+		bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+
+		if ( ! stays )
+			{
+			slots[i] = slots[j];
+			i = j;
+			}
+		}
+
+	slots[i] = TOPK_NONE;
+	}
+
+TopkIndex TopkVal::NewElement()
+	{
+	TopkIndex e = freeElements;
+
+	if ( e != TOPK_NONE )
+		freeElements = elements[e].next;
+	else
+		{
+		e = elements.size();
+		elements.emplace_back();
+		}
+
+	Element& el = elements[e];
+	el.epsilon = 0;
+	el.parent = TOPK_NONE;
+	el.prev = el.next = TOPK_NONE;
+	return e;
+	}
+
+void TopkVal::FreeElement(TopkIndex e)
+	{
+	Element& el = elements[e];
+
+	// Keep the key's buffer around for the element's next use.
+	el.value = nullptr;
+	el.key.clear();
+	el.next = freeElements;
+	freeElements = e;
+	}
+
+TopkIndex TopkVal::NewBucket(uint64_t count)
+	{
+	TopkIndex b = freeBuckets;
+
+	if ( b != TOPK_NONE )
+		freeBuckets = buckets[b].next;
+	else
+		{
+		b = buckets.size();
+		buckets.emplace_back();
+		}
+
+	Bucket& bu = buckets[b];
+	bu.count = count;
+	bu.size = 0;
+	bu.head = bu.tail = TOPK_NONE;
+	bu.prev = bu.next = TOPK_NONE;
+	return b;
+	}
+
+void TopkVal::LinkBucket(TopkIndex b, TopkIndex before)
+	{
+	TopkIndex prev = before != TOPK_NONE ? buckets[before].prev : maxBucket;
+
+	buckets[b].prev = prev;
+	buckets[b].next = before;
+
+	if ( prev != TOPK_NONE )
+		buckets[prev].next = b;
+	else
+		minBucket = b;
+
+	if ( before != TOPK_NONE )
+		buckets[before].prev = b;
+	else
+		maxBucket = b;
+	}
+
+void TopkVal::FreeBucket(TopkIndex b)
+	{
+	Bucket& bu = buckets[b];
+	assert(bu.size == 0);
+
+	if ( bu.prev != TOPK_NONE )
+		buckets[bu.prev].next = bu.next;
+	else
+		minBucket = bu.next;
+
+	if ( bu.next != TOPK_NONE )
+		buckets[bu.next].prev = bu.prev;
+	else
+		maxBucket = bu.prev;
+
+	bu.next = freeBuckets;
+	freeBuckets = b;
+	}
+
+void TopkVal::Append(TopkIndex b, TopkIndex e)
+	{
+	Bucket& bu = buckets[b];
+	Element& el = elements[e];
+
+	el.parent = b;
+	el.prev = bu.tail;
+	el.next = TOPK_NONE;
+
+	if ( bu.tail != TOPK_NONE )
+		elements[bu.tail].next = e;
+	else
+		bu.head = e;
+
+	bu.tail = e;
+	++bu.size;
+	}
+
+void TopkVal::Unlink(TopkIndex e)
+	{
+	Element& el = elements[e];
+	Bucket& bu = buckets[el.parent];
+
+	if ( el.prev != TOPK_NONE )
+		elements[el.prev].next = el.next;
+	else
+		bu.head = el.next;
+
+	if ( el.next != TOPK_NONE )
+		elements[el.next].prev = el.prev;
+	else
+		bu.tail = el.prev;
+
+	--bu.size;
+	el.parent = TOPK_NONE;
+	el.prev = el.next = TOPK_NONE;
+	}
+
+TopkIndex TopkVal::RemoveMin()
+	{
+	assert(minBucket != TOPK_NONE);
+	TopkIndex e = buckets[minBucket].head;
+	assert(e != TOPK_NONE); // there has to have been a minimal element...
+
+	Unlink(e);
+	IndexRemove(e);
+	return e;
+	}
+
+TopkIndex TopkVal::BucketFor(uint64_t count, TopkIndex from)
+	{
+	TopkIndex b = from;
+
+	while ( b != TOPK_NONE && buckets[b].count < count )
+		b = buckets[b].next;
+
+	if ( b != TOPK_NONE && buckets[b].count == count )
+		return b;
+
+	// the bucket for the value that we want does not exist.
+	// create it...
+	TopkIndex nb = NewBucket(count);
+	LinkBucket(nb, b);
+	return nb;
 	}
 
 void TopkVal::Merge(const TopkVal* value, bool doPrune)
@@ -92,54 +305,47 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 			}
 		}
 
-	std::list<Bucket*>::const_iterator it = value->buckets.begin();
-	while ( it != value->buckets.end() )
+	// The other side's elements come in order of increasing counts, so
+	// the bucket that the last new element went into is a good place to
+	// start looking for the next one's - if it's still around.
+	TopkIndex hint = TOPK_NONE;
+
+	for ( TopkIndex ob = value->minBucket; ob != TOPK_NONE; ob = value->buckets[ob].next )
 		{
-		Bucket* b = *it;
-		uint64_t currcount = b->count;
-		std::list<Element*>::const_iterator eit = b->elements.begin();
+		uint64_t currcount = value->buckets[ob].count;
 
-		while ( eit != b->elements.end() )
+		for ( TopkIndex oe = value->buckets[ob].head; oe != TOPK_NONE; oe = value->elements[oe].next )
 			{
-			Element* e = *eit;
-			// lookup if we already know this one...
-			zeek::detail::HashKey* key = GetHash(e->value);
-			Element* olde = (Element*) elementDict->Lookup(key);
+			const Element& other = value->elements[oe];
 
-			if ( olde == nullptr )
+			// lookup if we already know this one. Both sides use
+			// the same type, so the other side's key is ours too.
+			TopkIndex e = Find(other.key.data(), other.key.size(), other.hash);
+
+			if ( e == TOPK_NONE )
 				{
-				olde = new Element();
-				olde->epsilon = 0;
-				olde->value = e->value;
-				// insert at bucket position 0
-				if ( buckets.size() > 0 )
-					{
-					assert (buckets.front()-> count > 0 );
-					}
-
-				Bucket* newbucket = new Bucket();
-				newbucket->count = 0;
-				newbucket->bucketPos = buckets.insert(buckets.begin(), newbucket);
-
-				olde->parent = newbucket;
-				newbucket->elements.insert(newbucket->elements.end(), olde);
-
-				elementDict->Insert(key, olde);
+				e = NewElement();
+				Element& el = elements[e];
+				el.value = other.value;
+				el.key = other.key;
+				el.hash = other.hash;
+				el.epsilon = other.epsilon;
+
+				bool hint_valid = hint != TOPK_NONE && buckets[hint].size > 0 &&
+				                  buckets[hint].count <= currcount;
+				hint = BucketFor(currcount, hint_valid ? hint : minBucket);
+				Append(hint, e);
+				IndexInsert(e);
 				numElements++;
-
+				continue;
 				}
 
 			// now that we are sure that the old element is present - increment epsilon
-			olde->epsilon += e->epsilon;
+			elements[e].epsilon += other.epsilon;
 
 			// and increment position...
-			IncrementCounter(olde, currcount);
-			delete key;
-
-			eit++;
+			IncrementCounter(e, currcount);
 			}
-
-		it++;
 		}
 
 	// now we have added everything. And our top-k table could be too big.
@@ -153,23 +359,11 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 	while ( numElements > size )
 		{
 		pruned = true;
-		assert(buckets.size() > 0 );
-		Bucket* b = buckets.front();
-		assert(b->elements.size() > 0);
-
-		Element* e = b->elements.front();
-		zeek::detail::HashKey* key = GetHash(e->value);
-		elementDict->RemoveEntry(key);
-		delete key;
-		delete e;
+		TopkIndex b = minBucket;
+		FreeElement(RemoveMin());
 
-		b->elements.pop_front();
-
-		if ( b->elements.size() == 0 )
-			{
-			delete b;
-			buckets.pop_front();
-			}
+		if ( buckets[b].size == 0 )
+			FreeBucket(b);
 
 		numElements--;
 		}
@@ -197,70 +391,46 @@ VectorValPtr TopkVal::GetTopK(int k) const // returns vector
 	// in any case - just to make this future-proof (and I am lazy) - this can return more than k.
 
 	int read = 0;
-	std::list<Bucket*>::const_iterator it = buckets.end();
-	it--;
-	while (read < k )
-		{
-		//printf("Bucket %llu\n", (*it)->count);
-		std::list<Element*>::iterator eit = (*it)->elements.begin();
-		while ( eit != (*it)->elements.end() )
-			{
-			//printf("Size: %ld\n", (*it)->elements.size());
-			t->Assign(read, (*eit)->value);
-			read++;
-			eit++;
-			}
 
-		if ( it == buckets.begin() )
-			break;
-
-		it--;
-		}
+	for ( TopkIndex b = maxBucket; b != TOPK_NONE && read < k; b = buckets[b].prev )
+		for ( TopkIndex e = buckets[b].head; e != TOPK_NONE; e = elements[e].next )
+			t->Assign(read++, elements[e].value);
 
 	return t;
 	}
 
 uint64_t TopkVal::GetCount(Val* value) const
 	{
-	zeek::detail::HashKey* key = GetHash(value);
-	Element* e = (Element*) elementDict->Lookup(key);
-	delete key;
+	TopkIndex e = Find(*GetHash(value));
 
-	if ( e == nullptr )
+	if ( e == TOPK_NONE )
 		{
 		reporter->Error("GetCount for element that is not in top-k");
 		return 0;
 		}
 
-	return e->parent->count;
+	return buckets[elements[e].parent].count;
 	}
 
 uint64_t TopkVal::GetEpsilon(Val* value) const
 	{
-	zeek::detail::HashKey* key = GetHash(value);
-	Element* e = (Element*) elementDict->Lookup(key);
-	delete key;
+	TopkIndex e = Find(*GetHash(value));
 
-	if ( e == nullptr )
+	if ( e == TOPK_NONE )
 		{
 		reporter->Error("GetEpsilon for element that is not in top-k");
 		return 0;
 		}
 
-	return e->epsilon;
+	return elements[e].epsilon;
 	}
 
 uint64_t TopkVal::GetSum() const
 	{
 	uint64_t sum = 0;
 
-	std::list<Bucket*>::const_iterator it = buckets.begin();
-	while ( it != buckets.end() )
-		{
-		sum += (*it)->elements.size() * (*it)->count;
-
-		it++;
-		}
+	for ( TopkIndex b = minBucket; b != TOPK_NONE; b = buckets[b].next )
+		sum += buckets[b].size * buckets[b].count;
 
 	if ( pruned )
 		reporter->Warning("TopkVal::GetSum() was used on a pruned data structure. Result values do not represent total element count");
@@ -282,119 +452,74 @@ void TopkVal::Encountered(ValPtr encountered)
 			}
 
 	// Step 1 - get the hash.
-	zeek::detail::HashKey* key = GetHash(encountered);
-	Element* e = (Element*) elementDict->Lookup(key);
+	auto key = GetHash(encountered);
+	TopkIndex e = Find(*key);
 
-	if ( e == nullptr )
+	if ( e == TOPK_NONE )
 		{
-		e = new Element();
-		e->epsilon = 0;
-		e->value = std::move(encountered);
-
 		// well, we do not know this one yet...
 		if ( numElements < size )
 			{
 			// brilliant. just add it at position 1
-			if ( buckets.size() == 0 || (*buckets.begin())->count > 1 )
-				{
-				Bucket* b = new Bucket();
-				b->count = 1;
-				std::list<Bucket*>::iterator pos = buckets.insert(buckets.begin(), b);
-				b->bucketPos = pos;
-				b->elements.insert(b->elements.end(), e);
-				e->parent = b;
-				}
-			else
+			TopkIndex b = minBucket;
+
+			if ( b == TOPK_NONE || buckets[b].count > 1 )
 				{
-				Bucket* b = *buckets.begin();
-				assert(b->count == 1);
-				b->elements.insert(b->elements.end(), e);
-				e->parent = b;
+				b = NewBucket(1);
+				LinkBucket(b, minBucket);
 				}
 
-			elementDict->Insert(key, e);
+			e = NewElement();
+			Element& el = elements[e];
+			el.value = std::move(encountered);
+			el.key.assign(static_cast<const char*>(key->Key()), key->Size());
+			el.hash = key->Hash();
+
+			Append(b, e);
+			IndexInsert(e);
 			numElements++;
-			delete key;
 
 			return; // done. it is at pos 1.
 			}
 
-		else
-			{
-			// replace element with min-value
-			Bucket* b = *buckets.begin(); // bucket with smallest elements
-
-			// evict oldest element with least hits.
-			assert(b->elements.size() > 0);
-			zeek::detail::HashKey* deleteKey = GetHash((*(b->elements.begin()))->value);
-			b->elements.erase(b->elements.begin());
-			Element* deleteElement = (Element*) elementDict->RemoveEntry(deleteKey);
-			assert(deleteElement); // there has to have been a minimal element...
-			delete deleteElement;
-			delete deleteKey;
-
-			// and add the new one to the end
-			e->epsilon = b->count;
-			b->elements.insert(b->elements.end(), e);
-			elementDict->Insert(key, e);
-			e->parent = b;
-
-			// fallthrough, increment operation has to run!
-			}
+		// replace element with min-value: evict oldest element with
+		// least hits, and reuse its slot for the new one.
+		TopkIndex b = minBucket; // bucket with smallest elements
+		e = RemoveMin();
+
+		Element& el = elements[e];
+		el.value = std::move(encountered);
+		el.key.assign(static_cast<const char*>(key->Key()), key->Size());
+		el.hash = key->Hash();
 
+		// and add the new one to the end
+		el.epsilon = buckets[b].count;
+		Append(b, e);
+		IndexInsert(e);
+
+		// fallthrough, increment operation has to run!
 		}
 
 	// ok, we now have an element in e
-	delete key;
 	IncrementCounter(e); // well, this certainly was anticlimatic.
 	}
 
 // increment by count
-void TopkVal::IncrementCounter(Element* e, unsigned int count)
+void TopkVal::IncrementCounter(TopkIndex e, uint64_t count)
 	{
-	Bucket* currBucket = e->parent;
-	uint64_t currcount = currBucket->count;
-
-	// well, let's test if there is a bucket for currcount++
-	std::list<Bucket*>::iterator bucketIter = currBucket->bucketPos;
+	TopkIndex currBucket = elements[e].parent;
+	uint64_t target = buckets[currBucket].count + count;
 
-	Bucket* nextBucket = nullptr;
-
-	bucketIter++;
-
-	while ( bucketIter != buckets.end() && (*bucketIter)->count < currcount+count )
-		bucketIter++;
-
-	if ( bucketIter != buckets.end() && (*bucketIter)->count == currcount+count )
-		nextBucket = *bucketIter;
-
-	if ( nextBucket == nullptr )
-		{
-		// the bucket for the value that we want does not exist.
-		// create it...
-
-		Bucket* b = new Bucket();
-		b->count = currcount+count;
-
-		std::list<Bucket*>::iterator nextBucketPos = buckets.insert(bucketIter, b);
-		b->bucketPos = nextBucketPos; // and give it the iterator we know now.
-
-		nextBucket = b;
-		}
+	// well, let's test if there is a bucket for currcount + count
+	TopkIndex nextBucket = BucketFor(target, buckets[currBucket].next);
 
 	// ok, now we have the new bucket in nextBucket. Shift the element over...
-	currBucket->elements.remove(e);
-	nextBucket->elements.insert(nextBucket->elements.end(), e);
-
-	e->parent = nextBucket;
+	Unlink(e);
+	Append(nextBucket, e);
 
 	// if currBucket is empty, we have to delete it now
-	if ( currBucket->elements.size() == 0 )
-		{
-		buckets.remove(currBucket);
-		delete currBucket;
-		currBucket = nullptr;
-		}
+	if ( buckets[currBucket].size == 0 )
+		FreeBucket(currBucket);
 	}
 
 IMPLEMENT_OPAQUE_VALUE(TopkVal)
@@ -415,31 +540,23 @@ broker::expected<broker::data> TopkVal::DoSerialize() const
 		d.emplace_back(broker::none());
 
 	uint64_t i = 0;
-	std::list<Bucket*>::const_iterator it = buckets.begin();
-	while ( it != buckets.end() )
-		{
-		Bucket* b = *it;
-		uint32_t elements_count = b->elements.size();
 
-		d.emplace_back(static_cast<uint64_t>(b->elements.size()));
-		d.emplace_back(b->count);
+	for ( TopkIndex b = minBucket; b != TOPK_NONE; b = buckets[b].next )
+		{
+		d.emplace_back(buckets[b].size);
+		d.emplace_back(buckets[b].count);
 
-		std::list<Element*>::const_iterator eit = b->elements.begin();
-		while ( eit != b->elements.end() )
+		for ( TopkIndex e = buckets[b].head; e != TOPK_NONE; e = elements[e].next )
 			{
-			Element* element = *eit;
-			d.emplace_back(element->epsilon);
-			auto v = Broker::detail::val_to_data(element->value.get());
+			const Element& element = elements[e];
+			d.emplace_back(element.epsilon);
+			auto v = Broker::detail::val_to_data(element.value.get());
 			if ( ! v )
 				return broker::ec::invalid_data;
 
 			d.emplace_back(*v);
-
-			eit++;
 			i++;
 			}
-
-		it++;
 		}
 
 	assert(i == numElements);
@@ -462,7 +579,6 @@ bool TopkVal::DoUnserialize(const broker::data& data)
 		return false;
 
 	size = *size_;
-	numElements = *numElements_;
 	pruned = *pruned_;
 
 	auto no_type = caf::get_if<broker::none>(&(*v)[3]);
@@ -476,48 +592,55 @@ bool TopkVal::DoUnserialize(const broker::data& data)
 		Typify(t);
 		}
 
-	uint64_t i = 0;
+	if ( *numElements_ > 0 && ! hash )
+		return false;
+
+	// numElements counts the elements as they get indexed, so that the
+	// index only grows to what's actually there.
 	uint64_t idx = 4;
 
-	while ( i < numElements )
+	while ( numElements < *numElements_ )
 		{
+		if ( idx + 2 > v->size() )
+			return false;
+
 		auto elements_count = caf::get_if<uint64_t>(&(*v)[idx++]);
 		auto count = caf::get_if<uint64_t>(&(*v)[idx++]);
 
-		if ( ! (elements_count && count) )
+		if ( ! (elements_count && count && *elements_count > 0) )
 			return false;
 
-		Bucket* b = new Bucket();
-		b->count = *count;
-		b->bucketPos = buckets.insert(buckets.end(), b);
+		TopkIndex b = NewBucket(*count);
+		LinkBucket(b, TOPK_NONE);
 
 		for ( uint64_t j = 0; j < *elements_count; j++ )
 			{
+			if ( idx + 2 > v->size() )
+				return false;
+
 			auto epsilon = caf::get_if<uint64_t>(&(*v)[idx++]);
 			auto val = Broker::detail::data_to_val((*v)[idx++], type.get());
 
 			if ( ! (epsilon && val) )
 				return false;
 
-			Element* e = new Element();
-			e->epsilon = *epsilon;
-			e->value = std::move(val);
-			e->parent = b;
-
-			b->elements.insert(b->elements.end(), e);
+			auto key = GetHash(val);
+			assert(Find(*key) == TOPK_NONE);
 
-			zeek::detail::HashKey* key = GetHash(e->value);
-			assert (elementDict->Lookup(key) == nullptr);
+			TopkIndex e = NewElement();
+			Element& el = elements[e];
+			el.epsilon = *epsilon;
+			el.value = std::move(val);
+			el.key.assign(static_cast<const char*>(key->Key()), key->Size());
+			el.hash = key->Hash();
 
-			elementDict->Insert(key, e);
-			delete key;
-
-			i++;
+			Append(b, e);
+			IndexInsert(e);
+			numElements++;
 			}
 		}
 
-	assert(i == numElements);
-	return true;
+	return numElements == *numElements_;
 	}
 
 } // namespace zeek::probabilistic::detail
@@ -2,7 +2,12 @@
 
 #pragma once
 
-#include <list>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zeek/Hash.h"
 #include "zeek/Val.h"
 #include "zeek/OpaqueVal.h"
 
@@ -13,22 +18,41 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(CompositeHash, zeek::detail);
 
 namespace zeek::probabilistic::detail {
 
-struct Element;
+// Elements and buckets live in arrays and refer to each other by index, so
+// that tracking an element doesn't need any allocations of its own once the
+// arrays have grown to size.
+using TopkIndex = uint32_t;
+constexpr TopkIndex TOPK_NONE = UINT32_MAX;
 
 struct Bucket {
 	uint64_t count;
-	std::list<Element*> elements;
+	uint64_t size; // number of elements
+
+	// The elements with this count, oldest first.
+	TopkIndex head;
+	TopkIndex tail;
 
-	// Iterators only get invalidated for removed elements. This one
-	// points to us - so it is invalid when we are no longer there. Cute,
-	// isn't it?
-	std::list<Bucket*>::iterator bucketPos;
+	// Neighbouring buckets, ordered by count.  Buckets that aren't in
+	// use are chained through next.
+	TopkIndex prev;
+	TopkIndex next;
 };
 
 struct Element {
 	uint64_t epsilon;
 	ValPtr value;
-	Bucket* parent;
+
+	// The element's HashKey, kept so that evicting or merging it doesn't
+	// have to recompute it.
+	std::string key;
+	uint64_t hash;
+
+	TopkIndex parent;
+
+	// Neighbouring elements in the parent bucket.  Elements that aren't
+	// in use are chained through next.
+	TopkIndex prev;
+	TopkIndex next;
 };
 
 class TopkVal : public OpaqueVal {
@@ -143,7 +167,19 @@ private:
 	 *
 	 * @param count increment counter by this much
 	 */
-	void IncrementCounter(Element* e, unsigned int count = 1);
+	void IncrementCounter(TopkIndex e, uint64_t count = 1);
+
+	/**
+	 * Returns the bucket for a count, creating it if there's none yet.
+	 *
+	 * @param count the bucket's count
+	 *
+	 * @param from the first bucket to consider, which must not have a
+	 * larger count.  With TOPK_NONE, a new bucket goes last.
+	 *
+	 * @returns the bucket's index
+	 */
+	TopkIndex BucketFor(uint64_t count, TopkIndex from);
 
 	/**
 	 * get the hashkey for a specific value
@@ -152,8 +188,8 @@ private:
 	 *
 	 * @returns HashKey for value
 	 */
-	zeek::detail::HashKey* GetHash(Val* v) const; // this probably should go somewhere else.
-	zeek::detail::HashKey* GetHash(const ValPtr& v) const
+	std::unique_ptr<zeek::detail::HashKey> GetHash(Val* v) const; // this probably should go somewhere else.
+	std::unique_ptr<zeek::detail::HashKey> GetHash(const ValPtr& v) const
 		{ return GetHash(v.get()); }
 
 	/**
@@ -163,10 +199,46 @@ private:
 	 */
 	void Typify(TypePtr t);
 
+	// Returns the element with the given key, or TOPK_NONE.
+	TopkIndex Find(const void* key, size_t key_size, uint64_t h) const;
+	TopkIndex Find(const zeek::detail::HashKey& key) const;
+
+	// Adds an element to, or removes it from, the index of keys.
+	void IndexInsert(TopkIndex e);
+	void IndexRemove(TopkIndex e);
+
+	// Takes an unused element or bucket, growing the arrays if needed.
+	TopkIndex NewElement();
+	TopkIndex NewBucket(uint64_t count);
+
+	// Links a bucket into the ordered list of buckets before another
+	// one, or at the end if that's TOPK_NONE.
+	void LinkBucket(TopkIndex b, TopkIndex before);
+
+	// Unlinks an empty bucket and returns it to the unused ones.
+	void FreeBucket(TopkIndex b);
+
+	// Appends an element to a bucket, or unlinks it from its bucket.
+	void Append(TopkIndex b, TopkIndex e);
+	void Unlink(TopkIndex e);
+
+	// Unlinks the oldest element with the smallest count and removes
+	// it from the index, leaving its bucket in place.  The caller reuses
+	// or frees it.
+	TopkIndex RemoveMin();
+
+	// Returns an unlinked element to the unused ones.
+	void FreeElement(TopkIndex e);
+
 	TypePtr type;
 	zeek::detail::CompositeHash* hash;
-	std::list<Bucket*> buckets;
-	PDict<Element>* elementDict;
+	std::vector<Element> elements;
+	std::vector<Bucket> buckets;
+	TopkIndex freeElements = TOPK_NONE;
+	TopkIndex freeBuckets = TOPK_NONE;
+	TopkIndex minBucket = TOPK_NONE; // smallest count
+	TopkIndex maxBucket = TOPK_NONE; // largest count
+	std::vector<TopkIndex> slots; // open addressing over elements, by key
 	uint64_t size; // how many elements are we tracking?
 	uint64_t numElements; // how many elements do we have at the moment
 	bool pruned; // was this data structure pruned?
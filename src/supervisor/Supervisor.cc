@@ -12,6 +12,7 @@
 #include <cstdio>
 #include <csignal>
 #include <cstdarg>
+#include <set>
 #include <sstream>
 #include <variant>
 #include <utility>
@@ -87,7 +88,17 @@ struct Stem {
 	 *   - return value is True: we are the parent and fork() succeeded
 	 *   - return value is False: we are the parent and fork() failed
 	 */
-	std::variant<bool, SupervisedNode> Spawn(SupervisorNode* node);
+	std::variant<bool, SupervisedNode> Spawn(SupervisorNode* node, bool spare = false);
+
+	/**
+	 * Hands a node over to its warm spare, if it has one.
+	 * @return true if the spare took over.
+	 */
+	bool Activate(SupervisorNode* node);
+
+	void DestroySpare(SupervisorNode* node) const;
+
+	bool WaitSpare(SupervisorNode* node, int options) const;
 
 	int AliveNodeCount() const;
 
@@ -658,6 +669,9 @@ void Stem::Reap()
 		{
 		auto& node = n.second;
 
+		if ( node.spare.pid )
+			WaitSpare(&node, WNOHANG);
+
 		if ( ! node.pid )
 			continue;
 
@@ -665,6 +679,39 @@ void Stem::Reap()
 		}
 	}
 
+bool Stem::WaitSpare(SupervisorNode* node, int options) const
+	{
+	auto& spare = node->spare;
+	int status;
+	auto res = waitpid(spare.pid, &status, options);
+
+	if ( res == 0 )
+		return false;
+
+	if ( res == -1 )
+		{
+		LogError("Stem failed to get exit status of warm spare of node '%s' (PID %d): %s",
+		         node->Name().data(), spare.pid, strerror(errno));
+		return false;
+		}
+
+	if ( ! spare.killed )
+		LogError("Warm spare of supervised node '%s' (PID %d) exited prematurely",
+		         node->Name().data(), spare.pid);
+
+	if ( spare.activation_fd >= 0 )
+		util::safe_close(spare.activation_fd);
+
+	spare.stdout_pipe.Drain();
+	spare.stderr_pipe.Drain();
+
+	// The spawn time limits how soon the next spare gets spawned.
+	auto spawn_time = spare.spawn_time;
+	spare = SupervisorNode::Spare();
+	spare.spawn_time = spawn_time;
+	return true;
+	}
+
 bool Stem::Wait(SupervisorNode* node, int options) const
 	{
 	if ( node->pid <= 0 )
@@ -746,12 +793,29 @@ static int get_kill_signal(int attempts, int max_attempts)
 	return SIGKILL;
 	}
 
+void Stem::DestroySpare(SupervisorNode* node) const
+	{
+	if ( ! node->spare.pid )
+		return;
+
+	// A spare has yet to do anything worth shutting down for.
+	node->spare.killed = true;
+
+	if ( kill(node->spare.pid, SIGKILL) == -1 )
+		LogError("Failed to kill warm spare of node '%s' (PID %d): %s",
+		         node->Name().data(), node->spare.pid, strerror(errno));
+
+	WaitSpare(node, 0);
+	}
+
 void Stem::Destroy(SupervisorNode* node) const
 	{
 	constexpr auto max_term_attempts = 13;
 	constexpr auto kill_delay = 2;
 	auto kill_attempts = 0;
 
+	DestroySpare(node);
+
 	if ( node->pid <= 0 )
 		{
 		DBG_STEM("Stem skip killing/waiting node '%s' (PID %d): already dead",
@@ -795,6 +859,25 @@ std::optional<SupervisedNode> Stem::Revive()
 				node.revival_delay = 1;
 				}
 
+			auto spare_delay = std::chrono::seconds(node.revival_delay);
+
+			if ( node.config.warm_spare && ! node.spare.pid &&
+			     now - node.spare.spawn_time >= spare_delay )
+				{
+				auto spawn_res = Spawn(&node, true);
+
+				if ( std::holds_alternative<SupervisedNode>(spawn_res) )
+					return std::get<SupervisedNode>(spawn_res);
+				}
+
+			continue;
+			}
+
+		if ( Activate(&node) )
+			{
+			LogError("Supervised node '%s' (PID %d) taken over by its warm spare after premature exit",
+			         node.Name().data(), node.pid);
+			ReportStatus(node);
 			continue;
 			}
 
@@ -823,16 +906,33 @@ std::optional<SupervisedNode> Stem::Revive()
 	return {};
 	}
 
-std::variant<bool, SupervisedNode> Stem::Spawn(SupervisorNode* node)
+std::variant<bool, SupervisedNode> Stem::Spawn(SupervisorNode* node, bool spare)
 	{
+	int activation_fds[2] = {-1, -1};
+
+	if ( spare && ::pipe(activation_fds) == -1 )
+		{
+		LogError("failed to create activation pipe for warm spare of Zeek node '%s': %s",
+		         node->Name().data(), strerror(errno));
+		return false;
+		}
+
 	auto ppid = getpid();
-	auto fork_res = fork_with_stdio_redirect(util::fmt("node %s", node->Name().data()));
+	auto fork_res = fork_with_stdio_redirect(util::fmt("node %s%s", node->Name().data(),
+	                                                   spare ? " spare" : ""));
 	auto node_pid = fork_res.pid;
 
 	if ( node_pid == -1 )
 		{
 		LogError("failed to fork Zeek node '%s': %s",
 		         node->Name().data(), strerror(errno));
+
+		if ( spare )
+			{
+			util::safe_close(activation_fds[0]);
+			util::safe_close(activation_fds[1]);
+			}
+
 		return false;
 		}
 
@@ -841,12 +941,45 @@ std::variant<bool, SupervisedNode> Stem::Spawn(SupervisorNode* node)
 		setsignal(SIGCHLD, SIG_DFL);
 		setsignal(SIGTERM, SIG_DFL);
 		util::detail::set_thread_name(util::fmt("zeek.%s", node->Name().data()));
+
+		// Spares have to see the Stem closing their activation pipes,
+		// so no other process may keep them open.
+		for ( const auto& n : nodes )
+			if ( n.second.spare.activation_fd >= 0 )
+				util::safe_close(n.second.spare.activation_fd);
+
 		SupervisedNode rval;
 		rval.config = node->config;
 		rval.parent_pid = ppid;
+
+		if ( spare )
+			{
+			util::safe_close(activation_fds[1]);
+			rval.activation_fd = activation_fds[0];
+			}
+
 		return rval;
 		}
 
+	if ( spare )
+		{
+		util::safe_close(activation_fds[0]);
+		auto& s = node->spare;
+		s.pid = node_pid;
+		s.killed = false;
+		s.activation_fd = activation_fds[1];
+		auto prefix = util::fmt("[%s] ", node->Name().data());
+		s.stdout_pipe.pipe = std::move(fork_res.stdout_pipe);
+		s.stdout_pipe.prefix = prefix;
+		s.stdout_pipe.stream = stdout;
+		s.stderr_pipe.pipe = std::move(fork_res.stderr_pipe);
+		s.stderr_pipe.prefix = prefix;
+		s.stderr_pipe.stream = stderr;
+		s.spawn_time = std::chrono::steady_clock::now();
+		DBG_STEM("Stem spawned warm spare of node: %s (PID %d)", node->Name().data(), s.pid);
+		return true;
+		}
+
 	node->pid = node_pid;
 	auto prefix = util::fmt("[%s] ", node->Name().data());
 	node->stdout_pipe.pipe = std::move(fork_res.stdout_pipe);
@@ -860,21 +993,69 @@ std::variant<bool, SupervisedNode> Stem::Spawn(SupervisorNode* node)
 	return true;
 	}
 
+bool Stem::Activate(SupervisorNode* node)
+	{
+	auto& s = node->spare;
+
+	if ( ! s.pid )
+		return false;
+
+	char go = 1;
+
+	if ( ! util::safe_write(s.activation_fd, &go, 1) )
+		{
+		LogError("failed to activate warm spare of node '%s' (PID %d)",
+		         node->Name().data(), s.pid);
+		DestroySpare(node);
+		return false;
+		}
+
+	util::safe_close(s.activation_fd);
+	s.activation_fd = -1;
+
+	node->pid = s.pid;
+	node->killed = false;
+	node->stdout_pipe = std::move(s.stdout_pipe);
+	node->stderr_pipe = std::move(s.stderr_pipe);
+	node->spawn_time = std::chrono::steady_clock::now();
+
+	// The next spare follows after the revival delay.
+	s = SupervisorNode::Spare();
+	s.spawn_time = node->spawn_time;
+	DBG_STEM("Stem activated warm spare of node: %s (PID %d)", node->Name().data(), node->pid);
+	return true;
+	}
+
 int Stem::AliveNodeCount() const
 	{
 	auto rval = 0;
 
 	for ( const auto& n : nodes )
+		{
 		if ( n.second.pid )
 			++rval;
 
+		if ( n.second.spare.pid )
+			++rval;
+		}
+
 	return rval;
 	}
 
 void Stem::KillNodes(int signal)
 	{
 	for ( auto& n : nodes )
+		{
 		KillNode(&n.second, signal);
+
+		auto& spare = n.second.spare;
+
+		if ( spare.pid > 0 )
+			{
+			spare.killed = true;
+			kill(spare.pid, signal);
+			}
+		}
 	}
 
 void Stem::Shutdown(int exit_code)
@@ -982,7 +1163,7 @@ std::optional<SupervisedNode> Stem::Poll()
 	{
 	std::map<std::string, int> node_pollfd_indices;
 	constexpr auto fixed_fd_count = 2;
-	const auto total_fd_count = fixed_fd_count + (nodes.size() * 2);
+	const auto total_fd_count = fixed_fd_count + (nodes.size() * 4);
 	auto pfds = std::make_unique<pollfd[]>(total_fd_count);
 	int pfd_idx = 0;
 	pfds[pfd_idx++] = { pipe->InFD(), POLLIN, 0 };
@@ -1001,6 +1182,16 @@ std::optional<SupervisedNode> Stem::Poll()
 			pfds[pfd_idx++] = { node.stderr_pipe.pipe->ReadFD(), POLLIN, 0 };
 		else
 			pfds[pfd_idx++] = { -1, POLLIN, 0 };
+
+		if ( node.spare.stdout_pipe.pipe )
+			pfds[pfd_idx++] = { node.spare.stdout_pipe.pipe->ReadFD(), POLLIN, 0 };
+		else
+			pfds[pfd_idx++] = { -1, POLLIN, 0 };
+
+		if ( node.spare.stderr_pipe.pipe )
+			pfds[pfd_idx++] = { node.spare.stderr_pipe.pipe->ReadFD(), POLLIN, 0 };
+		else
+			pfds[pfd_idx++] = { -1, POLLIN, 0 };
 		}
 
 	// Note: the poll timeout here is for periodically checking if the parent
@@ -1066,6 +1257,12 @@ std::optional<SupervisedNode> Stem::Poll()
 
 		if ( pfds[idx + 1].revents )
 			node.stderr_pipe.Process();
+
+		if ( pfds[idx + 2].revents )
+			node.spare.stdout_pipe.Process();
+
+		if ( pfds[idx + 3].revents )
+			node.spare.stderr_pipe.Process();
 		}
 
 	if ( ! pfds[0].revents )
@@ -1251,6 +1448,13 @@ Supervisor::NodeConfig Supervisor::NodeConfig::FromRecord(const RecordVal* node)
 	if ( affinity_val )
 		rval.cpu_affinity = affinity_val->AsInt();
 
+	const auto& numa_val = node->GetField("numa_node");
+
+	if ( numa_val )
+		rval.numa_node = numa_val->AsInt();
+
+	rval.warm_spare = node->GetFieldOrDefault("warm_spare")->AsBool();
+
 	auto scripts_val = node->GetField("scripts")->AsVectorVal();
 
 	for ( auto i = 0u; i < scripts_val->Size(); ++i )
@@ -1310,6 +1514,12 @@ Supervisor::NodeConfig Supervisor::NodeConfig::FromJSON(std::string_view json)
 	if ( auto it = j.FindMember("cpu_affinity"); it != j.MemberEnd() )
 		rval.cpu_affinity = it->value.GetInt();
 
+	if ( auto it = j.FindMember("numa_node"); it != j.MemberEnd() )
+		rval.numa_node = it->value.GetInt();
+
+	if ( auto it = j.FindMember("warm_spare"); it != j.MemberEnd() )
+		rval.warm_spare = it->value.GetBool();
+
 	auto& scripts = j["scripts"];
 
 	for ( auto it = scripts.Begin(); it != scripts.End(); ++it )
@@ -1366,6 +1576,11 @@ RecordValPtr Supervisor::NodeConfig::ToRecord() const
 	if ( cpu_affinity )
 		rval->Assign(rt->FieldOffset("cpu_affinity"), val_mgr->Int(*cpu_affinity));
 
+	if ( numa_node )
+		rval->Assign(rt->FieldOffset("numa_node"), val_mgr->Int(*numa_node));
+
+	rval->Assign(rt->FieldOffset("warm_spare"), val_mgr->Bool(warm_spare));
+
 	auto st = rt->GetFieldType<VectorType>("scripts");
 	auto scripts_val = make_intrusive<VectorVal>(std::move(st));
 
@@ -1478,21 +1693,92 @@ bool SupervisedNode::InitCluster() const
 	return true;
 	}
 
-void SupervisedNode::Init(Options* options) const
+// Returns the NUMA node of the device behind an interface name, which may
+// carry a packet source prefix like "af_packet::".
+static int interface_numa_node(const std::string& iface)
 	{
-	const auto& node_name = config.name;
+	auto pos = iface.rfind("::");
+	return numa_device_node(pos == std::string::npos ? iface : iface.substr(pos + 2));
+	}
 
-	if ( config.directory )
+// Runs a supervised node on the cores of its NUMA node, with its memory
+// preferably from there too: the configured one, or for a node reading
+// from an interface the one that the interface's device is local to.
+// Other cluster nodes get the NUMA nodes that no worker's interface is
+// local to, if there are any, so they don't take cores from the workers.
+static void set_numa_placement(const std::string& node_name,
+                               const Supervisor::NodeConfig& config)
+	{
+	if ( config.cpu_affinity && ! config.numa_node )
+		return;
+
+	auto online = numa_online_nodes();
+	std::vector<int> nodes;
+
+	if ( config.numa_node )
+		nodes.push_back(*config.numa_node);
+
+	else if ( online.size() < 2 )
+		return;
+
+	else if ( config.interface )
 		{
-		if ( chdir(config.directory->data()) )
+		auto n = interface_numa_node(*config.interface);
+
+		if ( n >= 0 )
+			nodes.push_back(n);
+		}
+
+	else
+		{
+		std::set<int> worker_nodes;
+
+		for ( const auto& e : config.cluster )
 			{
-			fprintf(stderr, "node '%s' failed to chdir to %s: %s\n",
-			        node_name.data(), config.directory->data(),
-			        strerror(errno));
-			exit(1);
+			if ( e.second.role != BifEnum::Supervisor::WORKER || ! e.second.interface )
+				continue;
+
+			auto n = interface_numa_node(*e.second.interface);
+
+			if ( n >= 0 )
+				worker_nodes.insert(n);
 			}
+
+		if ( ! worker_nodes.empty() )
+			for ( auto n : online )
+				if ( worker_nodes.count(n) == 0 )
+					nodes.push_back(n);
+		}
+
+	if ( nodes.empty() )
+		return;
+
+	if ( ! config.cpu_affinity )
+		{
+		std::vector<int> cores;
+
+		for ( auto n : nodes )
+			{
+			auto c = numa_node_cores(n);
+			cores.insert(cores.end(), c.begin(), c.end());
+			}
+
+		if ( cores.empty() || ! set_affinity(cores) )
+			fprintf(stderr, "node '%s' failed to set CPU affinity for NUMA placement: %s\n",
+			        node_name.data(), cores.empty() ? "no such NUMA node" : strerror(errno));
 		}
 
+	if ( nodes.size() == 1 && ! set_numa_preferred(nodes[0]) )
+		fprintf(stderr, "node '%s' failed to prefer memory of NUMA node %d: %s\n",
+		        node_name.data(), nodes[0], strerror(errno));
+	}
+
+// Redirects a node's stdout and stderr to the files its configuration
+// asks for.
+static void redirect_stdio(const Supervisor::NodeConfig& config)
+	{
+	const auto& node_name = config.name;
+
 	if ( config.stderr_file )
 		{
 		auto fd = open(config.stderr_file->data(),
@@ -1526,6 +1812,27 @@ void SupervisedNode::Init(Options* options) const
 
 		util::safe_close(fd);
 		}
+	}
+
+void SupervisedNode::Init(Options* options) const
+	{
+	const auto& node_name = config.name;
+
+	if ( config.directory )
+		{
+		if ( chdir(config.directory->data()) )
+			{
+			fprintf(stderr, "node '%s' failed to chdir to %s: %s\n",
+			        node_name.data(), config.directory->data(),
+			        strerror(errno));
+			exit(1);
+			}
+		}
+
+	// A warm spare mustn't clobber the node's output files before it
+	// takes over.
+	if ( activation_fd < 0 )
+		redirect_stdio(config);
 
 	if ( config.cpu_affinity )
 		{
@@ -1536,6 +1843,8 @@ void SupervisedNode::Init(Options* options) const
 			        node_name.data(), strerror(errno));
 		}
 
+	set_numa_placement(node_name, config);
+
 	if ( ! config.cluster.empty() )
 		{
 		if ( setenv("CLUSTER_NODE", node_name.data(), true) == -1 )
@@ -1555,6 +1864,26 @@ void SupervisedNode::Init(Options* options) const
 		options->scripts_to_load.emplace_back(s);
 	}
 
+void SupervisedNode::AwaitActivation() const
+	{
+	if ( activation_fd < 0 )
+		return;
+
+	char go;
+	ssize_t n;
+
+	while ( (n = read(activation_fd, &go, 1)) == -1 && errno == EINTR )
+		;
+
+	if ( n != 1 )
+		// The Stem closed the pipe, so it doesn't need this spare
+		// anymore.
+		exit(0);
+
+	util::safe_close(activation_fd);
+	redirect_stdio(config);
+	}
+
 RecordValPtr Supervisor::Status(std::string_view node_name)
 	{
 	auto rval = make_intrusive<RecordVal>(BifType::Record::Supervisor::Status);
@@ -186,6 +186,15 @@ public:
 		 * A cpu/core number to which the node will try to pin itself.
 		 */
 		std::optional<int> cpu_affinity;
+		/**
+		 * A NUMA node on whose cores the node will run and from whose
+		 * memory it will preferably allocate.
+		 */
+		std::optional<int> numa_node;
+		/**
+		 * Whether the Stem keeps a warm spare of the node.
+		 */
+		bool warm_spare = false;
 		/**
 		 * Additional script filename/paths that the node should load.
 		 */
@@ -371,6 +380,13 @@ struct SupervisedNode {
 	 */
 	void Init(Options* options) const;
 
+	/**
+	 * For a warm spare, waits until the Stem tells it to take over, or
+	 * exits if the Stem gives up on it instead.  Returns right away for
+	 * other nodes.
+	 */
+	void AwaitActivation() const;
+
 	/**
 	 * The node's configuration options.
 	 */
@@ -380,6 +396,11 @@ struct SupervisedNode {
 	 * of the Stem process).
 	 */
 	pid_t parent_pid;
+	/**
+	 * For a warm spare, the pipe from which it reads that it takes over,
+	 * else -1.
+	 */
+	int activation_fd = -1;
 };
 
 /**
@@ -449,6 +470,26 @@ struct SupervisorNode {
 	 * any output written to the Node's stdout.
 	 */
 	detail::LineBufferedPipe stderr_pipe;
+
+	/**
+	 * A process that initialized itself as the node and waits to take
+	 * over once the node's process dies.
+	 */
+	struct Spare {
+		pid_t pid = 0;
+		bool killed = false;
+		// Writing to it activates the spare, closing it makes the
+		// spare exit.
+		int activation_fd = -1;
+		std::chrono::time_point<std::chrono::steady_clock> spawn_time;
+		detail::LineBufferedPipe stdout_pipe;
+		detail::LineBufferedPipe stderr_pipe;
+	};
+
+	/**
+	 * The node's warm spare, if its configuration asks for one.
+	 */
+	Spare spare;
 };
 
 /**
@@ -5,6 +5,7 @@
 #include <pthread.h>
 
 #include "zeek/threading/Manager.h"
+#include "zeek/threading/WorkerPool.h"
 #include "zeek/util.h"
 
 namespace zeek::threading {
@@ -46,6 +47,10 @@ void BasicThread::SetName(const char* arg_name)
 
 void BasicThread::SetOSName(const char* arg_name)
 	{
+	// Pooled threads share the OS threads of the pool.
+	if ( pool )
+		return;
+
 	static_assert(std::is_same<std::thread::native_handle_type, pthread_t>::value, "libstdc++ doesn't use pthread_t");
 	util::detail::set_thread_name(arg_name, thread.native_handle());
 	}
@@ -94,9 +99,12 @@ void BasicThread::Start()
 
 	started = true;
 
-	thread = std::thread(&BasicThread::launcher, this);
+	if ( pool )
+		pool->Schedule(this);
+	else
+		thread = std::thread(&BasicThread::launcher, this);
 
-	DBG_LOG(DBG_THREADING, "Started thread %s", name);
+	DBG_LOG(DBG_THREADING, "Started thread %s%s", name, pool ? " in worker pool" : "");
 
 	OnStart();
 	}
@@ -131,6 +139,14 @@ void BasicThread::Join()
 	if ( ! started )
 		return;
 
+	if ( pool )
+		{
+		assert(terminating);
+		pool->Join(this);
+		DBG_LOG(DBG_THREADING, "Joined with pooled thread %s", name);
+		return;
+		}
+
 	if ( ! thread.joinable() )
 		return;
 
@@ -158,6 +174,12 @@ void BasicThread::Kill()
 	OnKill();
 	}
 
+void BasicThread::Wake()
+	{
+	if ( pool && started )
+		pool->Schedule(this);
+	}
+
 void BasicThread::Done()
 	{
 	DBG_LOG(DBG_THREADING, "Thread %s has finished", name);
@@ -166,11 +188,8 @@ void BasicThread::Done()
 	killed = true;
 	}
 
-void* BasicThread::launcher(void *arg)
+void BasicThread::BlockSignals()
 	{
-	static_assert(std::is_same<std::thread::native_handle_type, pthread_t>::value, "libstdc++ doesn't use pthread_t");
-	BasicThread* thread = (BasicThread *)arg;
-
 	// Block signals in thread. We handle signals only in the main
 	// process.
 	sigset_t mask_set;
@@ -185,6 +204,14 @@ void* BasicThread::launcher(void *arg)
 	sigdelset(&mask_set, SIGBUS);
 	int res = pthread_sigmask(SIG_BLOCK, &mask_set, 0);
 	assert(res == 0);
+	}
+
+void* BasicThread::launcher(void *arg)
+	{
+	static_assert(std::is_same<std::thread::native_handle_type, pthread_t>::value, "libstdc++ doesn't use pthread_t");
+	BasicThread* thread = (BasicThread *)arg;
+
+	BlockSignals();
 
 	// Run thread's main function.
 	thread->Run();
@@ -5,10 +5,12 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <iosfwd>
 #include <thread>
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(Manager, zeek, threading);
+ZEEK_FORWARD_DECLARE_NAMESPACED(WorkerPool, zeek, threading);
 
 namespace zeek::threading {
 
@@ -63,6 +65,23 @@ public:
 	 */
 	void SetOSName(const char* name);
 
+	/**
+	 * Runs the thread as a task of a WorkerPool rather than in an OS
+	 * thread of its own. This requires the thread to split its work
+	 * into slices, see RunSlice().
+	 *
+	 * This method must be called only from the main thread, before
+	 * Start().
+	 */
+	void SetPool(WorkerPool* arg_pool)	{ pool = arg_pool; }
+
+	/**
+	 * Returns true if the thread runs as a task of a WorkerPool.
+	 *
+	 * This method is safe to call from any thread.
+	 */
+	bool Pooled() const	{ return pool != nullptr; }
+
 	/**
 	 * Starts the thread. Calling this methods will spawn a new OS thread
 	 * executing Run(). Note that one can't restart a thread after a
@@ -130,6 +149,16 @@ public:
 
 protected:
 	friend class Manager;
+	friend class WorkerPool;
+
+	/**
+	 * The outcomes of RunSlice().
+	 */
+	enum SliceResult {
+		SLICE_MORE,	// Stopped with more work left.
+		SLICE_IDLE,	// Stopped for lack of work.
+		SLICE_DONE,	// Finished, like a return from Run().
+	};
 
 	/**
 	 * Entry point for the thread. This must be overridden by derived
@@ -140,6 +169,25 @@ protected:
 	 */
 	virtual void Run() = 0;
 
+	/**
+	 * Entry point for a pooled thread, see SetPool(). This gets called
+	 * whenever the thread may have work, and must return after a short
+	 * while so that the pool's other tasks get their turn. Unless it
+	 * returns SLICE_MORE, it doesn't get called again until Wake().
+	 *
+	 * The default implementation runs Run() to completion, which only
+	 * suits threads with short-lived work.
+	 */
+	virtual SliceResult RunSlice()	{ Run(); return SLICE_DONE; }
+
+	/**
+	 * Lets a pooled thread's next RunSlice() happen, e.g. after new work
+	 * arrived. Does nothing for other threads.
+	 *
+	 * This method must be called only from the main thread.
+	 */
+	void Wake();
+
 	/**
 	 * Executed with Start(). This is a hook into starting the thread. It
 	 * will be called from Bro's main thread after the OS thread has been
@@ -197,12 +245,22 @@ private:
 	// thread entry function.
 	static void* launcher(void *arg);
 
+	// Blocks the signals that the main thread handles.
+	static void BlockSignals();
+
 	const char* name;
 	std::thread thread;
 	bool started; 		// Set to to true once running.
 	bool terminating;	// Set to to true to signal termination.
 	bool killed;	// Set to true once forcefully killed.
 
+	// For running as a pooled task. The state counts wake-ups in all
+	// but the lowest bit, which is set while the task is queued or
+	// running; done is protected by the pool's mutex.
+	WorkerPool* pool = nullptr;
+	std::atomic<uint64_t> pool_state{0};
+	bool pool_done = false;
+
 	// For implementing Fmt().
 	char* buf;
 	unsigned int buf_len;
@@ -4,9 +4,11 @@
 #include "zeek/threading/Formatter.h"
 
 #include <errno.h>
+#include <stdarg.h>
 
 #include "zeek/threading/MsgThread.h"
 #include "zeek/bro_inet_ntop.h"
+#include "zeek/IPAddr.h"
 
 using zeek::threading::Value;
 using zeek::threading::Field;
@@ -22,16 +24,32 @@ Formatter::~Formatter()
 	{
 	}
 
+void Formatter::Warning(const char* fmt, ...) const
+	{
+	va_list al;
+	va_start(al, fmt);
+	int n = vsnprintf(nullptr, 0, fmt, al);
+	va_end(al);
+
+	std::string msg(n > 0 ? n : 0, '\0');
+
+	va_start(al, fmt);
+	vsnprintf(&msg[0], msg.size() + 1, fmt, al);
+	va_end(al);
+
+	if ( warnings )
+		warnings->push_back(std::move(msg));
+	else
+		thread->Warning(msg.c_str());
+	}
+
 std::string Formatter::Render(const threading::Value::addr_t& addr)
 	{
 	if ( addr.family == IPv4 )
 		{
 		char s[INET_ADDRSTRLEN];
-
-		if ( ! bro_inet_ntop(AF_INET, &addr.in.in4, s, INET_ADDRSTRLEN) )
-			return "<bad IPv4 address conversion>";
-		else
-			return s;
+		int n = IPAddr::FormatIPv4(addr.in.in4, s);
+		return {s, static_cast<size_t>(n)};
 		}
 	else
 		{
@@ -55,7 +73,7 @@ TransportProto Formatter::ParseProto(const std::string &proto) const
 	else if ( proto == "icmp" )
 		return TRANSPORT_ICMP;
 
-	thread->Warning(thread->Fmt("Tried to parse invalid/unknown protocol: %s", proto.c_str()));
+	Warning("Tried to parse invalid/unknown protocol: %s", proto.c_str());
 
 	return TRANSPORT_UNKNOWN;
 	}
@@ -72,7 +90,7 @@ threading::Value::addr_t Formatter::ParseAddr(const std::string &s) const
 
 		if ( inet_aton(s.c_str(), &(val.in.in4)) <= 0 )
 			{
-			thread->Warning(thread->Fmt("Bad address: %s", s.c_str()));
+			Warning("Bad address: %s", s.c_str());
 			memset(&val.in.in4.s_addr, 0, sizeof(val.in.in4.s_addr));
 			}
 		}
@@ -85,7 +103,7 @@ threading::Value::addr_t Formatter::ParseAddr(const std::string &s) const
 			clean_s = s.substr(1, s.length() - 2);
 		if ( inet_pton(AF_INET6, clean_s.c_str(), val.in.in6.s6_addr) <= 0 )
 			{
-			thread->Warning(thread->Fmt("Bad address: %s", clean_s.c_str()));
+			Warning("Bad address: %s", clean_s.c_str());
 			memset(val.in.in6.s6_addr, 0, sizeof(val.in.in6.s6_addr));
 			}
 		}
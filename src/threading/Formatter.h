@@ -3,6 +3,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "zeek/Type.h"
 #include "zeek/threading/SerialTypes.h"
@@ -152,6 +153,17 @@ public:
 	 */
 	Value::addr_t ParseAddr(const std::string &addr) const;
 
+	/**
+	 * Collects the warnings the formatter raises into a vector rather
+	 * than reporting them through the thread.  That allows parsing on
+	 * other threads than the formatter's, with each using a formatter of
+	 * its own.
+	 *
+	 * @param sink The vector to append warnings to, or null to report
+	 * them through the thread again.
+	 */
+	void CollectWarnings(std::vector<std::string>* sink)	{ warnings = sink; }
+
 protected:
 	/**
 	 * Returns the thread associated with the formatter via the
@@ -159,8 +171,15 @@ protected:
 	 */
 	MsgThread* GetThread() const	{ return thread; }
 
+	/**
+	 * Reports a warning through the thread, or collects it if
+	 * CollectWarnings() says so.  Works printf()-style.
+	 */
+	void Warning(const char* fmt, ...) const __attribute__((format(printf, 2, 3)));
+
 private:
 	MsgThread* thread;
+	std::vector<std::string>* warnings = nullptr;
 };
 
 } // namespace zeek::threading
@@ -2,6 +2,7 @@
 
 #include <sys/socket.h>
 #include <unistd.h>
+#include <algorithm>
 
 #include "zeek/NetVar.h"
 #include "zeek/iosource/Manager.h"
@@ -21,6 +22,48 @@ void HeartbeatTimer::Dispatch(double t, bool is_expire)
 	thread_mgr->StartHeartbeatTimer();
 	}
 
+OutputSource::OutputSource()
+	{
+	if ( ! iosource_mgr->RegisterFd(flare.FD(), this) )
+		reporter->FatalError("Failed to register thread output fd with iosource_mgr");
+	}
+
+OutputSource::~OutputSource()
+	{
+	iosource_mgr->UnregisterFd(flare.FD(), this);
+	}
+
+void OutputSource::Signal(MsgThread* thread)
+	{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// Only the first thread needs to wake up the main loop.
+	if ( ready.empty() )
+		flare.Fire();
+
+	ready.push_back(thread);
+	}
+
+void OutputSource::Forget(MsgThread* thread)
+	{
+	std::unique_lock<std::mutex> lock(mutex);
+	ready.erase(std::remove(ready.begin(), ready.end(), thread), ready.end());
+	}
+
+void OutputSource::Process()
+	{
+		{
+		std::unique_lock<std::mutex> lock(mutex);
+		flare.Extinguish();
+		processing.swap(ready);
+		}
+
+	for ( MsgThread* t : processing )
+		t->Process();
+
+	processing.clear();
+	}
+
 } // namespace detail
 
 Manager::Manager()
@@ -63,6 +106,11 @@ void Manager::Terminate()
 
 	all_threads.clear();
 	msg_threads.clear();
+	output_source.reset();
+
+	// All pooled threads are gone now.
+	writer_pool.reset();
+
 	terminating = false;
 	}
 
@@ -79,6 +127,39 @@ void Manager::AddMsgThread(MsgThread* thread)
 	{
 	DBG_LOG(DBG_THREADING, "%s is a MsgThread ...", thread->Name());
 	msg_threads.push_back(thread);
+
+	if ( ! output_source )
+		output_source = std::make_unique<detail::OutputSource>();
+	}
+
+void Manager::DeleteThread(BasicThread* t)
+	{
+	t->WaitForStop();
+
+	all_threads.remove(t);
+
+	MsgThread* mt = dynamic_cast<MsgThread *>(t);
+
+	if ( mt )
+		{
+		msg_threads.remove(mt);
+		output_source->Forget(mt);
+		}
+
+	t->Join();
+	delete t;
+	}
+
+WorkerPool* Manager::WriterPool()
+	{
+	if ( ! writer_pool && BifConst::Threading::writer_pool_size > 0 )
+		{
+		DBG_LOG(DBG_THREADING, "Starting pool of %" PRIu64 " writer threads ...",
+		        BifConst::Threading::writer_pool_size);
+		writer_pool = std::make_unique<WorkerPool>(BifConst::Threading::writer_pool_size);
+		}
+
+	return writer_pool.get();
 	}
 
 void Manager::KillThreads()
@@ -112,20 +193,7 @@ void Manager::SendHeartbeats()
 		}
 
 	for ( all_thread_list::iterator i = to_delete.begin(); i != to_delete.end(); i++ )
-		{
-		BasicThread* t = *i;
-		t->WaitForStop();
-
-		all_threads.remove(t);
-
-		MsgThread* mt = dynamic_cast<MsgThread *>(t);
-
-		if ( mt )
-			msg_threads.remove(mt);
-
-		t->Join();
-		delete t;
-		}
+		DeleteThread(*i);
 	}
 
 void Manager::StartHeartbeatTimer()
@@ -239,20 +307,7 @@ void Manager::Flush()
 		}
 
 	for ( all_thread_list::iterator i = to_delete.begin(); i != to_delete.end(); i++ )
-		{
-		BasicThread* t = *i;
-		t->WaitForStop();
-
-		all_threads.remove(t);
-
-		MsgThread* mt = dynamic_cast<MsgThread *>(t);
-
-		if ( mt )
-			msg_threads.remove(mt);
-
-		t->Join();
-		delete t;
-		}
+		DeleteThread(*i);
 
 	// fprintf(stderr, "P %.6f %.6f do_beat=%d did_process=%d next_next=%.6f\n", run_state::network_time,
 	//         detail::timer_mgr->Time(), do_beat, (int)did_process, next_beat);
@@ -1,9 +1,14 @@
 #pragma once
 
 #include <list>
+#include <memory>
+#include <mutex>
 #include <utility>
+#include <vector>
 
 #include "zeek/threading/MsgThread.h"
+#include "zeek/threading/WorkerPool.h"
+#include "zeek/Flare.h"
 #include "zeek/Timer.h"
 
 namespace zeek {
@@ -22,6 +27,39 @@ protected:
 	void Init();
 };
 
+/**
+ * Wakes up the main loop once message threads have output for it, through
+ * a single flare for all of them, and then processes the output of just
+ * those threads.
+ */
+class OutputSource final : public iosource::IOSource {
+public:
+	OutputSource();
+	~OutputSource() override;
+
+	/**
+	 * Queues a thread for processing its output.
+	 *
+	 * This method is safe to call from any thread.
+	 */
+	void Signal(MsgThread* thread);
+
+	/**
+	 * Drops a thread that's going away.
+	 */
+	void Forget(MsgThread* thread);
+
+	void Process() override;
+	const char* Tag() override	{ return "threading::OutputSource"; }
+	double GetNextTimeout() override	{ return -1; }
+
+private:
+	zeek::detail::Flare flare;
+	std::mutex mutex;
+	std::vector<MsgThread*> ready;	// Protected by the mutex.
+	std::vector<MsgThread*> processing;
+};
+
 } // namespace detail
 
 /**
@@ -103,6 +141,19 @@ public:
 	 */
 	bool SendEvent(MsgThread* thread, const std::string& name, const int num_vals, Value* *vals) const;
 
+	/**
+	 * Returns the pool that log writers run in, creating it on first
+	 * use, or null if Threading::writer_pool_size is zero.
+	 */
+	WorkerPool* WriterPool();
+
+	/**
+	 * Lets the main thread know that a thread has output for it.
+	 *
+	 * This method is safe to call from any thread.
+	 */
+	void SignalOutput(MsgThread* thread)	{ output_source->Signal(thread); }
+
 protected:
 	friend class BasicThread;
 	friend class MsgThread;
@@ -128,6 +179,9 @@ protected:
 
 	void Flush();
 
+	// Deletes a thread that has stopped.
+	void DeleteThread(BasicThread* thread);
+
 	/**
 	 * Sends heartbeat messages to all active message threads.
 	 */
@@ -152,6 +206,9 @@ private:
 	msg_stats_list stats;
 
 	bool heartbeat_timer_running = false;
+
+	std::unique_ptr<WorkerPool> writer_pool;
+	std::unique_ptr<detail::OutputSource> output_source;
 };
 
 } // namespace threading
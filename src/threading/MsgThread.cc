@@ -3,11 +3,17 @@
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <thread>
+#include <vector>
 
 #include "zeek/DebugLogger.h"
 #include "zeek/threading/Manager.h"
 #include "zeek/iosource/Manager.h"
 #include "zeek/RunState.h"
+#include "zeek/NetVar.h"
+#include "zeek/threading/SPSCQueue.h"
+
+#include "zeek/3rdparty/doctest.h"
 
 // Set by Zeek's main signal handler.
 extern int signal_val;
@@ -59,6 +65,7 @@ public:
 		{ network_time = arg_network_time; current_time = arg_current_time; }
 
 	bool Process() override	{
+		Object()->heartbeat_pending = false;
 		return Object()->OnHeartbeat(network_time, current_time);
 	}
 
@@ -200,7 +207,10 @@ Message::~Message()
 	delete [] name;
 	}
 
-MsgThread::MsgThread() : BasicThread(), queue_in(this, nullptr), queue_out(nullptr, this)
+MsgThread::MsgThread()
+	: BasicThread(),
+	  queue_in(this, nullptr, BifConst::Threading::queue_ring_size),
+	  queue_out(nullptr, this, BifConst::Threading::queue_ring_size)
 	{
 	cnt_sent_in = cnt_sent_out = 0;
 	main_finished = false;
@@ -208,18 +218,11 @@ MsgThread::MsgThread() : BasicThread(), queue_in(this, nullptr), queue_out(nullp
 	child_sent_finish = false;
 	failed = false;
 	thread_mgr->AddMsgThread(this);
-
-	if ( ! iosource_mgr->RegisterFd(flare.FD(), this) )
-		reporter->FatalError("Failed to register MsgThread fd with iosource_mgr");
-
 	SetClosed(false);
 	}
 
 MsgThread::~MsgThread()
 	{
-	// Unregister this thread from the iosource manager so it doesn't wake
-	// up the main poll anymore.
-	iosource_mgr->UnregisterFd(flare.FD(), this);
 	}
 
 void MsgThread::OnSignalStop()
@@ -296,6 +299,9 @@ void MsgThread::OnKill()
 	// input. This is just an optimization to make it terminate more
 	// quickly, even without the message it will eventually time out.
 	queue_in.WakeUp();
+
+	// A pooled thread needs to run to notice.
+	Wake();
 	}
 
 void MsgThread::Heartbeat()
@@ -303,6 +309,10 @@ void MsgThread::Heartbeat()
 	if ( child_sent_finish )
 		return;
 
+	// The pending one will do.
+	if ( heartbeat_pending.exchange(true) )
+		return;
+
 	SendIn(new detail::HeartbeatMessage(this, run_state::network_time, util::current_time()));
 	}
 
@@ -370,6 +380,8 @@ void MsgThread::SendIn(BasicInputMessage* msg, bool force)
 
 	queue_in.Put(msg);
 	++cnt_sent_in;
+
+	Wake();
 	}
 
 
@@ -385,7 +397,9 @@ void MsgThread::SendOut(BasicOutputMessage* msg, bool force)
 
 	++cnt_sent_out;
 
-	flare.Fire();
+	// Let the main thread know, unless it does already.
+	if ( ! output_signaled.exchange(true) )
+		thread_mgr->SignalOutput(this);
 	}
 
 void MsgThread::SendEvent(const char* name, const int num_vals, Value* *vals)
@@ -406,27 +420,38 @@ BasicOutputMessage* MsgThread::RetrieveOut()
 
 BasicInputMessage* MsgThread::RetrieveIn()
 	{
-	BasicInputMessage* msg = queue_in.Get();
+	BasicInputMessage* msg = nullptr;
+	RetrieveIn(&msg, 1);
+	return msg;
+	}
 
-	if ( ! msg )
-		return nullptr;
+size_t MsgThread::RetrieveIn(BasicInputMessage** msgs, size_t max)
+	{
+	size_t n = queue_in.GetBatch(msgs, max);
 
 #ifdef DEBUG
-	std::string s = Fmt("Retrieved '%s' in %s",  msg->Name(), Name());
-	Debug(DBG_THREADING, s.c_str());
+	for ( size_t i = 0; i < n; ++i )
+		{
+		std::string s = Fmt("Retrieved '%s' in %s",  msgs[i]->Name(), Name());
+		Debug(DBG_THREADING, s.c_str());
+		}
 #endif
 
-	return msg;
+	return n;
 	}
 
-void MsgThread::Run()
+void MsgThread::ProcessIn(BasicInputMessage** msgs, size_t n)
 	{
-	while ( ! (child_finished || Killed() ) )
+	for ( size_t i = 0; i < n; ++i )
 		{
-		BasicInputMessage* msg = RetrieveIn();
+		BasicInputMessage* msg = msgs[i];
 
-		if ( ! msg )
+		if ( child_finished || Killed() )
+			{
+			// Same as for messages still queued when we stop.
+			delete msg;
 			continue;
+			}
 
 		bool result = msg->Process();
 
@@ -444,7 +469,10 @@ void MsgThread::Run()
 			failed = true;
 			}
 		}
+	}
 
+void MsgThread::FinishRun()
+	{
 	// In case we haven't sent the finish method yet, do it now. Reading
 	// global network_time here should be fine, it isn't changing
 	// anymore.
@@ -455,6 +483,42 @@ void MsgThread::Run()
 		}
 	}
 
+void MsgThread::Run()
+	{
+	BasicInputMessage* batch[MAX_INPUT_BATCH];
+
+	while ( ! (child_finished || Killed() ) )
+		{
+		size_t n = RetrieveIn(batch, MAX_INPUT_BATCH);
+		ProcessIn(batch, n);
+		}
+
+	FinishRun();
+	}
+
+BasicThread::SliceResult MsgThread::RunSlice()
+	{
+	BasicInputMessage* batch[MAX_INPUT_BATCH];
+	size_t total = 0;
+
+	// Never wait for input here, the pool runs us again once there's
+	// more.
+	while ( total < MAX_INPUT_BATCH && ! (child_finished || Killed()) && HasIn() )
+		{
+		size_t n = RetrieveIn(batch, MAX_INPUT_BATCH - total);
+		ProcessIn(batch, n);
+		total += n;
+		}
+
+	if ( child_finished || Killed() )
+		{
+		FinishRun();
+		return SLICE_DONE;
+		}
+
+	return total < MAX_INPUT_BATCH ? SLICE_IDLE : SLICE_MORE;
+	}
+
 void MsgThread::GetStats(Stats* stats)
 	{
 	stats->sent_in = cnt_sent_in;
@@ -467,7 +531,8 @@ void MsgThread::GetStats(Stats* stats)
 
 void MsgThread::Process()
 	{
-	flare.Extinguish();
+	// Output arriving from here on gets signaled anew.
+	output_signaled.exchange(false);
 
 	while ( HasOut() )
 		{
@@ -484,4 +549,141 @@ void MsgThread::Process()
 		}
 	}
 
+namespace detail {
+
+// Drains everything currently queued, in whatever batch sizes the queue
+// hands out.
+static std::vector<int> drain(SPSCQueue<int>& q)
+	{
+	std::vector<int> result;
+	int batch[3];
+
+	while ( q.Ready() )
+		{
+		size_t n = q.GetBatch(batch, 3);
+		result.insert(result.end(), batch, batch + n);
+		}
+
+	return result;
+	}
+
+TEST_CASE("spsc queue ring wrap")
+	{
+	SPSCQueue<int> q(3, nullptr, nullptr);
+	int next_put = 1;
+	int next_get = 1;
+
+	CHECK_FALSE(q.Ready());
+
+	// Three elements per round in a ring of four moves head and tail
+	// around the ring many times without ever filling it.
+	for ( int round = 0; round < 20; ++round )
+		{
+		for ( int i = 0; i < 3; ++i )
+			q.Put(next_put++);
+
+		CHECK(q.Size() == 3);
+
+		for ( int i = 0; i < 3; ++i )
+			{
+			REQUIRE(q.Ready());
+			CHECK(q.Get() == next_get++);
+			}
+
+		CHECK_FALSE(q.Ready());
+		CHECK(q.Size() == 0);
+		}
+
+	CHECK(q.NumOverflows() == 0);
+	CHECK(q.NumWrites() == 60);
+	CHECK(q.NumReads() == 60);
+	}
+
+TEST_CASE("spsc queue full boundary")
+	{
+	SPSCQueue<int> q(4, nullptr, nullptr);
+
+	for ( int i = 1; i <= 4; ++i )
+		q.Put(i);
+
+	// Exactly full fits in the ring.
+	CHECK(q.NumOverflows() == 0);
+	CHECK(q.Size() == 4);
+
+	q.Put(5);
+	CHECK(q.NumOverflows() == 1);
+	CHECK(q.Size() == 5);
+
+	CHECK(drain(q) == std::vector<int>({1, 2, 3, 4, 5}));
+	CHECK_FALSE(q.Ready());
+	CHECK(q.Size() == 0);
+
+	// With the spill drained, the ring takes elements again.
+	q.Put(6);
+	CHECK(q.NumOverflows() == 1);
+	CHECK(drain(q) == std::vector<int>({6}));
+	}
+
+TEST_CASE("spsc queue overflow keeps order")
+	{
+	SPSCQueue<int> q(4, nullptr, nullptr);
+
+	for ( int i = 1; i <= 6; ++i )
+		q.Put(i);
+
+	CHECK(q.NumOverflows() == 2);
+
+	int first = 0;
+	CHECK(q.GetBatch(&first, 1) == 1);
+	CHECK(first == 1);
+
+	// Room in the ring again, but the spill still holds older elements,
+	// so this one must queue up behind them.
+	q.Put(7);
+	CHECK(q.NumOverflows() == 3);
+	CHECK(q.Size() == 6);
+
+	CHECK(drain(q) == std::vector<int>({2, 3, 4, 5, 6, 7}));
+	CHECK_FALSE(q.Ready());
+	CHECK(q.NumWrites() == 7);
+	CHECK(q.NumReads() == 7);
+	}
+
+TEST_CASE("spsc queue concurrent producer")
+	{
+	constexpr int n = 100000;
+	SPSCQueue<int> q(8, nullptr, nullptr);
+
+	std::thread producer([&q]()
+		{
+		for ( int i = 1; i <= n; ++i )
+			q.Put(i);
+		});
+
+	int expected = 1;
+	bool in_order = true;
+
+	while ( expected <= n )
+		{
+		// Get() returns a default value when it times out on an empty queue.
+		int v = q.Get();
+
+		if ( v == 0 )
+			continue;
+
+		if ( v != expected )
+			in_order = false;
+
+		++expected;
+		}
+
+	producer.join();
+
+	CHECK(in_order);
+	CHECK_FALSE(q.Ready());
+	CHECK(q.NumReads() == n);
+	}
+
+} // namespace detail
+
 } // namespace zeek::threading
@@ -4,7 +4,8 @@
 #include "zeek/threading/BasicThread.h"
 #include "zeek/threading/Queue.h"
 #include "zeek/iosource/IOSource.h"
-#include "zeek/Flare.h"
+
+#include <atomic>
 
 namespace zeek::threading {
 	struct Value;
@@ -211,7 +212,9 @@ public:
 	void GetStats(Stats* stats);
 
 	/**
-	 * Overridden from iosource::IOSource.
+	 * Overridden from iosource::IOSource. Processes all pending output.
+	 * The thread manager calls this when the thread has signaled output
+	 * for the main thread.
 	 */
 	void Process() override;
 	const char* Tag() override { return Name(); }
@@ -273,6 +276,7 @@ protected:
 	 * Overriden from BasicThread.
 	 */
 	void Run() override;
+	SliceResult RunSlice() override;
 	void OnWaitForStop() override;
 	void OnSignalStop() override;
 	void OnKill() override;
@@ -289,6 +293,29 @@ private:
 	 */
 	BasicInputMessage* RetrieveIn();
 
+	/**
+	 * Pops up to \a max messages sent by the main thread at once.
+	 *
+	 * Must only be called by the child thread.
+	 *
+	 * @return The number of messages stored into \a msgs, with ownership
+	 * passed to caller.
+	 */
+	size_t RetrieveIn(BasicInputMessage** msgs, size_t max);
+
+	/**
+	 * Processes messages retrieved with RetrieveIn(), taking ownership.
+	 */
+	void ProcessIn(BasicInputMessage** msgs, size_t n);
+
+	/**
+	 * Wraps up once the thread stops processing messages.
+	 */
+	void FinishRun();
+
+	// Maximum number of messages the child retrieves at once.
+	static constexpr size_t MAX_INPUT_BATCH = 64;
+
 	/**
 	 * Queues a message for the child.
 	 *
@@ -350,7 +377,12 @@ private:
 	bool child_sent_finish; // Child thread asked to be finished.
 	bool failed;	// Set to true when a command failed.
 
-	zeek::detail::Flare flare;
+	// True while the thread manager knows about pending output.
+	std::atomic<bool> output_signaled{false};
+
+	// True while a heartbeat is waiting to be processed, so that a busy
+	// thread doesn't get a backlog of them.
+	std::atomic<bool> heartbeat_pending{false};
 };
 
 /**
@@ -9,6 +9,7 @@
 
 #include "zeek/Reporter.h"
 #include "zeek/threading/BasicThread.h"
+#include "zeek/threading/SPSCQueue.h"
 
 #undef Queue // Defined elsewhere unfortunately.
 
@@ -35,8 +36,12 @@ public:
 	 * reader, writer: The corresponding threads. This is for checking
 	 * whether they have terminated so that we can abort I/O opeations.
 	 * Can be left null for the main thread.
+	 *
+	 * ring_size: If non-zero, the queue is backed by a lock-free
+	 * SPSCQueue with that many ring slots instead of by the mutex-protected
+	 * rotary queues.
 	 */
-	Queue(BasicThread* arg_reader, BasicThread* arg_writer);
+	Queue(BasicThread* arg_reader, BasicThread* arg_writer, size_t ring_size = 0);
 
 	/**
 	 * Destructor.
@@ -50,6 +55,15 @@ public:
 	 */
 	T Get();
 
+	/**
+	 * Retrieves up to \a max elements at once. This may block like Get()
+	 * if no input is available. Only the lock-free backing returns more
+	 * than one element per call.
+	 *
+	 * @return The number of elements stored into \a out.
+	 */
+	size_t GetBatch(T* out, size_t max);
+
 	/**
 	 * Queues one element.
 	 */
@@ -69,7 +83,7 @@ public:
 	 * it is empty. In other words, this method helps to avoid locking the queue
 	 * frequently, but doesn't allow you to forgo it completely.
 	 */
-	bool MaybeReady() { return (num_reads != num_writes); }
+	bool MaybeReady() { return ring ? ring->MaybeReady() : (num_reads != num_writes); }
 
 	/**
 	 * Wake up the reader if it's currently blocked for input. This is
@@ -89,6 +103,7 @@ public:
 		{
 		uint64_t num_reads;	//! Number of messages read from the queue.
 		uint64_t num_writes;	//! Number of messages written to the queue.
+		uint64_t num_overflows;	//! Number of messages that didn't fit into the lock-free ring.
 		};
 
 	/**
@@ -111,6 +126,8 @@ private:
 	int read_ptr;	// Where the next operation will read from
 	int write_ptr;	// Where the next operation will write to
 
+	std::unique_ptr<SPSCQueue<T>> ring;	// If set, used instead of the above.
+
 	BasicThread* reader;
 	BasicThread* writer;
 
@@ -134,13 +151,16 @@ inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m)
 	}
 
 template<typename T>
-inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer)
+inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer, size_t ring_size)
 	{
 	read_ptr = 0;
 	write_ptr = 0;
 	num_reads = num_writes = 0;
 	reader = arg_reader;
 	writer = arg_writer;
+
+	if ( ring_size )
+		ring = std::make_unique<SPSCQueue<T>>(ring_size, reader, writer);
 	}
 
 template<typename T>
@@ -151,6 +171,9 @@ inline Queue<T>::~Queue()
 template<typename T>
 inline T Queue<T>::Get()
 	{
+	if ( ring )
+		return ring->Get();
+
 	auto lock = acquire_lock(mutex[read_ptr]);
 
 	int old_read_ptr = read_ptr;
@@ -173,9 +196,28 @@ inline T Queue<T>::Get()
 	return data;
 	}
 
+template<typename T>
+inline size_t Queue<T>::GetBatch(T* out, size_t max)
+	{
+	if ( ring )
+		return ring->GetBatch(out, max);
+
+	if ( max == 0 )
+		return 0;
+
+	out[0] = Get();
+	return out[0] ? 1 : 0;
+	}
+
 template<typename T>
 inline void Queue<T>::Put(T data)
 	{
+	if ( ring )
+		{
+		ring->Put(data);
+		return;
+		}
+
 	auto lock = acquire_lock(mutex[write_ptr]);
 
 	int old_write_ptr = write_ptr;
@@ -198,6 +240,9 @@ inline void Queue<T>::Put(T data)
 template<typename T>
 inline bool Queue<T>::Ready()
 	{
+	if ( ring )
+		return ring->Ready();
+
 	auto lock = acquire_lock(mutex[read_ptr]);
 
 	bool ret = (messages[read_ptr].size());
@@ -229,6 +274,9 @@ inline std::vector<std::unique_lock<std::mutex>> Queue<T>::LocksForAllQueues()
 template<typename T>
 inline uint64_t Queue<T>::Size()
 	{
+	if ( ring )
+		return ring->Size();
+
 	// Need to lock all queues.
 	auto locks = LocksForAllQueues();
 
@@ -243,6 +291,16 @@ inline uint64_t Queue<T>::Size()
 template<typename T>
 inline void Queue<T>::GetStats(Stats* stats)
 	{
+	if ( ring )
+		{
+		stats->num_reads = ring->NumReads();
+		stats->num_writes = ring->NumWrites();
+		stats->num_overflows = ring->NumOverflows();
+		return;
+		}
+
+	stats->num_overflows = 0;
+
 	// To be safe, we look all queues. That's probably unneccessary, but
 	// doesn't really hurt.
 	auto locks = LocksForAllQueues();
@@ -254,6 +312,12 @@ inline void Queue<T>::GetStats(Stats* stats)
 template<typename T>
 inline void Queue<T>::WakeUp()
 	{
+	if ( ring )
+		{
+		ring->WakeUp();
+		return;
+		}
+
 	for ( int i = 0; i < NUM_QUEUES; i++ )
 		{
 		auto lock = acquire_lock(mutex[i]);
@@ -0,0 +1,308 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+
+#include "zeek/threading/BasicThread.h"
+
+namespace zeek::threading {
+
+/**
+ * A lock-free single-reader single-writer queue.
+ *
+ * Elements pass through a bounded ring buffer whose read and write
+ * positions are only ever modified by one side each, so neither Put() nor
+ * Get() take a lock in the common case. Should the ring fill up, further
+ * elements spill into a mutex-protected overflow list until the reader has
+ * caught up; the writer therefore never blocks, just like with Queue.
+ *
+ * A reader finding the queue empty first spins for a while, then yields,
+ * and eventually parks on a condition variable. The spin budget adapts to
+ * how often spinning has paid off recently. Writers only touch the
+ * condition variable while a reader is actually parked.
+ *
+ * This class is used as an alternative backing by Queue and not meant to be
+ * instantiated directly.
+ */
+template<typename T>
+class SPSCQueue
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param capacity The number of ring slots. Rounded up to a power of
+	 * two.
+	 *
+	 * reader, writer: The corresponding threads. This is for checking
+	 * whether they have terminated so that we can abort I/O opeations.
+	 * Can be left null for the main thread.
+	 */
+	SPSCQueue(size_t capacity, BasicThread* arg_reader, BasicThread* arg_writer);
+
+	/**
+	 * Retrieves one element, waiting for a while if none is available.
+	 * Returns a null element if nothing shows up.
+	 */
+	T Get();
+
+	/**
+	 * Retrieves up to \a max elements at once, waiting like Get() if none
+	 * is available.
+	 *
+	 * @return The number of elements stored into \a out.
+	 */
+	size_t GetBatch(T* out, size_t max);
+
+	/**
+	 * Queues one element.
+	 */
+	void Put(T data);
+
+	/**
+	 * Returns true if the next Get() operation will succeed. Must only be
+	 * called by the reader.
+	 */
+	bool Ready()
+		{ return head != tail.load(std::memory_order_acquire) || num_overflow.load(std::memory_order_acquire); }
+
+	/**
+	 * Returns true if the next Get() operation might succeed. Safe to call
+	 * from any thread.
+	 */
+	bool MaybeReady()
+		{ return num_reads.load(std::memory_order_relaxed) != num_writes.load(std::memory_order_relaxed); }
+
+	/**
+	 * Wakes up the reader if it's currently parked.
+	 */
+	void WakeUp();
+
+	/**
+	 * Returns the number of queued items not yet retrieved.
+	 */
+	uint64_t Size()
+		{ return num_writes.load(std::memory_order_relaxed) - num_reads.load(std::memory_order_relaxed); }
+
+	uint64_t NumReads() const	{ return num_reads.load(std::memory_order_relaxed); }
+	uint64_t NumWrites() const	{ return num_writes.load(std::memory_order_relaxed); }
+
+	/**
+	 * Returns the number of elements that didn't fit into the ring.
+	 */
+	uint64_t NumOverflows() const	{ return num_overflows.load(std::memory_order_relaxed); }
+
+private:
+	static constexpr size_t CACHE_LINE = 64;
+	static constexpr int MIN_SPINS = 16;
+	static constexpr int MAX_SPINS = 4096;
+	static constexpr int YIELDS = 8;
+
+	// Non-blocking retrieval of up to max elements.
+	size_t TryGet(T* out, size_t max);
+
+	// Waits until data might be available, returning false on timeout
+	// or when one of the threads got killed.
+	bool Wait();
+
+	bool Stopped() const
+		{ return (reader && reader->Killed()) || (writer && writer->Killed()); }
+
+	std::unique_ptr<T[]> ring;
+	size_t mask;
+
+	BasicThread* reader;
+	BasicThread* writer;
+
+	// The reader's side. head is the next slot to read.
+	alignas(CACHE_LINE) uint64_t head = 0;
+	uint64_t cached_tail = 0;
+	int spin_budget = MIN_SPINS;
+	std::atomic<uint64_t> num_reads{0};
+
+	// The writer's side. tail is the next slot to write.
+	alignas(CACHE_LINE) std::atomic<uint64_t> tail{0};
+	uint64_t cached_head = 0;
+	std::atomic<uint64_t> num_writes{0};
+
+	// Shared state for the slow paths.
+	alignas(CACHE_LINE) std::atomic<uint64_t> shared_head{0};
+	std::atomic<uint64_t> num_overflow{0};
+	std::atomic<uint64_t> num_overflows{0};
+	std::atomic<bool> parked{false};
+	std::mutex mutex;
+	std::condition_variable has_data;
+	std::deque<T> overflow;
+};
+
+template<typename T>
+inline SPSCQueue<T>::SPSCQueue(size_t capacity, BasicThread* arg_reader, BasicThread* arg_writer)
+	: reader(arg_reader), writer(arg_writer)
+	{
+	size_t size = 2;
+
+	while ( size < capacity )
+		size <<= 1;
+
+	ring = std::make_unique<T[]>(size);
+	mask = size - 1;
+	}
+
+template<typename T>
+inline void SPSCQueue<T>::Put(T data)
+	{
+	uint64_t t = tail.load(std::memory_order_relaxed);
+
+	// Once elements have spilled over, keep appending there until they
+	// have made it into the ring so that ordering is preserved.
+	bool full = t - cached_head > mask &&
+		t - (cached_head = shared_head.load(std::memory_order_acquire)) > mask;
+
+	if ( full || num_overflow.load(std::memory_order_acquire) )
+		{
+		std::unique_lock<std::mutex> lock(mutex);
+		overflow.push_back(data);
+		++num_overflows;
+
+		// Move as much of the overflow back into the ring as fits now.
+		// The reader checks the ring again under the lock before
+		// touching the overflow, so this keeps the order intact.
+		cached_head = shared_head.load(std::memory_order_acquire);
+		while ( ! overflow.empty() && t - cached_head <= mask )
+			{
+			ring[t++ & mask] = overflow.front();
+			overflow.pop_front();
+			}
+
+		tail.store(t, std::memory_order_release);
+		num_overflow.store(overflow.size(), std::memory_order_release);
+		}
+	else
+		{
+		ring[t & mask] = data;
+		tail.store(t + 1, std::memory_order_release);
+		}
+
+	num_writes.fetch_add(1, std::memory_order_relaxed);
+
+	// Pairs with the fence in Wait(): either the reader sees the new
+	// element, or we see that it's parked.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if ( parked.load(std::memory_order_relaxed) )
+		{
+		std::unique_lock<std::mutex> lock(mutex);
+		has_data.notify_one();
+		}
+	}
+
+template<typename T>
+inline size_t SPSCQueue<T>::TryGet(T* out, size_t max)
+	{
+	size_t n = 0;
+
+	if ( head == cached_tail )
+		cached_tail = tail.load(std::memory_order_acquire);
+
+	while ( n < max && head != cached_tail )
+		out[n++] = ring[head++ & mask];
+
+	if ( n )
+		shared_head.store(head, std::memory_order_release);
+
+	// Spilled elements are newer than anything in the ring, so only
+	// look at them once the ring is empty.
+	if ( n < max && head == cached_tail && num_overflow.load(std::memory_order_acquire) )
+		{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		// The writer may have moved spilled elements into the ring
+		// in the meantime, and those need to come first.
+		cached_tail = tail.load(std::memory_order_acquire);
+
+		if ( head == cached_tail )
+			{
+			while ( n < max && ! overflow.empty() )
+				{
+				out[n++] = overflow.front();
+				overflow.pop_front();
+				num_overflow.fetch_sub(1, std::memory_order_release);
+				}
+			}
+		}
+
+	if ( n )
+		num_reads.fetch_add(n, std::memory_order_relaxed);
+
+	return n;
+	}
+
+template<typename T>
+inline bool SPSCQueue<T>::Wait()
+	{
+	for ( int i = 0; i < spin_budget; ++i )
+		{
+		if ( Ready() )
+			{
+			spin_budget = std::min(spin_budget * 2, MAX_SPINS);
+			return true;
+			}
+		}
+
+	for ( int i = 0; i < YIELDS; ++i )
+		{
+		std::this_thread::yield();
+
+		if ( Ready() )
+			return true;
+		}
+
+	// Spinning didn't pay off this time, so spin less next time.
+	spin_budget = std::max(spin_budget / 2, MIN_SPINS);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	parked.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	bool ready = has_data.wait_for(lock, std::chrono::seconds(5),
+	                               [this]() { return Ready() || Stopped(); });
+
+	parked.store(false, std::memory_order_relaxed);
+	return ready && ! Stopped();
+	}
+
+template<typename T>
+inline size_t SPSCQueue<T>::GetBatch(T* out, size_t max)
+	{
+	size_t n = TryGet(out, max);
+
+	if ( n || Stopped() || ! Wait() )
+		return n;
+
+	return TryGet(out, max);
+	}
+
+template<typename T>
+inline T SPSCQueue<T>::Get()
+	{
+	T data{};
+	GetBatch(&data, 1);
+	return data;
+	}
+
+template<typename T>
+inline void SPSCQueue<T>::WakeUp()
+	{
+	std::unique_lock<std::mutex> lock(mutex);
+	has_data.notify_all();
+	}
+
+} // namespace zeek::threading
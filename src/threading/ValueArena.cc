@@ -0,0 +1,101 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/threading/ValueArena.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::threading {
+
+TEST_CASE("value arena")
+	{
+	ValueArena arena(64);
+
+	Value* v = arena.NewValue(TYPE_STRING);
+	v->val.string_val.data = arena.CopyString("foo", 3);
+	v->val.string_val.length = 3;
+	CHECK(arena.Owns(v));
+	CHECK(arena.Owns(v->val.string_val.data));
+	CHECK(strcmp(v->val.string_val.data, "foo") == 0);
+
+	// Larger than the first chunk.
+	char* big = static_cast<char*>(arena.Allocate(1000, 1));
+	CHECK(arena.Owns(big));
+	CHECK(arena.Owns(big + 999));
+	CHECK(arena.Owns(v));
+
+	Value x;
+	CHECK(! arena.Owns(&x));
+
+	arena.Reset();
+	CHECK(! arena.Owns(v));
+	CHECK(arena.MemoryAllocation() >= 1000);
+
+	Value** vals = arena.NewValueArray(4);
+	CHECK(reinterpret_cast<uintptr_t>(vals) % alignof(Value*) == 0);
+	CHECK(arena.Owns(vals));
+	}
+
+char* ValueArena::CopyString(const char* s, size_t len)
+	{
+	char* buf = static_cast<char*>(Allocate(len + 1, 1));
+	memcpy(buf, s, len);
+	buf[len] = '\0';
+	return buf;
+	}
+
+void* ValueArena::AllocateSlow(size_t size, size_t align)
+	{
+	size_t chunk_size = next_chunk_size;
+
+	while ( chunk_size < size + align )
+		chunk_size *= 2;
+
+	next_chunk_size = std::min(chunk_size * 2, MAX_CHUNK_SIZE);
+
+	chunks.push_back({std::make_unique<char[]>(chunk_size), chunk_size});
+	allocated += chunk_size;
+
+	pos = reinterpret_cast<uintptr_t>(chunks.back().data.get());
+	end = pos + chunk_size;
+
+	return Allocate(size, align);
+	}
+
+bool ValueArena::Owns(const void* p) const
+	{
+	auto addr = reinterpret_cast<uintptr_t>(p);
+
+	// Most lookups concern recent allocations, so start at the back.
+	for ( auto i = chunks.rbegin(); i != chunks.rend(); ++i )
+		{
+		auto start = reinterpret_cast<uintptr_t>(i->data.get());
+
+		if ( addr >= start && addr < start + i->size )
+			return i != chunks.rbegin() || addr < pos;
+		}
+
+	return false;
+	}
+
+void ValueArena::Reset()
+	{
+	if ( chunks.empty() )
+		return;
+
+	// Keep the most recent chunk, it's usually the largest one.
+	if ( chunks.size() > 1 )
+		{
+		Chunk last = std::move(chunks.back());
+		chunks.clear();
+		chunks.push_back(std::move(last));
+		allocated = chunks.back().size;
+		}
+
+	pos = reinterpret_cast<uintptr_t>(chunks.back().data.get());
+	end = pos + chunks.back().size;
+	}
+
+} // namespace zeek::threading
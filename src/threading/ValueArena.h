@@ -0,0 +1,112 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "zeek/threading/SerialTypes.h"
+
+namespace zeek::threading {
+
+/**
+ * A bump allocator for building threading::Value instances.
+ *
+ * All memory of a set of values (the values themselves, their strings, and
+ * the element arrays of sets and vectors) comes from a few large chunks
+ * that are released in one go once the values are no longer needed, either
+ * by Reset() or by deleting the arena. Values living in an arena must
+ * therefore never be deleted individually.
+ *
+ * The logging framework uses one arena per batch of writes that a
+ * WriterFrontend sends over to its backend.
+ *
+ * An arena isn't thread-safe, but it can be passed between threads with
+ * the usual message passing.
+ */
+class ValueArena {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param initial_chunk_size Size of the first chunk to allocate.
+	 * Subsequent chunks double in size up to MAX_CHUNK_SIZE.
+	 */
+	explicit ValueArena(size_t initial_chunk_size = 16 * 1024)
+		: next_chunk_size(initial_chunk_size)	{ }
+
+	ValueArena(const ValueArena&) = delete;
+	ValueArena& operator=(const ValueArena&) = delete;
+
+	/**
+	 * Returns uninitialized memory of the given size and alignment.
+	 */
+	void* Allocate(size_t size, size_t align = alignof(std::max_align_t))
+		{
+		size_t offset = (pos + align - 1) & ~(align - 1);
+
+		if ( offset + size > end )
+			return AllocateSlow(size, align);
+
+		pos = offset + size;
+		return reinterpret_cast<void*>(offset);
+		}
+
+	/**
+	 * Constructs a value inside the arena. The arguments are those of
+	 * the Value constructor.
+	 */
+	template<typename... Args>
+	Value* NewValue(Args&&... args)
+		{ return new (Allocate(sizeof(Value), alignof(Value))) Value(std::forward<Args>(args)...); }
+
+	/**
+	 * Returns an uninitialized array of value pointers.
+	 */
+	Value** NewValueArray(size_t n)
+		{ return static_cast<Value**>(Allocate(n * sizeof(Value*), alignof(Value*))); }
+
+	/**
+	 * Copies a string into the arena, adding a terminating NUL.
+	 */
+	char* CopyString(const char* s, size_t len);
+
+	/**
+	 * Returns true if the given pointer has been handed out by the arena
+	 * since its last reset.
+	 */
+	bool Owns(const void* p) const;
+
+	/**
+	 * Releases all memory handed out so far, keeping only the most
+	 * recently allocated chunk around for reuse.
+	 */
+	void Reset();
+
+	/**
+	 * Returns the total size of the chunks currently allocated.
+	 */
+	size_t MemoryAllocation() const	{ return allocated; }
+
+	static constexpr size_t MAX_CHUNK_SIZE = 1024 * 1024;
+
+private:
+	struct Chunk {
+		std::unique_ptr<char[]> data;
+		size_t size;
+	};
+
+	void* AllocateSlow(size_t size, size_t align);
+
+	std::vector<Chunk> chunks;
+	uintptr_t pos = 0;	// Next free byte in the current chunk.
+	uintptr_t end = 0;	// End of the current chunk.
+	size_t next_chunk_size;
+	size_t allocated = 0;
+};
+
+} // namespace zeek::threading
@@ -0,0 +1,166 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/threading/WorkerPool.h"
+
+#include <stdio.h>
+#include <chrono>
+
+#include "zeek/threading/BasicThread.h"
+#include "zeek/util.h"
+
+namespace zeek::threading {
+
+WorkerPool::WorkerPool(int num_workers)
+	{
+	for ( int i = 0; i < num_workers; ++i )
+		workers.emplace_back(std::make_unique<Worker>());
+
+	for ( size_t i = 0; i < workers.size(); ++i )
+		workers[i]->thread = std::thread(&WorkerPool::Run, this, i);
+	}
+
+WorkerPool::~WorkerPool()
+	{
+		{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+		}
+
+	has_tasks.notify_all();
+
+	for ( auto& w : workers )
+		w->thread.join();
+	}
+
+void WorkerPool::Schedule(BasicThread* t)
+	{
+	uint64_t s = t->pool_state.load();
+
+	// Count the wake-up and mark the task queued, and only queue it if
+	// it wasn't already. A running task checks for wake-ups that it
+	// missed before it gets unmarked.
+	while ( ! t->pool_state.compare_exchange_weak(s, (s + 2) | 1) )
+		;
+
+	if ( ! (s & 1) )
+		Push(t);
+	}
+
+void WorkerPool::Join(BasicThread* t)
+	{
+	// Give a killed task the chance to notice.
+	Schedule(t);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	task_done.wait(lock, [t]() { return t->pool_done; });
+	}
+
+void WorkerPool::Push(BasicThread* t)
+	{
+	Worker* w = workers[next_worker++ % workers.size()].get();
+
+		{
+		std::unique_lock<std::mutex> lock(w->mutex);
+		w->tasks.push_back(t);
+		}
+
+	++num_tasks;
+
+	if ( num_idle.load() )
+		{
+		std::unique_lock<std::mutex> lock(mutex);
+		has_tasks.notify_one();
+		}
+	}
+
+BasicThread* WorkerPool::Next(size_t idx)
+	{
+	for ( size_t i = 0; i < workers.size(); ++i )
+		{
+		Worker* w = workers[(idx + i) % workers.size()].get();
+		std::unique_lock<std::mutex> lock(w->mutex);
+
+		if ( w->tasks.empty() )
+			continue;
+
+		BasicThread* t;
+
+		// Take our own tasks in order, and steal the most recently
+		// queued ones from others.
+		if ( i == 0 )
+			{
+			t = w->tasks.front();
+			w->tasks.pop_front();
+			}
+		else
+			{
+			t = w->tasks.back();
+			w->tasks.pop_back();
+			}
+
+		--num_tasks;
+		return t;
+		}
+
+	return nullptr;
+	}
+
+void WorkerPool::RunTask(BasicThread* t)
+	{
+	uint64_t s = t->pool_state.load();
+
+	switch ( t->RunSlice() ) {
+	case BasicThread::SLICE_MORE:
+		Push(t);
+		break;
+
+	case BasicThread::SLICE_IDLE:
+		// Unmark the task unless it got woken up in the meantime. Once
+		// unmarked, another worker may run it, so we must not touch it
+		// anymore.
+		if ( ! t->pool_state.compare_exchange_strong(s, s & ~uint64_t(1)) )
+			Push(t);
+		break;
+
+	case BasicThread::SLICE_DONE:
+		{
+		// The task stays marked, so that it never gets queued again.
+		t->Done();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		t->pool_done = true;
+		task_done.notify_all();
+		break;
+		}
+	}
+	}
+
+void WorkerPool::Run(size_t idx)
+	{
+	BasicThread::BlockSignals();
+
+	char name[32];
+	snprintf(name, sizeof(name), "zk.pool-%zu", idx);
+	util::detail::set_thread_name(name);
+
+	while ( true )
+		{
+		if ( BasicThread* t = Next(idx) )
+			{
+			RunTask(t);
+			continue;
+			}
+
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if ( stopping )
+			break;
+
+		++num_idle;
+		has_tasks.wait_for(lock, std::chrono::milliseconds(100),
+		                   [this]() { return stopping || num_tasks.load() > 0; });
+		--num_idle;
+		}
+	}
+
+} // namespace zeek::threading
@@ -0,0 +1,92 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zeek::threading {
+
+class BasicThread;
+
+/**
+ * A fixed number of OS threads that run BasicThread instances as tasks,
+ * for when there are many threads that are idle most of the time. A
+ * pooled thread runs only when it has work, in slices of bounded length
+ * (see BasicThread::RunSlice()), and on only one of the pool's threads at
+ * a time, so it sees its messages in order just like with an OS thread of
+ * its own.
+ *
+ * Each of the pool's threads keeps a queue of runnable tasks. New tasks
+ * get spread over the queues round-robin, and threads that run out of
+ * tasks steal from the back of the other queues.
+ */
+class WorkerPool {
+public:
+	/**
+	 * Constructor. Starts the pool's threads.
+	 *
+	 * @param num_workers The number of threads.
+	 */
+	explicit WorkerPool(int num_workers);
+
+	/**
+	 * Destructor. Stops the pool's threads. All tasks must have finished
+	 * by then.
+	 */
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	/**
+	 * Lets a task run its next slice, unless it's queued or running
+	 * already, in which case it runs another one once done with the
+	 * current.
+	 *
+	 * This method is safe to call from any thread.
+	 */
+	void Schedule(BasicThread* t);
+
+	/**
+	 * Waits until a task has finished, i.e., its RunSlice() returned
+	 * SLICE_DONE. Afterwards, the pool doesn't access the task anymore.
+	 *
+	 * This method must be called only from the main thread.
+	 */
+	void Join(BasicThread* t);
+
+	/**
+	 * Returns the number of the pool's threads.
+	 */
+	int NumWorkers() const	{ return workers.size(); }
+
+private:
+	struct Worker {
+		std::thread thread;
+		std::mutex mutex;
+		std::deque<BasicThread*> tasks;
+	};
+
+	void Run(size_t idx);
+	void Push(BasicThread* t);
+	BasicThread* Next(size_t idx);
+	void RunTask(BasicThread* t);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<size_t> next_worker{0};
+	std::atomic<size_t> num_tasks{0};	// Queued across all workers.
+	std::atomic<int> num_idle{0};	// Workers waiting for tasks.
+	bool stopping = false;
+
+	std::mutex mutex;	// Protects stopping and the tasks' pool_done.
+	std::condition_variable has_tasks;
+	std::condition_variable task_done;
+};
+
+} // namespace zeek::threading
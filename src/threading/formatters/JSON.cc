@@ -10,11 +10,17 @@
 #include <errno.h>
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
 #include <sstream>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <rapidjson/internal/ieee754.h>
 
 #include "zeek/Desc.h"
+#include "zeek/bro_inet_ntop.h"
 #include "zeek/threading/MsgThread.h"
 
 namespace zeek::threading::formatter {
@@ -27,7 +33,90 @@ bool JSON::NullDoubleWriter::Double(double d)
 	return rapidjson::Writer<rapidjson::StringBuffer>::Double(d);
 	}
 
-JSON::JSON(MsgThread* t, TimeFormat tf) : Formatter(t), surrounding_braces(true)
+// Returns true if the string doesn't contain any bytes outside of ASCII,
+// in which case it's valid UTF-8 already and can be used as-is.
+static bool is_ascii(const char* s, size_t len)
+	{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	for ( ; i + 16 <= len; i += 16 )
+		{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+
+		if ( _mm_movemask_epi8(block) )
+			return false;
+		}
+#else
+	for ( ; i + 8 <= len; i += 8 )
+		{
+		uint64_t word;
+		memcpy(&word, s + i, sizeof(word));
+
+		if ( word & 0x8080808080808080ULL )
+			return false;
+		}
+#endif
+
+	for ( ; i < len; ++i )
+		{
+		if ( static_cast<unsigned char>(s[i]) >= 0x80 )
+			return false;
+		}
+
+	return true;
+	}
+
+// Writes the decimal representation of n to out, returning the number of
+// characters written.
+static size_t render_uint(unsigned int n, char* out)
+	{
+	char tmp[10];
+	size_t len = 0;
+
+	do
+		{
+		tmp[len++] = '0' + n % 10;
+		n /= 10;
+		}
+	while ( n );
+
+	for ( size_t i = 0; i < len; ++i )
+		out[i] = tmp[len - i - 1];
+
+	return len;
+	}
+
+// Renders an address into out, which needs to provide space for
+// INET6_ADDRSTRLEN characters. Equivalent to Formatter::Render(), but
+// without building a string.
+static size_t render_addr(const Value::addr_t& addr, char* out)
+	{
+	if ( addr.family == IPv4 )
+		{
+		const uint8_t* b = reinterpret_cast<const uint8_t*>(&addr.in.in4);
+		size_t len = render_uint(b[0], out);
+
+		for ( int i = 1; i < 4; ++i )
+			{
+			out[len++] = '.';
+			len += render_uint(b[i], out + len);
+			}
+
+		return len;
+		}
+
+	if ( ! bro_inet_ntop(AF_INET6, &addr.in.in6, out, INET6_ADDRSTRLEN) )
+		{
+		static const char bad[] = "<bad IPv6 address conversion>";
+		memcpy(out, bad, sizeof(bad) - 1);
+		return sizeof(bad) - 1;
+		}
+
+	return strlen(out);
+	}
+
+JSON::JSON(MsgThread* t, TimeFormat tf) : Formatter(t), surrounding_braces(true), writer(buffer)
 	{
 	timestamps = tf;
 	}
@@ -39,8 +128,7 @@ JSON::~JSON()
 bool JSON::Describe(ODesc* desc, int num_fields, const Field* const * fields,
                     Value** vals) const
 	{
-	rapidjson::StringBuffer buffer;
-	NullDoubleWriter writer(buffer);
+	NullDoubleWriter& writer = ResetWriter();
 
 	writer.StartObject();
 
@@ -51,7 +139,7 @@ bool JSON::Describe(ODesc* desc, int num_fields, const Field* const * fields,
 		}
 
 	writer.EndObject();
-	desc->Add(buffer.GetString());
+	desc->AddN(buffer.GetString(), buffer.GetSize());
 
 	return true;
 	}
@@ -67,18 +155,77 @@ bool JSON::Describe(ODesc* desc, Value* val, const std::string& name) const
 	if ( ! val->present || name.empty() )
 		return true;
 
-	rapidjson::Document doc;
-	rapidjson::StringBuffer buffer;
-	NullDoubleWriter writer(buffer);
+	NullDoubleWriter& writer = ResetWriter();
 
 	writer.StartObject();
 	BuildJSON(writer, val, name);
 	writer.EndObject();
 
-	desc->Add(buffer.GetString());
+	desc->AddN(buffer.GetString(), buffer.GetSize());
 	return true;
 	}
 
+JSON::NullDoubleWriter& JSON::ResetWriter() const
+	{
+	// Keeps the allocated capacity of both the buffer and the writer's
+	// nesting stack.
+	buffer.Clear();
+	writer.Reset(buffer);
+	return writer;
+	}
+
+void JSON::WriteISO8601(NullDoubleWriter& writer, double t) const
+	{
+	time_t the_time = time_t(floor(t));
+
+	// Consecutive records tend to fall into the same second, so only the
+	// fractional part needs formatting most of the time.
+	if ( the_time != cached_second )
+		{
+		struct tm tm;
+
+		if ( ! gmtime_r(&the_time, &tm) ||
+		     ! (cached_second_len = strftime(cached_second_str, sizeof(cached_second_str),
+		                                     "%Y-%m-%dT%H:%M:%S", &tm)) )
+			{
+			cached_second = -1;
+			GetThread()->Error(GetThread()->Fmt("json formatter: failure getting time: (%lf)", t));
+			// This was a failure, doesn't really matter what gets put here
+			// but it should probably stand out...
+			writer.String("2000-01-01T00:00:00.000000");
+			return;
+			}
+
+		cached_second = the_time;
+		}
+
+	double integ;
+	double frac = modf(t, &integ);
+
+	if ( frac < 0 )
+		frac += 1;
+
+	// Rounds like the "%06.0f" this replaces.
+	auto usecs = static_cast<unsigned int>(nearbyint(fabs(frac) * 1000000));
+
+	char buf[sizeof(cached_second_str) + 16];
+	memcpy(buf, cached_second_str, cached_second_len);
+	size_t len = cached_second_len;
+	buf[len++] = '.';
+
+	char digits[10];
+	size_t n = render_uint(usecs, digits);
+
+	for ( size_t i = n; i < 6; ++i )
+		buf[len++] = '0';
+
+	memcpy(buf + len, digits, n);
+	len += n;
+	buf[len++] = 'Z';
+
+	writer.String(buf, len);
+	}
+
 Value* JSON::ParseValue(const std::string& s, const std::string& name,
                         TypeTag type, TypeTag subtype) const
 	{
@@ -116,12 +263,27 @@ void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& na
 			break;
 
 		case TYPE_SUBNET:
-			writer.String(Formatter::Render(val->val.subnet_val));
+			{
+			const auto& subnet = val->val.subnet_val;
+			char buf[INET6_ADDRSTRLEN + 4];
+			size_t len = render_addr(subnet.prefix, buf);
+			buf[len++] = '/';
+
+			if ( subnet.prefix.family == IPv4 )
+				len += render_uint(subnet.length - 96, buf + len);
+			else
+				len += render_uint(subnet.length, buf + len);
+
+			writer.String(buf, len);
 			break;
+			}
 
 		case TYPE_ADDR:
-			writer.String(Formatter::Render(val->val.addr_val));
+			{
+			char buf[INET6_ADDRSTRLEN];
+			writer.String(buf, render_addr(val->val.addr_val, buf));
 			break;
+			}
 
 		case TYPE_DOUBLE:
 		case TYPE_INTERVAL:
@@ -131,32 +293,7 @@ void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& na
 		case TYPE_TIME:
 			{
 			if ( timestamps == TS_ISO8601 )
-				{
-				char buffer[40];
-				char buffer2[48];
-				time_t the_time = time_t(floor(val->val.double_val));
-				struct tm t;
-
-				if ( ! gmtime_r(&the_time, &t) ||
-				     ! strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &t) )
-					{
-					GetThread()->Error(GetThread()->Fmt("json formatter: failure getting time: (%lf)", val->val.double_val));
-					// This was a failure, doesn't really matter what gets put here
-					// but it should probably stand out...
-					writer.String("2000-01-01T00:00:00.000000");
-					}
-				else
-					{
-					double integ;
-					double frac = modf(val->val.double_val, &integ);
-
-					if ( frac < 0 )
-						frac += 1;
-
-					snprintf(buffer2, sizeof(buffer2), "%s.%06.0fZ", buffer, fabs(frac) * 1000000);
-					writer.String(buffer2, strlen(buffer2));
-					}
-				}
+				WriteISO8601(writer, val->val.double_val);
 
 			else if ( timestamps == TS_EPOCH )
 				writer.Double(val->val.double_val);
@@ -175,8 +312,16 @@ void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& na
 		case TYPE_FILE:
 		case TYPE_FUNC:
 			{
-			writer.String(util::json_escape_utf8(
-				              std::string(val->val.string_val.data, val->val.string_val.length)));
+			const char* data = val->val.string_val.data;
+			size_t len = val->val.string_val.length;
+
+			// Only strings with non-ASCII bytes may need UTF-8 escaping;
+			// everything else goes to the writer directly.
+			if ( is_ascii(data, len) )
+				writer.String(data, len);
+			else
+				writer.String(util::json_escape_utf8(std::string(data, len)));
+
 			break;
 			}
 
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <time.h>
+
 #define RAPIDJSON_HAS_STDSTRING 1
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
@@ -40,8 +42,25 @@ public:
 private:
 	void BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& name = "") const;
 
+	// Writes a timestamp in ISO 8601 format.
+	void WriteISO8601(NullDoubleWriter& writer, double t) const;
+
+	// Starts a new document in the reused output buffer.
+	NullDoubleWriter& ResetWriter() const;
+
 	TimeFormat timestamps;
 	bool surrounding_braces;
+
+	// A formatter only ever runs inside its thread, so the output buffer
+	// and writer can be kept across calls to avoid reallocating them for
+	// every record.
+	mutable rapidjson::StringBuffer buffer;
+	mutable NullDoubleWriter writer;
+
+	// The ISO 8601 rendering of the most recently formatted second.
+	mutable time_t cached_second = -1;
+	mutable char cached_second_str[40];
+	mutable size_t cached_second_len = 0;
 };
 
 } // namespace zeek::threading::formatter
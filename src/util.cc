@@ -353,6 +353,33 @@ void hmac_md5(size_t size, const unsigned char* bytes, unsigned char digest[16])
 	zeek::detail::internal_md5(digest, 16, digest);
 	}
 
+uint32_t fnv1a32(const unsigned char* bytes, size_t size)
+	{
+	uint32_t offset32 = 2166136261;
+	uint32_t prime32 = 16777619;
+	uint32_t rval = offset32;
+
+	for ( size_t i = 0; i < size; ++i )
+		{
+		rval ^= (uint32_t) bytes[i];
+		rval *= prime32;
+		}
+
+	return rval;
+	}
+
+uint32_t hrw_weight(uint32_t key_digest, uint32_t site_id)
+	{
+	uint32_t d = key_digest;
+	d &= 0x7fffffff; // 31-bit digest
+	uint32_t si = site_id;
+	auto a = 1103515245;
+	auto b = 12345;
+	auto m = 2147483648; // 2**31
+
+	return (a * ((a * si + b) ^ d) + b) % m;
+	}
+
 static bool read_random_seeds(const char* read_file, uint32_t* seed,
 				std::array<uint32_t, zeek::detail::KeyedHash::SEED_INIT_SIZE>& buf)
 	{
@@ -1132,12 +1159,21 @@ ODesc* get_escaped_string(ODesc* d, const char* str, size_t len,
 	if ( ! d )
 		d = new ODesc();
 
+	// The start of the current run of characters that don't need
+	// escaping, which get added in one go.
+	size_t run = 0;
+
 	for ( size_t i = 0; i < len; ++i )
 		{
 		char c = str[i];
 
 		if ( escape_all || isspace(c) || ! isascii(c) || ! isprint(c) )
 			{
+			if ( i > run )
+				d->AddRaw(str + run, i - run);
+
+			run = i + 1;
+
 			if ( c == '\\' )
 				d->AddRaw("\\\\", 2);
 			else
@@ -1147,11 +1183,11 @@ ODesc* get_escaped_string(ODesc* d, const char* str, size_t len,
 				d->AddRaw(hex, 4);
 				}
 			}
-
-		else
-			d->AddRaw(&c, 1);
 		}
 
+	if ( len > run )
+		d->AddRaw(str + run, len - run);
+
 	return d;
 	}
 
@@ -1514,6 +1550,15 @@ TEST_CASE("util strstr_n")
 
 	out = strstr_n(16, s, 9, reinterpret_cast<const u_char*>("not there"));
 	CHECK(out == -1);
+
+	out = strstr_n(16, s, 2, reinterpret_cast<const u_char*>("is"));
+	CHECK(out == 2);
+
+	out = strstr_n(16, s, 1, reinterpret_cast<const u_char*>("g"));
+	CHECK(out == 15);
+
+	out = strstr_n(16, s, 0, reinterpret_cast<const u_char*>(""));
+	CHECK(out == 0);
 	}
 
 int strstr_n(const int big_len, const u_char* big,
@@ -1522,10 +1567,25 @@ int strstr_n(const int big_len, const u_char* big,
 	if ( little_len > big_len )
 		return -1;
 
-	for ( int i = 0; i <= big_len - little_len; ++i )
+	if ( little_len <= 0 )
+		return 0;
+
+	// Let memchr() find the candidates, which it does a word or vector
+	// at a time, and compare the rest only there.
+	const u_char* p = big;
+	const u_char* last = big + big_len - little_len;
+
+	while ( p <= last )
 		{
-		if ( ! memcmp(big + i, little, little_len) )
-			return i;
+		p = static_cast<const u_char*>(memchr(p, little[0], last - p + 1));
+
+		if ( ! p )
+			break;
+
+		if ( ! memcmp(p + 1, little + 1, little_len - 1) )
+			return p - big;
+
+		++p;
 		}
 
 	return -1;
@@ -2181,6 +2241,43 @@ bool safe_write(int fd, const char* data, int len)
 	return true;
 	}
 
+bool safe_writev(int fd, struct iovec* iov, int iovcnt)
+	{
+	while ( iovcnt > 0 )
+		{
+		ssize_t n = writev(fd, iov, iovcnt);
+
+		if ( n < 0 )
+			{
+			if ( errno == EINTR )
+				continue;
+
+			char buf[128];
+			zeek_strerror_r(errno, buf, sizeof(buf));
+			fprintf(stderr, "safe_writev error: %d (%s)\n", errno, buf);
+			abort();
+
+			return false;
+			}
+
+		// Skip what got written, which may end inside an element.
+		while ( iovcnt > 0 && static_cast<size_t>(n) >= iov->iov_len )
+			{
+			n -= iov->iov_len;
+			++iov;
+			--iovcnt;
+			}
+
+		if ( iovcnt > 0 )
+			{
+			iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+			iov->iov_len -= n;
+			}
+		}
+
+	return true;
+	}
+
 bool safe_pwrite(int fd, const unsigned char* data, size_t len, size_t offset)
 	{
 	while ( len != 0 )
@@ -52,6 +52,7 @@ extern HeapLeakChecker* heap_checker;
 #endif
 
 #include <pthread.h>
+#include <sys/uio.h>
 
 #ifdef HAVE_LINUX
 #include <sys/prctl.h>
@@ -156,6 +157,13 @@ extern bool ensure_dir(const char *dirname);
 extern void hmac_md5(size_t size, const unsigned char* bytes,
                      unsigned char digest[16]);
 
+// Returns the 32-bit FNV-1a hash of the given bytes.
+extern uint32_t fnv1a32(const unsigned char* bytes, size_t size);
+
+// Returns the weight of a site for a key in Rendezvous (Highest Random
+// Weight) hashing, given the key's 32-bit digest and the site's id.
+extern uint32_t hrw_weight(uint32_t key_digest, uint32_t site_id);
+
 // Initializes RNGs for zeek::random_number() and MD5 usage.  If load_file is given,
 // the seeds (both random & MD5) are loaded from that file.  This takes
 // precedence over the "use_empty_seeds" argument, which just
@@ -520,6 +528,10 @@ constexpr size_t pad_size(size_t size)
 // thread-safe as long as no two threads write to the same descriptor.
 extern bool safe_write(int fd, const char* data, int len);
 
+// Same as safe_write(), but for writev(). Modifies the elements of iov as
+// it goes.
+extern bool safe_writev(int fd, struct iovec* iov, int iovcnt);
+
 // Same as safe_write(), but for pwrite().
 extern bool safe_pwrite(int fd, const unsigned char* data, size_t len,
                         size_t offset);
@@ -13,6 +13,13 @@
 #endif
 
 #include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+
+#include "zeek/zeek-affinity.h"
 
 namespace zeek {
 bool set_affinity(int core_number)
@@ -23,12 +30,111 @@ bool set_affinity(int core_number)
 	auto res = sched_setaffinity(0, sizeof(cpus), &cpus);
 	return res == 0;
 	}
+
+bool set_affinity(const std::vector<int>& cores)
+	{
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+
+	for ( auto c : cores )
+		if ( c >= 0 && c < CPU_SETSIZE )
+			CPU_SET(c, &cpus);
+
+	auto res = sched_setaffinity(0, sizeof(cpus), &cpus);
+	return res == 0;
+	}
+
+// Reads a sysfs list of numbers like "0-3,8-11".
+static std::vector<int> read_list(const std::string& path)
+	{
+	std::vector<int> rval;
+	std::ifstream f(path);
+	std::string s;
+
+	if ( ! std::getline(f, s) )
+		return rval;
+
+	const char* p = s.c_str();
+
+	while ( *p )
+		{
+		char* end;
+		long first = strtol(p, &end, 10);
+
+		if ( end == p )
+			break;
+
+		long last = first;
+		p = end;
+
+		if ( *p == '-' )
+			{
+			last = strtol(p + 1, &end, 10);
+			p = end;
+			}
+
+		for ( long i = first; i <= last; ++i )
+			rval.push_back(i);
+
+		if ( *p != ',' )
+			break;
+
+		++p;
+		}
+
+	return rval;
+	}
+
+std::vector<int> numa_online_nodes()
+	{
+	return read_list("/sys/devices/system/node/online");
+	}
+
+std::vector<int> numa_node_cores(int node)
+	{
+	return read_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+	}
+
+int numa_device_node(const std::string& device)
+	{
+	std::ifstream f("/sys/class/net/" + device + "/device/numa_node");
+	int node = -1;
+
+	if ( ! (f >> node) )
+		return -1;
+
+	return node;
+	}
+
+bool set_numa_preferred(int node)
+	{
+	// Avoids depending on libnuma for the single call we need.
+	constexpr int mpol_preferred = 1;
+	constexpr int bits = 8 * sizeof(unsigned long);
+	constexpr int max_nodes = 1024;
+	unsigned long mask[max_nodes / bits] = {0};
+
+	if ( node < 0 || node >= max_nodes )
+		{
+		errno = EINVAL;
+		return false;
+		}
+
+	mask[node / bits] = 1UL << (node % bits);
+
+	// The kernel looks at one bit less than it's told.
+	auto res = syscall(SYS_set_mempolicy, mpol_preferred, mask, max_nodes + 1);
+	return res == 0;
+	}
 } // namespace zeek
 
 #elif defined(__FreeBSD__)
 
 #include <sys/param.h>
 #include <sys/cpuset.h>
+#include <cerrno>
+
+#include "zeek/zeek-affinity.h"
 
 namespace zeek {
 bool set_affinity(int core_number)
@@ -40,18 +146,82 @@ bool set_affinity(int core_number)
 	                              sizeof(cpus), &cpus);
 	return res == 0;
 	}
+
+bool set_affinity(const std::vector<int>& cores)
+	{
+	cpuset_t cpus;
+	CPU_ZERO(&cpus);
+
+	for ( auto c : cores )
+		if ( c >= 0 && c < CPU_SETSIZE )
+			CPU_SET(c, &cpus);
+
+	auto res = cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_PID, -1,
+	                              sizeof(cpus), &cpus);
+	return res == 0;
+	}
+
+std::vector<int> numa_online_nodes()
+	{
+	return {};
+	}
+
+std::vector<int> numa_node_cores(int node)
+	{
+	return {};
+	}
+
+int numa_device_node(const std::string& device)
+	{
+	return -1;
+	}
+
+bool set_numa_preferred(int node)
+	{
+	errno = ENOTSUP;
+	return false;
+	}
 } // namespace zeek
 
 #else
 
 #include <cerrno>
 
+#include "zeek/zeek-affinity.h"
+
 namespace zeek {
 bool set_affinity(int core_number)
 	{
 	errno = ENOTSUP;
 	return false;
 	}
+
+bool set_affinity(const std::vector<int>& cores)
+	{
+	errno = ENOTSUP;
+	return false;
+	}
+
+std::vector<int> numa_online_nodes()
+	{
+	return {};
+	}
+
+std::vector<int> numa_node_cores(int node)
+	{
+	return {};
+	}
+
+int numa_device_node(const std::string& device)
+	{
+	return -1;
+	}
+
+bool set_numa_preferred(int node)
+	{
+	errno = ENOTSUP;
+	return false;
+	}
 } // namespace zeek
 
 #endif
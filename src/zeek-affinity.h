@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+
 namespace zeek {
 
 /**
@@ -14,4 +17,43 @@ namespace zeek {
  */
 bool set_affinity(int core_number);
 
+/**
+ * Set the process affinity to a set of CPUs, among which the scheduler may
+ * move the process.  Currently only supported on Linux and FreeBSD.
+ * @param cores  the cores to which this process should set its affinity.
+ * @return true if the affinity is successfully set and false if not with
+ * errno additionally being set to indicate the reason.
+ */
+bool set_affinity(const std::vector<int>& cores);
+
+/**
+ * @return the NUMA nodes that are online, or an empty vector if the
+ * system doesn't tell.  Currently only supported on Linux.
+ */
+std::vector<int> numa_online_nodes();
+
+/**
+ * @param node  a NUMA node number.
+ * @return the cores that belong to the NUMA node, or an empty vector if
+ * unknown.  Currently only supported on Linux.
+ */
+std::vector<int> numa_node_cores(int node);
+
+/**
+ * @param device  the name of a network device, like "eth0".
+ * @return the NUMA node to which the device is attached, or -1 if unknown.
+ * Currently only supported on Linux.
+ */
+int numa_device_node(const std::string& device);
+
+/**
+ * Make the process allocate its memory from the given NUMA node while
+ * that has any left, and from other nodes only after.  Currently only
+ * supported on Linux.
+ * @param node  the preferred NUMA node.
+ * @return true if the memory policy is successfully set and false if not
+ * with errno additionally being set to indicate the reason.
+ */
+bool set_numa_preferred(int node);
+
 } // namespace zeek
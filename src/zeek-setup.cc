@@ -47,18 +47,29 @@ extern "C" {
 #include "zeek/EventRegistry.h"
 #include "zeek/Stats.h"
 #include "zeek/ScriptCoverageManager.h"
+#include "zeek/ScriptOptimizer.h"
+#include "zeek/ScriptProfile.h"
+#include "zeek/DFACache.h"
+#include "zeek/MemoryArenas.h"
+#include "zeek/Metrics.h"
+#include "zeek/ParallelReplay.h"
+#include "zeek/PipelineStats.h"
 #include "zeek/Traverse.h"
 #include "zeek/Trigger.h"
 #include "zeek/Hash.h"
 #include "zeek/Func.h"
 #include "zeek/ScannedFile.h"
 #include "zeek/Frag.h"
+#include "zeek/Reassem.h"
+#include "zeek/PrefixTable.h"
+#include "zeek/OpaqueVal.h"
 
 #include "zeek/supervisor/Supervisor.h"
 #include "zeek/threading/Manager.h"
 #include "zeek/input/Manager.h"
 #include "zeek/logging/Manager.h"
 #include "zeek/input/readers/raw/Raw.h"
+#include "zeek/analyzer/AnalyzerCost.h"
 #include "zeek/analyzer/Manager.h"
 #include "zeek/analyzer/Tag.h"
 #include "zeek/packet_analysis/Manager.h"
@@ -154,11 +165,14 @@ zeek::OpaqueTypePtr sha1_type;
 zeek::OpaqueTypePtr sha256_type;
 zeek::OpaqueTypePtr entropy_type;
 zeek::OpaqueTypePtr cardinality_type;
+zeek::OpaqueTypePtr countminsketch_type;
 zeek::OpaqueTypePtr topk_type;
 zeek::OpaqueTypePtr bloomfilter_type;
 zeek::OpaqueTypePtr x509_opaque_type;
 zeek::OpaqueTypePtr ocsp_resp_opaque_type;
 zeek::OpaqueTypePtr paraglob_type;
+zeek::OpaqueTypePtr shared_table_type;
+zeek::OpaqueTypePtr packet_header_type;
 
 // Keep copy of command line
 int zeek::detail::zeek_argc;
@@ -317,6 +331,13 @@ static void terminate_bro()
 	timer_mgr->Expire();
 	event_mgr.Drain();
 
+	if ( script_profile_mgr )
+		{
+		script_profile_mgr->Report();
+		delete script_profile_mgr;
+		script_profile_mgr = nullptr;
+		}
+
 	if ( profiling_logger )
 		{
 		// FIXME: There are some occasional crashes in the memory
@@ -370,6 +391,16 @@ RETSIGTYPE sig_handler(int signo)
 	return RETSIGVAL;
 	}
 
+static RETSIGTYPE script_profile_sig_handler(int signo)
+	{
+	ScriptProfileMgr::RequestReport();
+
+	if ( ! run_state::terminating )
+		iosource_mgr->Wakeup("script_profile_sig_handler");
+
+	return RETSIGVAL;
+	}
+
 static void atexit_handler()
 	{
 	util::detail::set_processing_status("TERMINATED", "atexit");
@@ -442,6 +473,19 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 	if ( Supervisor::ThisNode() )
 		Supervisor::ThisNode()->Init(&options);
 
+	if ( options.parallel && *options.parallel > 1 )
+		{
+		if ( ! options.pcap_file || options.interface || options.pcap_output_file ||
+		     options.supervisor_mode )
+			{
+			fprintf(stderr, "--parallel requires -r, without -i, -w, or -j\n");
+			exit(1);
+			}
+
+		// Continues in each of the shards' processes.
+		run_parallel(*options.parallel);
+		}
+
 	script_coverage_mgr.ReadStats();
 
 	auto dns_type = options.dns_mode;
@@ -546,7 +590,17 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 	createCurrentDoc("1.0");		// Set a global XML document
 #endif
 
-	timer_mgr = new PQ_TimerMgr();
+	const char* timer_mgr_type = util::zeekenv("ZEEK_TIMER_MGR");
+
+	if ( timer_mgr_type && util::streq(timer_mgr_type, "wheel") )
+		timer_mgr = new TimerWheelMgr();
+	else
+		{
+		if ( timer_mgr_type && ! util::streq(timer_mgr_type, "pq") )
+			reporter->Warning("unknown ZEEK_TIMER_MGR '%s', using 'pq'", timer_mgr_type);
+
+		timer_mgr = new PQ_TimerMgr();
+		}
 
 	auto zeekygen_cfg = options.zeekygen_config_file.value_or("");
 	zeekygen_mgr = new zeekygen::detail::Manager(zeekygen_cfg, zeek_argv[0]);
@@ -616,11 +670,14 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 	sha256_type = make_intrusive<OpaqueType>("sha256");
 	entropy_type = make_intrusive<OpaqueType>("entropy");
 	cardinality_type = make_intrusive<OpaqueType>("cardinality");
+	countminsketch_type = make_intrusive<OpaqueType>("countminsketch");
 	topk_type = make_intrusive<OpaqueType>("topk");
 	bloomfilter_type = make_intrusive<OpaqueType>("bloomfilter");
 	x509_opaque_type = make_intrusive<OpaqueType>("x509");
 	ocsp_resp_opaque_type = make_intrusive<OpaqueType>("ocsp_resp");
 	paraglob_type = make_intrusive<OpaqueType>("paraglob");
+	shared_table_type = make_intrusive<OpaqueType>("shared_table");
+	packet_header_type = make_intrusive<OpaqueType>("packet_header");
 
 	// The leak-checker tends to produce some false
 	// positives (memory which had already been
@@ -646,6 +703,9 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 		};
 	auto ipbb = make_intrusive<BuiltinFunc>(init_bifs, ipbid->Name(), false);
 
+	if ( options.dfa_cache_file )
+		dfa_cache_file = new DFACacheFile(*options.dfa_cache_file);
+
 	run_state::is_parsing = true;
 	yyparse();
 	run_state::is_parsing = false;
@@ -704,6 +764,7 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 	packet_mgr->InitPostScript();
 	file_mgr->InitPostScript();
 	dns_mgr->InitPostScript();
+	MemoryArenas::Init();
 
 	if ( options.parse_only )
 		{
@@ -735,6 +796,13 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 		id->SetVal(make_intrusive<StringVal>(*options.pcap_filter));
 		}
 
+	DFA_State_Cache::SetMemoryLimit(BifConst::dfa_state_memory_limit);
+	PrefixTable::SetStrideThreshold(BifConst::subnet_table_stride_threshold);
+	ParaglobVal::SetCacheSize(BifConst::paraglob_cache_size);
+	EventHandler::SetTelemetryEnabled(BifConst::event_handler_telemetry);
+	PipelineStats::SetEnabled(BifConst::pipeline_stage_telemetry);
+	AnalyzerCost::SetSampling(BifConst::analyzer_cost_sampling);
+
 	auto all_signature_files = options.signature_files;
 
 	// Append signature files defined in "signature_files" script option
@@ -760,6 +828,13 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 		file_mgr->InitMagic();
 		}
 
+	if ( dfa_cache_file )
+		{
+		dfa_cache_file->Finish(BifConst::dfa_precompile_max_states);
+		delete dfa_cache_file;
+		dfa_cache_file = nullptr;
+		}
+
 	if ( g_policy_debug )
 		// ### Add support for debug command file.
 		dbg_init_debugger(nullptr);
@@ -779,9 +854,31 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 			}
 		}
 
+	// A warm spare waits here, with its scripts loaded and its signatures
+	// compiled, until it takes over for its node.
+	if ( Supervisor::ThisNode() )
+		Supervisor::ThisNode()->AwaitActivation();
+
 	if ( dns_type != DNS_PRIME )
 		run_state::detail::init_run(options.interface, options.pcap_file, options.pcap_output_file, options.use_watchdog);
 
+	metrics_registry.AddCoreMetrics();
+
+	if ( dns_type != DNS_PRIME && BifConst::metrics_port > 0 )
+		{
+		auto server = new MetricsServer();
+
+		if ( BifConst::metrics_port > 65535 )
+			{
+			reporter->Error("invalid metrics_port %" PRIu64, BifConst::metrics_port);
+			delete server;
+			}
+
+		else if ( ! server->Listen(BifConst::metrics_address->ToStdString(),
+		                           BifConst::metrics_port) )
+			delete server;
+		}
+
 	if ( ! g_policy_debug )
 		{
 		(void) setsignal(SIGTERM, sig_handler);
@@ -832,11 +929,21 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 			segment_logger = profiling_logger;
 		}
 
+	script_coverage_mgr.StartPeriodicWrites(BifConst::script_coverage_interval);
+
+	if ( options.script_profile_file )
+		{
+		script_profile_mgr = new ScriptProfileMgr(*options.script_profile_file);
+		(void) setsignal(SIGUSR1, script_profile_sig_handler);
+		}
+
 	if ( ! run_state::reading_live && ! run_state::reading_traces )
 		// Set up network_time to track real-time, since
 		// we don't have any other source for it.
 		run_state::detail::update_network_time(util::current_time());
 
+	optimize_scripts();
+
 	if ( zeek_init )
 		event_mgr.Enqueue(zeek_init, Args{});
 
@@ -877,6 +984,9 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 	if ( options.ignore_checksums )
 		ignore_checksums = 1;
 
+	Reassembler::SetMemoryLimit(options.reassembly_memory_limit.value_or(
+		BifConst::reassembly_memory_limit));
+
 	if ( zeek_script_loaded )
 		{
 		// Queue events reporting loaded scripts.
@@ -902,6 +1012,7 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 	run_state::detail::zeek_init_done = true;
 	analyzer_mgr->DumpDebug();
 	packet_mgr->DumpDebug();
+	packet_mgr->SetupFastPath();
 
 	run_state::detail::have_pending_timers = ! run_state::reading_traces && timer_mgr->Size() > 0;
 